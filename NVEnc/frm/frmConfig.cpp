@@ -905,7 +905,7 @@ System::Void frmConfig::ConfToFrm(CONF_GUIEX *cnf) {
     NV_ENC_CODEC_CONFIG codecPrm[2] = { 0 };
     codecPrm[NV_ENC_H264] = DefaultParamH264();
     codecPrm[NV_ENC_HEVC] = DefaultParamHEVC();
-    parse_cmd(&encPrm, codecPrm, cnf->nvenc.cmd, err);
+    parse_cmd_cached(&encPrm, codecPrm, cnf->nvenc.cmd, err);
 
     SetCXIndex(fcgCXEncCodec,          get_index_from_value(encPrm.codec, list_nvenc_codecs));
     SetCXIndex(fcgCXEncMode,           get_cx_index(list_nvenc_rc_method, encPrm.encConfig.rcParams.rateControlMode));
@@ -45,8 +45,23 @@
 #include "NVEncParam.h"
 #include "NVEncUtil.h"
 #include "NVEncFilterAfs.h"
+#include "NVEncFilterNnedi.h"
 #include "NVEncCmd.h"
 #include "rgy_util.h"
+#include "convert_csp_bench.h"
+#include "rgy_bitstream.h"
+#include "rgy_queue_bench.h"
+#include "rgy_input_avcodec.h"
+#include "rgy_shared_mem.h"
+#include "rgy_log_async.h"
+#include "rgy_perf_trace.h"
+#include "rgy_metrics.h"
+#include "rgy_segment.h"
+#include "rgy_input_avindex.h"
+#include "rgy_ladder.h"
+#include "rgy_output_avcodec.h"
+#include "rgy_hdr10plus.h"
+#include "NVEncFilterCpu.h"
 
 #if ENABLE_CPP_REGEX
 #include <regex>
@@ -179,18 +194,66 @@ static tstring help() {
         _T("                                  if unset, will check DeviceId #0\n")
         _T("   --check-features [<int>]     check for NVEnc Features for specified DeviceId\n")
         _T("                                  if unset, will check DeviceId #0\n")
+        _T("   --check-features-cache <string>\n")
+        _T("                                check save/load/invalidation of features cache\n")
+        _T("                                  using features of --check-features output.\n")
         _T("   --check-environment          check for Environment Info\n")
+        _T("   --check-csp-bench [<int>]    benchmark color space conversions of input\n")
+        _T("                                  for 1 - <int> threads, and output as csv.\n")
+        _T("                                  if unset, will check up to physical cores.\n")
+        _T("   --check-nal-bench [<int>]    benchmark NAL unit parsing of output bitstream\n")
+        _T("                                  at <int> kbps (4K 60fps), and output as csv.\n")
+        _T("                                  if unset, will check at 50000 kbps.\n")
+        _T("   --check-queue-bench          benchmark queues used between threads,\n")
+        _T("                                  and output as csv.\n")
+        _T("   --check-sm-bench [<int>]     benchmark frame transfer through pipe and\n")
+        _T("                                  shared memory ring of <int> slots,\n")
+        _T("                                  and output as csv. (default: %d slots)\n")
+        _T("   --check-parse-bench          benchmark command line parsing, check round trip\n")
+        _T("                                  with generated command line, and output as csv.\n")
+        _T("   --check-trace-bench          benchmark recording of --perf-trace, check output,\n")
+        _T("                                  and output as csv.\n")
+        _T("   --check-metrics-bench        benchmark snapshot of --metrics, check response\n")
+        _T("                                  from local http server, and output as csv.\n")
+        _T("   --check-log-bench            benchmark logging in sync/async/binary mode,\n")
+        _T("                                  check decoded binary log, and output as csv.\n")
+        _T("   --check-segment-bench        benchmark segmented encode with pseudo encoder,\n")
+        _T("                                  check joined output, and output as csv.\n")
+        _T("   --check-index-bench          benchmark save/load of --input-index, check seek\n")
+        _T("                                  target for trim, and output as csv.\n")
+        _T("   --check-ladder-bench         benchmark --ladder frame distribution with\n")
+        _T("                                  pseudo encoders, and output as csv.\n")
+        _T("   --check-vpp-cpu-bench        benchmark cpu filter chain (crop/resize/unsharp/\n")
+        _T("                                  tweak/pad), check C/AVX2 outputs match,\n")
+        _T("                                  and output as csv.\n")
+        _T("   --check-afs-cpu-bench        benchmark cpu afs on telecined 1080i pattern,\n")
+        _T("                                  check C/AVX2 outputs match, and output as csv.\n")
+        _T("   --check-afs-cpu-gpu          compare cpu and gpu afs frame by frame on\n")
+        _T("                                  telecined 1080i pattern, and output as csv.\n")
+        _T("   --check-nnedi-cpu-bench      benchmark cpu nnedi on 1080i pattern,\n")
+        _T("                                  check C/AVX2 outputs match within tolerance,\n")
+        _T("                                  and output as csv.\n")
+        _T("   --check-nnedi-cpu-gpu        compare cpu and gpu nnedi frame by frame on\n")
+        _T("                                  1080i pattern, and output as csv.\n")
+        _T("   --check-hdr10plus            check HDR10+ SEI made from built-in json\n")
+        _T("                                  against reference json, and output as csv.\n")
 #if ENABLE_AVSW_READER
         _T("   --check-avversion            show dll version\n")
         _T("   --check-codecs               show codecs available\n")
         _T("   --check-encoders             show audio encoders available\n")
         _T("   --check-decoders             show audio decoders available\n")
         _T("   --check-profiles <string>    show profile names available for specified codec\n")
+        _T("   --check-avsw-bench <string>  benchmark sw decode of specified file\n")
+        _T("                                  with/without decode ahead, and output as csv.\n")
+        _T("   --check-audio-pool-bench     benchmark audio transcode of multiple tracks\n")
+        _T("                                  with/without frame pool, check output,\n")
+        _T("                                  and output as csv.\n")
         _T("   --check-formats              show in/out formats available\n")
         _T("   --check-protocols            show in/out protocols available\n")
         _T("   --check-filters              show filters available\n")
 #endif
-        _T("\n"));
+        _T("\n"),
+        RGY_SM_RING_SLOTS_DEFAULT);
     str += strsprintf(_T("\n")
         _T("Basic Encoding Options: \n")
         _T("-d,--device <int>               set DeviceId used in NVEnc (default:-1 as auto)\n")
@@ -212,6 +275,10 @@ static tstring help() {
         _T("   --vpy                        set input as vpy format\n")
         _T("   --vpy-mt                     set input as vpy(mt) format\n")
 #endif
+#if ENABLE_SM_READER
+        _T("   --sm                         read frames from shared memory ring\n")
+        _T("                                 created by frame server, -i <name>.\n")
+#endif
 #if ENABLE_AVSW_READER
         _T("   --avhw [<string>]           use libavformat + cuvid for input\n")
         _T("                                 this enables full hw transcode and resize.\n")
@@ -219,10 +286,21 @@ static tstring help() {
         _T("                                  - native (default)\n")
         _T("                                  - cuda\n")
         _T("   --avsw                       set input to use avcodec + sw decoder\n")
+        _T("   --avsw-decode-ahead <int>    frames to decode ahead in a separate thread\n")
+        _T("                                 when using avsw reader (default: %d, 0-%d)\n")
+        _T("                                  0 ... decode in the same thread as conversion.\n")
+        _T("   --avsw-threads <int>         threads of sw decoder (default: 0 = auto, 0-%d)\n")
+        _T("   --avsw-thread-type <string>  thread type of sw decoder (default: auto)\n")
+        _T("                                 auto, frame, slice, frame+slice\n")
         _T("   --input-analyze <int>       set time (sec) which reader analyze input file.\n")
         _T("                                 default: 5 (seconds).\n")
         _T("                                 could be only used with avhw/avsw reader.\n")
         _T("                                 use if reader fails to detect audio stream.\n")
+        _T("   --input-index [<string>]     save index of video packets and analysis of\n")
+        _T("                                 input file, and use it on next encode of the\n")
+        _T("                                 same file to skip analysis and seek to --trim.\n")
+        _T("                                 default: <input file>.rgyidx\n")
+        _T("                                 could be only used with avhw/avsw reader.\n")
         _T("   --video-track <int>          set video track to encode in track id\n")
         _T("                                 1 (default)  highest resolution video track\n")
         _T("                                 2            next high resolution video track\n")
@@ -333,6 +411,7 @@ static tstring help() {
         _T("                                set muxer option name and value.\n")
         _T("                                 these could be only used with\n")
         _T("                                 avhw/avsw reader and avcodec muxer.\n"),
+        RGY_AVSW_DECODE_AHEAD_DEFAULT, RGY_AVSW_DECODE_AHEAD_MAX, RGY_AVSW_THREADS_MAX,
         DEFAULT_IGNORE_DECODE_ERROR);
 #endif
     str += strsprintf(_T("")
@@ -675,7 +754,10 @@ static tstring help() {
         FILTER_DEFAULT_DELOGO_DEPTH);
     str += strsprintf(_T("")
         _T("   --vpp-perf-monitor           check duration of each filter.\n")
-        _T("                                  may decrease overall transcode performance.\n"));
+        _T("                                  may decrease overall transcode performance.\n")
+        _T("   --vpp-cpu                    run vpp filters on cpu before uploading to gpu.\n")
+        _T("                                  supports crop, resize, afs, nnedi, unsharp,\n")
+        _T("                                  tweak and pad, requires input decoded on cpu.\n"));
     str += strsprintf(_T("")
         _T("   --cuda-schedule <string>     set cuda schedule mode (default: sync).\n")
         _T("       auto  : let cuda driver to decide\n")
@@ -690,15 +772,52 @@ static tstring help() {
         _T("                                 default %d MB (0-%d)\n"),
         DEFAULT_OUTPUT_BUF, RGY_OUTPUT_BUF_MB_MAX
     );
+    str += strsprintf(_T("")
+        _T("   --input-read-mode <string>   set read mode for raw/y4m input (default: fread)\n")
+        _T("                                 fread  ... read into buffer, then convert.\n")
+        _T("                                 mmap   ... map file to memory, convert directly.\n")
+        _T("                                 direct ... bypass OS cache, read ahead in thread.\n")
+        _T("   --input-read-ahead <int>     frames to read ahead for mmap/direct (default: %d, 1-%d)\n"),
+        RGY_INPUT_READ_AHEAD_DEFAULT, RGY_INPUT_READ_AHEAD_MAX
+    );
     str += strsprintf(_T("")
         _T("   --max-procfps <int>         limit encoding speed for lower utilization.\n")
-        _T("                                 default:0 (no limit)\n"));
+        _T("                                 default:0 (no limit)\n")
+        _T("   --low-latency                minimize frames buffered from input to output,\n")
+        _T("                                 flush output per packet and log latency.\n"));
+#if ENABLE_AVSW_READER
+    str += strsprintf(_T("")
+        _T("   --segment <int>              split input at keyframes into <int> segments,\n")
+        _T("                                 encode them in parallel and join (max %d).\n")
+        _T("                                 available only with avhw/avsw reader.\n")
+        _T("   --segment-parallel <int>     segments to encode at the same time\n")
+        _T("                                 default:0 (auto)\n"),
+        RGY_SEGMENT_MAX);
+#endif //#if ENABLE_AVSW_READER
+    str += strsprintf(_T("")
+        _T("   --ladder <param1>=<value>[,<param2>=<value>][...]\n")
+        _T("                                additionally encode filtered frames with\n")
+        _T("                                 different resolution/bitrate (max %d).\n")
+        _T("                                 audio of the main output is copied.\n")
+        _T("    params\n")
+        _T("      res=<int>x<int>            output resolution (required)\n")
+        _T("      output=<string>            output file (required)\n")
+        _T("      bitrate=<int>              bitrate in kbps (default: same as main)\n")
+        _T("      max-bitrate=<int>          max bitrate in kbps (default: same as main)\n")
+        _T("   --ladder-queue <int>         frames to buffer for each --ladder output\n")
+        _T("                                 default:0 (auto = %d), max %d\n"),
+        RGY_LADDER_MAX_RUNGS, RGY_LADDER_QUEUE_DEFAULT, RGY_LADDER_QUEUE_MAX);
 #if ENABLE_AVCODEC_OUT_THREAD
     str += strsprintf(_T("")
         _T("   --output-thread <int>        set output thread num\n")
         _T("                                 -1: auto (= default)\n")
         _T("                                  0: disable (slow, but less memory usage)\n")
         _T("                                  1: use one thread\n")
+        _T("   --audio-track-thread <int>   process each audio track to be encoded in a separate thread,\n")
+        _T("                                 available only with output thread\n")
+        _T("                                  0: disable (= default)\n")
+        _T("                                 -1: use one thread for each track\n")
+        _T("                                  n: use up to n threads\n")
 #if 0
         _T("   --audio-thread <int>         set audio thread num, available only with output thread\n")
         _T("                                 -1: auto (= default)\n")
@@ -712,6 +831,9 @@ static tstring help() {
         _T("   --log <string>               set log file name\n")
         _T("   --log-level <string>         set log level\n")
         _T("                                  debug, info(default), warn, error\n")
+        _T("   --log-mode <string>          set log mode\n")
+        _T("                                  sync(default), async, binary\n")
+        _T("   --log-decode <string>        convert binary log to text and print\n")
         _T("   --log-framelist <string>     output frame info of avhw reader to path\n"));
 
     str += strsprintf(_T("\n")
@@ -731,6 +853,7 @@ static tstring help() {
         _T("                                 cpu_aud_proc ... cpu aud proc thread usage (%%)\n")
         _T("                                 cpu_aud_enc  ... cpu aud enc thread usage (%%)\n")
 #endif //#if defined(_WIN32) || defined(_WIN64)
+        _T("                                 cpu_pool     ... cpu thread pool usage (%%)\n")
         _T("                                 cpu          ... monitor all cpu info\n")
 #if defined(_WIN32) || defined(_WIN64)
         _T("                                 gpu_load    ... gpu usage (%%)\n")
@@ -750,6 +873,7 @@ static tstring help() {
         _T("                                 mem         ... monitor all memory info\n")
         _T("                                 io_read     ... io read  (MB/s)\n")
         _T("                                 io_write    ... io write (MB/s)\n")
+        _T("                                 io_input    ... input read (MB/s)\n")
         _T("                                 io          ... monitor all io info\n")
         _T("                                 fps         ... encode speed (fps)\n")
         _T("                                 fps_avg     ... encode avg. speed (fps)\n")
@@ -758,7 +882,13 @@ static tstring help() {
         _T("                                 frame_out   ... written_frames\n")
         _T("                                 \n")
         _T("   --perf-monitor-interval <int> set perf monitor check interval (millisec)\n")
-        _T("                                 default 500, must be 50 or more\n"));
+        _T("                                 default 500, must be 50 or more\n")
+        _T("   --perf-trace <string>        output timeline of each stage of the pipeline\n")
+        _T("                                 as Chrome trace event json to the file.\n")
+        _T("   --metrics [<addr>:]<int>     serve encode status in OpenMetrics format\n")
+        _T("                                 on http://<addr>:<int>/metrics.\n")
+        _T("                                 <addr> defaults to 127.0.0.1.\n")
+        _T("   --metrics unix:<string>      serve on unix domain socket (except Windows).\n"));
     return str;
 }
 
@@ -956,6 +1086,92 @@ int parse_print_options(const TCHAR *option_name, const TCHAR *arg1) {
         show_environment_info();
         return 1;
     }
+    if (IS_OPTION("check-csp-bench")) {
+        int threads = 0;
+        if (arg1 && arg1[0] != '-') {
+            int value = 0;
+            if (1 == _stscanf_s(arg1, _T("%d"), &value)) {
+                threads = value;
+            }
+        }
+        return (convert_csp_bench(stdout, threads) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-nal-bench")) {
+        int bitrate = 0;
+        if (arg1 && arg1[0] != '-') {
+            int value = 0;
+            if (1 == _stscanf_s(arg1, _T("%d"), &value)) {
+                bitrate = value;
+            }
+        }
+        return (parse_nal_unit_bench(stdout, bitrate) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-queue-bench")) {
+        return (queue_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-sm-bench")) {
+        int slots = 0;
+        if (arg1 && arg1[0] != '-') {
+            int value = 0;
+            if (1 == _stscanf_s(arg1, _T("%d"), &value)) {
+                slots = value;
+            }
+        }
+        return (shared_mem_bench(stdout, slots) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-parse-bench")) {
+        return (parse_cmd_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-trace-bench")) {
+        return (perf_trace_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-metrics-bench")) {
+        return (metrics_server_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-log-bench")) {
+        return (rgy_log_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-segment-bench")) {
+        return (segment_encode_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-index-bench")) {
+        return (avindex_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-ladder-bench")) {
+        return (ladder_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-vpp-cpu-bench")) {
+        return (vpp_cpu_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-afs-cpu-bench")) {
+        return (afs_cpu_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-afs-cpu-gpu")) {
+        return (afs_cpu_gpu_check(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-nnedi-cpu-bench")) {
+        return (nnedi_cpu_bench(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-nnedi-cpu-gpu")) {
+        return (nnedi_cpu_gpu_check(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-hdr10plus")) {
+        return (hdr10plus_check(stdout) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("log-decode")) {
+        if (arg1 == nullptr) {
+            _ftprintf(stderr, _T("--log-decode requires binary log file.\n"));
+            return -1;
+        }
+        return (rgy_log_decode(stdout, arg1) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-features-cache")) {
+        if (arg1 == nullptr) {
+            _ftprintf(stderr, _T("--check-features-cache requires output of --check-features.\n"));
+            return -1;
+        }
+        return (nvfeature_cache_check(stdout, arg1) == 0) ? 1 : -1;
+    }
     if (IS_OPTION("check-features")) {
         int deviceid = 0;
         if (arg1 && arg1[0] != '-') {
@@ -996,6 +1212,16 @@ int parse_print_options(const TCHAR *option_name, const TCHAR *arg1) {
         }
         return 1;
     }
+    if (IS_OPTION("check-avsw-bench")) {
+        if (arg1 == nullptr) {
+            _ftprintf(stderr, _T("--check-avsw-bench requires input filename.\n"));
+            return -1;
+        }
+        return (avsw_decode_bench(stdout, arg1) == 0) ? 1 : -1;
+    }
+    if (IS_OPTION("check-audio-pool-bench")) {
+        return (audio_pool_bench(stdout) == 0) ? 1 : -1;
+    }
     if (0 == _tcscmp(option_name, _T("check-protocols"))) {
         _ftprintf(stdout, _T("%s\n"), getAVProtocols().c_str());
         return 1;
@@ -1114,6 +1340,15 @@ int _tmain(int argc, TCHAR **argv) {
     int ret = 1;
 
     NVEncCore nvEnc;
+    if (encPrm.segmentCount > 1) {
+        //区間ごとに子プロセスでエンコードし、結合する
+        if (NV_ENC_SUCCESS == nvEnc.InitSegment(&encPrm, codecPrm)) {
+            nvEnc.SetAbortFlagPointer(&g_signal_abort);
+            set_signal_handler();
+            ret = (NV_ENC_SUCCESS == nvEnc.EncodeSegment()) ? 0 : 1;
+        }
+        return ret;
+    }
     if (   NV_ENC_SUCCESS == nvEnc.Initialize(&encPrm)
         && NV_ENC_SUCCESS == nvEnc.InitEncode(&encPrm)) {
         nvEnc.SetAbortFlagPointer(&g_signal_abort);
@@ -100,12 +100,8 @@ protected:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_pPrintMes->write_va(log_level, _T("cuvid: "), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
 
     CUresult CreateDecoder();
@@ -31,15 +31,21 @@
 #include <set>
 #include <sstream>
 #include <iomanip>
+#include <stdexcept>
+#include <mutex>
+#include <deque>
 #include <Windows.h>
 #include <shellapi.h>
 #include "rgy_version.h"
 #include "rgy_perf_monitor.h"
 #include "rgy_caption.h"
+#include "cpu_info.h"
 #include "NVEncParam.h"
 #include "NVEncCmd.h"
 #include "NVEncFilterAfs.h"
 #include "rgy_avutil.h"
+#include "rgy_segment.h"
+#include "rgy_ladder.h"
 
 tstring GetNVEncVersion() {
     static const TCHAR *const ENABLED_INFO[] = { _T("disabled"), _T("enabled") };
@@ -100,7 +106,146 @@ const TCHAR *cmd_short_opt_to_long(TCHAR short_opt) {
     return option_name;
 }
 
-#define IS_OPTION(x) (0 == _tcscmp(option_name, _T(x)))
+//parse_one_option()で扱うオプション名の一覧
+//オプションを追加する場合はここにも追加する (登録されていない名前をOPTION_ID()に渡すとコンパイルエラーとなる)
+static constexpr const TCHAR *OPTION_NAMES[] = {
+    _T("device"), _T("preset"), _T("input"), _T("output"), _T("fps"), _T("input-res"), _T("output-res"), _T("crop"),
+    _T("codec"), _T("raw"), _T("y4m"), _T("avi"), _T("avs"), _T("vpy"), _T("vpy-mt"), _T("avcuvid"), _T("avhw"),
+    _T("avsw"), _T("sm"), _T("avsw-decode-ahead"), _T("avsw-threads"), _T("avsw-thread-type"), _T("input-analyze"),
+    _T("avcuvid-analyze"), _T("input-index"), _T("no-input-index"), _T("video-track"), _T("video-streamid"),
+    _T("video-tag"), _T("trim"), _T("seek"), _T("audio-source"), _T("audio-file"), _T("format"), _T("output-format"),
+    _T("input-format"), _T("audio-copy"), _T("copy-audio"), _T("audio-codec"), _T("audio-profile"), _T("audio-bitrate"),
+    _T("audio-ignore-decode-error"), _T("audio-ignore-notrack-error"), _T("audio-samplerate"), _T("audio-resampler"),
+    _T("audio-stream"), _T("audio-filter"), _T("chapter-copy"), _T("copy-chapter"), _T("chapter"), _T("key-on-chapter"),
+    _T("keyfile"), _T("sub-copy"), _T("copy-sub"), _T("sub-codec"), _T("caption2ass"), _T("no-caption2ass"),
+    _T("data-copy"), _T("avsync"), _T("mux-option"), _T("cqp"), _T("vbr"), _T("vbrhq"), _T("vbr2"), _T("cbr"),
+    _T("cbrhq"), _T("vbr-quality"), _T("dynamic-rc"), _T("qp-init"), _T("qp-max"), _T("qp-min"), _T("gop-len"),
+    _T("strict-gop"), _T("bframes"), _T("bref-mode"), _T("max-bitrate"), _T("maxbitrate"), _T("lookahead"),
+    _T("no-i-adapt"), _T("no-b-adapt"), _T("vbv-bufsize"), _T("aq"), _T("aq-temporal"), _T("aq-strength"),
+    _T("disable-aq"), _T("no-aq"), _T("direct"), _T("adapt-transform"), _T("no-adapt-transform"), _T("ref"),
+    _T("weightp"), _T("nonrefp"), _T("mv-precision"), _T("vpp-deinterlace"), _T("vpp-resize"), _T("vpp-gauss"),
+    _T("vpp-unsharp"), _T("vpp-edgelevel"), _T("vpp-delogo-select"), _T("vpp-delogo-add"), _T("vpp-delogo-pos"),
+    _T("vpp-delogo-depth"), _T("vpp-delogo-y"), _T("vpp-delogo-cb"), _T("vpp-delogo-cr"), _T("vpp-delogo"),
+    _T("vpp-knn"), _T("vpp-pmd"), _T("vpp-deband"), _T("vpp-afs"), _T("vpp-nnedi"), _T("vpp-yadif"), _T("vpp-rff"),
+    _T("vpp-tweak"), _T("vpp-colorspace"), _T("vpp-subburn"), _T("vpp-pad"), _T("vpp-select-every"),
+    _T("vpp-perf-monitor"), _T("no-vpp-perf-monitor"), _T("vpp-cpu"), _T("no-vpp-cpu"), _T("tff"), _T("bff"), _T("interlace"), _T("interlaced"),
+    _T("cavlc"), _T("cabac"), _T("bluray"), _T("lossless"), _T("no-deblock"), _T("slices:h264"), _T("slices:hevc"),
+    _T("slices"), _T("deblock"), _T("aud:h264"), _T("aud:hevc"), _T("aud"), _T("pic-struct:h264"),
+    _T("pic-struct:hevc"), _T("pic-struct"), _T("fullrange:h264"), _T("fullrange:hevc"), _T("fullrange"),
+    _T("videoformat"), _T("videoformat:h264"), _T("videoformat:hevc"), _T("colormatrix"), _T("colormatrix:h264"),
+    _T("colormatrix:hevc"), _T("colorprim"), _T("colorprim:h264"), _T("colorprim:hevc"), _T("transfer"),
+    _T("transfer:h264"), _T("transfer:hevc"), _T("level"), _T("level:h264"), _T("level:hevc"), _T("profile"),
+    _T("profile:h264"), _T("profile:hevc"), _T("chromaloc"), _T("chromaloc:h264"), _T("chromaloc:hevc"), _T("tier"), _T("tier:hevc"),
+    _T("max-cll"), _T("master-display"), _T("dhdr10-info"), _T("output-depth"), _T("sar"), _T("par"), _T("dar"),
+    _T("cu-max"), _T("cu-min"), _T("cuda-schedule"), _T("gpu-select"), _T("max-procfps"), _T("low-latency"), _T("log"),
+    _T("log-level"), _T("log-mode"), _T("log-framelist"), _T("log-mux-ts"), _T("output-buf"), _T("input-thread"),
+    _T("thread-input"), _T("no-output-thread"), _T("output-thread"), _T("thread-output"), _T("audio-thread"),
+    _T("thread-audio"), _T("audio-track-thread"), _T("thread-audio-track"), _T("thread-csp"), _T("simd-csp"),
+    _T("input-read-mode"), _T("input-read-ahead"), _T("perf-monitor"), _T("perf-monitor-interval"), _T("perf-trace"),
+    _T("metrics"), _T("segment"), _T("segment-parallel"), _T("ladder"), _T("ladder-queue"), _T("session-retry"),
+};
+static constexpr int OPTION_COUNT = (int)array_size(OPTION_NAMES);
+
+//オプション名の完全ハッシュ表 (コンパイル時に作成する)
+//名前のハッシュからバケットを決め、バケットごとに決めた変位を加えたハッシュで格納位置を決める
+//要素の多いバケットから順に、すべての名前が空いている位置に入る変位を探す
+static constexpr int OPTION_HASH_BUCKET_BITS = 7;
+static constexpr int OPTION_HASH_BUCKETS = 1 << OPTION_HASH_BUCKET_BITS;
+static constexpr int OPTION_HASH_SLOTS = 512;
+static_assert(OPTION_COUNT < OPTION_HASH_SLOTS / 2 && OPTION_COUNT < 256, "too many options for OPTION_HASH_SLOTS.");
+
+struct OptionHashTable {
+    bool valid;
+    uint16_t displace[OPTION_HASH_BUCKETS]; //バケットごとの変位
+    uint8_t slot[OPTION_HASH_SLOTS];        //OPTION_NAMESの位置+1 (0なら空き)
+};
+
+static constexpr uint32_t option_hash_mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+static constexpr int option_hash_bucket(uint32_t hash) {
+    return (int)(option_hash_mix(hash) >> (32 - OPTION_HASH_BUCKET_BITS));
+}
+static constexpr int option_hash_slot(uint32_t hash, uint32_t displace) {
+    return (int)(option_hash_mix(hash ^ (displace * 0x9e3779b9u)) & (OPTION_HASH_SLOTS - 1));
+}
+
+static constexpr OptionHashTable make_option_hash_table() {
+    OptionHashTable table = {};
+    uint32_t hash[OPTION_COUNT] = {};
+    int bucketSize[OPTION_HASH_BUCKETS] = {};
+    int maxBucketSize = 0;
+    for (int i = 0; i < OPTION_COUNT; i++) {
+        hash[i] = rgy_str_hash(OPTION_NAMES[i]);
+        const int size = ++bucketSize[option_hash_bucket(hash[i])];
+        maxBucketSize = (size > maxBucketSize) ? size : maxBucketSize;
+    }
+    //バケットごとに名前の位置を並べる
+    int bucketStart[OPTION_HASH_BUCKETS + 1] = {};
+    for (int b = 0; b < OPTION_HASH_BUCKETS; b++) {
+        bucketStart[b + 1] = bucketStart[b] + bucketSize[b];
+    }
+    int bucketFill[OPTION_HASH_BUCKETS] = {};
+    int member[OPTION_COUNT] = {};
+    for (int i = 0; i < OPTION_COUNT; i++) {
+        const int b = option_hash_bucket(hash[i]);
+        member[bucketStart[b] + bucketFill[b]++] = i;
+    }
+    int memberSlot[OPTION_COUNT] = {};
+    table.valid = true;
+    for (int size = maxBucketSize; size > 0; size--) {
+        for (int b = 0; b < OPTION_HASH_BUCKETS; b++) {
+            if (bucketSize[b] != size) {
+                continue;
+            }
+            const int *bucketMember = &member[bucketStart[b]];
+            bool found = false;
+            for (uint32_t d = 0; d < 0x10000 && !found; d++) {
+                found = true;
+                for (int j = 0; j < size && found; j++) {
+                    const int s = option_hash_slot(hash[bucketMember[j]], d);
+                    found = table.slot[s] == 0;
+                    //同じバケットの中での衝突
+                    for (int k = 0; k < j && found; k++) {
+                        found = s != memberSlot[k];
+                    }
+                    memberSlot[j] = s;
+                }
+                if (found) {
+                    table.displace[b] = (uint16_t)d;
+                    for (int j = 0; j < size; j++) {
+                        table.slot[memberSlot[j]] = (uint8_t)(bucketMember[j] + 1);
+                    }
+                }
+            }
+            table.valid &= found;
+        }
+    }
+    return table;
+}
+static constexpr OptionHashTable OPTION_HASH_TABLE = make_option_hash_table();
+static_assert(OPTION_HASH_TABLE.valid, "failed to build perfect hash table of options.");
+
+static constexpr bool option_name_equal(const TCHAR *a, const TCHAR *b) {
+    return (*a == *b) && (*a == _T('\0') || option_name_equal(a + 1, b + 1));
+}
+//オプション名からOPTION_NAMESの位置を求める (見つからなければ-1)
+static constexpr int get_option_id(const TCHAR *option_name) {
+    const uint32_t hash = rgy_str_hash(option_name);
+    const int idx = OPTION_HASH_TABLE.slot[option_hash_slot(hash, OPTION_HASH_TABLE.displace[option_hash_bucket(hash)])] - 1;
+    return (idx >= 0 && option_name_equal(OPTION_NAMES[idx], option_name)) ? idx : -1;
+}
+static constexpr int option_id_registered(const TCHAR *option_name) {
+    return (get_option_id(option_name) >= 0) ? get_option_id(option_name) : throw std::invalid_argument("option not registered in OPTION_NAMES.");
+}
+//コンパイル時にオプション名をidに変換する
+#define OPTION_ID(x) (std::integral_constant<int, option_id_registered(_T(x))>::value)
+#define IS_OPTION(x) (option_id == OPTION_ID(x))
 
 static int getAudioTrackIdx(const InEncodeVideoParam* pParams, int iTrack) {
     for (int i = 0; i < pParams->nAudioSelectCount; i++) {
@@ -197,8 +342,116 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
     err.strErrorMessage = (errmes) ? errmes : _T(""); \
     err.strOptionName = (opt_name) ? opt_name : _T(""); \
     err.strErrorValue = (err_val) ? err_val : _T("");
+    const int option_id = get_option_id(option_name);
+
+#if ENABLE_AVSW_READER
+    auto set_audio_prm = [&](std::function<void(AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr)> func_set) {
+        const TCHAR *ptr = nullptr;
+        const TCHAR *ptrDelim = nullptr;
+        int trackId = 0;
+        if (i+1 < nArgNum) {
+            if (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0')) {
+                i++;
+                ptrDelim = _tcschr(strInput[i], _T('?'));
+                ptr = (ptrDelim == nullptr) ? strInput[i] : ptrDelim+1;
+            }
+            if (ptrDelim != nullptr) {
+                tstring temp = tstring(strInput[i]).substr(0, ptrDelim - strInput[i]);
+                trackId = std::stoi(temp);
+            }
+        }
+        AudioSelect *pAudioSelect = nullptr;
+        int audioIdx = getAudioTrackIdx(pParams, trackId);
+        if (audioIdx < 0) {
+            pAudioSelect = new AudioSelect();
+            if (trackId != 0) {
+                //もし、trackID=0以外の指定であれば、
+                //これまでalltrackに指定されたパラメータを探して引き継ぐ
+                AudioSelect *pAudioSelectAll = nullptr;
+                for (int itrack = 0; itrack < pParams->nAudioSelectCount; itrack++) {
+                    if (pParams->ppAudioSelectList[itrack]->trackID == 0) {
+                        pAudioSelectAll = pParams->ppAudioSelectList[itrack];
+                    }
+                }
+                if (pAudioSelectAll) {
+                    *pAudioSelect = *pAudioSelectAll;
+                }
+            }
+            pAudioSelect->trackID = trackId;
+        } else {
+            pAudioSelect = pParams->ppAudioSelectList[audioIdx];
+        }
+        func_set(pAudioSelect, trackId, ptr);
+        if (trackId == 0) {
+            for (int itrack = 0; itrack < pParams->nAudioSelectCount; itrack++) {
+                func_set(pParams->ppAudioSelectList[itrack], trackId, ptr);
+            }
+        }
 
-    if (IS_OPTION("device")) {
+        if (audioIdx < 0) {
+            audioIdx = pParams->nAudioSelectCount;
+            //新たに要素を追加
+            pParams->ppAudioSelectList = (AudioSelect **)realloc(pParams->ppAudioSelectList, sizeof(pParams->ppAudioSelectList[0]) * (pParams->nAudioSelectCount + 1));
+            pParams->ppAudioSelectList[pParams->nAudioSelectCount] = pAudioSelect;
+            pParams->nAudioSelectCount++;
+        }
+        return 0;
+    };
+    auto set_sub_prm = [&](std::function<void(SubtitleSelect *pSubSelect, int trackId, const TCHAR *prmstr)> func_set) {
+        const TCHAR *ptr = nullptr;
+        const TCHAR *ptrDelim = nullptr;
+        int trackId = 0;
+        if (i+1 < nArgNum) {
+            if (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0')) {
+                i++;
+                ptrDelim = _tcschr(strInput[i], _T('?'));
+                ptr = (ptrDelim == nullptr) ? strInput[i] : ptrDelim+1;
+            }
+            if (ptrDelim != nullptr) {
+                tstring temp = tstring(strInput[i]).substr(0, ptrDelim - strInput[i]);
+                trackId = std::stoi(temp);
+            }
+        }
+        SubtitleSelect *pSubSelect = nullptr;
+        int subIdx = getSubTrackIdx(pParams, trackId);
+        if (subIdx < 0) {
+            pSubSelect = new SubtitleSelect();
+            if (trackId != 0) {
+                //もし、trackID=0以外の指定であれば、
+                //これまでalltrackに指定されたパラメータを探して引き継ぐ
+                SubtitleSelect *pSubSelectAll = nullptr;
+                for (int itrack = 0; itrack < pParams->nSubtitleSelectCount; itrack++) {
+                    if (pParams->ppSubtitleSelectList[itrack]->trackID == 0) {
+                        pSubSelectAll = pParams->ppSubtitleSelectList[itrack];
+                    }
+                }
+                if (pSubSelectAll) {
+                    *pSubSelect = *pSubSelectAll;
+                }
+            }
+            pSubSelect->trackID = trackId;
+        } else {
+            pSubSelect = pParams->ppSubtitleSelectList[subIdx];
+        }
+        func_set(pSubSelect, trackId, ptr);
+        if (trackId == 0) {
+            for (int itrack = 0; itrack < pParams->nSubtitleSelectCount; itrack++) {
+                func_set(pParams->ppSubtitleSelectList[itrack], trackId, ptr);
+            }
+        }
+
+        if (subIdx < 0) {
+            subIdx = pParams->nSubtitleSelectCount;
+            //新たに要素を追加
+            pParams->ppSubtitleSelectList = (SubtitleSelect **)realloc(pParams->ppSubtitleSelectList, sizeof(pParams->ppSubtitleSelectList[0]) * (pParams->nSubtitleSelectCount + 1));
+            pParams->ppSubtitleSelectList[pParams->nSubtitleSelectCount] = pSubSelect;
+            pParams->nSubtitleSelectCount++;
+        }
+        return 0;
+    };
+#endif //#if ENABLE_AVSW_READER
+    switch (option_id) {
+    case OPTION_ID("device"): {
         int deviceid = -1;
         if (i + 1 < nArgNum) {
             i++;
@@ -214,7 +467,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->deviceID = deviceid;
         return 0;
     }
-    if (IS_OPTION("preset")) {
+    case OPTION_ID("preset"): {
         i++;
         int value = get_value_from_name(strInput[i], list_nvenc_preset_names);
         if (value >= 0) {
@@ -225,17 +478,17 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("input")) {
+    case OPTION_ID("input"): {
         i++;
         pParams->inputFilename = strInput[i];
         return 0;
     }
-    if (IS_OPTION("output")) {
+    case OPTION_ID("output"): {
         i++;
         pParams->outputFilename = strInput[i];
         return 0;
     }
-    if (IS_OPTION("fps")) {
+    case OPTION_ID("fps"): {
         i++;
         int a[2] = { 0 };
         if (   2 == _stscanf_s(strInput[i], _T("%d/%d"), &a[0], &a[1])
@@ -262,7 +515,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("input-res")) {
+    case OPTION_ID("input-res"): {
         i++;
         int a[2] = { 0 };
         if (   2 == _stscanf_s(strInput[i], _T("%dx%d"), &a[0], &a[1])
@@ -276,7 +529,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("output-res")) {
+    case OPTION_ID("output-res"): {
         i++;
         int a[2] = { 0 };
         if (   2 == _stscanf_s(strInput[i], _T("%dx%d"), &a[0], &a[1])
@@ -290,7 +543,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("crop")) {
+    case OPTION_ID("crop"): {
         i++;
         sInputCrop a = { 0 };
         if (   4 == _stscanf_s(strInput[i], _T("%d,%d,%d,%d"), &a.c[0], &a.c[1], &a.c[2], &a.c[3])
@@ -302,7 +555,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("codec")) {
+    case OPTION_ID("codec"): {
         i++;
         int value = 0;
         if (get_list_value(list_nvenc_codecs_for_opt, strInput[i], &value)) {
@@ -313,39 +566,39 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("raw")) {
+    case OPTION_ID("raw"): {
         pParams->input.type = RGY_INPUT_FMT_RAW;
         return 0;
     }
-    if (IS_OPTION("y4m")) {
+    case OPTION_ID("y4m"): {
         pParams->input.type = RGY_INPUT_FMT_Y4M;
 #if ENABLE_AVI_READER
         return 0;
     }
-    if (IS_OPTION("avi")) {
+    case OPTION_ID("avi"): {
         pParams->input.type = RGY_INPUT_FMT_AVI;
 #endif
 #if ENABLE_AVISYNTH_READER
         return 0;
     }
-    if (IS_OPTION("avs")) {
+    case OPTION_ID("avs"): {
         pParams->input.type = RGY_INPUT_FMT_AVS;
 #endif
 #if ENABLE_VAPOURSYNTH_READER
         return 0;
     }
-    if (IS_OPTION("vpy")) {
+    case OPTION_ID("vpy"): {
         pParams->input.type = RGY_INPUT_FMT_VPY;
         return 0;
     }
-    if (IS_OPTION("vpy-mt")) {
+    case OPTION_ID("vpy-mt"): {
         pParams->input.type = RGY_INPUT_FMT_VPY_MT;
 #endif
 #if ENABLE_AVSW_READER
         return 0;
     }
-    if (IS_OPTION("avcuvid")
-        || IS_OPTION("avhw")) {
+    case OPTION_ID("avcuvid"):
+    case OPTION_ID("avhw"): {
         pParams->input.type = RGY_INPUT_FMT_AVHW;
         if (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0')) {
             i++;
@@ -360,12 +613,55 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
 #endif
         return 0;
     }
-    if (IS_OPTION("avsw")) {
+    case OPTION_ID("avsw"): {
         pParams->input.type = RGY_INPUT_FMT_AVSW;
         return 0;
     }
-    if (   IS_OPTION("input-analyze")
-        || IS_OPTION("avcuvid-analyze")) {
+    case OPTION_ID("sm"): {
+        pParams->input.type = RGY_INPUT_FMT_SM;
+        return 0;
+    }
+    case OPTION_ID("avsw-decode-ahead"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || value > RGY_AVSW_DECODE_AHEAD_MAX) {
+            SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->avswDecodeAhead = value;
+        return 0;
+    }
+    case OPTION_ID("avsw-threads"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || value > RGY_AVSW_THREADS_MAX) {
+            SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->avswThreads = value;
+        return 0;
+    }
+    case OPTION_ID("avsw-thread-type"): {
+        i++;
+        int value = 0;
+        if (get_list_value(list_avsw_thread_type, strInput[i], &value)) {
+            pParams->avswThreadType = value;
+        } else {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        return 0;
+    }
+    case OPTION_ID("input-analyze"):
+    case OPTION_ID("avcuvid-analyze"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -379,7 +675,20 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("video-track")) {
+    case OPTION_ID("input-index"): {
+        pParams->inputIndex = true;
+        pParams->inputIndexFile.clear();
+        if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
+            i++;
+            pParams->inputIndexFile = strInput[i];
+        }
+        return 0;
+    }
+    case OPTION_ID("no-input-index"): {
+        pParams->inputIndex = false;
+        return 0;
+    }
+    case OPTION_ID("video-track"): {
         i++;
         int v = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &v)) {
@@ -393,7 +702,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nVideoTrack = v;
         return 0;
     }
-    if (IS_OPTION("video-streamid")) {
+    case OPTION_ID("video-streamid"): {
         i++;
         int v = 0;
         if (1 != _stscanf_s(strInput[i], _T("%i"), &v)) {
@@ -403,12 +712,12 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nVideoStreamId = v;
         return 0;
     }
-    if (IS_OPTION("video-tag")) {
+    case OPTION_ID("video-tag"): {
         i++;
         pParams->videoCodecTag = tchar_to_string(strInput[i]);
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("trim"))) {
+    case OPTION_ID("trim"): {
         i++;
         auto trim_str_list = split(strInput[i], _T(","));
         std::vector<sTrim> trim_list;
@@ -439,7 +748,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("seek"))) {
+    case OPTION_ID("seek"): {
         i++;
         int ret = 0;
         int hh = 0, mm = 0;
@@ -472,7 +781,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->fSeekSec = sec + mm * 60;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-source"))) {
+    case OPTION_ID("audio-source"): {
         i++;
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_AUDIO);
         size_t audioSourceLen = _tcslen(strInput[i]) + 1;
@@ -483,7 +792,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nAudioSourceCount++;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-file"))) {
+    case OPTION_ID("audio-file"): {
         i++;
         const TCHAR *ptr = strInput[i];
         AudioSelect *pAudioSelect = nullptr;
@@ -546,8 +855,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         argData->nParsedAudioFile++;
         return 0;
     }
-    if (   0 == _tcscmp(option_name, _T("format"))
-        || 0 == _tcscmp(option_name, _T("output-format"))) {
+    case OPTION_ID("format"):
+    case OPTION_ID("output-format"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             pParams->sAVMuxOutputFormat = strInput[i];
@@ -557,7 +866,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("input-format"))) {
+    case OPTION_ID("input-format"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             pParams->pAVInputFormat = _tcsdup(strInput[i]);
@@ -568,112 +877,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 #if ENABLE_AVSW_READER
-    auto set_audio_prm = [&](std::function<void(AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr)> func_set) {
-        const TCHAR *ptr = nullptr;
-        const TCHAR *ptrDelim = nullptr;
-        int trackId = 0;
-        if (i+1 < nArgNum) {
-            if (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0')) {
-                i++;
-                ptrDelim = _tcschr(strInput[i], _T('?'));
-                ptr = (ptrDelim == nullptr) ? strInput[i] : ptrDelim+1;
-            }
-            if (ptrDelim != nullptr) {
-                tstring temp = tstring(strInput[i]).substr(0, ptrDelim - strInput[i]);
-                trackId = std::stoi(temp);
-            }
-        }
-        AudioSelect *pAudioSelect = nullptr;
-        int audioIdx = getAudioTrackIdx(pParams, trackId);
-        if (audioIdx < 0) {
-            pAudioSelect = new AudioSelect();
-            if (trackId != 0) {
-                //もし、trackID=0以外の指定であれば、
-                //これまでalltrackに指定されたパラメータを探して引き継ぐ
-                AudioSelect *pAudioSelectAll = nullptr;
-                for (int itrack = 0; itrack < pParams->nAudioSelectCount; itrack++) {
-                    if (pParams->ppAudioSelectList[itrack]->trackID == 0) {
-                        pAudioSelectAll = pParams->ppAudioSelectList[itrack];
-                    }
-                }
-                if (pAudioSelectAll) {
-                    *pAudioSelect = *pAudioSelectAll;
-                }
-            }
-            pAudioSelect->trackID = trackId;
-        } else {
-            pAudioSelect = pParams->ppAudioSelectList[audioIdx];
-        }
-        func_set(pAudioSelect, trackId, ptr);
-        if (trackId == 0) {
-            for (int itrack = 0; itrack < pParams->nAudioSelectCount; itrack++) {
-                func_set(pParams->ppAudioSelectList[itrack], trackId, ptr);
-            }
-        }
-
-        if (audioIdx < 0) {
-            audioIdx = pParams->nAudioSelectCount;
-            //新たに要素を追加
-            pParams->ppAudioSelectList = (AudioSelect **)realloc(pParams->ppAudioSelectList, sizeof(pParams->ppAudioSelectList[0]) * (pParams->nAudioSelectCount + 1));
-            pParams->ppAudioSelectList[pParams->nAudioSelectCount] = pAudioSelect;
-            pParams->nAudioSelectCount++;
-        }
-        return 0;
-    };
-    auto set_sub_prm = [&](std::function<void(SubtitleSelect *pSubSelect, int trackId, const TCHAR *prmstr)> func_set) {
-        const TCHAR *ptr = nullptr;
-        const TCHAR *ptrDelim = nullptr;
-        int trackId = 0;
-        if (i+1 < nArgNum) {
-            if (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0')) {
-                i++;
-                ptrDelim = _tcschr(strInput[i], _T('?'));
-                ptr = (ptrDelim == nullptr) ? strInput[i] : ptrDelim+1;
-            }
-            if (ptrDelim != nullptr) {
-                tstring temp = tstring(strInput[i]).substr(0, ptrDelim - strInput[i]);
-                trackId = std::stoi(temp);
-            }
-        }
-        SubtitleSelect *pSubSelect = nullptr;
-        int subIdx = getSubTrackIdx(pParams, trackId);
-        if (subIdx < 0) {
-            pSubSelect = new SubtitleSelect();
-            if (trackId != 0) {
-                //もし、trackID=0以外の指定であれば、
-                //これまでalltrackに指定されたパラメータを探して引き継ぐ
-                SubtitleSelect *pSubSelectAll = nullptr;
-                for (int itrack = 0; itrack < pParams->nSubtitleSelectCount; itrack++) {
-                    if (pParams->ppSubtitleSelectList[itrack]->trackID == 0) {
-                        pSubSelectAll = pParams->ppSubtitleSelectList[itrack];
-                    }
-                }
-                if (pSubSelectAll) {
-                    *pSubSelect = *pSubSelectAll;
-                }
-            }
-            pSubSelect->trackID = trackId;
-        } else {
-            pSubSelect = pParams->ppSubtitleSelectList[subIdx];
-        }
-        func_set(pSubSelect, trackId, ptr);
-        if (trackId == 0) {
-            for (int itrack = 0; itrack < pParams->nSubtitleSelectCount; itrack++) {
-                func_set(pParams->ppSubtitleSelectList[itrack], trackId, ptr);
-            }
-        }
-
-        if (subIdx < 0) {
-            subIdx = pParams->nSubtitleSelectCount;
-            //新たに要素を追加
-            pParams->ppSubtitleSelectList = (SubtitleSelect **)realloc(pParams->ppSubtitleSelectList, sizeof(pParams->ppSubtitleSelectList[0]) * (pParams->nSubtitleSelectCount + 1));
-            pParams->ppSubtitleSelectList[pParams->nSubtitleSelectCount] = pSubSelect;
-            pParams->nSubtitleSelectCount++;
-        }
-        return 0;
-    };
-    if (0 == _tcscmp(option_name, _T("audio-copy"))
-        || 0 == _tcscmp(option_name, _T("copy-audio"))) {
+    case OPTION_ID("audio-copy"):
+    case OPTION_ID("copy-audio"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_AUDIO);
         std::set<int> trackSet; //重複しないよう、setを使う
         if (i+1 < nArgNum && (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0'))) {
@@ -715,7 +920,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-codec"))) {
+    case OPTION_ID("audio-codec"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_AUDIO);
         auto ret = set_audio_prm([](AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr) {
             if (trackId != 0 || pAudioSelect->encCodec.length() == 0) {
@@ -741,7 +946,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-profile"))) {
+    case OPTION_ID("audio-profile"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_AUDIO);
         auto ret = set_audio_prm([](AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr) {
             if (trackId != 0 || pAudioSelect->encCodecProfile.length() == 0) {
@@ -754,7 +959,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-bitrate"))) {
+    case OPTION_ID("audio-bitrate"): {
         try {
             auto ret = set_audio_prm([](AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr) {
                 if (trackId != 0 || pAudioSelect->encBitrate == 0) {
@@ -767,7 +972,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
             return 1;
         }
     }
-    if (0 == _tcscmp(option_name, _T("audio-ignore-decode-error"))) {
+    case OPTION_ID("audio-ignore-decode-error"): {
         i++;
         uint32_t value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -778,10 +983,10 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
     //互換性のため残す
-    if (0 == _tcscmp(option_name, _T("audio-ignore-notrack-error"))) {
+    case OPTION_ID("audio-ignore-notrack-error"): {
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-samplerate"))) {
+    case OPTION_ID("audio-samplerate"): {
         try {
             auto ret = set_audio_prm([](AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr) {
                 if (trackId != 0 || pAudioSelect->encSamplingRate == 0) {
@@ -794,7 +999,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
             return 1;
         }
     }
-    if (0 == _tcscmp(option_name, _T("audio-resampler"))) {
+    case OPTION_ID("audio-resampler"): {
         i++;
         int v = 0;
         if (PARSE_ERROR_FLAG != (v = get_value_from_chr(list_resampler, strInput[i]))) {
@@ -807,7 +1012,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-stream"))) {
+    case OPTION_ID("audio-stream"): {
         //ここで、av_get_channel_layout()を使うため、チェックする必要がある
         if (!check_avcodec_dll()) {
             _ftprintf(stderr, _T("%s\n--audio-stream could not be used.\n"), error_mes_avcodec_dll_not_found().c_str());
@@ -850,7 +1055,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
             return 1;
         }
     }
-    if (0 == _tcscmp(option_name, _T("audio-filter"))) {
+    case OPTION_ID("audio-filter"): {
         try {
             auto ret = set_audio_prm([](AudioSelect *pAudioSelect, int trackId, const TCHAR *prmstr) {
                 if (trackId != 0 || pAudioSelect->filter.length() == 0) {
@@ -864,12 +1069,12 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
     }
 #endif //#if ENABLE_AVCODEC_QSV_READER
-    if (   0 == _tcscmp(option_name, _T("chapter-copy"))
-        || 0 == _tcscmp(option_name, _T("copy-chapter"))) {
+    case OPTION_ID("chapter-copy"):
+    case OPTION_ID("copy-chapter"): {
         pParams->bCopyChapter = TRUE;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("chapter"))) {
+    case OPTION_ID("chapter"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             pParams->sChapterFile = strInput[i];
@@ -879,11 +1084,11 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("key-on-chapter")) {
+    case OPTION_ID("key-on-chapter"): {
         pParams->keyOnChapter = true;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("keyfile"))) {
+    case OPTION_ID("keyfile"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             pParams->keyFile = strInput[i];
@@ -894,8 +1099,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 #if ENABLE_AVSW_READER
-    if (   0 == _tcscmp(option_name, _T("sub-copy"))
-        || 0 == _tcscmp(option_name, _T("copy-sub"))) {
+    case OPTION_ID("sub-copy"):
+    case OPTION_ID("copy-sub"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_SUBTITLE);
         std::map<int, SubtitleSelect> trackSet; //重複しないように
         if (i+1 < nArgNum && (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0'))) {
@@ -947,7 +1152,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("sub-codec"))) {
+    case OPTION_ID("sub-codec"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_AUDIO);
         auto ret = set_sub_prm([](SubtitleSelect *pSubSelect, int trackId, const TCHAR *prmstr) {
             if (trackId != 0 || pSubSelect->encCodec.length() == 0) {
@@ -973,7 +1178,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("caption2ass"))) {
+    case OPTION_ID("caption2ass"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             C2AFormat format = FORMAT_INVALID;
@@ -988,11 +1193,11 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("no-caption2ass"))) {
+    case OPTION_ID("no-caption2ass"): {
         pParams->caption2ass = FORMAT_INVALID;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("data-copy"))) {
+    case OPTION_ID("data-copy"): {
         pParams->nAVMux |= (RGY_MUX_VIDEO | RGY_MUX_SUBTITLE);
         std::map<int, DataSelect> trackSet; //重複しないように
         if (i+1 < nArgNum && (strInput[i+1][0] != _T('-') && strInput[i+1][0] != _T('\0'))) {
@@ -1033,7 +1238,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 #endif //#if ENABLE_AVSW_READER
-    if (0 == _tcscmp(option_name, _T("avsync"))) {
+    case OPTION_ID("avsync"): {
         int value = 0;
         i++;
         if (PARSE_ERROR_FLAG != (value = get_value_from_chr(list_avsync, strInput[i]))) {
@@ -1044,7 +1249,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("mux-option"))) {
+    case OPTION_ID("mux-option"): {
         if (i+1 < nArgNum && strInput[i+1][0] != _T('-')) {
             i++;
             auto ptr = _tcschr(strInput[i], ':');
@@ -1063,7 +1268,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cqp")) {
+    case OPTION_ID("cqp"): {
         i++;
         int a[3] = { 0 };
         int ret = parse_qp(a, strInput[i]);
@@ -1077,7 +1282,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->encConfig.rcParams.constQP.qpInterB = (ret > 2) ? a[2] : a[ret-1];
         return 0;
     }
-    if (IS_OPTION("vbr")) {
+    case OPTION_ID("vbr"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1089,7 +1294,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vbrhq") || IS_OPTION("vbr2")) {
+    case OPTION_ID("vbrhq"):
+    case OPTION_ID("vbr2"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1101,7 +1307,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cbr")) {
+    case OPTION_ID("cbr"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1114,7 +1320,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cbrhq")) {
+    case OPTION_ID("cbrhq"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1127,7 +1333,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vbr-quality")) {
+    case OPTION_ID("vbr-quality"): {
         i++;
         double value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%lf"), &value)) {
@@ -1141,7 +1347,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("dynamic-rc")) {
+    case OPTION_ID("dynamic-rc"): {
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
         }
@@ -1254,7 +1460,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->dynamicRC.push_back(rcPrm);
         return 0;
     }
-    if (IS_OPTION("qp-init") || IS_OPTION("qp-max") || IS_OPTION("qp-min")) {
+    case OPTION_ID("qp-init"):
+    case OPTION_ID("qp-max"):
+    case OPTION_ID("qp-min"): {
         i++;
         int a[4] = { 0 };
         if (   4 == _stscanf_s(strInput[i], _T("%d;%d:%d:%d"), &a[3], &a[0], &a[1], &a[2])
@@ -1313,7 +1521,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         ptrQP->qpInterB = a[2];
         return 0;
     }
-    if (IS_OPTION("gop-len")) {
+    case OPTION_ID("gop-len"): {
         i++;
         int value = 0;
         if (0 == _tcsnccmp(strInput[i], _T("auto"), _tcslen(_T("auto")))) {
@@ -1326,11 +1534,11 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("strict-gop")) {
+    case OPTION_ID("strict-gop"): {
         pParams->encConfig.rcParams.strictGOPTarget = 1;
         return 0;
     }
-    if (IS_OPTION("bframes")) {
+    case OPTION_ID("bframes"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1341,7 +1549,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("bref-mode")) {
+    case OPTION_ID("bref-mode"): {
         i++;
         int value = 0;
         if (get_list_value(list_bref_mode, strInput[i], &value)) {
@@ -1353,7 +1561,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("max-bitrate") || IS_OPTION("maxbitrate")) {
+    case OPTION_ID("max-bitrate"):
+    case OPTION_ID("maxbitrate"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1364,7 +1573,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("lookahead")) {
+    case OPTION_ID("lookahead"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1376,15 +1585,15 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("no-i-adapt")) {
+    case OPTION_ID("no-i-adapt"): {
         pParams->encConfig.rcParams.disableIadapt = 1;
         return 0;
     }
-    if (IS_OPTION("no-b-adapt")) {
+    case OPTION_ID("no-b-adapt"): {
         pParams->encConfig.rcParams.disableBadapt = 1;
         return 0;
     }
-    if (IS_OPTION("vbv-bufsize")) {
+    case OPTION_ID("vbv-bufsize"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1395,15 +1604,15 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("aq")) {
+    case OPTION_ID("aq"): {
         pParams->encConfig.rcParams.enableAQ = 1;
         return 0;
     }
-    if (IS_OPTION("aq-temporal")) {
+    case OPTION_ID("aq-temporal"): {
         pParams->encConfig.rcParams.enableTemporalAQ = 1;
         return 0;
     }
-    if (IS_OPTION("aq-strength")) {
+    case OPTION_ID("aq-strength"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1414,12 +1623,12 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("disable-aq")
-        || IS_OPTION("no-aq")) {
+    case OPTION_ID("disable-aq"):
+    case OPTION_ID("no-aq"): {
         pParams->encConfig.rcParams.enableAQ = 0;
         return 0;
     }
-    if (IS_OPTION("direct")) {
+    case OPTION_ID("direct"): {
         i++;
         int value = 0;
         if (get_list_value(list_bdirect, strInput[i], &value)) {
@@ -1430,15 +1639,15 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("adapt-transform")) {
+    case OPTION_ID("adapt-transform"): {
         codecPrm[NV_ENC_H264].h264Config.adaptiveTransformMode = NV_ENC_H264_ADAPTIVE_TRANSFORM_ENABLE;
         return 0;
     }
-    if (IS_OPTION("no-adapt-transform")) {
+    case OPTION_ID("no-adapt-transform"): {
         codecPrm[NV_ENC_H264].h264Config.adaptiveTransformMode = NV_ENC_H264_ADAPTIVE_TRANSFORM_DISABLE;
         return 0;
     }
-    if (IS_OPTION("ref")) {
+    case OPTION_ID("ref"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1450,7 +1659,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("weightp")) {
+    case OPTION_ID("weightp"): {
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             pParams->nWeightP = 1;
             return 0;
@@ -1461,11 +1670,11 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("nonrefp")) {
+    case OPTION_ID("nonrefp"): {
         pParams->encConfig.rcParams.enableNonRefP = 1;
         return 0;
     }
-    if (IS_OPTION("mv-precision")) {
+    case OPTION_ID("mv-precision"): {
         i++;
         int value = 0;
         if (get_list_value(list_mv_presicion, strInput[i], &value)) {
@@ -1476,7 +1685,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-deinterlace")) {
+    case OPTION_ID("vpp-deinterlace"): {
         i++;
         int value = 0;
         if (get_list_value(list_deinterlace, strInput[i], &value)) {
@@ -1491,7 +1700,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-resize")) {
+    case OPTION_ID("vpp-resize"): {
         i++;
         int value = 0;
         if (get_list_value(list_nppi_resize, strInput[i], &value)) {
@@ -1502,7 +1711,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-gauss")) {
+    case OPTION_ID("vpp-gauss"): {
         i++;
         int value = 0;
         if (get_list_value(list_nppi_gauss, strInput[i], &value)) {
@@ -1513,7 +1722,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-unsharp")) {
+    case OPTION_ID("vpp-unsharp"): {
         pParams->vpp.unsharp.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             pParams->vpp.unsharp.radius = FILTER_DEFAULT_UNSHARP_RADIUS;
@@ -1569,7 +1778,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-edgelevel")) {
+    case OPTION_ID("vpp-edgelevel"): {
         pParams->vpp.edgelevel.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -1634,16 +1843,16 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-select")) {
+    case OPTION_ID("vpp-delogo-select"): {
         i++;
         pParams->vpp.delogo.logoSelect = strInput[i];
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-add")) {
+    case OPTION_ID("vpp-delogo-add"): {
         pParams->vpp.delogo.mode = DELOGO_MODE_ADD;
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-pos")) {
+    case OPTION_ID("vpp-delogo-pos"): {
         i++;
         int posOffsetX, posOffsetY;
         if (   2 != _stscanf_s(strInput[i], _T("%dx%d"), &posOffsetX, &posOffsetY)
@@ -1657,7 +1866,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->vpp.delogo.posY = posOffsetY;
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-depth")) {
+    case OPTION_ID("vpp-delogo-depth"): {
         i++;
         int depth;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &depth)) {
@@ -1667,7 +1876,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->vpp.delogo.depth = depth;
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-y")) {
+    case OPTION_ID("vpp-delogo-y"): {
         i++;
         int value;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1677,7 +1886,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->vpp.delogo.Y = value;
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-cb")) {
+    case OPTION_ID("vpp-delogo-cb"): {
         i++;
         int value;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1687,7 +1896,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->vpp.delogo.Cb = value;
         return 0;
     }
-    if (IS_OPTION("vpp-delogo-cr")) {
+    case OPTION_ID("vpp-delogo-cr"): {
         i++;
         int value;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -1698,7 +1907,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 
-    if (IS_OPTION("vpp-delogo")) {
+    case OPTION_ID("vpp-delogo"): {
         pParams->vpp.delogo.enable = true;
 
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
@@ -1874,7 +2083,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-knn")) {
+    case OPTION_ID("vpp-knn"): {
         pParams->vpp.knn.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             pParams->vpp.knn.radius = FILTER_DEFAULT_KNN_RADIUS;
@@ -1954,7 +2163,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-pmd")) {
+    case OPTION_ID("vpp-pmd"): {
         pParams->vpp.pmd.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2020,7 +2229,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 
-    if (IS_OPTION("vpp-deband")) {
+    case OPTION_ID("vpp-deband"): {
         pParams->vpp.deband.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2161,7 +2370,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-afs")) {
+    case OPTION_ID("vpp-afs"): {
         pParams->vpp.afs.enable = true;
 
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
@@ -2394,7 +2603,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-nnedi")) {
+    case OPTION_ID("vpp-nnedi"): {
         pParams->vpp.nnedi.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2500,7 +2709,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-yadif")) {
+    case OPTION_ID("vpp-yadif"): {
         pParams->vpp.yadif.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2542,12 +2751,12 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-rff")) {
+    case OPTION_ID("vpp-rff"): {
         pParams->vpp.rff = true;
         return 0;
     }
 
-    if (IS_OPTION("vpp-tweak")) {
+    case OPTION_ID("vpp-tweak"): {
         pParams->vpp.tweak.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2624,7 +2833,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-colorspace")) {
+    case OPTION_ID("vpp-colorspace"): {
         pParams->vpp.colorspace.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -2843,7 +3052,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
 
 
 
-    if (IS_OPTION("vpp-subburn")) {
+    case OPTION_ID("vpp-subburn"): {
         VppSubburn subburn;
         subburn.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
@@ -2932,7 +3141,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 
-    if (IS_OPTION("vpp-pad")) {
+    case OPTION_ID("vpp-pad"): {
         pParams->vpp.pad.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -3010,7 +3219,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 
-    if (IS_OPTION("vpp-select-every")) {
+    case OPTION_ID("vpp-select-every"): {
         pParams->vpp.selectevery.enable = true;
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
@@ -3065,23 +3274,32 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("vpp-perf-monitor")) {
+    case OPTION_ID("vpp-perf-monitor"): {
         pParams->vpp.bCheckPerformance = true;
         return 0;
     }
-    if (IS_OPTION("no-vpp-perf-monitor")) {
+    case OPTION_ID("no-vpp-perf-monitor"): {
         pParams->vpp.bCheckPerformance = false;
         return 0;
     }
-    if (IS_OPTION("tff")) {
+    case OPTION_ID("vpp-cpu"): {
+        pParams->vpp.cpu = true;
+        return 0;
+    }
+    case OPTION_ID("no-vpp-cpu"): {
+        pParams->vpp.cpu = false;
+        return 0;
+    }
+    case OPTION_ID("tff"): {
         pParams->input.picstruct = RGY_PICSTRUCT_FRAME_TFF;
         return 0;
     }
-    if (IS_OPTION("bff")) {
+    case OPTION_ID("bff"): {
         pParams->input.picstruct = RGY_PICSTRUCT_FRAME_BFF;
         return 0;
     }
-    if (IS_OPTION("interlace") || IS_OPTION("interlaced")) {
+    case OPTION_ID("interlace"):
+    case OPTION_ID("interlaced"): {
         i++;
         int value = 0;
         if (get_list_value(list_interlaced, strInput[i], &value)) {
@@ -3092,27 +3310,27 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cavlc")) {
+    case OPTION_ID("cavlc"): {
         codecPrm[NV_ENC_H264].h264Config.entropyCodingMode = NV_ENC_H264_ENTROPY_CODING_MODE_CAVLC;
         return 0;
     }
-    if (IS_OPTION("cabac")) {
+    case OPTION_ID("cabac"): {
         codecPrm[NV_ENC_H264].h264Config.entropyCodingMode = NV_ENC_H264_ENTROPY_CODING_MODE_CABAC;
         return 0;
     }
-    if (IS_OPTION("bluray")) {
+    case OPTION_ID("bluray"): {
         pParams->bluray = TRUE;
         return 0;
     }
-    if (IS_OPTION("lossless")) {
+    case OPTION_ID("lossless"): {
         pParams->lossless = TRUE;
         return 0;
     }
-    if (IS_OPTION("no-deblock")) {
+    case OPTION_ID("no-deblock"): {
         codecPrm[NV_ENC_H264].h264Config.disableDeblockingFilterIDC = 1;
         return 0;
     }
-    if (IS_OPTION("slices:h264")) {
+    case OPTION_ID("slices:h264"): {
         i++;
         try {
             int value = std::stoi(strInput[i]);
@@ -3124,7 +3342,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("slices:hevc")) {
+    case OPTION_ID("slices:hevc"): {
         i++;
         try {
             int value = std::stoi(strInput[i]);
@@ -3136,7 +3354,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("slices")) {
+    case OPTION_ID("slices"): {
         i++;
         try {
             int value = std::stoi(strInput[i]);
@@ -3150,50 +3368,52 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("deblock")) {
+    case OPTION_ID("deblock"): {
         codecPrm[NV_ENC_H264].h264Config.disableDeblockingFilterIDC = 0;
         return 0;
     }
-    if (IS_OPTION("aud:h264")) {
+    case OPTION_ID("aud:h264"): {
         codecPrm[NV_ENC_H264].h264Config.outputAUD = 1;
         return 0;
     }
-    if (IS_OPTION("aud:hevc")) {
+    case OPTION_ID("aud:hevc"): {
         codecPrm[NV_ENC_HEVC].hevcConfig.outputAUD = 1;
         return 0;
     }
-    if (IS_OPTION("aud")) {
+    case OPTION_ID("aud"): {
         codecPrm[NV_ENC_H264].h264Config.outputAUD = 1;
         codecPrm[NV_ENC_HEVC].hevcConfig.outputAUD = 1;
         return 0;
     }
-    if (IS_OPTION("pic-struct:h264")) {
+    case OPTION_ID("pic-struct:h264"): {
         codecPrm[NV_ENC_H264].h264Config.outputPictureTimingSEI = 1;
         return 0;
     }
-    if (IS_OPTION("pic-struct:hevc")) {
+    case OPTION_ID("pic-struct:hevc"): {
         codecPrm[NV_ENC_HEVC].hevcConfig.outputPictureTimingSEI = 1;
         return 0;
     }
-    if (IS_OPTION("pic-struct")) {
+    case OPTION_ID("pic-struct"): {
         codecPrm[NV_ENC_H264].h264Config.outputPictureTimingSEI = 1;
         codecPrm[NV_ENC_HEVC].hevcConfig.outputPictureTimingSEI = 1;
         return 0;
     }
-    if (IS_OPTION("fullrange:h264")) {
+    case OPTION_ID("fullrange:h264"): {
         codecPrm[NV_ENC_H264].h264Config.h264VUIParameters.videoFullRangeFlag = 1;
         return 0;
     }
-    if (IS_OPTION("fullrange:hevc")) {
+    case OPTION_ID("fullrange:hevc"): {
         codecPrm[NV_ENC_HEVC].hevcConfig.hevcVUIParameters.videoFullRangeFlag = 1;
         return 0;
     }
-    if (IS_OPTION("fullrange")) {
+    case OPTION_ID("fullrange"): {
         codecPrm[NV_ENC_H264].h264Config.h264VUIParameters.videoFullRangeFlag = 1;
         codecPrm[NV_ENC_HEVC].hevcConfig.hevcVUIParameters.videoFullRangeFlag = 1;
         return 0;
     }
-    if (IS_OPTION("videoformat") || IS_OPTION("videoformat:h264") || IS_OPTION("videoformat:hevc")) {
+    case OPTION_ID("videoformat"):
+    case OPTION_ID("videoformat:h264"):
+    case OPTION_ID("videoformat:hevc"): {
         const bool for_h264 = IS_OPTION("videoformat") || IS_OPTION("videoformat:h264");
         const bool for_hevc = IS_OPTION("videoformat") || IS_OPTION("videoformat:hevc");
         i++;
@@ -3207,7 +3427,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("colormatrix") || IS_OPTION("colormatrix:h264") || IS_OPTION("colormatrix:hevc")) {
+    case OPTION_ID("colormatrix"):
+    case OPTION_ID("colormatrix:h264"):
+    case OPTION_ID("colormatrix:hevc"): {
         const bool for_h264 = IS_OPTION("colormatrix") || IS_OPTION("colormatrix:h264");
         const bool for_hevc = IS_OPTION("colormatrix") || IS_OPTION("colormatrix:hevc");
         i++;
@@ -3221,7 +3443,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("colorprim") || IS_OPTION("colorprim:h264") || IS_OPTION("colorprim:hevc")) {
+    case OPTION_ID("colorprim"):
+    case OPTION_ID("colorprim:h264"):
+    case OPTION_ID("colorprim:hevc"): {
         const bool for_h264 = IS_OPTION("colorprim") || IS_OPTION("colorprim:h264");
         const bool for_hevc = IS_OPTION("colorprim") || IS_OPTION("colorprim:hevc");
         i++;
@@ -3235,7 +3459,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("transfer") || IS_OPTION("transfer:h264") || IS_OPTION("transfer:hevc")) {
+    case OPTION_ID("transfer"):
+    case OPTION_ID("transfer:h264"):
+    case OPTION_ID("transfer:hevc"): {
         const bool for_h264 = IS_OPTION("transfer") || IS_OPTION("transfer:h264");
         const bool for_hevc = IS_OPTION("transfer") || IS_OPTION("transfer:hevc");
         i++;
@@ -3249,7 +3475,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("level") || IS_OPTION("level:h264") || IS_OPTION("level:hevc")) {
+    case OPTION_ID("level"):
+    case OPTION_ID("level:h264"):
+    case OPTION_ID("level:hevc"): {
         const bool for_h264 = IS_OPTION("level") || IS_OPTION("level:h264");
         const bool for_hevc = IS_OPTION("level") || IS_OPTION("level:hevc");
         i++;
@@ -3295,7 +3523,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("profile") || IS_OPTION("profile:h264") || IS_OPTION("profile:hevc")) {
+    case OPTION_ID("profile"):
+    case OPTION_ID("profile:h264"):
+    case OPTION_ID("profile:hevc"): {
         const bool for_h264 = IS_OPTION("profile") || IS_OPTION("profile:h264");
         const bool for_hevc = IS_OPTION("profile") || IS_OPTION("profile:hevc");
         i++;
@@ -3334,7 +3564,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("chromaloc") || IS_OPTION("chromaloc:h264") || IS_OPTION("chromaloc:hevc")) {
+    case OPTION_ID("chromaloc"):
+    case OPTION_ID("chromaloc:h264"):
+    case OPTION_ID("chromaloc:hevc"): {
         const bool for_h264 = IS_OPTION("chromaloc") || IS_OPTION("chromaloc:h264");
         const bool for_hevc = IS_OPTION("chromaloc") || IS_OPTION("chromaloc:hevc");
         i++;
@@ -3356,7 +3588,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("tier")) {
+    case OPTION_ID("tier"):
+    case OPTION_ID("tier:hevc"): {
         i++;
         int value = 0;
         if (get_list_value(h265_tier_names, strInput[i], &value)) {
@@ -3369,22 +3602,22 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("max-cll")) {
+    case OPTION_ID("max-cll"): {
         i++;
         pParams->sMaxCll = tchar_to_string(strInput[i]);
         return 0;
     }
-    if (IS_OPTION("master-display")) {
+    case OPTION_ID("master-display"): {
         i++;
         pParams->sMasterDisplay = tchar_to_string(strInput[i]);
         return 0;
     }
-    if (IS_OPTION("dhdr10-info")) {
+    case OPTION_ID("dhdr10-info"): {
         i++;
         pParams->dynamicHdr10plusJson = strInput[i];
         return 0;
     }
-    if (IS_OPTION("output-depth")) {
+    case OPTION_ID("output-depth"): {
         i++;
         int value = 0;
         if (1 == _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3395,7 +3628,9 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("sar") || IS_OPTION("par") || IS_OPTION("dar")) {
+    case OPTION_ID("sar"):
+    case OPTION_ID("par"):
+    case OPTION_ID("dar"): {
         i++;
         int a[2] = { 0 };
         if (   2 == _stscanf_s(strInput[i], _T("%d:%d"), &a[0], &a[1])
@@ -3414,7 +3649,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cu-max")) {
+    case OPTION_ID("cu-max"): {
         i++;
         int value = 0;
         if (get_list_value(list_hevc_cu_size, strInput[i], &value)) {
@@ -3425,7 +3660,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cu-min")) {
+    case OPTION_ID("cu-min"): {
         i++;
         int value = 0;
         if (get_list_value(list_hevc_cu_size, strInput[i], &value)) {
@@ -3436,7 +3671,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("cuda-schedule")) {
+    case OPTION_ID("cuda-schedule"): {
         i++;
         int value = 0;
         if (get_list_value(list_cuda_schedule, strInput[i], &value)) {
@@ -3448,7 +3683,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         return 0;
     }
 
-    if (IS_OPTION("gpu-select")) {
+    case OPTION_ID("gpu-select"): {
         if (i+1 >= nArgNum || strInput[i+1][0] == _T('-')) {
             return 0;
         }
@@ -3504,7 +3739,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("max-procfps")) {
+    case OPTION_ID("max-procfps"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3521,12 +3756,16 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("log")) {
+    case OPTION_ID("low-latency"): {
+        pParams->lowLatency = true;
+        return 0;
+    }
+    case OPTION_ID("log"): {
         i++;
         pParams->logfile = strInput[i];
         return 0;
     }
-    if (IS_OPTION("log-level")) {
+    case OPTION_ID("log-level"): {
         i++;
         int value = 0;
         if (get_list_value(list_log_level, strInput[i], &value)) {
@@ -3537,17 +3776,28 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (IS_OPTION("log-framelist")) {
+    case OPTION_ID("log-mode"): {
+        i++;
+        int value = 0;
+        if (get_list_value(list_log_mode, strInput[i], &value)) {
+            pParams->logMode = value;
+        } else {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return -1;
+        }
+        return 0;
+    }
+    case OPTION_ID("log-framelist"): {
         i++;
         pParams->sFramePosListLog = strInput[i];
         return 0;
     }
-    if (IS_OPTION("log-mux-ts")) {
+    case OPTION_ID("log-mux-ts"): {
         i++;
         pParams->pMuxVidTsLogFile = _tcsdup(strInput[i]);
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("output-buf"))) {
+    case OPTION_ID("output-buf"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3561,8 +3811,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nOutputBufSizeMB = (std::min)(value, RGY_OUTPUT_BUF_MB_MAX);
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("input-thread"))
-        || 0 == _tcscmp(option_name, _T("thread-input"))) {
+    case OPTION_ID("input-thread"):
+    case OPTION_ID("thread-input"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3576,12 +3826,12 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nInputThread = (int8_t)value;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("no-output-thread"))) {
+    case OPTION_ID("no-output-thread"): {
         pParams->nOutputThread = 0;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("output-thread"))
-        || 0 == _tcscmp(option_name, _T("thread-output"))) {
+    case OPTION_ID("output-thread"):
+    case OPTION_ID("thread-output"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3595,8 +3845,8 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nOutputThread = value;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("audio-thread"))
-        || 0 == _tcscmp(option_name, _T("thread-audio"))) {
+    case OPTION_ID("audio-thread"):
+    case OPTION_ID("thread-audio"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3610,21 +3860,38 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nAudioThread = value;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("thread-csp"))) {
+    case OPTION_ID("audio-track-thread"):
+    case OPTION_ID("thread-audio-track"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
             SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
             return 1;
         }
-        if (value < -1 || value >= 2) {
+        if (value < -1) {
             SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
             return 1;
         }
+        pParams->nAudioTrackThread = value;
+        return 0;
+    }
+    case OPTION_ID("thread-csp"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        //2以上は共有のスレッドプールの大きさにもなるので、論理コア数までとする
+        const int maxThreads = (int)get_cpu_info().logical_cores;
+        if (value < -1 || value > maxThreads) {
+            SET_ERR(strInput[0], strsprintf(_T("Invalid value, should be -1 - %d"), maxThreads).c_str(), option_name, strInput[i]);
+            return 1;
+        }
         pParams->threadCsp = value;
         return 0;
     }
-    if (IS_OPTION("simd-csp")) {
+    case OPTION_ID("simd-csp"): {
         i++;
         int value = 0;
         if (get_list_value(list_simd, strInput[i], &value)) {
@@ -3635,21 +3902,32 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("max-procfps"))) {
+    case OPTION_ID("input-read-mode"): {
+        i++;
+        int value = 0;
+        if (get_list_value(list_input_read_mode, strInput[i], &value)) {
+            pParams->inputReadMode = value;
+        } else {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        return 0;
+    }
+    case OPTION_ID("input-read-ahead"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
             SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
             return 1;
         }
-        if (value < 0) {
+        if (value < 1 || value > RGY_INPUT_READ_AHEAD_MAX) {
             SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
             return 1;
         }
-        pParams->nProcSpeedLimit = (uint16_t)(std::min)(value, (int)UINT16_MAX);
+        pParams->inputReadAhead = value;
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("perf-monitor"))) {
+    case OPTION_ID("perf-monitor"): {
         if (strInput[i+1][0] == _T('-') || _tcslen(strInput[i+1]) == 0) {
             pParams->nPerfMonitorSelect = (int)PERF_MONITOR_ALL;
         } else {
@@ -3666,7 +3944,7 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         }
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("perf-monitor-interval"))) {
+    case OPTION_ID("perf-monitor-interval"): {
         i++;
         int v;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &v)) {
@@ -3676,7 +3954,108 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->nPerfMonitorInterval = std::max(50, v);
         return 0;
     }
-    if (0 == _tcscmp(option_name, _T("session-retry"))) {
+    case OPTION_ID("perf-trace"): {
+        i++;
+        pParams->perfTraceFile = strInput[i];
+        return 0;
+    }
+    case OPTION_ID("metrics"): {
+        i++;
+        pParams->metricsListen = strInput[i];
+        return 0;
+    }
+    case OPTION_ID("segment"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || RGY_SEGMENT_MAX < value) {
+            SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->segmentCount = value;
+        return 0;
+    }
+    case OPTION_ID("segment-parallel"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->segmentParallel = value;
+        return 0;
+    }
+    case OPTION_ID("ladder"): {
+        i++;
+        LadderRungParam rung;
+        for (const auto &param : split(strInput[i], _T(","))) {
+            auto pos = param.find_first_of(_T("="));
+            if (pos == std::string::npos) {
+                SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+                return 1;
+            }
+            auto param_arg = tolowercase(param.substr(0, pos));
+            auto param_val = param.substr(pos+1);
+            if (param_arg == _T("res")) {
+                int a[2] = { 0 };
+                if (2 != _stscanf_s(param_val.c_str(), _T("%dx%d"), &a[0], &a[1])
+                    || a[0] <= 0 || a[1] <= 0 || (a[0] & 1) || (a[1] & 1)) {
+                    SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+                    return 1;
+                }
+                rung.width = a[0];
+                rung.height = a[1];
+                continue;
+            }
+            if (param_arg == _T("bitrate") || param_arg == _T("max-bitrate")) {
+                int value = 0;
+                if (1 != _stscanf_s(param_val.c_str(), _T("%d"), &value) || value <= 0) {
+                    SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+                    return 1;
+                }
+                ((param_arg == _T("bitrate")) ? rung.bitrate : rung.maxBitrate) = value;
+                continue;
+            }
+            if (param_arg == _T("output")) {
+                rung.outputFilename = param_val;
+                continue;
+            }
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (rung.width <= 0 || rung.outputFilename.length() == 0) {
+            SET_ERR(strInput[0], _T("res and output must be set"), option_name, strInput[i]);
+            return 1;
+        }
+        if ((int)pParams->ladder.size() >= RGY_LADDER_MAX_RUNGS) {
+            SET_ERR(strInput[0], _T("Too many rungs"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->ladder.push_back(rung);
+        return 0;
+    }
+    case OPTION_ID("ladder-queue"): {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || RGY_LADDER_QUEUE_MAX < value) {
+            SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->ladderQueue = value;
+        return 0;
+    }
+    case OPTION_ID("session-retry"): {
         i++;
         int value = 0;
         if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
@@ -3690,12 +4069,16 @@ int parse_one_option(const TCHAR *option_name, const TCHAR* strInput[], int& i,
         pParams->sessionRetry = value;
         return 0;
     }
+    default:
+        break;
+    }
     tstring mes = _T("Unknown option: --");
     mes += option_name;
     SET_ERR(strInput[0], (TCHAR *)mes.c_str(), NULL, strInput[i]);
     return -1;
 }
 #undef IS_OPTION
+#undef OPTION_ID
 
 int parse_cmd(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, int nArgNum, const TCHAR **strInput, ParseCmdError& err, bool ignore_parse_err) {
     sArgsData argsData;
@@ -3760,6 +4143,60 @@ int parse_cmd(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, const
     return ret;
 }
 
+//Aviutlのプラグインでは、同じ設定のコマンドラインを設定画面の表示やエンコード開始時に何度も解析するので、
+//解析結果をコマンドラインごとに保持しておき、2回目以降はコピーするだけにする
+struct ParseCmdCacheEntry {
+    std::string cmd;
+    InEncodeVideoParam prm;
+    NV_ENC_CODEC_CONFIG codecPrm[2];
+};
+static const size_t PARSE_CMD_CACHE_MAX = 16;
+static std::mutex g_parseCmdCacheMtx;
+static std::deque<ParseCmdCacheEntry> g_parseCmdCache;
+
+//ポインタで保持しているリストはコピーすると解放が二重になるので、これらを使用する場合はキャッシュしない
+static bool parse_cmd_cacheable(const InEncodeVideoParam *pParams) {
+    return pParams->nAudioSelectCount == 0
+        && pParams->nAudioSourceCount == 0
+        && pParams->nSubtitleSelectCount == 0
+        && pParams->nDataSelectCount == 0
+        && pParams->nTrimCount == 0
+        && pParams->pTrimList == nullptr
+        && pParams->pMuxOpt == nullptr
+        && pParams->pMuxVidTsLogFile == nullptr
+        && pParams->pAVInputFormat == nullptr
+        && pParams->pPrivatePrm == nullptr;
+}
+
+int parse_cmd_cached(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, const char *cmda, ParseCmdError& err) {
+    const std::string cmd = (cmda) ? cmda : "";
+    {
+        std::lock_guard<std::mutex> lock(g_parseCmdCacheMtx);
+        for (const auto& entry : g_parseCmdCache) {
+            if (entry.cmd == cmd) {
+                *pParams = entry.prm;
+                memcpy(codecPrm, entry.codecPrm, sizeof(entry.codecPrm));
+                return 0;
+            }
+        }
+    }
+    ParseCmdCacheEntry entry;
+    entry.cmd = cmd;
+    entry.codecPrm[NV_ENC_H264] = DefaultParamH264();
+    entry.codecPrm[NV_ENC_HEVC] = DefaultParamHEVC();
+    int ret = parse_cmd(&entry.prm, entry.codecPrm, cmda, err);
+    *pParams = entry.prm;
+    memcpy(codecPrm, entry.codecPrm, sizeof(entry.codecPrm));
+    if (ret == 0 && parse_cmd_cacheable(&entry.prm)) {
+        std::lock_guard<std::mutex> lock(g_parseCmdCacheMtx);
+        if (g_parseCmdCache.size() >= PARSE_CMD_CACHE_MAX) {
+            g_parseCmdCache.pop_front();
+        }
+        g_parseCmdCache.push_back(std::move(entry));
+    }
+    return ret;
+}
+
 #pragma warning (push)
 #pragma warning (disable: 4127)
 tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG codecPrmArg[2], bool save_disabled_prm) {
@@ -3843,6 +4280,7 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
     case RGY_INPUT_FMT_VPY_MT: cmd << _T(" --vpy-mt"); break;
     case RGY_INPUT_FMT_AVHW:   cmd << _T(" --avhw"); break;
     case RGY_INPUT_FMT_AVSW:   cmd << _T(" --avsw"); break;
+    case RGY_INPUT_FMT_SM:     cmd << _T(" --sm"); break;
     default: break;
     }
     if (save_disabled_prm || pParams->input.picstruct != RGY_PICSTRUCT_FRAME) {
@@ -3911,8 +4349,9 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
     if (pParams->encConfig.rcParams.enableMaxQP || save_disabled_prm) {
         OPT_QP(_T("--qp-max"), encConfig.rcParams.maxQP, pParams->encConfig.rcParams.enableMaxQP, false);
     }
-    if (pParams->encConfig.rcParams.enableLookahead || save_disabled_prm) {
-        OPT_NUM(_T("--lookahead"), encConfig.rcParams.lookaheadDepth);
+    //lookaheadDepthが既定値でも、有効化されていることを出力する必要がある
+    if (pParams->encConfig.rcParams.enableLookahead) {
+        cmd << _T(" --lookahead ") << (int)pParams->encConfig.rcParams.lookaheadDepth;
     }
     OPT_BOOL(_T("--no-i-adapt"), _T(""), encConfig.rcParams.disableIadapt);
     OPT_BOOL(_T("--no-b-adapt"), _T(""), encConfig.rcParams.disableBadapt);
@@ -3986,6 +4425,12 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
     std::basic_stringstream<TCHAR> tmp;
 #if ENABLE_AVSW_READER
     OPT_NUM(_T("--input-analyze"), nAVDemuxAnalyzeSec);
+    if (pParams->inputIndex) {
+        cmd << _T(" --input-index");
+        if (pParams->inputIndexFile.length() > 0) {
+            cmd << _T(" \"") << pParams->inputIndexFile << _T("\"");
+        }
+    }
     if (pParams->nTrimCount > 0) {
         cmd << _T(" --trim ");
         for (int i = 0; i < pParams->nTrimCount; i++) {
@@ -4139,6 +4584,9 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
     OPT_BOOL(_T("--key-on-chapter"), _T(""), keyOnChapter);
     OPT_STR_PATH(_T("--keyfile"), keyFile);
     OPT_LST(_T("--avsync"), nAVSyncMode, list_avsync);
+    OPT_NUM(_T("--avsw-decode-ahead"), avswDecodeAhead);
+    OPT_NUM(_T("--avsw-threads"), avswThreads);
+    OPT_LST(_T("--avsw-thread-type"), avswThreadType, list_avsw_thread_type);
 #endif //#if ENABLE_AVSW_READER
 
     OPT_LST(_T("--vpp-deinterlace"), vpp.deinterlace, list_deinterlace);
@@ -4471,6 +4919,7 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
         }
     }
     OPT_BOOL(_T("--vpp-perf-monitor"), _T("--no-vpp-perf-monitor"), vpp.bCheckPerformance);
+    OPT_BOOL(_T("--vpp-cpu"), _T("--no-vpp-cpu"), vpp.cpu);
 
     OPT_LST(_T("--cuda-schedule"), nCudaSchedule, list_cuda_schedule);
     if (pParams->gpuSelect != encPrmDefault.gpuSelect) {
@@ -4487,11 +4936,16 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
     OPT_NUM(_T("--thread-output"), nOutputThread);
     OPT_NUM(_T("--thread-input"), nInputThread);
     OPT_NUM(_T("--thread-audio"), nAudioThread);
+    OPT_NUM(_T("--thread-audio-track"), nAudioTrackThread);
     OPT_NUM(_T("--thread-csp"), threadCsp);
     OPT_LST(_T("--simd-csp"), simdCsp, list_simd);
+    OPT_LST(_T("--input-read-mode"), inputReadMode, list_input_read_mode);
+    OPT_NUM(_T("--input-read-ahead"), inputReadAhead);
     OPT_NUM(_T("--max-procfps"), nProcSpeedLimit);
+    OPT_BOOL(_T("--low-latency"), _T(""), lowLatency);
     OPT_STR_PATH(_T("--log"), logfile);
     OPT_LST(_T("--log-level"), loglevel, list_log_level);
+    OPT_LST(_T("--log-mode"), logMode, list_log_mode);
     OPT_STR_PATH(_T("--log-framelist"), sFramePosListLog);
     OPT_CHAR_PATH(_T("--log-mux-ts"), pMuxVidTsLogFile);
     if (pParams->nPerfMonitorSelect != encPrmDefault.nPerfMonitorSelect) {
@@ -4511,9 +4965,282 @@ tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG cod
         }
     }
     OPT_NUM(_T("--perf-monitor-interval"), nPerfMonitorInterval);
+    OPT_STR_PATH(_T("--perf-trace"), perfTraceFile);
+    OPT_STR_PATH(_T("--metrics"), metricsListen);
+    OPT_NUM(_T("--segment"), segmentCount);
+    OPT_NUM(_T("--segment-parallel"), segmentParallel);
+    for (const auto& rung : pParams->ladder) {
+        cmd << _T(" --ladder \"") << rung.print() << _T("\"");
+    }
+    OPT_NUM(_T("--ladder-queue"), ladderQueue);
     OPT_NUM(_T("--session-retry"), sessionRetry);
     return cmd.str();
 }
 #pragma warning (pop)
 
+//コマンドラインを空白で区切り、parse_cmdに渡せる形にする
+//(オプションの省略可能な引数の判定のため、末尾に空文字列を追加する)
+static std::vector<tstring> parse_cmd_bench_split(const tstring& cmd) {
+    std::vector<tstring> args = { _T("NVEncC") };
+    std::basic_stringstream<TCHAR> ss(cmd);
+    tstring arg;
+    while (ss >> arg) {
+        args.push_back(arg);
+    }
+    args.push_back(_T(""));
+    return args;
+}
+
+static int parse_cmd_bench_parse(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG codecPrm[2], const std::vector<tstring>& args) {
+    std::vector<const TCHAR *> argv;
+    for (const auto& arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    ParseCmdError err;
+    return parse_cmd(pParams, codecPrm, (int)argv.size() - 1, argv.data(), err);
+}
+
+struct ParseCmdBenchResult {
+    InEncodeVideoParam prm;
+    NV_ENC_CODEC_CONFIG codecPrm[2];
+    bool ok;
+
+    ParseCmdBenchResult(const std::vector<tstring>& args) : prm(), codecPrm(), ok(false) {
+        codecPrm[NV_ENC_H264] = DefaultParamH264();
+        codecPrm[NV_ENC_HEVC] = DefaultParamHEVC();
+        ok = parse_cmd_bench_parse(&prm, codecPrm, args) == 0;
+    }
+};
+
+static bool parse_cmd_bench_str_equal(const TCHAR *a, const TCHAR *b) {
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+    return _tcscmp(a, b) == 0;
+}
+
+//2つの解析結果を比較し、最初に一致しなかったメンバ名を返す (すべて一致すればnullptr)
+static const TCHAR *parse_cmd_bench_diff(const InEncodeVideoParam *a, const NV_ENC_CODEC_CONFIG codecPrmA[2], const InEncodeVideoParam *b, const NV_ENC_CODEC_CONFIG codecPrmB[2]) {
+#define CMP_VAL(x) if (!(a->x == b->x)) return _T(#x);
+#define CMP_MEM(x) if (memcmp(&a->x, &b->x, sizeof(a->x)) != 0) return _T(#x);
+    CMP_VAL(input.type);
+    CMP_VAL(input.srcWidth);
+    CMP_VAL(input.srcHeight);
+    CMP_VAL(input.dstWidth);
+    CMP_VAL(input.dstHeight);
+    CMP_VAL(input.fpsN);
+    CMP_VAL(input.fpsD);
+    CMP_MEM(input.crop);
+    CMP_MEM(input.sar);
+    CMP_VAL(input.csp);
+    CMP_VAL(input.picstruct);
+    CMP_VAL(input.vui);
+    CMP_VAL(inputFilename);
+    CMP_VAL(outputFilename);
+    CMP_VAL(sAVMuxOutputFormat);
+    CMP_VAL(preset);
+    CMP_VAL(deviceID);
+    CMP_VAL(nHWDecType);
+    CMP_MEM(par);
+    CMP_MEM(encConfig);
+    CMP_VAL(dynamicRC);
+    CMP_VAL(codec);
+    CMP_VAL(bluray);
+    CMP_VAL(yuv444);
+    CMP_VAL(lossless);
+    CMP_VAL(sMaxCll);
+    CMP_VAL(sMasterDisplay);
+    CMP_VAL(dynamicHdr10plusJson);
+    CMP_VAL(videoCodecTag);
+    CMP_VAL(logfile);
+    CMP_VAL(loglevel);
+    CMP_VAL(logMode);
+    CMP_VAL(nOutputBufSizeMB);
+    CMP_VAL(sFramePosListLog);
+    CMP_VAL(fSeekSec);
+    CMP_VAL(nSubtitleSelectCount);
+    for (int i = 0; i < a->nSubtitleSelectCount; i++) {
+        CMP_VAL(ppSubtitleSelectList[i]->trackID);
+        CMP_VAL(ppSubtitleSelectList[i]->encCodec);
+        CMP_VAL(ppSubtitleSelectList[i]->encCodecPrm);
+        CMP_VAL(ppSubtitleSelectList[i]->decCodecPrm);
+        CMP_VAL(ppSubtitleSelectList[i]->asdata);
+    }
+    CMP_VAL(nAudioSourceCount);
+    for (int i = 0; i < a->nAudioSourceCount; i++) {
+        if (!parse_cmd_bench_str_equal(a->ppAudioSourceList[i], b->ppAudioSourceList[i])) return _T("ppAudioSourceList");
+    }
+    CMP_VAL(nAudioSelectCount);
+    for (int i = 0; i < a->nAudioSelectCount; i++) {
+        CMP_VAL(ppAudioSelectList[i]->trackID);
+        CMP_VAL(ppAudioSelectList[i]->decCodecPrm);
+        CMP_VAL(ppAudioSelectList[i]->encCodec);
+        CMP_VAL(ppAudioSelectList[i]->encCodecPrm);
+        CMP_VAL(ppAudioSelectList[i]->encCodecProfile);
+        CMP_VAL(ppAudioSelectList[i]->encBitrate);
+        CMP_VAL(ppAudioSelectList[i]->encSamplingRate);
+        CMP_VAL(ppAudioSelectList[i]->extractFilename);
+        CMP_VAL(ppAudioSelectList[i]->extractFormat);
+        CMP_VAL(ppAudioSelectList[i]->filter);
+        CMP_MEM(ppAudioSelectList[i]->pnStreamChannelSelect);
+        CMP_MEM(ppAudioSelectList[i]->pnStreamChannelOut);
+    }
+    CMP_VAL(nDataSelectCount);
+    for (int i = 0; i < a->nDataSelectCount; i++) {
+        CMP_VAL(ppDataSelectList[i]->trackID);
+    }
+    CMP_VAL(nAudioResampler);
+    CMP_VAL(nAVDemuxAnalyzeSec);
+    CMP_VAL(inputIndex);
+    CMP_VAL(inputIndexFile);
+    CMP_VAL(nAVMux);
+    CMP_VAL(nVideoTrack);
+    CMP_VAL(nVideoStreamId);
+    CMP_VAL(nTrimCount);
+    for (int i = 0; i < a->nTrimCount; i++) {
+        CMP_VAL(pTrimList[i].start);
+        CMP_VAL(pTrimList[i].fin);
+    }
+    CMP_VAL(bCopyChapter);
+    CMP_VAL(keyOnChapter);
+    CMP_VAL(caption2ass);
+    CMP_VAL(nOutputThread);
+    CMP_VAL(nAudioThread);
+    CMP_VAL(nAudioTrackThread);
+    CMP_VAL(nInputThread);
+    CMP_VAL(nAudioIgnoreDecodeError);
+    if ((a->pMuxOpt == nullptr) != (b->pMuxOpt == nullptr)
+        || (a->pMuxOpt != nullptr && *a->pMuxOpt != *b->pMuxOpt)) {
+        return _T("pMuxOpt");
+    }
+    CMP_VAL(sChapterFile);
+    CMP_VAL(keyFile);
+    if (!parse_cmd_bench_str_equal(a->pMuxVidTsLogFile, b->pMuxVidTsLogFile)) return _T("pMuxVidTsLogFile");
+    if (!parse_cmd_bench_str_equal(a->pAVInputFormat, b->pAVInputFormat)) return _T("pAVInputFormat");
+    CMP_VAL(nAVSyncMode);
+    CMP_VAL(nProcSpeedLimit);
+    CMP_VAL(vpp.bCheckPerformance);
+    CMP_VAL(vpp.cpu);
+    CMP_VAL(vpp.deinterlace);
+    CMP_VAL(vpp.resizeInterp);
+    CMP_VAL(vpp.gaussMaskSize);
+    CMP_VAL(vpp.delogo);
+    CMP_VAL(vpp.unsharp);
+    CMP_VAL(vpp.edgelevel);
+    CMP_VAL(vpp.knn);
+    CMP_VAL(vpp.pmd);
+    CMP_VAL(vpp.deband);
+    CMP_VAL(vpp.afs);
+    CMP_VAL(vpp.nnedi);
+    CMP_VAL(vpp.yadif);
+    CMP_VAL(vpp.tweak);
+    CMP_VAL(vpp.colorspace);
+    CMP_VAL(vpp.pad);
+    CMP_VAL(vpp.subburn);
+    CMP_VAL(vpp.selectevery);
+    CMP_VAL(vpp.rff);
+    CMP_VAL(nWeightP);
+    CMP_VAL(nPerfMonitorSelect);
+    CMP_VAL(nPerfMonitorSelectMatplot);
+    CMP_VAL(nPerfMonitorInterval);
+    CMP_VAL(perfTraceFile);
+    CMP_VAL(metricsListen);
+    CMP_VAL(segmentCount);
+    CMP_VAL(segmentParallel);
+    CMP_VAL(ladder);
+    CMP_VAL(ladderQueue);
+    CMP_VAL(nCudaSchedule);
+    CMP_VAL(gpuSelect);
+    CMP_VAL(sessionRetry);
+    CMP_VAL(threadCsp);
+    CMP_VAL(simdCsp);
+    CMP_VAL(inputReadMode);
+    CMP_VAL(inputReadAhead);
+    CMP_VAL(avswDecodeAhead);
+    CMP_VAL(avswThreads);
+    CMP_VAL(avswThreadType);
+    CMP_VAL(lowLatency);
+#undef CMP_VAL
+#undef CMP_MEM
+    if (memcmp(&codecPrmA[NV_ENC_H264], &codecPrmB[NV_ENC_H264], sizeof(codecPrmA[0])) != 0) return _T("codecPrm[NV_ENC_H264]");
+    if (memcmp(&codecPrmA[NV_ENC_HEVC], &codecPrmB[NV_ENC_HEVC], sizeof(codecPrmA[0])) != 0) return _T("codecPrm[NV_ENC_HEVC]");
+    return nullptr;
+}
+
+int parse_cmd_bench(FILE *fp) {
+    //Aviutlのプラグインのプリセット相当のコマンドラインと、
+    //従来の比較の順で後方にあるオプションを多く含むコマンドライン
+    static const TCHAR *SAMPLES[][2] = {
+        { _T("h264"), _T("-c h264 --vbr 0 --vbr-quality 24 --preset quality --bframes 3 --ref 4 --lookahead 16 --aq --aq-temporal --gop-len 300 --level 4.1 --profile high --colormatrix bt709 --colorprim bt709 --transfer bt709 --mv-precision Q-pel --weightp --strict-gop") },
+        { _T("hevc"), _T("-c hevc --cqp 20:22:24 --preset quality --bframes 5 --ref 3 --output-depth 10 --tier high --cu-max 32 --cu-min 8 --sar 1:1 --fps 30000/1001 --interlace tff --vpp-deinterlace normal --vpp-knn --vpp-pmd --vpp-unsharp --vpp-deband") },
+        { _T("late"), _T("--avsw --avsw-decode-ahead 2 --thread-csp 1 --max-procfps 120 --log-level debug --perf-monitor-interval 250 --session-retry 5 --low-latency") },
+    };
+    static const int PARSE_COUNT = 20000;
+
+    _ftprintf(fp, _T("sample,args,parses,us/parse,ns/arg,us/cached,roundtrip\n"));
+    int ret = 0;
+    for (const auto& sample : SAMPLES) {
+        const auto args = parse_cmd_bench_split(sample[1]);
+        const int argCount = (int)args.size() - 2;
+
+        //parse_cmd -> gen_cmd -> parse_cmdで、同じパラメータが得られることを確認する
+        bool roundtrip = true;
+        const ParseCmdBenchResult result1(args);
+        if (!result1.ok) {
+            roundtrip = false;
+            _ftprintf(stderr, _T("%s: failed to parse\n  %s\n"), sample[0], sample[1]);
+        }
+        for (const bool save_disabled_prm : { false, true }) {
+            const auto cmd = gen_cmd(&result1.prm, result1.codecPrm, save_disabled_prm);
+            const ParseCmdBenchResult result2(parse_cmd_bench_split(cmd));
+            const TCHAR *diff = parse_cmd_bench_diff(&result1.prm, result1.codecPrm, &result2.prm, result2.codecPrm);
+            if (!result2.ok || diff != nullptr) {
+                roundtrip = false;
+                _ftprintf(stderr, _T("%s: round trip failed (save_disabled_prm=%d): %s\n  %s\n"), sample[0], save_disabled_prm ? 1 : 0,
+                    (diff) ? diff : _T("failed to parse"), cmd.c_str());
+            }
+        }
+
+        //parse_cmd_cachedのキャッシュから得たパラメータも、解析したパラメータと一致することを確認する
+        //(先頭はプログラム名として扱われるので、空白を入れておく)
+        const std::string cmda = " " + tchar_to_string(sample[1]);
+        InEncodeVideoParam prmCached;
+        NV_ENC_CODEC_CONFIG codecPrmCached[2];
+        ParseCmdError errCached;
+        for (int i = 0; i < 2; i++) {
+            const int retCached = parse_cmd_cached(&prmCached, codecPrmCached, cmda.c_str(), errCached);
+            const TCHAR *diff = parse_cmd_bench_diff(&result1.prm, result1.codecPrm, &prmCached, codecPrmCached);
+            if (retCached != 0 || diff != nullptr) {
+                roundtrip = false;
+                _ftprintf(stderr, _T("%s: cached parse (%s) differs: %s\n"), sample[0], (i) ? _T("hit") : _T("miss"),
+                    (diff) ? diff : _T("failed to parse"));
+            }
+        }
+
+        //同じ内容を上書きするだけなので、パラメータは使いまわす
+        InEncodeVideoParam prm;
+        NV_ENC_CODEC_CONFIG codecPrm[2] = { 0 };
+        codecPrm[NV_ENC_H264] = DefaultParamH264();
+        codecPrm[NV_ENC_HEVC] = DefaultParamHEVC();
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < PARSE_COUNT; i++) {
+            parse_cmd_bench_parse(&prm, codecPrm, args);
+        }
+        const double sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        const auto startCached = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < PARSE_COUNT; i++) {
+            parse_cmd_cached(&prmCached, codecPrmCached, cmda.c_str(), errCached);
+        }
+        const double secCached = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startCached).count();
+        _ftprintf(fp, _T("%s,%d,%d,%.3f,%.1f,%.3f,%s\n"), sample[0], argCount, PARSE_COUNT,
+            sec * 1e6 / PARSE_COUNT, sec * 1e9 / ((double)PARSE_COUNT * argCount), secCached * 1e6 / PARSE_COUNT, (roundtrip) ? _T("OK") : _T("NG"));
+        fflush(fp);
+        if (!roundtrip) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
 #undef SET_ERR
\ No newline at end of file
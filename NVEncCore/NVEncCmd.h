@@ -46,6 +46,13 @@ struct ParseCmdError {
 int parse_cmd(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, int nArgNum, const TCHAR **strInput, ParseCmdError& err, bool ignore_parse_err = false);
 int parse_cmd(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, const char *cmda, ParseCmdError& err, bool ignore_parse_err = false);
 
+//既定値のパラメータにcmdaを解析した結果を返す (pParams, codecPrmの入力値は使用しない)
+//同じコマンドラインの解析結果は保持しておき、2回目以降はコピーして返す
+int parse_cmd_cached(InEncodeVideoParam *pParams, NV_ENC_CODEC_CONFIG *codecPrm, const char *cmda, ParseCmdError& err);
+
 tstring gen_cmd(const InEncodeVideoParam *pParams, const NV_ENC_CODEC_CONFIG codecPrm[2], bool save_disabled_prm);
 
+//代表的なコマンドラインのparse_cmdの速度を計測し、gen_cmdとの往復で同じパラメータが得られるかを確認してCSVで出力する
+int parse_cmd_bench(FILE *fp);
+
 #endif //__NVENC_PARSE_CMD_H__
\ No newline at end of file
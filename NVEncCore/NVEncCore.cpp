@@ -57,8 +57,10 @@
 #include "rgy_input_avs.h"
 #include "rgy_input_vpy.h"
 #include "rgy_input_avcodec.h"
+#include "rgy_input_sm.h"
 #include "rgy_output.h"
 #include "rgy_output_avcodec.h"
+#include "rgy_thread_pool.h"
 #include "NVEncParam.h"
 #include "NVEncUtil.h"
 #include "NVEncFilter.h"
@@ -76,7 +78,9 @@
 #include "NVEncFilterColorspace.h"
 #include "NVEncFilterSubburn.h"
 #include "NVEncFilterSelectEvery.h"
+#include "NVEncFilterCpuVpp.h"
 #include "NVEncFeature.h"
+#include "NVEncCmd.h"
 #include "chapter_rw.h"
 #include "helper_cuda.h"
 #include "helper_nvenc.h"
@@ -245,6 +249,32 @@ bool check_if_nvcuda_dll_available() {
     return true;
 }
 
+int getNVDriverVersion(const std::string& pciBusId, int deviceId) {
+    int version = 0;
+#if ENABLE_NVML
+    {
+        NVMLMonitor nvml_monitor;
+        if (NVML_SUCCESS != nvml_monitor.Init(pciBusId)
+            || NVML_SUCCESS != nvml_monitor.getDriverVersionx1000(version)) {
+            version = 0;
+        }
+    }
+#endif //#if ENABLE_NVML
+    if (version == 0) {
+        TCHAR buffer[1024];
+        if (0 == getGPUInfo(GPU_VENDOR, buffer, _countof(buffer), deviceId, true, true)) {
+            try {
+                version = (int)(std::stod(buffer) * 1000.0 + 0.5);
+            } catch (...) {
+            }
+        }
+    }
+    if (0 < version && version < NV_DRIVER_VER_MIN) {
+        version = -1;
+    }
+    return version;
+}
+
 NVEncoderGPUInfo::NVEncoderGPUInfo(int deviceId, bool getFeatures) {
     CUresult cuResult = CUDA_SUCCESS;
 
@@ -283,34 +313,23 @@ NVEncoderGPUInfo::NVEncoderGPUInfo(int deviceId, bool getFeatures) {
             gpu.compute_capability.second = devProp.minor;
             gpu.clock_rate = devProp.clockRate;
             gpu.cuda_cores = _ConvertSMVer2Cores(devProp.major, devProp.minor) * devProp.multiProcessorCount;
-            gpu.nv_driver_version = INT_MAX;
+            gpu.nv_driver_version = getNVDriverVersion(gpu.pciBusId, currentDevice);
+            if (gpu.nv_driver_version == 0) {
+                gpu.nv_driver_version = INT_MAX;
+            }
             gpu.pcie_gen = 0;
             gpu.pcie_link = 0;
 #if ENABLE_NVML
             {
-                int version = 0, pcie_gen = 0, pcie_link = 0;
+                int pcie_gen = 0, pcie_link = 0;
                 NVMLMonitor nvml_monitor;
                 if (NVML_SUCCESS == nvml_monitor.Init(gpu.pciBusId)
-                    && NVML_SUCCESS == nvml_monitor.getDriverVersionx1000(version)
                     && NVML_SUCCESS == nvml_monitor.getMaxPCIeLink(pcie_gen, pcie_link)) {
-                    gpu.nv_driver_version = version;
                     gpu.pcie_gen = pcie_gen;
                     gpu.pcie_link = pcie_link;
                 }
             }
 #endif //#if ENABLE_NVML
-            if (gpu.nv_driver_version == INT_MAX) {
-                TCHAR buffer[1024];
-                if (0 == getGPUInfo(GPU_VENDOR, buffer, _countof(buffer), currentDevice, true, true)) {
-                    try {
-                        gpu.nv_driver_version = (int)(std::stod(buffer) * 1000.0 + 0.5);
-                    } catch (...) {
-                    }
-                }
-            }
-            if (0 < gpu.nv_driver_version && gpu.nv_driver_version < NV_DRIVER_VER_MIN) {
-                gpu.nv_driver_version = -1;
-            }
 
             gpu.cuda_driver_version = 0;
             if (CUDA_SUCCESS != (cuResult = cuDriverGetVersion(&gpu.cuda_driver_version))) {
@@ -360,12 +379,21 @@ NVEncCore::NVEncCore() {
     m_keyOnChapter = false;
 #endif
     m_appliedDynamicRC = DYNAMIC_PARAM_NOT_SELECTED;
+    m_lowLatency = false;
+    m_pipelineDepth = PIPELINE_DEPTH;
+    m_encodeNeedMoreInput = false;
+    m_latencyFrames = 0;
+    m_latencySum = 0.0;
+    m_latencyMax = 0.0;
+    m_ladderParent = nullptr;
+    m_ladderEncodeFrames = 0;
 
     INIT_CONFIG(m_stCreateEncodeParams, NV_ENC_INITIALIZE_PARAMS);
     INIT_CONFIG(m_stEncConfig, NV_ENC_CONFIG);
 
     memset(&m_stEOSOutputBfr, 0, sizeof(m_stEOSOutputBfr));
     memset(&m_stEncodeBuffer, 0, sizeof(m_stEncodeBuffer));
+    memset(&m_segmentCodecPrm, 0, sizeof(m_segmentCodecPrm));
 }
 
 NVEncCore::~NVEncCore() {
@@ -410,16 +438,15 @@ void NVEncCore::PrintMes(int logLevel, const TCHAR *format, ...) {
     va_list args;
     va_start(args, format);
 
-    int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-    vector<TCHAR> buffer(len, 0);
-    _vstprintf_s(buffer.data(), len, format, args);
-    va_end(args);
-
     if (m_pNVLog.get() != nullptr) {
-        m_pNVLog->write(logLevel, buffer.data());
+        m_pNVLog->write_va(logLevel, nullptr, format, args);
     } else {
+        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
+        vector<TCHAR> buffer(len, 0);
+        _vstprintf_s(buffer.data(), len, format, args);
         _ftprintf(stderr, _T("%s"), buffer.data());
     }
+    va_end(args);
 }
 
 void NVEncCore::NVPrintFuncError(const TCHAR *funcName, NVENCSTATUS nvStatus) {
@@ -433,7 +460,7 @@ void NVEncCore::NVPrintFuncError(const TCHAR *funcName, CUresult code) {
 //ログを初期化
 NVENCSTATUS NVEncCore::InitLog(const InEncodeVideoParam *inputParam) {
     //ログの初期化
-    m_pNVLog.reset(new RGYLog(inputParam->logfile.c_str(), inputParam->loglevel));
+    m_pNVLog.reset(new RGYLog(inputParam->logfile.c_str(), inputParam->loglevel, inputParam->logMode));
     if (inputParam->logfile.length()) {
         m_pNVLog->writeFileHeader(inputParam->outputFilename.c_str());
     }
@@ -562,11 +589,20 @@ NVENCSTATUS NVEncCore::InitInput(InEncodeVideoParam *inputParam) {
         PrintMes(RGY_LOG_ERROR, _T("avsw reader not compiled in this binary.\n"));
         return NV_ENC_ERR_UNSUPPORTED_PARAM;
     }
+    if (inputParam->input.type == RGY_INPUT_FMT_SM && !ENABLE_SM_READER) {
+        PrintMes(RGY_LOG_ERROR, _T("shared memory reader not compiled in this binary.\n"));
+        return NV_ENC_ERR_UNSUPPORTED_PARAM;
+    }
 
+    //--thread-cspで2以上が指定された場合は、色変換とCPUフィルタで共有するスレッドプールもその数とする
+    if (inputParam->threadCsp > 1) {
+        RGYThreadPool::setThreads(inputParam->threadCsp);
+    }
     RGYInputPrm inputPrm;
     inputPrm.threadCsp = inputParam->threadCsp;
     inputPrm.simdCsp = inputParam->simdCsp;
     RGYInputPrm *pInputPrm = &inputPrm;
+    RGYInputRawPrm inputPrmRaw(inputPrm);
 
     auto subBurnTrack = std::make_unique<SubtitleSelect>();
     SubtitleSelect *subBurnTrackPtr = subBurnTrack.get();
@@ -641,16 +677,27 @@ NVENCSTATUS NVEncCore::InitInput(InEncodeVideoParam *inputParam) {
         inputInfoAVCuvid.nAVSyncMode = RGY_AVSYNC_ASSUME_CFR;
         inputInfoAVCuvid.fSeekSec = inputParam->fSeekSec;
         inputInfoAVCuvid.pFramePosListLog = inputParam->sFramePosListLog.c_str();
+        inputInfoAVCuvid.pIndexFile = (inputParam->inputIndex) ? inputParam->inputIndexFile.c_str() : nullptr;
         inputInfoAVCuvid.nInputThread = inputParam->nInputThread;
         inputInfoAVCuvid.pQueueInfo = (m_pPerfMonitor) ? m_pPerfMonitor->GetQueueInfoPtr() : nullptr;
         inputInfoAVCuvid.pHWDecCodecCsp = &HWDecCodecCsp;
         inputInfoAVCuvid.bVideoDetectPulldown = !inputParam->vpp.rff && !inputParam->vpp.afs.enable && inputParam->nAVSyncMode == RGY_AVSYNC_ASSUME_CFR;
         inputInfoAVCuvid.caption2ass = inputParam->caption2ass;
+        //低遅延モードでは、色変換と重ねるための1フレームのみ先行してデコードする
+        inputInfoAVCuvid.nDecodeAhead = (inputParam->lowLatency) ? std::min(inputParam->avswDecodeAhead, 1) : inputParam->avswDecodeAhead;
+        inputInfoAVCuvid.nDecodeThreads = inputParam->avswThreads;
+        inputInfoAVCuvid.nDecodeThreadType = inputParam->avswThreadType;
         pInputPrm = &inputInfoAVCuvid;
         PrintMes(RGY_LOG_DEBUG, _T("avhw reader selected.\n"));
         m_pFileReader.reset(new RGYInputAvcodec());
         } break;
 #endif //#if ENABLE_AVSW_READER
+#if ENABLE_SM_READER
+    case RGY_INPUT_FMT_SM:
+        PrintMes(RGY_LOG_DEBUG, _T("shared memory reader selected.\n"));
+        m_pFileReader.reset(new RGYInputSM());
+        break;
+#endif //ENABLE_SM_READER
     case RGY_INPUT_FMT_RAW:
     case RGY_INPUT_FMT_Y4M:
     default: {
@@ -659,6 +706,9 @@ NVENCSTATUS NVEncCore::InitInput(InEncodeVideoParam *inputParam) {
             PrintMes(RGY_LOG_ERROR, _T("Please set fps when using raw input.\n"));
             return NV_ENC_ERR_UNSUPPORTED_PARAM;
         }
+        inputPrmRaw.readMode = (RGYInputReadMode)inputParam->inputReadMode;
+        inputPrmRaw.readAhead = inputParam->inputReadAhead;
+        pInputPrm = &inputPrmRaw;
         PrintMes(RGY_LOG_DEBUG, _T("raw/y4m reader selected.\n"));
         m_pFileReader.reset(new RGYInputRaw());
         break; }
@@ -677,7 +727,10 @@ NVENCSTATUS NVEncCore::InitInput(InEncodeVideoParam *inputParam) {
     sourceDataTrackIdStart     += m_pFileReader->GetDataTrackCount();
 
     //ユーザー指定のオプションを必要に応じて復元する
-    inputParam->input.picstruct = inputParamCopy.picstruct;
+    //smリーダーは、指定がなければ共有メモリのヘッダのpicstructを使用する
+    if (inputParam->input.type != RGY_INPUT_FMT_SM || inputParamCopy.picstruct != RGY_PICSTRUCT_UNKNOWN) {
+        inputParam->input.picstruct = inputParamCopy.picstruct;
+    }
     if (inputParamCopy.fpsN * inputParamCopy.fpsD > 0) {
         inputParam->input.fpsN = inputParamCopy.fpsN;
         inputParam->input.fpsD = inputParamCopy.fpsD;
@@ -802,15 +855,12 @@ NVENCSTATUS NVEncCore::InitInput(InEncodeVideoParam *inputParam) {
             return NV_ENC_ERR_GENERIC;
         }
         m_hdr10plus = std::make_unique<RGYHDR10Plus>();
-        ret = m_hdr10plus->init(inputParam->dynamicHdr10plusJson);
-        if (ret == RGY_ERR_NOT_FOUND) {
-            PrintMes(RGY_LOG_ERROR, _T("Cannot find \"%s\" required for --dhdr10-info.\n"), RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME);
-            return NV_ENC_ERR_GENERIC;
-        } else if (ret != RGY_ERR_NONE) {
+        ret = m_hdr10plus->init(inputParam->dynamicHdr10plusJson, m_pNVLog);
+        if (ret != RGY_ERR_NONE) {
             PrintMes(RGY_LOG_ERROR, _T("Failed to initialize hdr10plus reader: %s.\n"), get_err_mes((RGY_ERR)ret));
             return NV_ENC_ERR_GENERIC;
         }
-        PrintMes(RGY_LOG_DEBUG, _T("initialized hdr10plus reader: %s\n"), inputParam->dynamicHdr10plusJson.c_str());
+        PrintMes(RGY_LOG_DEBUG, _T("initialized hdr10plus reader: %s, %d frames\n"), inputParam->dynamicHdr10plusJson.c_str(), m_hdr10plus->frameCount());
     }
 #endif //#if ENABLE_AVSW_READER
     return NV_ENC_SUCCESS;
@@ -848,9 +898,12 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
         if (pAVCodecReader != nullptr) {
             //caption2ass用の解像度情報の提供
             //これをしないと入力ファイルのデータをずっとバッファし続けるので注意
-            pAVCodecReader->setOutputVideoInfo(m_uEncWidth, m_uEncHeight,
-                m_sar.n(), m_sar.d(),
-                (inputParams->nAVMux & RGY_MUX_VIDEO) != 0);
+            //--ladderの段では、親の出力の情報を上書きしないようにする
+            if (m_ladderParent == nullptr) {
+                pAVCodecReader->setOutputVideoInfo(m_uEncWidth, m_uEncHeight,
+                    m_sar.n(), m_sar.d(),
+                    (inputParams->nAVMux & RGY_MUX_VIDEO) != 0);
+            }
             inputFileDuration = pAVCodecReader->GetInputVideoDuration();
         }
     }
@@ -873,6 +926,7 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
         writerPrm.bVideoDtsUnavailable    = false;
         writerPrm.nOutputThread           = inputParams->nOutputThread;
         writerPrm.nAudioThread            = inputParams->nAudioThread;
+        writerPrm.nAudioTrackThread       = inputParams->nAudioTrackThread;
         writerPrm.nBufSizeMB              = inputParams->nOutputBufSizeMB;
         writerPrm.nAudioResampler         = inputParams->nAudioResampler;
         writerPrm.nAudioIgnoreDecodeError = inputParams->nAudioIgnoreDecodeError;
@@ -881,6 +935,7 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
         writerPrm.rBitstreamTimebase      = av_make_q(m_outputTimebase);
         writerPrm.pHEVCHdrSei             = &hedrsei;
         writerPrm.videoCodecTag           = inputParams->videoCodecTag;
+        writerPrm.lowLatency              = inputParams->lowLatency;
         if (inputParams->pMuxOpt > 0) {
             writerPrm.vMuxOpt = *inputParams->pMuxOpt;
         }
@@ -896,7 +951,16 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
             writerPrm.nVideoInputFirstKeyPts = pAVCodecReader->GetVideoFirstKeyPts();
             writerPrm.pVideoInputStream = pAVCodecReader->GetInputVideoStream();
         }
-        if (inputParams->nAVMux & (RGY_MUX_AUDIO | RGY_MUX_SUBTITLE)) {
+        //--ladderの段では、親の出力で処理済みの音声をそのままコピーする
+        auto pLadderParentWriter = (m_ladderParent) ? std::dynamic_pointer_cast<RGYOutputAvcodec>(m_ladderParent->m_pFileWriter) : nullptr;
+        if (pLadderParentWriter) {
+            for (const auto& stream : pLadderParentWriter->GetAudioMirrorStreams()) {
+                AVOutputStreamPrm prm;
+                prm.src = stream;
+                PrintMes(RGY_LOG_DEBUG, _T("Output: Added audio track#%d from ladder parent for mux.\n"), trackID(stream.nTrackId));
+                writerPrm.inputStreamList.push_back(std::move(prm));
+            }
+        } else if (inputParams->nAVMux & (RGY_MUX_AUDIO | RGY_MUX_SUBTITLE)) {
             PrintMes(RGY_LOG_DEBUG, _T("Output: Audio/Subtitle muxing enabled.\n"));
             for (int i = 0; !audioCopyAll && i < inputParams->nAudioSelectCount; i++) {
                 //トラック"0"が指定されていれば、すべてのトラックをコピーするということ
@@ -1029,6 +1093,8 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
             return NV_ENC_ERR_GENERIC;
         } else if (inputParams->nAVMux & (RGY_MUX_AUDIO | RGY_MUX_SUBTITLE)) {
             m_pFileWriterListAudio.push_back(m_pFileWriter);
+        } else if (pLadderParentWriter && writerPrm.inputStreamList.size() > 0) {
+            pLadderParentWriter->AddAudioMirror(dynamic_cast<RGYOutputAvcodec *>(m_pFileWriter.get()));
         }
         stdoutUsed = m_pFileWriter->outputStdout();
         PrintMes(RGY_LOG_DEBUG, _T("Output: Initialized avformat writer%s.\n"), (stdoutUsed) ? _T("using stdout") : _T(""));
@@ -1043,6 +1109,7 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
         rawPrm.bBenchmark = false;
         rawPrm.codecId = inputParams->codec == NV_ENC_H264 ? RGY_CODEC_H264 : RGY_CODEC_HEVC;
         rawPrm.seiNal = hedrsei.gen_nal();
+        rawPrm.lowLatency = inputParams->lowLatency;
         sts = m_pFileWriter->Init(inputParams->outputFilename.c_str(), &outputVideoInfo, &rawPrm, m_pNVLog, m_pStatus);
         if (sts != 0) {
             PrintMes(RGY_LOG_ERROR, m_pFileWriter->GetOutputMessage());
@@ -1099,7 +1166,9 @@ NVENCSTATUS NVEncCore::InitOutput(InEncodeVideoParam *inputParams, NV_ENC_BUFFER
                 AvcodecWriterPrm writerAudioPrm;
                 writerAudioPrm.nOutputThread   = inputParams->nOutputThread;
                 writerAudioPrm.nAudioThread    = inputParams->nAudioThread;
+                writerAudioPrm.nAudioTrackThread = inputParams->nAudioTrackThread;
                 writerAudioPrm.nBufSizeMB      = inputParams->nOutputBufSizeMB;
+                writerAudioPrm.lowLatency      = inputParams->lowLatency;
                 writerAudioPrm.outputFormat   = pAudioSelect->extractFormat;
                 writerAudioPrm.nAudioIgnoreDecodeError = inputParams->nAudioIgnoreDecodeError;
                 writerAudioPrm.nAudioResampler = inputParams->nAudioResampler;
@@ -1528,6 +1597,7 @@ NVENCSTATUS NVEncCore::ProcessOutput(const EncodeBuffer *pEncodeBuffer) {
             return NV_ENC_ERR_INVALID_PARAM;
         }
         NVTXRANGE(ProcessOutputWait);
+        RGY_PERF_TRACE_SCOPE(traceWait, RGY_TRACE_OUTPUT_WAIT, -1, RGY_PERF_TRACE_NO_PTS);
         WaitForSingleObject(pEncodeBuffer->stOutputBfr.hOutputEvent, INFINITE);
     }
 
@@ -1535,6 +1605,7 @@ NVENCSTATUS NVEncCore::ProcessOutput(const EncodeBuffer *pEncodeBuffer) {
         return NV_ENC_SUCCESS;
 
     NVTXRANGE(ProcessOutput);
+    RGY_PERF_TRACE_SCOPE(traceOutput, RGY_TRACE_OUTPUT, -1, RGY_PERF_TRACE_NO_PTS);
     NV_ENC_LOCK_BITSTREAM lockBitstreamData;
     INIT_CONFIG(lockBitstreamData, NV_ENC_LOCK_BITSTREAM);
     lockBitstreamData.outputBitstream = pEncodeBuffer->stOutputBfr.hBitstreamBuffer;
@@ -1542,8 +1613,23 @@ NVENCSTATUS NVEncCore::ProcessOutput(const EncodeBuffer *pEncodeBuffer) {
 
     NVENCSTATUS nvStatus = m_pEncodeAPI->nvEncLockBitstream(m_hEncoder, &lockBitstreamData);
     if (nvStatus == NV_ENC_SUCCESS) {
+        RGY_PERF_TRACE_SET_FRAME(traceOutput, (int)lockBitstreamData.frameIdx, (int64_t)lockBitstreamData.outputTimeStamp);
         RGYBitstream bitstream = RGYBitstreamInit(lockBitstreamData);
         m_pFileWriter->WriteNextFrame(&bitstream);
+        if (m_lowLatency) {
+            //フレームを読み込んでから出力し終わるまでの遅延
+            auto encTime = m_latencyEncTime.find(lockBitstreamData.outputTimeStamp);
+            if (encTime != m_latencyEncTime.end()) {
+                const double latency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - encTime->second).count();
+                PrintMes(RGY_LOG_DEBUG, _T("frame %d: latency %.2f ms.\n"), m_latencyFrames, latency);
+                m_latencyFrames++;
+                m_latencySum += latency;
+                m_latencyMax = std::max(m_latencyMax, latency);
+                //Bフレームの並べ替えにより、より小さいtimestampのフレームがまだ出力されていないことがあるので、
+                //出力されたフレームのものだけを削除する
+                m_latencyEncTime.erase(encTime);
+            }
+        }
         nvStatus = m_pEncodeAPI->nvEncUnlockBitstream(m_hEncoder, pEncodeBuffer->stOutputBfr.hBitstreamBuffer);
     } else {
         NVPrintFuncError(_T("nvEncLockBitstream"), nvStatus);
@@ -1577,19 +1663,42 @@ NVENCSTATUS NVEncCore::FlushEncoder() {
 NVENCSTATUS NVEncCore::Deinitialize() {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
 
+    //--ladderの段のスレッドを先に停止する
+    m_ladder.reset();
     m_hdr10plus.reset();
     m_AudioReaders.clear();
     m_pFileReader.reset();
-    m_pFileWriter.reset();
-    m_pFileWriterListAudio.clear();
-
-    if (m_vpFilters.size()) {
+    //段の出力は親の出力の音声ストリームを参照するので、Encode()と同じ順序で閉じる
+    ladder_close_outputs((int)m_ladderRungs.size(),
+        [this]() { if (m_pFileWriter) { m_pFileWriter->WaitFin(); } },
+        [this](int rung) { m_ladderRungs[rung].reset(); },
+        [this]() { m_pFileWriter.reset(); m_pFileWriterListAudio.clear(); });
+    m_ladderRungs.clear();
+    m_ladderPrm.clear();
+
+    if (m_vpFilters.size() || m_ladderFrames.size()) {
         NVEncCtxAutoLock(ctxlock(m_ctxLock));
         m_vpFilters.clear();
+        m_ladderFrames.clear();
     }
     ReleaseIOBuffers();
 
+    //入力/出力/フィルタのスレッドに加え、カウンタを書き込むm_pPerfMonitorのスレッドも停止してから閉じる
+    if (m_perfTrace) {
+        if (m_pPerfMonitor) {
+            m_pPerfMonitor->clear();
+        }
+        PrintMes(RGY_LOG_DEBUG, _T("Closing perf trace...\n"));
+        m_perfTrace.reset();
+    }
+
     nvStatus = NvEncDestroyEncoder();
+    if (m_ladderParent) {
+        //CUDAコンテキストとロックは親のものなので、ここでは破棄しない
+        m_ctxLock = nullptr;
+        m_pDevice = nullptr;
+        m_ladderParent = nullptr;
+    }
 
 #if ENABLE_AVSW_READER
     m_cuvidDec.reset();
@@ -1613,7 +1722,16 @@ NVENCSTATUS NVEncCore::Deinitialize() {
     }
 
     PrintMes(RGY_LOG_DEBUG, _T("Closing perf monitor...\n"));
+    if (m_metrics && m_pPerfMonitor) {
+        //m_pPerfMonitorは他からも参照されている場合があるので、
+        //metricsを終了する前に、スナップショットを書き込むスレッドを確実に停止させる
+        m_pPerfMonitor->clear();
+    }
     m_pPerfMonitor.reset();
+    if (m_metrics) {
+        PrintMes(RGY_LOG_DEBUG, _T("Closing metrics server...\n"));
+        m_metrics.reset();
+    }
 
     m_pNVLog.reset();
     m_pAbortByUser = nullptr;
@@ -1709,12 +1827,13 @@ NVENCSTATUS NVEncCore::AllocateIOBuffers(uint32_t uInputWidth, uint32_t uInputHe
         m_stEncodeBuffer[i].stOutputBfr.bWaitOnEvent = true;
     }
 
+    //--ladderの段は親のフィルタ済みのフレームを受け取るので、入力用のバッファは不要
 #if ENABLE_AVSW_READER
-    if (!m_cuvidDec) {
+    if (!m_cuvidDec && m_ladderParent == nullptr) {
 #else
-    {
+    if (m_ladderParent == nullptr) {
 #endif //#if ENABLE_AVSW_READER
-        m_inputHostBuffer.resize(PIPELINE_DEPTH);
+        m_inputHostBuffer.resize(m_pipelineDepth);
         //このアライメントは読み込み時の色変換の並列化のために必要
         const int align = 64 * (RGY_CSP_BIT_DEPTH[pInputInfo->csp] > 8 ? 2 : 1);
         const int bufWidth  = pInputInfo->srcWidth  - pInputInfo->crop.e.left - pInputInfo->crop.e.right;
@@ -1969,66 +2088,26 @@ NVENCSTATUS NVEncCore::setInputFormatList(void *hEncoder, NVEncCodecFeature& cod
 NVENCSTATUS NVEncCore::GetCurrentDeviceNVEncCapability(void *hEncoder, NVEncCodecFeature& codecFeature) {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
     bool check_h264 = get_value_from_guid(codecFeature.codec, list_nvenc_codecs) == NV_ENC_H264;
-    auto add_cap_info = [&](NV_ENC_CAPS cap_id, bool for_h264_only, bool is_boolean, const TCHAR *cap_name) {
-        if (!(!check_h264 && for_h264_only)) {
+    for (int i = 0; list_nvenc_caps[i].name; i++) {
+        const auto& desc = list_nvenc_caps[i];
+        if (!(!check_h264 && desc.h264Only)) {
             NV_ENC_CAPS_PARAM param;
             INIT_CONFIG(param, NV_ENC_CAPS_PARAM);
-            param.capsToQuery = cap_id;
+            param.capsToQuery = (NV_ENC_CAPS)desc.id;
             int value = 0;
             NVENCSTATUS result = m_pEncodeAPI->nvEncGetEncodeCaps(hEncoder, codecFeature.codec, &param, &value);
             if (NV_ENC_SUCCESS == result) {
                 NVEncCap cap = { 0 };
-                cap.id = cap_id;
-                cap.isBool = is_boolean;
-                cap.name = cap_name;
+                cap.id = desc.id;
+                cap.isBool = desc.isBool;
+                cap.name = desc.name;
                 cap.value = value;
                 codecFeature.caps.push_back(cap);
             } else {
                 nvStatus = result;
             }
         }
-    };
-
-    add_cap_info(NV_ENC_CAPS_NUM_MAX_BFRAMES,              false, false, _T("Max Bframes"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_BFRAME_REF_MODE,      false, true,  _T("B Ref Mode"));
-    add_cap_info(NV_ENC_CAPS_SUPPORTED_RATECONTROL_MODES,  false, false, _T("RC Modes"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_FIELD_ENCODING,       false, true,  _T("Field Encoding"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_MONOCHROME,           false, true,  _T("MonoChrome"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_FMO,                  true,  true,  _T("FMO"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_QPELMV,               false, true,  _T("Quater-Pel MV"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_BDIRECT_MODE,         false, true,  _T("B Direct Mode"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_CABAC,                true,  true,  _T("CABAC"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_ADAPTIVE_TRANSFORM,   true,  true,  _T("Adaptive Transform"));
-    add_cap_info(NV_ENC_CAPS_NUM_MAX_TEMPORAL_LAYERS,      false, false, _T("Max Temporal Layers"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_HIERARCHICAL_PFRAMES, false, true,  _T("Hierarchial P Frames"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_HIERARCHICAL_BFRAMES, false, true,  _T("Hierarchial B Frames"));
-    add_cap_info(NV_ENC_CAPS_LEVEL_MAX,                    false, false, _T("Max Level"));
-    add_cap_info(NV_ENC_CAPS_LEVEL_MIN,                    false, false, _T("Min Level"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_YUV444_ENCODE,        false, true,  _T("4:4:4"));
-    add_cap_info(NV_ENC_CAPS_WIDTH_MAX,                    false, false, _T("Max Width"));
-    add_cap_info(NV_ENC_CAPS_HEIGHT_MAX,                   false, false, _T("Max Height"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_DYN_RES_CHANGE,       false, true,  _T("Dynamic Resolution Change"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_DYN_BITRATE_CHANGE,   false, true,  _T("Dynamic Bitrate Change"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_DYN_FORCE_CONSTQP,    false, true,  _T("Forced constant QP"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_DYN_RCMODE_CHANGE,    false, true,  _T("Dynamic RC Mode Change"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_SUBFRAME_READBACK,    false, true,  _T("Subframe Readback"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_CONSTRAINED_ENCODING, false, true,  _T("Constrained Encoding"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_INTRA_REFRESH,        false, true,  _T("Intra Refresh"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_CUSTOM_VBV_BUF_SIZE,  false, true,  _T("Custom VBV Bufsize"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_DYNAMIC_SLICE_MODE,   false, true,  _T("Dynamic Slice Mode"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION, false, true,  _T("Ref Pic Invalidiation"));
-    add_cap_info(NV_ENC_CAPS_PREPROC_SUPPORT,              false, true,  _T("PreProcess"));
-    add_cap_info(NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT,         false, true,  _T("Async Encoding"));
-    add_cap_info(NV_ENC_CAPS_MB_NUM_MAX,                   false, false, _T("Max MBs"));
-    //add_cap_info(NV_ENC_CAPS_MB_PER_SEC_MAX,               false, false, _T("MAX MB per sec"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_LOSSLESS_ENCODE,      false, true,  _T("Lossless"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_SAO,                  false, true,  _T("SAO"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_MEONLY_MODE,          false, true,  _T("Me Only Mode"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_LOOKAHEAD,            false, true,  _T("Lookahead"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_TEMPORAL_AQ,          false, true,  _T("AQ (temporal)"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_WEIGHTED_PREDICTION,  false, true,  _T("Weighted Prediction"));
-    add_cap_info(NV_ENC_CAPS_NUM_MAX_LTR_FRAMES,           false, false, _T("Max LTR Frames"));
-    add_cap_info(NV_ENC_CAPS_SUPPORT_10BIT_ENCODE,         false, true,  _T("10bit depth"));
+    }
     return nvStatus;
 }
 
@@ -2515,12 +2594,19 @@ NVENCSTATUS NVEncCore::SetInputParam(const InEncodeVideoParam *inputParam) {
     } else if (m_uEncWidth * m_uEncHeight <= 4096 * 2160) {
         extraBufSize = 2;
     }
-    int requiredBufferFrames = m_stEncConfig.frameIntervalP + 4;
+    const int baseBufferFrames = 4;
+    int requiredBufferFrames = m_stEncConfig.frameIntervalP + baseBufferFrames;
     if (m_stEncConfig.rcParams.enableLookahead) {
         requiredBufferFrames += m_stEncConfig.rcParams.lookaheadDepth;
     }
-    //PIPELINE_DEPTH分拡張しないと、バッファ不足でエンコードが止まってしまう
-    m_encodeBufferCount = requiredBufferFrames + PIPELINE_DEPTH;
+    //m_pipelineDepth分拡張しないと、バッファ不足でエンコードが止まってしまう
+    m_encodeBufferCount = requiredBufferFrames + m_pipelineDepth;
+    //Bフレームもlookaheadも使わない場合 (frameIntervalP = 1) より多く必要になるバッファは、
+    //エンコーダが出力前に保持するフレーム (bframes + lookahead) であり、その分だけ出力が遅延する
+    const int delayFrames = requiredBufferFrames - (1 + baseBufferFrames);
+    if (m_lowLatency && delayFrames > 0) {
+        PrintMes(RGY_LOG_WARN, _T("low latency mode: bframes and lookahead will delay output by %d frames.\n"), delayFrames);
+    }
     m_encodeBufferCount = std::max(m_encodeBufferCount, std::min(m_encodeBufferCount + extraBufSize, 32));
     if (m_encodeBufferCount > MAX_ENCODE_QUEUE) {
 #if FOR_AUO
@@ -2839,8 +2925,50 @@ RGY_ERR NVEncCore::InitFilters(const InEncodeVideoParam *inputParam) {
             return RGY_ERR_UNSUPPORTED;
         }
     }
+    //--vpp-cpu: 対応するフィルタをCPUで処理し、最後のフィルタでGPUに転送する
+    const bool cpuVppRequired = inputParam->vpp.cpu
+        && (resizeRequired
+            || inputParam->vpp.afs.enable
+            || inputParam->vpp.nnedi.enable
+            || inputParam->vpp.unsharp.enable
+            || inputParam->vpp.tweak.enable
+            || inputParam->vpp.pad.enable);
+    if (inputParam->vpp.cpu && !cpuVppRequired) {
+        PrintMes(RGY_LOG_WARN, _T("--vpp-cpu: no filter to run on cpu, disabled.\n"));
+    }
+    if (cpuVppRequired) {
+        //CPUで処理するにはswデコードが必要 (cuvidのcropもCPU版では扱わない)
+        if (m_pFileReader->getInputCodec() != RGY_CODEC_UNKNOWN) {
+            PrintMes(RGY_LOG_ERROR, _T("--vpp-cpu requires the input to be decoded on cpu (--avsw or raw/y4m/avs/vpy reader).\n"));
+            return RGY_ERR_UNSUPPORTED;
+        }
+        unique_ptr<NVEncFilter> filter(new NVEncFilterCpuVpp());
+        shared_ptr<NVEncFilterParamCpuVpp> param(new NVEncFilterParamCpuVpp());
+        param->vpp = inputParam->vpp;
+        param->dstWidth = (resizeRequired) ? m_uEncWidth : 0;
+        param->dstHeight = (resizeRequired) ? m_uEncHeight : 0;
+        param->inFps = m_inputFps;
+        param->timebase = m_outputTimebase;
+        param->outFilename = inputParam->outputFilename;
+        param->simd = (uint32_t)inputParam->simdCsp;
+        param->frameIn = inputFrame;
+        param->frameOut.csp = GetEncoderCSP(inputParam);
+        param->baseFps = m_encFps;
+        param->bOutOverwrite = false;
+        NVEncCtxAutoLock(cxtlock(m_ctxLock));
+        auto sts = filter->init(param, m_pNVLog);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        //フィルタチェーンに追加
+        m_vpFilters.push_back(std::move(filter));
+        //パラメータ情報を更新
+        m_pLastFilterParam = std::dynamic_pointer_cast<NVEncFilterParam>(param);
+        //入力フレーム情報を更新
+        inputFrame = param->frameOut;
+        m_encFps = param->baseFps;
     //フィルタが必要
-    if (resizeRequired
+    } else if (resizeRequired
         || cropRequired
         || inputParam->vpp.delogo.enable
         || inputParam->vpp.gaussMaskSize > 0
@@ -2858,6 +2986,7 @@ RGY_ERR NVEncCore::InitFilters(const InEncodeVideoParam *inputParam) {
         || inputParam->vpp.subburn.size() > 0
         || inputParam->vpp.rff
         || inputParam->vpp.selectevery.enable
+        || inputParam->ladder.size() > 0 //--ladderでは、最後のフィルタの前でフレームを分岐する
         ) {
         //swデコードならGPUに上げる必要がある
         if (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
@@ -3157,7 +3286,7 @@ RGY_ERR NVEncCore::InitFilters(const InEncodeVideoParam *inputParam) {
 #else
             unique_ptr<NVEncFilter> filterGauss(new NVEncFilterDenoiseGauss());
             shared_ptr<NVEncFilterParamGaussDenoise> param(new NVEncFilterParamGaussDenoise());
-            param->masksize = inputParam->vpp.gaussMaskSize;
+            param->masksize = (NppiMaskSize)inputParam->vpp.gaussMaskSize;
             param->frameIn = inputFrame;
             param->frameOut = inputFrame;
             param->baseFps = m_encFps;
@@ -3372,7 +3501,9 @@ RGY_ERR NVEncCore::InitFilters(const InEncodeVideoParam *inputParam) {
     //最後のフィルタ
     {
         //もし入力がCPUメモリで色空間が違うなら、一度そのままGPUに転送する必要がある
-        if (inputFrame.deivce_mem == false && inputFrame.csp != GetEncoderCSP(inputParam)) {
+        //--ladderでは最後のフィルタの入力をGPUから分岐するので、--vpp-cpuの出力も一度GPUに転送する
+        if (inputFrame.deivce_mem == false
+            && (inputFrame.csp != GetEncoderCSP(inputParam) || inputParam->ladder.size() > 0)) {
             unique_ptr<NVEncFilter> filterCrop(new NVEncFilterCspCrop());
             shared_ptr<NVEncFilterParamCrop> param(new NVEncFilterParamCrop());
             param->frameIn = inputFrame;
@@ -3641,6 +3772,11 @@ NVENCSTATUS NVEncCore::InitDevice(const InEncodeVideoParam *inputParam) {
     }
     PrintMes(RGY_LOG_DEBUG, _T("InitCuda: Success.\n"));
 
+    return InitNVEncInstance(inputParam->sessionRetry);
+}
+
+NVENCSTATUS NVEncCore::InitNVEncInstance(int sessionRetry) {
+    auto nvStatus = NV_ENC_SUCCESS;
     MYPROC nvEncodeAPICreateInstance; // function pointer to create instance in nvEncodeAPI
     if (NULL == (nvEncodeAPICreateInstance = (MYPROC)GetProcAddress(m_hinstLib, "NvEncodeAPICreateInstance"))) {
         PrintMes(RGY_LOG_ERROR, _T("Failed to load address of NvEncodeAPICreateInstance from %s.\n"), NVENCODE_API_DLL);
@@ -3664,7 +3800,7 @@ NVENCSTATUS NVEncCore::InitDevice(const InEncodeVideoParam *inputParam) {
     }
     PrintMes(RGY_LOG_DEBUG, _T("nvEncodeAPICreateInstance(APIVer=0x%x): Success.\n"), NV_ENCODE_API_FUNCTION_LIST_VER);
 
-    if (NV_ENC_SUCCESS != (nvStatus = NvEncOpenEncodeSessionEx(m_pDevice, NV_ENC_DEVICE_TYPE_CUDA, inputParam->sessionRetry))) {
+    if (NV_ENC_SUCCESS != (nvStatus = NvEncOpenEncodeSessionEx(m_pDevice, NV_ENC_DEVICE_TYPE_CUDA, sessionRetry))) {
         if (nvStatus == NV_ENC_ERR_INVALID_VERSION) {
             PrintMes(RGY_LOG_ERROR, _T("Failed to create instance of NvEncOpenEncodeSessionEx(device_type=NV_ENC_DEVICE_TYPE_CUDA), please consider updating your GPU driver.\n"), NV_ENCODE_API_FUNCTION_LIST_VER);
         } else {
@@ -3723,6 +3859,9 @@ NVENCSTATUS NVEncCore::InitEncode(InEncodeVideoParam *inputParam) {
     }
     m_nAVSyncMode = inputParam->nAVSyncMode;
     m_nProcSpeedLimit = inputParam->nProcSpeedLimit;
+    m_lowLatency = inputParam->lowLatency;
+    //低遅延モードでは、フレームをためずに1枚ずつエンコーダに渡す
+    m_pipelineDepth = (m_lowLatency) ? 1 : PIPELINE_DEPTH;
 
     //デコーダが使用できるか確認する必要があるので、先にGPU関係の情報を取得しておく必要がある
     NVEncoderGPUInfo gpuInfo(m_nDeviceId, true);
@@ -3823,7 +3962,17 @@ NVENCSTATUS NVEncCore::InitEncode(InEncodeVideoParam *inputParam) {
 #if ENABLE_NVML
         perfMonitorPrm.pciBusId = selectedGpu->pciBusId.c_str();
 #endif
-        if (m_pPerfMonitor->init(perfMonLog.c_str(), _T(""), (bLogOutput) ? inputParam->nPerfMonitorInterval : 1000,
+        perfMonitorPrm.metrics = m_metrics.get();
+        //--perf-trace/--metrics有効時は、キューの使用量などを細かく記録する
+        int perfMonInterval = 1000;
+        if (bLogOutput) {
+            perfMonInterval = inputParam->nPerfMonitorInterval;
+        } else if (m_perfTrace) {
+            perfMonInterval = RGY_PERF_TRACE_COUNTER_INTERVAL_MS;
+        } else if (m_metrics) {
+            perfMonInterval = RGY_METRICS_UPDATE_INTERVAL_MS;
+        }
+        if (m_pPerfMonitor->init(perfMonLog.c_str(), _T(""), perfMonInterval,
             (int)inputParam->nPerfMonitorSelect, (int)inputParam->nPerfMonitorSelectMatplot,
 #if defined(_WIN32) || defined(_WIN64)
             std::unique_ptr<void, handle_deleter>(OpenThread(SYNCHRONIZE | THREAD_QUERY_INFORMATION, false, GetCurrentThreadId()), handle_deleter()),
@@ -3899,9 +4048,318 @@ NVENCSTATUS NVEncCore::InitEncode(InEncodeVideoParam *inputParam) {
         return nvStatus;
     }
     PrintMes(RGY_LOG_DEBUG, _T("InitOutput: Success.\n"), inputParam->outputFilename.c_str());
+
+    //--ladderの各段を作成 (親の出力の音声を段の出力に渡すため、InitOutputの後に行う)
+    if (inputParam->ladder.size() > 0) {
+        if (NV_ENC_SUCCESS != (nvStatus = InitLadder(inputParam, encBufferFormat))) {
+            return nvStatus;
+        }
+        PrintMes(RGY_LOG_DEBUG, _T("InitLadder: Success.\n"));
+    }
     return nvStatus;
 }
 
+//--ladderの段では、進捗は親でまとめて表示する
+class EncodeStatusLadder : public EncodeStatus {
+public:
+    EncodeStatusLadder() : EncodeStatus() {};
+    virtual ~EncodeStatusLadder() {};
+    virtual void UpdateDisplay(const TCHAR *mes, double progressPercent = 0.0) {
+        UNREFERENCED_PARAMETER(mes);
+        UNREFERENCED_PARAMETER(progressPercent);
+    }
+    virtual RGY_ERR UpdateDisplay(double progressPercent = 0.0) {
+        UNREFERENCED_PARAMETER(progressPercent);
+        return RGY_ERR_NONE;
+    }
+};
+
+NVENCSTATUS NVEncCore::InitLadder(const InEncodeVideoParam *inputParam, NV_ENC_BUFFER_FORMAT encBufferFormat) {
+    //各段は最後のフィルタ(NVEncFilterCspCrop)の入力を受け取り、リサイズしてエンコードする
+    if (m_stPicStruct != NV_ENC_PIC_STRUCT_FRAME) {
+        PrintMes(RGY_LOG_ERROR, _T("--ladder does not support interlaced encoding.\n"));
+        return NV_ENC_ERR_UNSUPPORTED_PARAM;
+    }
+#if ENABLE_AVSW_READER
+    if (m_keyOnChapter) {
+        PrintMes(RGY_LOG_ERROR, _T("--ladder cannot be used with --key-on-chapter.\n"));
+        return NV_ENC_ERR_UNSUPPORTED_PARAM;
+    }
+#endif //#if ENABLE_AVSW_READER
+    if (m_dynamicRC.size() > 0) {
+        //--dynamic-rcは切り替え時にIDRを挿入するので、各段とキーフレームの位置がずれてしまう
+        PrintMes(RGY_LOG_ERROR, _T("--ladder cannot be used with --dynamic-rc.\n"));
+        return NV_ENC_ERR_UNSUPPORTED_PARAM;
+    }
+    if (m_hdr10plus) {
+        PrintMes(RGY_LOG_WARN, _T("--dhdr10-info is not applied to --ladder outputs.\n"));
+    }
+    if (m_vpFilters.size() < 2 || !m_vpFilters.back()->GetFilterParam()->frameIn.deivce_mem) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to find filtered frame for --ladder.\n"));
+        return NV_ENC_ERR_GENERIC;
+    }
+    for (const auto& prm : inputParam->ladder) {
+        if (inputParam->encConfig.rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP && (prm.bitrate > 0 || prm.maxBitrate > 0)) {
+            PrintMes(RGY_LOG_ERROR, _T("bitrate of --ladder cannot be set with --cqp.\n"));
+            return NV_ENC_ERR_INVALID_PARAM;
+        }
+    }
+    const auto frameIn = m_vpFilters.back()->GetFilterParam()->frameIn;
+    //各段は親と同じ表示上のアスペクト比とする
+    const auto sar = (m_sar.n() > 0 && m_sar.d() > 0) ? m_sar : rgy_rational<int>(1, 1);
+    const auto dar = rgy_rational<int>(sar.n() * (int)m_uEncWidth, sar.d() * (int)m_uEncHeight);
+    const int depth = (inputParam->ladderQueue > 0) ? inputParam->ladderQueue : RGY_LADDER_QUEUE_DEFAULT;
+    m_ladderPrm = inputParam->ladder;
+
+    for (int i = 0; i < (int)inputParam->ladder.size(); i++) {
+        const auto& prm = inputParam->ladder[i];
+        InEncodeVideoParam rungPrm = *inputParam;
+        rungPrm.outputFilename = prm.outputFilename;
+        rungPrm.input.dstWidth = prm.width;
+        rungPrm.input.dstHeight = prm.height;
+        rungPrm.input.picstruct = RGY_PICSTRUCT_FRAME;
+        rungPrm.par[0] = -dar.n();
+        rungPrm.par[1] = -dar.d();
+        if (prm.bitrate > 0) {
+            rungPrm.encConfig.rcParams.averageBitRate = prm.bitrate * 1000;
+        }
+        if (prm.maxBitrate > 0) {
+            rungPrm.encConfig.rcParams.maxBitRate = prm.maxBitrate * 1000;
+        }
+        //フィルタは親で適用済み、リサイズのみ行う
+        rungPrm.vpp = VppParam();
+        rungPrm.vpp.resizeInterp = inputParam->vpp.resizeInterp;
+        //音声は親の出力で処理したものを受け取る、字幕/データ/チャプターは出力しない
+        rungPrm.nAudioSelectCount = 0;
+        rungPrm.ppAudioSelectList = nullptr;
+        rungPrm.nAudioSourceCount = 0;
+        rungPrm.ppAudioSourceList = nullptr;
+        rungPrm.nSubtitleSelectCount = 0;
+        rungPrm.ppSubtitleSelectList = nullptr;
+        rungPrm.nDataSelectCount = 0;
+        rungPrm.ppDataSelectList = nullptr;
+        rungPrm.nAVMux &= ~(RGY_MUX_VIDEO | RGY_MUX_AUDIO | RGY_MUX_SUBTITLE);
+        rungPrm.sAVMuxOutputFormat.clear();
+        rungPrm.pMuxVidTsLogFile = nullptr;
+        rungPrm.bCopyChapter = false;
+        rungPrm.sChapterFile.clear();
+        rungPrm.dynamicRC.clear();
+        rungPrm.dynamicHdr10plusJson.clear();
+        rungPrm.keyFile.clear();
+        rungPrm.nPerfMonitorSelect = 0;
+        rungPrm.nPerfMonitorSelectMatplot = 0;
+        rungPrm.perfTraceFile.clear();
+        rungPrm.metricsListen.clear();
+        rungPrm.ladder.clear();
+        rungPrm.nOutputThread = std::max(1, inputParam->nOutputThread);
+
+        m_ladderRungs.push_back(std::unique_ptr<NVEncCore>(new NVEncCore()));
+        auto nvStatus = m_ladderRungs.back()->InitLadderRung(this, &rungPrm, frameIn, depth, encBufferFormat);
+        if (nvStatus != NV_ENC_SUCCESS) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to initialize ladder #%d: %s.\n"), i + 1, prm.print().c_str());
+            return nvStatus;
+        }
+        PrintMes(RGY_LOG_DEBUG, _T("ladder #%d: %dx%d, %s.\n"), i + 1,
+            m_ladderRungs.back()->m_uEncWidth, m_ladderRungs.back()->m_uEncHeight, prm.outputFilename.c_str());
+    }
+    m_ladder.reset(new RGYLadderFanout());
+    auto err = m_ladder->init((int)m_ladderRungs.size(), depth);
+    if (err != RGY_ERR_NONE) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to initialize ladder: %s.\n"), get_err_mes(err));
+        return err_to_nv(err);
+    }
+    PrintMes(RGY_LOG_DEBUG, _T("ladder: %d outputs, %d frames queued at most.\n"), (int)m_ladderRungs.size(), depth);
+    return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVEncCore::InitLadderRung(NVEncCore *parent, InEncodeVideoParam *inputParam, const FrameInfo& frameIn, int queueDepth, NV_ENC_BUFFER_FORMAT encBufferFormat) {
+    //CUDAコンテキスト、入力、フレームレート等は親のものを使用する
+    m_ladderParent = parent;
+    m_pNVLog = parent->m_pNVLog;
+    m_cudaSchedule = parent->m_cudaSchedule;
+    m_device = parent->m_device;
+    m_cuContextCurr = parent->m_cuContextCurr;
+    m_ctxLock = parent->m_ctxLock;
+    m_pDevice = parent->m_pDevice;
+    m_nDeviceId = parent->m_nDeviceId;
+    m_GPUList = parent->m_GPUList;
+    m_pFileReader = parent->m_pFileReader;
+    m_trimParam = parent->m_trimParam;
+    m_inputFps = parent->m_inputFps;
+    m_outputTimebase = parent->m_outputTimebase;
+    m_encFps = parent->m_encFps;
+    m_nAVSyncMode = parent->m_nAVSyncMode;
+#if ENABLE_AVSW_READER
+    //--keyfileは各段にも同じフレームに適用する
+    m_keyFile = parent->m_keyFile;
+#endif //#if ENABLE_AVSW_READER
+
+    //エンコードセッションは段ごとに作成する
+    if (NULL == (m_hinstLib = LoadLibrary(NVENCODE_API_DLL))) {
+        PrintMes(RGY_LOG_ERROR, _T("%s does not exists in your system.\n"), NVENCODE_API_DLL);
+        return NV_ENC_ERR_OUT_OF_MEMORY;
+    }
+    NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
+    if (NV_ENC_SUCCESS != (nvStatus = InitNVEncInstance(inputParam->sessionRetry))) {
+        return nvStatus;
+    }
+    if (NV_ENC_SUCCESS != (nvStatus = createDeviceFeatureList(false))) {
+        return nvStatus;
+    }
+
+    //リサイズ (親のスレッドで実行)
+    {
+        unique_ptr<NVEncFilter> filterResize(new NVEncFilterResize());
+        shared_ptr<NVEncFilterParamResize> param(new NVEncFilterParamResize());
+        param->interp = (inputParam->vpp.resizeInterp != NPPI_INTER_UNDEFINED) ? inputParam->vpp.resizeInterp : RESIZE_CUDA_SPLINE36;
+        param->frameIn = frameIn;
+        param->frameOut = frameIn;
+        param->frameOut.width = inputParam->input.dstWidth;
+        param->frameOut.height = inputParam->input.dstHeight;
+        param->baseFps = m_encFps;
+        param->bOutOverwrite = false;
+#if _M_IX86
+        if (param->interp <= NPPI_INTER_MAX) {
+            param->interp = RESIZE_CUDA_SPLINE36;
+            PrintMes(RGY_LOG_WARN, _T("npp resize filters not supported in x86, switching to %s.\n"), get_chr_from_value(list_nppi_resize, param->interp));
+        }
+#endif
+        NVEncCtxAutoLock(cxtlock(m_ctxLock));
+        auto sts = filterResize->init(param, m_pNVLog);
+        if (sts != RGY_ERR_NONE) {
+            return err_to_nv(sts);
+        }
+        m_vpFilters.push_back(std::move(filterResize));
+        m_pLastFilterParam = std::dynamic_pointer_cast<NVEncFilterParam>(param);
+    }
+    //エンコードバッファへの転送 (段のスレッドで実行)
+    {
+        unique_ptr<NVEncFilter> filterCrop(new NVEncFilterCspCrop());
+        shared_ptr<NVEncFilterParamCrop> param(new NVEncFilterParamCrop());
+        param->frameIn = m_pLastFilterParam->frameOut;
+        param->frameOut.csp = GetEncoderCSP(inputParam);
+        param->frameOut.deivce_mem = true;
+        param->bOutOverwrite = false;
+        NVEncCtxAutoLock(cxtlock(m_ctxLock));
+        auto sts = filterCrop->init(param, m_pNVLog);
+        if (sts != RGY_ERR_NONE) {
+            return err_to_nv(sts);
+        }
+        m_vpFilters.push_back(std::move(filterCrop));
+        m_pLastFilterParam = std::dynamic_pointer_cast<NVEncFilterParam>(param);
+    }
+    //リサイズしたフレームを格納するスロット
+    {
+        NVEncCtxAutoLock(cxtlock(m_ctxLock));
+        for (int i = 0; i < queueDepth; i++) {
+            unique_ptr<CUFrameBuf> slot(new CUFrameBuf(m_vpFilters.front()->GetFilterParam()->frameOut));
+            auto cudaerr = slot->alloc();
+            if (cudaerr != cudaSuccess) {
+                PrintMes(RGY_LOG_ERROR, _T("Failed to allocate memory for ladder: %s.\n"), char_to_tstring(_cudaGetErrorEnum(cudaerr)).c_str());
+                return NV_ENC_ERR_OUT_OF_MEMORY;
+            }
+            m_ladderFrames.push_back(std::move(slot));
+        }
+    }
+    m_pStatus.reset(new EncodeStatusLadder());
+
+    if (NV_ENC_SUCCESS != (nvStatus = CreateEncoder(inputParam))) {
+        return nvStatus;
+    }
+    if (NV_ENC_SUCCESS != (nvStatus = AllocateIOBuffers(m_uEncWidth, m_uEncHeight, encBufferFormat, &inputParam->input))) {
+        return nvStatus;
+    }
+    if (NV_ENC_SUCCESS != (nvStatus = InitOutput(inputParam, encBufferFormat))) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to open output file: \"%s\"\n"), inputParam->outputFilename.c_str());
+        return nvStatus;
+    }
+    return NV_ENC_SUCCESS;
+}
+
+RGY_ERR NVEncCore::LadderResizeFrame(FrameInfo *pInputFrame, int slot) {
+    NVEncCtxAutoLock(ctxlock(m_ctxLock));
+    int nOutFrames = 0;
+    FrameInfo *outInfo[16] = { 0 };
+    outInfo[0] = &m_ladderFrames[slot]->frame;
+    auto sts = m_vpFilters.front()->filter(pInputFrame, (FrameInfo **)&outInfo, &nOutFrames);
+    if (sts != RGY_ERR_NONE) {
+        PrintMes(RGY_LOG_ERROR, _T("Error while running filter \"%s\".\n"), m_vpFilters.front()->name().c_str());
+        return sts;
+    }
+    if (nOutFrames != 1) {
+        PrintMes(RGY_LOG_ERROR, _T("Unexpected number of frames from filter \"%s\": %d.\n"), m_vpFilters.front()->name().c_str(), nOutFrames);
+        return RGY_ERR_UNKNOWN;
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncCore::LadderEncodeFrame(int slot) {
+    //エンコードバッファを取得
+    EncodeBuffer *pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
+    if (!pEncodeBuffer) {
+        pEncodeBuffer = m_EncodeBufferQueue.GetPending();
+        ProcessOutput(pEncodeBuffer);
+        if (pEncodeBuffer->stInputBfr.hInputSurface) {
+            auto nvencret = NvEncUnmapInputResource(pEncodeBuffer->stInputBfr.hInputSurface);
+            if (nvencret != NV_ENC_SUCCESS) {
+                PrintMes(RGY_LOG_ERROR, _T("Failed to Unmap input buffer %p: %s\n"), pEncodeBuffer->stInputBfr.hInputSurface, char_to_tstring(_nvencGetErrorEnum(nvencret)).c_str());
+                return err_to_rgy(nvencret);
+            }
+            pEncodeBuffer->stInputBfr.hInputSurface = nullptr;
+        }
+        pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
+        if (!pEncodeBuffer) {
+            PrintMes(RGY_LOG_ERROR, _T("Error get enc buffer from queue.\n"));
+            return RGY_ERR_UNKNOWN;
+        }
+    }
+    //エンコードバッファにコピー
+    FrameInfo encFrameInfo = { 0 };
+    {
+        NVEncCtxAutoLock(ctxlock(m_ctxLock));
+        encFrameInfo.ptr = (uint8_t *)pEncodeBuffer->stInputBfr.pNV12devPtr;
+        encFrameInfo.pitch = pEncodeBuffer->stInputBfr.uNV12Stride;
+        encFrameInfo.width = pEncodeBuffer->stInputBfr.dwWidth;
+        encFrameInfo.height = pEncodeBuffer->stInputBfr.dwHeight;
+        encFrameInfo.deivce_mem = true;
+        encFrameInfo.csp = getEncCsp(pEncodeBuffer->stInputBfr.bufferFmt);
+        int nOutFrames = 0;
+        FrameInfo *outInfo[16] = { 0 };
+        outInfo[0] = &encFrameInfo;
+        auto sts = m_vpFilters.back()->filter(&m_ladderFrames[slot]->frame, (FrameInfo **)&outInfo, &nOutFrames);
+        if (sts != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("Error while running filter \"%s\".\n"), m_vpFilters.back()->name().c_str());
+            return sts;
+        }
+        auto cudaret = cudaEventRecord(m_ladderFrames[slot]->event);
+        if (cudaret != cudaSuccess) {
+            PrintMes(RGY_LOG_ERROR, _T("Error cudaEventRecord: %d (%s).\n"), cudaret, char_to_tstring(_cudaGetErrorEnum(cudaret)).c_str());
+            return RGY_ERR_CUDA;
+        }
+    }
+    //スロットはこの関数から戻ると再利用されるので、転送の完了を待機する
+    cudaEventSynchronize(m_ladderFrames[slot]->event);
+    auto nvencret = NvEncMapInputResource(pEncodeBuffer->stInputBfr.nvRegisteredResource, &pEncodeBuffer->stInputBfr.hInputSurface);
+    if (nvencret != NV_ENC_SUCCESS) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to Map input buffer %p\n"), pEncodeBuffer->stInputBfr.hInputSurface);
+        return err_to_rgy(nvencret);
+    }
+    return err_to_rgy(NvEncEncodeFrame(pEncodeBuffer, m_ladderEncodeFrames++, encFrameInfo.timestamp, encFrameInfo.duration, encFrameInfo.inputFrameId));
+}
+
+void NVEncCore::LadderClose() {
+#if ENABLE_AVSW_READER
+    //親の出力から渡された音声を書き出す
+    auto pAVCodecWriter = std::dynamic_pointer_cast<RGYOutputAvcodec>(m_pFileWriter);
+    if (pAVCodecWriter && pAVCodecWriter->GetStreamTrackIdList().size() > 0) {
+        pAVCodecWriter->WriteNextPacket(nullptr);
+    }
+#endif //#if ENABLE_AVSW_READER
+    if (m_pFileWriter) {
+        m_pFileWriter->Close();
+    }
+}
+
 NVENCSTATUS NVEncCore::Initialize(InEncodeVideoParam *inputParam) {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
 
@@ -3930,10 +4388,29 @@ NVENCSTATUS NVEncCore::Initialize(InEncodeVideoParam *inputParam) {
     m_nDeviceId = inputParam->deviceID;
     //入力などにも渡すため、まずはインスタンスを作っておく必要がある
     m_pPerfMonitor = std::unique_ptr<CPerfMonitor>(new CPerfMonitor());
+#if ENABLE_PERF_TRACE
+    if (inputParam->perfTraceFile.length() > 0) {
+        //入力/出力のスレッドも記録するため、それらの初期化より前に開始する
+        m_perfTrace = std::unique_ptr<RGYPerfTrace>(new RGYPerfTrace());
+        if (m_perfTrace->init(inputParam->perfTraceFile, m_pNVLog) != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_WARN, _T("Failed to initialize perf-trace, disabled.\n"));
+            m_perfTrace.reset();
+        }
+    }
+#endif //#if ENABLE_PERF_TRACE
+    if (inputParam->metricsListen.length() > 0) {
+        //CPerfMonitorの初期化時に渡すため、それより前に開始する
+        m_metrics = std::unique_ptr<RGYMetricsServer>(new RGYMetricsServer());
+        if (m_metrics->init(inputParam->metricsListen, m_pNVLog) != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to start metrics server on \"%s\".\n"), inputParam->metricsListen.c_str());
+            return NV_ENC_ERR_INVALID_PARAM;
+        }
+    }
     return nvStatus;
 }
 
 NVENCSTATUS NVEncCore::NvEncEncodeFrame(EncodeBuffer *pEncodeBuffer, int id, uint64_t timestamp, uint64_t duration, int inputFrameId) {
+    RGY_PERF_TRACE_SCOPE(traceEncode, RGY_TRACE_ENCODE, inputFrameId, (int64_t)timestamp);
 
     NV_ENC_PIC_PARAMS encPicParams;
     INIT_CONFIG(encPicParams, NV_ENC_PIC_PARAMS);
@@ -4014,16 +4491,15 @@ NVENCSTATUS NVEncCore::NvEncEncodeFrame(EncodeBuffer *pEncodeBuffer, int id, uin
     }
 #endif //#if ENABLE_AVSW_READER
     vector<NV_ENC_SEI_PAYLOAD> sei_payload;
-    vector<uint8_t> dhdr10plus_sei;
     const int codec = get_value_from_guid(m_stCodecGUID, list_nvenc_codecs);
     if (codec == NV_ENC_HEVC && m_hdr10plus) {
-        const auto data = m_hdr10plus->getData(inputFrameId);
-        if (data && data->size() > 0) {
-            dhdr10plus_sei = *data;
-
+        size_t data_size = 0;
+        const auto data = m_hdr10plus->getData(inputFrameId, &data_size);
+        if (data && data_size > 0) {
+            //ペイロードはm_hdr10plusが保持しているので、コピーせずにそのまま渡す
             NV_ENC_SEI_PAYLOAD payload;
-            payload.payload = dhdr10plus_sei.data();
-            payload.payloadSize = (uint32_t)dhdr10plus_sei.size();
+            payload.payload = const_cast<uint8_t *>(data);
+            payload.payloadSize = (uint32_t)data_size;
             payload.payloadType = USER_DATA_REGISTERED_ITU_T_T35;
             sei_payload.push_back(payload);
 
@@ -4066,6 +4542,8 @@ NVENCSTATUS NVEncCore::NvEncEncodeFrame(EncodeBuffer *pEncodeBuffer, int id, uin
     //}
 
     NVENCSTATUS nvStatus = m_pEncodeAPI->nvEncEncodePicture(m_hEncoder, &encPicParams);
+    //NV_ENC_SUCCESSなら、これまでに渡したフレームはすべて出力可能になる
+    m_encodeNeedMoreInput = (nvStatus == NV_ENC_ERR_NEED_MORE_INPUT);
     if (nvStatus != NV_ENC_SUCCESS && nvStatus != NV_ENC_ERR_NEED_MORE_INPUT) {
         PrintMes(RGY_LOG_ERROR, FOR_AUO ? _T("フレームの投入に失敗しました。\n") : _T("Failed to add frame into the encoder.\n"));
         return nvStatus;
@@ -4077,8 +4555,9 @@ NVENCSTATUS NVEncCore::NvEncEncodeFrame(EncodeBuffer *pEncodeBuffer, int id, uin
 #if 1
 NVENCSTATUS NVEncCore::Encode() {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
-    const uint32_t nPipelineDepth = PIPELINE_DEPTH;
+    const uint32_t nPipelineDepth = m_pipelineDepth;
     m_pStatus->SetStart();
+    RGY_PERF_TRACE_THREAD_NAME("encode");
 
     const int nEventCount = nPipelineDepth + CHECK_PTS_MAX_INSERT_FRAMES + 1 + MAX_FILTER_OUTPUT;
 
@@ -4223,7 +4702,9 @@ NVENCSTATUS NVEncCore::Encode() {
             CUresult curesult = CUDA_SUCCESS;
             RGYBitstream bitstream = RGYBitstreamInit();
             RGY_ERR sts = RGY_ERR_NONE;
+            RGY_PERF_TRACE_THREAD_NAME("input");
             for (int i = 0; sts == RGY_ERR_NONE && nvStatus == NV_ENC_SUCCESS && !m_cuvidDec->GetError(); i++) {
+                RGY_PERF_TRACE_SCOPE(traceRead, RGY_TRACE_READ, i, RGY_PERF_TRACE_NO_PTS);
                 sts = m_pFileReader->LoadNextFrame(nullptr);
                 m_pFileReader->GetNextBitstream(&bitstream);
                 PrintMes(RGY_LOG_TRACE, _T("Set packet %d\n"), i);
@@ -4420,6 +4901,23 @@ NVENCSTATUS NVEncCore::Encode() {
         return NV_ENC_SUCCESS;
     };
 
+    //エンコードの終わったバッファを出力し、入力バッファのマップを解除する
+    auto process_output = [&](EncodeBuffer *pEncodeBuffer) {
+        ProcessOutput(pEncodeBuffer);
+        PrintMes(RGY_LOG_TRACE, _T("Output frame %d\n"), m_pStatus->m_sData.frameOut);
+        if (pEncodeBuffer->stInputBfr.pNV12devPtr) {
+            if (pEncodeBuffer->stInputBfr.hInputSurface) {
+                auto nvencret = NvEncUnmapInputResource(pEncodeBuffer->stInputBfr.hInputSurface);
+                if (nvencret != NV_ENC_SUCCESS) {
+                    PrintMes(RGY_LOG_ERROR, _T("Failed to Unmap input buffer %p: %s\n"), pEncodeBuffer->stInputBfr.hInputSurface, char_to_tstring(_nvencGetErrorEnum(nvencret)).c_str());
+                    return nvencret;
+                }
+                pEncodeBuffer->stInputBfr.hInputSurface = nullptr;
+            }
+        }
+        return NV_ENC_SUCCESS;
+    };
+
     auto filter_frame = [&](int& nFilterFrame, unique_ptr<FrameBufferDataIn>& inframe, deque<unique_ptr<FrameBufferDataEnc>>& dqEncFrames, bool& bDrain) {
         cudaMemcpyKind memcpyKind = cudaMemcpyDeviceToDevice;
         FrameInfo frameInfo = { 0 };
@@ -4498,22 +4996,25 @@ NVENCSTATUS NVEncCore::Encode() {
             if (bDrain) {
                 return NV_ENC_SUCCESS; //最後までbDrain = trueなら、drain完了
             }
+            //--ladder: 最後のフィルタに渡すフレームを、各段にも渡す
+            //空きのない段があれば、その段のエンコードが進むまで待機する
+            if (m_ladder) {
+                auto err = m_ladder->send([&](int rung, int slot) {
+                    return m_ladderRungs[rung]->LadderResizeFrame(&filterframes.front().first, slot);
+                });
+                if (err != RGY_ERR_NONE) {
+                    PrintMes(RGY_LOG_ERROR, _T("Error while sending frame to ladder outputs: %s.\n"), get_err_mes(err));
+                    return NV_ENC_ERR_GENERIC;
+                }
+            }
 
             //エンコードバッファを取得
             EncodeBuffer *pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
             if (!pEncodeBuffer) {
                 pEncodeBuffer = m_EncodeBufferQueue.GetPending();
-                ProcessOutput(pEncodeBuffer);
-                PrintMes(RGY_LOG_TRACE, _T("Output frame %d\n"), m_pStatus->m_sData.frameOut);
-                if (pEncodeBuffer->stInputBfr.pNV12devPtr) {
-                    if (pEncodeBuffer->stInputBfr.hInputSurface) {
-                        auto nvencret = NvEncUnmapInputResource(pEncodeBuffer->stInputBfr.hInputSurface);
-                        if (nvencret != NV_ENC_SUCCESS) {
-                            PrintMes(RGY_LOG_ERROR, _T("Failed to Unmap input buffer %p: %s\n"), pEncodeBuffer->stInputBfr.hInputSurface, char_to_tstring(_nvencGetErrorEnum(nvencret)).c_str());
-                            return nvencret;
-                        }
-                        pEncodeBuffer->stInputBfr.hInputSurface = nullptr;
-                    }
+                auto nvencret = process_output(pEncodeBuffer);
+                if (nvencret != NV_ENC_SUCCESS) {
+                    return nvencret;
                 }
                 pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
                 if (!pEncodeBuffer) {
@@ -4584,6 +5085,9 @@ NVENCSTATUS NVEncCore::Encode() {
         //エンコーダ用のバッファまで転送が終了するのを待機
         if (encFrame->m_pEvent) { cudaEventSynchronize(*encFrame->m_pEvent); }
         EncodeBuffer *pEncodeBuffer = encFrame->m_pEncodeBuffer;
+        if (m_lowLatency && encFrame->m_inputFrameId >= 0) {
+            m_latencyEncTime[encFrame->m_timestamp] = m_latencyInputTime[encFrame->m_inputFrameId % m_latencyInputTime.size()];
+        }
         if (pEncodeBuffer->stInputBfr.pNV12devPtr) {
             auto nvencret = NvEncMapInputResource(pEncodeBuffer->stInputBfr.nvRegisteredResource, &pEncodeBuffer->stInputBfr.hInputSurface);
             if (nvencret != NV_ENC_SUCCESS) {
@@ -4604,6 +5108,20 @@ NVENCSTATUS NVEncCore::Encode() {
     int nEncodeFrames = 0;
     bool bInputEmpty = false;
     bool bFilterEmpty = false;
+    //--ladder: 各段のエンコードのスレッドを開始する
+    //中断時にもフラッシュを行うため、フラッシュは終了時にこのスレッドで行う
+    if (m_ladder) {
+        for (auto& rung : m_ladderRungs) {
+            rung->m_pStatus->SetStart();
+        }
+        auto err = m_ladder->start([this](int rung, int slot) {
+            return m_ladderRungs[rung]->LadderEncodeFrame(slot);
+        }, nullptr);
+        if (err != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to start ladder outputs: %s.\n"), get_err_mes(err));
+            return NV_ENC_ERR_GENERIC;
+        }
+    }
     for (int nInputFrame = 0, nFilterFrame = 0; nvStatus == NV_ENC_SUCCESS && !bInputEmpty && !bFilterEmpty; ) {
         if (m_pAbortByUser && *m_pAbortByUser) {
             nvStatus = NV_ENC_ERR_ABORT;
@@ -4665,6 +5183,7 @@ NVENCSTATUS NVEncCore::Encode() {
                 }
             }
             NVTXRANGE(LoadNextFrame);
+            RGY_PERF_TRACE_SCOPE(traceRead, RGY_TRACE_READ, nInputFrame, RGY_PERF_TRACE_NO_PTS);
             RGYFrame frame = RGYFrameInit(inputFrameBuf.frameInfo);
             auto rgy_err = m_pFileReader->LoadNextFrame(&frame);
             if (rgy_err != RGY_ERR_NONE) {
@@ -4684,6 +5203,9 @@ NVENCSTATUS NVEncCore::Encode() {
         }
 
         if (!bInputEmpty) {
+            if (m_lowLatency) {
+                m_latencyInputTime[nInputFrame % m_latencyInputTime.size()] = std::chrono::high_resolution_clock::now();
+            }
             //trim反映
             const auto trimSts = frame_inside_range(nInputFrame++, m_trimParam.list);
 #if ENABLE_AVSW_READER
@@ -4720,6 +5242,8 @@ NVENCSTATUS NVEncCore::Encode() {
             if (!bDrain) {
                 dqInFrames.pop_front();
             }
+            RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_FILTER, dqInFrames.size());
+            RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_ENCODE, dqEncFrames.size());
             while (dqEncFrames.size() >= nPipelineDepth) {
                 auto& encframe = dqEncFrames.front();
                 if (NV_ENC_SUCCESS != (nvStatus = send_encoder(nEncodeFrames, encframe))) {
@@ -4727,6 +5251,14 @@ NVENCSTATUS NVEncCore::Encode() {
                 }
                 dqEncFrames.pop_front();
             }
+            //低遅延モードでは、エンコーダが出力可能になったフレームをすぐに出力する
+            if (m_lowLatency && nvStatus == NV_ENC_SUCCESS && dqEncFrames.size() == 0 && !m_encodeNeedMoreInput) {
+                for (auto pEncodeBuffer = m_EncodeBufferQueue.GetPending(); pEncodeBuffer; pEncodeBuffer = m_EncodeBufferQueue.GetPending()) {
+                    if (NV_ENC_SUCCESS != (nvStatus = process_output(pEncodeBuffer))) {
+                        break;
+                    }
+                }
+            }
         }
     }
     //すべての転送を終了させる
@@ -4782,9 +5314,44 @@ NVENCSTATUS NVEncCore::Encode() {
             PrintMes(RGY_LOG_DEBUG, _T("Flushed Encoder\n"));
         }
     }
-    m_pFileWriter->Close();
+    //--ladder: 各段のエンコードの終了を待つ
+    if (m_ladder) {
+        if (nvStatus != NV_ENC_SUCCESS) {
+            m_ladder->abort(RGY_ERR_ABORTED);
+        }
+        const auto ladderErr = m_ladder->finish();
+        if (ladderErr != RGY_ERR_NONE && nvStatus == NV_ENC_SUCCESS) {
+            PrintMes(RGY_LOG_ERROR, _T("Error in ladder outputs: %s.\n"), get_err_mes(ladderErr));
+            nvStatus = err_to_nv(ladderErr);
+        }
+        for (int i = 0; i < (int)m_ladderRungs.size(); i++) {
+            auto& rung = m_ladderRungs[i];
+            const auto stat = m_ladder->stat(i);
+            PrintMes(RGY_LOG_DEBUG, _T("ladder #%d: %lld frames, waited %.1f ms for free slot, max queued %d.\n"),
+                i + 1, (lls)stat.frames, stat.waitUs * 0.001, stat.maxQueued);
+            //段のFlushEncoderも、エラー時を含めてかならず行う
+            encstatus = rung->FlushEncoder();
+            if (encstatus != NV_ENC_SUCCESS) {
+                PrintMes(RGY_LOG_ERROR, _T("Error FlushEncoder (ladder #%d): %d.\n"), i + 1, encstatus);
+                nvStatus = encstatus;
+            }
+        }
+    }
+    //段の出力は親の出力の音声ストリームを参照するので、
+    //親の出力のスレッドを停止して音声をすべて渡し、段の出力を閉じてから、親の出力を閉じる
+    ladder_close_outputs((int)m_ladderRungs.size(),
+        [this]() { m_pFileWriter->WaitFin(); },
+        [this](int rung) { m_ladderRungs[rung]->LadderClose(); },
+        [this]() { m_pFileWriter->Close(); });
     m_pFileReader->Close();
     m_pStatus->WriteResults();
+    for (int i = 0; i < (int)m_ladderRungs.size(); i++) {
+        PrintMes(RGY_LOG_INFO, _T("\nladder #%d: %s\n"), i + 1, m_ladderPrm[i].outputFilename.c_str());
+        m_ladderRungs[i]->m_pStatus->WriteResults();
+    }
+    if (m_lowLatency && m_latencyFrames > 0) {
+        PrintMes(RGY_LOG_INFO, _T("latency (input -> output): avg %.2f ms, max %.2f ms\n"), m_latencySum / m_latencyFrames, m_latencyMax);
+    }
     vector<std::pair<tstring, double>> filter_result;
     for (auto& filter : m_vpFilters) {
         auto avgtime = filter->GetAvgTimeElapsed();
@@ -5077,6 +5644,347 @@ NVENCSTATUS NVEncCore::Encode() {
 }
 #endif
 
+#if ENABLE_AVSW_READER
+NVENCSTATUS NVEncCore::InitSegment(InEncodeVideoParam *inputParam, const NV_ENC_CODEC_CONFIG codecPrm[2]) {
+    InitLog(inputParam);
+
+    //区間ごとに子プロセスでエンコードする場合に使用できない設定
+    tstring unsupported;
+    if (inputParam->inputFilename == _T("-"))          unsupported += _T("pipe input, ");
+    if (inputParam->outputFilename == _T("-"))         unsupported += _T("pipe output, ");
+    if (inputParam->nTrimCount > 0)                    unsupported += _T("--trim, ");
+    if (inputParam->fSeekSec > 0.0f)                   unsupported += _T("--seek, ");
+    if (inputParam->keyFile.length() > 0)              unsupported += _T("--keyfile, ");
+    if (inputParam->keyOnChapter)                      unsupported += _T("--key-on-chapter, ");
+    if (inputParam->dynamicRC.size() > 0)              unsupported += _T("--dynamic-rc, ");
+    if (inputParam->nAudioSourceCount > 0)             unsupported += _T("--audio-source, ");
+    if (inputParam->vpp.subburn.size() > 0)            unsupported += _T("--vpp-subburn, ");
+    if (inputParam->caption2ass != FORMAT_INVALID)     unsupported += _T("--caption2ass, ");
+    if (inputParam->dynamicHdr10plusJson.length() > 0) unsupported += _T("--dhdr10-info, ");
+    if (inputParam->ladder.size() > 0)                 unsupported += _T("--ladder, ");
+    if (inputParam->vpp.afs.enable && (inputParam->vpp.afs.timecode || inputParam->vpp.afs.log)) unsupported += _T("--vpp-afs timecode/log, ");
+    const bool avReader = (inputParam->input.type == RGY_INPUT_FMT_AUTO)
+        ? !check_ext(inputParam->inputFilename, { ".y4m", ".yuv", ".avi", ".avs", ".vpy" })
+        : (inputParam->input.type == RGY_INPUT_FMT_AVHW || inputParam->input.type == RGY_INPUT_FMT_AVSW || inputParam->input.type == RGY_INPUT_FMT_AVANY);
+    if (!avReader)                                     unsupported += _T("readers other than avhw/avsw, ");
+    if (unsupported.length() > 0) {
+        PrintMes(RGY_LOG_ERROR, _T("--segment cannot be used with %s.\n"), unsupported.substr(0, unsupported.length()-2).c_str());
+        return NV_ENC_ERR_UNSUPPORTED_PARAM;
+    }
+    if (inputParam->nPerfMonitorSelect || inputParam->nPerfMonitorSelectMatplot
+        || inputParam->perfTraceFile.length() > 0 || inputParam->metricsListen.length() > 0) {
+        PrintMes(RGY_LOG_WARN, _T("--perf-monitor, --perf-trace and --metrics are ignored with --segment.\n"));
+    }
+
+    //映像のパケットのみを読み込み、キーフレームの位置を取得する
+    auto sts = rgy_segment_scan(&m_segmentSource, inputParam->inputFilename, inputParam->pAVInputFormat,
+        inputParam->nVideoTrack, inputParam->nVideoStreamId, m_pNVLog);
+    if (sts != RGY_ERR_NONE) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to scan input file \"%s\": %s.\n"), inputParam->inputFilename.c_str(), get_err_mes(sts));
+        return NV_ENC_ERR_GENERIC;
+    }
+    const auto& frames = m_segmentSource.frames;
+    const double durationSec = (frames.size() > 1) ? (frames.back().pts - frames.front().pts) * m_segmentSource.timebase.qdouble() : 0.0;
+    if (durationSec <= 0.0) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to get duration of input file \"%s\".\n"), inputParam->inputFilename.c_str());
+        return NV_ENC_ERR_GENERIC;
+    }
+    const int minFrames = (int)(RGY_SEGMENT_MIN_SEC * (frames.size() - 1) / durationSec + 0.5);
+    m_segments = rgy_segment_plan(frames, inputParam->segmentCount, minFrames);
+    if ((int)m_segments.size() < inputParam->segmentCount) {
+        PrintMes(RGY_LOG_WARN, _T("only %d segments could be made from keyframes of the input (%d segments requested).\n"),
+            (int)m_segments.size(), inputParam->segmentCount);
+    }
+    for (const auto& seg : m_segments) {
+        PrintMes(RGY_LOG_DEBUG, _T("segment %d: frame %d - %d (%s)\n"), seg.index, seg.start, seg.start + seg.frames - 1,
+            print_time((seg.startPts - frames.front().pts) * m_segmentSource.timebase.qdouble()).c_str());
+    }
+    m_segmentPrm = std::make_unique<InEncodeVideoParam>(*inputParam);
+    memcpy(m_segmentCodecPrm, codecPrm, sizeof(m_segmentCodecPrm));
+    PrintMes(RGY_LOG_INFO, _T("split %d frames into %d segments at keyframes.\n"), (int)frames.size(), (int)m_segments.size());
+    return NV_ENC_SUCCESS;
+}
+
+NVENCSTATUS NVEncCore::EncodeSegment() {
+    InEncodeVideoParam *inputParam = m_segmentPrm.get();
+    if (inputParam == nullptr || m_segments.size() == 0) {
+        return NV_ENC_ERR_INVALID_CALL;
+    }
+    m_pStatus = std::make_shared<EncodeStatus>();
+    m_pStatus->SetStart();
+
+    const tstring exePath = getExePath();
+    auto segmentFile = [inputParam](int index) {
+        return inputParam->outputFilename + strsprintf(_T(".seg%03d.nut"), index);
+    };
+    auto removeSegmentFiles = [&]() {
+        for (const auto& seg : m_segments) {
+            _tremove(segmentFile(seg.index).c_str());
+            _tremove((segmentFile(seg.index) + _T(".log")).c_str());
+        }
+    };
+
+    //区間ごとに子プロセスでエンコードする
+    //出力はAnnex-Bのままptsを保持できるnutとし、音声等は含めない
+    const int parallel = (inputParam->segmentParallel > 0) ? inputParam->segmentParallel : std::min((int)m_segments.size(), 2);
+    PrintMes(RGY_LOG_INFO, _T("encoding %d segments, %d in parallel...\n"), (int)m_segments.size(), parallel);
+    auto sts = rgy_segment_run(m_segments, parallel, [&](const RGYSegment& seg, int) {
+        InEncodeVideoParam childPrm = *inputParam;
+        childPrm.outputFilename = segmentFile(seg.index);
+        childPrm.sAVMuxOutputFormat = _T("nut");
+        childPrm.nAVMux = RGY_MUX_NONE;
+        childPrm.nAudioSelectCount = 0;
+        childPrm.ppAudioSelectList = nullptr;
+        childPrm.nSubtitleSelectCount = 0;
+        childPrm.ppSubtitleSelectList = nullptr;
+        childPrm.nDataSelectCount = 0;
+        childPrm.ppDataSelectList = nullptr;
+        childPrm.bCopyChapter = false;
+        childPrm.sChapterFile.clear();
+        childPrm.pMuxOpt = nullptr;
+        childPrm.logfile = childPrm.outputFilename + _T(".log");
+        childPrm.loglevel = (inputParam->loglevel == RGY_LOG_INFO) ? RGY_LOG_WARN : inputParam->loglevel; //進捗表示が重ならないように
+        childPrm.sFramePosListLog.clear();
+        childPrm.pMuxVidTsLogFile = nullptr;
+        childPrm.nPerfMonitorSelect = 0;
+        childPrm.nPerfMonitorSelectMatplot = 0;
+        childPrm.perfTraceFile.clear();
+        childPrm.metricsListen.clear();
+        childPrm.segmentCount = 0;
+        childPrm.segmentParallel = 0;
+        //--seekの精度はgen_cmdの出力では不足するので、別途追加する
+        tstring cmd = gen_cmd(&childPrm, m_segmentCodecPrm, false);
+        const double seekSec = rgy_segment_seek_sec(m_segmentSource, seg);
+        if (seekSec > 0.0) {
+            cmd += strsprintf(_T(" --seek %.6f"), seekSec);
+        }
+        if (seg.start + seg.frames < (int)m_segmentSource.frames.size()) {
+            cmd += strsprintf(_T(" --trim 0:%d"), seg.frames - 1);
+        }
+        PrintMes(RGY_LOG_DEBUG, _T("segment %d: %s%s\n"), seg.index, exePath.c_str(), cmd.c_str());
+        const auto tmStart = std::chrono::system_clock::now();
+        const int exitCode = rgy_segment_exec(exePath, cmd);
+        if (exitCode != 0) {
+            PrintMes(RGY_LOG_ERROR, _T("segment %d: encode failed (exit code %d), see \"%s\".\n"), seg.index, exitCode, childPrm.logfile.c_str());
+            return RGY_ERR_RUN_PROCESS;
+        }
+        const double elapsedSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - tmStart).count() * 0.001;
+        PrintMes(RGY_LOG_INFO, _T("segment %d: encoded %d frames in %.1f sec.\n"), seg.index, seg.frames, elapsedSec);
+        return RGY_ERR_NONE;
+    }, m_pAbortByUser);
+    if (sts != RGY_ERR_NONE) {
+        if (m_pAbortByUser && *m_pAbortByUser) {
+            PrintMes(RGY_LOG_ERROR, _T("aborted by user, segment files are left as \"%s\".\n"), segmentFile(0).c_str());
+            return NV_ENC_ERR_ABORT;
+        }
+        return NV_ENC_ERR_GENERIC;
+    }
+
+    //音声/字幕/チャプターは元の入力から読み込む (映像は読み込まない)
+    RGYInputPrm inputPrmBase;
+    RGYInputAvcodecPrm inputPrm(inputPrmBase);
+    inputPrm.pInputFormat = inputParam->pAVInputFormat;
+    inputPrm.bReadVideo = false;
+    inputPrm.nVideoTrack = inputParam->nVideoTrack;
+    inputPrm.nVideoStreamId = inputParam->nVideoStreamId;
+    inputPrm.nReadAudio = inputParam->nAudioSelectCount > 0;
+    inputPrm.bReadSubtitle = inputParam->nSubtitleSelectCount > 0;
+    inputPrm.bReadData = inputParam->nDataSelectCount > 0;
+    inputPrm.bReadChapter = true;
+    inputPrm.nVideoAvgFramerate = std::make_pair(inputParam->input.fpsN, inputParam->input.fpsD);
+    inputPrm.nAnalyzeSec = inputParam->nAVDemuxAnalyzeSec;
+    inputPrm.nAudioTrackStart = 1;
+    inputPrm.nSubtitleTrackStart = 1;
+    inputPrm.nDataTrackStart = 1;
+    inputPrm.nAudioSelectCount = inputParam->nAudioSelectCount;
+    inputPrm.ppAudioSelect = inputParam->ppAudioSelectList;
+    inputPrm.nSubtitleSelectCount = inputParam->nSubtitleSelectCount;
+    inputPrm.ppSubtitleSelect = inputParam->ppSubtitleSelectList;
+    inputPrm.nDataSelectCount = inputParam->nDataSelectCount;
+    inputPrm.ppDataSelect = inputParam->ppDataSelectList;
+    inputPrm.nAVSyncMode = RGY_AVSYNC_ASSUME_CFR;
+    inputPrm.nInputThread = 0;
+    VideoInfo inputInfo = inputParam->input;
+    m_pFileReader.reset(new RGYInputAvcodec());
+    if (m_pFileReader->Init(inputParam->inputFilename.c_str(), &inputInfo, &inputPrm, m_pNVLog, m_pStatus) != 0) {
+        PrintMes(RGY_LOG_ERROR, m_pFileReader->GetInputMessage());
+        return NV_ENC_ERR_GENERIC;
+    }
+
+    //出力の設定は最初の区間の出力から取得する
+    RGYSegmentReaderAvformat segReader;
+    if ((sts = segReader.open(segmentFile(0))) != RGY_ERR_NONE) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to open \"%s\": %s.\n"), segmentFile(0).c_str(), get_err_mes(sts));
+        return NV_ENC_ERR_GENERIC;
+    }
+    const AVStream *segStream = segReader.stream();
+    const AVCodecParameters *segCodecpar = segStream->codecpar;
+    m_stCodecGUID = (inputParam->codec == NV_ENC_H264) ? NV_ENC_CODEC_H264_GUID : NV_ENC_CODEC_HEVC_GUID;
+    if (segCodecpar->codec_id != ((inputParam->codec == NV_ENC_H264) ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC)) {
+        PrintMes(RGY_LOG_ERROR, _T("Unexpected codec found in \"%s\".\n"), segmentFile(0).c_str());
+        return NV_ENC_ERR_GENERIC;
+    }
+    m_uEncWidth = segCodecpar->width;
+    m_uEncHeight = segCodecpar->height;
+    m_sar = (segCodecpar->sample_aspect_ratio.num > 0) ? to_rgy(segCodecpar->sample_aspect_ratio) : to_rgy(segStream->sample_aspect_ratio);
+    switch (segCodecpar->field_order) {
+    case AV_FIELD_TT: m_stPicStruct = NV_ENC_PIC_STRUCT_FIELD_TOP_BOTTOM; break;
+    case AV_FIELD_BB: m_stPicStruct = NV_ENC_PIC_STRUCT_FIELD_BOTTOM_TOP; break;
+    default:          m_stPicStruct = NV_ENC_PIC_STRUCT_FRAME; break;
+    }
+    m_encFps = (segStream->avg_frame_rate.num > 0) ? to_rgy(segStream->avg_frame_rate) : to_rgy(segStream->r_frame_rate);
+    if (m_encFps.n() <= 0 || m_encFps.d() <= 0) {
+        const double fps = (m_segmentSource.frames.size() - 1) / ((m_segmentSource.frames.back().pts - m_segmentSource.frames.front().pts) * m_segmentSource.timebase.qdouble());
+        m_encFps = to_rgy(av_d2q(fps, 1000000));
+    }
+    m_stCreateEncodeParams.frameRateNum = m_encFps.n();
+    m_stCreateEncodeParams.frameRateDen = m_encFps.d();
+    m_outputTimebase = segReader.timebase();
+    m_stEncConfig = inputParam->encConfig;
+    auto& vui = (inputParam->codec == NV_ENC_H264) ? m_stEncConfig.encodeCodecConfig.h264Config.h264VUIParameters : m_stEncConfig.encodeCodecConfig.hevcConfig.hevcVUIParameters;
+    if (segCodecpar->color_primaries != AVCOL_PRI_UNSPECIFIED || segCodecpar->color_trc != AVCOL_TRC_UNSPECIFIED || segCodecpar->color_space != AVCOL_SPC_UNSPECIFIED) {
+        vui.colourDescriptionPresentFlag = 1;
+        vui.colourPrimaries = segCodecpar->color_primaries;
+        vui.transferCharacteristics = segCodecpar->color_trc;
+        vui.colourMatrix = segCodecpar->color_space;
+    }
+    if (segCodecpar->color_range == AVCOL_RANGE_JPEG) {
+        vui.videoFullRangeFlag = 1;
+    }
+    const bool bOutputHighBitDepth = inputParam->codec == NV_ENC_HEVC && inputParam->encConfig.encodeCodecConfig.hevcConfig.pixelBitDepthMinus8 > 0;
+    NV_ENC_BUFFER_FORMAT encBufferFormat;
+    if (bOutputHighBitDepth) {
+        encBufferFormat = (inputParam->yuv444) ? NV_ENC_BUFFER_FORMAT_YUV444_10BIT : NV_ENC_BUFFER_FORMAT_YUV420_10BIT;
+    } else {
+        encBufferFormat = (inputParam->yuv444) ? NV_ENC_BUFFER_FORMAT_YUV444_PL : NV_ENC_BUFFER_FORMAT_NV12_PL;
+    }
+    //HDR10のSEIは各区間の出力にすでに含まれている
+    inputParam->sMaxCll.clear();
+    inputParam->sMasterDisplay.clear();
+    inputParam->nPerfMonitorSelect = 0;
+    inputParam->nPerfMonitorSelectMatplot = 0;
+    inputParam->input.frames = (int)m_segmentSource.frames.size();
+
+    NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
+    if (NV_ENC_SUCCESS != (nvStatus = InitChapters(inputParam))) {
+        return nvStatus;
+    }
+    if (NV_ENC_SUCCESS != (nvStatus = InitOutput(inputParam, encBufferFormat))) {
+        PrintMes(RGY_LOG_ERROR, _T("Failed to open output file: \"%s\"\n"), inputParam->outputFilename.c_str());
+        return nvStatus;
+    }
+
+    std::map<int, shared_ptr<RGYOutputAvcodec>> pWriterForAudioStreams;
+    for (auto pWriter : m_pFileWriterListAudio) {
+        auto pAVCodecWriter = std::dynamic_pointer_cast<RGYOutputAvcodec>(pWriter);
+        if (pAVCodecWriter) {
+            auto trackIdList = pAVCodecWriter->GetStreamTrackIdList();
+            for (auto trackID : trackIdList) {
+                pWriterForAudioStreams[trackID] = pAVCodecWriter;
+            }
+        }
+    }
+    auto extract_audio = [&]() {
+        auto pAVCodecReader = std::dynamic_pointer_cast<RGYInputAvcodec>(m_pFileReader);
+        if (m_pFileWriterListAudio.size() == 0 || pAVCodecReader == nullptr) {
+            return RGY_ERR_NONE;
+        }
+        auto packetList = pAVCodecReader->GetStreamDataPackets();
+        for (uint32_t i = 0; i < packetList.size(); i++) {
+            const int nTrackId = (int)((uint32_t)packetList[i].flags >> 16);
+            if (pWriterForAudioStreams.count(nTrackId) == 0) {
+                PrintMes(RGY_LOG_ERROR, _T("Failed to find writer for audio track %d\n"), nTrackId);
+                return RGY_ERR_NOT_FOUND;
+            }
+            auto err = pWriterForAudioStreams[nTrackId]->WriteNextPacket(&packetList[i]);
+            if (err != RGY_ERR_NONE) {
+                return err;
+            }
+        }
+        return RGY_ERR_NONE;
+    };
+
+    //フレーム数の変わるフィルタを使用している場合は、区間のフレーム数を確認しない
+    const bool frameCountChanged = inputParam->vpp.deinterlace == cudaVideoDeinterlaceMode_Bob
+        || inputParam->vpp.afs.enable
+        || (inputParam->vpp.nnedi.enable && inputParam->vpp.nnedi.isbob())
+        || (inputParam->vpp.yadif.enable && (inputParam->vpp.yadif.mode & VPP_YADIF_MODE_BOB))
+        || inputParam->vpp.selectevery.enable
+        || inputParam->vpp.rff;
+    RGYSegmentConcat concat;
+    for (const auto& seg : m_segments) {
+        if (seg.index > 0 && (sts = segReader.open(segmentFile(seg.index))) != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to open \"%s\": %s.\n"), segmentFile(seg.index).c_str(), get_err_mes(sts));
+            nvStatus = NV_ENC_ERR_GENERIC;
+            break;
+        }
+        if ((sts = concat.begin(seg, segReader.timebase(), (frameCountChanged) ? 0 : seg.frames)) != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("%s"), concat.message().c_str());
+            nvStatus = NV_ENC_ERR_GENERIC;
+            break;
+        }
+        RGYSegmentPacket pkt;
+        while ((sts = segReader.read(&pkt)) == RGY_ERR_NONE) {
+            if (m_pAbortByUser && *m_pAbortByUser) {
+                sts = RGY_ERR_ABORTED;
+                break;
+            }
+            if ((sts = concat.add(&pkt)) != RGY_ERR_NONE) {
+                PrintMes(RGY_LOG_ERROR, _T("%s"), concat.message().c_str());
+                break;
+            }
+            RGYBitstream bitstream = RGYBitstreamInit();
+            bitstream.ref(pkt.data.data(), pkt.data.size(), 0, pkt.pts);
+            bitstream.setDuration(pkt.duration);
+            bitstream.setFrametype((pkt.key) ? RGY_FRAMETYPE_IDR : RGY_FRAMETYPE_P);
+            if ((sts = m_pFileWriter->WriteNextFrame(&bitstream)) != RGY_ERR_NONE
+                || (sts = extract_audio()) != RGY_ERR_NONE) {
+                break;
+            }
+        }
+        if (sts == RGY_ERR_MORE_BITSTREAM) {
+            if ((sts = concat.end()) != RGY_ERR_NONE) {
+                PrintMes(RGY_LOG_ERROR, _T("%s"), concat.message().c_str());
+            }
+        } else if (sts == RGY_ERR_INVALID_FORMAT && concat.message().length() == 0) {
+            PrintMes(RGY_LOG_ERROR, _T("segment %d: invalid packet found in \"%s\".\n"), seg.index, segmentFile(seg.index).c_str());
+        }
+        if (sts != RGY_ERR_NONE) {
+            nvStatus = (sts == RGY_ERR_ABORTED) ? NV_ENC_ERR_ABORT : NV_ENC_ERR_GENERIC;
+            break;
+        }
+    }
+    segReader.close();
+
+    for (const auto& writer : m_pFileWriterListAudio) {
+        auto pAVCodecWriter = std::dynamic_pointer_cast<RGYOutputAvcodec>(writer);
+        if (pAVCodecWriter != nullptr) {
+            //エンコーダなどにキャッシュされたパケットを書き出す
+            pAVCodecWriter->WriteNextPacket(nullptr);
+        }
+    }
+    m_pFileWriter->Close();
+    m_pFileReader->Close();
+    m_pStatus->WriteResults();
+    if (nvStatus == NV_ENC_SUCCESS) {
+        removeSegmentFiles();
+    } else {
+        PrintMes(RGY_LOG_ERROR, _T("failed to join segments, segment files are left as \"%s\".\n"), segmentFile(0).c_str());
+    }
+    return nvStatus;
+}
+#else
+NVENCSTATUS NVEncCore::InitSegment(InEncodeVideoParam *inputParam, const NV_ENC_CODEC_CONFIG codecPrm[2]) {
+    InitLog(inputParam);
+    PrintMes(RGY_LOG_ERROR, _T("--segment is not supported in this build.\n"));
+    return NV_ENC_ERR_UNIMPLEMENTED;
+}
+
+NVENCSTATUS NVEncCore::EncodeSegment() {
+    return NV_ENC_ERR_UNIMPLEMENTED;
+}
+#endif //#if ENABLE_AVSW_READER
+
 tstring NVEncCore::GetEncodingParamsInfo(int output_level) {
     tstring str;
     auto add_str =[output_level, &str](int info_level, const TCHAR *fmt, ...) {
@@ -5241,6 +6149,26 @@ tstring NVEncCore::GetEncodingParamsInfo(int output_level) {
         }
         add_str(RGY_LOG_INFO, _T("%s\n"), strDynamicRC.c_str());
     }
+    if (m_ladderRungs.size() > 0) {
+        tstring strLadder = _T("Ladder         ");
+        for (int i = 0; i < (int)m_ladderRungs.size(); i++) {
+            const auto& rung = m_ladderRungs[i];
+            if (i > 0) {
+                strLadder += _T("\n               ");
+            }
+            strLadder += strsprintf(_T("%dx%d, "), rung->m_uEncWidth, rung->m_uEncHeight);
+            if (rung->m_stEncConfig.rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP) {
+                strLadder += _T("cqp");
+            } else {
+                strLadder += strsprintf(_T("%d kbps"), rung->m_stEncConfig.rcParams.averageBitRate / 1000);
+                if (rung->m_stEncConfig.rcParams.maxBitRate > 0) {
+                    strLadder += strsprintf(_T(" (max %d kbps)"), rung->m_stEncConfig.rcParams.maxBitRate / 1000);
+                }
+            }
+            strLadder += _T(", ") + m_ladderPrm[i].outputFilename;
+        }
+        add_str(RGY_LOG_INFO, _T("%s\n"), strLadder.c_str());
+    }
     tstring strLookahead = _T("Lookahead      ");
     if (m_stEncConfig.rcParams.enableLookahead) {
         strLookahead += strsprintf(_T("on, %d frames"), m_stEncConfig.rcParams.lookaheadDepth);
@@ -40,11 +40,18 @@
 #include <tchar.h>
 #include <vector>
 #include <list>
+#include <map>
+#include <array>
+#include <chrono>
 #include <string>
 #include "rgy_input.h"
 #include "rgy_output.h"
 #include "rgy_status.h"
 #include "rgy_log.h"
+#include "rgy_perf_trace.h"
+#include "rgy_metrics.h"
+#include "rgy_segment.h"
+#include "rgy_ladder.h"
 #include "rgy_bitstream.h"
 #include "rgy_hdr10plus.h"
 #include "NVEncUtil.h"
@@ -70,6 +77,10 @@ typedef NVENCSTATUS (NVENCAPI *MYPROC)(NV_ENCODE_API_FUNCTION_LIST*);
 
 bool check_if_nvcuda_dll_available();
 
+//ドライバのバージョン(1000倍)を取得する
+//取得できなければ0、NV_DRIVER_VER_MIN未満なら-1
+int getNVDriverVersion(const std::string& pciBusId, int deviceId);
+
 struct InputFrameBufInfo {
     FrameInfo frameInfo; //入力フレームへのポインタと情報
     std::unique_ptr<void, handle_deleter> heTransferFin; //入力フレームに関連付けられたイベント、このフレームが不要になったらSetする
@@ -153,6 +164,12 @@ public:
     //エンコードを実行
     virtual NVENCSTATUS Encode();
 
+    //入力をキーフレームで区間に分割する (--segment、Initialize()/InitEncode()の代わりに使用する)
+    NVENCSTATUS InitSegment(InEncodeVideoParam *inputParam, const NV_ENC_CODEC_CONFIG codecPrm[2]);
+
+    //区間ごとのエンコードを子プロセスで並列に実行し、結果を結合して出力する
+    NVENCSTATUS EncodeSegment();
+
     //エンコーダのClose・リソース開放
     virtual NVENCSTATUS Deinitialize();
 
@@ -204,6 +221,9 @@ protected:
     //CUDAインターフェースを初期化
     NVENCSTATUS InitCuda(int cudaSchedule);
 
+    //NVEncのインスタンスを作成し、エンコードセッションを開く
+    NVENCSTATUS InitNVEncInstance(int sessionRetry);
+
     //inputParamからエンコーダに渡すパラメータを設定
     NVENCSTATUS SetInputParam(const InEncodeVideoParam *inputParam);
 
@@ -216,6 +236,21 @@ protected:
     //チャプター読み込み等
     NVENCSTATUS InitChapters(const InEncodeVideoParam *inputParam);
 
+    //--ladderの各段のエンコーダを作成
+    NVENCSTATUS InitLadder(const InEncodeVideoParam *inputParam, NV_ENC_BUFFER_FORMAT encBufferFormat);
+
+    //--ladderの段として初期化 (CUDAコンテキストと入力は親のものを使用する)
+    NVENCSTATUS InitLadderRung(NVEncCore *parent, InEncodeVideoParam *inputParam, const FrameInfo& frameIn, int queueDepth, NV_ENC_BUFFER_FORMAT encBufferFormat);
+
+    //--ladderの段: 親のフレームをリサイズしてslotに格納する (親のスレッドから呼ぶ)
+    RGY_ERR LadderResizeFrame(FrameInfo *pInputFrame, int slot);
+
+    //--ladderの段: slotのフレームをエンコードする (段のスレッドから呼ぶ)
+    RGY_ERR LadderEncodeFrame(int slot);
+
+    //--ladderの段の出力を閉じる
+    void LadderClose();
+
     //エンコーダインスタンスを作成
     NVENCSTATUS CreateEncoder(const InEncodeVideoParam *inputParam);
 
@@ -269,6 +304,18 @@ protected:
     vector<shared_ptr<RGYOutput>> m_pFileWriterListAudio;
     shared_ptr<EncodeStatus>      m_pStatus;               //エンコードステータス管理
     shared_ptr<CPerfMonitor>      m_pPerfMonitor;
+    unique_ptr<RGYPerfTrace>      m_perfTrace;             //--perf-trace
+    unique_ptr<RGYMetricsServer>  m_metrics;               //--metrics
+    unique_ptr<InEncodeVideoParam> m_segmentPrm;           //--segment 区間ごとのコマンドラインの元になる設定
+    NV_ENC_CODEC_CONFIG           m_segmentCodecPrm[2];
+    RGYSegmentSourceInfo          m_segmentSource;         //--segment 入力の映像フレームの一覧
+    vector<RGYSegment>            m_segments;              //--segment 分割した区間
+    NVEncCore                    *m_ladderParent;          //--ladder 段として動作する場合の親 (それ以外はnullptr)
+    unique_ptr<RGYLadderFanout>   m_ladder;                //--ladder 各段へのフレームの分配
+    vector<unique_ptr<NVEncCore>> m_ladderRungs;           //--ladder 各段のエンコーダ
+    vector<LadderRungParam>       m_ladderPrm;             //--ladder 各段の設定
+    vector<unique_ptr<CUFrameBuf>> m_ladderFrames;         //--ladder 段: リサイズしたフレームを格納するスロット
+    int                           m_ladderEncodeFrames;    //--ladder 段: エンコーダに渡したフレーム数
     NV_ENC_PIC_STRUCT             m_stPicStruct;           //エンコードフレーム情報(プログレッシブ/インタレ)
     NV_ENC_CONFIG                 m_stEncConfig;           //エンコード設定
 #if ENABLE_AVSW_READER
@@ -287,6 +334,14 @@ protected:
     rgy_rational<int>            m_sar;                   //出力のsar比
 
     int                          m_nProcSpeedLimit;       //処理速度制限 (0で制限なし)
+    bool                         m_lowLatency;            //低遅延モード
+    uint32_t                     m_pipelineDepth;         //エンコーダに渡すまでに保持するフレーム数
+    bool                         m_encodeNeedMoreInput;   //直前のnvEncEncodePictureがNV_ENC_ERR_NEED_MORE_INPUTを返したか
+    std::array<std::chrono::high_resolution_clock::time_point, 256> m_latencyInputTime;    //入力フレームIDごとの読み込み時刻
+    std::map<uint64_t, std::chrono::high_resolution_clock::time_point> m_latencyEncTime; //エンコーダに渡したtimestampごとの読み込み時刻
+    int                          m_latencyFrames;         //遅延を計測したフレーム数
+    double                       m_latencySum;            //入力から出力までの遅延の合計 (ms)
+    double                       m_latencyMax;            //入力から出力までの遅延の最大 (ms)
     RGYAVSync                    m_nAVSyncMode;           //映像音声同期設定
     rgy_rational<int>            m_inputFps;              //入力フレームレート
     rgy_rational<int>            m_outputTimebase;        //出力のtimebase
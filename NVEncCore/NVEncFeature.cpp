@@ -26,11 +26,371 @@
 //
 // ------------------------------------------------------------------------------------------
 
+#include <fstream>
+#if defined(_WIN32) || defined(_WIN64)
 #include <process.h>
 #pragma comment(lib, "winmm.lib")
+#else
+#include <unistd.h>
+#endif //#if defined(_WIN32) || defined(_WIN64)
 #include "NVEncCore.h"
 #include "NVEncFeature.h"
-#include "NVEncFeature.h"
+
+#pragma pack(push, 8)
+struct NVEncFeatureCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t apiVersion;         //NVENCAPI_VERSION
+    uint32_t presetConfigSize;   //sizeof(NV_ENC_PRESET_CONFIG)
+    uint32_t codecCount;
+    uint64_t fileSize;
+    uint64_t checksum;           //ヘッダ以降のデータのFNV-1a
+    NVEncFeatureCacheKey key;
+};
+
+//codecごとに、この後ろにprofiles, presets, presetConfigs, surfaceFmt, capsの順で配列が並ぶ
+struct NVEncFeatureCacheCodec {
+    GUID codec;
+    uint32_t profileCount;
+    uint32_t presetCount;
+    uint32_t presetConfigCount;
+    uint32_t surfaceFmtCount;
+    uint32_t capCount;
+};
+
+struct NVEncFeatureCacheCap {
+    int32_t id;
+    int32_t value;
+};
+#pragma pack(pop)
+
+static uint64_t nvfeature_cache_checksum(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool nvfeature_cache_key_equal(const NVEncFeatureCacheKey& a, const NVEncFeatureCacheKey& b) {
+    return a.driverVersion == b.driverVersion
+        && 0 == strncmp(a.pciBusId, b.pciBusId, sizeof(a.pciBusId))
+        && 0 == strncmp(a.gpuName, b.gpuName, sizeof(a.gpuName));
+}
+
+tstring nvfeature_cache_path(const NVEncFeatureCacheKey& key) {
+    //PCI Bus ID ("0000:01:00.0")をファイル名に使える文字に置き換える
+    std::string busId;
+    for (size_t i = 0; i < sizeof(key.pciBusId) && key.pciBusId[i]; i++) {
+        const char c = key.pciBusId[i];
+        busId += (isalnum((unsigned char)c)) ? c : '_';
+    }
+    //32bit版と64bit版ではNV_ENC_PRESET_CONFIGのサイズが異なるので、別のファイルとする
+    const tstring filename = strsprintf(_T("NVEncFeatureCache_%s_%s.bin"), (sizeof(void *) == 8) ? _T("x64") : _T("x86"), char_to_tstring(busId).c_str());
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR tempDir[1024] = { 0 };
+    if (0 == GetTempPath(_countof(tempDir), tempDir)) {
+        return _T("");
+    }
+    return PathCombineS(tstring(tempDir), filename);
+#else
+    const char *tempDir = getenv("TMPDIR");
+    return tstring((tempDir && tempDir[0]) ? tempDir : "/tmp") + _T("/") + filename;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+template<typename T>
+static bool nvfeature_cache_read(std::vector<T>& dst, uint32_t count, const uint8_t *&ptr, const uint8_t *fin) {
+    if ((size_t)(fin - ptr) / sizeof(T) < count) {
+        return false;
+    }
+    dst.resize(count);
+    if (count) {
+        memcpy(dst.data(), ptr, sizeof(T) * count);
+    }
+    ptr += sizeof(T) * count;
+    return true;
+}
+
+RGY_ERR nvfeature_cache_load(const TCHAR *path, const NVEncFeatureCacheKey& key, std::vector<NVEncCodecFeature>& codecFeatures) {
+    //ドライバのバージョンが取得できない場合は、キャッシュを使用しない
+    if (key.driverVersion <= 0) {
+        return RGY_ERR_INVALID_VERSION;
+    }
+    RGYFileMapRead map;
+    auto err = map.open(path);
+    if (err != RGY_ERR_NONE) {
+        return err;
+    }
+    if (map.size() < sizeof(NVEncFeatureCacheHeader)) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    NVEncFeatureCacheHeader header;
+    memcpy(&header, map.ptr(), sizeof(header));
+    if (header.magic != NVENC_FEATURE_CACHE_MAGIC
+        || header.headerSize != sizeof(NVEncFeatureCacheHeader)
+        || header.fileSize != (uint64_t)map.size()) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    if (header.version != NVENC_FEATURE_CACHE_VERSION
+        || header.apiVersion != NVENCAPI_VERSION
+        || header.presetConfigSize != sizeof(NV_ENC_PRESET_CONFIG)
+        || !nvfeature_cache_key_equal(header.key, key)) {
+        return RGY_ERR_INVALID_VERSION;
+    }
+    const uint8_t *ptr = map.ptr() + sizeof(header);
+    const uint8_t *fin = map.ptr() + map.size();
+    if (header.checksum != nvfeature_cache_checksum(ptr, fin - ptr)) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    std::vector<NVEncCodecFeature> features;
+    for (uint32_t i = 0; i < header.codecCount; i++) {
+        std::vector<NVEncFeatureCacheCodec> codec;
+        std::vector<NVEncFeatureCacheCap> caps;
+        NVEncCodecFeature feature;
+        if (!nvfeature_cache_read(codec, 1, ptr, fin)) {
+            return RGY_ERR_INVALID_FORMAT;
+        }
+        feature.codec = codec[0].codec;
+        if (   !nvfeature_cache_read(feature.profiles,      codec[0].profileCount,      ptr, fin)
+            || !nvfeature_cache_read(feature.presets,       codec[0].presetCount,       ptr, fin)
+            || !nvfeature_cache_read(feature.presetConfigs, codec[0].presetConfigCount, ptr, fin)
+            || !nvfeature_cache_read(feature.surfaceFmt,    codec[0].surfaceFmtCount,   ptr, fin)
+            || !nvfeature_cache_read(caps,                  codec[0].capCount,          ptr, fin)) {
+            return RGY_ERR_INVALID_FORMAT;
+        }
+        for (const auto& c : caps) {
+            //名前はキャッシュに保存せず、一覧から復元する
+            auto desc = get_nvenc_cap_desc(c.id);
+            if (desc == nullptr) {
+                return RGY_ERR_INVALID_FORMAT;
+            }
+            NVEncCap cap = { 0 };
+            cap.id = c.id;
+            cap.name = desc->name;
+            cap.isBool = desc->isBool;
+            cap.value = c.value;
+            feature.caps.push_back(cap);
+        }
+        features.push_back(feature);
+    }
+    if (ptr != fin) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    codecFeatures = features;
+    return RGY_ERR_NONE;
+}
+
+template<typename T>
+static void nvfeature_cache_append(std::vector<uint8_t>& buf, const T *data, size_t count) {
+    if (count) {
+        const auto offset = buf.size();
+        buf.resize(offset + sizeof(T) * count);
+        memcpy(buf.data() + offset, data, sizeof(T) * count);
+    }
+}
+
+RGY_ERR nvfeature_cache_save(const TCHAR *path, const NVEncFeatureCacheKey& key, const std::vector<NVEncCodecFeature>& codecFeatures) {
+    if (key.driverVersion <= 0) {
+        return RGY_ERR_INVALID_VERSION;
+    }
+    std::vector<uint8_t> buf(sizeof(NVEncFeatureCacheHeader), 0);
+    for (const auto& feature : codecFeatures) {
+        NVEncFeatureCacheCodec codec;
+        memset(&codec, 0, sizeof(codec));
+        codec.codec = feature.codec;
+        codec.profileCount = (uint32_t)feature.profiles.size();
+        codec.presetCount = (uint32_t)feature.presets.size();
+        codec.presetConfigCount = (uint32_t)feature.presetConfigs.size();
+        codec.surfaceFmtCount = (uint32_t)feature.surfaceFmt.size();
+        codec.capCount = (uint32_t)feature.caps.size();
+        std::vector<NVEncFeatureCacheCap> caps;
+        for (const auto& cap : feature.caps) {
+            caps.push_back({ cap.id, cap.value });
+        }
+        nvfeature_cache_append(buf, &codec, 1);
+        nvfeature_cache_append(buf, feature.profiles.data(),      feature.profiles.size());
+        nvfeature_cache_append(buf, feature.presets.data(),       feature.presets.size());
+        nvfeature_cache_append(buf, feature.presetConfigs.data(), feature.presetConfigs.size());
+        nvfeature_cache_append(buf, feature.surfaceFmt.data(),    feature.surfaceFmt.size());
+        nvfeature_cache_append(buf, caps.data(),                  caps.size());
+    }
+    NVEncFeatureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = NVENC_FEATURE_CACHE_MAGIC;
+    header.version = NVENC_FEATURE_CACHE_VERSION;
+    header.headerSize = sizeof(NVEncFeatureCacheHeader);
+    header.apiVersion = NVENCAPI_VERSION;
+    header.presetConfigSize = sizeof(NV_ENC_PRESET_CONFIG);
+    header.codecCount = (uint32_t)codecFeatures.size();
+    header.fileSize = buf.size();
+    header.checksum = nvfeature_cache_checksum(buf.data() + sizeof(header), buf.size() - sizeof(header));
+    header.key = key;
+    memcpy(buf.data(), &header, sizeof(header));
+
+    //複数のプロセスから同時に書き込まれても壊れたファイルが見えないよう、一時ファイルに書き込んでから置き換える
+#if defined(_WIN32) || defined(_WIN64)
+    const tstring tmpPath = tstring(path) + strsprintf(_T(".%d.tmp"), GetCurrentProcessId());
+#else
+    const tstring tmpPath = tstring(path) + strsprintf(_T(".%d.tmp"), (int)getpid());
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    {
+        std::ofstream fout(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fout.good()) {
+            return RGY_ERR_FILE_OPEN;
+        }
+        fout.write((const char *)buf.data(), buf.size());
+        if (!fout.good()) {
+            fout.close();
+            _tremove(tmpPath.c_str());
+            return RGY_ERR_UNKNOWN;
+        }
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (!MoveFileEx(tmpPath.c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (0 != rename(tmpPath.c_str(), path)) {
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        _tremove(tmpPath.c_str());
+        return RGY_ERR_ACCESS_DENIED;
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR nvfeature_parse_dump(const TCHAR *path, std::vector<NVEncCodecFeature>& codecFeatures) {
+    std::ifstream fin(path);
+    if (!fin.good()) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    codecFeatures.clear();
+    NVEncCodecFeature *feature = nullptr;
+    std::string line;
+    while (std::getline(fin, line)) {
+        const auto str = trim(char_to_tstring(line));
+        if (str.length() == 0) {
+            //空行でcodecごとのリストが終わる
+            feature = nullptr;
+            continue;
+        }
+        //"Codec: H.264/AVC" (古いバージョンでは日本語で出力されている)
+        const auto codecPos = str.rfind(_T(": "));
+        if (codecPos != tstring::npos) {
+            const GUID codec = get_guid_from_name(str.c_str() + codecPos + 2, list_nvenc_codecs);
+            const GUID guidNull = { 0 };
+            if (0 != memcmp(&codec, &guidNull, sizeof(GUID))) {
+                codecFeatures.push_back(NVEncCodecFeature(codec));
+                feature = &codecFeatures.back();
+                continue;
+            }
+        }
+        if (feature == nullptr) {
+            continue;
+        }
+        //"名前 (空白で桁揃え) 値"の形式
+        const auto pos = str.find_last_of(_T(" \t"));
+        if (pos == tstring::npos) {
+            continue;
+        }
+        const auto name = trim(str.substr(0, pos));
+        const auto valueStr = str.substr(pos + 1);
+        for (int i = 0; list_nvenc_caps[i].name; i++) {
+            if (name == list_nvenc_caps[i].name) {
+                NVEncCap cap = { 0 };
+                cap.id = list_nvenc_caps[i].id;
+                cap.name = list_nvenc_caps[i].name;
+                cap.isBool = list_nvenc_caps[i].isBool;
+                if (valueStr == _T("yes")) {
+                    cap.value = 1;
+                } else if (valueStr == _T("no")) {
+                    cap.value = 0;
+                } else {
+                    try {
+                        cap.value = std::stoi(valueStr);
+                    } catch (...) {
+                        return RGY_ERR_INVALID_FORMAT;
+                    }
+                }
+                feature->caps.push_back(cap);
+                break;
+            }
+        }
+    }
+    return (codecFeatures.size() > 0) ? RGY_ERR_NONE : RGY_ERR_NOT_FOUND;
+}
+
+static bool nvfeature_equal(const std::vector<NVEncCodecFeature>& a, const std::vector<NVEncCodecFeature>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (0 != memcmp(&a[i].codec, &b[i].codec, sizeof(GUID))
+            || a[i].caps.size() != b[i].caps.size()
+            || a[i].profiles.size() != b[i].profiles.size()
+            || a[i].presets.size() != b[i].presets.size()
+            || a[i].presetConfigs.size() != b[i].presetConfigs.size()
+            || a[i].surfaceFmt.size() != b[i].surfaceFmt.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < a[i].caps.size(); j++) {
+            if (a[i].caps[j].id != b[i].caps[j].id
+                || a[i].caps[j].value != b[i].caps[j].value
+                || a[i].caps[j].isBool != b[i].caps[j].isBool
+                || 0 != _tcscmp(a[i].caps[j].name, b[i].caps[j].name)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int nvfeature_cache_check(FILE *fp, const TCHAR *dumpPath) {
+    std::vector<NVEncCodecFeature> dumpFeatures;
+    auto err = nvfeature_parse_dump(dumpPath, dumpFeatures);
+    if (err != RGY_ERR_NONE) {
+        _ftprintf(fp, _T("Failed to parse \"%s\": %s.\n"), dumpPath, get_err_mes(err));
+        return 1;
+    }
+    for (const auto& feature : dumpFeatures) {
+        _ftprintf(fp, _T("%s: %d caps\n"), get_name_from_guid(feature.codec, list_nvenc_codecs), (int)feature.caps.size());
+    }
+    //実際のGPUと重ならないよう、ダミーのキーを使用する
+    NVEncFeatureCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.driverVersion = NV_DRIVER_VER_MIN;
+    strcpy_s(key.pciBusId, "check:features:cache");
+    strcpy_s(key.gpuName, tchar_to_string(PathFindFileName(dumpPath)).c_str());
+    const auto cachePath = nvfeature_cache_path(key);
+
+    int ret = 0;
+    auto check = [&](const TCHAR *name, bool ok) {
+        _ftprintf(fp, _T("%-28s: %s\n"), name, ok ? _T("OK") : _T("NG"));
+        if (!ok) ret = 1;
+    };
+    std::vector<NVEncCodecFeature> loaded;
+    check(_T("save"), nvfeature_cache_save(cachePath.c_str(), key, dumpFeatures) == RGY_ERR_NONE);
+    check(_T("load"), nvfeature_cache_load(cachePath.c_str(), key, loaded) == RGY_ERR_NONE && nvfeature_equal(dumpFeatures, loaded));
+
+    NVEncFeatureCacheKey keyChanged = key;
+    keyChanged.driverVersion++;
+    check(_T("invalidate (driver version)"), nvfeature_cache_load(cachePath.c_str(), keyChanged, loaded) == RGY_ERR_INVALID_VERSION);
+    keyChanged = key;
+    keyChanged.pciBusId[0] = 'x';
+    check(_T("invalidate (pci bus id)"), nvfeature_cache_load(cachePath.c_str(), keyChanged, loaded) == RGY_ERR_INVALID_VERSION);
+    keyChanged = key;
+    keyChanged.driverVersion = 0;
+    check(_T("invalidate (unknown driver)"), nvfeature_cache_load(cachePath.c_str(), keyChanged, loaded) != RGY_ERR_NONE);
+
+    //ファイルの一部を壊して、読み込まれないことを確認する
+    {
+        std::fstream f(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(-1, std::ios::end);
+        f.put((char)0xff);
+    }
+    check(_T("invalidate (corrupted)"), nvfeature_cache_load(cachePath.c_str(), key, loaded) == RGY_ERR_INVALID_FORMAT);
+    _tremove(cachePath.c_str());
+    return ret;
+}
 
 NVEncFeature::NVEncFeature() :
     m_nTargetDeviceID(0),
@@ -50,9 +410,34 @@ NVEncFeature::~NVEncFeature() {
     m_hEvCreateCodecCache.reset();
 }
 
+bool NVEncFeature::getCacheKey(int deviceID, NVEncFeatureCacheKey& key) {
+    memset(&key, 0, sizeof(key));
+    if (CUDA_SUCCESS != cuInit(0)) {
+        return false;
+    }
+    char pci_bus_name[1024] = { 0 };
+    cudaDeviceProp devProp;
+    if (cudaSuccess != cudaDeviceGetPCIBusId(pci_bus_name, sizeof(pci_bus_name), deviceID)
+        || cudaSuccess != cudaGetDeviceProperties(&devProp, deviceID)) {
+        return false;
+    }
+    //CUDA 8ではGPUのUUIDが取得できないため、PCI Bus IDとGPU名で識別する
+    memcpy(key.pciBusId, pci_bus_name, (std::min)(strlen(pci_bus_name), sizeof(key.pciBusId) - 1));
+    memcpy(key.gpuName, devProp.name, (std::min)(strlen(devProp.name), sizeof(key.gpuName) - 1));
+    key.driverVersion = getNVDriverVersion(pci_bus_name, deviceID);
+    return key.driverVersion > 0;
+}
+
 int NVEncFeature::createCache(int deviceID, int loglevel) {
+    NVEncFeatureCacheKey key;
+    tstring cachePath;
     if (!check_if_nvcuda_dll_available()) {
         SetEvent(m_hEvCreateCodecCache.get());
+    } else if (getCacheKey(deviceID, key)
+        && (cachePath = nvfeature_cache_path(key)).length() > 0
+        && RGY_ERR_NONE == nvfeature_cache_load(cachePath.c_str(), key, m_EncodeFeatures)) {
+        //キャッシュが有効なら、エンコーダを初期化せずに済ませる
+        SetEvent(m_hEvCreateCodecCache.get());
     } else {
 
         m_pNVEncCore.reset(new NVEncCore());
@@ -72,6 +457,9 @@ int NVEncFeature::createCache(int deviceID, int loglevel) {
             m_pNVEncCore->createDeviceFeatureList();
             m_EncodeFeatures = m_pNVEncCore->GetNVEncCapability();
             m_pNVEncCore.reset();
+            if (cachePath.length() > 0 && m_EncodeFeatures.size() > 0) {
+                nvfeature_cache_save(cachePath.c_str(), key, m_EncodeFeatures);
+            }
         }
     }
     SetEvent(m_hEvCreateCache.get());
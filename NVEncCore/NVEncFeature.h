@@ -38,6 +38,32 @@
 #include "NVEncCore.h"
 #include "NVEncParam.h"
 
+//featureリストのキャッシュ
+//ドライバのバージョン、PCI Bus ID、GPU名が一致する場合のみ有効とし、
+//一致しない場合やファイルが壊れている場合は取得し直して上書きする
+//NVENC APIのバージョンと構造体のサイズはヘッダで確認する
+static const uint32_t NVENC_FEATURE_CACHE_MAGIC = 0x4346564e; //'NVFC'
+static const uint32_t NVENC_FEATURE_CACHE_VERSION = 1;
+
+struct NVEncFeatureCacheKey {
+    int32_t driverVersion;   //1000倍
+    char pciBusId[32];
+    char gpuName[256];
+};
+
+//キャッシュファイルのパスを取得 (一時フォルダ内)
+tstring nvfeature_cache_path(const NVEncFeatureCacheKey& key);
+//キャッシュをメモリマップして読み込む (キーが一致しない、または壊れている場合はエラー)
+RGY_ERR nvfeature_cache_load(const TCHAR *path, const NVEncFeatureCacheKey& key, std::vector<NVEncCodecFeature>& codecFeatures);
+//キャッシュを書き込む (一時ファイルに書き込んだのち置き換える)
+RGY_ERR nvfeature_cache_save(const TCHAR *path, const NVEncFeatureCacheKey& key, const std::vector<NVEncCodecFeature>& codecFeatures);
+
+//--check-featuresの出力 (GPUFeatures/*.txt) からfeatureリストを作成する
+//capsとcodecのみが復元され、profile/preset等は空となる
+RGY_ERR nvfeature_parse_dump(const TCHAR *path, std::vector<NVEncCodecFeature>& codecFeatures);
+//ダンプから作成したfeatureリストでキャッシュの保存/読み込み/無効化を確認する
+int nvfeature_cache_check(FILE *fp, const TCHAR *dumpPath);
+
 class NVEncFeature : public NVEncCore
 {
 public:
@@ -62,6 +88,8 @@ public:
 protected:
     //featureの取得を実行
     int createCache(int deviceID, int loglevel);
+    //キャッシュのキーを取得 (取得できなければfalse)
+    static bool getCacheKey(int deviceID, NVEncFeatureCacheKey& key);
 
     int m_nTargetDeviceID;   //対象デバイスID
     std::unique_ptr<NVEncCore> m_pNVEncCore; //NVEncCoreのインスタンス (スレッド終了時にdelete)
@@ -32,7 +32,7 @@ NVEncFilter::NVEncFilter() :
     m_sFilterName(), m_sFilterInfo(), m_pPrintMes(), m_pFrameBuf(), m_nFrameIdx(0),
     m_pFieldPairIn(), m_pFieldPairOut(),
     m_pParam(),
-    m_nPathThrough(FILTER_PATHTHROUGH_ALL), m_bCheckPerformance(false),
+    m_nPathThrough(FILTER_PATHTHROUGH_ALL), m_nTraceNameId(RGY_TRACE_FILTER), m_bCheckPerformance(false),
     m_peFilterStart(), m_peFilterFin(), m_dFilterTimeMs(0.0), m_nFilterRunCount(0) {
 
 }
@@ -78,6 +78,15 @@ cudaError_t NVEncFilter::AllocFrameBuf(const FrameInfo& frame, int frames) {
 }
 
 RGY_ERR NVEncFilter::filter(FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+#if ENABLE_PERF_TRACE
+    if (m_nTraceNameId == RGY_TRACE_FILTER && RGYPerfTrace::get()) {
+        m_nTraceNameId = RGYPerfTrace::registerName(m_sFilterName);
+    }
+#endif //#if ENABLE_PERF_TRACE
+    //GPUの処理は非同期なので、ここで記録されるのはCPU側でカーネルを投入するまでの時間
+    RGY_PERF_TRACE_SCOPE(traceFilter, m_nTraceNameId,
+        (pInputFrame) ? pInputFrame->inputFrameId : -1,
+        (pInputFrame) ? pInputFrame->timestamp : RGY_PERF_TRACE_NO_PTS);
     cudaError_t cudaerr = cudaSuccess;
     if (m_bCheckPerformance) {
         cudaerr = cudaEventRecord(*m_peFilterStart.get());
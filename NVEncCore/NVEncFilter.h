@@ -45,8 +45,10 @@
 #include "NVEncUtil.h"
 #include "NVEncParam.h"
 #include "rgy_log.h"
+#include "rgy_perf_trace.h"
 #include "convert_csp.h"
 #include "NVEncFrameInfo.h"
+#include "NVEncFilterParam.h"
 
 #pragma comment(lib, "cudart_static.lib")
 
@@ -227,17 +229,6 @@ static cudaError_t copyFrameDataAsync(FrameInfo *dst, const FrameInfo *src, cuda
     return cudaMemcpy2DAsync(dst->ptr, dst->pitch, src->ptr, src->pitch, dstInfoEx.width_byte, dstInfoEx.height_total, getCudaMemcpyKind(src->deivce_mem, dst->deivce_mem), stream);
 }
 
-class NVEncFilterParam {
-public:
-    FrameInfo frameIn;
-    FrameInfo frameOut;
-    rgy_rational<int> baseFps;
-    bool bOutOverwrite;
-
-    NVEncFilterParam() : frameIn({ 0 }), frameOut({ 0 }), baseFps(), bOutOverwrite(false) {};
-    virtual ~NVEncFilterParam() {};
-};
-
 struct CUFrameBuf {
 public:
     FrameInfo frame;
@@ -405,37 +396,6 @@ struct CUMemBufPair {
     }
 };
 
-enum FILTER_PATHTHROUGH_FRAMEINFO : uint32_t {
-    FILTER_PATHTHROUGH_NONE      = 0x00u,
-    FILTER_PATHTHROUGH_TIMESTAMP = 0x01u,
-    FILTER_PATHTHROUGH_FLAGS     = 0x02u,
-    FILTER_PATHTHROUGH_PICSTRUCT = 0x04u,
-
-    FILTER_PATHTHROUGH_ALL       = 0x07u,
-};
-
-static FILTER_PATHTHROUGH_FRAMEINFO operator|(FILTER_PATHTHROUGH_FRAMEINFO a, FILTER_PATHTHROUGH_FRAMEINFO b) {
-    return (FILTER_PATHTHROUGH_FRAMEINFO)((uint32_t)a | (uint32_t)b);
-}
-
-static FILTER_PATHTHROUGH_FRAMEINFO operator|=(FILTER_PATHTHROUGH_FRAMEINFO& a, FILTER_PATHTHROUGH_FRAMEINFO b) {
-    a = a | b;
-    return a;
-}
-
-static FILTER_PATHTHROUGH_FRAMEINFO operator&(FILTER_PATHTHROUGH_FRAMEINFO a, FILTER_PATHTHROUGH_FRAMEINFO b) {
-    return (FILTER_PATHTHROUGH_FRAMEINFO)((uint32_t)a & (uint32_t)b);
-}
-
-static FILTER_PATHTHROUGH_FRAMEINFO operator&=(FILTER_PATHTHROUGH_FRAMEINFO& a, FILTER_PATHTHROUGH_FRAMEINFO b) {
-    a = a & b;
-    return a;
-}
-
-static FILTER_PATHTHROUGH_FRAMEINFO operator~(FILTER_PATHTHROUGH_FRAMEINFO a) {
-    return (FILTER_PATHTHROUGH_FRAMEINFO)(~((uint32_t)a));
-}
-
 class NVEncFilter {
 public:
     NVEncFilter();
@@ -478,12 +438,8 @@ protected:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_pPrintMes->write_va(log_level, (m_sFilterName + _T(": ")).c_str(), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
     cudaError_t AllocFrameBuf(const FrameInfo& frame, int frames);
 
@@ -497,6 +453,7 @@ protected:
     shared_ptr<NVEncFilterParam> m_pParam;
     FILTER_PATHTHROUGH_FRAMEINFO m_nPathThrough;
 private:
+    uint16_t m_nTraceNameId; //--perf-trace用のフィルタ名のID
     bool m_bCheckPerformance;
     unique_ptr<cudaEvent_t, cudaevent_deleter> m_peFilterStart;
     unique_ptr<cudaEvent_t, cudaevent_deleter> m_peFilterFin;
@@ -504,13 +461,6 @@ private:
     int m_nFilterRunCount;
 };
 
-class NVEncFilterParamCrop : public NVEncFilterParam {
-public:
-    sInputCrop crop;
-
-    virtual ~NVEncFilterParamCrop() {};
-};
-
 class NVEncFilterCspCrop : public NVEncFilter {
 public:
     NVEncFilterCspCrop();
@@ -527,12 +477,6 @@ protected:
     virtual void close() override;
 };
 
-class NVEncFilterParamResize : public NVEncFilterParam {
-public:
-    int interp;
-    virtual ~NVEncFilterParamResize() {};
-};
-
 class NVEncFilterResize : public NVEncFilter {
 public:
     NVEncFilterResize();
@@ -568,12 +512,6 @@ protected:
     bool m_bInterlacedWarn;
 };
 
-class NVEncFilterParamPad : public NVEncFilterParam {
-public:
-    VppPad pad;
-    virtual ~NVEncFilterParamPad() {};
-};
-
 class NVEncFilterPad : public NVEncFilter {
 public:
     NVEncFilterPad();
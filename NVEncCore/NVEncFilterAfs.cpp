@@ -30,6 +30,7 @@
 #include <array>
 #include "convert_csp.h"
 #include "NVEncFilterAfs.h"
+#include "NVEncFilterCpu.h"
 #include "NVEncParam.h"
 #include "afs_stg.h"
 #pragma warning (push)
@@ -37,17 +38,6 @@
 static void afs_get_motion_count_simd(int *motion_count, const uint8_t *ptr, const AFS_SCAN_CLIP *clip, int pitch, int scan_w, int scan_h, int tb_order);
 static void afs_get_stripe_count_simd(int *stripe_count, const uint8_t *ptr, const AFS_SCAN_CLIP *clip, int pitch, int scan_w, int scan_h, int tb_order);
 
-template<typename T>
-T max3(T a, T b, T c) {
-    return std::max(std::max(a, b), c);
-}
-template<typename T>
-T absdiff(T a, T b) {
-    T a_b = a - b;
-    T b_a = b - a;
-    return (a >= b) ? a_b : b_a;
-}
-
 afsSourceCache::afsSourceCache() :
     m_sourceArray(),
     m_nFramesInput(0) {
@@ -254,198 +244,6 @@ afsStripeCache::~afsStripeCache() {
     clear();
 }
 
-afsStreamStatus::afsStreamStatus() :
-    m_initialized(false),
-    m_quarter_jitter(0),
-    m_additional_jitter(0),
-    m_phase24(0),
-    m_position24(0),
-    m_prev_jitter(0),
-    m_prev_rff_smooth(0),
-    m_prev_status(0),
-    m_set_frame(-1),
-    m_pos(),
-    m_fpLog() {
-};
-
-afsStreamStatus::~afsStreamStatus() {
-    m_fpLog.reset();
-}
-
-void afsStreamStatus::init(uint8_t status, int drop24) {
-    m_prev_status = status;
-    m_prev_jitter = 0;
-    m_additional_jitter = 0;
-    m_prev_rff_smooth = 0;
-    m_phase24 = 4;
-    m_position24 = 0;
-    if (drop24 ||
-        (!(status & AFS_FLAG_SHIFT0) &&
-        (status & AFS_FLAG_SHIFT1) &&
-            (status & AFS_FLAG_SHIFT2))) {
-        m_phase24 = 0;
-    }
-    if (status & AFS_FLAG_FORCE24) {
-        m_position24++;
-    } else {
-        m_phase24 -= m_position24 + 1;
-        m_position24 = 0;
-    }
-    m_initialized = true;
-}
-
-int afsStreamStatus::open_log(const tstring& log_filename) {
-    FILE *fp = NULL;
-    if (_tfopen_s(&fp, log_filename.c_str(), _T("w"))) {
-        return 1;
-    }
-    m_fpLog = unique_ptr<FILE, fp_deleter>(fp, fp_deleter());
-    fprintf(m_fpLog.get(), " iframe,  sts,       ,        pos,   orig_pts, q_jit, prevjit, pos24, phase24, rff_smooth\n");
-    return 0;
-}
-
-void afsStreamStatus::write_log(const afsFrameTs *const frameTs) {
-    if (!m_fpLog) {
-        return;
-    }
-    fprintf(m_fpLog.get(), "%7d, 0x%2x, %s%s%s%s%s%s, %10lld, %10lld, %3d, %3d, %3d, %3d, %3d\n",
-        frameTs->iframe,
-        m_prev_status,
-        m_prev_status & AFS_FLAG_PROGRESSIVE ? "p" : "i",
-        ISRFF(m_prev_status) ? "r" : "-",
-        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT0) ? "0" : "-",
-        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT1) ? "1" : "-",
-        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT2) ? "2" : "-",
-        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT3) ? "3" : "-",
-        frameTs->pos, frameTs->orig_pts,
-        m_quarter_jitter, m_prev_jitter, m_position24, m_phase24, m_prev_rff_smooth);
-    return;
-}
-
-int afsStreamStatus::set_status(int iframe, uint8_t status, int drop24, int64_t orig_pts) {
-    afsFrameTs *const frameTs = &m_pos[iframe & 15];
-    frameTs->iframe = iframe;
-    frameTs->orig_pts = orig_pts;
-    if (!m_initialized) {
-        init(status, 0);
-        frameTs->pos = orig_pts;
-        m_set_frame = iframe;
-        write_log(frameTs);
-        return 0;
-    }
-    if (iframe > m_set_frame + 1) {
-        return 1;
-    }
-    m_set_frame = iframe;
-
-    int pull_drop = 0;
-    int quarter_jitter = 0;
-    int rff_smooth = 0;
-    if (status & AFS_FLAG_PROGRESSIVE) {
-        if (status & (AFS_FLAG_FORCE24 | AFS_FLAG_SMOOTHING)) {
-            if (!m_prev_rff_smooth) {
-                if (ISRFF(m_prev_status)) rff_smooth = -1;
-                else if ((m_prev_status & AFS_FLAG_PROGRESSIVE) && ISRFF(status)) rff_smooth = 1;
-            }
-            quarter_jitter = rff_smooth;
-        }
-        pull_drop = 0;
-        m_additional_jitter = 0;
-        drop24 = 0;
-    } else {
-        if (status & AFS_FLAG_SHIFT0) {
-            quarter_jitter = -2;
-        } else if (m_prev_status & AFS_FLAG_SHIFT0) {
-            quarter_jitter = (status & AFS_FLAG_SMOOTHING) ? -1 : -2;
-        } else {
-            quarter_jitter = 0;
-        }
-        quarter_jitter += ((status & AFS_FLAG_SMOOTHING) || m_additional_jitter != -1) ? m_additional_jitter : -2;
-
-        if (status & (AFS_FLAG_FORCE24 | AFS_FLAG_SMOOTHING)) {
-            if (!m_prev_rff_smooth) {
-                if (ISRFF(m_prev_status)) rff_smooth = -1;
-                else if ((m_prev_status & AFS_FLAG_PROGRESSIVE) && ISRFF(status)) rff_smooth = 1;
-            }
-        }
-        quarter_jitter += rff_smooth;
-        m_position24 += rff_smooth;
-
-        pull_drop = (status & AFS_FLAG_FRAME_DROP)
-            && !((m_prev_status|status) & AFS_FLAG_SHIFT0)
-            && (status & AFS_FLAG_SHIFT1);
-        m_additional_jitter = pull_drop ? -1 : 0;
-
-        drop24 = drop24 ||
-            (!(status & AFS_FLAG_SHIFT0) &&
-              (status & AFS_FLAG_SHIFT1) &&
-              (status & AFS_FLAG_SHIFT2));
-    }
-
-    if (drop24) m_phase24 = (m_position24 + 100) % 5;
-    drop24 = 0;
-    if (m_position24 >= m_phase24 &&
-        ((m_position24 + 100) % 5 == m_phase24 ||
-         (m_position24 +  99) % 5 == m_phase24)) {
-        m_position24 -= 5;
-        drop24 = 1;
-    }
-
-    if (status & AFS_FLAG_FORCE24) {
-        pull_drop = drop24;
-        if (status & AFS_FLAG_PROGRESSIVE) {
-            quarter_jitter += m_position24;
-        } else {
-            quarter_jitter = m_position24++;
-        }
-    } else if (!(status & AFS_FLAG_PROGRESSIVE)) {
-        m_phase24 -= m_position24 + 1;
-        m_position24 = 0;
-    }
-    int drop_thre = (status & AFS_FLAG_FRAME_DROP) ? 0 : -3;
-    if (!(status & AFS_FLAG_PROGRESSIVE) && ISRFF(m_prev_status)) {
-        //rffからの切替時はなるべくdropさせない
-        drop_thre = -3;
-    }
-    int drop = (quarter_jitter - m_prev_jitter < drop_thre);
-
-    m_quarter_jitter = quarter_jitter;
-    m_prev_rff_smooth = rff_smooth;
-    m_prev_status = status;
-
-    drop |= pull_drop;
-    if (drop) {
-        m_prev_jitter -= 4;
-        m_quarter_jitter = 0;
-        frameTs->pos = AFS_SSTS_DROP; //drop
-    } else {
-        m_prev_jitter = m_quarter_jitter;
-        frameTs->pos = frameTs->orig_pts + m_quarter_jitter;
-    }
-    write_log(frameTs);
-    return 0;
-}
-
-int64_t afsStreamStatus::get_duration(int64_t iframe) {
-    if (m_set_frame < iframe + 2) {
-        return AFS_SSTS_ERROR;
-    }
-    auto iframe_pos = m_pos[(iframe + 0) & 15].pos;
-    if (iframe_pos < 0) {
-        return AFS_SSTS_DROP;
-    }
-    auto next_pos = m_pos[(iframe + 1) & 15].pos;
-    if (next_pos < 0) {
-        //iframe + 1がdropならその先のフレームを参照
-        next_pos = m_pos[(iframe + 2) & 15].pos;
-    }
-    if (next_pos < 0) {
-        //iframe + 1がdropならその先のフレームを参照
-        next_pos = m_pos[(iframe + 3) & 15].pos;
-    }
-    return next_pos - iframe_pos;
-}
-
 NVEncFilterAfs::NVEncFilterAfs() :
     m_streamAnalyze(),
     m_streamCopy(),
@@ -460,7 +258,7 @@ NVEncFilterAfs::NVEncFilterAfs() :
     m_status(),
     m_streamsts(),
     m_count_motion(),
-    m_fpTimecode() {
+    m_timecode() {
     m_sFilterName = _T("afs");
 }
 
@@ -626,7 +424,7 @@ RGY_ERR NVEncFilterAfs::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGY
 
     if (pAfsParam->afs.timecode) {
         const tstring tc_filename = PathRemoveExtensionS(pAfsParam->outFilename) + _T(".timecode.txt");
-        if (open_timecode(tc_filename)) {
+        if (m_timecode.open(tc_filename)) {
             errno_t error = errno;
             AddMessage(RGY_LOG_ERROR, _T("failed to open timecode file \"%s\": %s.\n"), tc_filename.c_str(), _tcserror(error));
             return RGY_ERR_FILE_OPEN; // Couldn't open file
@@ -851,30 +649,7 @@ cudaError_t NVEncFilterAfs::count_stripe(AFS_STRIPE_DATA *sp, const AFS_SCAN_CLI
 }
 
 int NVEncFilterAfs::detect_telecine_cross(int iframe, int coeff_shift) {
-    using std::max;
-    const AFS_SCAN_DATA *sp1 = m_scan.get(iframe - 1);
-    const AFS_SCAN_DATA *sp2 = m_scan.get(iframe + 0);
-    const AFS_SCAN_DATA *sp3 = m_scan.get(iframe + 1);
-    const AFS_SCAN_DATA *sp4 = m_scan.get(iframe + 2);
-    int shift = 0;
-
-    if (max(absdiff(sp1->lf_motion + sp2->lf_motion, sp2->ff_motion),
-        absdiff(sp3->ff_motion + sp4->ff_motion, sp3->lf_motion)) * coeff_shift >
-        max3(absdiff(sp1->ff_motion + sp2->ff_motion, sp1->lf_motion),
-            absdiff(sp2->ff_motion + sp3->ff_motion, sp2->lf_motion),
-            absdiff(sp3->lf_motion + sp4->lf_motion, sp4->ff_motion)) * 256)
-        if (max(sp2->lf_motion, sp3->ff_motion) * coeff_shift > sp2->ff_motion * 256)
-            shift = 1;
-
-    if (max(absdiff(sp1->lf_motion + sp2->lf_motion, sp2->ff_motion),
-        absdiff(sp3->ff_motion + sp4->ff_motion, sp3->lf_motion)) * coeff_shift >
-        max3(absdiff(sp1->ff_motion + sp2->ff_motion, sp1->lf_motion),
-            absdiff(sp2->lf_motion + sp3->lf_motion, sp3->ff_motion),
-            absdiff(sp3->lf_motion + sp4->lf_motion, sp4->ff_motion)) * 256)
-        if (max(sp2->lf_motion, sp3->ff_motion) * coeff_shift > sp3->lf_motion * 256)
-            shift = 1;
-
-    return shift;
+    return afs_detect_telecine_cross(m_scan.get(iframe - 1), m_scan.get(iframe + 0), m_scan.get(iframe + 1), m_scan.get(iframe + 2), coeff_shift);
 }
 
 cudaError_t NVEncFilterAfs::analyze_frame(int iframe, const NVEncFilterParamAfs *pAfsPrm, int reverse[4], int assume_shift[4], int result_stat[4]) {
@@ -882,13 +657,8 @@ cudaError_t NVEncFilterAfs::analyze_frame(int iframe, const NVEncFilterParamAfs
         assume_shift[i] = detect_telecine_cross(iframe + i, pAfsPrm->afs.coeff_shift);
     }
 
-    AFS_SCAN_DATA *scp = m_scan.get(iframe);
-    const int scan_w = m_pParam->frameIn.width;
-    const int scan_h = m_pParam->frameIn.height;
-    int total = 0;
-    if (scan_h - scp->clip.bottom - ((scan_h - scp->clip.top - scp->clip.bottom) & 1) > scp->clip.top && scan_w - scp->clip.right > scp->clip.left)
-        total = (scan_h - scp->clip.bottom - ((scan_h - scp->clip.top - scp->clip.bottom) & 1) - scp->clip.top) * (scan_w - scp->clip.right - scp->clip.left);
-    const int threshold = (total * pAfsPrm->afs.method_switch) >> 12;
+    const AFS_SCAN_DATA *scp = m_scan.get(iframe);
+    const int threshold = afs_stripe_threshold(&scp->clip, m_pParam->frameIn.width, m_pParam->frameIn.height, pAfsPrm->afs.method_switch);
 
     for (int i = 0; i < 4; i++) {
         auto cudaerr = get_stripe_info(iframe + i, 0, pAfsPrm);
@@ -896,55 +666,28 @@ cudaError_t NVEncFilterAfs::analyze_frame(int iframe, const NVEncFilterParamAfs
             AddMessage(RGY_LOG_ERROR, _T("failed on get_stripe_info(iframe=%d): %s.\n"), iframe + i, char_to_tstring(cudaGetErrorName(cudaerr)).c_str());
             return cudaerr;
         }
-        AFS_STRIPE_DATA *stp = m_stripe.get(iframe + i);
-        result_stat[i] = (stp->count0 * pAfsPrm->afs.coeff_shift > stp->count1 * 256) ? 1 : 0;
-        if (threshold > stp->count1 && threshold > stp->count0)
-            result_stat[i] += 2;
-    }
-
-    uint8_t status = AFS_STATUS_DEFAULT;
-    if (result_stat[0] & 2)
-        status |= assume_shift[0] ? AFS_FLAG_SHIFT0 : 0;
-    else
-        status |= (result_stat[0] & 1) ? AFS_FLAG_SHIFT0 : 0;
-    if (reverse[0]) status ^= AFS_FLAG_SHIFT0;
-
-    if (result_stat[1] & 2)
-        status |= assume_shift[1] ? AFS_FLAG_SHIFT1 : 0;
-    else
-        status |= (result_stat[1] & 1) ? AFS_FLAG_SHIFT1 : 0;
-    if (reverse[1]) status ^= AFS_FLAG_SHIFT1;
-
-    if (result_stat[2] & 2)
-        status |= assume_shift[2] ? AFS_FLAG_SHIFT2 : 0;
-    else
-        status |= (result_stat[2] & 1) ? AFS_FLAG_SHIFT2 : 0;
-    if (reverse[2]) status ^= AFS_FLAG_SHIFT2;
-
-    if (result_stat[3] & 2)
-        status |= assume_shift[3] ? AFS_FLAG_SHIFT3 : 0;
-    else
-        status |= (result_stat[3] & 1) ? AFS_FLAG_SHIFT3 : 0;
-    if (reverse[3]) status ^= AFS_FLAG_SHIFT3;
-
-    const auto& frameinfo = m_source.get(iframe)->frame;
-    if (!interlaced(frameinfo)) {
-        status |= AFS_FLAG_PROGRESSIVE;
-        if (frameinfo.flags & RGY_FRAME_FLAG_RFF) status |= AFS_FLAG_RFF;
-    }
-    if (pAfsPrm->afs.drop) {
-        if (interlaced(frameinfo)) status |= AFS_FLAG_FRAME_DROP;
-        if (pAfsPrm->afs.smooth) status |= AFS_FLAG_SMOOTHING;
-    }
-    if (pAfsPrm->afs.force24) status |= AFS_FLAG_FORCE24;
-    if (iframe < 1) status &= AFS_MASK_SHIFT0;
-
-    m_status[iframe] = status;
+        const AFS_STRIPE_DATA *stp = m_stripe.get(iframe + i);
+        result_stat[i] = afs_result_stat(stp->count0, stp->count1, threshold, pAfsPrm->afs.coeff_shift);
+    }
+
+    m_status[iframe] = afs_frame_status(iframe, m_source.get(iframe)->frame, &pAfsPrm->afs, reverse, assume_shift, result_stat);
     return cudaSuccess;
 }
 
 RGY_ERR NVEncFilterAfs::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
     RGY_ERR sts = RGY_ERR_NONE;
+    //drainはptr == nullptrのフレームで行われるが、間引きで出力がないと、
+    //呼び出し側ではdrainが完了したと判断されてしまうので、出力があるか、すべて出力し終えるまで繰り返す
+    do {
+        sts = proc_frame(pInputFrame, ppOutputFrames, pOutputFrameNum);
+    } while (sts == RGY_ERR_NONE
+        && pInputFrame->ptr == nullptr && *pOutputFrameNum == 0
+        && m_nFrame < m_source.inframe());
+    return sts;
+}
+
+RGY_ERR NVEncFilterAfs::proc_frame(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
 
     auto pAfsParam = std::dynamic_pointer_cast<NVEncFilterParamAfs>(m_pParam);
     if (!pAfsParam) {
@@ -1003,7 +746,8 @@ RGY_ERR NVEncFilterAfs::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppO
     }
     static const int preread_len = 3;
     //十分な数のフレームがたまった、あるいはdrainモードならフレームを出力
-    if (iframe >= (5+preread_len+STREAM_OPT) || pInputFrame == nullptr) {
+    //(drainはptr == nullptrのフレームで行われるので、短いクリップでもここで出力する)
+    if (iframe >= (5+preread_len+STREAM_OPT) || pInputFrame->ptr == nullptr) {
         int reverse[4] = { 0 }, assume_shift[4] = { 0 }, result_stat[4] = { 0 };
 
         //m_streamsts.get_durationを呼ぶには、3フレーム先までstatusをセットする必要がある
@@ -1062,7 +806,7 @@ RGY_ERR NVEncFilterAfs::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppO
             }
 
             if (pAfsParam->afs.timecode) {
-                write_timecode(m_nPts, pAfsParam->outTimebase);
+                m_timecode.write(m_nPts, pAfsParam->outTimebase);
             }
 
             pOutFrame->frame.flags = m_source.get(m_nFrame)->frame.flags & (~(RGY_FRAME_FLAG_RFF | RGY_FRAME_FLAG_RFF_COPY | RGY_FRAME_FLAG_RFF_BFF | RGY_FRAME_FLAG_RFF_TFF));
@@ -1152,22 +896,6 @@ cudaError_t NVEncFilterAfs::copy_frame(CUFrameBuf *pOut, CUFrameBuf *p0, cudaStr
     return cudaerr;
 }
 
-int NVEncFilterAfs::open_timecode(tstring tc_filename) {
-    FILE *fp = NULL;
-    if (_tfopen_s(&fp, tc_filename.c_str(), _T("w"))) {
-        return 1;
-    }
-    m_fpTimecode = unique_ptr<FILE, fp_deleter>(fp, fp_deleter());
-    fprintf(m_fpTimecode.get(), "# timecode format v2\n");
-    return 0;
-}
-
-void NVEncFilterAfs::write_timecode(int64_t pts, const rgy_rational<int>& timebase) {
-    if (pts >= 0) {
-        fprintf(m_fpTimecode.get(), "%.6lf\n", pts * timebase.qdouble() * 1000.0);
-    }
-}
-
 void NVEncFilterAfs::close() {
     m_streamAnalyze.reset();
     m_streamCopy.reset();
@@ -1181,10 +909,205 @@ void NVEncFilterAfs::close() {
     m_stripe.clear();
     m_status.clear();
     m_count_motion.clear();
-    m_fpTimecode.reset();
+    m_timecode.close();
     AddMessage(RGY_LOG_DEBUG, _T("closed afs filter.\n"));
 }
 
+//CPU版とCUDA版の出力フレームの画素の差の最大値を求める (maxDiff[0]:輝度, maxDiff[1]:色差)
+static void afs_cpu_gpu_diff(const FrameInfo *cpu, const FrameInfo *gpu, int maxDiff[2]) {
+    const bool highbit = RGY_CSP_BIT_DEPTH[cpu->csp] > 8;
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto p0 = getPlane(cpu, plane);
+        const auto p1 = getPlane(gpu, plane);
+        int& diff = maxDiff[(plane == RGY_PLANE_Y) ? 0 : 1];
+        for (int y = 0; y < p0.height; y++) {
+            const uint8_t *line0 = p0.ptr + y * p0.pitch;
+            const uint8_t *line1 = p1.ptr + y * p1.pitch;
+            for (int x = 0; x < p0.width; x++) {
+                const int v0 = (highbit) ? ((const uint16_t *)line0)[x] : line0[x];
+                const int v1 = (highbit) ? ((const uint16_t *)line1)[x] : line1[x];
+                diff = std::max(diff, std::abs(v0 - v1));
+            }
+        }
+    }
+}
+
+int afs_cpu_gpu_check(FILE *fp) {
+    static const int width = 1920;
+    static const int height = 1080;
+    static const int frames = 60;
+    auto cudaerr = cudaSetDevice(0);
+    if (cudaerr == cudaSuccess) {
+        cudaerr = cudaFree(nullptr);
+    }
+    if (cudaerr != cudaSuccess) {
+        fprintf(fp, "failed to initialize cuda: %s\n", cudaGetErrorName(cudaerr));
+        return 1;
+    }
+    const std::pair<RGY_CSP, const char *> csps[] = {
+        { RGY_CSP_YV12,      "yv12" },
+        { RGY_CSP_YV12_16,   "yv12_16" },
+        { RGY_CSP_YUV444,    "yuv444" },
+    };
+    struct AfsCpuGpuCase {
+        const char *name;
+        int analyze;
+        bool tune, drop, smooth;
+    };
+    static const AfsCpuGpuCase checkCases[] = {
+        { "level0", 0, false, false, false },
+        { "level1", 1, false, false, false },
+        { "level2", 2, false, false, false },
+        { "level3", 3, false, false, false },
+        { "level4", 4, false, false, false },
+        { "level5", 5, false, false, false },
+        { "tune",   3, true,  false, false },
+        { "24fps",  3, false, true,  true  },
+    };
+    const auto inFps = rgy_rational<int>(30000, 1001);
+    auto timebase = inFps.inv();
+    timebase *= rgy_rational<int>(1, 4);
+    int ret = 0;
+    fprintf(fp, "csp,case,frames_in,frames_out_cpu,frames_out_gpu,first_mismatch,max_diff_y,max_diff_c,status_mismatch,verify\n");
+    for (const auto& csp : csps) {
+        //入力はCPU版のベンチマークと同じもの
+        vector<unique_ptr<NVEncCpuFrameBuf>> input;
+        vector<unique_ptr<CUFrameBuf>> inputGpu;
+        bool inputOK = afs_cpu_bench_make_input(input, csp.first, width, height, 10) == RGY_ERR_NONE;
+        for (size_t i = 0; inputOK && i < input.size(); i++) {
+            unique_ptr<CUFrameBuf> frame(new CUFrameBuf(width, height, csp.first));
+            inputOK = frame->alloc() == cudaSuccess && frame->copyFrame(&input[i]->frame) == cudaSuccess;
+            frame->frame.picstruct = input[i]->frame.picstruct;
+            inputGpu.push_back(std::move(frame));
+        }
+        if (!inputOK) {
+            fprintf(fp, "%s,-,0,0,0,-1,0,0,0,NG\n", csp.second);
+            ret |= 1;
+            continue;
+        }
+        //YUV420の色差はCUDA版ではテクスチャの補間を通るので、±1の差を許容する
+        const int toleranceC = (RGY_CSP_CHROMA_FORMAT[csp.first] == RGY_CHROMAFMT_YUV420) ? 1 : 0;
+        for (const auto& checkCase : checkCases) {
+            //YUV444は代表的なものだけ
+            if (csp.first == RGY_CSP_YUV444 && strcmp(checkCase.name, "level3") != 0 && strcmp(checkCase.name, "level4") != 0) {
+                continue;
+            }
+            VppParam vpp;
+            vpp.afs.enable = true;
+            vpp.afs.analyze = checkCase.analyze;
+            vpp.afs.tune = checkCase.tune;
+            vpp.afs.drop = checkCase.drop;
+            vpp.afs.smooth = checkCase.smooth;
+
+            NVEncFilterCpuChain chain;
+            auto sts = chain.init(input[0]->frame, sInputCrop({ 0 }), 0, 0, vpp, inFps, timebase, tstring(), csp.first, get_availableSIMD(), nullptr);
+            auto filterCpu = (sts == RGY_ERR_NONE) ? dynamic_cast<NVEncFilterCpuAfs *>(chain.filters()[0].get()) : nullptr;
+
+            unique_ptr<NVEncFilterAfs> filterGpu(new NVEncFilterAfs());
+            shared_ptr<NVEncFilterParamAfs> param(new NVEncFilterParamAfs());
+            param->afs = vpp.afs;
+            param->afs.tb_order = (input[0]->frame.picstruct & RGY_PICSTRUCT_TFF) != 0;
+            param->frameIn = inputGpu[0]->frame;
+            param->frameOut = inputGpu[0]->frame;
+            param->inFps = inFps;
+            param->inTimebase = timebase;
+            param->outTimebase = timebase;
+            param->baseFps = inFps;
+            param->bOutOverwrite = false;
+            if (sts == RGY_ERR_NONE) {
+                sts = filterGpu->init(param, nullptr);
+            }
+            if (sts != RGY_ERR_NONE || filterCpu == nullptr) {
+                fprintf(fp, "%s,%s,0,0,0,-1,0,0,0,NG\n", csp.second, checkCase.name);
+                ret |= 1;
+                continue;
+            }
+
+            //出力されたフレームを順に比較する (出力のタイミングは両者で同じはずだが、ずれても比較できるようにためておく)
+            std::deque<unique_ptr<NVEncCpuFrameBuf>> outCpu, outGpu;
+            int framesOutCpu = 0, framesOutGpu = 0, framesCompared = 0, firstMismatch = -1;
+            int maxDiff[2] = { 0 };
+            auto compareFrames = [&]() {
+                for (; !outCpu.empty() && !outGpu.empty(); outCpu.pop_front(), outGpu.pop_front(), framesCompared++) {
+                    int diff[2] = { 0 };
+                    afs_cpu_gpu_diff(&outCpu.front()->frame, &outGpu.front()->frame, diff);
+                    maxDiff[0] = std::max(maxDiff[0], diff[0]);
+                    maxDiff[1] = std::max(maxDiff[1], diff[1]);
+                    if (firstMismatch < 0
+                        && (diff[0] > 0 || diff[1] > toleranceC
+                            || outCpu.front()->frame.timestamp != outGpu.front()->frame.timestamp
+                            || outCpu.front()->frame.duration != outGpu.front()->frame.duration)) {
+                        firstMismatch = framesCompared;
+                    }
+                }
+            };
+            //出力は次の呼び出しまでしか有効でないので、CPU側にコピーしておく
+            auto addOutput = [&](std::deque<unique_ptr<NVEncCpuFrameBuf>>& queue, const FrameInfo *frame) {
+                unique_ptr<NVEncCpuFrameBuf> copy(new NVEncCpuFrameBuf(frame->width, frame->height, frame->csp));
+                if (copy->alloc() != RGY_ERR_NONE) {
+                    return RGY_ERR_MEMORY_ALLOC;
+                }
+                if (frame->deivce_mem) {
+                    if (copyFrameData(&copy->frame, frame) != cudaSuccess) {
+                        return RGY_ERR_CUDA;
+                    }
+                } else if (copy->copyFrame(frame) != RGY_ERR_NONE) {
+                    return RGY_ERR_UNKNOWN;
+                }
+                copy->frame.timestamp = frame->timestamp;
+                copy->frame.duration = frame->duration;
+                queue.push_back(std::move(copy));
+                return RGY_ERR_NONE;
+            };
+            vector<FrameInfo *> outputs;
+            bool drainCpu = false, drainGpu = false;
+            for (int i = 0; sts == RGY_ERR_NONE && (i < frames || !drainCpu || !drainGpu); i++) {
+                //入力は使いまわし、タイムスタンプのみ設定する
+                //入力を使い切ったら、ptr == nullptrのフレームでdrainする
+                FrameInfo frameCpu = { 0 }, frameGpu = { 0 };
+                if (i < frames) {
+                    frameCpu = input[i % input.size()]->frame;
+                    frameGpu = inputGpu[i % inputGpu.size()]->frame;
+                    frameCpu.timestamp = frameGpu.timestamp = i * 4;
+                    frameCpu.duration = frameGpu.duration = 4;
+                    frameCpu.inputFrameId = frameGpu.inputFrameId = i;
+                }
+                if (!drainCpu) {
+                    sts = chain.filter((i < frames) ? &frameCpu : nullptr, outputs);
+                    for (size_t j = 0; sts == RGY_ERR_NONE && j < outputs.size(); j++) {
+                        sts = addOutput(outCpu, outputs[j]);
+                        framesOutCpu++;
+                    }
+                    drainCpu = i >= frames && outputs.empty();
+                }
+                if (!drainGpu && sts == RGY_ERR_NONE) {
+                    int nOutFrames = 0;
+                    FrameInfo *outInfo[16] = { 0 };
+                    sts = filterGpu->filter(&frameGpu, (FrameInfo **)&outInfo, &nOutFrames);
+                    for (int j = 0; sts == RGY_ERR_NONE && j < nOutFrames; j++) {
+                        sts = addOutput(outGpu, outInfo[j]);
+                        framesOutGpu++;
+                    }
+                    drainGpu = i >= frames && nOutFrames == 0;
+                }
+                compareFrames();
+            }
+            int statusMismatch = 0;
+            for (int i = 0; i < frames; i++) {
+                statusMismatch += (filterCpu->status(i) != filterGpu->status(i)) ? 1 : 0;
+            }
+            if (firstMismatch < 0 && framesOutCpu != framesOutGpu) {
+                firstMismatch = framesCompared;
+            }
+            const bool ok = sts == RGY_ERR_NONE && framesOutCpu > 0 && firstMismatch < 0 && statusMismatch == 0;
+            fprintf(fp, "%s,%s,%d,%d,%d,%d,%d,%d,%d,%s\n", csp.second, checkCase.name, frames, framesOutCpu, framesOutGpu,
+                firstMismatch, maxDiff[0], maxDiff[1], statusMismatch, ok ? "OK" : "NG");
+            ret |= ok ? 0 : 1;
+        }
+    }
+    return ret;
+}
+
 static inline BOOL is_latter_field(int pos_y, int tb_order) {
     return ((pos_y & 1) == tb_order);
 }
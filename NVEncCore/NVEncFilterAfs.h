@@ -30,58 +30,10 @@
 
 #include "NVEncFilter.h"
 #include "NVEncParam.h"
+#include "NVEncFilterAfsCommon.h"
 
 static const int STREAM_OPT = 1;
 
-#define AFS_SOURCE_CACHE_NUM 16
-#define AFS_SCAN_CACHE_NUM   16
-#define AFS_STRIPE_CACHE_NUM 16
-
-#define AFS_FLAG_SHIFT0      0x01
-#define AFS_FLAG_SHIFT1      0x02
-#define AFS_FLAG_SHIFT2      0x04
-#define AFS_FLAG_SHIFT3      0x08
-#define AFS_FLAG_FRAME_DROP  0x10
-#define AFS_FLAG_SMOOTHING   0x20
-#define AFS_FLAG_FORCE24     0x40
-//#define AFS_FLAG_ERROR       0x80
-#define AFS_FLAG_PROGRESSIVE 0x80
-#define AFS_FLAG_RFF         0x10
-#define AFS_MASK_SHIFT0      0xfe
-#define AFS_MASK_SHIFT1      0xfd
-#define AFS_MASK_SHIFT2      0xfb
-#define AFS_MASK_SHIFT3      0xf7
-#define AFS_MASK_FRAME_DROP  0xef
-#define AFS_MASK_SMOOTHING   0xdf
-#define AFS_MASK_FORCE24     0xbf
-#define AFS_MASK_ERROR       0x7f
-
-#define AFS_STATUS_DEFAULT   0
-
-#define AFS_SHARE_SIZE       0x0018
-#define AFS_OFFSET_SHARE_N   0x0000
-#define AFS_OFFSET_SHARE_ERR 0x0004
-#define AFS_OFFSET_FRAME_N   0x0008
-#define AFS_OFFSET_STARTFRM  0x000C
-#define AFS_OFFSET_STATUSPTR 0x0010
-
-#define ISRFF(x) (((x) & (AFS_FLAG_PROGRESSIVE | AFS_FLAG_RFF)) == (AFS_FLAG_PROGRESSIVE | AFS_FLAG_RFF))
-
-class NVEncFilterParamAfs : public NVEncFilterParam {
-public:
-    VppAfs afs;
-    rgy_rational<int> inFps;
-    rgy_rational<int> inTimebase;
-    rgy_rational<int> outTimebase;
-    tstring outFilename;
-    CUctx_flags cudaSchedule;
-
-    NVEncFilterParamAfs() : afs(), inFps(), inTimebase(), outTimebase(), outFilename(), cudaSchedule(CU_CTX_SCHED_BLOCKING_SYNC) {
-
-    };
-    virtual ~NVEncFilterParamAfs() {};
-};
-
 class afsSourceCache {
 public:
     afsSourceCache();
@@ -164,74 +116,19 @@ protected:
     AFS_STRIPE_DATA m_stripeArray[AFS_STRIPE_CACHE_NUM + 1];
 };
 
-class afsStatus {
-public:
-    afsStatus() : m_ptr(nullptr), m_buf_size(0) { };
-    ~afsStatus() { clear(); };
-
-    uint8_t& operator[](int iframe) {
-        iframe = std::max<int>(0, iframe);
-        if (iframe >= m_buf_size) {
-            const int new_bufsize = std::max(128, m_buf_size * 2);
-            m_ptr = (uint8_t *)realloc(m_ptr, new_bufsize * sizeof(uint8_t));
-            memset(m_ptr + m_buf_size, 0, (new_bufsize - m_buf_size) * sizeof(uint8_t));
-            m_buf_size = new_bufsize;
-        }
-        return m_ptr[iframe];
-    }
-    void clear() {
-        if (m_ptr) {
-            free(m_ptr);
-            m_ptr = nullptr;
-        }
-        m_buf_size = 0;
-    }
-protected:
-    uint8_t *m_ptr;
-    int m_buf_size;
-};
-
-struct afsFrameTs {
-    int64_t pos;
-    int64_t orig_pts;
-    RGY_PICSTRUCT picstruct;
-    int iframe;
-};
-
-class afsStreamStatus {
-public:
-    static const int64_t AFS_SSTS_DROP  = -1;
-    static const int64_t AFS_SSTS_ERROR = -2;
-    afsStreamStatus();
-    ~afsStreamStatus();
-
-    int open_log(const tstring& log_filename);
-    void init(uint8_t status, int drop24);
-    int set_status(int iframe, uint8_t status, int drop24, int64_t orig_pts);
-    int64_t get_duration(int64_t iframe);
-private:
-    void write_log(const afsFrameTs *const frameTs);
-
-    bool m_initialized;
-    int m_quarter_jitter;
-    int m_additional_jitter;
-    int m_phase24;
-    int m_position24;
-    int m_prev_jitter;
-    int m_prev_rff_smooth;
-    uint8_t m_prev_status;
-    int64_t m_set_frame;
-    afsFrameTs m_pos[16];
-    unique_ptr<FILE, fp_deleter> m_fpLog;
-};
-
 class NVEncFilterAfs : public NVEncFilter {
 public:
     NVEncFilterAfs();
     virtual ~NVEncFilterAfs();
     virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    //iframeの判定結果 (analyze_frameの実行後に有効)
+    uint8_t status(int iframe) {
+        return m_status[iframe];
+    }
 protected:
     virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    //1フレームを入力し、出力するフレームがあれば1フレーム出力する
+    RGY_ERR proc_frame(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum);
     virtual void close() override;
     RGY_ERR check_param(shared_ptr<NVEncFilterParamAfs> pAfsParam);
 
@@ -250,12 +147,6 @@ protected:
     cudaError_t synthesize(int iframe, CUFrameBuf *pOut, CUFrameBuf *p0, CUFrameBuf *p1, AFS_STRIPE_DATA *sip, const NVEncFilterParamAfs *pAfsPrm, cudaStream_t stream);
     cudaError_t copy_frame(CUFrameBuf *pOut, CUFrameBuf *p0, cudaStream_t stream);
 
-    int open_timecode(tstring tc_filename);
-    void write_timecode(int64_t pts, const rgy_rational<int>& timebase);
-
-    int open_log(tstring log_filename);
-    void write_log(int64_t pts, const rgy_rational<int>& timebase);
-
     unique_ptr<cudaStream_t, cudastream_deleter> m_streamAnalyze;
     unique_ptr<cudaStream_t, cudastream_deleter> m_streamCopy;
     unique_ptr<cudaEvent_t, cudaevent_deleter> m_eventSrcAdd;
@@ -270,5 +161,9 @@ protected:
     afsStatus       m_status;
     afsStreamStatus m_streamsts;
     CUMemBufPair    m_count_motion;
-    unique_ptr<FILE, fp_deleter> m_fpTimecode;
+    afsTimecode     m_timecode;
 };
+
+//CPU版とCUDA版のafsの出力をフレームごとに比較してCSVで出力する
+//判定結果、タイムスタンプ、画像 (YUV420の色差は±1まで) が一致することを確認する
+int afs_cpu_gpu_check(FILE *fp);
@@ -0,0 +1,267 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include "NVEncFilterAfsCommon.h"
+
+afsStreamStatus::afsStreamStatus() :
+    m_initialized(false),
+    m_quarter_jitter(0),
+    m_additional_jitter(0),
+    m_phase24(0),
+    m_position24(0),
+    m_prev_jitter(0),
+    m_prev_rff_smooth(0),
+    m_prev_status(0),
+    m_set_frame(-1),
+    m_pos(),
+    m_fpLog() {
+};
+
+afsStreamStatus::~afsStreamStatus() {
+    m_fpLog.reset();
+}
+
+void afsStreamStatus::init(uint8_t status, int drop24) {
+    m_prev_status = status;
+    m_prev_jitter = 0;
+    m_additional_jitter = 0;
+    m_prev_rff_smooth = 0;
+    m_phase24 = 4;
+    m_position24 = 0;
+    if (drop24 ||
+        (!(status & AFS_FLAG_SHIFT0) &&
+        (status & AFS_FLAG_SHIFT1) &&
+            (status & AFS_FLAG_SHIFT2))) {
+        m_phase24 = 0;
+    }
+    if (status & AFS_FLAG_FORCE24) {
+        m_position24++;
+    } else {
+        m_phase24 -= m_position24 + 1;
+        m_position24 = 0;
+    }
+    m_initialized = true;
+}
+
+int afsStreamStatus::open_log(const tstring& log_filename) {
+    FILE *fp = NULL;
+    if (_tfopen_s(&fp, log_filename.c_str(), _T("w"))) {
+        return 1;
+    }
+    m_fpLog = unique_ptr<FILE, fp_deleter>(fp, fp_deleter());
+    fprintf(m_fpLog.get(), " iframe,  sts,       ,        pos,   orig_pts, q_jit, prevjit, pos24, phase24, rff_smooth\n");
+    return 0;
+}
+
+void afsStreamStatus::write_log(const afsFrameTs *const frameTs) {
+    if (!m_fpLog) {
+        return;
+    }
+    fprintf(m_fpLog.get(), "%7d, 0x%2x, %s%s%s%s%s%s, %10lld, %10lld, %3d, %3d, %3d, %3d, %3d\n",
+        frameTs->iframe,
+        m_prev_status,
+        m_prev_status & AFS_FLAG_PROGRESSIVE ? "p" : "i",
+        ISRFF(m_prev_status) ? "r" : "-",
+        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT0) ? "0" : "-",
+        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT1) ? "1" : "-",
+        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT2) ? "2" : "-",
+        (((m_prev_status & AFS_FLAG_PROGRESSIVE) ? 0 : m_prev_status) & AFS_FLAG_SHIFT3) ? "3" : "-",
+        frameTs->pos, frameTs->orig_pts,
+        m_quarter_jitter, m_prev_jitter, m_position24, m_phase24, m_prev_rff_smooth);
+    return;
+}
+
+int afsStreamStatus::set_status(int iframe, uint8_t status, int drop24, int64_t orig_pts) {
+    afsFrameTs *const frameTs = &m_pos[iframe & 15];
+    frameTs->iframe = iframe;
+    frameTs->orig_pts = orig_pts;
+    if (!m_initialized) {
+        init(status, 0);
+        frameTs->pos = orig_pts;
+        m_set_frame = iframe;
+        write_log(frameTs);
+        return 0;
+    }
+    if (iframe > m_set_frame + 1) {
+        return 1;
+    }
+    m_set_frame = iframe;
+
+    int pull_drop = 0;
+    int quarter_jitter = 0;
+    int rff_smooth = 0;
+    if (status & AFS_FLAG_PROGRESSIVE) {
+        if (status & (AFS_FLAG_FORCE24 | AFS_FLAG_SMOOTHING)) {
+            if (!m_prev_rff_smooth) {
+                if (ISRFF(m_prev_status)) rff_smooth = -1;
+                else if ((m_prev_status & AFS_FLAG_PROGRESSIVE) && ISRFF(status)) rff_smooth = 1;
+            }
+            quarter_jitter = rff_smooth;
+        }
+        pull_drop = 0;
+        m_additional_jitter = 0;
+        drop24 = 0;
+    } else {
+        if (status & AFS_FLAG_SHIFT0) {
+            quarter_jitter = -2;
+        } else if (m_prev_status & AFS_FLAG_SHIFT0) {
+            quarter_jitter = (status & AFS_FLAG_SMOOTHING) ? -1 : -2;
+        } else {
+            quarter_jitter = 0;
+        }
+        quarter_jitter += ((status & AFS_FLAG_SMOOTHING) || m_additional_jitter != -1) ? m_additional_jitter : -2;
+
+        if (status & (AFS_FLAG_FORCE24 | AFS_FLAG_SMOOTHING)) {
+            if (!m_prev_rff_smooth) {
+                if (ISRFF(m_prev_status)) rff_smooth = -1;
+                else if ((m_prev_status & AFS_FLAG_PROGRESSIVE) && ISRFF(status)) rff_smooth = 1;
+            }
+        }
+        quarter_jitter += rff_smooth;
+        m_position24 += rff_smooth;
+
+        pull_drop = (status & AFS_FLAG_FRAME_DROP)
+            && !((m_prev_status|status) & AFS_FLAG_SHIFT0)
+            && (status & AFS_FLAG_SHIFT1);
+        m_additional_jitter = pull_drop ? -1 : 0;
+
+        drop24 = drop24 ||
+            (!(status & AFS_FLAG_SHIFT0) &&
+              (status & AFS_FLAG_SHIFT1) &&
+              (status & AFS_FLAG_SHIFT2));
+    }
+
+    if (drop24) m_phase24 = (m_position24 + 100) % 5;
+    drop24 = 0;
+    if (m_position24 >= m_phase24 &&
+        ((m_position24 + 100) % 5 == m_phase24 ||
+         (m_position24 +  99) % 5 == m_phase24)) {
+        m_position24 -= 5;
+        drop24 = 1;
+    }
+
+    if (status & AFS_FLAG_FORCE24) {
+        pull_drop = drop24;
+        if (status & AFS_FLAG_PROGRESSIVE) {
+            quarter_jitter += m_position24;
+        } else {
+            quarter_jitter = m_position24++;
+        }
+    } else if (!(status & AFS_FLAG_PROGRESSIVE)) {
+        m_phase24 -= m_position24 + 1;
+        m_position24 = 0;
+    }
+    int drop_thre = (status & AFS_FLAG_FRAME_DROP) ? 0 : -3;
+    if (!(status & AFS_FLAG_PROGRESSIVE) && ISRFF(m_prev_status)) {
+        //rffからの切替時はなるべくdropさせない
+        drop_thre = -3;
+    }
+    int drop = (quarter_jitter - m_prev_jitter < drop_thre);
+
+    m_quarter_jitter = quarter_jitter;
+    m_prev_rff_smooth = rff_smooth;
+    m_prev_status = status;
+
+    drop |= pull_drop;
+    if (drop) {
+        m_prev_jitter -= 4;
+        m_quarter_jitter = 0;
+        frameTs->pos = AFS_SSTS_DROP; //drop
+    } else {
+        m_prev_jitter = m_quarter_jitter;
+        frameTs->pos = frameTs->orig_pts + m_quarter_jitter;
+    }
+    write_log(frameTs);
+    return 0;
+}
+
+int64_t afsStreamStatus::get_duration(int64_t iframe) {
+    if (m_set_frame < iframe + 2) {
+        return AFS_SSTS_ERROR;
+    }
+    auto iframe_pos = m_pos[(iframe + 0) & 15].pos;
+    if (iframe_pos < 0) {
+        return AFS_SSTS_DROP;
+    }
+    auto next_pos = m_pos[(iframe + 1) & 15].pos;
+    if (next_pos < 0) {
+        //iframe + 1がdropならその先のフレームを参照
+        next_pos = m_pos[(iframe + 2) & 15].pos;
+    }
+    if (next_pos < 0) {
+        //iframe + 1がdropならその先のフレームを参照
+        next_pos = m_pos[(iframe + 3) & 15].pos;
+    }
+    return next_pos - iframe_pos;
+}
+
+int afsTimecode::open(const tstring& tc_filename) {
+    FILE *fp = NULL;
+    if (_tfopen_s(&fp, tc_filename.c_str(), _T("w"))) {
+        return 1;
+    }
+    m_fp = unique_ptr<FILE, fp_deleter>(fp, fp_deleter());
+    fprintf(m_fp.get(), "# timecode format v2\n");
+    return 0;
+}
+
+void afsTimecode::write(int64_t pts, const rgy_rational<int>& timebase) {
+    if (m_fp && pts >= 0) {
+        fprintf(m_fp.get(), "%.6lf\n", pts * timebase.qdouble() * 1000.0);
+    }
+}
+
+int afs_stripe_threshold(const AFS_SCAN_CLIP *clip, int scan_w, int scan_h, int method_switch) {
+    int total = 0;
+    if (scan_h - clip->bottom - ((scan_h - clip->top - clip->bottom) & 1) > clip->top && scan_w - clip->right > clip->left)
+        total = (scan_h - clip->bottom - ((scan_h - clip->top - clip->bottom) & 1) - clip->top) * (scan_w - clip->right - clip->left);
+    return (total * method_switch) >> 12;
+}
+
+uint8_t afs_frame_status(int iframe, const FrameInfo& frameinfo, const VppAfs *afs, const int reverse[4], const int assume_shift[4], const int result_stat[4]) {
+    static const uint8_t AFS_FLAG_SHIFT[4] = { AFS_FLAG_SHIFT0, AFS_FLAG_SHIFT1, AFS_FLAG_SHIFT2, AFS_FLAG_SHIFT3 };
+    uint8_t status = AFS_STATUS_DEFAULT;
+    for (int i = 0; i < 4; i++) {
+        if (result_stat[i] & 2)
+            status |= assume_shift[i] ? AFS_FLAG_SHIFT[i] : 0;
+        else
+            status |= (result_stat[i] & 1) ? AFS_FLAG_SHIFT[i] : 0;
+        if (reverse[i]) status ^= AFS_FLAG_SHIFT[i];
+    }
+
+    if (!interlaced(frameinfo)) {
+        status |= AFS_FLAG_PROGRESSIVE;
+        if (frameinfo.flags & RGY_FRAME_FLAG_RFF) status |= AFS_FLAG_RFF;
+    }
+    if (afs->drop) {
+        if (interlaced(frameinfo)) status |= AFS_FLAG_FRAME_DROP;
+        if (afs->smooth) status |= AFS_FLAG_SMOOTHING;
+    }
+    if (afs->force24) status |= AFS_FLAG_FORCE24;
+    if (iframe < 1) status &= AFS_MASK_SHIFT0;
+    return status;
+}
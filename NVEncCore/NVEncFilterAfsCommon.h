@@ -0,0 +1,205 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_FILTER_AFS_COMMON_H__
+#define __NVENC_FILTER_AFS_COMMON_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "rgy_util.h"
+#include "convert_csp.h"
+#include "NVEncVppParam.h"
+
+//afsのCUDA版(NVEncFilterAfs)とCPU版(NVEncFilterCpuAfs)で共通の部分
+//フレームの判定(ステータスの決定)とタイムスタンプの計算、timecode/logの出力はここで行い、
+//両者で同じ結果となるようにする (CUDAのヘッダに依存しないこと)
+
+#define AFS_SOURCE_CACHE_NUM 16
+#define AFS_SCAN_CACHE_NUM   16
+#define AFS_STRIPE_CACHE_NUM 16
+
+#define AFS_FLAG_SHIFT0      0x01
+#define AFS_FLAG_SHIFT1      0x02
+#define AFS_FLAG_SHIFT2      0x04
+#define AFS_FLAG_SHIFT3      0x08
+#define AFS_FLAG_FRAME_DROP  0x10
+#define AFS_FLAG_SMOOTHING   0x20
+#define AFS_FLAG_FORCE24     0x40
+//#define AFS_FLAG_ERROR       0x80
+#define AFS_FLAG_PROGRESSIVE 0x80
+#define AFS_FLAG_RFF         0x10
+#define AFS_MASK_SHIFT0      0xfe
+#define AFS_MASK_SHIFT1      0xfd
+#define AFS_MASK_SHIFT2      0xfb
+#define AFS_MASK_SHIFT3      0xf7
+#define AFS_MASK_FRAME_DROP  0xef
+#define AFS_MASK_SMOOTHING   0xdf
+#define AFS_MASK_FORCE24     0xbf
+#define AFS_MASK_ERROR       0x7f
+
+#define AFS_STATUS_DEFAULT   0
+
+#define AFS_SHARE_SIZE       0x0018
+#define AFS_OFFSET_SHARE_N   0x0000
+#define AFS_OFFSET_SHARE_ERR 0x0004
+#define AFS_OFFSET_FRAME_N   0x0008
+#define AFS_OFFSET_STARTFRM  0x000C
+#define AFS_OFFSET_STATUSPTR 0x0010
+
+#define ISRFF(x) (((x) & (AFS_FLAG_PROGRESSIVE | AFS_FLAG_RFF)) == (AFS_FLAG_PROGRESSIVE | AFS_FLAG_RFF))
+
+template<typename T>
+T max3(T a, T b, T c) {
+    return std::max(std::max(a, b), c);
+}
+template<typename T>
+T absdiff(T a, T b) {
+    T a_b = a - b;
+    T b_a = b - a;
+    return (a >= b) ? a_b : b_a;
+}
+
+class afsStatus {
+public:
+    afsStatus() : m_ptr(nullptr), m_buf_size(0) { };
+    ~afsStatus() { clear(); };
+
+    uint8_t& operator[](int iframe) {
+        iframe = std::max<int>(0, iframe);
+        if (iframe >= m_buf_size) {
+            const int new_bufsize = std::max(128, m_buf_size * 2);
+            m_ptr = (uint8_t *)realloc(m_ptr, new_bufsize * sizeof(uint8_t));
+            memset(m_ptr + m_buf_size, 0, (new_bufsize - m_buf_size) * sizeof(uint8_t));
+            m_buf_size = new_bufsize;
+        }
+        return m_ptr[iframe];
+    }
+    void clear() {
+        if (m_ptr) {
+            free(m_ptr);
+            m_ptr = nullptr;
+        }
+        m_buf_size = 0;
+    }
+protected:
+    uint8_t *m_ptr;
+    int m_buf_size;
+};
+
+struct afsFrameTs {
+    int64_t pos;
+    int64_t orig_pts;
+    RGY_PICSTRUCT picstruct;
+    int iframe;
+};
+
+class afsStreamStatus {
+public:
+    static const int64_t AFS_SSTS_DROP  = -1;
+    static const int64_t AFS_SSTS_ERROR = -2;
+    afsStreamStatus();
+    ~afsStreamStatus();
+
+    int open_log(const tstring& log_filename);
+    void init(uint8_t status, int drop24);
+    int set_status(int iframe, uint8_t status, int drop24, int64_t orig_pts);
+    int64_t get_duration(int64_t iframe);
+private:
+    void write_log(const afsFrameTs *const frameTs);
+
+    bool m_initialized;
+    int m_quarter_jitter;
+    int m_additional_jitter;
+    int m_phase24;
+    int m_position24;
+    int m_prev_jitter;
+    int m_prev_rff_smooth;
+    uint8_t m_prev_status;
+    int64_t m_set_frame;
+    afsFrameTs m_pos[16];
+    unique_ptr<FILE, fp_deleter> m_fpLog;
+};
+
+//timecode(v2)の出力
+class afsTimecode {
+public:
+    afsTimecode() : m_fp() {};
+    ~afsTimecode() { close(); };
+
+    int open(const tstring& tc_filename);
+    void write(int64_t pts, const rgy_rational<int>& timebase);
+    void close() { m_fp.reset(); };
+protected:
+    unique_ptr<FILE, fp_deleter> m_fp;
+};
+
+//iframeのフィールドシフトの有無を前後のフレームの動きの量から推定する
+//sp1 ～ sp4はiframe-1 ～ iframe+2の解析結果 (ff_motion/lf_motionを持つ構造体)
+template<typename ScanData>
+int afs_detect_telecine_cross(const ScanData *sp1, const ScanData *sp2, const ScanData *sp3, const ScanData *sp4, int coeff_shift) {
+    using std::max;
+    int shift = 0;
+
+    if (max(absdiff(sp1->lf_motion + sp2->lf_motion, sp2->ff_motion),
+        absdiff(sp3->ff_motion + sp4->ff_motion, sp3->lf_motion)) * coeff_shift >
+        max3(absdiff(sp1->ff_motion + sp2->ff_motion, sp1->lf_motion),
+            absdiff(sp2->ff_motion + sp3->ff_motion, sp2->lf_motion),
+            absdiff(sp3->lf_motion + sp4->lf_motion, sp4->ff_motion)) * 256)
+        if (max(sp2->lf_motion, sp3->ff_motion) * coeff_shift > sp2->ff_motion * 256)
+            shift = 1;
+
+    if (max(absdiff(sp1->lf_motion + sp2->lf_motion, sp2->ff_motion),
+        absdiff(sp3->ff_motion + sp4->ff_motion, sp3->lf_motion)) * coeff_shift >
+        max3(absdiff(sp1->ff_motion + sp2->ff_motion, sp1->lf_motion),
+            absdiff(sp2->lf_motion + sp3->lf_motion, sp3->ff_motion),
+            absdiff(sp3->lf_motion + sp4->lf_motion, sp4->ff_motion)) * 256)
+        if (max(sp2->lf_motion, sp3->ff_motion) * coeff_shift > sp3->lf_motion * 256)
+            shift = 1;
+
+    return shift;
+}
+
+//縞の量の判定に使用する閾値 (解析範囲の画素数 * method_switch / 4096)
+int afs_stripe_threshold(const AFS_SCAN_CLIP *clip, int scan_w, int scan_h, int method_switch);
+
+//縞の量(count0: シフトなし、count1: シフトあり)の判定結果
+//  bit0: シフトありと判定、bit1: 縞が閾値未満で判定不能 (推定結果を使用する)
+static inline int afs_result_stat(int count0, int count1, int threshold, int coeff_shift) {
+    int result_stat = (count0 * coeff_shift > count1 * 256) ? 1 : 0;
+    if (threshold > count1 && threshold > count0)
+        result_stat += 2;
+    return result_stat;
+}
+
+//iframe ～ iframe+3の判定結果から、iframeのステータスを決定する
+uint8_t afs_frame_status(int iframe, const FrameInfo& frameinfo, const VppAfs *afs, const int reverse[4], const int assume_shift[4], const int result_stat[4]);
+
+#endif //__NVENC_FILTER_AFS_COMMON_H__
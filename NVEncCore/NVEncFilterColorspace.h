@@ -97,12 +97,8 @@ private:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_log->write_va(log_level, _T("ColorspaceOpCtrl: "), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
     void AddMessage(int log_level, const tstring &str) {
         if (m_log == nullptr || log_level < m_log->getLogLevel()) {
@@ -0,0 +1,1239 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "rgy_simd.h"
+#include "rgy_thread_pool.h"
+#include "rgy_perf_trace.h"
+#include "NVEncFilterCpu.h"
+
+static const int CPU_FILTER_ROW_TILE_MIN = 16; //1タスクあたりの最小の行数
+static const int CPU_FILTER_TASK_PER_THREAD = 4; //スレッドあたりのタスク数 (負荷の偏りを均すため)
+static const int CPU_FILTER_PITCH_ALIGN = 64;
+
+//CPU版のフレームは、CUDA版と同様に各プレーンのpitchを共通とする配置(getPlaneの配置)とするので、
+//YV12などではホストメモリ用の大きさではなく、デバイスメモリ用の大きさを使用する
+static FrameInfoExtra getFrameInfoExtraCpu(const FrameInfo *frame) {
+    FrameInfo frameDev = *frame;
+    frameDev.deivce_mem = true;
+    return getFrameInfoExtra(&frameDev);
+}
+
+NVEncCpuStream::NVEncCpuStream() :
+    m_thread(), m_mtx(), m_cvQueue(), m_cvDone(), m_queue(),
+    m_queued(0), m_completed(0), m_err(RGY_ERR_NONE), m_abort(false) {
+    m_thread = std::thread(&NVEncCpuStream::workerFunc, this);
+}
+
+NVEncCpuStream::~NVEncCpuStream() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_abort = true;
+    }
+    m_cvQueue.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void NVEncCpuStream::workerFunc() {
+    RGY_PERF_TRACE_THREAD_NAME("vpp-cpu-stream");
+    for (;;) {
+        std::function<RGY_ERR()> func;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvQueue.wait(lock, [this]() { return m_abort || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                break; //m_abortかつ、残りの処理がない
+            }
+            func = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        const auto err = func();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (err != RGY_ERR_NONE && m_err == RGY_ERR_NONE) {
+                m_err = err; //最初のエラーを保持する
+            }
+            m_completed++;
+        }
+        m_cvDone.notify_all();
+    }
+}
+
+uint64_t NVEncCpuStream::enqueue(std::function<RGY_ERR()> func) {
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_queue.push_back(std::move(func));
+        id = ++m_queued;
+    }
+    m_cvQueue.notify_one();
+    return id;
+}
+
+RGY_ERR NVEncCpuStream::wait(uint64_t id) {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cvDone.wait(lock, [this, id]() { return m_completed >= id; });
+    return m_err;
+}
+
+RGY_ERR NVEncCpuStream::synchronize() {
+    return wait(queued());
+}
+
+uint64_t NVEncCpuStream::queued() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_queued;
+}
+
+uint64_t NVEncCpuStream::completed() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_completed;
+}
+
+void NVEncCpuEvent::record(NVEncCpuStream *stream) {
+    m_stream = stream;
+    m_id = (stream) ? stream->queued() : 0;
+}
+
+bool NVEncCpuEvent::query() const {
+    return m_stream == nullptr || m_stream->completed() >= m_id;
+}
+
+RGY_ERR NVEncCpuEvent::synchronize() const {
+    return (m_stream) ? m_stream->wait(m_id) : RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncCpuFrameBuf::alloc() {
+    clear();
+    frame.deivce_mem = false;
+    const auto infoEx = getFrameInfoExtraCpu(&frame);
+    if (!infoEx.width_byte) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    frame.pitch = ALIGN(infoEx.width_byte, CPU_FILTER_PITCH_ALIGN);
+    const auto infoExAligned = getFrameInfoExtraCpu(&frame);
+    frame.ptr = (uint8_t *)_aligned_malloc(infoExAligned.frame_size, CPU_FILTER_PITCH_ALIGN);
+    if (frame.ptr == nullptr) {
+        frame.pitch = 0;
+        return RGY_ERR_NULL_PTR;
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncCpuFrameBuf::copyFrame(const FrameInfo *src) {
+    return copyFrameDataCpu(&frame, src);
+}
+
+void NVEncCpuFrameBuf::clear() {
+    if (frame.ptr) {
+        _aligned_free(frame.ptr);
+        frame.ptr = nullptr;
+    }
+}
+
+RGY_ERR copyFrameDataCpu(FrameInfo *dst, const FrameInfo *src) {
+    if (src->deivce_mem || dst->deivce_mem) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    auto dstInfoEx = getFrameInfoExtraCpu(dst);
+    const auto srcInfoEx = getFrameInfoExtraCpu(src);
+    if (dst->pitch == 0
+        || srcInfoEx.width_byte > dst->pitch
+        || srcInfoEx.height_total > dstInfoEx.height_total) {
+        if (dst->ptr) {
+            _aligned_free(dst->ptr);
+            dst->ptr = nullptr;
+        }
+        dst->pitch = 0;
+    }
+    dst->width = src->width;
+    dst->height = src->height;
+    dst->csp = src->csp;
+    dst->picstruct = src->picstruct;
+    dst->timestamp = src->timestamp;
+    dst->duration = src->duration;
+    dst->flags = src->flags;
+    dst->inputFrameId = src->inputFrameId;
+    if (dst->ptr == nullptr) {
+        dstInfoEx = getFrameInfoExtraCpu(dst);
+        if (!dstInfoEx.width_byte) {
+            return RGY_ERR_UNSUPPORTED;
+        }
+        dst->pitch = ALIGN(dstInfoEx.width_byte, CPU_FILTER_PITCH_ALIGN);
+        dstInfoEx = getFrameInfoExtraCpu(dst);
+        dst->ptr = (uint8_t *)_aligned_malloc(dstInfoEx.frame_size, CPU_FILTER_PITCH_ALIGN);
+        if (dst->ptr == nullptr) {
+            dst->pitch = 0;
+            return RGY_ERR_NULL_PTR;
+        }
+    }
+    //更新
+    dstInfoEx = getFrameInfoExtraCpu(dst);
+    for (int y = 0; y < dstInfoEx.height_total; y++) {
+        memcpy(dst->ptr + y * dst->pitch, src->ptr + y * src->pitch, dstInfoEx.width_byte);
+    }
+    return RGY_ERR_NONE;
+}
+
+NVEncFilterCpu::NVEncFilterCpu() :
+    m_sFilterName(), m_sFilterInfo(), m_pPrintMes(), m_pFrameBuf(), m_nFrameIdx(0),
+    m_pParam(),
+    m_nPathThrough(FILTER_PATHTHROUGH_ALL), m_pKernel(get_cpu_filter_kernel(get_availableSIMD())),
+    m_nTraceNameId(RGY_TRACE_FILTER), m_bCheckPerformance(false),
+    m_dFilterTimeMs(0.0), m_nFilterRunCount(0) {
+
+}
+
+NVEncFilterCpu::~NVEncFilterCpu() {
+    m_pFrameBuf.clear();
+    m_pParam.reset();
+}
+
+void NVEncFilterCpu::setSimd(uint32_t simd) {
+    m_pKernel = get_cpu_filter_kernel(simd & get_availableSIMD());
+}
+
+RGY_ERR NVEncFilterCpu::AllocFrameBuf(const FrameInfo& frame, int frames) {
+    if (m_pFrameBuf.size() == frames
+        && !cmpFrameInfoCspResolution(&m_pFrameBuf[0]->frame, &frame)) {
+        //すべて確保されているか確認
+        bool allocated = true;
+        for (int i = 0; i < m_pFrameBuf.size(); i++) {
+            if (m_pFrameBuf[i]->frame.ptr == nullptr) {
+                allocated = false;
+                break;
+            }
+        }
+        if (allocated) {
+            return RGY_ERR_NONE;
+        }
+    }
+    m_pFrameBuf.clear();
+
+    for (int i = 0; i < frames; i++) {
+        unique_ptr<NVEncCpuFrameBuf> uptr(new NVEncCpuFrameBuf(frame));
+        uptr->frame.ptr = nullptr;
+        auto ret = uptr->alloc();
+        if (ret != RGY_ERR_NONE) {
+            m_pFrameBuf.clear();
+            return ret;
+        }
+        m_pFrameBuf.push_back(std::move(uptr));
+    }
+    m_nFrameIdx = 0;
+    return RGY_ERR_NONE;
+}
+
+int NVEncFilterCpu::rowTaskCount(int height) const {
+    return rowTaskCount(height, CPU_FILTER_ROW_TILE_MIN);
+}
+
+int NVEncFilterCpu::rowTaskCount(int height, int rowTileMin) const {
+    const int threads = RGYThreadPool::get()->threadCount() + 1; //呼び出し元のスレッドも処理に参加する
+    return clamp((height + rowTileMin - 1) / rowTileMin, 1, threads * CPU_FILTER_TASK_PER_THREAD);
+}
+
+void NVEncFilterCpu::run_rows(int height, const std::function<void(int y_start, int y_end, int task_id)>& func) {
+    run_rows(height, CPU_FILTER_ROW_TILE_MIN, func);
+}
+
+void NVEncFilterCpu::run_rows(int height, int rowTileMin, const std::function<void(int y_start, int y_end, int task_id)>& func) {
+    const int tasks = rowTaskCount(height, rowTileMin);
+    if (tasks <= 1) {
+        func(0, height, 0);
+        return;
+    }
+    RGYThreadPool::get()->run(tasks, [&](int task_id) {
+        const int y_start = (int)((int64_t)height * task_id / tasks);
+        const int y_end   = (int)((int64_t)height * (task_id + 1) / tasks);
+        func(y_start, y_end, task_id);
+    });
+}
+
+RGY_ERR NVEncFilterCpu::filter(FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+#if ENABLE_PERF_TRACE
+    if (m_nTraceNameId == RGY_TRACE_FILTER && RGYPerfTrace::get()) {
+        m_nTraceNameId = RGYPerfTrace::registerName(m_sFilterName + _T("(cpu)"));
+    }
+#endif //#if ENABLE_PERF_TRACE
+    //CUDA版と異なり、処理はこの関数内で完了する
+    RGY_PERF_TRACE_SCOPE(traceFilter, m_nTraceNameId,
+        (pInputFrame) ? pInputFrame->inputFrameId : -1,
+        (pInputFrame) ? pInputFrame->timestamp : RGY_PERF_TRACE_NO_PTS);
+    const auto timeStart = std::chrono::high_resolution_clock::now();
+
+    if (pInputFrame == nullptr) {
+        *pOutputFrameNum = 0;
+        ppOutputFrames[0] = nullptr;
+    }
+    if (m_pParam
+        && m_pParam->bOutOverwrite //上書きか?
+        && pInputFrame != nullptr && pInputFrame->ptr != nullptr //入力が存在するか?
+        && ppOutputFrames != nullptr && ppOutputFrames[0] == nullptr) { //出力先がセット可能か?
+        ppOutputFrames[0] = pInputFrame;
+        *pOutputFrameNum = 1;
+    }
+    if (pInputFrame != nullptr && pInputFrame->deivce_mem) {
+        AddMessage(RGY_LOG_ERROR, _T("only supported on host memory.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    const auto ret = run_filter(pInputFrame, ppOutputFrames, pOutputFrameNum);
+    const int nOutFrame = *pOutputFrameNum;
+    if (!m_pParam->bOutOverwrite && nOutFrame > 0) {
+        if (m_nPathThrough & FILTER_PATHTHROUGH_TIMESTAMP) {
+            if (nOutFrame != 1) {
+                AddMessage(RGY_LOG_ERROR, _T("timestamp path through can only be applied to 1-in/1-out filter.\n"));
+                return RGY_ERR_INVALID_CALL;
+            } else {
+                ppOutputFrames[0]->timestamp = pInputFrame->timestamp;
+                ppOutputFrames[0]->duration  = pInputFrame->duration;
+                ppOutputFrames[0]->inputFrameId = pInputFrame->inputFrameId;
+            }
+        }
+        for (int i = 0; i < nOutFrame; i++) {
+            if (m_nPathThrough & FILTER_PATHTHROUGH_FLAGS)     ppOutputFrames[i]->flags     = pInputFrame->flags;
+            if (m_nPathThrough & FILTER_PATHTHROUGH_PICSTRUCT) ppOutputFrames[i]->picstruct = pInputFrame->picstruct;
+        }
+    }
+    if (m_bCheckPerformance) {
+        const auto timeFin = std::chrono::high_resolution_clock::now();
+        m_dFilterTimeMs += std::chrono::duration_cast<std::chrono::microseconds>(timeFin - timeStart).count() * 0.001;
+        m_nFilterRunCount++;
+    }
+    return ret;
+}
+
+RGY_ERR NVEncFilterCpu::filter_as_interlaced_pair(const FrameInfo *pInputFrame, FrameInfo *pOutputFrame) {
+    //各プレーンは同じpitchで連続して配置されているので、pitchを2倍、高さを1/2にすれば
+    //コピーせずにフィールドとして扱うことができる
+    for (int i = 0; i < 2; i++) {
+        FrameInfo fieldIn = *pInputFrame;
+        fieldIn.ptr += pInputFrame->pitch * i;
+        fieldIn.pitch *= 2;
+        fieldIn.height >>= 1;
+        fieldIn.picstruct = RGY_PICSTRUCT_FRAME;
+        fieldIn.flags &= ~(RGY_FRAME_FLAG_RFF | RGY_FRAME_FLAG_RFF_COPY | RGY_FRAME_FLAG_RFF_TFF | RGY_FRAME_FLAG_RFF_BFF);
+        FrameInfo fieldOut = *pOutputFrame;
+        fieldOut.ptr += pOutputFrame->pitch * i;
+        fieldOut.pitch *= 2;
+        fieldOut.height >>= 1;
+        fieldOut.picstruct = RGY_PICSTRUCT_FRAME;
+        fieldOut.flags = fieldIn.flags;
+
+        int nFieldOut = 0;
+        auto pFieldOut = &fieldOut;
+        auto err = run_filter(&fieldIn, &pFieldOut, &nFieldOut);
+        if (err != RGY_ERR_NONE) {
+            return err;
+        }
+    }
+    return RGY_ERR_NONE;
+}
+
+void NVEncFilterCpu::CheckPerformance(bool flag) {
+    m_bCheckPerformance = flag;
+    m_dFilterTimeMs = 0.0;
+    m_nFilterRunCount = 0;
+}
+
+double NVEncFilterCpu::GetAvgTimeElapsed() {
+    if (!m_bCheckPerformance) {
+        return 0.0;
+    }
+    return m_dFilterTimeMs / (double)m_nFilterRunCount;
+}
+
+NVEncFilterCpuCspCrop::NVEncFilterCpuCspCrop() {
+    m_sFilterName = _T("copy/cspconv/crop");
+}
+
+NVEncFilterCpuCspCrop::~NVEncFilterCpuCspCrop() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuCspCrop::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pCropParam = std::dynamic_pointer_cast<NVEncFilterParamCrop>(pParam);
+    if (!pCropParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //フィルタ名の調整
+    m_sFilterName = _T("");
+    if (cropEnabled(pCropParam->crop)) {
+        m_sFilterName += _T("crop");
+    }
+    if (pCropParam->frameOut.csp != pCropParam->frameIn.csp) {
+        m_sFilterName += (m_sFilterName.length()) ? _T("/cspconv") : _T("cspconv");
+    }
+    if (m_sFilterName.length() == 0) {
+        m_sFilterName += _T("copyHtoH");
+    }
+    //パラメータチェック
+    for (int i = 0; i < _countof(pCropParam->crop.c); i++) {
+        if ((pCropParam->crop.c[i] & 1) != 0) {
+            AddMessage(RGY_LOG_ERROR, _T("crop should be divided by 2.\n"));
+            return RGY_ERR_INVALID_PARAM;
+        }
+    }
+    pCropParam->frameOut.height = pCropParam->frameIn.height - pCropParam->crop.e.bottom - pCropParam->crop.e.up;
+    pCropParam->frameOut.width = pCropParam->frameIn.width - pCropParam->crop.e.left - pCropParam->crop.e.right;
+    if (pCropParam->frameOut.height <= 0 || pCropParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("crop size is too big.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto fmtIn  = RGY_CSP_CHROMA_FORMAT[pCropParam->frameIn.csp];
+    const auto fmtOut = RGY_CSP_CHROMA_FORMAT[pCropParam->frameOut.csp];
+    if (!((fmtIn == RGY_CHROMAFMT_YUV420 && fmtOut == RGY_CHROMAFMT_YUV420)
+        || (fmtIn == RGY_CHROMAFMT_YUV444 && fmtOut == RGY_CHROMAFMT_YUV444))) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp conversion: %s -> %s.\n"),
+            RGY_CSP_NAMES[pCropParam->frameIn.csp], RGY_CSP_NAMES[pCropParam->frameOut.csp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    sts = AllocFrameBuf(pCropParam->frameOut, 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pCropParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    //フィルタ情報の調整
+    m_sFilterInfo = _T("");
+    if (cropEnabled(pCropParam->crop)) {
+        m_sFilterInfo += strsprintf(_T("crop: %d,%d,%d,%d"), pCropParam->crop.e.left, pCropParam->crop.e.up, pCropParam->crop.e.right, pCropParam->crop.e.bottom);
+    }
+    if (pCropParam->frameOut.csp != pCropParam->frameIn.csp) {
+        m_sFilterInfo += (m_sFilterInfo.length()) ? _T("/cspconv") : _T("cspconv");
+        m_sFilterInfo += strsprintf(_T("(%s -> %s)"), RGY_CSP_NAMES[pCropParam->frameIn.csp], RGY_CSP_NAMES[pCropParam->frameOut.csp]);
+    }
+    if (m_sFilterInfo.length() == 0) {
+        m_sFilterInfo += _T("copyHtoH");
+    }
+    m_sFilterInfo += strsprintf(_T(" [cpu %s]"), m_pKernel->name);
+
+    m_pParam = pCropParam;
+    return sts;
+}
+
+RGY_ERR NVEncFilterCpuCspCrop::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+
+    *pOutputFrameNum = 1;
+    if (ppOutputFrames[0] == nullptr) {
+        auto pOutFrame = m_pFrameBuf[m_nFrameIdx].get();
+        ppOutputFrames[0] = &pOutFrame->frame;
+        m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+    }
+    auto pCropParam = std::dynamic_pointer_cast<NVEncFilterParamCrop>(m_pParam);
+    if (!pCropParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    FrameInfo *pOutputFrame = ppOutputFrames[0];
+    const auto& crop = pCropParam->crop;
+    const RGY_CSP cspIn = pInputFrame->csp;
+    const RGY_CSP cspOut = pOutputFrame->csp;
+    const int in16  = (RGY_CSP_BIT_DEPTH[cspIn]  > 8) ? 1 : 0;
+    const int out16 = (RGY_CSP_BIT_DEPTH[cspOut] > 8) ? 1 : 0;
+    const int shift = RGY_CSP_BIT_DEPTH[cspOut] - RGY_CSP_BIT_DEPTH[cspIn];
+    const bool nv12In  = cspIn  == RGY_CSP_NV12 || cspIn  == RGY_CSP_P010;
+    const bool nv12Out = cspOut == RGY_CSP_NV12 || cspOut == RGY_CSP_P010;
+    const auto fmtIn  = RGY_CSP_CHROMA_FORMAT[cspIn];
+    const auto fmtOut = RGY_CSP_CHROMA_FORMAT[cspOut];
+
+    //cropの開始位置(offsetX/offsetYは画素単位)に合わせたポインタ
+    auto cropPtr = [in16](const FrameInfo& plane, int offsetX, int offsetY) {
+        return (const uint8_t *)plane.ptr + offsetY * plane.pitch + offsetX * (in16 ? 2 : 1);
+    };
+    auto copyPlane = [&](RGY_PLANE plane, int offsetX, int offsetY, int widthMul) {
+        const auto planeIn = getPlane(pInputFrame, plane);
+        const auto planeOut = getPlane(pOutputFrame, plane);
+        const auto src = cropPtr(planeIn, offsetX, offsetY);
+        const auto func = m_pKernel->plane_copy[in16][out16];
+        run_rows(planeOut.height, [&](int y_start, int y_end, int task_id) {
+            func(planeOut.ptr, planeOut.pitch, src, planeIn.pitch, planeOut.width * widthMul, y_start, y_end, shift);
+        });
+    };
+
+    copyPlane(RGY_PLANE_Y, crop.e.left, crop.e.up, 1);
+    if (fmtIn == RGY_CHROMAFMT_YUV420 && fmtOut == RGY_CHROMAFMT_YUV420) {
+        if (nv12In && nv12Out) {
+            //UVが交互に並んでいるので、横方向はYと同じ
+            const auto planeIn = getPlane(pInputFrame, RGY_PLANE_C);
+            auto planeOut = getPlane(pOutputFrame, RGY_PLANE_C);
+            const auto src = cropPtr(planeIn, crop.e.left, crop.e.up >> 1);
+            const auto func = m_pKernel->plane_copy[in16][out16];
+            run_rows(planeOut.height, [&](int y_start, int y_end, int task_id) {
+                func(planeOut.ptr, planeOut.pitch, src, planeIn.pitch, planeOut.width, y_start, y_end, shift);
+            });
+        } else if (nv12In) {
+            const auto planeIn = getPlane(pInputFrame, RGY_PLANE_C);
+            const auto planeOutU = getPlane(pOutputFrame, RGY_PLANE_U);
+            const auto planeOutV = getPlane(pOutputFrame, RGY_PLANE_V);
+            const auto src = cropPtr(planeIn, crop.e.left, crop.e.up >> 1);
+            const auto func = m_pKernel->split_uv[in16][out16];
+            run_rows(planeOutU.height, [&](int y_start, int y_end, int task_id) {
+                func(planeOutU.ptr, planeOutV.ptr, planeOutU.pitch, src, planeIn.pitch, planeOutU.width, y_start, y_end, shift);
+            });
+        } else if (nv12Out) {
+            const auto planeInU = getPlane(pInputFrame, RGY_PLANE_U);
+            const auto planeInV = getPlane(pInputFrame, RGY_PLANE_V);
+            const auto planeOut = getPlane(pOutputFrame, RGY_PLANE_C);
+            const auto srcU = cropPtr(planeInU, crop.e.left >> 1, crop.e.up >> 1);
+            const auto srcV = cropPtr(planeInV, crop.e.left >> 1, crop.e.up >> 1);
+            const auto func = m_pKernel->merge_uv[in16][out16];
+            run_rows(planeOut.height, [&](int y_start, int y_end, int task_id) {
+                func(planeOut.ptr, planeOut.pitch, srcU, srcV, planeInU.pitch, planeOut.width >> 1, y_start, y_end, shift);
+            });
+        } else {
+            copyPlane(RGY_PLANE_U, crop.e.left >> 1, crop.e.up >> 1, 1);
+            copyPlane(RGY_PLANE_V, crop.e.left >> 1, crop.e.up >> 1, 1);
+        }
+    } else if (fmtIn == RGY_CHROMAFMT_YUV444 && fmtOut == RGY_CHROMAFMT_YUV444) {
+        copyPlane(RGY_PLANE_U, crop.e.left, crop.e.up, 1);
+        copyPlane(RGY_PLANE_V, crop.e.left, crop.e.up, 1);
+    } else {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp conversion: %s -> %s.\n"), RGY_CSP_NAMES[cspIn], RGY_CSP_NAMES[cspOut]);
+        sts = RGY_ERR_UNSUPPORTED;
+    }
+    return sts;
+}
+
+void NVEncFilterCpuCspCrop::close() {
+    m_pFrameBuf.clear();
+}
+
+NVEncFilterCpuPad::NVEncFilterCpuPad() {
+    m_sFilterName = _T("pad");
+}
+
+NVEncFilterCpuPad::~NVEncFilterCpuPad() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuPad::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pPadParam = std::dynamic_pointer_cast<NVEncFilterParamPad>(pParam);
+    if (!pPadParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //パラメータチェック
+    if (pPadParam->frameOut.height <= 0 || pPadParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (   pPadParam->pad.left   % 2 != 0
+        || pPadParam->pad.top    % 2 != 0
+        || pPadParam->pad.right  % 2 != 0
+        || pPadParam->pad.bottom % 2 != 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter, --vpp-pad only supports values which is multiple of 2.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pParam->frameOut.width != pParam->frameIn.width + pPadParam->pad.right + pPadParam->pad.left
+        || pParam->frameOut.height != pParam->frameIn.height + pPadParam->pad.top + pPadParam->pad.bottom) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter, input/output resolution does not match pad settings.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+
+    sts = AllocFrameBuf(pPadParam->frameOut, 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pPadParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    m_sFilterInfo = strsprintf(_T("pad: [%dx%d]->[%dx%d] (right=%d, left=%d, top=%d, bottom=%d) [cpu]"),
+        pPadParam->frameIn.width, pPadParam->frameIn.height,
+        pPadParam->frameOut.width, pPadParam->frameOut.height,
+        pPadParam->pad.right, pPadParam->pad.left,
+        pPadParam->pad.top, pPadParam->pad.bottom);
+
+    //コピーを保存
+    m_pParam = pPadParam;
+    return sts;
+}
+
+template<typename Type>
+static void pad_fill(uint8_t *ptr, int count, int pad_color) {
+    if (sizeof(Type) == 1) {
+        memset(ptr, pad_color, count);
+    } else {
+        std::fill_n((Type *)ptr, count, (Type)pad_color);
+    }
+}
+
+RGY_ERR NVEncFilterCpuPad::padPlane(FrameInfo *pOutputFrame, const FrameInfo *pInputFrame, int pad_color, const VppPad *pad) {
+    const bool high = RGY_CSP_BIT_DEPTH[pOutputFrame->csp] > 8;
+    const int pixel_byte = high ? 2 : 1;
+    const auto fill = high ? pad_fill<uint16_t> : pad_fill<uint8_t>;
+    run_rows(pOutputFrame->height, [&](int y_start, int y_end, int task_id) {
+        for (int y = y_start; y < y_end; y++) {
+            uint8_t *ptrDst = pOutputFrame->ptr + y * pOutputFrame->pitch;
+            const int y_in = y - pad->top;
+            if (y_in < 0 || pInputFrame->height <= y_in) {
+                fill(ptrDst, pOutputFrame->width, pad_color);
+                continue;
+            }
+            fill(ptrDst, pad->left, pad_color);
+            memcpy(ptrDst + pad->left * pixel_byte, pInputFrame->ptr + y_in * pInputFrame->pitch, pInputFrame->width * pixel_byte);
+            fill(ptrDst + (pad->left + pInputFrame->width) * pixel_byte, pad->right, pad_color);
+        }
+    });
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuPad::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+
+    *pOutputFrameNum = 1;
+    if (ppOutputFrames[0] == nullptr) {
+        auto pOutFrame = m_pFrameBuf[m_nFrameIdx].get();
+        ppOutputFrames[0] = &pOutFrame->frame;
+        m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+    }
+    ppOutputFrames[0]->picstruct = pInputFrame->picstruct;
+    if (m_pParam->frameOut.csp != m_pParam->frameIn.csp) {
+        AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    auto pPadParam = std::dynamic_pointer_cast<NVEncFilterParamPad>(m_pParam);
+    if (!pPadParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+
+    const int bit_depth = RGY_CSP_BIT_DEPTH[m_pParam->frameIn.csp];
+    const auto chromaFmt = RGY_CSP_CHROMA_FORMAT[m_pParam->frameIn.csp];
+    if ((chromaFmt != RGY_CHROMAFMT_YUV420 && chromaFmt != RGY_CHROMAFMT_YUV444)
+        || m_pParam->frameIn.csp == RGY_CSP_NV12 || m_pParam->frameIn.csp == RGY_CSP_P010) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    auto uvPad = pPadParam->pad;
+    if (chromaFmt == RGY_CHROMAFMT_YUV420) {
+        uvPad.right >>= 1;
+        uvPad.left >>= 1;
+        uvPad.top >>= 1;
+        uvPad.bottom >>= 1;
+    }
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        auto planeOut = getPlane(ppOutputFrames[0], plane);
+        const auto planeIn = getPlane(pInputFrame, plane);
+        const int pad_color = ((plane == RGY_PLANE_Y) ? 16 : 128) << (bit_depth - 8);
+        sts = padPlane(&planeOut, &planeIn, pad_color, (plane == RGY_PLANE_Y) ? &pPadParam->pad : &uvPad);
+        if (sts != RGY_ERR_NONE) return sts;
+    }
+    return sts;
+}
+
+void NVEncFilterCpuPad::close() {
+    m_pFrameBuf.clear();
+}
+
+NVEncFilterCpuChain::NVEncFilterCpuChain() :
+    m_filters(), m_frameOut({ 0 }), m_baseFps(), m_log() {
+
+}
+
+NVEncFilterCpuChain::~NVEncFilterCpuChain() {
+    close();
+}
+
+void NVEncFilterCpuChain::close() {
+    m_filters.clear();
+    m_frameOut = FrameInfo({ 0 });
+    m_baseFps = rgy_rational<int>();
+}
+
+void NVEncFilterCpuChain::AddMessage(int log_level, const TCHAR *format, ...) {
+    if (m_log == nullptr || log_level < m_log->getLogLevel()) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    m_log->write_va(log_level, _T("vpp-cpu: "), format, args);
+    va_end(args);
+}
+
+RGY_ERR NVEncFilterCpuChain::init(const FrameInfo& frameIn, const sInputCrop& crop, int dstWidth, int dstHeight, const VppParam& vpp,
+    rgy_rational<int> inFps, rgy_rational<int> timebase, const tstring& outFilename, RGY_CSP outCsp, uint32_t simd, shared_ptr<RGYLog> log) {
+    close();
+    m_log = log;
+    m_baseFps = inFps;
+
+    //CPU版のないフィルタ
+    const std::pair<bool, const TCHAR *> unsupported[] = {
+        { vpp.deinterlace != VPP_DEINTERLACE_NONE, _T("--vpp-deinterlace") },
+        { vpp.delogo.enable,         _T("--vpp-delogo") },
+        { vpp.gaussMaskSize > 0,     _T("--vpp-gauss") },
+        { vpp.knn.enable,            _T("--vpp-knn") },
+        { vpp.pmd.enable,            _T("--vpp-pmd") },
+        { vpp.deband.enable,         _T("--vpp-deband") },
+        { vpp.edgelevel.enable,      _T("--vpp-edgelevel") },
+        { vpp.yadif.enable,          _T("--vpp-yadif") },
+        { vpp.colorspace.enable,     _T("--vpp-colorspace") },
+        { vpp.subburn.size() > 0,    _T("--vpp-subburn") },
+        { vpp.rff,                   _T("--vpp-rff") },
+        { vpp.selectevery.enable,    _T("--vpp-select-every") },
+    };
+    for (const auto& filter : unsupported) {
+        if (filter.first) {
+            AddMessage(RGY_LOG_ERROR, _T("%s is not supported by the cpu filter chain.\n"), filter.second);
+            return RGY_ERR_UNSUPPORTED;
+        }
+    }
+    if (frameIn.deivce_mem) {
+        AddMessage(RGY_LOG_ERROR, _T("input frame should be on host memory.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (vpp.afs.enable) {
+        if (!(frameIn.picstruct & (RGY_PICSTRUCT_TFF | RGY_PICSTRUCT_BFF))) {
+            AddMessage(RGY_LOG_ERROR, _T("Please set input interlace field order (--interlace tff/bff) for vpp-afs.\n"));
+            return RGY_ERR_INVALID_PARAM;
+        }
+        if (inFps.n() <= 0 || inFps.d() <= 0 || timebase.n() <= 0 || timebase.d() <= 0) {
+            AddMessage(RGY_LOG_ERROR, _T("invalid fps or timebase for vpp-afs.\n"));
+            return RGY_ERR_INVALID_PARAM;
+        }
+    }
+    if (vpp.nnedi.enable) {
+        if (!(frameIn.picstruct & (RGY_PICSTRUCT_TFF | RGY_PICSTRUCT_BFF))) {
+            AddMessage(RGY_LOG_ERROR, _T("Please set input interlace field order (--interlace tff/bff) for vpp-nnedi.\n"));
+            return RGY_ERR_INVALID_PARAM;
+        }
+    }
+    if (vpp.afs.enable && vpp.nnedi.enable) {
+        AddMessage(RGY_LOG_ERROR, _T("Activating 2 or more deinterlacer is not supported.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    auto filterCsp = outCsp;
+    switch (filterCsp) {
+    case RGY_CSP_NV12: filterCsp = RGY_CSP_YV12; break;
+    case RGY_CSP_P010: filterCsp = RGY_CSP_YV12_16; break;
+    case RGY_CSP_YV12:
+    case RGY_CSP_YV12_16:
+    case RGY_CSP_YUV444:
+    case RGY_CSP_YUV444_16: break;
+    default:
+        AddMessage(RGY_LOG_ERROR, _T("unsupported output csp: %s.\n"), RGY_CSP_NAMES[outCsp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    const int croppedWidth = frameIn.width - crop.e.left - crop.e.right;
+    const int croppedHeight = frameIn.height - crop.e.up - crop.e.bottom;
+    int resizeWidth = croppedWidth;
+    int resizeHeight = croppedHeight;
+    if (dstWidth > 0 && dstHeight > 0) {
+        resizeWidth = dstWidth;
+        resizeHeight = dstHeight;
+        if (vpp.pad.enable) {
+            resizeWidth -= (vpp.pad.right + vpp.pad.left);
+            resizeHeight -= (vpp.pad.bottom + vpp.pad.top);
+        }
+    }
+    const bool resizeRequired = croppedWidth != resizeWidth || croppedHeight != resizeHeight;
+
+    FrameInfo inputFrame = frameIn;
+    auto addFilter = [&](unique_ptr<NVEncFilterCpu> filter, shared_ptr<NVEncFilterParam> param) {
+        filter->setSimd(simd);
+        auto sts = filter->init(param, m_log);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("%s\n"), filter->GetInputMessage().c_str());
+        //フィルタチェーンに追加
+        m_filters.push_back(std::move(filter));
+        //入力フレーム情報を更新
+        inputFrame = param->frameOut;
+        return RGY_ERR_NONE;
+    };
+
+    //tweakは入力を上書きするので、呼び出し元のフレームを書き換えないよう、先にコピーしておく
+    const bool tweakFirst = vpp.tweak.enable && !resizeRequired && !vpp.unsharp.enable && !vpp.afs.enable && !vpp.nnedi.enable;
+    if (filterCsp != inputFrame.csp
+        || cropEnabled(crop)
+        || tweakFirst) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuCspCrop());
+        shared_ptr<NVEncFilterParamCrop> param(new NVEncFilterParamCrop());
+        param->frameIn = inputFrame;
+        param->frameOut.csp = filterCsp;
+        param->frameOut.picstruct = inputFrame.picstruct;
+        param->crop = crop;
+        param->baseFps = rgy_rational<int>();
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    //afs
+    if (vpp.afs.enable) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuAfs());
+        shared_ptr<NVEncFilterParamAfs> param(new NVEncFilterParamAfs());
+        param->afs = vpp.afs;
+        param->afs.tb_order = (frameIn.picstruct & RGY_PICSTRUCT_TFF) != 0;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->inFps = inFps;
+        param->inTimebase = timebase;
+        param->outTimebase = timebase;
+        param->baseFps = m_baseFps;
+        param->outFilename = outFilename;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        m_baseFps = param->baseFps;
+    }
+    //nnedi
+    if (vpp.nnedi.enable) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuNnedi());
+        shared_ptr<NVEncFilterParamNnedi> param(new NVEncFilterParamNnedi());
+        param->nnedi = vpp.nnedi;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->baseFps = m_baseFps;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        m_baseFps = param->baseFps;
+    }
+    //リサイズ
+    if (resizeRequired) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuResize());
+        shared_ptr<NVEncFilterParamResize> param(new NVEncFilterParamResize());
+        param->interp = (vpp.resizeInterp != VPP_RESIZE_DEFAULT) ? vpp.resizeInterp : RESIZE_CUDA_SPLINE36;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->frameOut.width = resizeWidth;
+        param->frameOut.height = resizeHeight;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    //unsharp
+    if (vpp.unsharp.enable) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuUnsharp());
+        shared_ptr<NVEncFilterParamUnsharp> param(new NVEncFilterParamUnsharp());
+        param->unsharp = vpp.unsharp;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    //tweak
+    if (vpp.tweak.enable) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuTweak());
+        shared_ptr<NVEncFilterParamTweak> param(new NVEncFilterParamTweak());
+        param->tweak = vpp.tweak;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->bOutOverwrite = true;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    //pad
+    if (vpp.pad.enable) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuPad());
+        shared_ptr<NVEncFilterParamPad> param(new NVEncFilterParamPad());
+        param->pad = vpp.pad;
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->frameOut.width += vpp.pad.left + vpp.pad.right;
+        param->frameOut.height += vpp.pad.top + vpp.pad.bottom;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    //出力の色空間への変換
+    if (inputFrame.csp != outCsp) {
+        unique_ptr<NVEncFilterCpu> filter(new NVEncFilterCpuCspCrop());
+        shared_ptr<NVEncFilterParamCrop> param(new NVEncFilterParamCrop());
+        param->frameIn = inputFrame;
+        param->frameOut = inputFrame;
+        param->frameOut.csp = outCsp;
+        param->bOutOverwrite = false;
+        auto sts = addFilter(std::move(filter), param);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    m_frameOut = inputFrame;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuChain::filter(FrameInfo *pInputFrame, vector<FrameInfo *>& outputFrames) {
+    outputFrames.clear();
+    std::deque<std::pair<FrameInfo *, uint32_t>> filterframes;
+    if (pInputFrame == nullptr) {
+        //フレームを保持するフィルタ(afs)に残っているフレームを取り出す
+        //NVEncCoreと同様に、ptrがnullptrのフレームを先頭のフィルタから順に渡し、
+        //出力のあったフィルタの後段のフィルタを実行して返す (出力がなくなるまで繰り返し呼び出すこと)
+        FrameInfo drainFrame = { 0 };
+        for (uint32_t ifilter = 0; ifilter < m_filters.size(); ifilter++) {
+            int nOutFrames = 0;
+            FrameInfo *outInfo[16] = { 0 };
+            auto sts = m_filters[ifilter]->filter(&drainFrame, (FrameInfo **)&outInfo, &nOutFrames);
+            if (sts != RGY_ERR_NONE) {
+                AddMessage(RGY_LOG_ERROR, _T("Error while running filter \"%s\".\n"), m_filters[ifilter]->name().c_str());
+                return sts;
+            }
+            if (nOutFrames > 0) {
+                for (int jframe = 0; jframe < nOutFrames; jframe++) {
+                    filterframes.push_back(std::make_pair(outInfo[jframe], ifilter + 1));
+                }
+                return filterFrames(filterframes, outputFrames);
+            }
+        }
+        return RGY_ERR_NONE;
+    }
+    filterframes.push_back(std::make_pair(pInputFrame, 0u));
+    return filterFrames(filterframes, outputFrames);
+}
+
+RGY_ERR NVEncFilterCpuChain::filterFrames(std::deque<std::pair<FrameInfo *, uint32_t>>& filterframes, vector<FrameInfo *>& outputFrames) {
+    //NVEncCoreのフィルタの実行と同様に、各フィルタの出力を順に次のフィルタに渡す
+    while (filterframes.size() > 0) {
+        const auto ifilter = filterframes.front().second;
+        if (ifilter >= m_filters.size()) {
+            outputFrames.push_back(filterframes.front().first);
+            filterframes.pop_front();
+            continue;
+        }
+        int nOutFrames = 0;
+        FrameInfo *outInfo[16] = { 0 };
+        auto sts = m_filters[ifilter]->filter(filterframes.front().first, (FrameInfo **)&outInfo, &nOutFrames);
+        filterframes.pop_front();
+        if (sts != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Error while running filter \"%s\".\n"), m_filters[ifilter]->name().c_str());
+            return sts;
+        }
+        for (int jframe = nOutFrames - 1; jframe >= 0; jframe--) {
+            filterframes.push_front(std::make_pair(outInfo[jframe], ifilter + 1));
+        }
+    }
+    return RGY_ERR_NONE;
+}
+
+uint64_t NVEncFilterCpuChain::filterAsync(NVEncCpuStream *stream, FrameInfo *pInputFrame, std::function<RGY_ERR(const FrameInfo *)> onOutput) {
+    return stream->enqueue([this, pInputFrame, onOutput]() {
+        vector<FrameInfo *> outputFrames;
+        auto sts = filter(pInputFrame, outputFrames);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        for (auto frame : outputFrames) {
+            if ((sts = onOutput(frame)) != RGY_ERR_NONE) {
+                return sts;
+            }
+        }
+        return RGY_ERR_NONE;
+    });
+}
+
+static const int VPP_CPU_BENCH_SRC_FRAMES = 4;
+
+//入力のフレームを作成する (グラデーションに疑似乱数のノイズを加える)
+static RGY_ERR vpp_cpu_bench_make_input(vector<unique_ptr<NVEncCpuFrameBuf>>& frames, RGY_CSP csp, int width, int height, RGY_PICSTRUCT picstruct) {
+    frames.clear();
+    uint32_t seed = 12345;
+    const bool high = RGY_CSP_BIT_DEPTH[csp] > 8;
+    for (int i = 0; i < VPP_CPU_BENCH_SRC_FRAMES; i++) {
+        unique_ptr<NVEncCpuFrameBuf> frame(new NVEncCpuFrameBuf(width, height, csp));
+        auto sts = frame->alloc();
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        frame->frame.picstruct = picstruct;
+        frame->frame.timestamp = i;
+        frame->frame.duration = 1;
+        frame->frame.inputFrameId = i;
+        const auto infoEx = getFrameInfoExtraCpu(&frame->frame);
+        for (int y = 0; y < infoEx.height_total; y++) {
+            uint8_t *ptr = frame->frame.ptr + y * frame->frame.pitch;
+            const int pixels = infoEx.width_byte / (high ? 2 : 1);
+            for (int x = 0; x < pixels; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                const int value = clamp(((x + y + i * 8) & 255) + (int)(seed >> 28) - 8, 0, 255);
+                if (high) {
+                    ((uint16_t *)ptr)[x] = (uint16_t)(((value << 2) | (seed >> 30)) << 6);
+                } else {
+                    ptr[x] = (uint8_t)value;
+                }
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+    return RGY_ERR_NONE;
+}
+
+uint64_t vpp_cpu_bench_hash(uint64_t hash, const FrameInfo *frame) {
+    //各プレーンのpitchは共通なので、YUV420の色差の右側のpadding(初期化されない)を含めないよう、プレーンごとの幅で計算する
+    const int pixel_size = (RGY_CSP_BIT_DEPTH[frame->csp] > 8) ? 2 : 1;
+    const bool nv12 = frame->csp == RGY_CSP_NV12 || frame->csp == RGY_CSP_P010;
+    const RGY_PLANE planeList[] = { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V };
+    for (int i = 0; i < (nv12 ? 2 : 3); i++) {
+        const auto plane = getPlane(frame, planeList[i]);
+        for (int y = 0; y < plane.height; y++) {
+            const uint8_t *ptr = plane.ptr + y * plane.pitch;
+            for (int x = 0; x < plane.width * pixel_size; x++) {
+                hash = (hash ^ ptr[x]) * 0x100000001b3ull; //FNV-1a
+            }
+        }
+    }
+    return hash;
+}
+
+//padした領域の値を確認する
+static bool vpp_cpu_bench_check_pad(const FrameInfo *frame, const VppPad& pad) {
+    const int bit_depth = RGY_CSP_BIT_DEPTH[frame->csp];
+    const bool high = bit_depth > 8;
+    auto pixel = [high](const FrameInfo& plane, int x, int y) {
+        const uint8_t *ptr = plane.ptr + y * plane.pitch;
+        return (high) ? (int)((const uint16_t *)ptr)[x] : (int)ptr[x];
+    };
+    const auto planeY = getPlane(frame, RGY_PLANE_Y);
+    const auto planeC = getPlane(frame, RGY_PLANE_C);
+    return pixel(planeY, 0, 0) == (16 << (bit_depth - 8))
+        && pixel(planeY, planeY.width - 1, planeY.height - 1) == (16 << (bit_depth - 8))
+        && pixel(planeY, pad.left - 1, pad.top) == (16 << (bit_depth - 8))
+        && pixel(planeC, 0, 0) == (128 << (bit_depth - 8))
+        && pixel(planeC, 1, 0) == (128 << (bit_depth - 8));
+}
+
+struct VppCpuBenchResult {
+    RGY_ERR err;
+    int frames;
+    double timeMs;
+    uint64_t hash;
+    bool padOK;
+};
+
+static VppCpuBenchResult vpp_cpu_bench_run(const vector<unique_ptr<NVEncCpuFrameBuf>>& input, int frames,
+    int dstWidth, int dstHeight, const VppParam& vpp, uint32_t simd, bool async) {
+    VppCpuBenchResult result = { RGY_ERR_NONE, 0, 0.0, 0xcbf29ce484222325ull, true };
+    sInputCrop crop = { 0 };
+    crop.e.left = crop.e.right = crop.e.up = crop.e.bottom = 8;
+
+    NVEncFilterCpuChain chain;
+    result.err = chain.init(input[0]->frame, crop, dstWidth, dstHeight, vpp, rgy_rational<int>(), rgy_rational<int>(), tstring(), input[0]->frame.csp, simd, nullptr);
+    if (result.err != RGY_ERR_NONE) {
+        return result;
+    }
+    auto onOutput = [&](const FrameInfo *frame) {
+        result.hash = vpp_cpu_bench_hash(result.hash, frame);
+        result.padOK &= vpp_cpu_bench_check_pad(frame, vpp.pad);
+        result.frames++;
+        return RGY_ERR_NONE;
+    };
+    const auto timeStart = std::chrono::high_resolution_clock::now();
+    if (async) {
+        //入力フレームは読み取りのみなので、まとめて投入できる
+        NVEncCpuStream stream;
+        for (int i = 0; i < frames; i++) {
+            chain.filterAsync(&stream, &input[i % input.size()]->frame, onOutput);
+        }
+        result.err = stream.synchronize();
+    } else {
+        vector<FrameInfo *> outputFrames;
+        for (int i = 0; i < frames && result.err == RGY_ERR_NONE; i++) {
+            result.err = chain.filter(&input[i % input.size()]->frame, outputFrames);
+            for (auto frame : outputFrames) {
+                onOutput(frame);
+            }
+        }
+    }
+    const auto timeFin = std::chrono::high_resolution_clock::now();
+    result.timeMs = std::chrono::duration_cast<std::chrono::microseconds>(timeFin - timeStart).count() * 0.001;
+    return result;
+}
+
+//C版の出力の期待値 (コンパイラや最適化オプションによらず一致すること)
+//フィルタの処理内容を変更した場合は、C版の出力を確認のうえ更新する
+struct VppCpuBenchGolden {
+    const char *csp;
+    const char *name;
+    const char *interp;
+    uint64_t hash;
+};
+static const VppCpuBenchGolden VPP_CPU_BENCH_GOLDEN[] = {
+    { "nv12", "down", "bilinear",  0x27b9643a255135d5ull },
+    { "nv12", "down", "spline16",  0x1e26d8993cfda745ull },
+    { "nv12", "down", "spline36",  0x8e57386ef1356605ull },
+    { "nv12", "down", "spline64",  0x138eca68958a61a5ull },
+    { "nv12", "down", "lanczos2",  0xd32e1cbd4f53372dull },
+    { "nv12", "down", "lanczos3",  0x88fd15a8859e4cf5ull },
+    { "nv12", "down", "lanczos4",  0x8d3159a85ba9289dull },
+    { "nv12", "up", "spline36",  0xaee3fcb0a5aa754dull },
+    { "nv12", "up", "lanczos3",  0x78d893acacd2a505ull },
+    { "nv12", "interlaced", "spline36",  0x828178b6fa82d925ull },
+    { "nv12", "interlaced", "lanczos3",  0x625b32bbd552d295ull },
+    { "p010", "down", "bilinear",  0xdc2313a41e9a1565ull },
+    { "p010", "down", "spline16",  0xa381e9f3b66a2145ull },
+    { "p010", "down", "spline36",  0x891e5596be2c5f05ull },
+    { "p010", "down", "spline64",  0xa6431e98f5baf74dull },
+    { "p010", "down", "lanczos2",  0xe6cea8150df7be4dull },
+    { "p010", "down", "lanczos3",  0xb948d40cb02e0645ull },
+    { "p010", "down", "lanczos4",  0x9261219f56542515ull },
+    { "p010", "up", "spline36",  0xff63d78b0aa81c35ull },
+    { "p010", "up", "lanczos3",  0x7a1ab4e0185ff285ull },
+    { "p010", "interlaced", "spline36",  0xd886723843f334edull },
+    { "p010", "interlaced", "lanczos3",  0x5b731b47b2e9ac65ull },
+};
+
+static bool vpp_cpu_bench_check_golden(const char *csp, const char *name, const char *interp, uint64_t hash) {
+    for (const auto& golden : VPP_CPU_BENCH_GOLDEN) {
+        if (strcmp(golden.csp, csp) == 0 && strcmp(golden.name, name) == 0 && strcmp(golden.interp, interp) == 0) {
+            return golden.hash == hash;
+        }
+    }
+    return false;
+}
+
+int vpp_cpu_bench(FILE *fp) {
+    const int frames = 16;
+    const bool avx2 = (get_availableSIMD() & AVX2) != 0;
+    int ret = 0;
+
+    VppParam vpp;
+    vpp.unsharp.enable = true;
+    vpp.unsharp.radius = 3;
+    vpp.unsharp.weight = 0.5f;
+    vpp.unsharp.threshold = 10.0f;
+    vpp.tweak.enable = true;
+    vpp.tweak.brightness = 0.05f;
+    vpp.tweak.contrast = 1.1f;
+    vpp.tweak.gamma = 1.2f;
+    vpp.tweak.saturation = 1.2f;
+    vpp.tweak.hue = 10.0f;
+    vpp.pad.enable = true;
+    vpp.pad.left = vpp.pad.right = vpp.pad.top = vpp.pad.bottom = 8;
+
+    struct VppCpuBenchCase {
+        const char *name;
+        int srcWidth, srcHeight, dstWidth, dstHeight;
+        RGY_PICSTRUCT picstruct;
+    };
+    const VppCpuBenchCase cases[] = {
+        { "down",       1920, 1080, 1280,  720, RGY_PICSTRUCT_FRAME },
+        { "up",         1280,  720, 1920, 1080, RGY_PICSTRUCT_FRAME },
+        { "interlaced", 1920, 1080, 1280,  720, RGY_PICSTRUCT_FRAME_TFF },
+    };
+    const std::pair<int, const char *> interps[] = {
+        { RESIZE_CUDA_TEXTURE_BILINEAR, "bilinear" },
+        { RESIZE_CUDA_SPLINE16,         "spline16" },
+        { RESIZE_CUDA_SPLINE36,         "spline36" },
+        { RESIZE_CUDA_SPLINE64,         "spline64" },
+        { RESIZE_CUDA_LANCZOS2,         "lanczos2" },
+        { RESIZE_CUDA_LANCZOS3,         "lanczos3" },
+        { RESIZE_CUDA_LANCZOS4,         "lanczos4" },
+    };
+    const std::pair<RGY_CSP, const char *> csps[] = {
+        { RGY_CSP_NV12, "nv12" },
+        { RGY_CSP_P010, "p010" },
+    };
+
+    fprintf(fp, "csp,case,interp,simd,frames,time_ms,fps,hash,verify\n");
+    for (const auto& csp : csps) {
+        for (const auto& benchCase : cases) {
+            vector<unique_ptr<NVEncCpuFrameBuf>> input;
+            if (vpp_cpu_bench_make_input(input, csp.first, benchCase.srcWidth, benchCase.srcHeight, benchCase.picstruct) != RGY_ERR_NONE) {
+                fprintf(fp, "%s,%s,-,-,0,0.0,0.0,0,NG\n", csp.second, benchCase.name);
+                ret |= 1;
+                continue;
+            }
+            for (const auto& interp : interps) {
+                //アップスケールとインタレ保持は代表的なものだけ
+                if (strcmp(benchCase.name, "down") != 0
+                    && interp.first != RESIZE_CUDA_SPLINE36 && interp.first != RESIZE_CUDA_LANCZOS3) {
+                    continue;
+                }
+                vpp.resizeInterp = interp.first;
+                //C版の出力を期待値と比較したうえで、これを基準としてAVX2版/AVX2版の非同期実行の出力が一致するか確認する
+                const auto resultC = vpp_cpu_bench_run(input, frames, benchCase.dstWidth, benchCase.dstHeight, vpp, NONE, false);
+                const bool okC = resultC.err == RGY_ERR_NONE && resultC.frames == frames && resultC.padOK
+                    && vpp_cpu_bench_check_golden(csp.second, benchCase.name, interp.second, resultC.hash);
+                fprintf(fp, "%s,%s,%s,c,%d,%.1f,%.1f,%016llx,%s\n", csp.second, benchCase.name, interp.second,
+                    resultC.frames, resultC.timeMs, resultC.frames * 1000.0 / std::max(resultC.timeMs, 0.001),
+                    (unsigned long long)resultC.hash, okC ? "OK" : "NG");
+                ret |= okC ? 0 : 1;
+                if (!avx2) {
+                    continue;
+                }
+                for (const bool async : { false, true }) {
+                    const auto result = vpp_cpu_bench_run(input, frames, benchCase.dstWidth, benchCase.dstHeight, vpp, AVX2, async);
+                    const bool ok = okC && result.err == RGY_ERR_NONE && result.frames == frames && result.padOK && result.hash == resultC.hash;
+                    fprintf(fp, "%s,%s,%s,%s,%d,%.1f,%.1f,%016llx,%s\n", csp.second, benchCase.name, interp.second, async ? "avx2_async" : "avx2",
+                        result.frames, result.timeMs, result.frames * 1000.0 / std::max(result.timeMs, 0.001),
+                        (unsigned long long)result.hash, ok ? "OK" : "NG");
+                    ret |= ok ? 0 : 1;
+                }
+            }
+        }
+    }
+    {
+        //CPU版のないフィルタはエラーとする
+        VppParam vppNG;
+        vppNG.knn.enable = true;
+        vector<unique_ptr<NVEncCpuFrameBuf>> input;
+        vpp_cpu_bench_make_input(input, RGY_CSP_NV12, 64, 64, RGY_PICSTRUCT_FRAME);
+        NVEncFilterCpuChain chain;
+        const bool ok = chain.init(input[0]->frame, sInputCrop({ 0 }), 0, 0, vppNG, rgy_rational<int>(), rgy_rational<int>(), tstring(), RGY_CSP_NV12, NONE, nullptr) == RGY_ERR_UNSUPPORTED;
+        fprintf(fp, "nv12,reject_knn,-,-,0,0.0,0.0,0,%s\n", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    return ret;
+}
@@ -0,0 +1,438 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_FILTER_CPU_H__
+#define __NVENC_FILTER_CPU_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_err.h"
+#include "rgy_log.h"
+#include "convert_csp.h"
+#include "NVEncFilterParam.h"
+#include "NVEncFilterCpuKernel.h"
+#include "NVEncFilterAfsCommon.h"
+#include "NVEncFilterNnediCommon.h"
+
+//NVEncFilterのCPU版 (ホストメモリ上のフレームを処理する)
+//GPUのない環境でのフィルタチェーンの実行/検証や、GPUを使用できない場合の代替として使用する
+//パラメータはCUDA版と共通(NVEncFilterParam.h)で、各画素はCUDA版と同じ式で計算する
+//(テクスチャの補間や__sinfなど、GPUの組み込みの演算に依存する部分は誤差の範囲で一致する)
+
+//cudaStream_tの代わり: 投入された処理を専用のスレッドで投入順に実行する
+class NVEncCpuStream {
+public:
+    NVEncCpuStream();
+    ~NVEncCpuStream();
+    //処理を投入し、その番号を返す
+    uint64_t enqueue(std::function<RGY_ERR()> func);
+    //番号idまでの処理の完了を待機する (それまでにエラーがあればそれを返す)
+    RGY_ERR wait(uint64_t id);
+    //投入済みの処理がすべて完了するまで待機する
+    RGY_ERR synchronize();
+    uint64_t queued() const;
+    uint64_t completed() const;
+protected:
+    void workerFunc();
+
+    std::thread m_thread;
+    mutable std::mutex m_mtx;
+    std::condition_variable m_cvQueue;
+    std::condition_variable m_cvDone;
+    std::deque<std::function<RGY_ERR()>> m_queue;
+    uint64_t m_queued;
+    uint64_t m_completed;
+    RGY_ERR m_err;
+    bool m_abort;
+};
+
+//cudaEvent_tの代わり
+class NVEncCpuEvent {
+public:
+    NVEncCpuEvent() : m_stream(nullptr), m_id(0) {};
+    //streamにそれまでに投入した処理の完了を記録する (nullptrなら記録した時点で完了)
+    void record(NVEncCpuStream *stream);
+    bool query() const;
+    RGY_ERR synchronize() const;
+protected:
+    NVEncCpuStream *m_stream;
+    uint64_t m_id;
+};
+
+//CUFrameBufの代わり: ホストメモリ上に確保する
+struct NVEncCpuFrameBuf {
+public:
+    FrameInfo frame;
+    NVEncCpuEvent event;
+    NVEncCpuFrameBuf() : frame({ 0 }), event() {};
+    NVEncCpuFrameBuf(int width, int height, RGY_CSP csp = RGY_CSP_NV12) : frame({ 0 }), event() {
+        frame.width = width;
+        frame.height = height;
+        frame.csp = csp;
+    };
+    NVEncCpuFrameBuf(const FrameInfo& _info) : frame(_info), event() {
+        frame.deivce_mem = false;
+    };
+    ~NVEncCpuFrameBuf() {
+        clear();
+    }
+    RGY_ERR alloc();
+    RGY_ERR copyFrame(const FrameInfo *src);
+    void clear();
+protected:
+    NVEncCpuFrameBuf(const NVEncCpuFrameBuf &) = delete;
+    void operator =(const NVEncCpuFrameBuf &) = delete;
+};
+
+//ホストメモリ間でフレームをコピーする (dstが未確保、または大きさが足りなければ確保する)
+RGY_ERR copyFrameDataCpu(FrameInfo *dst, const FrameInfo *src);
+
+class NVEncFilterCpu {
+public:
+    NVEncFilterCpu();
+    virtual ~NVEncFilterCpu();
+    tstring name() {
+        return m_sFilterName;
+    }
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) = 0;
+    RGY_ERR filter(FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum);
+    const tstring GetInputMessage() {
+        return m_sFilterInfo;
+    }
+    const NVEncFilterParam *GetFilterParam() {
+        return m_pParam.get();
+    }
+    void CheckPerformance(bool flag);
+    double GetAvgTimeElapsed();
+    //使用するSIMDを制限する (既定値はget_availableSIMD())
+    void setSimd(uint32_t simd);
+    const NVEncCpuFilterKernel *kernel() const {
+        return m_pKernel;
+    }
+protected:
+    RGY_ERR filter_as_interlaced_pair(const FrameInfo *pInputFrame, FrameInfo *pOutputFrame);
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) = 0;
+    virtual void close() = 0;
+
+    //[0, height)を行単位のタイルに分割し、スレッドプールで処理する
+    //task_idは0 ～ rowTaskCount(height)-1 で、タスクごとの作業領域の選択に使用する
+    void run_rows(int height, const std::function<void(int y_start, int y_end, int task_id)>& func);
+    int rowTaskCount(int height) const;
+    //タスクの最小の行数を指定する (タスクごとに前後の行の再計算が必要な処理で、タイルを大きくするのに使用する)
+    void run_rows(int height, int rowTileMin, const std::function<void(int y_start, int y_end, int task_id)>& func);
+    int rowTaskCount(int height, int rowTileMin) const;
+
+    void AddMessage(int log_level, const tstring& str) {
+        if (m_pPrintMes == nullptr || log_level < m_pPrintMes->getLogLevel()) {
+            return;
+        }
+        auto lines = split(str, _T("\n"));
+        for (const auto& line : lines) {
+            if (line[0] != _T('\0')) {
+                m_pPrintMes->write(log_level, (m_sFilterName + _T(": ") + line + _T("\n")).c_str());
+            }
+        }
+    }
+    void AddMessage(int log_level, const TCHAR *format, ... ) {
+        if (m_pPrintMes == nullptr || log_level < m_pPrintMes->getLogLevel()) {
+            return;
+        }
+
+        va_list args;
+        va_start(args, format);
+        m_pPrintMes->write_va(log_level, (m_sFilterName + _T(": ")).c_str(), format, args);
+        va_end(args);
+    }
+    RGY_ERR AllocFrameBuf(const FrameInfo& frame, int frames);
+
+    tstring m_sFilterName;
+    tstring m_sFilterInfo;
+    shared_ptr<RGYLog> m_pPrintMes;  //ログ出力
+    vector<unique_ptr<NVEncCpuFrameBuf>> m_pFrameBuf;
+    int m_nFrameIdx;
+    shared_ptr<NVEncFilterParam> m_pParam;
+    FILTER_PATHTHROUGH_FRAMEINFO m_nPathThrough;
+    const NVEncCpuFilterKernel *m_pKernel;
+private:
+    uint16_t m_nTraceNameId; //--perf-trace用のフィルタ名のID
+    bool m_bCheckPerformance;
+    double m_dFilterTimeMs;
+    int m_nFilterRunCount;
+};
+
+class NVEncFilterCpuCspCrop : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuCspCrop();
+    virtual ~NVEncFilterCpuCspCrop();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    virtual void close() override;
+};
+
+class NVEncFilterCpuResize : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuResize();
+    virtual ~NVEncFilterCpuResize();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    //1方向分の参照画素と重み (taps x stride、strideはdstを8の倍数に切り上げたもの)
+    struct ResizeTable {
+        int src, dst, taps, stride;
+        vector<int> index;
+        vector<float> weight;
+    };
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    RGY_ERR resizePlane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane);
+    const ResizeTable *getTable(int src, int dst);
+    virtual void close() override;
+
+    int m_interp;
+    float m_outScale;
+    float m_outMax;
+    vector<unique_ptr<ResizeTable>> m_table;
+    vector<vector<float>> m_tmpBuf; //タスクごとの縦方向の処理結果
+};
+
+class NVEncFilterCpuPad : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuPad();
+    virtual ~NVEncFilterCpuPad();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    RGY_ERR padPlane(FrameInfo *pOutputFrame, const FrameInfo *pInputFrame, int pad_color, const VppPad *pad);
+    virtual void close() override;
+};
+
+class NVEncFilterCpuTweak : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuTweak();
+    virtual ~NVEncFilterCpuTweak();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    virtual void close() override;
+
+    vector<uint16_t> m_lutY; //輝度の変換テーブル (contrast/brightness/gammaはすべての画素値について事前に計算しておく)
+};
+
+class NVEncFilterCpuUnsharp : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuUnsharp();
+    virtual ~NVEncFilterCpuUnsharp();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    RGY_ERR unsharpPlane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane, const vector<float>& gauss);
+    virtual void close() override;
+
+    vector<float> m_gaussY;  //1次元のガウシアンの重み (2*radius+1)
+    vector<float> m_gaussUV;
+    vector<vector<float>> m_tmpBuf; //タスクごとの縦方向の処理結果
+};
+
+//afsのCPU版
+//解析(analyze_stripe)、マージ(merge_scan)、縞の判定結果のフィルタ(map_filter)、合成(synthesize)は
+//CUDA版と同じ結果(YUV420の色差の縦方向の補間のみ、テクスチャの補間の誤差の範囲)となるようにし、
+//フレームの判定とタイムスタンプの計算はCUDA版と共通の処理(NVEncFilterAfsCommon.h)を使用する
+class NVEncFilterCpuAfs : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuAfs();
+    virtual ~NVEncFilterCpuAfs();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    //iframeの判定結果 (analyze_frameの実行後に有効)
+    uint8_t status(int iframe) {
+        return m_status[iframe];
+    }
+    //1タスクあたりの最小の行数 (結果はタイルの大きさによらず同じになる)
+    void setRowTileMin(int rowTileMin) {
+        m_rowTileMin = std::max(rowTileMin, 1);
+    }
+protected:
+    struct ScanData {
+        vector<uint8_t> map;
+        int status, frame, mode, tb_order, thre_shift, thre_deint, thre_Ymotion, thre_Cmotion;
+        AFS_SCAN_CLIP clip;
+        int ff_motion, lf_motion;
+    };
+    struct StripeData {
+        vector<uint8_t> map;
+        int status, frame, count0, count1;
+        int count_pending[2]; //merge_scanで集計した縞の数 (CUDA版と同様、count_stripeで反映する)
+    };
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    //1フレームを入力し、出力するフレームがあれば1フレーム出力する
+    RGY_ERR proc_frame(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum);
+    virtual void close() override;
+    RGY_ERR check_param(shared_ptr<NVEncFilterParamAfs> pAfsParam);
+
+    NVEncCpuFrameBuf *source(int iframe) {
+        iframe = clamp(iframe, 0, m_nFramesInput - 1);
+        return m_source[iframe & (AFS_SOURCE_CACHE_NUM - 1)].get();
+    }
+    ScanData *scan(int iframe) {
+        return &m_scan[iframe & (AFS_SCAN_CACHE_NUM - 1)];
+    }
+    StripeData *stripe(int iframe) {
+        return &m_stripe[iframe & (AFS_STRIPE_CACHE_NUM - 1)];
+    }
+    void expire_stripe(int iframe);
+
+    bool scan_frame_result_cached(int iframe, const VppAfs *pAfsPrm);
+    RGY_ERR scan_frame(int iframe, bool stream, const NVEncFilterParamAfs *pAfsPrm);
+    void analyze_stripe(ScanData *sp, const FrameInfo *p0, const FrameInfo *p1, const NVEncFilterParamAfs *pAfsPrm, int count[2]);
+    void merge_scan(StripeData *sp, const ScanData *sp0, const ScanData *sp1, const NVEncFilterParamAfs *pAfsPrm);
+    void get_stripe_info(int iframe, int mode, const NVEncFilterParamAfs *pAfsPrm);
+    void analyze_frame(int iframe, const NVEncFilterParamAfs *pAfsPrm, int reverse[4], int assume_shift[4], int result_stat[4]);
+    const uint8_t *map_filter(int iframe, int analyze);
+    void synthesize(FrameInfo *pOut, const FrameInfo *p0, const FrameInfo *p1, const uint8_t *sip, uint8_t status, const NVEncFilterParamAfs *pAfsPrm);
+    void synthesize_tune(FrameInfo *pOut, const uint8_t *sip, uint8_t status);
+    void copy_frame(FrameInfo *pOut, const FrameInfo *p0);
+    //タスクごとの作業領域を確保する
+    void alloc_tmp_buf(int tasks);
+
+    int m_rowTileMin;
+    int m_nFrame;
+    int64_t m_nPts;
+    int m_nFramesInput;
+    int m_mapPitch;
+    unique_ptr<NVEncCpuFrameBuf> m_source[AFS_SOURCE_CACHE_NUM];
+    ScanData m_scan[AFS_SCAN_CACHE_NUM];
+    StripeData m_stripe[AFS_STRIPE_CACHE_NUM];
+    vector<uint8_t> m_mapFiltered;
+    int m_countMotion[2]; //直前のscan_frameで集計した動きのある画素の数 (CUDA版と同様、次のフレームのscan_frameで反映する)
+    afsStatus m_status;
+    afsStreamStatus m_streamsts;
+    afsTimecode m_timecode;
+    int m_tmpPitch;    //m_tmpBufの1行の大きさ
+    int m_tmpPitchInt; //m_tmpBufIntの1行の大きさ
+    vector<vector<uint8_t>> m_tmpBuf;    //タスクごとの作業領域
+    vector<vector<int32_t>> m_tmpBufInt; //タスクごとの作業領域 (YUV420の色差)
+};
+
+struct NnediCpuWeights;
+
+//nnediのCPU版
+//CUDA版のfp32の計算と同じ計算を行い、CUDA版とは誤差の範囲で一致する (fp16は使用しない)
+//predictorの重みは初期化時にSIMDで読みやすい並びに一度だけ変換し、同じ設定のフィルタ間で共有する
+class NVEncFilterCpuNnedi : public NVEncFilterCpu {
+public:
+    NVEncFilterCpuNnedi();
+    virtual ~NVEncFilterCpuNnedi();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    //1タスクあたりの最小のブロック数 (1ブロック=フィールドの4行、結果はタイルの大きさによらず同じになる)
+    void setRowTileMin(int rowTileMin) {
+        m_rowTileMin = std::max(rowTileMin, 1);
+    }
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    virtual void close() override;
+    RGY_ERR check_param(shared_ptr<NVEncFilterParamNnedi> pNnediParam);
+    template<typename Type>
+    void proc_plane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane, const NnediTargetField targetField, const VppNnedi& nnedi);
+    void proc_frame(FrameInfo *pOutputFrame, const FrameInfo *pInputFrame, const NnediTargetField targetField, const VppNnedi& nnedi);
+    //タスクごとの作業領域を確保する
+    void alloc_tmp_buf(int tasks);
+
+    int m_rowTileMin;
+    shared_ptr<const NnediCpuWeights> m_weights;
+    const NVEncCpuFilterKernel *m_pKernelNnedi; //FMA3が使用できない場合はC版
+    int m_tmpPitch;                       //m_tmpBufの1行の大きさ
+    vector<vector<float>> m_tmpBuf;       //タスクごとの作業領域 (フィールドの行とpredictorの出力)
+    vector<vector<uint8_t>> m_tmpBufFlag; //タスクごとの作業領域 (prescreenerの判定結果)
+    vector<vector<int>> m_tmpBufPos;      //タスクごとの作業領域 (predictorで処理する画素の位置)
+};
+
+//--vpp-*の設定から、CPU版のフィルタチェーンを構築して実行する
+//入力 -> crop/色空間変換 -> afs/nnedi -> resize -> unsharp -> tweak -> pad -> 出力の色空間 の順で、
+//NVEncCoreのInitFiltersと同じ順序とする (CPU版のないフィルタが指定された場合はエラー)
+class NVEncFilterCpuChain {
+public:
+    NVEncFilterCpuChain();
+    ~NVEncFilterCpuChain();
+    //dstWidth/dstHeightが0ならリサイズしない、outCspが出力の色空間
+    //inFps/timebase/outFilenameはafsのタイムスタンプとtimecode/logの出力に使用する
+    RGY_ERR init(const FrameInfo& frameIn, const sInputCrop& crop, int dstWidth, int dstHeight, const VppParam& vpp,
+        rgy_rational<int> inFps, rgy_rational<int> timebase, const tstring& outFilename, RGY_CSP outCsp, uint32_t simd, shared_ptr<RGYLog> log);
+    //1フレームを処理し、出力されたフレームを返す (出力は次の呼び出しまで有効)
+    //pInputFrameがnullptrの場合は、フィルタに残っているフレームを返す (出力がなくなるまで繰り返し呼び出すこと)
+    RGY_ERR filter(FrameInfo *pInputFrame, vector<FrameInfo *>& outputFrames);
+    //streamに処理を投入する (pInputFrameはstream上の処理が完了するまで有効であること)
+    //出力されたフレームはstreamのスレッドでonOutputに渡される
+    uint64_t filterAsync(NVEncCpuStream *stream, FrameInfo *pInputFrame, std::function<RGY_ERR(const FrameInfo *)> onOutput);
+    const FrameInfo& frameOut() const {
+        return m_frameOut;
+    }
+    const vector<unique_ptr<NVEncFilterCpu>>& filters() const {
+        return m_filters;
+    }
+    //afs/nnediによるフレームレートの変更を反映した出力のフレームレート
+    rgy_rational<int> baseFps() const {
+        return m_baseFps;
+    }
+    void close();
+protected:
+    void AddMessage(int log_level, const TCHAR *format, ...);
+    RGY_ERR filterFrames(std::deque<std::pair<FrameInfo *, uint32_t>>& filterframes, vector<FrameInfo *>& outputFrames);
+
+    vector<unique_ptr<NVEncFilterCpu>> m_filters;
+    FrameInfo m_frameOut;
+    rgy_rational<int> m_baseFps;
+    shared_ptr<RGYLog> m_log;
+};
+
+//CPU版のフィルタチェーン(crop/色空間変換/resize/unsharp/tweak/pad)の速度を計測してCSVで出力する
+//C版とAVX2版の出力が一致することと、既知の入力に対する出力のハッシュを確認する
+int vpp_cpu_bench(FILE *fp);
+//ベンチマークで出力を比較するためのハッシュ (FNV-1a)
+uint64_t vpp_cpu_bench_hash(uint64_t hash, const FrameInfo *frame);
+
+//CPU版のafsの速度を計測してCSVで出力する
+//C版とAVX2版、タイルの大きさを変えた場合の出力(画像、判定結果、タイムスタンプ)が一致することを確認する
+int afs_cpu_bench(FILE *fp);
+//afsのベンチマークの入力 (3:2プルダウンされたインタレ(TFF)) を作成する
+RGY_ERR afs_cpu_bench_make_input(vector<unique_ptr<NVEncCpuFrameBuf>>& input, RGY_CSP csp, int width, int height, int frames);
+
+//CPU版のnnediの速度を1080iで計測してCSVで出力する
+//AVX2版がC版と誤差の範囲で一致することと、タイルの大きさを変えた場合の出力が一致することを確認する
+int nnedi_cpu_bench(FILE *fp);
+//nnediのベンチマークの入力 (動きのあるインタレ(TFF)) を作成する
+RGY_ERR nnedi_cpu_bench_make_input(vector<unique_ptr<NVEncCpuFrameBuf>>& input, RGY_CSP csp, int width, int height, int frames);
+
+#endif //__NVENC_FILTER_CPU_H__
@@ -0,0 +1,1145 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include "rgy_simd.h"
+#include "NVEncFilterCpu.h"
+
+//作業領域の左右の余白 (解析結果のフィルタで左右にはみ出して参照する分)
+static const int AFS_CPU_TMP_PAD = 32;
+
+//合成の方法と参照する行 (CUDA版のsynthesize_mode_1/2/3/4と同じ組み合わせ)
+struct AfsCpuSynthOp {
+    int op;
+    uint8_t mask;
+    int src[5][2]; //{ フレーム(0: 現フレーム、1: 前フレーム), 行 (中央の行はmode 4なら4、それ以外は2) }
+};
+
+static AfsCpuSynthOp afs_cpu_synth_op(int mode, bool shift0, bool latter) {
+    AfsCpuSynthOp s;
+    s.op = CPU_AFS_SYN_COPY;
+    s.mask = 0;
+    for (auto& src : s.src) {
+        src[0] = 0;
+        src[1] = (mode == 4) ? 4 : 2;
+    }
+    auto set = [&s](int i, int frame, int line) {
+        s.src[i][0] = frame;
+        s.src[i][1] = line;
+    };
+    if (mode == 1) {
+        if (shift0 && !latter) {
+            s.op = CPU_AFS_SYN_INTER;
+            set(0, 0, 2); set(1, 1, 1); set(2, 1, 2); set(3, 1, 3);
+        } else if (shift0) {
+            s.op = CPU_AFS_SYN_SPOT;
+            set(0, 0, 1); set(1, 0, 3); set(2, 1, 1); set(3, 1, 3); set(4, 1, 2);
+        } else if (latter) {
+            s.op = CPU_AFS_SYN_INTER;
+            set(0, 0, 1); set(1, 0, 2); set(2, 0, 3); set(3, 1, 2);
+        } else {
+            s.op = CPU_AFS_SYN_SPOT;
+            set(0, 0, 1); set(1, 0, 3); set(2, 1, 1); set(3, 1, 3); set(4, 0, 2);
+        }
+    } else if (mode == 2 || mode == 3) {
+        s.op = CPU_AFS_SYN_BLEND;
+        if (shift0) {
+            s.mask = (mode == 2) ? 0x02 : 0x06;
+            if (!latter) {
+                set(0, 1, 1); set(1, 0, 2); set(2, 1, 3);
+            } else {
+                set(0, 0, 1); set(1, 1, 2); set(2, 0, 3);
+            }
+        } else {
+            s.mask = (mode == 2) ? 0x01 : 0x05;
+            set(0, 0, 1); set(1, 0, 2); set(2, 0, 3);
+        }
+    } else if (mode == 4) {
+        if (shift0 && !latter) {
+            s.op = CPU_AFS_SYN_DEINT;
+            s.mask = 0x06;
+            set(0, 1, 1); set(1, 1, 3); set(2, 0, 4); set(3, 1, 5); set(4, 1, 7);
+        } else if (shift0) {
+            set(0, 1, 4);
+        } else if (latter) {
+            s.op = CPU_AFS_SYN_DEINT;
+            s.mask = 0x05;
+            set(0, 0, 1); set(1, 0, 3); set(2, 0, 4); set(3, 0, 5); set(4, 0, 7);
+        }
+    }
+    return s;
+}
+
+//tuneモードの表示色 (CUDA版のsynthesize_mode_tune_select_colorと同じ)
+static int afs_cpu_tune_color(uint8_t sip, uint8_t status) {
+    const uint8_t mask = (status & AFS_FLAG_SHIFT0) ? 0x02 : 0x01;
+    if (!(sip & (mask | 0x04)))
+        return 3;
+    else if (~sip & mask)
+        return 1;
+    else if (~sip & 0x04)
+        return 2;
+    return 0;
+}
+
+NVEncFilterCpuAfs::NVEncFilterCpuAfs() :
+    m_rowTileMin(64),
+    m_nFrame(0),
+    m_nPts(0),
+    m_nFramesInput(0),
+    m_mapPitch(0),
+    m_source(),
+    m_scan(),
+    m_stripe(),
+    m_mapFiltered(),
+    m_countMotion(),
+    m_status(),
+    m_streamsts(),
+    m_timecode(),
+    m_tmpPitch(0),
+    m_tmpPitchInt(0),
+    m_tmpBuf(),
+    m_tmpBufInt() {
+    m_sFilterName = _T("afs");
+}
+
+NVEncFilterCpuAfs::~NVEncFilterCpuAfs() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuAfs::check_param(shared_ptr<NVEncFilterParamAfs> pAfsParam) {
+    if (pAfsParam->frameOut.height <= 0 || pAfsParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.top < 0 || pAfsParam->afs.clip.top >= pAfsParam->frameOut.height) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.top).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.bottom < 0 || pAfsParam->afs.clip.bottom >= pAfsParam->frameOut.height) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.bottom).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.top + pAfsParam->afs.clip.bottom >= pAfsParam->frameOut.height) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.top + clip.bottom).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.left < 0 || pAfsParam->afs.clip.left >= pAfsParam->frameOut.width) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.left).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.left % 4 != 0) {
+        AddMessage(RGY_LOG_ERROR, _T("parameter \"left\" rounded to multiple of 4.\n"));
+        pAfsParam->afs.clip.left = (pAfsParam->afs.clip.left + 2) & ~3;
+    }
+    if (pAfsParam->afs.clip.right < 0 || pAfsParam->afs.clip.right >= pAfsParam->frameOut.width) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.right).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.clip.right % 4 != 0) {
+        AddMessage(RGY_LOG_ERROR, _T("parameter \"right\" rounded to multiple of 4.\n"));
+        pAfsParam->afs.clip.right = (pAfsParam->afs.clip.right + 2) & ~3;
+    }
+    if (pAfsParam->afs.clip.left + pAfsParam->afs.clip.right >= pAfsParam->frameOut.width) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (clip.left + clip.right).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.method_switch < 0 || pAfsParam->afs.method_switch > 256) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (method_switch).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.coeff_shift < 0 || pAfsParam->afs.coeff_shift > 256) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (coeff_shift).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.thre_shift < 0 || pAfsParam->afs.thre_shift > 1024) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (thre_shift).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.thre_deint < 0 || pAfsParam->afs.thre_deint > 1024) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (thre_deint).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.thre_Ymotion < 0 || pAfsParam->afs.thre_Ymotion > 1024) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (thre_Ymotion).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.thre_Cmotion < 0 || pAfsParam->afs.thre_Cmotion > 1024) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (thre_Cmotion).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pAfsParam->afs.analyze < 0 || pAfsParam->afs.analyze > 5) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (level).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (!pAfsParam->afs.shift) {
+        AddMessage(RGY_LOG_WARN, _T("shift was off, so drop and smooth will also be off.\n"));
+        pAfsParam->afs.drop = false;
+        pAfsParam->afs.smooth = false;
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuAfs::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pAfsParam = std::dynamic_pointer_cast<NVEncFilterParamAfs>(pParam);
+    if (!pAfsParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //パラメータチェック
+    if (check_param(pAfsParam) != RGY_ERR_NONE) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto csp = pAfsParam->frameIn.csp;
+    if (csp != RGY_CSP_YV12 && csp != RGY_CSP_YV12_16 && csp != RGY_CSP_YUV444 && csp != RGY_CSP_YUV444_16) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp %s.\n"), RGY_CSP_NAMES[csp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    sts = AllocFrameBuf(pAfsParam->frameOut, 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pAfsParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    const int width = pAfsParam->frameIn.width;
+    const int height = pAfsParam->frameIn.height;
+    for (auto& source : m_source) {
+        source.reset(new NVEncCpuFrameBuf(width, height, csp));
+        sts = source->alloc();
+        if (sts != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+    }
+    //解析結果は1画素1byte (CUDA版と同じ)
+    m_mapPitch = ALIGN(width, 64);
+    for (auto& scan : m_scan) {
+        scan.map.assign(m_mapPitch * height, 0);
+        scan.status = scan.frame = scan.mode = scan.tb_order = 0;
+        scan.thre_shift = scan.thre_deint = scan.thre_Ymotion = scan.thre_Cmotion = 0;
+        memset(&scan.clip, 0, sizeof(scan.clip));
+        scan.ff_motion = scan.lf_motion = 0;
+    }
+    for (auto& stripe : m_stripe) {
+        stripe.map.assign(m_mapPitch * height, 0);
+        stripe.status = stripe.frame = stripe.count0 = stripe.count1 = 0;
+        stripe.count_pending[0] = stripe.count_pending[1] = 0;
+    }
+    m_mapFiltered.assign(m_mapPitch * height, 0);
+    m_countMotion[0] = m_countMotion[1] = 0;
+    m_tmpPitch = ALIGN(width + 2 * AFS_CPU_TMP_PAD, 64);
+    m_tmpPitchInt = ALIGN(width, 16);
+    m_tmpBuf.clear();
+    m_tmpBufInt.clear();
+
+    pAfsParam->frameOut.picstruct = RGY_PICSTRUCT_FRAME;
+    m_nFrame = 0;
+    m_nPts = 0;
+    m_nFramesInput = 0;
+    m_nPathThrough &= (~(FILTER_PATHTHROUGH_PICSTRUCT | FILTER_PATHTHROUGH_TIMESTAMP | FILTER_PATHTHROUGH_FLAGS));
+    if (pAfsParam->afs.force24) {
+        pAfsParam->baseFps *= rgy_rational<int>(4, 5);
+    }
+
+    if (pAfsParam->afs.timecode) {
+        const tstring tc_filename = PathRemoveExtensionS(pAfsParam->outFilename) + _T(".timecode.txt");
+        if (m_timecode.open(tc_filename)) {
+            errno_t error = errno;
+            AddMessage(RGY_LOG_ERROR, _T("failed to open timecode file \"%s\": %s.\n"), tc_filename.c_str(), _tcserror(error));
+            return RGY_ERR_FILE_OPEN; // Couldn't open file
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("opened timecode file \"%s\".\n"), tc_filename.c_str());
+    }
+
+    if (pAfsParam->afs.log) {
+        const tstring log_filename = PathRemoveExtensionS(pAfsParam->outFilename) + _T(".afslog.csv");
+        if (m_streamsts.open_log(log_filename)) {
+            errno_t error = errno;
+            AddMessage(RGY_LOG_ERROR, _T("failed to open afs log file \"%s\": %s.\n"), log_filename.c_str(), _tcserror(error));
+            return RGY_ERR_FILE_OPEN; // Couldn't open file
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("opened afs log file \"%s\".\n"), log_filename.c_str());
+    }
+
+#define ON_OFF(b) ((b) ? _T("on") : _T("off"))
+    m_sFilterInfo = strsprintf(
+        _T("afs: clip(T %d, B %d, L %d, R %d), switch %d, coeff_shift %d\n")
+        _T("                    thre(shift %d, deint %d, Ymotion %d, Cmotion %d)\n")
+        _T("                    level %d, shift %s, drop %s, smooth %s, force24 %s\n")
+        _T("                    tune %s, tb_order %d(%s), rff %s, timecode %s, log %s [cpu %s]"),
+        pAfsParam->afs.clip.top, pAfsParam->afs.clip.bottom, pAfsParam->afs.clip.left, pAfsParam->afs.clip.right,
+        pAfsParam->afs.method_switch, pAfsParam->afs.coeff_shift,
+        pAfsParam->afs.thre_shift, pAfsParam->afs.thre_deint, pAfsParam->afs.thre_Ymotion, pAfsParam->afs.thre_Cmotion,
+        pAfsParam->afs.analyze, ON_OFF(pAfsParam->afs.shift), ON_OFF(pAfsParam->afs.drop), ON_OFF(pAfsParam->afs.smooth), ON_OFF(pAfsParam->afs.force24),
+        ON_OFF(pAfsParam->afs.tune), pAfsParam->afs.tb_order, pAfsParam->afs.tb_order ? _T("tff") : _T("bff"), ON_OFF(pAfsParam->afs.rff), ON_OFF(pAfsParam->afs.timecode), ON_OFF(pAfsParam->afs.log),
+        m_pKernel->name);
+#undef ON_OFF
+
+    //コピーを保存
+    m_pParam = pAfsParam;
+    return sts;
+}
+
+void NVEncFilterCpuAfs::alloc_tmp_buf(int tasks) {
+    //8bit: 解析(F 3プレーンx4行 + m0 8行 + m1 1行)、解析結果のフィルタ(8行)、合成(縞の判定結果なしの1行)の大きい方
+    //int : 解析(YUV420の色差 2プレーンx2フレームx2行)、合成(YUV420の色差 2フレームx16行 + 4行、色差の幅)の大きい方
+    const size_t tmpSize = (size_t)m_tmpPitch * 21;
+    const size_t tmpSizeInt = std::max((size_t)m_tmpPitchInt * 8, (size_t)ALIGN(m_tmpPitchInt >> 1, 16) * 36);
+    if ((int)m_tmpBuf.size() < tasks) {
+        m_tmpBuf.resize(tasks);
+        m_tmpBufInt.resize(tasks);
+    }
+    for (int i = 0; i < tasks; i++) {
+        if (m_tmpBuf[i].size() < tmpSize) {
+            m_tmpBuf[i].resize(tmpSize, 0);
+        }
+        if (m_tmpBufInt[i].size() < tmpSizeInt) {
+            m_tmpBufInt[i].resize(tmpSizeInt, 0);
+        }
+    }
+}
+
+void NVEncFilterCpuAfs::expire_stripe(int iframe) {
+    auto stp = stripe(iframe);
+    if (stp->frame == iframe && stp->status > 0) {
+        stp->status = 0;
+    }
+}
+
+bool NVEncFilterCpuAfs::scan_frame_result_cached(int iframe, const VppAfs *pAfsPrm) {
+    auto sp = scan(iframe);
+    const int mode = pAfsPrm->analyze == 0 ? 0 : 1;
+    return sp->status > 0 && sp->frame == iframe && sp->tb_order == pAfsPrm->tb_order && sp->thre_shift == pAfsPrm->thre_shift &&
+        ((mode == 0) ||
+        (mode == 1 && sp->mode == 1 && sp->thre_deint == pAfsPrm->thre_deint && sp->thre_Ymotion == pAfsPrm->thre_Ymotion && sp->thre_Cmotion == pAfsPrm->thre_Cmotion));
+}
+
+RGY_ERR NVEncFilterCpuAfs::scan_frame(int iframe, bool stream, const NVEncFilterParamAfs *pAfsPrm) {
+    if (scan_frame_result_cached(iframe, &pAfsPrm->afs)) {
+        return RGY_ERR_NONE;
+    }
+    auto p1 = source(iframe - 1);
+    auto p0 = source(iframe);
+    auto sp = scan(iframe);
+
+    const int mode = pAfsPrm->afs.analyze == 0 ? 0 : 1;
+    expire_stripe(iframe - 1);
+    expire_stripe(iframe);
+    sp->status = 1;
+    sp->frame = iframe, sp->mode = mode, sp->tb_order = pAfsPrm->afs.tb_order;
+    sp->thre_shift = pAfsPrm->afs.thre_shift, sp->thre_deint = pAfsPrm->afs.thre_deint;
+    sp->thre_Ymotion = pAfsPrm->afs.thre_Ymotion, sp->thre_Cmotion = pAfsPrm->afs.thre_Cmotion;
+    sp->clip.top = sp->clip.bottom = sp->clip.left = sp->clip.right = -1;
+    int count[2] = { 0, 0 };
+    analyze_stripe(sp, &p0->frame, &p1->frame, pAfsPrm, count);
+
+    //CUDA版では動きの画素数の集計は非同期に行われ、結果は次のフレームのscan_frameで
+    //1フレーム前の解析結果に反映される (最初のフレームの前の解析では反映されない)
+    //判定結果を一致させるため、同じ順序で反映する
+    if (stream) {
+        sp = scan(iframe - 1);
+    }
+    sp->clip = pAfsPrm->afs.clip;
+    sp->ff_motion = m_countMotion[0];
+    sp->lf_motion = m_countMotion[1];
+    if (stream) {
+        m_countMotion[0] = count[0];
+        m_countMotion[1] = count[1];
+    }
+    return RGY_ERR_NONE;
+}
+
+void NVEncFilterCpuAfs::analyze_stripe(ScanData *sp, const FrameInfo *p0, const FrameInfo *p1, const NVEncFilterParamAfs *pAfsPrm, int count[2]) {
+    const int width = p0->width;
+    const int height = p0->height;
+    const bool yuv420 = RGY_CSP_CHROMA_FORMAT[p0->csp] == RGY_CHROMAFMT_YUV420;
+    //閾値はCUDA版と同様、格納する型のビット数に合わせて変換する
+    const int type_bits = (RGY_CSP_BIT_DEPTH[p0->csp] > 8) ? 16 : 8;
+    const int high = (type_bits > 8) ? 1 : 0;
+    const int thre_rsft = 12 - (type_bits - 8);
+    const int thre_max = (1 << (type_bits - 1)) - 1;
+    const int thre_shift   = clamp((pAfsPrm->afs.thre_shift   * 219 +  383) >> thre_rsft, 0, thre_max);
+    const int thre_deint   = clamp((pAfsPrm->afs.thre_deint   * 219 +  383) >> thre_rsft, 0, thre_max);
+    const int thre_Ymotion = clamp((pAfsPrm->afs.thre_Ymotion * 219 +  383) >> thre_rsft, 0, thre_max);
+    const int thre_Cmotion = clamp((pAfsPrm->afs.thre_Cmotion * 224 + 2112) >> thre_rsft, 0, thre_max);
+    const int threY[4] = { thre_Ymotion, thre_shift, thre_deint, thre_shift };
+    const int threC[4] = { thre_Cmotion, thre_shift, thre_deint, thre_shift };
+    //YUV420の色差はCUDA版ではテクスチャの補間(正規化したfloat)で比較するので、
+    //afs_get_uvの出力(16倍の整数)の単位に換算し、「<」の比較は切り上げ、「>」の比較は切り捨てとする
+    const float thre_mul = (224.0f / (float)(4096 >> (type_bits - 8))) * (1.0f / (1 << type_bits));
+    const double thre_scale = 16.0 * ((1 << type_bits) - 1);
+    const double thre_shift_uv   = std::max(0.0f, pAfsPrm->afs.thre_shift   * thre_mul) * thre_scale;
+    const double thre_deint_uv   = std::max(0.0f, pAfsPrm->afs.thre_deint   * thre_mul) * thre_scale;
+    const double thre_Cmotion_uv = std::max(0.0f, pAfsPrm->afs.thre_Cmotion * thre_mul) * thre_scale;
+    const int threUV[4] = {
+        (int)std::ceil(thre_Cmotion_uv), (int)std::ceil(thre_shift_uv), (int)std::floor(thre_deint_uv), (int)std::floor(thre_shift_uv)
+    };
+
+    const int tb_order = pAfsPrm->afs.tb_order ? 1 : 0;
+    //動きの画素数の集計範囲 (CUDA版と同様、縦は偶数行、横は4画素単位)
+    const auto& clip = pAfsPrm->afs.clip;
+    const int count_top = clip.top;
+    const int count_bottom = clip.top + ((height - clip.top - clip.bottom) & ~1);
+    const int count_start = clip.left;
+    const int count_end = clip.left + (std::max(width - clip.left - clip.right, 0) & ~3);
+
+    const FrameInfo plane0[3] = { getPlane(p0, RGY_PLANE_Y), getPlane(p0, RGY_PLANE_U), getPlane(p0, RGY_PLANE_V) };
+    const FrameInfo plane1[3] = { getPlane(p1, RGY_PLANE_Y), getPlane(p1, RGY_PLANE_U), getPlane(p1, RGY_PLANE_V) };
+    auto row = [](const FrameInfo& plane, int y) {
+        return (const void *)(plane.ptr + clamp(y, 0, plane.height - 1) * plane.pitch);
+    };
+
+    const int tasks = rowTaskCount(height, m_rowTileMin);
+    alloc_tmp_buf(tasks);
+    vector<int> countTask(tasks * 2, 0);
+    run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+        //F: 各プレーンの解析結果(4行のリングバッファ)、m0: 判定フラグ(8行のリングバッファ)、m1: 行kの縞の判定フラグ
+        uint8_t *buf = m_tmpBuf[task_id].data();
+        uint8_t *f[3][4], *m0[8];
+        for (int i = 0; i < 12; i++) {
+            f[i >> 2][i & 3] = buf + m_tmpPitch * i;
+        }
+        for (int i = 0; i < 8; i++) {
+            m0[i] = buf + m_tmpPitch * (12 + i);
+        }
+        uint8_t *m1 = buf + m_tmpPitch * 20;
+        //YUV420の色差を輝度の解像度に補間したもの [U/V][現フレーム/前フレーム][k & 1]
+        int32_t *g[2][2][2];
+        for (int i = 0; i < 8; i++) {
+            g[i >> 2][(i >> 1) & 1][i & 1] = m_tmpBufInt[task_id].data() + m_tmpPitchInt * i;
+        }
+        //CUDA版のテクスチャの読み込みと同様、フィールドごとに縦方向に補間する
+        auto get_uv = [&](int32_t *dst, const FrameInfo& plane, int k) {
+            const int field_height = std::max(height >> 2, 1);
+            const int iy = (k - 2) >> 2;
+            const int row0 = 2 * clamp(iy + 0, 0, field_height - 1) + (k & 1);
+            const int row1 = 2 * clamp(iy + 1, 0, field_height - 1) + (k & 1);
+            m_pKernel->afs_get_uv[high](dst, row(plane, row0), row(plane, row1), 7 - 2 * (k & 3), plane.width, 1);
+        };
+        auto analyze_row = [&](int k) {
+            const int stripe = (k >= 1) ? 1 : 0;
+            const int swap = ((k & 1) == tb_order) ? 1 : 0;
+            m_pKernel->afs_analyze[high](f[0][k & 3], row(plane0[0], k), row(plane0[0], k - 1), row(plane1[0], k), row(plane1[0], k - 1),
+                width, stripe, swap, threY);
+            for (int i = 1; i < 3; i++) {
+                if (yuv420) {
+                    get_uv(g[i - 1][0][k & 1], plane0[i], k);
+                    get_uv(g[i - 1][1][k & 1], plane1[i], k);
+                    m_pKernel->afs_analyze[2](f[i][k & 3], g[i - 1][0][k & 1], g[i - 1][0][(k - 1) & 1], g[i - 1][1][k & 1], g[i - 1][1][(k - 1) & 1],
+                        width, stripe, swap, threUV);
+                } else {
+                    m_pKernel->afs_analyze[high](f[i][k & 3], row(plane0[i], k), row(plane0[i], k - 1), row(plane1[i], k), row(plane1[i], k - 1),
+                        width, stripe, swap, threC);
+                }
+            }
+        };
+        if (yuv420) {
+            for (int i = 1; i < 3; i++) {
+                get_uv(g[i - 1][0][(y_start - 4) & 1], plane0[i], y_start - 4);
+                get_uv(g[i - 1][1][(y_start - 4) & 1], plane1[i], y_start - 4);
+            }
+        }
+        //出力の行rには、行r-3 ～ r+4の解析結果が必要
+        int motion[2] = { 0, 0 };
+        for (int k = y_start - 3; k < y_end + 4; k++) {
+            analyze_row(k);
+            if (k < y_start) {
+                continue;
+            }
+            const uint8_t *fy[4], *fu[4], *fv[4];
+            for (int i = 0; i < 4; i++) {
+                fy[i] = f[0][(k - 3 + i) & 3];
+                fu[i] = f[1][(k - 3 + i) & 3];
+                fv[i] = f[2][(k - 3 + i) & 3];
+            }
+            m_pKernel->afs_gen_flags(m0[k & 7], m1, fy, fu, fv, width);
+            if (k >= y_start + 4) {
+                const int r = k - 4;
+                const uint8_t *m0r[4] = { m0[r & 7], m0[(r + 1) & 7], m0[(r + 2) & 7], m0[(r + 3) & 7] };
+                const bool count_row = count_top <= r && r < count_bottom;
+                motion[((r & 1) == tb_order) ? 1 : 0] += m_pKernel->afs_output(sp->map.data() + r * m_mapPitch, m0r, m1, width,
+                    count_row ? count_start : 0, count_row ? count_end : 0);
+            }
+        }
+        countTask[task_id * 2 + 0] = motion[0];
+        countTask[task_id * 2 + 1] = motion[1];
+    });
+    count[0] = count[1] = 0;
+    for (int i = 0; i < tasks; i++) {
+        count[0] += countTask[i * 2 + 0];
+        count[1] += countTask[i * 2 + 1];
+    }
+}
+
+void NVEncFilterCpuAfs::merge_scan(StripeData *sp, const ScanData *sp0, const ScanData *sp1, const NVEncFilterParamAfs *pAfsPrm) {
+    const int width = m_pParam->frameIn.width;
+    const int height = m_pParam->frameIn.height;
+    const int tb_order = pAfsPrm->afs.tb_order ? 1 : 0;
+    const auto& clip = pAfsPrm->afs.clip;
+    const int count_start = clip.left;
+    const int count_end = clip.left + (std::max(width - clip.left - clip.right, 0) & ~3);
+
+    const int tasks = rowTaskCount(height, m_rowTileMin);
+    vector<int> countTask(tasks * 2, 0);
+    run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+        int stripe_count[2] = { 0, 0 };
+        for (int y = y_start; y < y_end; y++) {
+            const int rows[3] = { std::max(y - 1, 0) * m_mapPitch, y * m_mapPitch, std::min(y + 1, height - 1) * m_mapPitch };
+            const uint8_t *p0[3] = { sp0->map.data() + rows[0], sp0->map.data() + rows[1], sp0->map.data() + rows[2] };
+            const uint8_t *p1[3] = { sp1->map.data() + rows[0], sp1->map.data() + rows[1], sp1->map.data() + rows[2] };
+            //シフトあり(0x60)とシフトなし(0x50)の縞は、それぞれのフィールドの行で数える
+            const int field = (y + tb_order) & 1;
+            const bool count_row = clip.top <= y && y < height - clip.bottom;
+            stripe_count[field] += m_pKernel->afs_merge_scan(sp->map.data() + y * m_mapPitch, p0, p1, width, field ? 0x60 : 0x50,
+                count_row ? count_start : 0, count_row ? count_end : 0);
+        }
+        countTask[task_id * 2 + 0] = stripe_count[0];
+        countTask[task_id * 2 + 1] = stripe_count[1];
+    });
+    sp->count_pending[0] = sp->count_pending[1] = 0;
+    for (int i = 0; i < tasks; i++) {
+        sp->count_pending[0] += countTask[i * 2 + 0];
+        sp->count_pending[1] += countTask[i * 2 + 1];
+    }
+}
+
+void NVEncFilterCpuAfs::get_stripe_info(int iframe, int mode, const NVEncFilterParamAfs *pAfsPrm) {
+    auto sp = stripe(iframe);
+    if (sp->status > mode && sp->status < 4 && sp->frame == iframe) {
+        if (sp->status == 2) {
+            //CUDA版と同様、縞の画素数はmerge_scanの次の呼び出しで反映する
+            sp->count0 = sp->count_pending[0];
+            sp->count1 = sp->count_pending[1];
+            sp->status = 3;
+        }
+        return;
+    }
+    merge_scan(sp, scan(iframe), scan(iframe + 1), pAfsPrm);
+    sp->status = 2;
+    sp->frame = iframe;
+}
+
+void NVEncFilterCpuAfs::analyze_frame(int iframe, const NVEncFilterParamAfs *pAfsPrm, int reverse[4], int assume_shift[4], int result_stat[4]) {
+    for (int i = 0; i < 4; i++) {
+        assume_shift[i] = afs_detect_telecine_cross(scan(iframe + i - 1), scan(iframe + i), scan(iframe + i + 1), scan(iframe + i + 2), pAfsPrm->afs.coeff_shift);
+    }
+
+    const ScanData *scp = scan(iframe);
+    const int threshold = afs_stripe_threshold(&scp->clip, m_pParam->frameIn.width, m_pParam->frameIn.height, pAfsPrm->afs.method_switch);
+
+    for (int i = 0; i < 4; i++) {
+        get_stripe_info(iframe + i, 0, pAfsPrm);
+        const StripeData *stp = stripe(iframe + i);
+        result_stat[i] = afs_result_stat(stp->count0, stp->count1, threshold, pAfsPrm->afs.coeff_shift);
+    }
+
+    m_status[iframe] = afs_frame_status(iframe, source(iframe)->frame, &pAfsPrm->afs, reverse, assume_shift, result_stat);
+}
+
+const uint8_t *NVEncFilterCpuAfs::map_filter(int iframe, int analyze) {
+    auto sp = stripe(iframe);
+    if (analyze <= 1) {
+        return sp->map.data();
+    }
+    const int width = m_pParam->frameIn.width;
+    const int height = m_pParam->frameIn.height;
+    const int tasks = rowTaskCount(height, m_rowTileMin);
+    alloc_tmp_buf(tasks);
+    run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+        //ext: 左右を拡張した入力の行、h1/h2: 横方向のフィルタの結果(3行のリングバッファ)、v1: 1回目の縦方向のフィルタの結果
+        uint8_t *buf = m_tmpBuf[task_id].data() + AFS_CPU_TMP_PAD;
+        uint8_t *ext = buf;
+        uint8_t *h1[3] = { buf + m_tmpPitch * 1, buf + m_tmpPitch * 2, buf + m_tmpPitch * 3 };
+        uint8_t *v1 = buf + m_tmpPitch * 4;
+        uint8_t *h2[3] = { buf + m_tmpPitch * 5, buf + m_tmpPitch * 6, buf + m_tmpPitch * 7 };
+        auto slot = [y_start](int j) { return (j - (y_start - 3)) % 3; };
+        for (int k = y_start - 2; k <= y_end + 1; k++) {
+            //CUDA版では4画素単位で左右端をclampして読み込むので、はみ出した部分は端の4画素となる
+            const uint8_t *src = sp->map.data() + clamp(k, 0, height - 1) * m_mapPitch;
+            memcpy(ext, src, width);
+            memcpy(ext - 4, src, 4);
+            memcpy(ext + width, src + width - 4, 4);
+            m_pKernel->afs_map_h[0](h1[slot(k)] - 1, ext - 1, width + 2);
+            if (k < y_start) {
+                continue;
+            }
+            //1回目の縦方向のフィルタは、上下にはみ出した行(-1, height)も計算する
+            const int j = k - 1;
+            m_pKernel->afs_map_v[0](v1 - 1, h1[slot(j - 1)] - 1, h1[slot(j)] - 1, h1[slot(j + 1)] - 1, width + 2);
+            m_pKernel->afs_map_h[1](h2[slot(j)], v1, width);
+            if (k >= y_start + 2) {
+                const int r = k - 2;
+                m_pKernel->afs_map_v[1](m_mapFiltered.data() + r * m_mapPitch, h2[slot(r - 1)], h2[slot(r)], h2[slot(r + 1)], width);
+            }
+        }
+    });
+    return m_mapFiltered.data();
+}
+
+void NVEncFilterCpuAfs::synthesize(FrameInfo *pOut, const FrameInfo *p0, const FrameInfo *p1, const uint8_t *sip, uint8_t status, const NVEncFilterParamAfs *pAfsPrm) {
+    if (pAfsPrm->afs.tune) {
+        synthesize_tune(pOut, sip, status);
+        return;
+    }
+    const int mode = std::min(pAfsPrm->afs.analyze, 4);
+    const int tb_order = pAfsPrm->afs.tb_order ? 1 : 0;
+    const bool shift0 = (status & AFS_FLAG_SHIFT0) != 0;
+    const int width = p0->width;
+    const int height = p0->height;
+    const bool yuv420 = RGY_CSP_CHROMA_FORMAT[p0->csp] == RGY_CHROMAFMT_YUV420;
+    const int type_bits = (RGY_CSP_BIT_DEPTH[p0->csp] > 8) ? 16 : 8;
+    const int high = (type_bits > 8) ? 1 : 0;
+    const int pixel_size = high ? 2 : 1;
+    const int maxValue = (1 << type_bits) - 1;
+    //後のフィールドの行か
+    auto latter = [tb_order](int y) {
+        return ((y + tb_order + 1) & 1) != 0;
+    };
+    const FrameInfo planeSrc[2][3] = {
+        { getPlane(p0, RGY_PLANE_Y), getPlane(p0, RGY_PLANE_U), getPlane(p0, RGY_PLANE_V) },
+        { getPlane(p1, RGY_PLANE_Y), getPlane(p1, RGY_PLANE_U), getPlane(p1, RGY_PLANE_V) }
+    };
+    const FrameInfo planeDst[3] = { getPlane(pOut, RGY_PLANE_Y), getPlane(pOut, RGY_PLANE_U), getPlane(pOut, RGY_PLANE_V) };
+    const int planes_full = yuv420 ? 1 : 3; //輝度と同じ解像度のプレーンの数
+
+    if (mode == 0) {
+        //後のフィールドの行のみ、シフトしていれば前のフレームからコピーする
+        run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+            for (int y = y_start; y < y_end; y++) {
+                const int frame = (latter(y) && shift0) ? 1 : 0;
+                for (int i = 0; i < planes_full; i++) {
+                    memcpy(planeDst[i].ptr + y * planeDst[i].pitch, planeSrc[frame][i].ptr + y * planeSrc[frame][i].pitch, width * pixel_size);
+                }
+            }
+            if (yuv420) {
+                for (int y = (y_start + 1) >> 1; y < std::min((y_end + 1) >> 1, planeDst[1].height); y++) {
+                    const int frame = (latter(y) && shift0) ? 1 : 0;
+                    for (int i = 1; i < 3; i++) {
+                        memcpy(planeDst[i].ptr + y * planeDst[i].pitch, planeSrc[frame][i].ptr + y * planeSrc[frame][i].pitch, planeDst[i].width * pixel_size);
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    const int center = (mode == 4) ? 4 : 2;
+    const AfsCpuSynthOp ops[2] = { afs_cpu_synth_op(mode, shift0, false), afs_cpu_synth_op(mode, shift0, true) };
+    //上下端は折り返し (CUDA版のテクスチャのアドレスモードと同じ)
+    auto mirror = [height](int y) {
+        return (y < 0) ? -y : ((y >= height) ? 2 * (height - 1) - y : y);
+    };
+    run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+        for (int y = y_start; y < y_end; y++) {
+            const auto& op = ops[latter(y) ? 1 : 0];
+            for (int i = 0; i < planes_full; i++) {
+                const void *src[5];
+                for (int j = 0; j < 5; j++) {
+                    const auto& plane = planeSrc[op.src[j][0]][i];
+                    src[j] = plane.ptr + mirror(y + op.src[j][1] - center) * plane.pitch;
+                }
+                m_pKernel->afs_synth[high](planeDst[i].ptr + y * planeDst[i].pitch, op.op, src, sip + y * m_mapPitch, op.mask, width, maxValue);
+            }
+        }
+    });
+    if (!yuv420) {
+        return;
+    }
+
+    //YUV420の色差は、CUDA版と同様に輝度の4行(色差の2行)ごとに、
+    //フィールドごとに補間した色差を輝度の行の位置で合成し、それを色差の行の位置に戻す
+    const int uv_width = planeDst[1].width;
+    const int uv_height = planeDst[1].height;
+    const int uv_pitch_int = ALIGN(uv_width, 16);
+    const int pairs = (uv_height + 1) >> 1;
+    const int tileMin = std::max(m_rowTileMin >> 2, 1);
+    const int tasks = rowTaskCount(pairs, tileMin);
+    alloc_tmp_buf(tasks);
+    run_rows(pairs, tileMin, [&](int p_start, int p_end, int task_id) {
+        //縞の判定結果のない行(輝度の高さを超える行)の代わり
+        uint8_t *flag_none = m_tmpBuf[task_id].data();
+        memset(flag_none, 0, width);
+        //g: 補間した色差(フレームごとに16行のキャッシュ)、pr: 合成した4行
+        int32_t *bufInt = m_tmpBufInt[task_id].data();
+        int32_t *g[2][16], *pr[4];
+        for (int i = 0; i < 32; i++) {
+            g[i >> 4][i & 15] = bufInt + uv_pitch_int * i;
+        }
+        for (int i = 0; i < 4; i++) {
+            pr[i] = bufInt + uv_pitch_int * (32 + i);
+        }
+        for (int iplane = 1; iplane < 3; iplane++) {
+            int gtag[2][16];
+            std::fill(&gtag[0][0], &gtag[0][0] + 32, INT_MIN);
+            auto get_uv = [&](int frame, int k) {
+                const int islot = k & 15;
+                if (gtag[frame][islot] != k) {
+                    const auto& plane = planeSrc[frame][iplane];
+                    const int field_height = std::max(height >> 2, 1);
+                    const int iy = (k - 2) >> 2;
+                    const int row0 = 2 * clamp(iy + 0, 0, field_height - 1) + (k & 1);
+                    const int row1 = 2 * clamp(iy + 1, 0, field_height - 1) + (k & 1);
+                    m_pKernel->afs_get_uv[high](g[frame][islot], plane.ptr + row0 * plane.pitch, plane.ptr + row1 * plane.pitch,
+                        7 - 2 * (k & 3), uv_width, 0);
+                    gtag[frame][islot] = k;
+                }
+                return (const int32_t *)g[frame][islot];
+            };
+            const auto& dst = planeDst[iplane];
+            for (int ip = p_start; ip < p_end; ip++) {
+                for (int i = 0; i < 4; i++) {
+                    const int y = ip * 4 + i;
+                    const auto& op = ops[latter(y) ? 1 : 0];
+                    const int32_t *src[5];
+                    for (int j = 0; j < 5; j++) {
+                        src[j] = get_uv(op.src[j][0], y + op.src[j][1] - center);
+                    }
+                    m_pKernel->afs_synth_uv(pr[i], op.op, src, (y < height) ? sip + y * m_mapPitch : flag_none, op.mask, uv_width);
+                }
+                for (int i = 0; i < 2; i++) {
+                    const int y = ip * 2 + i;
+                    if (y >= uv_height) {
+                        break;
+                    }
+                    //偶数行は輝度の行0と2、奇数行は行1と3から
+                    m_pKernel->afs_synth_uv_out[high](dst.ptr + y * dst.pitch, pr[i], pr[i + 2], uv_width, i, maxValue);
+                }
+            }
+        }
+    });
+}
+
+void NVEncFilterCpuAfs::synthesize_tune(FrameInfo *pOut, const uint8_t *sip, uint8_t status) {
+    static const int YUY2_COLOR[4][3] = {
+        {  16,  128, 128 },
+        {  98,  128, 128 },
+        {  41,  240, 110 },
+        { 169,  166,  16 }
+    };
+    const int width = pOut->width;
+    const int height = pOut->height;
+    const bool yuv420 = RGY_CSP_CHROMA_FORMAT[pOut->csp] == RGY_CHROMAFMT_YUV420;
+    const int bit_depth = RGY_CSP_BIT_DEPTH[pOut->csp];
+    const bool high = bit_depth > 8;
+    const FrameInfo planeDst[3] = { getPlane(pOut, RGY_PLANE_Y), getPlane(pOut, RGY_PLANE_U), getPlane(pOut, RGY_PLANE_V) };
+    auto put = [high](const FrameInfo& plane, int x, int y, int value) {
+        if (high) {
+            ((uint16_t *)(plane.ptr + y * plane.pitch))[x] = (uint16_t)value;
+        } else {
+            (plane.ptr + y * plane.pitch)[x] = (uint8_t)value;
+        }
+    };
+    run_rows(height, m_rowTileMin, [&](int y_start, int y_end, int task_id) {
+        for (int y = y_start; y < y_end; y++) {
+            for (int x = 0; x < width; x++) {
+                const int c = afs_cpu_tune_color(sip[y * m_mapPitch + x], status);
+                put(planeDst[0], x, y, YUY2_COLOR[c][0] << (bit_depth - 8));
+                if (!yuv420) {
+                    put(planeDst[1], x, y, YUY2_COLOR[c][1] << (bit_depth - 8));
+                    put(planeDst[2], x, y, YUY2_COLOR[c][2] << (bit_depth - 8));
+                }
+            }
+        }
+        if (yuv420) {
+            for (int y = (y_start + 1) >> 1; y < std::min((y_end + 1) >> 1, planeDst[1].height); y++) {
+                for (int x = 0; x < planeDst[1].width; x++) {
+                    const uint8_t *sip0 = sip + (y * 2) * m_mapPitch + x * 2;
+                    const int c00 = afs_cpu_tune_color(sip0[0], status);
+                    const int c01 = afs_cpu_tune_color(sip0[1], status);
+                    const int c10 = afs_cpu_tune_color(sip0[m_mapPitch + 0], status);
+                    const int c11 = afs_cpu_tune_color(sip0[m_mapPitch + 1], status);
+                    for (int i = 1; i < 3; i++) {
+                        put(planeDst[i], x, y, ((YUY2_COLOR[c00][i] + YUY2_COLOR[c01][i] + YUY2_COLOR[c10][i] + YUY2_COLOR[c11][i] + 2) << (bit_depth - 8)) >> 2);
+                    }
+                }
+            }
+        }
+    });
+}
+
+void NVEncFilterCpuAfs::copy_frame(FrameInfo *pOut, const FrameInfo *p0) {
+    const int pixel_size = (RGY_CSP_BIT_DEPTH[p0->csp] > 8) ? 2 : 1;
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto planeSrc = getPlane(p0, plane);
+        auto planeDst = getPlane(pOut, plane);
+        for (int y = 0; y < planeSrc.height; y++) {
+            memcpy(planeDst.ptr + y * planeDst.pitch, planeSrc.ptr + y * planeSrc.pitch, planeSrc.width * pixel_size);
+        }
+    }
+}
+
+RGY_ERR NVEncFilterCpuAfs::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    //drain中に間引きで出力がないと、呼び出し側ではdrainが完了したと判断されてしまうので、
+    //出力があるか、すべて出力し終えるまで繰り返す (CUDA版と同じ)
+    do {
+        sts = proc_frame(pInputFrame, ppOutputFrames, pOutputFrameNum);
+    } while (sts == RGY_ERR_NONE
+        && pInputFrame->ptr == nullptr && *pOutputFrameNum == 0
+        && m_nFrame < m_nFramesInput);
+    return sts;
+}
+
+RGY_ERR NVEncFilterCpuAfs::proc_frame(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+
+    auto pAfsParam = std::dynamic_pointer_cast<NVEncFilterParamAfs>(m_pParam);
+    if (!pAfsParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+
+    const int iframe = m_nFramesInput;
+    if (pInputFrame->ptr == nullptr && m_nFrame >= iframe) {
+        //終了
+        *pOutputFrameNum = 0;
+        ppOutputFrames[0] = nullptr;
+        return sts;
+    } else if (pInputFrame->ptr != nullptr) {
+        //エラーチェック
+        if (m_pParam->frameOut.csp != m_pParam->frameIn.csp || pInputFrame->csp != m_pParam->frameIn.csp) {
+            AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+            return RGY_ERR_INVALID_PARAM;
+        }
+        //sourceキャッシュにコピー
+        sts = m_source[iframe & (AFS_SOURCE_CACHE_NUM - 1)]->copyFrame(pInputFrame);
+        if (sts != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to add frame to source buffer: %s.\n"), get_err_mes(sts));
+            return sts;
+        }
+        m_nFramesInput++;
+        if (iframe == 0) {
+            // scan_frame(p1 = -2, p0 = -1)のscan_frameも必要
+            scan_frame(iframe - 1, false, pAfsParam.get());
+        }
+        scan_frame(iframe, true, pAfsParam.get());
+    }
+
+    if (iframe >= 5) {
+        int reverse[4] = { 0 }, assume_shift[4] = { 0 }, result_stat[4] = { 0 };
+        analyze_frame(iframe - 5, pAfsParam.get(), reverse, assume_shift, result_stat);
+    }
+    static const int preread_len = 3;
+    //十分な数のフレームがたまった、あるいはdrainモードならフレームを出力
+    //(CUDA版と同じフレーム数の遅延とする)
+    if (iframe >= (5+preread_len+1) || pInputFrame->ptr == nullptr) {
+        int reverse[4] = { 0 }, assume_shift[4] = { 0 }, result_stat[4] = { 0 };
+
+        //m_streamsts.get_durationを呼ぶには、3フレーム先までstatusをセットする必要がある
+        for (int i = preread_len; i >= 0; i--) {
+            analyze_frame(m_nFrame + i, pAfsParam.get(), reverse, assume_shift, result_stat);
+        }
+
+        if (m_nFrame == 0) {
+            //m_nFrame == 0のときは、下記がセットされていない
+            for (int i = 0; i < preread_len; i++) {
+                if (m_streamsts.set_status(i, m_status[i], i, source(i)->frame.timestamp) != 0) {
+                    AddMessage(RGY_LOG_ERROR, _T("failed to set afs_status(%d).\n"), i);
+                    return RGY_ERR_INVALID_CALL;
+                }
+            }
+        }
+        {
+            auto timestamp = source(m_nFrame+preread_len)->frame.timestamp;
+            //読み込まれた範囲を超える部分のtimestampは外挿する
+            //こうしないと最終フレームのdurationが正しく計算されない
+            if (m_nFrame+preread_len >= m_nFramesInput) {
+                //1フレームの平均時間
+                auto inframe_avg_duration = (source(m_nFramesInput-1)->frame.timestamp + m_nFramesInput / 2) / m_nFramesInput;
+                //外挿するフレーム数をかけて足し込む
+                timestamp += (m_nFrame+preread_len - (m_nFramesInput-1)) * inframe_avg_duration;
+            }
+            if (m_streamsts.set_status(m_nFrame+preread_len, m_status[m_nFrame+preread_len], 0, timestamp) != 0) {
+                AddMessage(RGY_LOG_ERROR, _T("failed to set afs_status(%d).\n"), m_nFrame+preread_len);
+                return RGY_ERR_INVALID_CALL;
+            }
+        }
+        const auto afs_duration = m_streamsts.get_duration(m_nFrame);
+        if (afs_duration == afsStreamStatus::AFS_SSTS_DROP) {
+            //出力フレームなし
+            *pOutputFrameNum = 0;
+            ppOutputFrames[0] = nullptr;
+        } else if (afs_duration < 0) {
+            AddMessage(RGY_LOG_ERROR, _T("invalid call for m_streamsts.get_duration(%d).\n"), m_nFrame);
+            return RGY_ERR_INVALID_CALL;
+        } else {
+            //出力先のフレーム
+            *pOutputFrameNum = 1;
+            if (ppOutputFrames[0] == nullptr) {
+                auto pOutFrame = m_pFrameBuf[m_nFrameIdx].get();
+                ppOutputFrames[0] = &pOutFrame->frame;
+                m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+            }
+            auto pOutFrame = ppOutputFrames[0];
+
+            if (pAfsParam->afs.timecode) {
+                m_timecode.write(m_nPts, pAfsParam->outTimebase);
+            }
+
+            const auto pSource = source(m_nFrame);
+            pOutFrame->flags = pSource->frame.flags & (~(RGY_FRAME_FLAG_RFF | RGY_FRAME_FLAG_RFF_COPY | RGY_FRAME_FLAG_RFF_BFF | RGY_FRAME_FLAG_RFF_TFF));
+            pOutFrame->picstruct = RGY_PICSTRUCT_FRAME;
+            pOutFrame->duration = rational_rescale(afs_duration, pAfsParam->inTimebase, pAfsParam->outTimebase);
+            pOutFrame->timestamp = m_nPts;
+            m_nPts += pOutFrame->duration;
+
+            //出力するフレームを作成
+            get_stripe_info(m_nFrame, 1, pAfsParam.get());
+            const uint8_t *sip_filtered = map_filter(m_nFrame, pAfsParam->afs.analyze);
+            if (interlaced(pSource->frame) || pAfsParam->afs.tune) {
+                synthesize(pOutFrame, &pSource->frame, &source(m_nFrame-1)->frame, sip_filtered, m_status[m_nFrame], pAfsParam.get());
+            } else {
+                copy_frame(pOutFrame, &pSource->frame);
+            }
+        }
+
+        m_nFrame++;
+    } else {
+        //出力フレームなし
+        *pOutputFrameNum = 0;
+        ppOutputFrames[0] = nullptr;
+    }
+    return sts;
+}
+
+void NVEncFilterCpuAfs::close() {
+    m_nFrame = 0;
+    m_nFramesInput = 0;
+    m_pFrameBuf.clear();
+    for (auto& source : m_source) {
+        source.reset();
+    }
+    for (auto& scan : m_scan) {
+        scan.map.clear();
+        scan.status = 0;
+    }
+    for (auto& stripe : m_stripe) {
+        stripe.map.clear();
+        stripe.status = 0;
+    }
+    m_mapFiltered.clear();
+    m_status.clear();
+    m_timecode.close();
+    m_tmpBuf.clear();
+    m_tmpBufInt.clear();
+}
+
+//3:2プルダウンされたインタレ(TFF)の入力を作成する
+//横に動く縦縞を、フィルムのフレームごとに16画素ずつ動かす (縞の周期は128画素なので、フィルム8フレームで元に戻る)
+RGY_ERR afs_cpu_bench_make_input(vector<unique_ptr<NVEncCpuFrameBuf>>& input, RGY_CSP csp, int width, int height, int frames) {
+    //フレームごとの[トップフィールド, ボトムフィールド]のフィルムのフレーム番号
+    static const int TELECINE_FIELD[5][2] = { { 0, 0 }, { 1, 1 }, { 1, 2 }, { 2, 3 }, { 3, 3 } };
+    const bool yuv420 = RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV420;
+    const int shift = (RGY_CSP_BIT_DEPTH[csp] > 8) ? 8 : 0;
+    input.clear();
+    for (int i = 0; i < frames; i++) {
+        unique_ptr<NVEncCpuFrameBuf> frame(new NVEncCpuFrameBuf(width, height, csp));
+        auto sts = frame->alloc();
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        frame->frame.picstruct = RGY_PICSTRUCT_FRAME_TFF;
+        for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+            auto p = getPlane(&frame->frame, plane);
+            const int scale = (plane != RGY_PLANE_Y && yuv420) ? 2 : 1;
+            for (int y = 0; y < p.height; y++) {
+                const int film = (i / 5) * 4 + TELECINE_FIELD[i % 5][y & 1];
+                const int ly = y * scale;
+                for (int x = 0; x < p.width; x++) {
+                    const int lx = x * scale;
+                    int value = 0;
+                    if (ly >= height * 7 / 8) {
+                        //下端はフィールドごとに動くもの (インタレ解除の処理を通るように)
+                        const bool bar = ((lx - (i * 2 + (y & 1)) * 8) & 63) < 16;
+                        value = (plane == RGY_PLANE_Y) ? (bar ? 180 : 60) : (bar ? 144 : 112);
+                    } else if (ly < height / 4 || ly >= height * 3 / 4) {
+                        //上下は静止したグラデーション
+                        value = 32 + ((lx + ly) & 127) + ((plane == RGY_PLANE_Y) ? 0 : 32);
+                    } else {
+                        //動く縦縞 (合成の方法による差が出るよう、縦方向にも模様をつける)
+                        const bool bar = ((lx - film * 16) & 127) < 64;
+                        value = ((plane == RGY_PLANE_Y) ? (bar ? 200 : 40) : (bar ? 160 : 96)) + ((ly >> 2) & 7) * 4;
+                    }
+                    if (shift) {
+                        ((uint16_t *)(p.ptr + y * p.pitch))[x] = (uint16_t)((value << shift) | (x & 255));
+                    } else {
+                        (p.ptr + y * p.pitch)[x] = (uint8_t)value;
+                    }
+                }
+            }
+        }
+        input.push_back(std::move(frame));
+    }
+    return RGY_ERR_NONE;
+}
+
+struct AfsCpuBenchResult {
+    RGY_ERR err;
+    int framesOut;
+    double timeMs;
+    uint64_t hash;
+};
+
+static AfsCpuBenchResult afs_cpu_bench_run(const vector<unique_ptr<NVEncCpuFrameBuf>>& input, int frames, const VppAfs& afs, uint32_t simd, int rowTileMin) {
+    AfsCpuBenchResult result = { RGY_ERR_NONE, 0, 0.0, 0 };
+    const auto inFps = rgy_rational<int>(30000, 1001);
+    auto timebase = inFps.inv();
+    timebase *= rgy_rational<int>(1, 4);
+    VppParam vpp;
+    vpp.afs = afs;
+    vpp.afs.enable = true;
+    NVEncFilterCpuChain chain;
+    result.err = chain.init(input[0]->frame, sInputCrop({ 0 }), 0, 0, vpp, inFps, timebase, tstring(), input[0]->frame.csp, simd, nullptr);
+    if (result.err != RGY_ERR_NONE) {
+        return result;
+    }
+    auto filterAfs = dynamic_cast<NVEncFilterCpuAfs *>(chain.filters()[0].get());
+    if (filterAfs == nullptr) {
+        result.err = RGY_ERR_UNKNOWN;
+        return result;
+    }
+    filterAfs->setRowTileMin(rowTileMin);
+    uint64_t hash = 14695981039346656037ull;
+    vector<FrameInfo *> outputs;
+    auto addOutput = [&]() {
+        for (auto frame : outputs) {
+            hash = vpp_cpu_bench_hash(hash, frame);
+            for (const int64_t value : { frame->timestamp, frame->duration }) {
+                hash = (hash ^ (uint64_t)value) * 1099511628211ull;
+            }
+            result.framesOut++;
+        }
+    };
+    const auto timeStart = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; i++) {
+        //入力は使いまわし、タイムスタンプのみ設定する
+        FrameInfo frame = input[i % input.size()]->frame;
+        frame.timestamp = i * 4;
+        frame.duration = 4;
+        frame.inputFrameId = i;
+        result.err = chain.filter(&frame, outputs);
+        if (result.err != RGY_ERR_NONE) {
+            return result;
+        }
+        addOutput();
+    }
+    do {
+        result.err = chain.filter(nullptr, outputs);
+        if (result.err != RGY_ERR_NONE) {
+            return result;
+        }
+        addOutput();
+    } while (!outputs.empty());
+    result.timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+    //判定結果もハッシュに含める
+    for (int i = 0; i < frames; i++) {
+        hash = (hash ^ filterAfs->status(i)) * 1099511628211ull;
+    }
+    result.hash = hash;
+    return result;
+}
+
+int afs_cpu_bench(FILE *fp) {
+    static const int width = 1920;
+    static const int height = 1080;
+    static const int frames = 60;
+    const bool avx2 = (get_availableSIMD() & AVX2) == AVX2;
+    const std::pair<RGY_CSP, const char *> csps[] = {
+        { RGY_CSP_YV12,      "yv12" },
+        { RGY_CSP_YV12_16,   "yv12_16" },
+        { RGY_CSP_YUV444,    "yuv444" },
+    };
+    struct AfsCpuBenchCase {
+        const char *name;
+        int analyze;
+        bool tune, drop, smooth;
+    };
+    static const AfsCpuBenchCase benchCases[] = {
+        { "level0", 0, false, false, false },
+        { "level1", 1, false, false, false },
+        { "level2", 2, false, false, false },
+        { "level3", 3, false, false, false },
+        { "level4", 4, false, false, false },
+        { "level5", 5, false, false, false },
+        { "tune",   3, true,  false, false },
+        { "24fps",  3, false, true,  true  },
+    };
+    int ret = 0;
+    fprintf(fp, "csp,case,simd,tile,frames_in,frames_out,time_ms,fps,hash,verify\n");
+    for (const auto& csp : csps) {
+        vector<unique_ptr<NVEncCpuFrameBuf>> input;
+        if (afs_cpu_bench_make_input(input, csp.first, width, height, 10) != RGY_ERR_NONE) {
+            fprintf(fp, "%s,-,-,-,0,0,0.0,0.0,0,NG\n", csp.second);
+            ret |= 1;
+            continue;
+        }
+        for (const auto& benchCase : benchCases) {
+            //YUV444は代表的なものだけ
+            if (csp.first == RGY_CSP_YUV444 && strcmp(benchCase.name, "level3") != 0 && strcmp(benchCase.name, "level4") != 0) {
+                continue;
+            }
+            VppAfs afs;
+            afs.analyze = benchCase.analyze;
+            afs.tune = benchCase.tune;
+            afs.drop = benchCase.drop;
+            afs.smooth = benchCase.smooth;
+            //C版(1タスク)を基準として、AVX2版とタイルの大きさを変えた場合の出力が一致するか確認する
+            struct {
+                uint32_t simd;
+                int rowTileMin;
+                const char *simdName;
+            } runs[] = {
+                { NONE, height, "c" },
+                { AVX2, 64, "avx2" },
+                { AVX2, 16, "avx2" },
+            };
+            uint64_t hashRef = 0;
+            for (int irun = 0; irun < _countof(runs); irun++) {
+                if (runs[irun].simd != NONE && !avx2) {
+                    break;
+                }
+                const auto result = afs_cpu_bench_run(input, frames, afs, runs[irun].simd, runs[irun].rowTileMin);
+                if (irun == 0) {
+                    hashRef = result.hash;
+                }
+                const bool ok = result.err == RGY_ERR_NONE && result.framesOut > 0 && result.hash == hashRef;
+                fprintf(fp, "%s,%s,%s,%d,%d,%d,%.1f,%.1f,%016llx,%s\n", csp.second, benchCase.name, runs[irun].simdName, runs[irun].rowTileMin,
+                    frames, result.framesOut, result.timeMs, frames * 1000.0 / std::max(result.timeMs, 0.001),
+                    (unsigned long long)result.hash, ok ? "OK" : "NG");
+                ret |= ok ? 0 : 1;
+            }
+        }
+    }
+    return ret;
+}
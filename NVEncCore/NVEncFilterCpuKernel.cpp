@@ -0,0 +1,508 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include "rgy_simd.h"
+#include "rgy_util.h"
+#include "NVEncFilterCpuKernel.h"
+
+template<typename TypeOut, typename TypeIn>
+static inline TypeOut bit_depth_conv(TypeIn x, int shift) {
+    return (TypeOut)((shift >= 0) ? ((int)x << shift) : ((int)x >> (-shift)));
+}
+
+template<typename TypeOut, typename TypeIn>
+static void plane_copy_c(void *dst, int dstPitch, const void *src, int srcPitch, int width, int y_start, int y_end, int shift) {
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDst = (TypeOut *)((uint8_t *)dst + y * dstPitch);
+        const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + y * srcPitch);
+        if (sizeof(TypeOut) == sizeof(TypeIn) && shift == 0) {
+            memcpy(ptrDst, ptrSrc, width * sizeof(TypeIn));
+            continue;
+        }
+        for (int x = 0; x < width; x++) {
+            ptrDst[x] = bit_depth_conv<TypeOut>(ptrSrc[x], shift);
+        }
+    }
+}
+
+template<typename TypeOut, typename TypeIn>
+static void split_uv_c(void *dstU, void *dstV, int dstPitch, const void *src, int srcPitch, int uvWidth, int y_start, int y_end, int shift) {
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDstU = (TypeOut *)((uint8_t *)dstU + y * dstPitch);
+        TypeOut *ptrDstV = (TypeOut *)((uint8_t *)dstV + y * dstPitch);
+        const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + y * srcPitch);
+        for (int x = 0; x < uvWidth; x++) {
+            ptrDstU[x] = bit_depth_conv<TypeOut>(ptrSrc[2 * x + 0], shift);
+            ptrDstV[x] = bit_depth_conv<TypeOut>(ptrSrc[2 * x + 1], shift);
+        }
+    }
+}
+
+template<typename TypeOut, typename TypeIn>
+static void merge_uv_c(void *dst, int dstPitch, const void *srcU, const void *srcV, int srcPitch, int uvWidth, int y_start, int y_end, int shift) {
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDst = (TypeOut *)((uint8_t *)dst + y * dstPitch);
+        const TypeIn *ptrSrcU = (const TypeIn *)((const uint8_t *)srcU + y * srcPitch);
+        const TypeIn *ptrSrcV = (const TypeIn *)((const uint8_t *)srcV + y * srcPitch);
+        for (int x = 0; x < uvWidth; x++) {
+            ptrDst[2 * x + 0] = bit_depth_conv<TypeOut>(ptrSrcU[x], shift);
+            ptrDst[2 * x + 1] = bit_depth_conv<TypeOut>(ptrSrcV[x], shift);
+        }
+    }
+}
+
+template<typename TypeIn>
+static void conv_v_c(float *dst, const void *src, int width, const int *rows, const float *weight, int taps) {
+    for (int x = 0; x < width; x++) {
+        float sum = 0.0f;
+        for (int i = 0; i < taps; i++) {
+            const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + rows[i]);
+            sum += weight[i] * (float)ptrSrc[x];
+        }
+        dst[x] = sum;
+    }
+}
+
+template<typename TypeOut>
+static void resize_h_c(void *dst, const float *src, int width, const int *index, const float *weight, int taps, int stride, float scale, float maxValue) {
+    TypeOut *ptrDst = (TypeOut *)dst;
+    for (int x = 0; x < width; x++) {
+        float sum = 0.0f;
+        for (int i = 0; i < taps; i++) {
+            sum += weight[i * stride + x] * src[index[i * stride + x]];
+        }
+        const float pixel = std::min(std::max(sum * scale, 0.0f), maxValue);
+        ptrDst[x] = (TypeOut)pixel;
+    }
+}
+
+template<typename Type>
+static void unsharp_h_c(void *dst, const float *src, const void *center, int width, const float *gauss, int radius,
+    float scale, float weight, float threshold, float outScale) {
+    Type *ptrDst = (Type *)dst;
+    const Type *ptrCenter = (const Type *)center;
+    for (int x = 0; x < width; x++) {
+        float sum = 0.0f;
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            sum += gauss[i] * src[x + i - radius];
+        }
+        float pixel = (float)ptrCenter[x] * scale;
+        const float diff = pixel - sum * scale;
+        if (std::abs(diff) >= threshold) {
+            pixel += weight * diff;
+        }
+        pixel = std::min(std::max(pixel, 0.0f), 1.0f - FLT_EPSILON);
+        ptrDst[x] = (Type)(pixel * outScale);
+    }
+}
+
+template<typename Type>
+static void tweak_uv_c(void *u, void *v, int pitch, int width, int y_start, int y_end,
+    float saturation, float hue_sin, float hue_cos, int bit_depth) {
+    const float inv = 1.0f / (float)(1 << bit_depth);
+    const float mul = (float)(1 << bit_depth);
+    const int maxValue = (1 << bit_depth) - 1;
+    for (int y = y_start; y < y_end; y++) {
+        Type *ptrU = (Type *)((uint8_t *)u + y * pitch);
+        Type *ptrV = (Type *)((uint8_t *)v + y * pitch);
+        for (int x = 0; x < width; x++) {
+            float u0 = (float)ptrU[x] * inv;
+            float v0 = (float)ptrV[x] * inv;
+            u0 = saturation * (u0 - 0.5f) + 0.5f;
+            v0 = saturation * (v0 - 0.5f) + 0.5f;
+            const float u1 = ((hue_cos * (u0 - 0.5f)) - (hue_sin * (v0 - 0.5f))) + 0.5f;
+            const float v1 = ((hue_sin * (u0 - 0.5f)) + (hue_cos * (v0 - 0.5f))) + 0.5f;
+            ptrU[x] = (Type)clamp((int)(u1 * mul), 0, maxValue);
+            ptrV[x] = (Type)clamp((int)(v1 * mul), 0, maxValue);
+        }
+    }
+}
+
+//afs: 動き(0x08/0x80)の判定
+template<typename Type>
+static inline uint8_t afs_analyze_motion(Type p0, Type p1, const int *thre) {
+    const int diff = std::abs((int)p0 - (int)p1);
+    return (uint8_t)(((diff < thre[0]) ? 0x08 : 0x00) | ((diff < thre[1]) ? 0x80 : 0x00));
+}
+
+//afs: 縞の判定 (sign: a >= b、deint/shift: |a - b|が閾値を超える)
+template<typename Type>
+static inline uint8_t afs_analyze_stripe(Type a, Type b, uint8_t flag_sign, uint8_t flag_deint, uint8_t flag_shift, const int *thre) {
+    const int diff = std::abs((int)a - (int)b);
+    return (uint8_t)(((a >= b) ? flag_sign : 0x00) | ((diff > thre[2]) ? flag_deint : 0x00) | ((diff > thre[3]) ? flag_shift : 0x00));
+}
+
+template<typename Type>
+static void afs_analyze_c(uint8_t *dst, const void *p0, const void *p0m, const void *p1, const void *p1m,
+    int width, int stripe, int swap, const int *thre) {
+    const Type *ptrP0 = (const Type *)p0;
+    const Type *ptrP0m = (const Type *)p0m;
+    const Type *ptrP1 = (const Type *)p1;
+    const Type *ptrP1m = (const Type *)p1m;
+    for (int x = 0; x < width; x++) {
+        uint8_t flag = afs_analyze_motion(ptrP0[x], ptrP1[x], thre);
+        if (stripe) {
+            flag |= afs_analyze_stripe(ptrP0[x], ptrP0m[x], 0x40, 0x10, 0x20, thre);
+            flag |= (swap) ? afs_analyze_stripe(ptrP0m[x], ptrP1[x], 0x04, 0x01, 0x02, thre)
+                           : afs_analyze_stripe(ptrP1m[x], ptrP0[x], 0x04, 0x01, 0x02, thre);
+        }
+        dst[x] = flag;
+    }
+}
+
+template<typename Type>
+static void afs_get_uv_c(int32_t *dst, const void *src0, const void *src1, int beta, int srcWidth, int lumaRes) {
+    const Type *ptrSrc0 = (const Type *)src0;
+    const Type *ptrSrc1 = (const Type *)src1;
+    auto v = [=](int x) {
+        return (8 - beta) * (int)ptrSrc0[x] + beta * (int)ptrSrc1[x];
+    };
+    for (int x = 0; x < srcWidth; x++) {
+        const int v0 = v(x);
+        if (lumaRes) {
+            dst[2 * x + 0] = v0 * 2;
+            dst[2 * x + 1] = v0 + v(std::min(x + 1, srcWidth - 1));
+        } else {
+            dst[x] = v0 * 2;
+        }
+    }
+}
+
+//afs: 判定フラグの生成に使用する縞のカウント (符号の反転しない間は加算を続ける)
+static inline void afs_count_flags(uint8_t& count_deint, uint8_t& count_shift, uint8_t dat0, uint8_t dat1) {
+    uint8_t mask = (dat0 ^ dat1) & 0x44;
+    mask |= (uint8_t)(mask << 1);
+    mask |= (uint8_t)(mask >> 2);
+    count_deint &= mask;
+    count_shift &= mask;
+    count_deint += dat0 & 0x11;
+    count_shift += dat0 & 0x22;
+}
+
+static inline uint8_t afs_generate_flags(const uint8_t *const *f, int x) {
+    uint8_t count_deint = 0;
+    uint8_t count_shift = f[0][x] & 0x22;
+    //1行目はシフトの縞のみ
+    count_shift &= ((f[1][x] ^ f[0][x]) & 0x44) >> 1;
+    count_deint = f[1][x] & 0x11;
+    count_shift += f[1][x] & 0x22;
+    afs_count_flags(count_deint, count_shift, f[2][x], f[1][x]);
+    afs_count_flags(count_deint, count_shift, f[3][x], f[2][x]);
+    uint8_t result = (f[3][x] & 0x88) >> 1;
+    result |= ((count_deint & 0x70) > 0x20) ? 0x01 : 0x00;
+    result |= ((count_shift & 0xe0) > 0x60) ? 0x10 : 0x00;
+    result |= ((count_deint & 0x07) > 0x02) ? 0x02 : 0x00;
+    result |= ((count_shift & 0x0e) > 0x06) ? 0x20 : 0x00;
+    return result;
+}
+
+static void afs_gen_flags_c(uint8_t *m0, uint8_t *m1, const uint8_t *const *fy, const uint8_t *const *fu, const uint8_t *const *fv, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t y = afs_generate_flags(fy, x);
+        const uint8_t u = afs_generate_flags(fu, x);
+        const uint8_t v = afs_generate_flags(fv, x);
+        m1[x] = (y | u | v) & 0x33;
+        m0[x] = (y & u & v & 0xcc) | m1[x];
+    }
+}
+
+static int afs_output_c(uint8_t *dst, const uint8_t *const *m0, const uint8_t *m1, int width, int count_start, int count_end) {
+    int count = 0;
+    for (int x = 0; x < width; x++) {
+        dst[x] = (m1[x] & 0x30) | ((m0[1][x] | m0[2][x] | m0[3][x]) & 0x33) | m0[0][x];
+    }
+    for (int x = count_start; x < count_end; x++) {
+        count += (dst[x] & 0x40) ? 0 : 1;
+    }
+    return count;
+}
+
+static int afs_merge_scan_c(uint8_t *dst, const uint8_t *const *p0, const uint8_t *const *p1, int width,
+    uint8_t count_mask, int count_start, int count_end) {
+    int count = 0;
+    for (int x = 0; x < width; x++) {
+        const uint8_t m4 = (p0[0][x] | p0[2][x] | 0xf3) & p0[1][x];
+        const uint8_t m5 = (p1[0][x] | p1[2][x] | 0xf3) & p1[1][x];
+        dst[x] = (m4 & m5 & 0x44) | (~p0[1][x] & 0x33);
+    }
+    for (int x = count_start; x < count_end; x++) {
+        count += (dst[x] & count_mask) ? 0 : 1;
+    }
+    return count;
+}
+
+static void afs_map_h1_c(uint8_t *dst, const uint8_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t l = src[x - 1], c = src[x], r = src[x + 1];
+        dst[x] = c | ((l | r) & 0x03) | (l & r & 0x04);
+    }
+}
+
+static void afs_map_h2_c(uint8_t *dst, const uint8_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t l = src[x - 1], c = src[x], r = src[x + 1];
+        dst[x] = c & ((l & r) | 0xf8);
+    }
+}
+
+static void afs_map_v1_c(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, const uint8_t *src2, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = src1[x] | (src0[x] & src2[x] & 0x07);
+    }
+}
+
+static void afs_map_v2_c(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, const uint8_t *src2, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = src1[x] & ((src0[x] & src2[x]) | 0xf8);
+    }
+}
+
+template<typename Type>
+static void afs_synth_c(void *dst, int op, const void *const *src, const uint8_t *flag, uint8_t mask, int width, int maxValue) {
+    Type *ptrDst = (Type *)dst;
+    const Type *s0 = (const Type *)src[0];
+    const Type *s1 = (const Type *)src[1];
+    const Type *s2 = (const Type *)src[2];
+    const Type *s3 = (const Type *)src[3];
+    const Type *s4 = (const Type *)src[4];
+    for (int x = 0; x < width; x++) {
+        int pixel = 0;
+        switch (op) {
+        case CPU_AFS_SYN_INTER:
+            pixel = (s0[x] + s1[x] + s2[x] + s3[x] + 2) >> 2;
+            break;
+        case CPU_AFS_SYN_SPOT:
+            pixel = (((s0[x] + s1[x] + s2[x] + s3[x] + 2) >> 2) + s4[x] + 1) >> 1;
+            break;
+        case CPU_AFS_SYN_BLEND:
+            pixel = (flag[x] & mask) ? s1[x] : (s0[x] + 2 * s1[x] + s2[x] + 2) >> 2;
+            break;
+        case CPU_AFS_SYN_DEINT:
+            if (flag[x] & mask) {
+                pixel = s2[x];
+            } else {
+                const int tmp2 = s0[x] + s4[x];
+                const int tmp3 = s1[x] + s3[x];
+                pixel = clamp((tmp3 + ((tmp3 - tmp2) >> 3) + 1) >> 1, 0, maxValue);
+            }
+            break;
+        case CPU_AFS_SYN_COPY:
+        default:
+            pixel = s0[x];
+            break;
+        }
+        ptrDst[x] = (Type)pixel;
+    }
+}
+
+static void afs_synth_uv_c(int32_t *dst, int op, const int32_t *const *src, const uint8_t *flag, uint8_t mask, int width) {
+    const int32_t *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3], *s4 = src[4];
+    for (int x = 0; x < width; x++) {
+        int32_t pixel = 0;
+        switch (op) {
+        case CPU_AFS_SYN_INTER:
+            pixel = 4 * (s0[x] + s1[x] + s2[x] + s3[x]);
+            break;
+        case CPU_AFS_SYN_SPOT:
+            pixel = 2 * (s0[x] + s1[x] + s2[x] + s3[x]) + 8 * s4[x];
+            break;
+        case CPU_AFS_SYN_BLEND:
+            pixel = (flag[2 * x] & mask) ? 16 * s1[x] : 4 * (s0[x] + 2 * s1[x] + s2[x]);
+            break;
+        case CPU_AFS_SYN_DEINT:
+            pixel = (flag[2 * x] & mask) ? 16 * s2[x] : 9 * (s1[x] + s3[x]) - (s0[x] + s4[x]);
+            break;
+        case CPU_AFS_SYN_COPY:
+        default:
+            pixel = 16 * s0[x];
+            break;
+        }
+        dst[x] = pixel;
+    }
+}
+
+template<typename Type>
+static void afs_synth_uv_out_c(void *dst, const int32_t *p0, const int32_t *p2, int width, int odd, int maxValue) {
+    Type *ptrDst = (Type *)dst;
+    const int w0 = (odd) ? 1 : 3;
+    const int w2 = 4 - w0;
+    for (int x = 0; x < width; x++) {
+        ptrDst[x] = (Type)clamp((w0 * p0[x] + w2 * p2[x] + 512) >> 10, 0, maxValue);
+    }
+}
+
+static inline float nnedi_elliott(float x) {
+    return x / (1.0f + std::abs(x));
+}
+
+static void nnedi_prescreen_original_c(uint8_t *flag, const float *const *src, const float *weight, int width) {
+    const float *weight1 = weight + 4 * 49;
+    const float *weight2 = weight1 + 4 * 5;
+    for (int x = 0; x < width; x++) {
+        float t[8];
+        for (int n = 0; n < 4; n++) {
+            const float *w = weight + n * 48;
+            float sum = 0.0f;
+            for (int y = 0; y < 4; y++) {
+                const float *s = src[y] + x - 5;
+                for (int i = 0; i < 12; i++) {
+                    sum += s[i] * w[y * 12 + i];
+                }
+            }
+            t[n] = nnedi_elliott(sum + weight[4 * 48 + n]);
+        }
+        for (int n = 0; n < 4; n++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                sum += t[i] * weight1[n * 4 + i];
+            }
+            t[4 + n] = nnedi_elliott(sum + weight1[4 * 4 + n]);
+        }
+        float ret[4];
+        for (int n = 0; n < 4; n++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 8; i++) {
+                sum += t[i] * weight2[n * 8 + i];
+            }
+            ret[n] = sum + weight2[4 * 8 + n];
+        }
+        flag[x] = (std::max(ret[2], ret[3]) <= std::max(ret[0], ret[1])) ? 1 : 0;
+    }
+}
+
+static void nnedi_prescreen_new_c(uint8_t *flag, const float *const *src, const float *weight, int width) {
+    const float *weight1 = weight + 4 * 65;
+    for (int x = 0; x < width; x += 4) {
+        float t[4];
+        for (int n = 0; n < 4; n++) {
+            const float *w = weight + n * 64;
+            float sum = 0.0f;
+            for (int y = 0; y < 4; y++) {
+                const float *s = src[y] + x - 6;
+                for (int i = 0; i < 16; i++) {
+                    sum += s[i] * w[y * 16 + i];
+                }
+            }
+            t[n] = nnedi_elliott(sum + weight[4 * 64 + n]);
+        }
+        for (int n = 0; n < 4; n++) {
+            float sum = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                sum += t[i] * weight1[n * 4 + i];
+            }
+            flag[x + n] = (sum + weight1[4 * 4 + n] > 0.0f) ? 1 : 0;
+        }
+    }
+}
+
+static void nnedi_predict_c(float *dst, const float *const *src, const int *xlist, int count, const float *weight, int nns, int nnx, int nny) {
+    const int nnxy = nnx * nny;
+    const float invNnxy = 1.0f / (float)nnxy;
+    const float *weightOffset = weight + nns * 2 * nnxy;
+    for (int i = 0; i < count; i++) {
+        const int x = xlist[i] - (nnx / 2 - 1);
+        //平均と標準偏差
+        float sum = 0.0f, sumsq = 0.0f;
+        for (int y = 0; y < nny; y++) {
+            for (int ix = 0; ix < nnx; ix++) {
+                const float s = src[y][x + ix];
+                sum += s;
+                sumsq += s * s;
+            }
+        }
+        const float mean = sum * invNnxy;
+        const float var = sumsq * invNnxy - mean * mean;
+        float stddev = 0.0f, invStddev = 0.0f;
+        if (var > FLT_EPSILON) {
+            stddev = std::sqrt(var);
+            invStddev = 1.0f / stddev;
+        }
+        float wsum = 0.0f, vsum = 0.0f;
+        for (int iw = 0; iw < nns; iw += 8) {
+            const float *w = weight + iw * 2 * nnxy;
+            float sum0[8] = { 0.0f }, sum1[8] = { 0.0f };
+            for (int y = 0; y < nny; y++) {
+                for (int ix = 0; ix < nnx; ix++, w += 16) {
+                    const float s = src[y][x + ix];
+                    for (int j = 0; j < 8; j++) {
+                        sum0[j] += s * w[j];
+                        sum1[j] += s * w[8 + j];
+                    }
+                }
+            }
+            const float *wo = weightOffset + iw * 2;
+            for (int j = 0; j < 8; j++) {
+                const float ret0 = std::exp(clamp(sum0[j] * invStddev + wo[j], -80.0f, 80.0f));
+                const float ret1 = sum1[j] * invStddev + wo[8 + j];
+                wsum += ret0;
+                vsum += ret0 * nnedi_elliott(ret1);
+            }
+        }
+        float ret = mean;
+        if (wsum > 1e-10f) {
+            ret += ((5.0f * vsum) / wsum) * stddev;
+        }
+        dst[i] += ret;
+    }
+}
+
+const NVEncCpuFilterKernel CPU_FILTER_KERNEL_C = {
+    _T("c"), NONE,
+    { { plane_copy_c<uint8_t,  uint8_t>,  plane_copy_c<uint16_t, uint8_t>  },
+      { plane_copy_c<uint8_t,  uint16_t>, plane_copy_c<uint16_t, uint16_t> } },
+    { { split_uv_c<uint8_t,  uint8_t>,  split_uv_c<uint16_t, uint8_t>  },
+      { split_uv_c<uint8_t,  uint16_t>, split_uv_c<uint16_t, uint16_t> } },
+    { { merge_uv_c<uint8_t,  uint8_t>,  merge_uv_c<uint16_t, uint8_t>  },
+      { merge_uv_c<uint8_t,  uint16_t>, merge_uv_c<uint16_t, uint16_t> } },
+    { conv_v_c<uint8_t>, conv_v_c<uint16_t> },
+    { resize_h_c<uint8_t>, resize_h_c<uint16_t> },
+    { unsharp_h_c<uint8_t>, unsharp_h_c<uint16_t> },
+    { tweak_uv_c<uint8_t>, tweak_uv_c<uint16_t> },
+    { afs_analyze_c<uint8_t>, afs_analyze_c<uint16_t>, afs_analyze_c<int32_t> },
+    { afs_get_uv_c<uint8_t>, afs_get_uv_c<uint16_t> },
+    afs_gen_flags_c,
+    afs_output_c,
+    afs_merge_scan_c,
+    { afs_map_h1_c, afs_map_h2_c },
+    { afs_map_v1_c, afs_map_v2_c },
+    { afs_synth_c<uint8_t>, afs_synth_c<uint16_t> },
+    afs_synth_uv_c,
+    { afs_synth_uv_out_c<uint8_t>, afs_synth_uv_out_c<uint16_t> },
+    { nnedi_prescreen_original_c, nnedi_prescreen_new_c },
+    nnedi_predict_c,
+};
+
+const NVEncCpuFilterKernel *get_cpu_filter_kernel(uint32_t simd) {
+    if ((simd & AVX2) == AVX2) {
+        return &CPU_FILTER_KERNEL_AVX2;
+    }
+    return &CPU_FILTER_KERNEL_C;
+}
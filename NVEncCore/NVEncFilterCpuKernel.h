@@ -0,0 +1,155 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_FILTER_CPU_KERNEL_H__
+#define __NVENC_FILTER_CPU_KERNEL_H__
+
+#include <cstdint>
+#include "rgy_tchar.h"
+
+//CPU版フィルタ(NVEncFilterCpu)のカーネル
+//C版とAVX2版は同じ順序で演算を行い、出力がビット単位で一致するようにする
+//  - 積和はFMAを使わず、乗算→加算の順に行う
+//  - 浮動小数点→整数は切り捨て (CUDA版の(int)/(Type)キャストと同じ)
+//  - ただし、nnediはCUDA版と同様に誤差の範囲での一致とし、AVX2版ではFMAと近似のexpを使用する
+//行単位の処理は、呼び出し側でスレッドごとに[y_start, y_end)に分割して呼ぶ
+
+//コンパイラが乗算→加算をFMAにまとめると、C版とAVX2版やコンパイラごとに結果が変わるので、
+//CPU版フィルタのソースではFMAへの置き換えを無効にする (FMAを使用する箇所は明示的に記述する)
+//MSVCではプロジェクトの/fp:fastによる演算順序の変更も起きないよう、CPU版フィルタのソースは/fp:preciseでコンパイルする
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+//ビット深度の変換をしながらコピーする
+//shift: (出力のビット深度 - 入力のビット深度)、正なら左シフト、負なら右シフト
+//in16/out16: 入力/出力が16bit格納か
+typedef void (*funcCpuPlaneCopy)(void *dst, int dstPitch, const void *src, int srcPitch, int width, int y_start, int y_end, int shift);
+//NV12のUVを分離してYV12のU/Vにコピーする (uvWidth: 出力のU/Vの幅)
+typedef void (*funcCpuSplitUV)(void *dstU, void *dstV, int dstPitch, const void *src, int srcPitch, int uvWidth, int y_start, int y_end, int shift);
+//YV12のU/VをNV12のUVに結合する (uvWidth: 入力のU/Vの幅)
+typedef void (*funcCpuMergeUV)(void *dst, int dstPitch, const void *srcU, const void *srcV, int srcPitch, int uvWidth, int y_start, int y_end, int shift);
+
+//縦方向の畳み込み: dst[x] = Σ weight[i] * src[rows[i]][x] (x = 0 ～ width-1)
+//rowsはsrcからのバイトオフセット
+typedef void (*funcCpuConvV)(float *dst, const void *src, int width, const int *rows, const float *weight, int taps);
+//横方向の畳み込み (リサイズ): dst[x] = (Type)clamp(Σ weight[i*stride+x] * src[index[i*stride+x]] * scale, 0, maxValue)
+//index/weightはtaps x stride の配列 (strideは8の倍数)
+typedef void (*funcCpuResizeH)(void *dst, const float *src, int width, const int *index, const float *weight, int taps, int stride, float scale, float maxValue);
+//横方向のガウシアンとunsharpの適用
+//srcは左右にradius分の画素を拡張した縦方向の畳み込みの結果 (src[-radius] ～ src[width+radius-1]が有効)
+//center: 元の画素、scale: 正規化の係数 (1/(2^bit-1))、threshold/weightはCUDA版と同じ
+typedef void (*funcCpuUnsharpH)(void *dst, const float *src, const void *center, int width, const float *gauss, int radius,
+    float scale, float weight, float threshold, float outScale);
+//彩度/色相の調整 (U/Vを同時に処理)
+typedef void (*funcCpuTweakUV)(void *u, void *v, int pitch, int width, int y_start, int y_end,
+    float saturation, float hue_sin, float hue_cos, int bit_depth);
+
+//afs: 1行分の動き・縞の解析 (輝度/YUV444の色差はType=uint8_t/uint16_t、YUV420の色差はafs_get_uvの出力(int32_t))
+//p0/p0m: 現フレームの行k/行k-1、p1/p1m: 前フレームの行k/行k-1
+//stripe: 縞の解析を行うか (k >= 1)、swap: シフトの縞を(p0m, p1)で判定するか ((k & 1) == tb_order)、そうでなければ(p1m, p0)
+//thre: [0]動き(0x08)、[1]動き(シフト, 0x80)、[2]縞(deint)、[3]縞(shift) の閾値
+typedef void (*funcCpuAfsAnalyze)(uint8_t *dst, const void *p0, const void *p0m, const void *p1, const void *p1m,
+    int width, int stripe, int swap, const int *thre);
+//afs: YUV420の色差のフィールドを縦方向に補間し、16倍の値を出力する
+//src0/src1: フィールドの行a/a+1 (v = (8-beta)*src0 + beta*src1)、srcWidth: 色差の幅
+//lumaRes: 輝度の解像度で出力するか (奇数位置は右隣との平均)、そうでなければ色差の解像度で出力する
+typedef void (*funcCpuAfsGetUV)(int32_t *dst, const void *src0, const void *src1, int beta, int srcWidth, int lumaRes);
+//afs: 3プレーンの解析結果 F(k-3) ～ F(k) (fy[i] = F(k-3+i)) から判定フラグを生成してマージする
+//m0: 動き(0xcc)は論理積、縞(0x33)は論理和、m1: 縞(0x33)の論理和
+typedef void (*funcCpuAfsGenFlags)(uint8_t *m0, uint8_t *m1, const uint8_t *const *fy, const uint8_t *const *fu, const uint8_t *const *fv, int width);
+//afs: 行r ～ r+3のm0 (m0[i])と行r+4のm1から行rの解析結果を出力し、[count_start, count_end)の動きのある画素(0x40が0)の数を返す
+typedef int (*funcCpuAfsOutput)(uint8_t *dst, const uint8_t *const *m0, const uint8_t *m1, int width, int count_start, int count_end);
+//afs: 2フレームの解析結果をマージし、[count_start, count_end)の縞の画素((dst & count_mask) == 0)の数を返す
+//p0/p1: 行r-1, r, r+1 (上下端はクランプ済み)
+typedef int (*funcCpuAfsMergeScan)(uint8_t *dst, const uint8_t *const *p0, const uint8_t *const *p1, int width,
+    uint8_t count_mask, int count_start, int count_end);
+//afs: 縞の判定結果の横方向のフィルタ (src[-1]、src[width]も参照する)
+typedef void (*funcCpuAfsMapFilterH)(uint8_t *dst, const uint8_t *src, int width);
+//afs: 縞の判定結果の縦方向のフィルタ (src0/src1/src2: 行r-1, r, r+1)
+typedef void (*funcCpuAfsMapFilterV)(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, const uint8_t *src2, int width);
+
+//afsの合成の方法
+enum {
+    CPU_AFS_SYN_COPY = 0, //src[0]
+    CPU_AFS_SYN_INTER,    //(src[0] + src[1] + src[2] + src[3]) / 4
+    CPU_AFS_SYN_SPOT,     //((src[0] + src[1] + src[2] + src[3]) / 4 + src[4]) / 2
+    CPU_AFS_SYN_BLEND,    //(flag & mask) ? src[1] : (src[0] + 2 * src[1] + src[2]) / 4
+    CPU_AFS_SYN_DEINT,    //(flag & mask) ? src[2] : src[0], src[1], src[3], src[4]からの補間
+};
+//afs: 1行分の合成 (op: CPU_AFS_SYN_*、flag: 縞の判定結果、maxValue: 出力の最大値)
+typedef void (*funcCpuAfsSynth)(void *dst, int op, const void *const *src, const uint8_t *flag, uint8_t mask, int width, int maxValue);
+//afs: YUV420の色差の合成 (src: afs_get_uvの出力(16倍)、出力は256倍の値、flagは2画素おきに参照する)
+typedef void (*funcCpuAfsSynthUV)(int32_t *dst, int op, const int32_t *const *src, const uint8_t *flag, uint8_t mask, int width);
+//afs: 合成した色差(256倍)の2行p0/p2から、YUV420の色差の1行を出力する (odd: 奇数行か)
+typedef void (*funcCpuAfsSynthUVOut)(void *dst, const int32_t *p0, const int32_t *p2, int width, int odd, int maxValue);
+
+//nnedi: prescreenerで、x = 0 ～ width-1 を補間のみで済ませてよいか判定する (flag[x] = 1なら補間のみ)
+//src[0] ～ src[3]: 参照するフィールドの4行 (s = 画素値 / 最大値 * 256、左右は端の画素で拡張済み)
+//weight: nnedi_set_weight0の出力 (original: [x-5, x+6]を参照、new: 4画素ごとに[x-6, x+9]を参照し、flagはALIGN(width, 4)まで出力する)
+typedef void (*funcCpuNnediPrescreen)(uint8_t *flag, const float *const *src, const float *weight, int width);
+//nnedi: predictorで、xlist[i]の位置の値(sの単位、平均を含む)を計算し、dst[i]に加算する (i = 0 ～ count-1)
+//src[0] ～ src[nny-1]: 参照するフィールドの行 (左右は端の画素で拡張済み)、[x-(nnx/2-1), x+nnx/2]を参照する
+//weight: NVEncFilterCpuNnediで並べ替えた重み ([nns/8][nnx*nny][2][8]、続いてオフセット[nns/8][2][8])
+typedef void (*funcCpuNnediPredict)(float *dst, const float *const *src, const int *xlist, int count, const float *weight, int nns, int nnx, int nny);
+
+struct NVEncCpuFilterKernel {
+    const TCHAR *name;
+    uint32_t simd;
+    funcCpuPlaneCopy plane_copy[2][2]; //[in16][out16]
+    funcCpuSplitUV   split_uv[2][2];   //[in16][out16]
+    funcCpuMergeUV   merge_uv[2][2];   //[in16][out16]
+    funcCpuConvV     conv_v[2];        //[in16]
+    funcCpuResizeH   resize_h[2];      //[out16]
+    funcCpuUnsharpH  unsharp_h[2];     //[16bit]
+    funcCpuTweakUV   tweak_uv[2];      //[16bit]
+    funcCpuAfsAnalyze    afs_analyze[3];      //[uint8_t, uint16_t, int32_t(YUV420の色差)]
+    funcCpuAfsGetUV      afs_get_uv[2];       //[16bit]
+    funcCpuAfsGenFlags   afs_gen_flags;
+    funcCpuAfsOutput     afs_output;
+    funcCpuAfsMergeScan  afs_merge_scan;
+    funcCpuAfsMapFilterH afs_map_h[2];        //[1回目(膨張), 2回目(収縮)]
+    funcCpuAfsMapFilterV afs_map_v[2];        //[1回目(膨張), 2回目(収縮)]
+    funcCpuAfsSynth      afs_synth[2];        //[16bit]
+    funcCpuAfsSynthUV    afs_synth_uv;
+    funcCpuAfsSynthUVOut afs_synth_uv_out[2]; //[16bit]
+    funcCpuNnediPrescreen nnedi_prescreen[2]; //[original, new]
+    funcCpuNnediPredict   nnedi_predict;
+};
+
+//simdで使用可能なうち、最も高速なカーネルを取得する
+const NVEncCpuFilterKernel *get_cpu_filter_kernel(uint32_t simd);
+
+extern const NVEncCpuFilterKernel CPU_FILTER_KERNEL_C;
+extern const NVEncCpuFilterKernel CPU_FILTER_KERNEL_AVX2;
+
+#endif //__NVENC_FILTER_CPU_KERNEL_H__
@@ -0,0 +1,930 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <immintrin.h>
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include "rgy_simd.h"
+#include "rgy_util.h"
+#include "NVEncFilterCpuKernel.h"
+
+//端数の処理では一時バッファにコピーしてから同じ命令で処理し、C版と結果が一致するようにする
+
+template<typename Type>
+static __forceinline __m256 load8_ps(const Type *ptr) {
+    if (sizeof(Type) == 1) {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)ptr)));
+    } else {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)ptr)));
+    }
+}
+
+template<typename Type>
+static __forceinline __m256 load8_ps(const Type *ptr, int n) {
+    if (n >= 8) {
+        return load8_ps(ptr);
+    }
+    alignas(32) Type buf[8] = { 0 };
+    memcpy(buf, ptr, n * sizeof(Type));
+    return load8_ps(buf);
+}
+
+//8つの32bit整数をTypeに変換して格納する (値はTypeの範囲内であること)
+template<typename Type>
+static __forceinline void store8_epi32(Type *ptr, __m256i y0, int n) {
+    __m128i x0 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(y0, y0), _MM_SHUFFLE(3, 1, 2, 0)));
+    alignas(16) Type buf[8];
+    Type *dst = (n >= 8) ? ptr : buf;
+    if (sizeof(Type) == 1) {
+        _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(x0, x0));
+    } else {
+        _mm_storeu_si128((__m128i *)dst, x0);
+    }
+    if (n < 8) {
+        memcpy(ptr, buf, n * sizeof(Type));
+    }
+}
+
+template<typename TypeOut, typename TypeIn>
+static void plane_copy_avx2(void *dst, int dstPitch, const void *src, int srcPitch, int width, int y_start, int y_end, int shift) {
+    const __m128i xShiftL = _mm_cvtsi32_si128(std::max(shift, 0));
+    const __m128i xShiftR = _mm_cvtsi32_si128(std::max(-shift, 0));
+    const __m256i yMask8 = _mm256_set1_epi16(0xff);
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDst = (TypeOut *)((uint8_t *)dst + y * dstPitch);
+        const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + y * srcPitch);
+        if (sizeof(TypeOut) == sizeof(TypeIn) && shift == 0) {
+            memcpy(ptrDst, ptrSrc, width * sizeof(TypeIn));
+            continue;
+        }
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m256i y0;
+            if (sizeof(TypeIn) == 1) {
+                y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(ptrSrc + x)));
+            } else {
+                y0 = _mm256_loadu_si256((const __m256i *)(ptrSrc + x));
+            }
+            y0 = _mm256_srl_epi16(_mm256_sll_epi16(y0, xShiftL), xShiftR);
+            if (sizeof(TypeOut) == 1) {
+                y0 = _mm256_and_si256(y0, yMask8);
+                y0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(y0, y0), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128((__m128i *)(ptrDst + x), _mm256_castsi256_si128(y0));
+            } else {
+                _mm256_storeu_si256((__m256i *)(ptrDst + x), y0);
+            }
+        }
+        for (; x < width; x++) {
+            ptrDst[x] = (TypeOut)((shift >= 0) ? ((int)ptrSrc[x] << shift) : ((int)ptrSrc[x] >> (-shift)));
+        }
+    }
+}
+
+template<typename TypeOut, typename TypeIn>
+static void split_uv_avx2(void *dstU, void *dstV, int dstPitch, const void *src, int srcPitch, int uvWidth, int y_start, int y_end, int shift) {
+    const __m128i xShiftL = _mm_cvtsi32_si128(std::max(shift, 0));
+    const __m128i xShiftR = _mm_cvtsi32_si128(std::max(-shift, 0));
+    const __m256i yMask8 = _mm256_set1_epi16(0xff);
+    //各レーン内で偶数番目(U)を前半に、奇数番目(V)を後半に集める
+    const __m256i yShuffle8 = _mm256_setr_epi8(
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    const __m256i yShuffle16 = _mm256_setr_epi8(
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDstU = (TypeOut *)((uint8_t *)dstU + y * dstPitch);
+        TypeOut *ptrDstV = (TypeOut *)((uint8_t *)dstV + y * dstPitch);
+        const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + y * srcPitch);
+        int x = 0;
+        for (; x + 16 <= uvWidth; x += 16) {
+            __m256i yU, yV;
+            if (sizeof(TypeIn) == 1) {
+                __m256i y0 = _mm256_loadu_si256((const __m256i *)(ptrSrc + x * 2));
+                y0 = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(y0, yShuffle8), _MM_SHUFFLE(3, 1, 2, 0));
+                yU = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(y0));
+                yV = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(y0, 1));
+            } else {
+                __m256i y0 = _mm256_loadu_si256((const __m256i *)(ptrSrc + x * 2 + 0));
+                __m256i y1 = _mm256_loadu_si256((const __m256i *)(ptrSrc + x * 2 + 16));
+                y0 = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(y0, yShuffle16), _MM_SHUFFLE(3, 1, 2, 0));
+                y1 = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(y1, yShuffle16), _MM_SHUFFLE(3, 1, 2, 0));
+                yU = _mm256_permute2x128_si256(y0, y1, 0x20);
+                yV = _mm256_permute2x128_si256(y0, y1, 0x31);
+            }
+            yU = _mm256_srl_epi16(_mm256_sll_epi16(yU, xShiftL), xShiftR);
+            yV = _mm256_srl_epi16(_mm256_sll_epi16(yV, xShiftL), xShiftR);
+            if (sizeof(TypeOut) == 1) {
+                __m256i y0 = _mm256_packus_epi16(_mm256_and_si256(yU, yMask8), _mm256_and_si256(yV, yMask8));
+                y0 = _mm256_permute4x64_epi64(y0, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128((__m128i *)(ptrDstU + x), _mm256_castsi256_si128(y0));
+                _mm_storeu_si128((__m128i *)(ptrDstV + x), _mm256_extracti128_si256(y0, 1));
+            } else {
+                _mm256_storeu_si256((__m256i *)(ptrDstU + x), yU);
+                _mm256_storeu_si256((__m256i *)(ptrDstV + x), yV);
+            }
+        }
+        for (; x < uvWidth; x++) {
+            ptrDstU[x] = (TypeOut)((shift >= 0) ? ((int)ptrSrc[2 * x + 0] << shift) : ((int)ptrSrc[2 * x + 0] >> (-shift)));
+            ptrDstV[x] = (TypeOut)((shift >= 0) ? ((int)ptrSrc[2 * x + 1] << shift) : ((int)ptrSrc[2 * x + 1] >> (-shift)));
+        }
+    }
+}
+
+template<typename TypeOut, typename TypeIn>
+static void merge_uv_avx2(void *dst, int dstPitch, const void *srcU, const void *srcV, int srcPitch, int uvWidth, int y_start, int y_end, int shift) {
+    const __m128i xShiftL = _mm_cvtsi32_si128(std::max(shift, 0));
+    const __m128i xShiftR = _mm_cvtsi32_si128(std::max(-shift, 0));
+    const __m256i yMask8 = _mm256_set1_epi16(0xff);
+    for (int y = y_start; y < y_end; y++) {
+        TypeOut *ptrDst = (TypeOut *)((uint8_t *)dst + y * dstPitch);
+        const TypeIn *ptrSrcU = (const TypeIn *)((const uint8_t *)srcU + y * srcPitch);
+        const TypeIn *ptrSrcV = (const TypeIn *)((const uint8_t *)srcV + y * srcPitch);
+        int x = 0;
+        for (; x + 16 <= uvWidth; x += 16) {
+            __m256i yU, yV;
+            if (sizeof(TypeIn) == 1) {
+                yU = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(ptrSrcU + x)));
+                yV = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(ptrSrcV + x)));
+            } else {
+                yU = _mm256_loadu_si256((const __m256i *)(ptrSrcU + x));
+                yV = _mm256_loadu_si256((const __m256i *)(ptrSrcV + x));
+            }
+            yU = _mm256_srl_epi16(_mm256_sll_epi16(yU, xShiftL), xShiftR);
+            yV = _mm256_srl_epi16(_mm256_sll_epi16(yV, xShiftL), xShiftR);
+            if (sizeof(TypeOut) == 1) {
+                //16bitの下位にU、上位にVを置くと、そのままNV12の並びになる
+                const __m256i y0 = _mm256_or_si256(_mm256_and_si256(yU, yMask8), _mm256_slli_epi16(yV, 8));
+                _mm256_storeu_si256((__m256i *)(ptrDst + x * 2), y0);
+            } else {
+                const __m256i y0 = _mm256_unpacklo_epi16(yU, yV);
+                const __m256i y1 = _mm256_unpackhi_epi16(yU, yV);
+                _mm256_storeu_si256((__m256i *)(ptrDst + x * 2 +  0), _mm256_permute2x128_si256(y0, y1, 0x20));
+                _mm256_storeu_si256((__m256i *)(ptrDst + x * 2 + 16), _mm256_permute2x128_si256(y0, y1, 0x31));
+            }
+        }
+        for (; x < uvWidth; x++) {
+            ptrDst[2 * x + 0] = (TypeOut)((shift >= 0) ? ((int)ptrSrcU[x] << shift) : ((int)ptrSrcU[x] >> (-shift)));
+            ptrDst[2 * x + 1] = (TypeOut)((shift >= 0) ? ((int)ptrSrcV[x] << shift) : ((int)ptrSrcV[x] >> (-shift)));
+        }
+    }
+}
+
+template<typename TypeIn>
+static void conv_v_avx2(float *dst, const void *src, int width, const int *rows, const float *weight, int taps) {
+    for (int x = 0; x < width; x += 8) {
+        const int n = std::min(width - x, 8);
+        __m256 ySum = _mm256_setzero_ps();
+        for (int i = 0; i < taps; i++) {
+            const TypeIn *ptrSrc = (const TypeIn *)((const uint8_t *)src + rows[i]) + x;
+            ySum = _mm256_add_ps(ySum, _mm256_mul_ps(_mm256_set1_ps(weight[i]), load8_ps(ptrSrc, n)));
+        }
+        if (n >= 8) {
+            _mm256_storeu_ps(dst + x, ySum);
+        } else {
+            alignas(32) float buf[8];
+            _mm256_store_ps(buf, ySum);
+            memcpy(dst + x, buf, n * sizeof(float));
+        }
+    }
+}
+
+template<typename TypeOut>
+static void resize_h_avx2(void *dst, const float *src, int width, const int *index, const float *weight, int taps, int stride, float scale, float maxValue) {
+    TypeOut *ptrDst = (TypeOut *)dst;
+    const __m256 yScale = _mm256_set1_ps(scale);
+    const __m256 yMax = _mm256_set1_ps(maxValue);
+    //index/weightはstride(8の倍数)まで確保されているので、端数も8画素単位で読み込める
+    for (int x = 0; x < width; x += 8) {
+        __m256 ySum = _mm256_setzero_ps();
+        for (int i = 0; i < taps; i++) {
+            const __m256i yIdx = _mm256_loadu_si256((const __m256i *)(index + i * stride + x));
+            const __m256 yWeight = _mm256_loadu_ps(weight + i * stride + x);
+            ySum = _mm256_add_ps(ySum, _mm256_mul_ps(yWeight, _mm256_i32gather_ps(src, yIdx, 4)));
+        }
+        __m256 yPixel = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(ySum, yScale), _mm256_setzero_ps()), yMax);
+        store8_epi32(ptrDst + x, _mm256_cvttps_epi32(yPixel), width - x);
+    }
+}
+
+template<typename Type>
+static void unsharp_h_avx2(void *dst, const float *src, const void *center, int width, const float *gauss, int radius,
+    float scale, float weight, float threshold, float outScale) {
+    Type *ptrDst = (Type *)dst;
+    const Type *ptrCenter = (const Type *)center;
+    const __m256 yScale = _mm256_set1_ps(scale);
+    const __m256 yWeight = _mm256_set1_ps(weight);
+    const __m256 yThreshold = _mm256_set1_ps(threshold);
+    const __m256 yOutScale = _mm256_set1_ps(outScale);
+    const __m256 yMax = _mm256_set1_ps(1.0f - FLT_EPSILON);
+    const __m256 yAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    //srcは右端にさらに8画素分の余白があること
+    for (int x = 0; x < width; x += 8) {
+        const int n = std::min(width - x, 8);
+        __m256 ySum = _mm256_setzero_ps();
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            ySum = _mm256_add_ps(ySum, _mm256_mul_ps(_mm256_set1_ps(gauss[i]), _mm256_loadu_ps(src + x + i - radius)));
+        }
+        __m256 yPixel = _mm256_mul_ps(load8_ps(ptrCenter + x, n), yScale);
+        const __m256 yDiff = _mm256_sub_ps(yPixel, _mm256_mul_ps(ySum, yScale));
+        const __m256 yApply = _mm256_cmp_ps(_mm256_and_ps(yDiff, yAbsMask), yThreshold, _CMP_GE_OQ);
+        yPixel = _mm256_blendv_ps(yPixel, _mm256_add_ps(yPixel, _mm256_mul_ps(yWeight, yDiff)), yApply);
+        yPixel = _mm256_min_ps(_mm256_max_ps(yPixel, _mm256_setzero_ps()), yMax);
+        store8_epi32(ptrDst + x, _mm256_cvttps_epi32(_mm256_mul_ps(yPixel, yOutScale)), n);
+    }
+}
+
+template<typename Type>
+static void tweak_uv_avx2(void *u, void *v, int pitch, int width, int y_start, int y_end,
+    float saturation, float hue_sin, float hue_cos, int bit_depth) {
+    const __m256 yInv = _mm256_set1_ps(1.0f / (float)(1 << bit_depth));
+    const __m256 yMul = _mm256_set1_ps((float)(1 << bit_depth));
+    const __m256 yHalf = _mm256_set1_ps(0.5f);
+    const __m256 ySat = _mm256_set1_ps(saturation);
+    const __m256 yHueSin = _mm256_set1_ps(hue_sin);
+    const __m256 yHueCos = _mm256_set1_ps(hue_cos);
+    const __m256i yMaxValue = _mm256_set1_epi32((1 << bit_depth) - 1);
+    for (int y = y_start; y < y_end; y++) {
+        Type *ptrU = (Type *)((uint8_t *)u + y * pitch);
+        Type *ptrV = (Type *)((uint8_t *)v + y * pitch);
+        for (int x = 0; x < width; x += 8) {
+            const int n = std::min(width - x, 8);
+            __m256 yU0 = _mm256_mul_ps(load8_ps(ptrU + x, n), yInv);
+            __m256 yV0 = _mm256_mul_ps(load8_ps(ptrV + x, n), yInv);
+            yU0 = _mm256_add_ps(_mm256_mul_ps(ySat, _mm256_sub_ps(yU0, yHalf)), yHalf);
+            yV0 = _mm256_add_ps(_mm256_mul_ps(ySat, _mm256_sub_ps(yV0, yHalf)), yHalf);
+            const __m256 yU0c = _mm256_sub_ps(yU0, yHalf);
+            const __m256 yV0c = _mm256_sub_ps(yV0, yHalf);
+            const __m256 yU1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(yHueCos, yU0c), _mm256_mul_ps(yHueSin, yV0c)), yHalf);
+            const __m256 yV1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(yHueSin, yU0c), _mm256_mul_ps(yHueCos, yV0c)), yHalf);
+            __m256i yU = _mm256_cvttps_epi32(_mm256_mul_ps(yU1, yMul));
+            __m256i yV = _mm256_cvttps_epi32(_mm256_mul_ps(yV1, yMul));
+            yU = _mm256_min_epi32(_mm256_max_epi32(yU, _mm256_setzero_si256()), yMaxValue);
+            yV = _mm256_min_epi32(_mm256_max_epi32(yV, _mm256_setzero_si256()), yMaxValue);
+            store8_epi32(ptrU + x, yU, n);
+            store8_epi32(ptrV + x, yV, n);
+        }
+    }
+}
+
+//afs: bytes(32未満なら一時バッファ経由)の読み込み/書き込み
+static __forceinline __m256i afs_load_si256(const void *ptr, int bytes) {
+    if (bytes >= 32) {
+        return _mm256_loadu_si256((const __m256i *)ptr);
+    }
+    alignas(32) uint8_t buf[32] = { 0 };
+    memcpy(buf, ptr, bytes);
+    return _mm256_load_si256((const __m256i *)buf);
+}
+
+static __forceinline void afs_store_si256(void *ptr, __m256i y0, int bytes) {
+    if (bytes >= 32) {
+        _mm256_storeu_si256((__m256i *)ptr, y0);
+        return;
+    }
+    alignas(32) uint8_t buf[32];
+    _mm256_store_si256((__m256i *)buf, y0);
+    memcpy(ptr, buf, bytes);
+}
+
+//afs: 32バイトのうち、[start, end)の範囲で条件を満たすもの(cmpの0xff)を数える (start/endはブロック先頭からの位置)
+static __forceinline int afs_count_range(__m256i yCmp, int start, int end) {
+    start = clamp(start, 0, 32);
+    end = clamp(end, 0, 32);
+    if (start >= end) {
+        return 0;
+    }
+    const uint64_t range = ((end >= 32) ? 0xffffffffull : ((1ull << end) - 1)) & ~((1ull << start) - 1);
+    return (int)popcnt32((uint32_t)_mm256_movemask_epi8(yCmp) & (uint32_t)range);
+}
+
+//afs: 解析の各要素(Typeの大きさ)の比較、flagは要素の下位8bitに置く
+template<typename Type>
+static __forceinline __m256i afs_set1(int value) {
+    if (sizeof(Type) == 1) return _mm256_set1_epi8((char)value);
+    if (sizeof(Type) == 2) return _mm256_set1_epi16((short)value);
+    return _mm256_set1_epi32(value);
+}
+
+template<typename Type>
+static __forceinline __m256i afs_absdiff(__m256i a, __m256i b) {
+    if (sizeof(Type) == 1) return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+    if (sizeof(Type) == 2) return _mm256_or_si256(_mm256_subs_epu16(a, b), _mm256_subs_epu16(b, a));
+    return _mm256_abs_epi32(_mm256_sub_epi32(a, b));
+}
+
+//a > b なら flag
+template<typename Type>
+static __forceinline __m256i afs_flag_gt(__m256i a, __m256i b, __m256i flag) {
+    if (sizeof(Type) == 1) return _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(a, b), _mm256_setzero_si256()), flag);
+    if (sizeof(Type) == 2) return _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_subs_epu16(a, b), _mm256_setzero_si256()), flag);
+    return _mm256_and_si256(_mm256_cmpgt_epi32(a, b), flag);
+}
+
+//a >= b なら flag
+template<typename Type>
+static __forceinline __m256i afs_flag_ge(__m256i a, __m256i b, __m256i flag) {
+    if (sizeof(Type) == 1) return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a), flag);
+    if (sizeof(Type) == 2) return _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(a, b), a), flag);
+    return _mm256_andnot_si256(_mm256_cmpgt_epi32(b, a), flag);
+}
+
+template<typename Type>
+static __forceinline __m256i afs_analyze_stripe_avx2(__m256i a, __m256i b, int flag_sign, int flag_deint, int flag_shift, __m256i yThreDeint, __m256i yThreShift) {
+    const __m256i yDiff = afs_absdiff<Type>(a, b);
+    __m256i yFlag = afs_flag_ge<Type>(a, b, afs_set1<Type>(flag_sign));
+    yFlag = _mm256_or_si256(yFlag, afs_flag_gt<Type>(yDiff, yThreDeint, afs_set1<Type>(flag_deint)));
+    yFlag = _mm256_or_si256(yFlag, afs_flag_gt<Type>(yDiff, yThreShift, afs_set1<Type>(flag_shift)));
+    return yFlag;
+}
+
+template<typename Type>
+static void afs_analyze_avx2(uint8_t *dst, const void *p0, const void *p0m, const void *p1, const void *p1m,
+    int width, int stripe, int swap, const int *thre) {
+    const Type *ptrP0 = (const Type *)p0;
+    const Type *ptrP0m = (const Type *)p0m;
+    const Type *ptrP1 = (const Type *)p1;
+    const Type *ptrP1m = (const Type *)p1m;
+    const __m256i yThreMotion = afs_set1<Type>(thre[0]);
+    const __m256i yThreMotionShift = afs_set1<Type>(thre[1]);
+    const __m256i yThreDeint = afs_set1<Type>(thre[2]);
+    const __m256i yThreShift = afs_set1<Type>(thre[3]);
+    const int step = 32 / sizeof(Type);
+    for (int x = 0; x < width; x += step) {
+        const int n = std::min(width - x, step);
+        const int bytes = n * sizeof(Type);
+        const __m256i yP0 = afs_load_si256(ptrP0 + x, bytes);
+        const __m256i yP1 = afs_load_si256(ptrP1 + x, bytes);
+        const __m256i yDiff = afs_absdiff<Type>(yP0, yP1);
+        __m256i yFlag = _mm256_or_si256(
+            afs_flag_gt<Type>(yThreMotion, yDiff, afs_set1<Type>(0x08)),
+            afs_flag_gt<Type>(yThreMotionShift, yDiff, afs_set1<Type>(0x80)));
+        if (stripe) {
+            const __m256i yP0m = afs_load_si256(ptrP0m + x, bytes);
+            yFlag = _mm256_or_si256(yFlag, afs_analyze_stripe_avx2<Type>(yP0, yP0m, 0x40, 0x10, 0x20, yThreDeint, yThreShift));
+            if (swap) {
+                yFlag = _mm256_or_si256(yFlag, afs_analyze_stripe_avx2<Type>(yP0m, yP1, 0x04, 0x01, 0x02, yThreDeint, yThreShift));
+            } else {
+                const __m256i yP1m = afs_load_si256(ptrP1m + x, bytes);
+                yFlag = _mm256_or_si256(yFlag, afs_analyze_stripe_avx2<Type>(yP1m, yP0, 0x04, 0x01, 0x02, yThreDeint, yThreShift));
+            }
+        }
+        if (sizeof(Type) == 1) {
+            afs_store_si256(dst + x, yFlag, n);
+        } else if (sizeof(Type) == 2) {
+            const __m256i y0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(yFlag, yFlag), _MM_SHUFFLE(3, 1, 2, 0));
+            afs_store_si256(dst + x, y0, n);
+        } else {
+            store8_epi32(dst + x, yFlag, n);
+        }
+    }
+}
+
+template<typename Type>
+static void afs_get_uv_avx2(int32_t *dst, const void *src0, const void *src1, int beta, int srcWidth, int lumaRes) {
+    const Type *ptrSrc0 = (const Type *)src0;
+    const Type *ptrSrc1 = (const Type *)src1;
+    const __m256i yW0 = _mm256_set1_epi32(8 - beta);
+    const __m256i yW1 = _mm256_set1_epi32(beta);
+    auto load8_epi32 = [](const Type *ptr) {
+        return (sizeof(Type) == 1) ? _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)ptr))
+                                   : _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)ptr));
+    };
+    for (int x = 0; x < srcWidth; x += 8) {
+        const int n = std::min(srcWidth - x, 8);
+        //右隣(x+8)まで参照するので、右端は最後の画素を繰り返した一時バッファから読む
+        alignas(32) Type buf0[16], buf1[16];
+        const Type *s0 = ptrSrc0 + x;
+        const Type *s1 = ptrSrc1 + x;
+        if (x + 9 > srcWidth) {
+            for (int i = 0; i < 16; i++) {
+                buf0[i] = s0[std::min(i, n - 1)];
+                buf1[i] = s1[std::min(i, n - 1)];
+            }
+            s0 = buf0;
+            s1 = buf1;
+        }
+        const __m256i yV0 = _mm256_add_epi32(_mm256_mullo_epi32(load8_epi32(s0), yW0), _mm256_mullo_epi32(load8_epi32(s1), yW1));
+        const __m256i yEven = _mm256_add_epi32(yV0, yV0);
+        if (lumaRes) {
+            const __m256i yV1 = _mm256_add_epi32(_mm256_mullo_epi32(load8_epi32(s0 + 1), yW0), _mm256_mullo_epi32(load8_epi32(s1 + 1), yW1));
+            const __m256i yOdd = _mm256_add_epi32(yV0, yV1);
+            const __m256i yLo = _mm256_unpacklo_epi32(yEven, yOdd);
+            const __m256i yHi = _mm256_unpackhi_epi32(yEven, yOdd);
+            afs_store_si256(dst + 2 * x + 0, _mm256_permute2x128_si256(yLo, yHi, 0x20), std::min(2 * n, 8) * sizeof(int32_t));
+            if (n > 4) {
+                afs_store_si256(dst + 2 * x + 8, _mm256_permute2x128_si256(yLo, yHi, 0x31), (2 * n - 8) * sizeof(int32_t));
+            }
+        } else {
+            afs_store_si256(dst + x, yEven, n * sizeof(int32_t));
+        }
+    }
+}
+
+//afs: 判定フラグの生成に使用する縞のカウント (8bit単位の処理だが、シフトは8bitをまたがない)
+static __forceinline void afs_count_flags_avx2(__m256i& yCountDeint, __m256i& yCountShift, __m256i yDat0, __m256i yDat1) {
+    __m256i yMask = _mm256_and_si256(_mm256_xor_si256(yDat0, yDat1), _mm256_set1_epi8(0x44));
+    yMask = _mm256_or_si256(yMask, _mm256_slli_epi16(yMask, 1));
+    yMask = _mm256_or_si256(yMask, _mm256_srli_epi16(yMask, 2));
+    yCountDeint = _mm256_and_si256(yCountDeint, yMask);
+    yCountShift = _mm256_and_si256(yCountShift, yMask);
+    yCountDeint = _mm256_add_epi8(yCountDeint, _mm256_and_si256(yDat0, _mm256_set1_epi8(0x11)));
+    yCountShift = _mm256_add_epi8(yCountShift, _mm256_and_si256(yDat0, _mm256_set1_epi8(0x22)));
+}
+
+//a > b (符号なし8bit) なら flag
+static __forceinline __m256i afs_flag_gt_epu8(__m256i a, int b, int flag) {
+    return afs_flag_gt<uint8_t>(a, _mm256_set1_epi8((char)b), _mm256_set1_epi8((char)flag));
+}
+
+static __forceinline __m256i afs_generate_flags_avx2(const uint8_t *const *f, int x, int bytes) {
+    const __m256i yF0 = afs_load_si256(f[0] + x, bytes);
+    const __m256i yF1 = afs_load_si256(f[1] + x, bytes);
+    const __m256i yF2 = afs_load_si256(f[2] + x, bytes);
+    const __m256i yF3 = afs_load_si256(f[3] + x, bytes);
+    __m256i yCountShift = _mm256_and_si256(yF0, _mm256_set1_epi8(0x22));
+    //1行目はシフトの縞のみ
+    yCountShift = _mm256_and_si256(yCountShift, _mm256_srli_epi16(_mm256_and_si256(_mm256_xor_si256(yF1, yF0), _mm256_set1_epi8(0x44)), 1));
+    __m256i yCountDeint = _mm256_and_si256(yF1, _mm256_set1_epi8(0x11));
+    yCountShift = _mm256_add_epi8(yCountShift, _mm256_and_si256(yF1, _mm256_set1_epi8(0x22)));
+    afs_count_flags_avx2(yCountDeint, yCountShift, yF2, yF1);
+    afs_count_flags_avx2(yCountDeint, yCountShift, yF3, yF2);
+    __m256i yResult = _mm256_srli_epi16(_mm256_and_si256(yF3, _mm256_set1_epi8((char)0x88)), 1);
+    yResult = _mm256_or_si256(yResult, afs_flag_gt_epu8(_mm256_and_si256(yCountDeint, _mm256_set1_epi8(0x70)), 0x20, 0x01));
+    yResult = _mm256_or_si256(yResult, afs_flag_gt_epu8(_mm256_and_si256(yCountShift, _mm256_set1_epi8((char)0xe0)), 0x60, 0x10));
+    yResult = _mm256_or_si256(yResult, afs_flag_gt_epu8(_mm256_and_si256(yCountDeint, _mm256_set1_epi8(0x07)), 0x02, 0x02));
+    yResult = _mm256_or_si256(yResult, afs_flag_gt_epu8(_mm256_and_si256(yCountShift, _mm256_set1_epi8(0x0e)), 0x06, 0x20));
+    return yResult;
+}
+
+static void afs_gen_flags_avx2(uint8_t *m0, uint8_t *m1, const uint8_t *const *fy, const uint8_t *const *fu, const uint8_t *const *fv, int width) {
+    for (int x = 0; x < width; x += 32) {
+        const int n = std::min(width - x, 32);
+        const __m256i yY = afs_generate_flags_avx2(fy, x, n);
+        const __m256i yU = afs_generate_flags_avx2(fu, x, n);
+        const __m256i yV = afs_generate_flags_avx2(fv, x, n);
+        const __m256i yM1 = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(yY, yU), yV), _mm256_set1_epi8(0x33));
+        const __m256i yM0 = _mm256_or_si256(_mm256_and_si256(_mm256_and_si256(_mm256_and_si256(yY, yU), yV), _mm256_set1_epi8((char)0xcc)), yM1);
+        afs_store_si256(m0 + x, yM0, n);
+        afs_store_si256(m1 + x, yM1, n);
+    }
+}
+
+static int afs_output_avx2(uint8_t *dst, const uint8_t *const *m0, const uint8_t *m1, int width, int count_start, int count_end) {
+    int count = 0;
+    for (int x = 0; x < width; x += 32) {
+        const int n = std::min(width - x, 32);
+        __m256i y0 = _mm256_or_si256(_mm256_or_si256(afs_load_si256(m0[1] + x, n), afs_load_si256(m0[2] + x, n)), afs_load_si256(m0[3] + x, n));
+        y0 = _mm256_and_si256(y0, _mm256_set1_epi8(0x33));
+        y0 = _mm256_or_si256(y0, _mm256_and_si256(afs_load_si256(m1 + x, n), _mm256_set1_epi8(0x30)));
+        y0 = _mm256_or_si256(y0, afs_load_si256(m0[0] + x, n));
+        afs_store_si256(dst + x, y0, n);
+        const __m256i yCmp = _mm256_cmpeq_epi8(_mm256_and_si256(y0, _mm256_set1_epi8(0x40)), _mm256_setzero_si256());
+        count += afs_count_range(yCmp, count_start - x, count_end - x);
+    }
+    return count;
+}
+
+static int afs_merge_scan_avx2(uint8_t *dst, const uint8_t *const *p0, const uint8_t *const *p1, int width,
+    uint8_t count_mask, int count_start, int count_end) {
+    const __m256i yF3 = _mm256_set1_epi8((char)0xf3);
+    const __m256i yCountMask = _mm256_set1_epi8((char)count_mask);
+    int count = 0;
+    for (int x = 0; x < width; x += 32) {
+        const int n = std::min(width - x, 32);
+        const __m256i yP0c = afs_load_si256(p0[1] + x, n);
+        const __m256i yP1c = afs_load_si256(p1[1] + x, n);
+        const __m256i yM4 = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(afs_load_si256(p0[0] + x, n), afs_load_si256(p0[2] + x, n)), yF3), yP0c);
+        const __m256i yM5 = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(afs_load_si256(p1[0] + x, n), afs_load_si256(p1[2] + x, n)), yF3), yP1c);
+        const __m256i y0 = _mm256_or_si256(
+            _mm256_and_si256(_mm256_and_si256(yM4, yM5), _mm256_set1_epi8(0x44)),
+            _mm256_andnot_si256(yP0c, _mm256_set1_epi8(0x33)));
+        afs_store_si256(dst + x, y0, n);
+        const __m256i yCmp = _mm256_cmpeq_epi8(_mm256_and_si256(y0, yCountMask), _mm256_setzero_si256());
+        count += afs_count_range(yCmp, count_start - x, count_end - x);
+    }
+    return count;
+}
+
+template<int pass>
+static void afs_map_h_avx2(uint8_t *dst, const uint8_t *src, int width) {
+    for (int x = 0; x < width; x += 32) {
+        const int n = std::min(width - x, 32);
+        const __m256i yL = afs_load_si256(src + x - 1, n);
+        const __m256i yC = afs_load_si256(src + x + 0, n);
+        const __m256i yR = afs_load_si256(src + x + 1, n);
+        __m256i y0;
+        if (pass == 0) {
+            y0 = _mm256_or_si256(yC, _mm256_and_si256(_mm256_or_si256(yL, yR), _mm256_set1_epi8(0x03)));
+            y0 = _mm256_or_si256(y0, _mm256_and_si256(_mm256_and_si256(yL, yR), _mm256_set1_epi8(0x04)));
+        } else {
+            y0 = _mm256_and_si256(yC, _mm256_or_si256(_mm256_and_si256(yL, yR), _mm256_set1_epi8((char)0xf8)));
+        }
+        afs_store_si256(dst + x, y0, n);
+    }
+}
+
+template<int pass>
+static void afs_map_v_avx2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, const uint8_t *src2, int width) {
+    for (int x = 0; x < width; x += 32) {
+        const int n = std::min(width - x, 32);
+        const __m256i y0 = afs_load_si256(src0 + x, n);
+        const __m256i y1 = afs_load_si256(src1 + x, n);
+        const __m256i y2 = afs_load_si256(src2 + x, n);
+        const __m256i yOut = (pass == 0)
+            ? _mm256_or_si256(y1, _mm256_and_si256(_mm256_and_si256(y0, y2), _mm256_set1_epi8(0x07)))
+            : _mm256_and_si256(y1, _mm256_or_si256(_mm256_and_si256(y0, y2), _mm256_set1_epi8((char)0xf8)));
+        afs_store_si256(dst + x, yOut, n);
+    }
+}
+
+template<typename Type>
+static __forceinline __m256i afs_load8_epi32(const Type *ptr, int n) {
+    alignas(16) Type buf[8] = { 0 };
+    if (n < 8) {
+        memcpy(buf, ptr, n * sizeof(Type));
+        ptr = buf;
+    }
+    if (sizeof(Type) == 1) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)ptr));
+    } else if (sizeof(Type) == 2) {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)ptr));
+    }
+    return _mm256_loadu_si256((const __m256i *)ptr);
+}
+
+//afs: flag & maskが0でない要素を0xffffffffとする (flagはstride 1 または 2)
+template<int stride>
+static __forceinline __m256i afs_load8_flag(const uint8_t *flag, int n, __m256i yMask) {
+    __m256i yFlag;
+    if (stride == 1) {
+        yFlag = afs_load8_epi32(flag, n);
+    } else {
+        yFlag = _mm256_and_si256(afs_load8_epi32((const uint16_t *)flag, n), _mm256_set1_epi32(0xff));
+    }
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(yFlag, yMask), _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+}
+
+template<typename Type>
+static void afs_synth_avx2(void *dst, int op, const void *const *src, const uint8_t *flag, uint8_t mask, int width, int maxValue) {
+    Type *ptrDst = (Type *)dst;
+    const Type *s0 = (const Type *)src[0];
+    const Type *s1 = (const Type *)src[1];
+    const Type *s2 = (const Type *)src[2];
+    const Type *s3 = (const Type *)src[3];
+    const Type *s4 = (const Type *)src[4];
+    const __m256i yMask = _mm256_set1_epi32(mask);
+    const __m256i yMaxValue = _mm256_set1_epi32(maxValue);
+    const __m256i y1 = _mm256_set1_epi32(1);
+    const __m256i y2 = _mm256_set1_epi32(2);
+    for (int x = 0; x < width; x += 8) {
+        const int n = std::min(width - x, 8);
+        __m256i yPixel;
+        switch (op) {
+        case CPU_AFS_SYN_INTER:
+        case CPU_AFS_SYN_SPOT:
+            yPixel = _mm256_add_epi32(_mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s1 + x, n)),
+                                      _mm256_add_epi32(afs_load8_epi32(s2 + x, n), afs_load8_epi32(s3 + x, n)));
+            yPixel = _mm256_srai_epi32(_mm256_add_epi32(yPixel, y2), 2);
+            if (op == CPU_AFS_SYN_SPOT) {
+                yPixel = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(yPixel, afs_load8_epi32(s4 + x, n)), y1), 1);
+            }
+            break;
+        case CPU_AFS_SYN_BLEND: {
+            const __m256i yS1 = afs_load8_epi32(s1 + x, n);
+            __m256i yBlend = _mm256_add_epi32(_mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s2 + x, n)), _mm256_add_epi32(yS1, yS1));
+            yBlend = _mm256_srai_epi32(_mm256_add_epi32(yBlend, y2), 2);
+            yPixel = _mm256_blendv_epi8(yBlend, yS1, afs_load8_flag<1>(flag + x, n, yMask));
+            break;
+        }
+        case CPU_AFS_SYN_DEINT: {
+            const __m256i yTmp2 = _mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s4 + x, n));
+            const __m256i yTmp3 = _mm256_add_epi32(afs_load8_epi32(s1 + x, n), afs_load8_epi32(s3 + x, n));
+            __m256i yDeint = _mm256_add_epi32(yTmp3, _mm256_srai_epi32(_mm256_sub_epi32(yTmp3, yTmp2), 3));
+            yDeint = _mm256_srai_epi32(_mm256_add_epi32(yDeint, y1), 1);
+            yDeint = _mm256_min_epi32(_mm256_max_epi32(yDeint, _mm256_setzero_si256()), yMaxValue);
+            yPixel = _mm256_blendv_epi8(yDeint, afs_load8_epi32(s2 + x, n), afs_load8_flag<1>(flag + x, n, yMask));
+            break;
+        }
+        case CPU_AFS_SYN_COPY:
+        default:
+            yPixel = afs_load8_epi32(s0 + x, n);
+            break;
+        }
+        store8_epi32(ptrDst + x, yPixel, n);
+    }
+}
+
+static void afs_synth_uv_avx2(int32_t *dst, int op, const int32_t *const *src, const uint8_t *flag, uint8_t mask, int width) {
+    const int32_t *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3], *s4 = src[4];
+    const __m256i yMask = _mm256_set1_epi32(mask);
+    for (int x = 0; x < width; x += 8) {
+        const int n = std::min(width - x, 8);
+        __m256i yPixel;
+        switch (op) {
+        case CPU_AFS_SYN_INTER:
+        case CPU_AFS_SYN_SPOT:
+            yPixel = _mm256_add_epi32(_mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s1 + x, n)),
+                                      _mm256_add_epi32(afs_load8_epi32(s2 + x, n), afs_load8_epi32(s3 + x, n)));
+            if (op == CPU_AFS_SYN_SPOT) {
+                yPixel = _mm256_add_epi32(_mm256_slli_epi32(yPixel, 1), _mm256_slli_epi32(afs_load8_epi32(s4 + x, n), 3));
+            } else {
+                yPixel = _mm256_slli_epi32(yPixel, 2);
+            }
+            break;
+        case CPU_AFS_SYN_BLEND: {
+            const __m256i yS1 = afs_load8_epi32(s1 + x, n);
+            __m256i yBlend = _mm256_add_epi32(_mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s2 + x, n)), _mm256_add_epi32(yS1, yS1));
+            yPixel = _mm256_blendv_epi8(_mm256_slli_epi32(yBlend, 2), _mm256_slli_epi32(yS1, 4), afs_load8_flag<2>(flag + 2 * x, n, yMask));
+            break;
+        }
+        case CPU_AFS_SYN_DEINT: {
+            const __m256i yTmp2 = _mm256_add_epi32(afs_load8_epi32(s0 + x, n), afs_load8_epi32(s4 + x, n));
+            const __m256i yTmp3 = _mm256_add_epi32(afs_load8_epi32(s1 + x, n), afs_load8_epi32(s3 + x, n));
+            const __m256i yDeint = _mm256_sub_epi32(_mm256_add_epi32(_mm256_slli_epi32(yTmp3, 3), yTmp3), yTmp2);
+            yPixel = _mm256_blendv_epi8(yDeint, _mm256_slli_epi32(afs_load8_epi32(s2 + x, n), 4), afs_load8_flag<2>(flag + 2 * x, n, yMask));
+            break;
+        }
+        case CPU_AFS_SYN_COPY:
+        default:
+            yPixel = _mm256_slli_epi32(afs_load8_epi32(s0 + x, n), 4);
+            break;
+        }
+        afs_store_si256(dst + x, yPixel, n * sizeof(int32_t));
+    }
+}
+
+template<typename Type>
+static void afs_synth_uv_out_avx2(void *dst, const int32_t *p0, const int32_t *p2, int width, int odd, int maxValue) {
+    Type *ptrDst = (Type *)dst;
+    const __m256i yMaxValue = _mm256_set1_epi32(maxValue);
+    const __m256i yRound = _mm256_set1_epi32(512);
+    for (int x = 0; x < width; x += 8) {
+        const int n = std::min(width - x, 8);
+        __m256i yA = afs_load8_epi32(p0 + x, n);
+        __m256i yB = afs_load8_epi32(p2 + x, n);
+        if (odd) {
+            std::swap(yA, yB);
+        }
+        //3 * a + b
+        __m256i y0 = _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(yA, 1), yA), yB);
+        y0 = _mm256_srai_epi32(_mm256_add_epi32(y0, yRound), 10);
+        y0 = _mm256_min_epi32(_mm256_max_epi32(y0, _mm256_setzero_si256()), yMaxValue);
+        store8_epi32(ptrDst + x, y0, n);
+    }
+}
+
+//nnediはC版と誤差の範囲で一致すればよいので、FMAを使用する (呼び出し側でFMA3が使用可能か確認すること)
+static __forceinline __m256 nnedi_elliott_avx2(__m256 x) {
+    const __m256 yAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    return _mm256_div_ps(x, _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(x, yAbsMask)));
+}
+
+//exp(x) (x = -80 ～ 80、相対誤差は__expf程度)
+static __forceinline __m256 nnedi_exp_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-80.0f)), _mm256_set1_ps(80.0f));
+    //x = n * ln2 + r (|r| <= ln2/2)
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    //2^n (|n| <= 116なので、指数部に直接加算できる)
+    const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+static __forceinline float hsum256_ps(__m256 y) {
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(y), _mm256_extractf128_ps(y, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+}
+
+//8画素ずつ、4つのニューロンを同時に計算する
+static void nnedi_prescreen_original_avx2(uint8_t *flag, const float *const *src, const float *weight, int width) {
+    const float *weight1 = weight + 4 * 49;
+    const float *weight2 = weight1 + 4 * 5;
+    for (int x = 0; x < width; x += 8) {
+        __m256 t[8];
+        for (int n = 0; n < 4; n++) {
+            t[n] = _mm256_setzero_ps();
+        }
+        for (int y = 0; y < 4; y++) {
+            const float *s = src[y] + x - 5;
+            const float *w = weight + y * 12;
+            for (int i = 0; i < 12; i++) {
+                const __m256 y0 = _mm256_loadu_ps(s + i);
+                t[0] = _mm256_fmadd_ps(y0, _mm256_broadcast_ss(w + 0 * 48 + i), t[0]);
+                t[1] = _mm256_fmadd_ps(y0, _mm256_broadcast_ss(w + 1 * 48 + i), t[1]);
+                t[2] = _mm256_fmadd_ps(y0, _mm256_broadcast_ss(w + 2 * 48 + i), t[2]);
+                t[3] = _mm256_fmadd_ps(y0, _mm256_broadcast_ss(w + 3 * 48 + i), t[3]);
+            }
+        }
+        for (int n = 0; n < 4; n++) {
+            t[n] = nnedi_elliott_avx2(_mm256_add_ps(t[n], _mm256_broadcast_ss(weight + 4 * 48 + n)));
+        }
+        for (int n = 0; n < 4; n++) {
+            __m256 sum = _mm256_broadcast_ss(weight1 + 4 * 4 + n);
+            for (int i = 0; i < 4; i++) {
+                sum = _mm256_fmadd_ps(t[i], _mm256_broadcast_ss(weight1 + n * 4 + i), sum);
+            }
+            t[4 + n] = nnedi_elliott_avx2(sum);
+        }
+        __m256 ret[4];
+        for (int n = 0; n < 4; n++) {
+            ret[n] = _mm256_broadcast_ss(weight2 + 4 * 8 + n);
+            for (int i = 0; i < 8; i++) {
+                ret[n] = _mm256_fmadd_ps(t[i], _mm256_broadcast_ss(weight2 + n * 8 + i), ret[n]);
+            }
+        }
+        const __m256 yFlag = _mm256_cmp_ps(_mm256_max_ps(ret[2], ret[3]), _mm256_max_ps(ret[0], ret[1]), _CMP_LE_OQ);
+        store8_epi32(flag + x, _mm256_srli_epi32(_mm256_castps_si256(yFlag), 31), width - x);
+    }
+}
+
+//4画素(1グループ)ずつ、4つのニューロンの内積を横方向に計算する
+static void nnedi_prescreen_new_avx2(uint8_t *flag, const float *const *src, const float *weight, int width) {
+    const float *weight1 = weight + 4 * 65;
+    const __m128 xOffset0 = _mm_loadu_ps(weight + 4 * 64);
+    const __m128 xOffset1 = _mm_loadu_ps(weight1 + 4 * 4);
+    //2層目の重みを転置しておく (xWeight1[i] = { w[0*4+i], w[1*4+i], w[2*4+i], w[3*4+i] })
+    __m128 xWeight1[4];
+    for (int i = 0; i < 4; i++) {
+        xWeight1[i] = _mm_setr_ps(weight1[0 * 4 + i], weight1[1 * 4 + i], weight1[2 * 4 + i], weight1[3 * 4 + i]);
+    }
+    const __m128 xAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (int x = 0; x < width; x += 4) {
+        __m256 sum[4];
+        for (int n = 0; n < 4; n++) {
+            sum[n] = _mm256_setzero_ps();
+        }
+        for (int y = 0; y < 4; y++) {
+            const __m256 y0 = _mm256_loadu_ps(src[y] + x - 6);
+            const __m256 y1 = _mm256_loadu_ps(src[y] + x + 2);
+            for (int n = 0; n < 4; n++) {
+                sum[n] = _mm256_fmadd_ps(y0, _mm256_loadu_ps(weight + n * 64 + y * 16 + 0), sum[n]);
+                sum[n] = _mm256_fmadd_ps(y1, _mm256_loadu_ps(weight + n * 64 + y * 16 + 8), sum[n]);
+            }
+        }
+        //{ sum[0], sum[1], sum[2], sum[3] }の水平加算
+        const __m256 y01 = _mm256_hadd_ps(sum[0], sum[1]);
+        const __m256 y23 = _mm256_hadd_ps(sum[2], sum[3]);
+        const __m256 y0123 = _mm256_hadd_ps(y01, y23);
+        __m128 t = _mm_add_ps(_mm256_castps256_ps128(y0123), _mm256_extractf128_ps(y0123, 1));
+        t = _mm_add_ps(t, xOffset0);
+        t = _mm_div_ps(t, _mm_add_ps(_mm_set1_ps(1.0f), _mm_and_ps(t, xAbsMask)));
+        __m128 ret = xOffset1;
+        ret = _mm_fmadd_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)), xWeight1[0], ret);
+        ret = _mm_fmadd_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)), xWeight1[1], ret);
+        ret = _mm_fmadd_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2)), xWeight1[2], ret);
+        ret = _mm_fmadd_ps(_mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 3, 3)), xWeight1[3], ret);
+        const int mask = _mm_movemask_ps(_mm_cmpgt_ps(ret, _mm_setzero_ps()));
+        flag[x + 0] = (mask >> 0) & 1;
+        flag[x + 1] = (mask >> 1) & 1;
+        flag[x + 2] = (mask >> 2) & 1;
+        flag[x + 3] = (mask >> 3) & 1;
+    }
+}
+
+//PIX画素を同時に処理し、8ニューロン分の重みを1回の読み込みで各画素に使用する
+//4画素分を処理する (重みを読み込むごとに4画素分の積和を行い、重みの読み込みを減らす)
+//積和の途中の値は配列に入れるとメモリ経由になりやすいので、個別の変数とする
+//countが4未満の場合も、xlistの残りは最後の画素を繰り返して計算し、dstにはcount分のみ加算する
+static __forceinline void nnedi_predict_avx2_pix4(float *dst, const float *const *src, const int *xlist, int count, const float *weight, int nns, int nnx, int nny) {
+    const int nnxy = nnx * nny;
+    const float invNnxy = 1.0f / (float)nnxy;
+    const float *weightOffset = weight + nns * 2 * nnxy;
+    int x[4];
+    float stddev[4];
+    float mean[4];
+    __m256 yInvStddev[4];
+    for (int p = 0; p < 4; p++) {
+        x[p] = xlist[std::min(p, count - 1)] - (nnx / 2 - 1);
+        //平均と標準偏差 (nnxは8の倍数)
+        __m256 ySum = _mm256_setzero_ps();
+        __m256 ySumsq = _mm256_setzero_ps();
+        for (int y = 0; y < nny; y++) {
+            for (int ix = 0; ix < nnx; ix += 8) {
+                const __m256 y0 = _mm256_loadu_ps(src[y] + x[p] + ix);
+                ySum = _mm256_add_ps(ySum, y0);
+                ySumsq = _mm256_fmadd_ps(y0, y0, ySumsq);
+            }
+        }
+        mean[p] = hsum256_ps(ySum) * invNnxy;
+        const float var = hsum256_ps(ySumsq) * invNnxy - mean[p] * mean[p];
+        stddev[p] = 0.0f;
+        float invStddev = 0.0f;
+        if (var > FLT_EPSILON) {
+            stddev[p] = std::sqrt(var);
+            invStddev = 1.0f / stddev[p];
+        }
+        yInvStddev[p] = _mm256_set1_ps(invStddev);
+    }
+    __m256 yWsum[4], yVsum[4];
+    for (int p = 0; p < 4; p++) {
+        yWsum[p] = _mm256_setzero_ps();
+        yVsum[p] = _mm256_setzero_ps();
+    }
+    for (int iw = 0; iw < nns; iw += 8) {
+        const float *w = weight + iw * 2 * nnxy;
+        __m256 ySum00 = _mm256_setzero_ps(), ySum01 = _mm256_setzero_ps(), ySum02 = _mm256_setzero_ps(), ySum03 = _mm256_setzero_ps();
+        __m256 ySum10 = _mm256_setzero_ps(), ySum11 = _mm256_setzero_ps(), ySum12 = _mm256_setzero_ps(), ySum13 = _mm256_setzero_ps();
+        for (int y = 0; y < nny; y++) {
+            const float *s0 = src[y] + x[0];
+            const float *s1 = src[y] + x[1];
+            const float *s2 = src[y] + x[2];
+            const float *s3 = src[y] + x[3];
+            for (int ix = 0; ix < nnx; ix++, w += 16) {
+                const __m256 yW0 = _mm256_loadu_ps(w + 0);
+                const __m256 yW1 = _mm256_loadu_ps(w + 8);
+                __m256 yS;
+                yS = _mm256_broadcast_ss(s0 + ix); ySum00 = _mm256_fmadd_ps(yS, yW0, ySum00); ySum10 = _mm256_fmadd_ps(yS, yW1, ySum10);
+                yS = _mm256_broadcast_ss(s1 + ix); ySum01 = _mm256_fmadd_ps(yS, yW0, ySum01); ySum11 = _mm256_fmadd_ps(yS, yW1, ySum11);
+                yS = _mm256_broadcast_ss(s2 + ix); ySum02 = _mm256_fmadd_ps(yS, yW0, ySum02); ySum12 = _mm256_fmadd_ps(yS, yW1, ySum12);
+                yS = _mm256_broadcast_ss(s3 + ix); ySum03 = _mm256_fmadd_ps(yS, yW0, ySum03); ySum13 = _mm256_fmadd_ps(yS, yW1, ySum13);
+            }
+        }
+        const __m256 ySum0[4] = { ySum00, ySum01, ySum02, ySum03 };
+        const __m256 ySum1[4] = { ySum10, ySum11, ySum12, ySum13 };
+        const __m256 yOffset0 = _mm256_loadu_ps(weightOffset + iw * 2 + 0);
+        const __m256 yOffset1 = _mm256_loadu_ps(weightOffset + iw * 2 + 8);
+        for (int p = 0; p < 4; p++) {
+            const __m256 yRet0 = nnedi_exp_avx2(_mm256_fmadd_ps(ySum0[p], yInvStddev[p], yOffset0));
+            const __m256 yRet1 = _mm256_fmadd_ps(ySum1[p], yInvStddev[p], yOffset1);
+            yWsum[p] = _mm256_add_ps(yWsum[p], yRet0);
+            yVsum[p] = _mm256_fmadd_ps(yRet0, nnedi_elliott_avx2(yRet1), yVsum[p]);
+        }
+    }
+    for (int p = 0; p < std::min(count, 4); p++) {
+        const float wsum = hsum256_ps(yWsum[p]);
+        float ret = mean[p];
+        if (wsum > 1e-10f) {
+            ret += ((5.0f * hsum256_ps(yVsum[p])) / wsum) * stddev[p];
+        }
+        dst[p] += ret;
+    }
+}
+
+static void nnedi_predict_avx2(float *dst, const float *const *src, const int *xlist, int count, const float *weight, int nns, int nnx, int nny) {
+    for (int i = 0; i < count; i += 4) {
+        nnedi_predict_avx2_pix4(dst + i, src, xlist + i, count - i, weight, nns, nnx, nny);
+    }
+}
+
+const NVEncCpuFilterKernel CPU_FILTER_KERNEL_AVX2 = {
+    _T("avx2"), AVX2,
+    { { plane_copy_avx2<uint8_t,  uint8_t>,  plane_copy_avx2<uint16_t, uint8_t>  },
+      { plane_copy_avx2<uint8_t,  uint16_t>, plane_copy_avx2<uint16_t, uint16_t> } },
+    { { split_uv_avx2<uint8_t,  uint8_t>,  split_uv_avx2<uint16_t, uint8_t>  },
+      { split_uv_avx2<uint8_t,  uint16_t>, split_uv_avx2<uint16_t, uint16_t> } },
+    { { merge_uv_avx2<uint8_t,  uint8_t>,  merge_uv_avx2<uint16_t, uint8_t>  },
+      { merge_uv_avx2<uint8_t,  uint16_t>, merge_uv_avx2<uint16_t, uint16_t> } },
+    { conv_v_avx2<uint8_t>, conv_v_avx2<uint16_t> },
+    { resize_h_avx2<uint8_t>, resize_h_avx2<uint16_t> },
+    { unsharp_h_avx2<uint8_t>, unsharp_h_avx2<uint16_t> },
+    { tweak_uv_avx2<uint8_t>, tweak_uv_avx2<uint16_t> },
+    { afs_analyze_avx2<uint8_t>, afs_analyze_avx2<uint16_t>, afs_analyze_avx2<int32_t> },
+    { afs_get_uv_avx2<uint8_t>, afs_get_uv_avx2<uint16_t> },
+    afs_gen_flags_avx2,
+    afs_output_avx2,
+    afs_merge_scan_avx2,
+    { afs_map_h_avx2<0>, afs_map_h_avx2<1> },
+    { afs_map_v_avx2<0>, afs_map_v_avx2<1> },
+    { afs_synth_avx2<uint8_t>, afs_synth_avx2<uint16_t> },
+    afs_synth_uv_avx2,
+    { afs_synth_uv_out_avx2<uint8_t>, afs_synth_uv_out_avx2<uint16_t> },
+    { nnedi_prescreen_original_avx2, nnedi_prescreen_new_avx2 },
+    nnedi_predict_avx2,
+};
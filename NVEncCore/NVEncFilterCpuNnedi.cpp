@@ -0,0 +1,732 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include "rgy_simd.h"
+#include "NVEncFilterCpu.h"
+
+//フィールドの行をfloatに変換した作業領域の左右の余白 (predictorのnnx=48で[x-23, x+24]を参照する分)
+static const int NNEDI_CPU_TMP_PAD = 32;
+//1ブロックのフィールドの行数 (CUDA版のkernel_comute_network1の1warpが処理する行数)
+static const int NNEDI_CPU_BLOCK_Y = 4;
+//1ブロックの横方向の画素数 (CUDA版の1warpが処理する画素数、pre_screen=*_blockの判定単位)
+static const int NNEDI_CPU_BLOCK_X = 32;
+//1ブロックの処理で参照するフィールドの行数 (ブロックの先頭の行から-3 ～ +6)
+static const int NNEDI_CPU_SRC_ROWS = NNEDI_CPU_BLOCK_Y + 6;
+
+struct NnediCpuWeights {
+    vector<float> weight0;    //prescreener (nnedi_set_weight0の出力)
+    vector<float> weight1[2]; //predictor [iquality] ([nns/8][nnx*nny][2][8]、続いてオフセット[nns/8][2][8])
+};
+
+//変換済みの重みは、同じ設定のフィルタ間で共有する (bobやマルチレンディションで何度も変換しないように)
+static std::mutex g_nnediCpuWeightsMtx;
+static std::map<tstring, std::weak_ptr<const NnediCpuWeights>> g_nnediCpuWeights;
+
+static shared_ptr<const NnediCpuWeights> nnedi_cpu_get_weights(const VppNnedi& nnedi, HMODULE hModule, tstring& errMes) {
+    const auto preScreenMode = (VppNnediPreScreen)(nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE);
+    const tstring key = strsprintf(_T("%s:%d:%d:%d:%d"), nnedi.weightfile.c_str(), nnedi.nns, (int)nnedi.nsize, (int)nnedi.errortype, (int)preScreenMode);
+    std::lock_guard<std::mutex> lock(g_nnediCpuWeightsMtx);
+    auto cached = g_nnediCpuWeights.find(key);
+    if (cached != g_nnediCpuWeights.end()) {
+        auto weights = cached->second.lock();
+        if (weights) {
+            return weights;
+        }
+    }
+    auto weightsFile = nnedi_read_weights(nnedi.weightfile, hModule, errMes);
+    if (!weightsFile) {
+        return nullptr;
+    }
+    auto weights = std::make_shared<NnediCpuWeights>();
+    weights->weight0.resize((preScreenMode >= VPP_NNEDI_PRE_SCREEN_NEW) ? NNEDI_WEIGHT0_SIZE_NEW : NNEDI_WEIGHT0_SIZE);
+    nnedi_set_weight0(weights->weight0.data(), weightsFile.get(), preScreenMode);
+
+    //predictorの重みは、8ニューロン分の[iw]と[iw+nns]の重みが画素ごとに並ぶようにしておく
+    //[2][nns][nnxy] -> [nns/8][nnxy][2][8]、オフセットは[2][nns] -> [nns/8][2][8]
+    const int nns = nnedi.nns;
+    const int nnxy = NNEDI_SIZE_NX[nnedi.nsize] * NNEDI_SIZE_NY[nnedi.nsize];
+    vector<float> buf(nnedi_weight1_size(nnedi));
+    for (int iquality = 0; iquality < 2; iquality++) {
+        nnedi_set_weight1(buf.data(), weightsFile.get(), nnedi, iquality, 1.0f);
+        auto& dst = weights->weight1[iquality];
+        dst.resize(buf.size());
+        for (int iw = 0; iw < nns; iw += 8) {
+            for (int k = 0; k < nnxy; k++) {
+                for (int j = 0; j < 2; j++) {
+                    for (int i = 0; i < 8; i++) {
+                        dst[((iw / 8 * nnxy + k) * 2 + j) * 8 + i] = buf[(j * nns + iw + i) * nnxy + k];
+                    }
+                }
+            }
+            for (int j = 0; j < 2; j++) {
+                for (int i = 0; i < 8; i++) {
+                    dst[nns * 2 * nnxy + (iw / 8 * 2 + j) * 8 + i] = buf[nns * 2 * nnxy + j * nns + iw + i];
+                }
+            }
+        }
+    }
+    g_nnediCpuWeights[key] = weights;
+    return weights;
+}
+
+NVEncFilterCpuNnedi::NVEncFilterCpuNnedi() :
+    m_rowTileMin(2),
+    m_weights(),
+    m_pKernelNnedi(nullptr),
+    m_tmpPitch(0),
+    m_tmpBuf(),
+    m_tmpBufFlag(),
+    m_tmpBufPos() {
+    m_sFilterName = _T("nnedi");
+}
+
+NVEncFilterCpuNnedi::~NVEncFilterCpuNnedi() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuNnedi::check_param(shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
+    if (pNnediParam->frameOut.height <= 0 || pNnediParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid frame size.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.field <= VPP_NNEDI_FIELD_UNKNOWN || VPP_NNEDI_FIELD_MAX <= pNnediParam->nnedi.field) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"field\": %d\n"), pNnediParam->nnedi.field);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.nns < 16 || 256 < pNnediParam->nnedi.nns) {
+        pNnediParam->nnedi.nns = clamp(pNnediParam->nnedi.nns, 16, 256);
+        AddMessage(RGY_LOG_WARN, _T("nns should be in range of %d - %d.\n"), 16, 256);
+    }
+    if (get_cx_index(list_vpp_nnedi_nns, pNnediParam->nnedi.nns) < 0) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"nns\": %d\n"), pNnediParam->nnedi.nns);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.nsize <= VPP_NNEDI_NSIZE_UNKNOWN || VPP_NNEDI_NSIZE_MAX <= pNnediParam->nnedi.nsize) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"nsize\": %d\n"), pNnediParam->nnedi.nsize);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.quality <= VPP_NNEDI_QUALITY_UNKNOWN || VPP_NNEDI_QUALITY_MAX <= pNnediParam->nnedi.quality) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"quality\": %d\n"), pNnediParam->nnedi.quality);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.pre_screen < VPP_NNEDI_PRE_SCREEN_NONE || VPP_NNEDI_PRE_SCREEN_MAX <= pNnediParam->nnedi.pre_screen) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"pre_screen\": %d\n"), pNnediParam->nnedi.pre_screen);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pNnediParam->nnedi.precision < VPP_NNEDI_PRECISION_UNKNOWN || VPP_NNEDI_PRECISION_MAX <= pNnediParam->nnedi.precision) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid value for param \"prec\": %d\n"), pNnediParam->nnedi.precision);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //CPU版はfp32のみ
+    if (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP16) {
+        AddMessage(RGY_LOG_WARN, _T("prec=fp16 is not supported by cpu filter, switching to fp32.\n"));
+    }
+    pNnediParam->nnedi.precision = VPP_NNEDI_PRECISION_FP32;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuNnedi::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pNnediParam = std::dynamic_pointer_cast<NVEncFilterParamNnedi>(pParam);
+    if (!pNnediParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //パラメータチェック
+    if (check_param(pNnediParam) != RGY_ERR_NONE) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto csp = pNnediParam->frameIn.csp;
+    if (csp != RGY_CSP_YV12 && csp != RGY_CSP_YV12_16 && csp != RGY_CSP_YUV444 && csp != RGY_CSP_YUV444_16) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp %s.\n"), RGY_CSP_NAMES[csp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    pNnediParam->frameOut.picstruct = RGY_PICSTRUCT_FRAME;
+    sts = AllocFrameBuf(pNnediParam->frameOut, pNnediParam->nnedi.isbob() ? 2 : 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pNnediParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    //重みの変換は設定が変わった場合のみ行う
+    auto pNnediParamPrev = std::dynamic_pointer_cast<NVEncFilterParamNnedi>(m_pParam);
+    if (!m_weights
+        || !pNnediParamPrev
+        || pNnediParamPrev->nnedi != pNnediParam->nnedi) {
+        tstring errMes;
+        m_weights = nnedi_cpu_get_weights(pNnediParam->nnedi, pNnediParam->hModule, errMes);
+        if (!m_weights) {
+            AddMessage(RGY_LOG_ERROR, errMes);
+            return RGY_ERR_INVALID_PARAM;
+        }
+    }
+    //AVX2版のnnediのカーネルはFMAを使用するので、FMA3が使用できない場合はC版を使用する
+    m_pKernelNnedi = ((m_pKernel->simd & AVX2) == 0 || (get_availableSIMD() & FMA3) == FMA3) ? m_pKernel : &CPU_FILTER_KERNEL_C;
+    m_tmpPitch = ALIGN(pNnediParam->frameIn.width + 2 * NNEDI_CPU_TMP_PAD, 16);
+    m_tmpBuf.clear();
+    m_tmpBufFlag.clear();
+    m_tmpBufPos.clear();
+
+    m_nPathThrough &= (~(FILTER_PATHTHROUGH_PICSTRUCT));
+    if (pNnediParam->nnedi.isbob()) {
+        pParam->baseFps *= 2;
+        m_nPathThrough &= (~(FILTER_PATHTHROUGH_TIMESTAMP));
+    }
+
+    m_sFilterInfo = strsprintf(
+        _T("nnedi: field %s, nns %d, nsize %s, quality %s, prec %s\n")
+        _T("                       pre_screen %s, errortype %s, weight \"%s\" [cpu %s]"),
+        get_cx_desc(list_vpp_nnedi_field, pNnediParam->nnedi.field),
+        pNnediParam->nnedi.nns,
+        get_cx_desc(list_vpp_nnedi_nsize, pNnediParam->nnedi.nsize),
+        get_cx_desc(list_vpp_nnedi_quality, pNnediParam->nnedi.quality),
+        get_cx_desc(list_vpp_nnedi_prec, pNnediParam->nnedi.precision),
+        get_cx_desc(list_vpp_nnedi_pre_screen, pNnediParam->nnedi.pre_screen),
+        get_cx_desc(list_vpp_nnedi_error_type, pNnediParam->nnedi.errortype),
+        ((pNnediParam->nnedi.weightfile.length()) ? pNnediParam->nnedi.weightfile.c_str() : _T("internal")),
+        m_pKernelNnedi->name);
+
+    //コピーを保存
+    m_pParam = pNnediParam;
+    return sts;
+}
+
+void NVEncFilterCpuNnedi::alloc_tmp_buf(int tasks) {
+    //float: フィールドの行(NNEDI_CPU_SRC_ROWS行) + predictorの出力(1行)
+    //8bit : prescreenerの判定結果(1行) + ブロックごとのpredictorの要否
+    //int  : predictorで処理する画素の位置(1行)
+    const size_t tmpSize = (size_t)m_tmpPitch * (NNEDI_CPU_SRC_ROWS + 1);
+    const size_t tmpSizeFlag = (size_t)m_tmpPitch * 2;
+    if ((int)m_tmpBuf.size() < tasks) {
+        m_tmpBuf.resize(tasks);
+        m_tmpBufFlag.resize(tasks);
+        m_tmpBufPos.resize(tasks);
+    }
+    for (int i = 0; i < tasks; i++) {
+        if (m_tmpBuf[i].size() < tmpSize) {
+            m_tmpBuf[i].resize(tmpSize, 0.0f);
+        }
+        if (m_tmpBufFlag[i].size() < tmpSizeFlag) {
+            m_tmpBufFlag[i].resize(tmpSizeFlag, 0);
+        }
+        if (m_tmpBufPos[i].size() < (size_t)m_tmpPitch) {
+            m_tmpBufPos[i].resize(m_tmpPitch, 0);
+        }
+    }
+}
+
+template<typename Type>
+void NVEncFilterCpuNnedi::proc_plane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane, const NnediTargetField targetField, const VppNnedi& nnedi) {
+    const int width = pInputPlane->width;
+    const int fieldHeight = pInputPlane->height / 2;
+    const int bitDepth = RGY_CSP_BIT_DEPTH[pInputPlane->csp];
+    const int maxValue = (1 << bitDepth) - 1;
+    //有効なフィールド(src)と生成するフィールド(dst)の行
+    const int srcFieldOffset = (targetField == NNEDI_GEN_FIELD_TOP) ? 1 : 0;
+    const int dstFieldOffset = 1 - srcFieldOffset;
+    const auto preScreenMode = nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE;
+    const bool preScreenBlock = (nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_BLOCK) != 0;
+    const bool predict = (nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_ONLY) == 0;
+    const int nnx = NNEDI_SIZE_NX[nnedi.nsize];
+    const int nny = NNEDI_SIZE_NY[nnedi.nsize];
+    //参照範囲の先頭の行 (生成する行のフィールドの位置からの相対位置)
+    const int preScreenY = -(2 - ((targetField == NNEDI_GEN_FIELD_BOTTOM) ? 1 : 0));
+    const int predictY = -(nny / 2 - ((targetField == NNEDI_GEN_FIELD_BOTTOM) ? 1 : 0));
+    const int quals = (int)nnedi.quality;
+    //CUDA版と同じく、テクスチャから読み込んだ値(0～1)を256倍して使用する
+    const float srcScale = 256.0f / (float)maxValue;
+    const float pixScale = (float)(1 << bitDepth) / 256.0f;
+    const float outScale = pixScale * ((quals > 1) ? 0.5f : 1.0f);
+    const auto kernel = m_pKernelNnedi;
+    const auto weights = m_weights.get();
+    const int blocks = (fieldHeight + NNEDI_CPU_BLOCK_Y - 1) / NNEDI_CPU_BLOCK_Y;
+    const int blocksX = (width + NNEDI_CPU_BLOCK_X - 1) / NNEDI_CPU_BLOCK_X;
+    alloc_tmp_buf(rowTaskCount(blocks, m_rowTileMin));
+
+    auto ptrSrcField = [&](int fy) {
+        return (const Type *)(pInputPlane->ptr + (clamp(fy, 0, fieldHeight - 1) * 2 + srcFieldOffset) * pInputPlane->pitch);
+    };
+    auto ptrDstField = [&](int fy, int offset) {
+        return (Type *)(pOutputPlane->ptr + (fy * 2 + offset) * pOutputPlane->pitch);
+    };
+    run_rows(blocks, m_rowTileMin, [&](int by_start, int by_end, int task_id) {
+        float *tmpSrc = m_tmpBuf[task_id].data();
+        float *tmpOut = tmpSrc + m_tmpPitch * NNEDI_CPU_SRC_ROWS;
+        uint8_t *flag = m_tmpBufFlag[task_id].data();
+        uint8_t *blockFlag = flag + m_tmpPitch;
+        int *xlist = m_tmpBufPos[task_id].data();
+        for (int by = by_start; by < by_end; by++) {
+            const int fy_start = by * NNEDI_CPU_BLOCK_Y;
+            const int fy_end = std::min(fy_start + NNEDI_CPU_BLOCK_Y, fieldHeight);
+            //フィールドの行(fy)の作業領域での位置
+            auto srcRow = [&](int fy) {
+                return tmpSrc + (fy - fy_start + 3) * m_tmpPitch + NNEDI_CPU_TMP_PAD;
+            };
+            //有効なフィールドをコピーし、参照する行をfloatに変換する (範囲外は端の画素で拡張する)
+            for (int fy = fy_start; fy < fy_end; fy++) {
+                memcpy(ptrDstField(fy, srcFieldOffset), ptrSrcField(fy), width * sizeof(Type));
+            }
+            for (int fy = fy_start - 3; fy < fy_start + NNEDI_CPU_SRC_ROWS - 3; fy++) {
+                const Type *ptrSrc = ptrSrcField(fy);
+                float *ptrTmp = srcRow(fy);
+                for (int x = -NNEDI_CPU_TMP_PAD; x < width + NNEDI_CPU_TMP_PAD; x++) {
+                    ptrTmp[x] = (float)ptrSrc[clamp(x, 0, width - 1)] * srcScale;
+                }
+            }
+            //prescreener: 補間のみで済む画素は補間し、そうでない画素はmaxValueとする
+            for (int fy = fy_start; fy < fy_end; fy++) {
+                Type *ptrDst = ptrDstField(fy, dstFieldOffset);
+                if (preScreenMode == VPP_NNEDI_PRE_SCREEN_NONE) {
+                    std::fill(ptrDst, ptrDst + width, (Type)maxValue);
+                    continue;
+                }
+                const float *src[4];
+                for (int i = 0; i < 4; i++) {
+                    src[i] = srcRow(fy + preScreenY + i);
+                }
+                kernel->nnedi_prescreen[(preScreenMode >= VPP_NNEDI_PRE_SCREEN_NEW) ? 1 : 0](flag, src, weights->weight0.data(), width);
+                for (int x = 0; x < width; x++) {
+                    Type value = (Type)maxValue;
+                    if (flag[x]) {
+                        //CUDA版と同じく、一度画素値に戻してから補間する
+                        float pix[4];
+                        for (int i = 0; i < 4; i++) {
+                            pix[i] = (float)std::min((int)(src[i][x] * pixScale + 0.5f), maxValue);
+                        }
+                        const float tmp = (19.0f / 32.0f) * (pix[1] + pix[2]) - (3.0f / 32.0f) * (pix[0] + pix[3]);
+                        value = (Type)clamp(tmp + 0.5f, 0.0f, (float)maxValue);
+                    }
+                    ptrDst[x] = value;
+                }
+            }
+            if (!predict) {
+                continue;
+            }
+            //predictor: maxValueの画素を処理する
+            //pre_screen=*_blockでは、CUDA版の1warpに相当する範囲(32画素x4行)に1つでも対象の画素があれば、その範囲をすべて処理する
+            if (preScreenBlock && preScreenMode != VPP_NNEDI_PRE_SCREEN_NONE) {
+                memset(blockFlag, 0, blocksX);
+                for (int fy = fy_start; fy < fy_end; fy++) {
+                    const Type *ptrDst = ptrDstField(fy, dstFieldOffset);
+                    for (int x = 0; x < width; x++) {
+                        blockFlag[x / NNEDI_CPU_BLOCK_X] |= (ptrDst[x] == (Type)maxValue) ? 1 : 0;
+                    }
+                }
+            }
+            for (int fy = fy_start; fy < fy_end; fy++) {
+                Type *ptrDst = ptrDstField(fy, dstFieldOffset);
+                int count = 0;
+                if (preScreenMode == VPP_NNEDI_PRE_SCREEN_NONE) {
+                    for (int x = 0; x < width; x++) {
+                        xlist[count++] = x;
+                    }
+                } else if (preScreenBlock) {
+                    for (int x = 0; x < width; x++) {
+                        if (blockFlag[x / NNEDI_CPU_BLOCK_X]) {
+                            xlist[count++] = x;
+                        }
+                    }
+                } else {
+                    for (int x = 0; x < width; x++) {
+                        if (ptrDst[x] == (Type)maxValue) {
+                            xlist[count++] = x;
+                        }
+                    }
+                }
+                if (count == 0) {
+                    continue;
+                }
+                const float *src[6];
+                for (int i = 0; i < nny; i++) {
+                    src[i] = srcRow(fy + predictY + i);
+                }
+                std::fill(tmpOut, tmpOut + count, 0.0f);
+                for (int iquality = 0; iquality < quals; iquality++) {
+                    kernel->nnedi_predict(tmpOut, src, xlist, count, weights->weight1[iquality].data(), nnedi.nns, nnx, nny);
+                }
+                for (int i = 0; i < count; i++) {
+                    ptrDst[xlist[i]] = (Type)clamp(tmpOut[i] * outScale + 0.5f, 0.0f, (float)maxValue);
+                }
+            }
+        }
+    });
+}
+
+void NVEncFilterCpuNnedi::proc_frame(FrameInfo *pOutputFrame, const FrameInfo *pInputFrame, const NnediTargetField targetField, const VppNnedi& nnedi) {
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto planeSrc = getPlane(pInputFrame, plane);
+        auto planeDst = getPlane(pOutputFrame, plane);
+        if (RGY_CSP_BIT_DEPTH[pInputFrame->csp] > 8) {
+            proc_plane<uint16_t>(&planeDst, &planeSrc, targetField, nnedi);
+        } else {
+            proc_plane<uint8_t>(&planeDst, &planeSrc, targetField, nnedi);
+        }
+    }
+}
+
+RGY_ERR NVEncFilterCpuNnedi::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+    auto pNnediParam = std::dynamic_pointer_cast<NVEncFilterParamNnedi>(m_pParam);
+    if (!pNnediParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (m_pParam->frameOut.csp != m_pParam->frameIn.csp || pInputFrame->csp != m_pParam->frameIn.csp) {
+        AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+
+    NnediTargetField targetField = NNEDI_GEN_FIELD_UNKNOWN;
+    if (   pNnediParam->nnedi.field == VPP_NNEDI_FIELD_USE_AUTO
+        || pNnediParam->nnedi.field == VPP_NNEDI_FIELD_BOB_AUTO) {
+        if ((pInputFrame->picstruct & RGY_PICSTRUCT_INTERLACED) == 0) {
+            //プログレッシブのフレームはそのまま出力する (bobでも1フレームのみ)
+            *pOutputFrameNum = 1;
+            if (ppOutputFrames[0] == nullptr) {
+                ppOutputFrames[0] = &m_pFrameBuf[m_nFrameIdx]->frame;
+                m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+            }
+            sts = copyFrameDataCpu(ppOutputFrames[0], pInputFrame);
+            ppOutputFrames[0]->picstruct = pInputFrame->picstruct;
+            ppOutputFrames[0]->timestamp = pInputFrame->timestamp;
+            ppOutputFrames[0]->duration = pInputFrame->duration;
+            ppOutputFrames[0]->inputFrameId = pInputFrame->inputFrameId;
+            return sts;
+        } else if (pInputFrame->picstruct & RGY_PICSTRUCT_FRAME_TFF) {
+            targetField = NNEDI_GEN_FIELD_BOTTOM;
+        } else if (pInputFrame->picstruct & RGY_PICSTRUCT_FRAME_BFF) {
+            targetField = NNEDI_GEN_FIELD_TOP;
+        }
+    } else if (pNnediParam->nnedi.field == VPP_NNEDI_FIELD_USE_TOP
+        || pNnediParam->nnedi.field == VPP_NNEDI_FIELD_BOB_TOP_BOTTOM) {
+        targetField = NNEDI_GEN_FIELD_BOTTOM;
+    } else if (pNnediParam->nnedi.field == VPP_NNEDI_FIELD_USE_BOTTOM
+        || pNnediParam->nnedi.field == VPP_NNEDI_FIELD_BOB_BOTTOM_TOP) {
+        targetField = NNEDI_GEN_FIELD_TOP;
+    }
+    if (targetField == NNEDI_GEN_FIELD_UNKNOWN) {
+        AddMessage(RGY_LOG_ERROR, _T("Not implemented yet.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+
+    *pOutputFrameNum = (pNnediParam->nnedi.isbob()) ? 2 : 1;
+    if (ppOutputFrames[0] == nullptr) {
+        for (int i = 0; i < *pOutputFrameNum; i++) {
+            ppOutputFrames[i] = &m_pFrameBuf[m_nFrameIdx]->frame;
+            m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+        }
+    }
+    proc_frame(ppOutputFrames[0], pInputFrame, targetField, pNnediParam->nnedi);
+    ppOutputFrames[0]->picstruct = RGY_PICSTRUCT_FRAME;
+
+    if (pNnediParam->nnedi.isbob()) {
+        targetField = (targetField == NNEDI_GEN_FIELD_BOTTOM) ? NNEDI_GEN_FIELD_TOP : NNEDI_GEN_FIELD_BOTTOM;
+        proc_frame(ppOutputFrames[1], pInputFrame, targetField, pNnediParam->nnedi);
+        ppOutputFrames[1]->picstruct = RGY_PICSTRUCT_FRAME;
+        ppOutputFrames[0]->timestamp = pInputFrame->timestamp;
+        ppOutputFrames[0]->duration = (pInputFrame->duration + 1) / 2;
+        ppOutputFrames[0]->inputFrameId = pInputFrame->inputFrameId;
+        ppOutputFrames[1]->timestamp = ppOutputFrames[0]->timestamp + ppOutputFrames[0]->duration;
+        ppOutputFrames[1]->duration = pInputFrame->duration - ppOutputFrames[0]->duration;
+        ppOutputFrames[1]->inputFrameId = pInputFrame->inputFrameId;
+    }
+    return sts;
+}
+
+void NVEncFilterCpuNnedi::close() {
+    m_pFrameBuf.clear();
+    m_weights.reset();
+    m_tmpBuf.clear();
+    m_tmpBufFlag.clear();
+    m_tmpBufPos.clear();
+}
+
+//インタレ(TFF)の入力を作成する
+//斜めの縞を、フィールドごとに6画素ずつ横に動かす (フレーム内ではトップとボトムで縞の位置がずれる)
+RGY_ERR nnedi_cpu_bench_make_input(vector<unique_ptr<NVEncCpuFrameBuf>>& input, RGY_CSP csp, int width, int height, int frames) {
+    const bool yuv420 = RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV420;
+    const int shift = (RGY_CSP_BIT_DEPTH[csp] > 8) ? 8 : 0;
+    input.clear();
+    for (int i = 0; i < frames; i++) {
+        unique_ptr<NVEncCpuFrameBuf> frame(new NVEncCpuFrameBuf(width, height, csp));
+        auto sts = frame->alloc();
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+        frame->frame.picstruct = RGY_PICSTRUCT_FRAME_TFF;
+        for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+            auto p = getPlane(&frame->frame, plane);
+            const int scale = (plane != RGY_PLANE_Y && yuv420) ? 2 : 1;
+            for (int y = 0; y < p.height; y++) {
+                const int field = i * 2 + (y & 1);
+                const int ly = y * scale;
+                for (int x = 0; x < p.width; x++) {
+                    const int lx = x * scale;
+                    int value = 0;
+                    if (ly < height / 4) {
+                        //上は静止したグラデーション (prescreenerで補間のみとなるように)
+                        value = 32 + ((lx + ly) & 127) + ((plane == RGY_PLANE_Y) ? 0 : 32);
+                    } else {
+                        //動く斜めの縞 (縞の端は傾斜をつける)
+                        const int pos = (lx + ly - field * 6) & 127;
+                        const int ramp = clamp(std::min(pos, 64 - pos) * 8, 0, 128);
+                        value = ((plane == RGY_PLANE_Y) ? 48 : 96) + ((pos < 64) ? ramp : 0);
+                    }
+                    if (shift) {
+                        ((uint16_t *)(p.ptr + y * p.pitch))[x] = (uint16_t)((value << shift) | (x & 255));
+                    } else {
+                        (p.ptr + y * p.pitch)[x] = (uint8_t)value;
+                    }
+                }
+            }
+        }
+        input.push_back(std::move(frame));
+    }
+    return RGY_ERR_NONE;
+}
+
+struct NnediCpuBenchResult {
+    RGY_ERR err;
+    int framesOut;
+    double timeMs;
+    uint64_t hash;
+    vector<unique_ptr<NVEncCpuFrameBuf>> output; //基準との比較用に保存した出力
+};
+
+static NnediCpuBenchResult nnedi_cpu_bench_run(const vector<unique_ptr<NVEncCpuFrameBuf>>& input, int frames, const VppNnedi& nnedi, uint32_t simd, int rowTileMin) {
+    NnediCpuBenchResult result;
+    result.err = RGY_ERR_NONE;
+    result.framesOut = 0;
+    result.timeMs = 0.0;
+    result.hash = 0;
+    const auto inFps = rgy_rational<int>(30000, 1001);
+    auto timebase = inFps.inv();
+    timebase *= rgy_rational<int>(1, 2);
+    VppParam vpp;
+    vpp.nnedi = nnedi;
+    vpp.nnedi.enable = true;
+    NVEncFilterCpuChain chain;
+    result.err = chain.init(input[0]->frame, sInputCrop({ 0 }), 0, 0, vpp, inFps, timebase, tstring(), input[0]->frame.csp, simd, nullptr);
+    if (result.err != RGY_ERR_NONE) {
+        return result;
+    }
+    auto filterNnedi = dynamic_cast<NVEncFilterCpuNnedi *>(chain.filters()[0].get());
+    if (filterNnedi == nullptr) {
+        result.err = RGY_ERR_UNKNOWN;
+        return result;
+    }
+    filterNnedi->setRowTileMin(rowTileMin);
+    uint64_t hash = 14695981039346656037ull;
+    vector<FrameInfo *> outputs;
+    //出力は次の呼び出しまでしか有効でないので、比較用にコピーしておく (コピーの時間は計測に含めない)
+    auto addOutput = [&]() {
+        for (auto frame : outputs) {
+            hash = vpp_cpu_bench_hash(hash, frame);
+            for (const int64_t value : { frame->timestamp, frame->duration }) {
+                hash = (hash ^ (uint64_t)value) * 1099511628211ull;
+            }
+            unique_ptr<NVEncCpuFrameBuf> copy(new NVEncCpuFrameBuf(frame->width, frame->height, frame->csp));
+            if ((result.err = copy->alloc()) != RGY_ERR_NONE
+                || (result.err = copy->copyFrame(frame)) != RGY_ERR_NONE) {
+                return;
+            }
+            result.output.push_back(std::move(copy));
+            result.framesOut++;
+        }
+    };
+    auto runFilter = [&](FrameInfo *frame) {
+        const auto timeStart = std::chrono::high_resolution_clock::now();
+        result.err = chain.filter(frame, outputs);
+        result.timeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+        if (result.err == RGY_ERR_NONE) {
+            addOutput();
+        }
+        return result.err;
+    };
+    for (int i = 0; i < frames; i++) {
+        //入力は使いまわし、タイムスタンプのみ設定する
+        FrameInfo frame = input[i % input.size()]->frame;
+        frame.timestamp = i * 2;
+        frame.duration = 2;
+        frame.inputFrameId = i;
+        if (runFilter(&frame) != RGY_ERR_NONE) {
+            return result;
+        }
+    }
+    do {
+        if (runFilter(nullptr) != RGY_ERR_NONE) {
+            return result;
+        }
+    } while (!outputs.empty());
+    result.hash = hash;
+    return result;
+}
+
+//出力の画素ごとの差を比較し、最大の差とtoleranceを超える画素の数を返す
+template<typename Type>
+static void nnedi_cpu_bench_diff(const FrameInfo *a, const FrameInfo *b, int tolerance, int& maxDiff, int64_t& diffCount, int64_t& pixelCount) {
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto pa = getPlane(a, plane);
+        const auto pb = getPlane(b, plane);
+        for (int y = 0; y < pa.height; y++) {
+            const Type *ptrA = (const Type *)(pa.ptr + y * pa.pitch);
+            const Type *ptrB = (const Type *)(pb.ptr + y * pb.pitch);
+            for (int x = 0; x < pa.width; x++) {
+                const int diff = std::abs((int)ptrA[x] - (int)ptrB[x]);
+                maxDiff = std::max(maxDiff, diff);
+                diffCount += (diff > tolerance) ? 1 : 0;
+            }
+            pixelCount += pa.width;
+        }
+    }
+}
+
+int nnedi_cpu_bench(FILE *fp) {
+    static const int width = 1920;
+    static const int height = 1080;
+    static const int frames = 6;
+    //差が1(8bit換算)を超える画素の割合の許容値 (C版とAVX2版はexpの近似とFMAの有無のみ異なる)
+    static const double diffRatioMax = 0.001;
+    const bool avx2 = (get_availableSIMD() & (AVX2 | FMA3)) == (AVX2 | FMA3);
+    const std::pair<RGY_CSP, const char *> csps[] = {
+        { RGY_CSP_YV12,      "yv12" },
+        { RGY_CSP_YV12_16,   "yv12_16" },
+    };
+    struct NnediCpuBenchCase {
+        const char *name;
+        VppNnediField field;
+        VppNnediNSize nsize;
+        int nns;
+        VppNnediQuality quality;
+        VppNnediPreScreen pre_screen;
+    };
+    static const NnediCpuBenchCase benchCases[] = {
+        { "default",       VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_32x4, 32, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NEW_BLOCK },
+        { "original",      VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x6,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_ORIGINAL },
+        { "new_slow",      VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_16x6, 64, VPP_NNEDI_QUALITY_SLOW, VPP_NNEDI_PRE_SCREEN_NEW },
+        { "none",          VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x4,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NONE },
+        { "original_only", VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x4,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_ORIGINAL_ONLY },
+        { "bob",           VPP_NNEDI_FIELD_BOB_AUTO, VPP_NNEDI_NSIZE_32x4, 32, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NEW_BLOCK },
+    };
+    int ret = 0;
+    {
+        //重みを読み込めない場合は、すべての行がNGとなるので、原因を表示しておく
+        tstring errMes;
+        if (!nnedi_read_weights(tstring(), NULL, errMes)) {
+            _ftprintf(stderr, _T("%s"), errMes.c_str());
+        }
+    }
+    fprintf(fp, "csp,case,simd,tile,frames_in,frames_out,time_ms,fps,hash,max_diff,diff_ratio,verify\n");
+    for (const auto& csp : csps) {
+        vector<unique_ptr<NVEncCpuFrameBuf>> input;
+        if (nnedi_cpu_bench_make_input(input, csp.first, width, height, 4) != RGY_ERR_NONE) {
+            fprintf(fp, "%s,-,-,-,0,0,0.0,0.0,0,0,0.0,NG\n", csp.second);
+            ret |= 1;
+            continue;
+        }
+        for (const auto& benchCase : benchCases) {
+            //16bitは代表的なものだけ
+            if (csp.first == RGY_CSP_YV12_16 && strcmp(benchCase.name, "default") != 0) {
+                continue;
+            }
+            VppNnedi nnedi;
+            nnedi.field = benchCase.field;
+            nnedi.nsize = benchCase.nsize;
+            nnedi.nns = benchCase.nns;
+            nnedi.quality = benchCase.quality;
+            nnedi.pre_screen = benchCase.pre_screen;
+            //C版(1タスク)を基準として、AVX2版が誤差の範囲で一致するか確認する
+            //AVX2版同士ではタイルの大きさによらず、出力が一致することを確認する
+            struct {
+                uint32_t simd;
+                int rowTileMin;
+                const char *simdName;
+            } runs[] = {
+                { NONE, height, "c" },
+                { AVX2 | FMA3, 8, "avx2" },
+                { AVX2 | FMA3, 1, "avx2" },
+            };
+            NnediCpuBenchResult resultRef;
+            uint64_t hashAvx2 = 0;
+            for (int irun = 0; irun < _countof(runs); irun++) {
+                if (runs[irun].simd != NONE && !avx2) {
+                    break;
+                }
+                auto result = nnedi_cpu_bench_run(input, frames, nnedi, runs[irun].simd, runs[irun].rowTileMin);
+                if (result.err != RGY_ERR_NONE || result.framesOut == 0) {
+                    //初期化や処理に失敗した場合は、計測値を出さずにNGとする
+                    fprintf(fp, "%s,%s,%s,%d,%d,%d,0.0,0.0,0,0,0.0,NG\n", csp.second, benchCase.name, runs[irun].simdName, runs[irun].rowTileMin,
+                        frames, result.framesOut);
+                    ret |= 1;
+                    if (irun == 0) {
+                        resultRef = std::move(result);
+                    }
+                    continue;
+                }
+                int maxDiff = 0;
+                int64_t diffCount = 0, pixelCount = 0;
+                bool ok = true;
+                if (irun == 0) {
+                    resultRef = std::move(result);
+                } else {
+                    ok &= result.framesOut == resultRef.framesOut;
+                    const int tolerance = 1 << (RGY_CSP_BIT_DEPTH[csp.first] - 8);
+                    for (int i = 0; ok && i < result.framesOut; i++) {
+                        if (RGY_CSP_BIT_DEPTH[csp.first] > 8) {
+                            nnedi_cpu_bench_diff<uint16_t>(&result.output[i]->frame, &resultRef.output[i]->frame, tolerance, maxDiff, diffCount, pixelCount);
+                        } else {
+                            nnedi_cpu_bench_diff<uint8_t>(&result.output[i]->frame, &resultRef.output[i]->frame, tolerance, maxDiff, diffCount, pixelCount);
+                        }
+                    }
+                    if (hashAvx2 == 0) {
+                        hashAvx2 = result.hash;
+                    }
+                    ok &= result.hash == hashAvx2;
+                }
+                const auto& res = (irun == 0) ? resultRef : result;
+                const double diffRatio = (pixelCount > 0) ? diffCount / (double)pixelCount : 0.0;
+                ok &= diffRatio <= diffRatioMax;
+                fprintf(fp, "%s,%s,%s,%d,%d,%d,%.1f,%.1f,%016llx,%d,%.6f,%s\n", csp.second, benchCase.name, runs[irun].simdName, runs[irun].rowTileMin,
+                    frames, res.framesOut, res.timeMs, frames * 1000.0 / std::max(res.timeMs, 0.001),
+                    (unsigned long long)res.hash, maxDiff, diffRatio, ok ? "OK" : "NG");
+                ret |= ok ? 0 : 1;
+            }
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,290 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include "NVEncFilterCpu.h"
+
+//CUDA版(NVEncFilterResize.cu)と同じ係数
+static const float CPU_SPLINE16_WEIGHT[] = {
+    1.0f,       -9.0f/5.0f,  -1.0f/5.0f, 1.0f,
+    -1.0f/3.0f,  9.0f/5.0f, -46.0f/5.0f, 8.0f/5.0f
+};
+static const float CPU_SPLINE36_WEIGHT[] = {
+    13.0f/11.0f, -453.0f/209.0f,    -3.0f/209.0f,  1.0f,
+    -6.0f/11.0f,  612.0f/209.0f, -1038.0f/209.0f,  540.0f/209.0f,
+     1.0f/11.0f, -159.0f/209.0f,   434.0f/209.0f, -384.0f/209.0f
+};
+static const float CPU_SPLINE64_WEIGHT[] = {
+     49.0f/41.0f, -6387.0f/2911.0f,     -3.0f/2911.0f,  1.0f,
+    -24.0f/41.0f,  9144.0f/2911.0f, -15504.0f/2911.0f,  8064.0f/2911.0f,
+      6.0f/41.0f, -3564.0f/2911.0f,   9726.0f/2911.0f, -8604.0f/2911.0f,
+     -1.0f/41.0f,   807.0f/2911.0f,  -3022.0f/2911.0f,  3720.0f/2911.0f
+};
+
+static int resize_cpu_radius(int interp) {
+    switch (interp) {
+    case RESIZE_CUDA_SPLINE16: return 2;
+    case RESIZE_CUDA_SPLINE36: return 3;
+    case RESIZE_CUDA_SPLINE64: return 4;
+    case RESIZE_CUDA_LANCZOS2: return 2;
+    case RESIZE_CUDA_LANCZOS3: return 3;
+    case RESIZE_CUDA_LANCZOS4: return 4;
+    default: return 0;
+    }
+}
+
+static float spline_factor(const float *factor, int radius, float x) {
+    const float *psWeight = factor + std::min((int)x, radius - 1) * 4;
+    float w = psWeight[3];
+    w += x * psWeight[2];
+    const float x2 = x * x;
+    w += x2 * psWeight[1];
+    w += x2 * x * psWeight[0];
+    return w;
+}
+
+//sinの結果は実行環境のライブラリによって最下位bitが異なることがあるので、倍精度で計算してから丸める
+static float lanczos_factor(int radius, float x) {
+    if (x == 0.0f) return 1.0f;
+    if (x >= (float)radius) return 0.0f;
+    const double pi_x = M_PI * (double)x;
+    return (float)((double)radius * std::sin(pi_x) * std::sin(pi_x / (double)radius) / (pi_x * pi_x));
+}
+
+NVEncFilterCpuResize::NVEncFilterCpuResize() : m_interp(RESIZE_CUDA_SPLINE36), m_outScale(1.0f), m_outMax(255.0f), m_table(), m_tmpBuf() {
+    m_sFilterName = _T("resize");
+}
+
+NVEncFilterCpuResize::~NVEncFilterCpuResize() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuResize::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pResizeParam = std::dynamic_pointer_cast<NVEncFilterParamResize>(pParam);
+    if (!pResizeParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //nppのリサイズはCPU版では、近いものに置き換える
+    if (pResizeParam->interp <= NPPI_INTER_MAX) {
+        const auto interpOrg = pResizeParam->interp;
+        switch (pResizeParam->interp) {
+        case VPP_RESIZE_NPPI_LINEAR:  pResizeParam->interp = RESIZE_CUDA_TEXTURE_BILINEAR; break;
+        case VPP_RESIZE_NPPI_LANCZOS: pResizeParam->interp = RESIZE_CUDA_LANCZOS3; break;
+        default:                      pResizeParam->interp = RESIZE_CUDA_SPLINE36; break;
+        }
+        AddMessage(RGY_LOG_WARN, _T("--vpp-resize of npp (%d) is not supported by cpu filter, switching to %s.\n"),
+            interpOrg, get_chr_from_value(list_vpp_resize_cuda, pResizeParam->interp));
+    }
+    if (pResizeParam->interp != RESIZE_CUDA_TEXTURE_BILINEAR && resize_cpu_radius(pResizeParam->interp) == 0) {
+        AddMessage(RGY_LOG_ERROR, _T("unknown interpolation type: %d.\n"), pResizeParam->interp);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //パラメータチェック
+    if (pResizeParam->frameOut.height <= 0 || pResizeParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto chromaFmt = RGY_CSP_CHROMA_FORMAT[pResizeParam->frameIn.csp];
+    if (pResizeParam->frameOut.csp != pResizeParam->frameIn.csp
+        || pResizeParam->frameIn.csp == RGY_CSP_NV12 || pResizeParam->frameIn.csp == RGY_CSP_P010
+        || (chromaFmt != RGY_CHROMAFMT_YUV420 && chromaFmt != RGY_CHROMAFMT_YUV444 && chromaFmt != RGY_CHROMAFMT_YUVA444)) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+
+    sts = AllocFrameBuf(pResizeParam->frameOut, 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pResizeParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    //CUDA版はテクスチャから0～1に正規化した値を読み込むので、出力の係数もそれに合わせる
+    const int bit_depth = RGY_CSP_BIT_DEPTH[pResizeParam->frameIn.csp];
+    m_interp = pResizeParam->interp;
+    if (m_interp == RESIZE_CUDA_TEXTURE_BILINEAR) {
+        m_outScale = 1.0f;
+        m_outMax = (float)((1 << bit_depth) - 1);
+    } else {
+        m_outScale = (float)(1 << bit_depth) / (float)((1 << bit_depth) - 1);
+        m_outMax = (float)(1 << bit_depth) - 0.1f;
+    }
+    m_table.clear();
+
+    m_sFilterInfo = strsprintf(_T("resize(%s): %dx%d -> %dx%d [cpu %s]"),
+        get_chr_from_value(list_vpp_resize_cuda, pResizeParam->interp),
+        pResizeParam->frameIn.width, pResizeParam->frameIn.height,
+        pResizeParam->frameOut.width, pResizeParam->frameOut.height,
+        m_pKernel->name);
+
+    //コピーを保存
+    m_pParam = pResizeParam;
+    return sts;
+}
+
+const NVEncFilterCpuResize::ResizeTable *NVEncFilterCpuResize::getTable(int src, int dst) {
+    for (const auto& table : m_table) {
+        if (table->src == src && table->dst == dst) {
+            return table.get();
+        }
+    }
+    unique_ptr<ResizeTable> table(new ResizeTable());
+    table->src = src;
+    table->dst = dst;
+    table->stride = ALIGN(dst, 8);
+    if (m_interp == RESIZE_CUDA_TEXTURE_BILINEAR) {
+        //テクスチャの線形補間 (正規化座標、アドレスはclamp、補間の重みは1/256単位)
+        table->taps = 2;
+        table->index.resize(table->taps * table->stride, 0);
+        table->weight.resize(table->taps * table->stride, 0.0f);
+        const float ratio = 1.0f / (float)dst;
+        for (int d = 0; d < dst; d++) {
+            const float xb = ((float)d + 0.5f) * ratio * (float)src - 0.5f;
+            const float fx = std::floor(xb);
+            const float a = std::floor((xb - fx) * 256.0f + 0.5f) * (1.0f / 256.0f);
+            const int ix = (int)fx;
+            table->index[0 * table->stride + d] = clamp(ix + 0, 0, src - 1);
+            table->index[1 * table->stride + d] = clamp(ix + 1, 0, src - 1);
+            table->weight[0 * table->stride + d] = 1.0f - a;
+            table->weight[1 * table->stride + d] = a;
+        }
+    } else {
+        const int radius = resize_cpu_radius(m_interp);
+        const float *splineFactor = nullptr;
+        switch (m_interp) {
+        case RESIZE_CUDA_SPLINE16: splineFactor = CPU_SPLINE16_WEIGHT; break;
+        case RESIZE_CUDA_SPLINE36: splineFactor = CPU_SPLINE36_WEIGHT; break;
+        case RESIZE_CUDA_SPLINE64: splineFactor = CPU_SPLINE64_WEIGHT; break;
+        default: break;
+        }
+        table->taps = radius * 2;
+        table->index.resize(table->taps * table->stride, 0);
+        table->weight.resize(table->taps * table->stride, 0.0f);
+        const float ratio = src / (float)dst;
+        //拡大ならratioDistは1.0f、縮小ならratioの逆数(縮小側の距離に変換)
+        const float ratioDist = (src <= dst) ? 1.0f : dst / (float)src;
+        for (int d = 0; d < dst; d++) {
+            //ピクセルの中心を算出してからスケール
+            const float x = ((float)d + 0.5f) * ratio;
+            float weight[8];
+            float weightSum = 0.0f;
+            for (int i = 0; i < radius * 2; i++) {
+                //+0.5fはピクセル中心とするため
+                const float sx = std::floor(x) + i - radius + 1.0f + 0.5f;
+                const float dx = std::abs(sx - x) * ratioDist;
+                weight[i] = (splineFactor) ? spline_factor(splineFactor, radius, dx) : lanczos_factor(radius, dx);
+                weightSum += weight[i];
+                table->index[i * table->stride + d] = clamp((int)std::floor(x) + i - radius + 1, 0, src - 1);
+            }
+            //CUDA版は縦横の重みの積の和で正規化するが、分離して各方向の和で正規化しても同じ
+            const float weightSumInv = 1.0f / weightSum;
+            for (int i = 0; i < radius * 2; i++) {
+                table->weight[i * table->stride + d] = weight[i] * weightSumInv;
+            }
+        }
+    }
+    m_table.push_back(std::move(table));
+    return m_table.back().get();
+}
+
+RGY_ERR NVEncFilterCpuResize::resizePlane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane) {
+    const auto tableX = getTable(pInputPlane->width, pOutputPlane->width);
+    const auto tableY = getTable(pInputPlane->height, pOutputPlane->height);
+    const int in16 = (RGY_CSP_BIT_DEPTH[pInputPlane->csp] > 8) ? 1 : 0;
+    const auto conv_v = m_pKernel->conv_v[in16];
+    const auto resize_h = m_pKernel->resize_h[in16];
+    //タスクごとの作業領域 (縦方向の処理結果の1行分)
+    const int tasks = rowTaskCount(pOutputPlane->height);
+    if ((int)m_tmpBuf.size() < tasks) {
+        m_tmpBuf.resize(tasks);
+    }
+    for (int i = 0; i < tasks; i++) {
+        if ((int)m_tmpBuf[i].size() < pInputPlane->width + 8) {
+            m_tmpBuf[i].resize(pInputPlane->width + 8, 0.0f);
+        }
+    }
+    run_rows(pOutputPlane->height, [&](int y_start, int y_end, int task_id) {
+        float *tmp = m_tmpBuf[task_id].data();
+        for (int y = y_start; y < y_end; y++) {
+            int rows[8];
+            float weight[8];
+            for (int i = 0; i < tableY->taps; i++) {
+                rows[i] = tableY->index[i * tableY->stride + y] * pInputPlane->pitch;
+                weight[i] = tableY->weight[i * tableY->stride + y];
+            }
+            conv_v(tmp, pInputPlane->ptr, pInputPlane->width, rows, weight, tableY->taps);
+            resize_h(pOutputPlane->ptr + y * pOutputPlane->pitch, tmp, pOutputPlane->width,
+                tableX->index.data(), tableX->weight.data(), tableX->taps, tableX->stride, m_outScale, m_outMax);
+        }
+    });
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuResize::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+
+    *pOutputFrameNum = 1;
+    if (ppOutputFrames[0] == nullptr) {
+        auto pOutFrame = m_pFrameBuf[m_nFrameIdx].get();
+        ppOutputFrames[0] = &pOutFrame->frame;
+        m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+    }
+    ppOutputFrames[0]->picstruct = pInputFrame->picstruct;
+    if (interlaced(*pInputFrame)) {
+        return filter_as_interlaced_pair(pInputFrame, ppOutputFrames[0]);
+    }
+    if (m_pParam->frameOut.csp != m_pParam->frameIn.csp) {
+        AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V, RGY_PLANE_A }) {
+        const auto planeSrc = getPlane(pInputFrame, plane);
+        auto planeOutput = getPlane(ppOutputFrames[0], plane);
+        if (planeSrc.ptr == nullptr || planeOutput.ptr == nullptr) {
+            continue;
+        }
+        sts = resizePlane(&planeOutput, &planeSrc);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    return sts;
+}
+
+void NVEncFilterCpuResize::close() {
+    m_pFrameBuf.clear();
+    m_table.clear();
+    m_tmpBuf.clear();
+}
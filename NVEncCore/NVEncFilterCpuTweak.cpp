@@ -0,0 +1,176 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include "NVEncFilterCpu.h"
+
+NVEncFilterCpuTweak::NVEncFilterCpuTweak() : m_lutY() {
+    m_sFilterName = _T("tweak");
+}
+
+NVEncFilterCpuTweak::~NVEncFilterCpuTweak() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuTweak::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pTweakParam = std::dynamic_pointer_cast<NVEncFilterParamTweak>(pParam);
+    if (!pTweakParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //tweakは常に元のフレームを書き換え
+    if (!pTweakParam->bOutOverwrite) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid param, tweak will overwrite input frame.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    pTweakParam->frameOut = pTweakParam->frameIn;
+
+    //パラメータチェック
+    if (pTweakParam->frameOut.height <= 0 || pTweakParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto csp = pTweakParam->frameIn.csp;
+    if (csp != RGY_CSP_YV12 && csp != RGY_CSP_YV12_16 && csp != RGY_CSP_YUV444 && csp != RGY_CSP_YUV444_16) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp %s.\n"), RGY_CSP_NAMES[csp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (pTweakParam->tweak.brightness < -1.0f || 1.0f < pTweakParam->tweak.brightness) {
+        pTweakParam->tweak.brightness = clamp(pTweakParam->tweak.brightness, -1.0f, 1.0f);
+        AddMessage(RGY_LOG_WARN, _T("brightness should be in range of %.1f - %.1f.\n"), -1.0f, 1.0f);
+    }
+    if (pTweakParam->tweak.contrast < -2.0f || 2.0f < pTweakParam->tweak.contrast) {
+        pTweakParam->tweak.contrast = clamp(pTweakParam->tweak.contrast, -2.0f, 2.0f);
+        AddMessage(RGY_LOG_WARN, _T("contrast should be in range of %.1f - %.1f.\n"), -2.0f, 2.0f);
+    }
+    if (pTweakParam->tweak.saturation < 0.0f || 3.0f < pTweakParam->tweak.saturation) {
+        pTweakParam->tweak.saturation = clamp(pTweakParam->tweak.saturation, 0.0f, 3.0f);
+        AddMessage(RGY_LOG_WARN, _T("saturation should be in range of %.1f - %.1f.\n"), 0.0f, 3.0f);
+    }
+    if (pTweakParam->tweak.gamma < 0.1f || 10.0f < pTweakParam->tweak.gamma) {
+        pTweakParam->tweak.gamma = clamp(pTweakParam->tweak.gamma, 0.1f, 10.0f);
+        AddMessage(RGY_LOG_WARN, _T("gamma should be in range of %.1f - %.1f.\n"), 0.1f, 10.0f);
+    }
+
+    //輝度の変換はすべての画素値について事前に計算しておく (CUDA版のapply_basic_tweak_yと同じ式)
+    const int bit_depth = RGY_CSP_BIT_DEPTH[csp];
+    const float contrast = pTweakParam->tweak.contrast;
+    const float brightness = pTweakParam->tweak.brightness;
+    const float gamma_inv = 1.0f / pTweakParam->tweak.gamma;
+    m_lutY.resize(1 << bit_depth);
+    for (int i = 0; i < (1 << bit_depth); i++) {
+        float pixel = (float)i * (1.0f / (1 << bit_depth));
+        pixel = contrast * (pixel - 0.5f) + 0.5f + brightness;
+        //powfの結果は実行環境のライブラリによって最下位bitが異なることがあるので、倍精度で計算してから丸める
+        pixel = (float)std::pow((double)pixel, (double)gamma_inv);
+        //負の値のべき乗はNaNとなる (CUDAでは整数への変換で0になる)
+        //整数への変換でオーバーフローしないよう、clampの結果が変わらない範囲に制限してから変換する
+        pixel = (std::isnan(pixel)) ? 0.0f : clamp(pixel, -1.0f, 2.0f);
+        m_lutY[i] = (uint16_t)clamp((int)(pixel * (1 << bit_depth)), 0, (1 << bit_depth) - 1);
+    }
+
+    m_sFilterInfo = strsprintf(_T("tweak: brightness %.2f, contrast %.2f, saturation %.2f, gamma %.2f, hue %.2f [cpu %s]"),
+        pTweakParam->tweak.brightness, pTweakParam->tweak.contrast, pTweakParam->tweak.saturation, pTweakParam->tweak.gamma, pTweakParam->tweak.hue,
+        m_pKernel->name);
+
+    //コピーを保存
+    m_pParam = pTweakParam;
+    return sts;
+}
+
+template<typename Type>
+static void tweak_y_lut(uint8_t *ptr, int pitch, int width, int y_start, int y_end, const uint16_t *lut) {
+    for (int y = y_start; y < y_end; y++) {
+        Type *ptrY = (Type *)(ptr + y * pitch);
+        for (int x = 0; x < width; x++) {
+            ptrY[x] = (Type)lut[ptrY[x]];
+        }
+    }
+}
+
+RGY_ERR NVEncFilterCpuTweak::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+
+    *pOutputFrameNum = 1;
+    if (ppOutputFrames[0] == nullptr) {
+        AddMessage(RGY_LOG_ERROR, _T("ppOutputFrames[0] must be set.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (m_pParam->frameOut.csp != m_pParam->frameIn.csp) {
+        AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    ppOutputFrames[0]->picstruct = pInputFrame->picstruct;
+    auto pTweakParam = std::dynamic_pointer_cast<NVEncFilterParamTweak>(m_pParam);
+    if (!pTweakParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    FrameInfo *pFrame = ppOutputFrames[0];
+    const int bit_depth = RGY_CSP_BIT_DEPTH[pFrame->csp];
+    const int high = (bit_depth > 8) ? 1 : 0;
+    const auto& tweak = pTweakParam->tweak;
+
+    //Y
+    if (   tweak.contrast != 1.0f
+        || tweak.brightness != 0.0f
+        || tweak.gamma != 1.0f) {
+        const auto planeY = getPlane(pFrame, RGY_PLANE_Y);
+        const auto func = (high) ? tweak_y_lut<uint16_t> : tweak_y_lut<uint8_t>;
+        run_rows(planeY.height, [&](int y_start, int y_end, int task_id) {
+            func(planeY.ptr, planeY.pitch, planeY.width, y_start, y_end, m_lutY.data());
+        });
+    }
+
+    //UV
+    if (tweak.saturation != 1.0f
+        || tweak.hue != 0.0f) {
+        const float hue = tweak.hue * (float)M_PI / 180.0f;
+        const float hue_sin = (float)std::sin((double)hue) * tweak.saturation;
+        const float hue_cos = (float)std::cos((double)hue) * tweak.saturation;
+        const auto planeU = getPlane(pFrame, RGY_PLANE_U);
+        const auto planeV = getPlane(pFrame, RGY_PLANE_V);
+        const auto func = m_pKernel->tweak_uv[high];
+        run_rows(planeU.height, [&](int y_start, int y_end, int task_id) {
+            func(planeU.ptr, planeV.ptr, planeU.pitch, planeU.width, y_start, y_end,
+                tweak.saturation, hue_sin, hue_cos, bit_depth);
+        });
+    }
+    return sts;
+}
+
+void NVEncFilterCpuTweak::close() {
+    m_pFrameBuf.clear();
+    m_lutY.clear();
+}
@@ -0,0 +1,196 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include "NVEncFilterCpu.h"
+
+static const int UNSHARP_CPU_RADIUS_MAX = 9;
+
+//CUDA版の2次元のガウシアンの重みは、1次元の重みの積を正規化したものと同じ
+static vector<float> unsharp_cpu_weight(int radius, float sigma) {
+    vector<double> weight(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        weight[i + radius] = std::exp(-1.0 * (i * i) / (2.0 * sigma * sigma));
+        sum += weight[i + radius];
+    }
+    vector<float> weightNorm(weight.size());
+    for (size_t i = 0; i < weight.size(); i++) {
+        weightNorm[i] = (float)(weight[i] / sum);
+    }
+    return weightNorm;
+}
+
+NVEncFilterCpuUnsharp::NVEncFilterCpuUnsharp() : m_gaussY(), m_gaussUV(), m_tmpBuf() {
+    m_sFilterName = _T("unsharp");
+}
+
+NVEncFilterCpuUnsharp::~NVEncFilterCpuUnsharp() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuUnsharp::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    m_pPrintMes = pPrintMes;
+    auto pUnsharpParam = std::dynamic_pointer_cast<NVEncFilterParamUnsharp>(pParam);
+    if (!pUnsharpParam) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //パラメータチェック
+    if (pUnsharpParam->frameOut.height <= 0 || pUnsharpParam->frameOut.width <= 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto csp = pUnsharpParam->frameIn.csp;
+    if (csp != RGY_CSP_YV12 && csp != RGY_CSP_YV12_16 && csp != RGY_CSP_YUV444 && csp != RGY_CSP_YUV444_16) {
+        AddMessage(RGY_LOG_ERROR, _T("unsupported csp %s.\n"), RGY_CSP_NAMES[csp]);
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (pUnsharpParam->unsharp.radius < 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter (radius).\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (pUnsharpParam->unsharp.radius < 1 || pUnsharpParam->unsharp.radius > UNSHARP_CPU_RADIUS_MAX) {
+        AddMessage(RGY_LOG_WARN, _T("radius must be in range of 1-%d.\n"), UNSHARP_CPU_RADIUS_MAX);
+        pUnsharpParam->unsharp.radius = clamp(pUnsharpParam->unsharp.radius, 1, UNSHARP_CPU_RADIUS_MAX);
+    }
+    if (pUnsharpParam->unsharp.weight < 0.0f || 10.0f < pUnsharpParam->unsharp.weight) {
+        pUnsharpParam->unsharp.weight = clamp(pUnsharpParam->unsharp.weight, 0.0f, 10.0f);
+        AddMessage(RGY_LOG_WARN, _T("weight should be in range of %.1f - %.1f.\n"), 0.0f, 10.0f);
+    }
+    if (pUnsharpParam->unsharp.threshold < 0.0f || 255.0f < pUnsharpParam->unsharp.threshold) {
+        pUnsharpParam->unsharp.threshold = clamp(pUnsharpParam->unsharp.threshold, 0.0f, 255.0f);
+        AddMessage(RGY_LOG_WARN, _T("threshold should be in range of %.1f - %.1f.\n"), 0.0f, 255.0f);
+    }
+
+    sts = AllocFrameBuf(pUnsharpParam->frameOut, 1);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory: %s.\n"), get_err_mes(sts));
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    pUnsharpParam->frameOut.pitch = m_pFrameBuf[0]->frame.pitch;
+
+    const int radius = pUnsharpParam->unsharp.radius;
+    const float sigmaY = 0.8f + 0.3f * radius;
+    const float sigmaUV = (RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV420) ? 0.8f + 0.3f * (radius * 0.5f + 0.25f) : sigmaY;
+    m_gaussY = unsharp_cpu_weight(radius, sigmaY);
+    m_gaussUV = unsharp_cpu_weight(radius, sigmaUV);
+
+    m_sFilterInfo = strsprintf(_T("unsharp: radius %d, weight %.1f, threshold %.1f [cpu %s]"),
+        pUnsharpParam->unsharp.radius, pUnsharpParam->unsharp.weight, pUnsharpParam->unsharp.threshold, m_pKernel->name);
+
+    //コピーを保存
+    m_pParam = pUnsharpParam;
+    return sts;
+}
+
+RGY_ERR NVEncFilterCpuUnsharp::unsharpPlane(FrameInfo *pOutputPlane, const FrameInfo *pInputPlane, const vector<float>& gauss) {
+    auto pUnsharpParam = std::dynamic_pointer_cast<NVEncFilterParamUnsharp>(m_pParam);
+    const int radius = pUnsharpParam->unsharp.radius;
+    //CUDA版と同様、閾値は格納する型のビット数で正規化する
+    const int type_bits = (RGY_CSP_BIT_DEPTH[pInputPlane->csp] > 8) ? 16 : 8;
+    const int high = (type_bits > 8) ? 1 : 0;
+    const float scale = 1.0f / (float)((1 << type_bits) - 1);
+    const float threshold = pUnsharpParam->unsharp.threshold / (1 << type_bits);
+    const float outScale = (float)(1 << type_bits);
+    const auto conv_v = m_pKernel->conv_v[high];
+    const auto unsharp_h = m_pKernel->unsharp_h[high];
+
+    //タスクごとの作業領域 (左右にradius分、さらにSIMDで読み込む分の余白を追加する)
+    const int tasks = rowTaskCount(pOutputPlane->height);
+    const int tmpSize = pInputPlane->width + 2 * radius + 8;
+    if ((int)m_tmpBuf.size() < tasks) {
+        m_tmpBuf.resize(tasks);
+    }
+    for (int i = 0; i < tasks; i++) {
+        if ((int)m_tmpBuf[i].size() < tmpSize) {
+            m_tmpBuf[i].resize(tmpSize, 0.0f);
+        }
+    }
+    run_rows(pOutputPlane->height, [&](int y_start, int y_end, int task_id) {
+        float *tmp = m_tmpBuf[task_id].data() + radius;
+        const int width = pInputPlane->width;
+        for (int y = y_start; y < y_end; y++) {
+            //上下端はclamp (CUDA版のテクスチャのアドレスモードと同じ)
+            int rows[2 * UNSHARP_CPU_RADIUS_MAX + 1];
+            for (int j = -radius; j <= radius; j++) {
+                rows[j + radius] = clamp(y + j, 0, pInputPlane->height - 1) * pInputPlane->pitch;
+            }
+            conv_v(tmp, pInputPlane->ptr, width, rows, gauss.data(), 2 * radius + 1);
+            //左右端もclamp
+            for (int i = 1; i <= radius; i++) {
+                tmp[-i] = tmp[0];
+                tmp[width - 1 + i] = tmp[width - 1];
+            }
+            unsharp_h(pOutputPlane->ptr + y * pOutputPlane->pitch, tmp,
+                pInputPlane->ptr + y * pInputPlane->pitch, width, gauss.data(), radius,
+                scale, pUnsharpParam->unsharp.weight, threshold, outScale);
+        }
+    });
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuUnsharp::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    RGY_ERR sts = RGY_ERR_NONE;
+    if (pInputFrame->ptr == nullptr) {
+        return sts;
+    }
+
+    *pOutputFrameNum = 1;
+    if (ppOutputFrames[0] == nullptr) {
+        auto pOutFrame = m_pFrameBuf[m_nFrameIdx].get();
+        ppOutputFrames[0] = &pOutFrame->frame;
+        m_nFrameIdx = (m_nFrameIdx + 1) % m_pFrameBuf.size();
+    }
+    ppOutputFrames[0]->picstruct = pInputFrame->picstruct;
+    if (interlaced(*pInputFrame)) {
+        return filter_as_interlaced_pair(pInputFrame, ppOutputFrames[0]);
+    }
+    if (m_pParam->frameOut.csp != m_pParam->frameIn.csp) {
+        AddMessage(RGY_LOG_ERROR, _T("csp does not match.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto planeSrc = getPlane(pInputFrame, plane);
+        auto planeOutput = getPlane(ppOutputFrames[0], plane);
+        sts = unsharpPlane(&planeOutput, &planeSrc, (plane == RGY_PLANE_Y) ? m_gaussY : m_gaussUV);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
+    }
+    return sts;
+}
+
+void NVEncFilterCpuUnsharp::close() {
+    m_pFrameBuf.clear();
+    m_gaussY.clear();
+    m_gaussUV.clear();
+    m_tmpBuf.clear();
+}
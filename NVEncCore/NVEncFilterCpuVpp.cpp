@@ -0,0 +1,94 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include "NVEncFilterCpuVpp.h"
+#include "NVEncParam.h"
+
+NVEncFilterCpuVpp::NVEncFilterCpuVpp() :
+    m_chain(),
+    m_outputFrames() {
+    m_sFilterName = _T("vpp-cpu");
+}
+
+NVEncFilterCpuVpp::~NVEncFilterCpuVpp() {
+    close();
+}
+
+RGY_ERR NVEncFilterCpuVpp::init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) {
+    m_pPrintMes = pPrintMes;
+    auto prm = std::dynamic_pointer_cast<NVEncFilterParamCpuVpp>(pParam);
+    if (!prm) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (prm->frameIn.deivce_mem) {
+        AddMessage(RGY_LOG_ERROR, _T("input frame must be on cpu memory.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    //入力はcrop済み (cuvidでデコードする場合はvpp-cpuを使用できない)
+    sInputCrop crop = { 0 };
+    auto sts = m_chain.init(prm->frameIn, crop, prm->dstWidth, prm->dstHeight, prm->vpp,
+        prm->inFps, prm->timebase, prm->outFilename, prm->frameOut.csp, prm->simd, pPrintMes);
+    if (sts != RGY_ERR_NONE) {
+        return sts;
+    }
+    prm->frameOut = m_chain.frameOut();
+    prm->baseFps = m_chain.baseFps();
+
+    //タイムスタンプ等はCPU版の各フィルタで設定される
+    m_nPathThrough = FILTER_PATHTHROUGH_NONE;
+
+    m_sFilterInfo.clear();
+    for (const auto& filter : m_chain.filters()) {
+        m_sFilterInfo += strsprintf(_T("%scpu %s"), (m_sFilterInfo.length()) ? _T("\n               ") : _T(""), filter->GetInputMessage().c_str());
+    }
+    m_pParam = pParam;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR NVEncFilterCpuVpp::run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) {
+    ppOutputFrames[0] = nullptr;
+    *pOutputFrameNum = 0;
+
+    //入力がない場合は、フィルタに残っているフレームを取り出す
+    //CPU版のフィルタは入力を上書きしないので、const_castしてよい
+    FrameInfo *pChainInput = (pInputFrame->ptr != nullptr) ? const_cast<FrameInfo *>(pInputFrame) : nullptr;
+    auto sts = m_chain.filter(pChainInput, m_outputFrames);
+    if (sts != RGY_ERR_NONE) {
+        return sts;
+    }
+    for (size_t i = 0; i < m_outputFrames.size(); i++) {
+        ppOutputFrames[i] = m_outputFrames[i];
+    }
+    *pOutputFrameNum = (int)m_outputFrames.size();
+    return RGY_ERR_NONE;
+}
+
+void NVEncFilterCpuVpp::close() {
+    m_chain.close();
+    m_outputFrames.clear();
+}
@@ -0,0 +1,63 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "NVEncFilter.h"
+#include "NVEncParam.h"
+#include "NVEncFilterCpu.h"
+
+class NVEncFilterParamCpuVpp : public NVEncFilterParam {
+public:
+    VppParam vpp;
+    int dstWidth;  //padを含む出力の幅 (0ならリサイズしない)
+    int dstHeight; //padを含む出力の高さ (0ならリサイズしない)
+    rgy_rational<int> inFps;
+    rgy_rational<int> timebase;
+    tstring outFilename;
+    uint32_t simd;
+
+    NVEncFilterParamCpuVpp() : vpp(), dstWidth(0), dstHeight(0), inFps(), timebase(), outFilename(), simd(0) {
+
+    };
+    virtual ~NVEncFilterParamCpuVpp() {};
+};
+
+//--vpp-cpu: CPU版のフィルタチェーンをNVEncFilterとして実行する
+//入力/出力ともにCPU側のフレームで、GPUへの転送は後段のフィルタで行う
+class NVEncFilterCpuVpp : public NVEncFilter {
+public:
+    NVEncFilterCpuVpp();
+    virtual ~NVEncFilterCpuVpp();
+    virtual RGY_ERR init(shared_ptr<NVEncFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+protected:
+    virtual RGY_ERR run_filter(const FrameInfo *pInputFrame, FrameInfo **ppOutputFrames, int *pOutputFrameNum) override;
+    virtual void close() override;
+
+    NVEncFilterCpuChain m_chain;
+    vector<FrameInfo *> m_outputFrames;
+};
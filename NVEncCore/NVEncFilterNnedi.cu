@@ -32,10 +32,12 @@
 #include <fstream>
 #include <algorithm>
 #include <numeric>
+#include <deque>
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include "convert_csp.h"
 #include "NVEncFilterNnedi.h"
+#include "NVEncFilterCpu.h"
 #include "NVEncParam.h"
 #pragma warning (push)
 #pragma warning (disable: 4819)
@@ -51,9 +53,6 @@
 static const int NNEDI_BLOCK_X       = 32;
 static const int NNEDI_BLOCK_Y       = 8;
 
-static const int weight0size = 49 * 4 + 5 * 4 + 9 * 4;
-static const int weight0sizenew = 4 * 65 + 4 * 5;
-
 static const int TRASNPOSE_BLOCK_DIM = 16;
 static const int TRASNPOSE_TILE_DIM  = 64;
 
@@ -1259,8 +1258,8 @@ cudaError_t nnedi_compute_network_1(
         divCeil(pOutputFrame->width, blockSize.x),
         divCeil(pOutputFrame->height / 2, blockSize.y * THREAD_Y_LOOP));
 
-    const int nnx = NVEncFilterNnedi::sizeNX[nsize];
-    const int nny = NVEncFilterNnedi::sizeNY[nsize];
+    const int nnx = NNEDI_SIZE_NX[nsize];
+    const int nny = NNEDI_SIZE_NY[nsize];
     const int shared_mem_size =
         (NNEDI_BLOCK_X + nnx) * (NNEDI_BLOCK_Y * THREAD_Y_LOOP + nny) * sizeof(TypeCalc) + //src
         (NNEDI_BLOCK_Y * THREAD_Y_LOOP + nny) * NNEDI_BLOCK_X * 2 * sizeof(TypeCalc); //temp
@@ -1444,9 +1443,6 @@ cudaError_t proc_frame(FrameInfo *pOutputFrame,
 }
 
 const int NVEncFilterNnedi::weight_loop_1 = 4;
-const int NVEncFilterNnedi::sizeNX[] = { 8, 16, 32, 48, 8, 16, 32 };
-const int NVEncFilterNnedi::sizeNY[] = { 6, 6, 6, 6, 4, 4, 4 };
-const int NVEncFilterNnedi::sizeNN[] = { 16, 32, 64, 128, 256 };
 
 NVEncFilterNnedi::NVEncFilterNnedi() : m_weight0(), m_weight1() {
     m_sFilterName = _T("nnedi");
@@ -1495,59 +1491,12 @@ RGY_ERR NVEncFilterNnedi::checkParam(const std::shared_ptr<NVEncFilterParamNnedi
 }
 
 shared_ptr<const float> NVEncFilterNnedi::readWeights(const tstring& weightFile, HMODULE hModule) {
-    shared_ptr<const float> weights;
-    const uint32_t expectedFileSize = 13574928u;
-    uint64_t weightFileSize = 0;
-    if (weightFile.length() == 0) {
-        //埋め込みデータを使用する
-        if (hModule == NULL) {
-            hModule = GetModuleHandle(NULL);
-        }
-        HRSRC hResource = NULL;
-        HGLOBAL hResourceData = NULL;
-        const char *pDataPtr = NULL;
-        if (NULL == hModule) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to get module handle.\n"));
-        } else if (NULL == (hResource = FindResource(hModule, _T("NNEDI_WEIGHTBIN"), _T("EXE_DATA")))) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to get resource handle for \"NNEDI_WEIGHTBIN\".\n"));
-        } else if (NULL == (hResourceData = LoadResource(hModule, hResource))) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to load resource \"NNEDI_WEIGHTBIN\".\n"));
-        } else if (NULL == (pDataPtr = (const char *)LockResource(hResourceData))) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to lock resource \"NNEDI_WEIGHTBIN\".\n"));
-        } else if (expectedFileSize != (weightFileSize = SizeofResource(hModule, hResource))) {
-            AddMessage(RGY_LOG_ERROR, _T("Weights data has unexpected size %u [expected: %u].\n"),
-                weightFile.c_str(), (uint32_t)weightFileSize, expectedFileSize);
-        } else {
-            weights = shared_ptr<const float>((const float *)pDataPtr, [](const float *x) { return; /*何もしない*/ });
-        }
-    } else {
-        if (!PathFileExists(weightFile.c_str())) {
-            AddMessage(RGY_LOG_ERROR, _T("weight file \"%s\" does not exist.\n"), weightFile.c_str());
-        } else if (!rgy_get_filesize(weightFile.c_str(), &weightFileSize)) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to get filesize of weight file \"%s\".\n"), weightFile.c_str());
-        } else if (weightFileSize != expectedFileSize) {
-            AddMessage(RGY_LOG_ERROR, _T("Weights file \"%s\" has unexpected file size %u [expected: %u].\n"),
-                weightFile.c_str(), (uint32_t)weightFileSize, expectedFileSize);
-        } else {
-            std::ifstream fin(weightFile, std::ios::in | std::ios::binary);
-            if (!fin.good()) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to open weights file \"%s\".\n"), weightFile.c_str());
-            } else {
-                float *buffer = new float[weightFileSize / sizeof(float)];
-                if (!buffer) {
-                    AddMessage(RGY_LOG_ERROR, _T("Failed to allocate buffer memory for \"%s\".\n"), weightFile.c_str());
-                } else {
-                    weights = shared_ptr<float>(buffer, std::default_delete<float[]>());
-                    if (fin.read((char *)weights.get(), weightFileSize).gcount() != (int64_t)weightFileSize) {
-                        AddMessage(RGY_LOG_ERROR, _T("Failed to read weights file \"%s\".\n"), weightFile.c_str());
-                        weights.reset();
-                    }
-                }
-                fin.close();
-            }
-        }
+    tstring errMes;
+    auto weights = nnedi_read_weights(weightFile, hModule, errMes);
+    if (!weights) {
+        AddMessage(RGY_LOG_ERROR, errMes);
     }
-    return std::move(weights);
+    return weights;
 }
 
 RGY_ERR NVEncFilterNnedi::initParams(const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
@@ -1566,22 +1515,11 @@ RGY_ERR NVEncFilterNnedi::initParams(const std::shared_ptr<NVEncFilterParamNnedi
 #endif
     }
 
-    const int weight1size = pNnediParam->nnedi.nns * 2 * (sizeNX[pNnediParam->nnedi.nsize] * sizeNY[pNnediParam->nnedi.nsize] + 1);
+    const int weight1size = nnedi_weight1_size(pNnediParam->nnedi);
     const int sizeofweight = (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP32) ? 4 : 2;
-    int weight1size_tsize = 0;
-    int weight1size_offset = 0;
-    for (int j = 0; j < (int)_countof(sizeNN); j++) {
-        for (int i = 0; i < (int)_countof(sizeNX); i++) {
-            if (i == pNnediParam->nnedi.nsize
-                && j == get_cx_index(list_vpp_nnedi_nns, pNnediParam->nnedi.nns)) {
-                weight1size_offset = weight1size_tsize;
-            }
-            weight1size_tsize += sizeNN[j] * (sizeNX[i] * sizeNY[i] + 1) * 4;
-        }
-    }
 
     std::vector<char> weight0f;
-    weight0f.resize((((pNnediParam->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW) ? weight0sizenew : weight0size) * sizeofweight);
+    weight0f.resize((((pNnediParam->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW) ? NNEDI_WEIGHT0_SIZE_NEW : NNEDI_WEIGHT0_SIZE) * sizeofweight);
     if (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP32) {
         setWeight0<float>((float *)weight0f.data(), weights.get(), pNnediParam);
     } else {
@@ -1593,12 +1531,11 @@ RGY_ERR NVEncFilterNnedi::initParams(const std::shared_ptr<NVEncFilterParamNnedi
     std::array<std::vector<char>, 2> weight1;
     for (int i = 0; i < 2; i++) {
         weight1[i].resize(weight1size * sizeofweight, 0);
-        const float *ptrW = weights.get() + weight0size + weight0sizenew * 3 + weight1size_tsize * pNnediParam->nnedi.errortype + weight1size_offset + i * weight1size;
         if (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP32) {
-            setWeight1<float>((float *)weight1[i].data(), ptrW, pNnediParam);
+            setWeight1<float>((float *)weight1[i].data(), weights.get(), i, pNnediParam);
         } else {
 #if ENABLE_CUDA_FP16_HOST
-            setWeight1<__half>((__half *)weight1[i].data(), ptrW, pNnediParam);
+            setWeight1<__half>((__half *)weight1[i].data(), weights.get(), i, pNnediParam);
 #endif //#if ENABLE_CUDA_FP16_HOST
         }
     }
@@ -1620,44 +1557,20 @@ template<> __half toWeight<__half>(float f) { return __float2half_rn(f); }
 #endif
 
 template<typename TypeCalc>
-void NVEncFilterNnedi::setWeight0(TypeCalc *ptrDst, const float *ptrW, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
-    if ((pNnediParam->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW) {
-        auto index = [](int j, int k) {
-            return ((k >> 3) << 5) + ((j & 3) << 3) + (k & 7);
-        };
-
-        const auto ptr_w = ptrW + weight0size + weight0sizenew * ((pNnediParam->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) - VPP_NNEDI_PRE_SCREEN_NEW);
-        double avg[4] = { 0.0, 0.0, 0.0, 0.0 };
-        for (int j = 0; j < 4; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < 64; k++) {
-                sum += ptr_w[index(j, k)];
-            }
-            avg[j] = sum * (1.0 / 64.0);
-        }
-        const double halfinv = 1.0 / (((1 << 8) - 1) * 0.5);
-        for (int j = 0; j < 4; j++) {
-            for (int k = 0; k < 64; k++) {
-                //ptrDst[index(j, k)] = (float)((ptr_w[index(j, k)] - avg[j]) * halfinv);
-                ptrDst[j*64+k] = toWeight<TypeCalc>((float)((ptr_w[index(j, k)] - avg[j]) * halfinv));
-            }
-        }
-        for (int i = 0; i < 4; i++) {
-            ptrDst[4*64+i] = toWeight<TypeCalc>(ptr_w[4*64+i]);
-        }
-        for (int j = 0; j < 4; j++) {
-            for (int k = 0; k < 4; k++) {
-                ptrDst[4*65+j*4+k] = toWeight<TypeCalc>(ptr_w[4*65+ j + k*4]); //転置
-            }
-        }
-        for (int i = 0; i < 4; i++) {
-            ptrDst[4*65+4*4+i] = toWeight<TypeCalc>(ptr_w[4*65+4*4+i]);
-        }
-        //<<<<<< ここまでで通常(CPU版)の並びのデータが作成できた
+void NVEncFilterNnedi::setWeight0(TypeCalc *ptrDst, const float *weights, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
+    //通常(CPU版)の並びのデータを作成する
+    const bool prescreen_new = (pNnediParam->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW;
+    std::vector<float> weight0(prescreen_new ? NNEDI_WEIGHT0_SIZE_NEW : NNEDI_WEIGHT0_SIZE);
+    nnedi_set_weight0(weight0.data(), weights, pNnediParam->nnedi.pre_screen);
+    for (size_t i = 0; i < weight0.size(); i++) {
+        ptrDst[i] = toWeight<TypeCalc>(weight0[i]);
+    }
+    //<<<<<< ここまでで通常(CPU版)の並びのデータが作成できた
 
+    if (prescreen_new) {
         if (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP16) {
             //並べ替え
-            std::vector<TypeCalc> tmp(ptrDst, ptrDst + weight0sizenew);
+            std::vector<TypeCalc> tmp(ptrDst, ptrDst + NNEDI_WEIGHT0_SIZE_NEW);
             for (int j = 0; j < 4; j++) {
                 for (int k = 0; k < 64; k++) {
                     int j2 = j / 4;
@@ -1680,41 +1593,9 @@ void NVEncFilterNnedi::setWeight0(TypeCalc *ptrDst, const float *ptrW, const std
             }
         }
     } else {
-        const auto ptr_w = ptrW;
-        double avg[4] = { 0.0, 0.0, 0.0, 0.0 };
-        for (int j = 0; j < 4; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < 48; k++) {
-                sum += ptr_w[j * 48 + k];
-            }
-            avg[j] = sum * (1.0 / 48.0);
-        }
-        const double halfinv = 1.0 / (((1 << 8) - 1) * 0.5);
-        for (int j = 0; j < 4; j++) {
-            for (int k = 0; k < 48; k++) {
-                ptrDst[j * 48 + k] = toWeight<TypeCalc>((float)((ptr_w[j * 48 + k] - avg[j]) * halfinv));
-            }
-        }
-        for (int i = 4 * 48; i < 4*49; i++) {
-            ptrDst[i] = toWeight<TypeCalc>(ptr_w[i]);
-        }
-        for (int i = 4 * 49; i < 4*49 + 4*4; i++) {
-            ptrDst[i] = toWeight<TypeCalc>(ptr_w[i]);
-        }
-        for (int i = 4 * 49 + 4*4; i < 4*49 + 4*5; i++) {
-            ptrDst[i] = toWeight<TypeCalc>(ptr_w[i]);
-        }
-        for (int i = 4*49 + 4*5; i < 4*49 + 4*5+ 4*8; i++) {
-            ptrDst[i] = toWeight<TypeCalc>(ptr_w[i]);
-        }
-        for (int i = 4*49 + 4*5+ 4*8; i < 4*49 + 4*5+ 4*9; i++) {
-            ptrDst[i] = toWeight<TypeCalc>(ptr_w[i]);
-        }
-        //<<<<<< ここまでで通常(CPU版)の並びのデータが作成できた
-
         if (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP16) {
             //並べ替え
-            std::vector<TypeCalc> tmp(ptrDst, ptrDst + weight0size);
+            std::vector<TypeCalc> tmp(ptrDst, ptrDst + NNEDI_WEIGHT0_SIZE);
             for (int j = 0; j < 4; j++) {
                 for (int k = 0; k < 48; k++) {
                     int j2 = j / 4;
@@ -1750,45 +1631,15 @@ void NVEncFilterNnedi::setWeight0(TypeCalc *ptrDst, const float *ptrW, const std
 }
 
 template<typename TypeCalc>
-void NVEncFilterNnedi::setWeight1(TypeCalc *ptrDst, const float *ptrW, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
-    const int sizeNXY = sizeNX[pNnediParam->nnedi.nsize] * sizeNY[pNnediParam->nnedi.nsize];
+void NVEncFilterNnedi::setWeight1(TypeCalc *ptrDst, const float *weights, int iquality, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam) {
+    const int sizeNXY = NNEDI_SIZE_NX[pNnediParam->nnedi.nsize] * NNEDI_SIZE_NY[pNnediParam->nnedi.nsize];
 
-    std::vector<double> mean0(pNnediParam->nnedi.nns * 2, 0.0);
-    for (int j = 0; j < pNnediParam->nnedi.nns * 2; j++) {
-        const float *ptr = ptrW + j * sizeNXY;
-        mean0[j] = std::accumulate(ptr, ptr + sizeNXY, 0.0) / (double)sizeNXY;
-    }
-
-    const double inv_nns = 1.0 / (double)pNnediParam->nnedi.nns;
-    std::vector<double> mean1(sizeNXY, 0.0);
-    for (int j = 0; j < pNnediParam->nnedi.nns; j++) {
-        for (int k = 0; k < sizeNXY; k++) {
-            mean1[k] += (ptrW[j * sizeNXY + k] - mean0[j]) * inv_nns;
-        }
-    }
-
-    const float *ptr = ptrW + pNnediParam->nnedi.nns * 2 * sizeNXY;
-    const double mean2 = std::accumulate(ptr, ptr + pNnediParam->nnedi.nns, 0.0) * inv_nns;
-
-    vector<float> buf(pNnediParam->nnedi.nns * 2 * sizeNXY);
-    float max0 = 0.0f, max1 = 0.0f;
-    for (int j = 0; j < pNnediParam->nnedi.nns * 2; j++) {
-        for (int k = 0; k < sizeNXY; k++) {
-            buf[j * sizeNXY + k] = (float)(ptrW[j * sizeNXY + k] - mean0[j] - (j < pNnediParam->nnedi.nns ? mean1[k] : 0.0));
-            if (j < pNnediParam->nnedi.nns) {
-                max0 = std::max(max0, buf[j * sizeNXY + k]);
-            } else {
-                max1 = std::max(max1, buf[j * sizeNXY + k]);
-            }
-        }
-        //fp16の場合、オーバーフローを避けるため途中まで0～1の範囲で計算するので、offsetの部分には1/256が必要
-        float scale = (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP16) ? 1.0f / 256.0f : 1.0f;
-        ptrDst[pNnediParam->nnedi.nns * 2 * sizeNXY + j] = toWeight<TypeCalc>((ptrW[pNnediParam->nnedi.nns * 2 * sizeNXY + j] - (float)(j < pNnediParam->nnedi.nns ? mean2 : 0.0)) * scale);
-    }
-    for (int j = 0; j < pNnediParam->nnedi.nns * 2; j++) {
-        for (int k = 0; k < sizeNXY; k++) {
-            ptrDst[j * sizeNXY + k] = toWeight<TypeCalc>(buf[j * sizeNXY + k]);
-        }
+    //fp16の場合、オーバーフローを避けるため途中まで0～1の範囲で計算するので、offsetの部分には1/256が必要
+    const float scale = (pNnediParam->nnedi.precision == VPP_NNEDI_PRECISION_FP16) ? 1.0f / 256.0f : 1.0f;
+    vector<float> buf(nnedi_weight1_size(pNnediParam->nnedi));
+    nnedi_set_weight1(buf.data(), weights, pNnediParam->nnedi, iquality, scale);
+    for (size_t i = 0; i < buf.size(); i++) {
+        ptrDst[i] = toWeight<TypeCalc>(buf[i]);
     }
     //<<<<<< ここまでで通常(CPU版)の並びのデータが作成できた
 
@@ -1997,3 +1848,205 @@ RGY_ERR NVEncFilterNnedi::run_filter(const FrameInfo *pInputFrame, FrameInfo **p
 void NVEncFilterNnedi::close() {
     m_pFrameBuf.clear();
 }
+
+//CPU版とCUDA版の出力フレームの画素の差を比較し、最大の差とtoleranceを超える画素の数を求める
+static void nnedi_cpu_gpu_diff(const FrameInfo *cpu, const FrameInfo *gpu, int tolerance, int& maxDiff, int64_t& diffCount, int64_t& pixelCount) {
+    const bool highbit = RGY_CSP_BIT_DEPTH[cpu->csp] > 8;
+    for (const auto plane : { RGY_PLANE_Y, RGY_PLANE_U, RGY_PLANE_V }) {
+        const auto p0 = getPlane(cpu, plane);
+        const auto p1 = getPlane(gpu, plane);
+        for (int y = 0; y < p0.height; y++) {
+            const uint8_t *line0 = p0.ptr + y * p0.pitch;
+            const uint8_t *line1 = p1.ptr + y * p1.pitch;
+            for (int x = 0; x < p0.width; x++) {
+                const int v0 = (highbit) ? ((const uint16_t *)line0)[x] : line0[x];
+                const int v1 = (highbit) ? ((const uint16_t *)line1)[x] : line1[x];
+                const int diff = std::abs(v0 - v1);
+                maxDiff = std::max(maxDiff, diff);
+                diffCount += (diff > tolerance) ? 1 : 0;
+            }
+            pixelCount += p0.width;
+        }
+    }
+}
+
+int nnedi_cpu_gpu_check(FILE *fp) {
+    static const int width = 1920;
+    static const int height = 1080;
+    static const int frames = 6;
+    //差が1(8bit換算)を超える画素の割合の許容値 (CPU版とCUDA版はexpの実装と積和の順序が異なる)
+    static const double diffRatioMax = 0.001;
+    auto cudaerr = cudaSetDevice(0);
+    if (cudaerr == cudaSuccess) {
+        cudaerr = cudaFree(nullptr);
+    }
+    if (cudaerr != cudaSuccess) {
+        fprintf(fp, "failed to initialize cuda: %s\n", cudaGetErrorName(cudaerr));
+        return 1;
+    }
+    cudaDeviceProp prop = { 0 };
+    cudaerr = cudaGetDeviceProperties(&prop, 0);
+    if (cudaerr != cudaSuccess) {
+        fprintf(fp, "failed to get device properties: %s\n", cudaGetErrorName(cudaerr));
+        return 1;
+    }
+    const std::pair<RGY_CSP, const char *> csps[] = {
+        { RGY_CSP_YV12,      "yv12" },
+        { RGY_CSP_YV12_16,   "yv12_16" },
+    };
+    struct NnediCpuGpuCase {
+        const char *name;
+        VppNnediField field;
+        VppNnediNSize nsize;
+        int nns;
+        VppNnediQuality quality;
+        VppNnediPreScreen pre_screen;
+    };
+    //CPU版のベンチマークと同じ組み合わせ
+    static const NnediCpuGpuCase checkCases[] = {
+        { "default",       VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_32x4, 32, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NEW_BLOCK },
+        { "original",      VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x6,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_ORIGINAL },
+        { "new_slow",      VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_16x6, 64, VPP_NNEDI_QUALITY_SLOW, VPP_NNEDI_PRE_SCREEN_NEW },
+        { "none",          VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x4,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NONE },
+        { "original_only", VPP_NNEDI_FIELD_USE_AUTO, VPP_NNEDI_NSIZE_8x4,  16, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_ORIGINAL_ONLY },
+        { "bob",           VPP_NNEDI_FIELD_BOB_AUTO, VPP_NNEDI_NSIZE_32x4, 32, VPP_NNEDI_QUALITY_FAST, VPP_NNEDI_PRE_SCREEN_NEW_BLOCK },
+    };
+    const auto inFps = rgy_rational<int>(30000, 1001);
+    auto timebase = inFps.inv();
+    timebase *= rgy_rational<int>(1, 2);
+    int ret = 0;
+    fprintf(fp, "csp,case,frames_in,frames_out_cpu,frames_out_gpu,first_mismatch,max_diff,diff_ratio,verify\n");
+    for (const auto& csp : csps) {
+        //入力はCPU版のベンチマークと同じもの
+        vector<unique_ptr<NVEncCpuFrameBuf>> input;
+        vector<unique_ptr<CUFrameBuf>> inputGpu;
+        bool inputOK = nnedi_cpu_bench_make_input(input, csp.first, width, height, 4) == RGY_ERR_NONE;
+        for (size_t i = 0; inputOK && i < input.size(); i++) {
+            unique_ptr<CUFrameBuf> frame(new CUFrameBuf(width, height, csp.first));
+            inputOK = frame->alloc() == cudaSuccess && frame->copyFrame(&input[i]->frame) == cudaSuccess;
+            frame->frame.picstruct = input[i]->frame.picstruct;
+            inputGpu.push_back(std::move(frame));
+        }
+        if (!inputOK) {
+            fprintf(fp, "%s,-,0,0,0,-1,0,0.0,NG\n", csp.second);
+            ret |= 1;
+            continue;
+        }
+        const int tolerance = 1 << (RGY_CSP_BIT_DEPTH[csp.first] - 8);
+        for (const auto& checkCase : checkCases) {
+            //16bitは代表的なものだけ
+            if (csp.first == RGY_CSP_YV12_16 && strcmp(checkCase.name, "default") != 0) {
+                continue;
+            }
+            VppParam vpp;
+            vpp.nnedi.enable = true;
+            vpp.nnedi.field = checkCase.field;
+            vpp.nnedi.nsize = checkCase.nsize;
+            vpp.nnedi.nns = checkCase.nns;
+            vpp.nnedi.quality = checkCase.quality;
+            vpp.nnedi.pre_screen = checkCase.pre_screen;
+            //CPU版はfp32のみなので、CUDA版もfp32で比較する
+            vpp.nnedi.precision = VPP_NNEDI_PRECISION_FP32;
+
+            NVEncFilterCpuChain chain;
+            auto sts = chain.init(input[0]->frame, sInputCrop({ 0 }), 0, 0, vpp, inFps, timebase, tstring(), csp.first, get_availableSIMD(), nullptr);
+
+            unique_ptr<NVEncFilterNnedi> filterGpu(new NVEncFilterNnedi());
+            shared_ptr<NVEncFilterParamNnedi> param(new NVEncFilterParamNnedi());
+            param->nnedi = vpp.nnedi;
+            param->compute_capability = std::make_pair(prop.major, prop.minor);
+            param->frameIn = inputGpu[0]->frame;
+            param->frameOut = inputGpu[0]->frame;
+            param->baseFps = inFps;
+            param->bOutOverwrite = false;
+            if (sts == RGY_ERR_NONE) {
+                sts = filterGpu->init(param, nullptr);
+            }
+            if (sts != RGY_ERR_NONE) {
+                fprintf(fp, "%s,%s,0,0,0,-1,0,0.0,NG\n", csp.second, checkCase.name);
+                ret |= 1;
+                continue;
+            }
+
+            //出力されたフレームを順に比較する (出力のタイミングは両者で同じはずだが、ずれても比較できるようにためておく)
+            std::deque<unique_ptr<NVEncCpuFrameBuf>> outCpu, outGpu;
+            int framesOutCpu = 0, framesOutGpu = 0, framesCompared = 0, firstMismatch = -1;
+            int maxDiff = 0;
+            int64_t diffCount = 0, pixelCount = 0;
+            auto compareFrames = [&]() {
+                for (; !outCpu.empty() && !outGpu.empty(); outCpu.pop_front(), outGpu.pop_front(), framesCompared++) {
+                    int64_t frameDiffCount = 0, framePixelCount = 0;
+                    nnedi_cpu_gpu_diff(&outCpu.front()->frame, &outGpu.front()->frame, tolerance, maxDiff, frameDiffCount, framePixelCount);
+                    diffCount += frameDiffCount;
+                    pixelCount += framePixelCount;
+                    if (firstMismatch < 0
+                        && (frameDiffCount > framePixelCount * diffRatioMax
+                            || outCpu.front()->frame.timestamp != outGpu.front()->frame.timestamp
+                            || outCpu.front()->frame.duration != outGpu.front()->frame.duration)) {
+                        firstMismatch = framesCompared;
+                    }
+                }
+            };
+            //出力は次の呼び出しまでしか有効でないので、CPU側にコピーしておく
+            auto addOutput = [&](std::deque<unique_ptr<NVEncCpuFrameBuf>>& queue, const FrameInfo *frame) {
+                unique_ptr<NVEncCpuFrameBuf> copy(new NVEncCpuFrameBuf(frame->width, frame->height, frame->csp));
+                if (copy->alloc() != RGY_ERR_NONE) {
+                    return RGY_ERR_MEMORY_ALLOC;
+                }
+                if (frame->deivce_mem) {
+                    if (copyFrameData(&copy->frame, frame) != cudaSuccess) {
+                        return RGY_ERR_CUDA;
+                    }
+                } else if (copy->copyFrame(frame) != RGY_ERR_NONE) {
+                    return RGY_ERR_UNKNOWN;
+                }
+                copy->frame.timestamp = frame->timestamp;
+                copy->frame.duration = frame->duration;
+                queue.push_back(std::move(copy));
+                return RGY_ERR_NONE;
+            };
+            vector<FrameInfo *> outputs;
+            bool drainCpu = false, drainGpu = false;
+            for (int i = 0; sts == RGY_ERR_NONE && (i < frames || !drainCpu || !drainGpu); i++) {
+                //入力は使いまわし、タイムスタンプのみ設定する
+                //入力を使い切ったら、ptr == nullptrのフレームでdrainする
+                FrameInfo frameCpu = { 0 }, frameGpu = { 0 };
+                if (i < frames) {
+                    frameCpu = input[i % input.size()]->frame;
+                    frameGpu = inputGpu[i % inputGpu.size()]->frame;
+                    frameCpu.timestamp = frameGpu.timestamp = i * 2;
+                    frameCpu.duration = frameGpu.duration = 2;
+                    frameCpu.inputFrameId = frameGpu.inputFrameId = i;
+                }
+                if (!drainCpu) {
+                    sts = chain.filter((i < frames) ? &frameCpu : nullptr, outputs);
+                    for (size_t j = 0; sts == RGY_ERR_NONE && j < outputs.size(); j++) {
+                        sts = addOutput(outCpu, outputs[j]);
+                        framesOutCpu++;
+                    }
+                    drainCpu = i >= frames && outputs.empty();
+                }
+                if (!drainGpu && sts == RGY_ERR_NONE) {
+                    int nOutFrames = 0;
+                    FrameInfo *outInfo[16] = { 0 };
+                    sts = filterGpu->filter(&frameGpu, (FrameInfo **)&outInfo, &nOutFrames);
+                    for (int j = 0; sts == RGY_ERR_NONE && j < nOutFrames; j++) {
+                        sts = addOutput(outGpu, outInfo[j]);
+                        framesOutGpu++;
+                    }
+                    drainGpu = i >= frames && nOutFrames == 0;
+                }
+                compareFrames();
+            }
+            if (firstMismatch < 0 && framesOutCpu != framesOutGpu) {
+                firstMismatch = framesCompared;
+            }
+            const double diffRatio = (pixelCount > 0) ? diffCount / (double)pixelCount : 0.0;
+            const bool ok = sts == RGY_ERR_NONE && framesOutCpu > 0 && firstMismatch < 0;
+            fprintf(fp, "%s,%s,%d,%d,%d,%d,%d,%.6f,%s\n", csp.second, checkCase.name, frames, framesOutCpu, framesOutGpu,
+                firstMismatch, maxDiff, diffRatio, ok ? "OK" : "NG");
+            ret |= ok ? 0 : 1;
+        }
+    }
+    return ret;
+}
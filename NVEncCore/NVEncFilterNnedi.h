@@ -30,29 +30,11 @@
 
 #include "NVEncFilter.h"
 #include "NVEncParam.h"
-
-enum NnediTargetField {
-    NNEDI_GEN_FIELD_UNKNOWN = -1,
-    NNEDI_GEN_FIELD_TOP = 0,
-    NNEDI_GEN_FIELD_BOTTOM
-};
-
-class NVEncFilterParamNnedi : public NVEncFilterParam {
-public:
-    VppNnedi nnedi;
-    std::pair<int, int> compute_capability;
-    HMODULE hModule;
-
-    NVEncFilterParamNnedi() : nnedi(), compute_capability(std::make_pair(0, 0)), hModule(NULL) {};
-    virtual ~NVEncFilterParamNnedi() {};
-};
+#include "NVEncFilterNnediCommon.h"
 
 class NVEncFilterNnedi : public NVEncFilter {
 public:
     static const int weight_loop_1;
-    static const int sizeNX[];
-    static const int sizeNY[];
-    static const int sizeNN[];
     static const int maxVal = 65535 >> 8;
 public:
     NVEncFilterNnedi();
@@ -65,12 +47,16 @@ protected:
     virtual RGY_ERR initParams(const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam);
 
     template<typename TypeWeight>
-    void setWeight0(TypeWeight *ptrDst, const float *ptrW, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam);
+    void setWeight0(TypeWeight *ptrDst, const float *weights, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam);
 
     template<typename TypeWeight>
-    void setWeight1(TypeWeight *ptrDst, const float *ptrW, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam);
+    void setWeight1(TypeWeight *ptrDst, const float *weights, int iquality, const std::shared_ptr<NVEncFilterParamNnedi> pNnediParam);
     virtual shared_ptr<const float> readWeights(const tstring& weightFile, HMODULE hModule);
 
     CUMemBuf m_weight0;
     std::array<CUMemBuf, 2> m_weight1;
 };
+
+//CPU版とCUDA版(fp32)のnnediの出力をフレームごとに比較してCSVで出力する
+//タイムスタンプが一致し、画像が誤差の範囲 (差が1(8bit換算)を超える画素が0.1%以下) で一致することを確認する
+int nnedi_cpu_gpu_check(FILE *fp);
@@ -0,0 +1,213 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+#include "NVEncFilterNnediCommon.h"
+
+const int NNEDI_SIZE_NX[VPP_NNEDI_NSIZE_MAX] = { 8, 16, 32, 48, 8, 16, 32 };
+const int NNEDI_SIZE_NY[VPP_NNEDI_NSIZE_MAX] = { 6, 6, 6, 6, 4, 4, 4 };
+const int NNEDI_SIZE_NN[5] = { 16, 32, 64, 128, 256 };
+
+tstring nnedi_default_weight_file() {
+    const auto exeDir = PathRemoveFileSpecFixed(getExePath()).second;
+#if defined(_WIN32) || defined(_WIN64)
+    return PathCombineS(exeDir, NNEDI_WEIGHT_FILE_DEFAULT);
+#else
+    return exeDir + _T("/") + NNEDI_WEIGHT_FILE_DEFAULT;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+std::shared_ptr<const float> nnedi_read_weights(const tstring& weightFile, HMODULE hModule, tstring& errMes) {
+    std::shared_ptr<const float> weights;
+    const uint32_t expectedFileSize = 13574928u;
+    uint64_t weightFileSize = 0;
+    if (weightFile.length() == 0) {
+#if defined(_WIN32) || defined(_WIN64)
+        //埋め込みデータを使用する
+        if (hModule == NULL) {
+            hModule = GetModuleHandle(NULL);
+        }
+        HRSRC hResource = NULL;
+        HGLOBAL hResourceData = NULL;
+        const char *pDataPtr = NULL;
+        if (NULL == hModule) {
+            errMes = _T("Failed to get module handle.\n");
+        } else if (NULL == (hResource = FindResource(hModule, _T("NNEDI_WEIGHTBIN"), _T("EXE_DATA")))) {
+            errMes = _T("Failed to get resource handle for \"NNEDI_WEIGHTBIN\".\n");
+        } else if (NULL == (hResourceData = LoadResource(hModule, hResource))) {
+            errMes = _T("Failed to load resource \"NNEDI_WEIGHTBIN\".\n");
+        } else if (NULL == (pDataPtr = (const char *)LockResource(hResourceData))) {
+            errMes = _T("Failed to lock resource \"NNEDI_WEIGHTBIN\".\n");
+        } else if (expectedFileSize != (weightFileSize = SizeofResource(hModule, hResource))) {
+            errMes = strsprintf(_T("Weights data has unexpected size %u [expected: %u].\n"),
+                (uint32_t)weightFileSize, expectedFileSize);
+        } else {
+            weights = std::shared_ptr<const float>((const float *)pDataPtr, [](const float *x) { return; /*何もしない*/ });
+        }
+#else
+        //リソースを埋め込めないので、実行ファイルと同じ場所の重みファイルを使用する
+        weights = nnedi_read_weights(nnedi_default_weight_file(), hModule, errMes);
+        if (!weights) {
+            errMes += strsprintf(_T("Place %s next to the executable, or set its path by weightfile.\n"), NNEDI_WEIGHT_FILE_DEFAULT);
+        }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    } else {
+        if (!PathFileExists(weightFile.c_str())) {
+            errMes = strsprintf(_T("weight file \"%s\" does not exist.\n"), weightFile.c_str());
+        } else if (!rgy_get_filesize(weightFile.c_str(), &weightFileSize)) {
+            errMes = strsprintf(_T("Failed to get filesize of weight file \"%s\".\n"), weightFile.c_str());
+        } else if (weightFileSize != expectedFileSize) {
+            errMes = strsprintf(_T("Weights file \"%s\" has unexpected file size %u [expected: %u].\n"),
+                weightFile.c_str(), (uint32_t)weightFileSize, expectedFileSize);
+        } else {
+            std::ifstream fin(weightFile, std::ios::in | std::ios::binary);
+            if (!fin.good()) {
+                errMes = strsprintf(_T("Failed to open weights file \"%s\".\n"), weightFile.c_str());
+            } else {
+                float *buffer = new float[weightFileSize / sizeof(float)];
+                if (!buffer) {
+                    errMes = strsprintf(_T("Failed to allocate buffer memory for \"%s\".\n"), weightFile.c_str());
+                } else {
+                    weights = std::shared_ptr<float>(buffer, std::default_delete<float[]>());
+                    if (fin.read((char *)weights.get(), weightFileSize).gcount() != (int64_t)weightFileSize) {
+                        errMes = strsprintf(_T("Failed to read weights file \"%s\".\n"), weightFile.c_str());
+                        weights.reset();
+                    }
+                }
+                fin.close();
+            }
+        }
+    }
+    return weights;
+}
+
+void nnedi_set_weight0(float *dst, const float *weights, const VppNnediPreScreen pre_screen) {
+    if ((pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW) {
+        auto index = [](int j, int k) {
+            return ((k >> 3) << 5) + ((j & 3) << 3) + (k & 7);
+        };
+
+        const auto ptr_w = weights + NNEDI_WEIGHT0_SIZE + NNEDI_WEIGHT0_SIZE_NEW * ((pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) - VPP_NNEDI_PRE_SCREEN_NEW);
+        double avg[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (int j = 0; j < 4; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < 64; k++) {
+                sum += ptr_w[index(j, k)];
+            }
+            avg[j] = sum * (1.0 / 64.0);
+        }
+        const double halfinv = 1.0 / (((1 << 8) - 1) * 0.5);
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 64; k++) {
+                dst[j*64+k] = (float)((ptr_w[index(j, k)] - avg[j]) * halfinv);
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            dst[4*64+i] = ptr_w[4*64+i];
+        }
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) {
+                dst[4*65+j*4+k] = ptr_w[4*65+ j + k*4]; //転置
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            dst[4*65+4*4+i] = ptr_w[4*65+4*4+i];
+        }
+    } else {
+        const auto ptr_w = weights;
+        double avg[4] = { 0.0, 0.0, 0.0, 0.0 };
+        for (int j = 0; j < 4; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < 48; k++) {
+                sum += ptr_w[j * 48 + k];
+            }
+            avg[j] = sum * (1.0 / 48.0);
+        }
+        const double halfinv = 1.0 / (((1 << 8) - 1) * 0.5);
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 48; k++) {
+                dst[j * 48 + k] = (float)((ptr_w[j * 48 + k] - avg[j]) * halfinv);
+            }
+        }
+        //残り(オフセットと2層目以降)はそのまま
+        for (int i = 4 * 48; i < NNEDI_WEIGHT0_SIZE; i++) {
+            dst[i] = ptr_w[i];
+        }
+    }
+}
+
+int nnedi_weight1_size(const VppNnedi& nnedi) {
+    return nnedi.nns * 2 * (NNEDI_SIZE_NX[nnedi.nsize] * NNEDI_SIZE_NY[nnedi.nsize] + 1);
+}
+
+void nnedi_set_weight1(float *dst, const float *weights, const VppNnedi& nnedi, int iquality, float offsetScale) {
+    //重みファイル中のpredictorの重みの位置を求める
+    //nns x nsize の組み合わせごとに、quality=fast/slow用の2つの重みが並んでおり、それがerrortype(abs/square)の分だけ続く
+    const int weight1size = nnedi_weight1_size(nnedi);
+    int weight1size_tsize = 0;
+    int weight1size_offset = 0;
+    for (int j = 0; j < (int)_countof(NNEDI_SIZE_NN); j++) {
+        for (int i = 0; i < (int)_countof(NNEDI_SIZE_NX); i++) {
+            if (i == nnedi.nsize
+                && j == get_cx_index(list_vpp_nnedi_nns, nnedi.nns)) {
+                weight1size_offset = weight1size_tsize;
+            }
+            weight1size_tsize += NNEDI_SIZE_NN[j] * (NNEDI_SIZE_NX[i] * NNEDI_SIZE_NY[i] + 1) * 4;
+        }
+    }
+    const float *ptrW = weights + NNEDI_WEIGHT0_SIZE + NNEDI_WEIGHT0_SIZE_NEW * 3 + weight1size_tsize * nnedi.errortype + weight1size_offset + iquality * weight1size;
+
+    const int nns = nnedi.nns;
+    const int sizeNXY = NNEDI_SIZE_NX[nnedi.nsize] * NNEDI_SIZE_NY[nnedi.nsize];
+
+    std::vector<double> mean0(nns * 2, 0.0);
+    for (int j = 0; j < nns * 2; j++) {
+        const float *ptr = ptrW + j * sizeNXY;
+        mean0[j] = std::accumulate(ptr, ptr + sizeNXY, 0.0) / (double)sizeNXY;
+    }
+
+    const double inv_nns = 1.0 / (double)nns;
+    std::vector<double> mean1(sizeNXY, 0.0);
+    for (int j = 0; j < nns; j++) {
+        for (int k = 0; k < sizeNXY; k++) {
+            mean1[k] += (ptrW[j * sizeNXY + k] - mean0[j]) * inv_nns;
+        }
+    }
+
+    const float *ptr = ptrW + nns * 2 * sizeNXY;
+    const double mean2 = std::accumulate(ptr, ptr + nns, 0.0) * inv_nns;
+
+    for (int j = 0; j < nns * 2; j++) {
+        for (int k = 0; k < sizeNXY; k++) {
+            dst[j * sizeNXY + k] = (float)(ptrW[j * sizeNXY + k] - mean0[j] - (j < nns ? mean1[k] : 0.0));
+        }
+        dst[nns * 2 * sizeNXY + j] = (ptrW[nns * 2 * sizeNXY + j] - (float)(j < nns ? mean2 : 0.0)) * offsetScale;
+    }
+}
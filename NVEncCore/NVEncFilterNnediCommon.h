@@ -0,0 +1,81 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_FILTER_NNEDI_COMMON_H__
+#define __NVENC_FILTER_NNEDI_COMMON_H__
+
+#include <cstdint>
+#include <memory>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "NVEncVppParam.h"
+
+//nnediのCUDA版(NVEncFilterNnedi)とCPU版(NVEncFilterCpuNnedi)で共通の部分
+//重みの読み込みと、重みの通常(CPU版)の並びへの変換はここで行い、
+//それぞれの版ではこれを自身の計算に合わせて並べ替えて使用する (CUDAのヘッダに依存しないこと)
+
+enum NnediTargetField {
+    NNEDI_GEN_FIELD_UNKNOWN = -1,
+    NNEDI_GEN_FIELD_TOP = 0,
+    NNEDI_GEN_FIELD_BOTTOM
+};
+
+//predictorの参照範囲 (VppNnediNSizeの順)
+extern const int NNEDI_SIZE_NX[VPP_NNEDI_NSIZE_MAX];
+extern const int NNEDI_SIZE_NY[VPP_NNEDI_NSIZE_MAX];
+//predictorのニューロン数 (list_vpp_nnedi_nnsの順)
+extern const int NNEDI_SIZE_NN[5];
+
+//prescreener(original)の重みの数
+static const int NNEDI_WEIGHT0_SIZE = 49 * 4 + 5 * 4 + 9 * 4;
+//prescreener(new)の重みの数 (重みファイルにはnew, levels 2/3の3つ分が続けて格納されている)
+static const int NNEDI_WEIGHT0_SIZE_NEW = 4 * 65 + 4 * 5;
+
+//埋め込みのリソースを使用できない環境 (Windows以外) で、weightFileの指定がない場合に使用する重みファイル
+//実行ファイルと同じ場所から読み込む
+#define NNEDI_WEIGHT_FILE_DEFAULT _T("nnedi3_weights.bin")
+tstring nnedi_default_weight_file();
+
+//重みファイルを読み込む
+//weightFileが空なら、Windowsでは埋め込みのリソースを、それ以外ではnnedi_default_weight_file()を使用する
+//失敗した場合は、errMesにエラーメッセージを設定してnullptrを返す
+std::shared_ptr<const float> nnedi_read_weights(const tstring& weightFile, HMODULE hModule, tstring& errMes);
+
+//prescreenerの重みを通常(CPU版)の並びで作成する
+//dstのサイズは、pre_screenがnew以降ならNNEDI_WEIGHT0_SIZE_NEW、そうでなければNNEDI_WEIGHT0_SIZE
+void nnedi_set_weight0(float *dst, const float *weights, const VppNnediPreScreen pre_screen);
+
+//predictorの重みの数 (重み[2][nns][nnxy] + オフセット[2][nns])
+int nnedi_weight1_size(const VppNnedi& nnedi);
+
+//predictorの重みを通常(CPU版)の並びで作成する
+//weights: 重みファイル全体、iquality: quality=slowの場合の2つ目の重みなら1
+//offsetScale: オフセットにかける係数 (fp16で計算する場合に使用する)
+void nnedi_set_weight1(float *dst, const float *weights, const VppNnedi& nnedi, int iquality, float offsetScale);
+
+#endif //__NVENC_FILTER_NNEDI_COMMON_H__
@@ -0,0 +1,140 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_FILTER_PARAM_H__
+#define __NVENC_FILTER_PARAM_H__
+
+#include <cstdint>
+#include "rgy_util.h"
+#include "convert_csp.h"
+#include "NVEncVppParam.h"
+
+//フィルタのパラメータ
+//CUDA版(NVEncFilter)とCPU版(NVEncFilterCpu)で共通に使用するので、CUDAのヘッダに依存しないこと
+
+class NVEncFilterParam {
+public:
+    FrameInfo frameIn;
+    FrameInfo frameOut;
+    rgy_rational<int> baseFps;
+    bool bOutOverwrite;
+
+    NVEncFilterParam() : frameIn({ 0 }), frameOut({ 0 }), baseFps(), bOutOverwrite(false) {};
+    virtual ~NVEncFilterParam() {};
+};
+
+enum FILTER_PATHTHROUGH_FRAMEINFO : uint32_t {
+    FILTER_PATHTHROUGH_NONE      = 0x00u,
+    FILTER_PATHTHROUGH_TIMESTAMP = 0x01u,
+    FILTER_PATHTHROUGH_FLAGS     = 0x02u,
+    FILTER_PATHTHROUGH_PICSTRUCT = 0x04u,
+
+    FILTER_PATHTHROUGH_ALL       = 0x07u,
+};
+
+static FILTER_PATHTHROUGH_FRAMEINFO operator|(FILTER_PATHTHROUGH_FRAMEINFO a, FILTER_PATHTHROUGH_FRAMEINFO b) {
+    return (FILTER_PATHTHROUGH_FRAMEINFO)((uint32_t)a | (uint32_t)b);
+}
+
+static FILTER_PATHTHROUGH_FRAMEINFO operator|=(FILTER_PATHTHROUGH_FRAMEINFO& a, FILTER_PATHTHROUGH_FRAMEINFO b) {
+    a = a | b;
+    return a;
+}
+
+static FILTER_PATHTHROUGH_FRAMEINFO operator&(FILTER_PATHTHROUGH_FRAMEINFO a, FILTER_PATHTHROUGH_FRAMEINFO b) {
+    return (FILTER_PATHTHROUGH_FRAMEINFO)((uint32_t)a & (uint32_t)b);
+}
+
+static FILTER_PATHTHROUGH_FRAMEINFO operator&=(FILTER_PATHTHROUGH_FRAMEINFO& a, FILTER_PATHTHROUGH_FRAMEINFO b) {
+    a = a & b;
+    return a;
+}
+
+static FILTER_PATHTHROUGH_FRAMEINFO operator~(FILTER_PATHTHROUGH_FRAMEINFO a) {
+    return (FILTER_PATHTHROUGH_FRAMEINFO)(~((uint32_t)a));
+}
+
+class NVEncFilterParamCrop : public NVEncFilterParam {
+public:
+    sInputCrop crop;
+
+    virtual ~NVEncFilterParamCrop() {};
+};
+
+class NVEncFilterParamResize : public NVEncFilterParam {
+public:
+    int interp;
+    virtual ~NVEncFilterParamResize() {};
+};
+
+class NVEncFilterParamPad : public NVEncFilterParam {
+public:
+    VppPad pad;
+    virtual ~NVEncFilterParamPad() {};
+};
+
+class NVEncFilterParamTweak : public NVEncFilterParam {
+public:
+    VppTweak tweak;
+
+    virtual ~NVEncFilterParamTweak() {};
+};
+
+class NVEncFilterParamUnsharp : public NVEncFilterParam {
+public:
+    VppUnsharp unsharp;
+
+    virtual ~NVEncFilterParamUnsharp() {};
+};
+
+class NVEncFilterParamAfs : public NVEncFilterParam {
+public:
+    VppAfs afs;
+    rgy_rational<int> inFps;
+    rgy_rational<int> inTimebase;
+    rgy_rational<int> outTimebase;
+    tstring outFilename;
+    int cudaSchedule; //CUctx_flags (CPU版では使用しない)
+
+    NVEncFilterParamAfs() : afs(), inFps(), inTimebase(), outTimebase(), outFilename(), cudaSchedule(0x04 /*CU_CTX_SCHED_BLOCKING_SYNC*/) {
+
+    };
+    virtual ~NVEncFilterParamAfs() {};
+};
+
+class NVEncFilterParamNnedi : public NVEncFilterParam {
+public:
+    VppNnedi nnedi;
+    std::pair<int, int> compute_capability; //CPU版では使用しない
+    HMODULE hModule;
+
+    NVEncFilterParamNnedi() : nnedi(), compute_capability(std::make_pair(0, 0)), hModule(NULL) {};
+    virtual ~NVEncFilterParamNnedi() {};
+};
+
+#endif //__NVENC_FILTER_PARAM_H__
@@ -31,13 +31,6 @@
 #include "NVEncFilter.h"
 #include "NVEncParam.h"
 
-class NVEncFilterParamTweak : public NVEncFilterParam {
-public:
-    VppTweak tweak;
-
-    virtual ~NVEncFilterParamTweak() {};
-};
-
 class NVEncFilterTweak : public NVEncFilter {
 public:
     NVEncFilterTweak();
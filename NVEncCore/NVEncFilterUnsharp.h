@@ -31,13 +31,6 @@
 #include "NVEncFilter.h"
 #include "NVEncParam.h"
 
-class NVEncFilterParamUnsharp : public NVEncFilterParam {
-public:
-    VppUnsharp unsharp;
-
-    virtual ~NVEncFilterParamUnsharp() {};
-};
-
 class NVEncFilterUnsharp : public NVEncFilter {
 public:
     NVEncFilterUnsharp();
@@ -201,6 +201,23 @@ public:
         return RGY_ERR_NONE;
     }
 
+    //_aligned_malloc(..., 32)で確保された領域の所有権を受け取る
+    void attach(uint8_t *buf, size_t bufSize) {
+        clear();
+        dataptr = buf;
+        maxLength = bufSize;
+    }
+
+    //所有している領域を手放し、その領域を返す
+    uint8_t *detach() {
+        uint8_t *buf = dataptr;
+        dataptr = nullptr;
+        dataLength = 0;
+        dataOffset = 0;
+        maxLength = 0;
+        return buf;
+    }
+
     void trim() {
         if (dataOffset > 0 && dataLength > 0) {
             memmove(dataptr, dataptr + dataOffset, dataLength);
@@ -371,6 +388,12 @@ public:
     void setDuration(int64_t frame_duration) {
         info.duration = frame_duration;
     }
+    RGY_PICSTRUCT picstruct() {
+        return info.picstruct;
+    }
+    void setPicstruct(RGY_PICSTRUCT picstruct) {
+        info.picstruct = picstruct;
+    }
 };
 
 static inline RGYFrame RGYFrameInit() {
@@ -410,6 +433,4 @@ static inline RGYBitstream RGYBitstreamInit(const NV_ENC_LOCK_BITSTREAM& nv_bits
     return bitstream;
 }
 
-int64_t rational_rescale(int64_t v, rgy_rational<int> from, rgy_rational<int> to);
-
 #endif //__NVENC_UTIL_H__
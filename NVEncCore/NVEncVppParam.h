@@ -0,0 +1,739 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __NVENC_VPP_PARAM_H__
+#define __NVENC_VPP_PARAM_H__
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "convert_csp.h"
+
+//vppフィルタのパラメータ
+//CUDA版(NVEncFilter)とCPU版(NVEncFilterCpu)で共通に使用するので、CUDA/NPPのヘッダに依存しないこと
+
+using std::vector;
+
+static const int   FILTER_DEFAULT_DELOGO_DEPTH = 128;
+static const int   FILTER_DEFAULT_UNSHARP_RADIUS = 3;
+static const float FILTER_DEFAULT_UNSHARP_WEIGHT = 0.5f;
+static const float FILTER_DEFAULT_UNSHARP_THRESHOLD = 10.0f;
+static const float FILTER_DEFAULT_EDGELEVEL_STRENGTH = 5.0f;
+static const float FILTER_DEFAULT_EDGELEVEL_THRESHOLD = 20.0f;
+static const float FILTER_DEFAULT_EDGELEVEL_BLACK = 0.0f;
+static const float FILTER_DEFAULT_EDGELEVEL_WHITE = 0.0f;
+static const int   FILTER_DEFAULT_KNN_RADIUS = 3;
+static const float FILTER_DEFAULT_KNN_STRENGTH = 0.08f;
+static const float FILTER_DEFAULT_KNN_LERPC = 0.20f;
+static const float FILTER_DEFAULT_KNN_WEIGHT_THRESHOLD = 0.01f;
+static const float FILTER_DEFAULT_KNN_LERPC_THRESHOLD = 0.80f;
+static const float FILTER_DEFAULT_PMD_STRENGTH = 100.0f;
+static const float FILTER_DEFAULT_PMD_THRESHOLD = 100.0f;
+static const int   FILTER_DEFAULT_PMD_APPLY_COUNT = 2;
+static const bool  FILTER_DEFAULT_PMD_USE_EXP = true;
+static const int   FILTER_DEFAULT_DEBAND_RANGE = 15;
+static const int   FILTER_DEFAULT_DEBAND_THRE_Y = 15;
+static const int   FILTER_DEFAULT_DEBAND_THRE_CB = 15;
+static const int   FILTER_DEFAULT_DEBAND_THRE_CR = 15;
+static const int   FILTER_DEFAULT_DEBAND_DITHER_Y = 15;
+static const int   FILTER_DEFAULT_DEBAND_DITHER_C = 15;
+static const int   FILTER_DEFAULT_DEBAND_MODE = 1;
+static const int   FILTER_DEFAULT_DEBAND_SEED = 1234;
+static const bool  FILTER_DEFAULT_DEBAND_BLUR_FIRST = false;
+static const bool  FILTER_DEFAULT_DEBAND_RAND_EACH_FRAME = false;
+
+static const int   FILTER_DEFAULT_AFS_CLIP_TB = 16;
+static const int   FILTER_DEFAULT_AFS_CLIP_LR = 32;
+static const int   FILTER_DEFAULT_AFS_TB_ORDER = 0;
+static const int   FILTER_DEFAULT_AFS_METHOD_SWITCH = 0;
+static const int   FILTER_DEFAULT_AFS_COEFF_SHIFT = 192;
+static const int   FILTER_DEFAULT_AFS_THRE_SHIFT = 128;
+static const int   FILTER_DEFAULT_AFS_THRE_DEINT = 48;
+static const int   FILTER_DEFAULT_AFS_THRE_YMOTION = 112;
+static const int   FILTER_DEFAULT_AFS_THRE_CMOTION = 224;
+static const int   FILTER_DEFAULT_AFS_ANALYZE = 3;
+static const bool  FILTER_DEFAULT_AFS_SHIFT = true;
+static const bool  FILTER_DEFAULT_AFS_DROP = false;
+static const bool  FILTER_DEFAULT_AFS_SMOOTH = false;
+static const bool  FILTER_DEFAULT_AFS_FORCE24 = false;
+static const bool  FILTER_DEFAULT_AFS_TUNE = false;
+static const bool  FILTER_DEFAULT_AFS_RFF = false;
+static const bool  FILTER_DEFAULT_AFS_TIMECODE = false;
+static const bool  FILTER_DEFAULT_AFS_LOG = false;
+
+static const float FILTER_DEFAULT_TWEAK_BRIGHTNESS = 0.0f;
+static const float FILTER_DEFAULT_TWEAK_CONTRAST = 1.0f;
+static const float FILTER_DEFAULT_TWEAK_GAMMA = 1.0f;
+static const float FILTER_DEFAULT_TWEAK_SATURATION = 1.0f;
+static const float FILTER_DEFAULT_TWEAK_HUE = 0.0f;
+
+static const double FILTER_DEFAULT_COLORSPACE_LDRNITS = 100.0;
+static const double FILTER_DEFAULT_COLORSPACE_SOURCE_PEAK = 1000.0;
+
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_A = 0.22;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_B = 0.3;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_C = 0.1;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_D = 0.2;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_E = 0.01;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_F = 0.3;
+static const double FILTER_DEFAULT_HDR2SDR_HABLE_W = 11.2;
+
+static const double FILTER_DEFAULT_HDR2SDR_MOBIUS_TRANSITION = 0.3;
+static const double FILTER_DEFAULT_HDR2SDR_MOBIUS_PEAK = 1.0;
+
+static const double FILTER_DEFAULT_HDR2SDR_REINHARD_CONTRAST = 0.5;
+static const double FILTER_DEFAULT_HDR2SDR_REINHARD_PEAK = 1.0;
+
+static const TCHAR *FILTER_DEFAULT_CUSTOM_KERNEL_NAME = _T("kernel_filter");
+static const int FILTER_DEFAULT_CUSTOM_THREAD_PER_BLOCK_X = 32;
+static const int FILTER_DEFAULT_CUSTOM_THREAD_PER_BLOCK_Y = 8;
+static const int FILTER_DEFAULT_CUSTOM_PIXEL_PER_THREAD_X = 1;
+static const int FILTER_DEFAULT_CUSTOM_PIXEL_PER_THREAD_Y = 1;
+
+//CUDA/NPPのヘッダに依存しないよう、VppParamで使用するCUDA/NPPの値はここで定義する (NVEncParam.hで元の値と一致することを確認する)
+static const int VPP_DEINTERLACE_NONE    = 0;  //cudaVideoDeinterlaceMode_Weave
+static const int VPP_RESIZE_DEFAULT      = 0;  //NPPI_INTER_UNDEFINED
+static const int VPP_RESIZE_NPPI_LINEAR  = 2;  //NPPI_INTER_LINEAR
+static const int VPP_RESIZE_NPPI_LANCZOS = 16; //NPPI_INTER_LANCZOS
+
+enum {
+    NPPI_INTER_MAX = 17, //NPPI_INTER_LANCZOS3_ADVANCED
+    RESIZE_CUDA_TEXTURE_BILINEAR,
+    RESIZE_CUDA_SPLINE16,
+    RESIZE_CUDA_SPLINE36,
+    RESIZE_CUDA_SPLINE64,
+    RESIZE_CUDA_LANCZOS2,
+    RESIZE_CUDA_LANCZOS3,
+    RESIZE_CUDA_LANCZOS4,
+};
+
+//--vpp-resizeのうち、nppを使用しないもの
+const CX_DESC list_vpp_resize_cuda[] = {
+    { _T("bilinear"),      RESIZE_CUDA_TEXTURE_BILINEAR },
+    { _T("spline16"),      RESIZE_CUDA_SPLINE16 },
+    { _T("spline36"),      RESIZE_CUDA_SPLINE36 },
+    { _T("spline64"),      RESIZE_CUDA_SPLINE64 },
+    { _T("lanczos2"),      RESIZE_CUDA_LANCZOS2 },
+    { _T("lanczos3"),      RESIZE_CUDA_LANCZOS3 },
+    { _T("lanczos4"),      RESIZE_CUDA_LANCZOS4 },
+    { NULL, NULL }
+};
+
+const CX_DESC list_vpp_denoise[] = {
+    { _T("none"), 0 },
+    { _T("knn"),  1 },
+    { _T("pmd"),  2 },
+    { NULL, NULL }
+};
+
+const CX_DESC list_vpp_detail_enahance[] = {
+    { _T("none"),       0 },
+    { _T("unsharp"),    1 },
+    { _T("edgelevel"),  2 },
+    { NULL, NULL }
+};
+
+const CX_DESC list_vpp_deband[] ={
+    { _T("0 - 1点参照"),  0 },
+    { _T("1 - 2点参照"),  1 },
+    { _T("2 - 4点参照"),  2 },
+    { NULL, NULL }
+};
+
+enum HDR2SDRToneMap {
+    HDR2SDR_DISABLED,
+    HDR2SDR_HABLE,
+    HDR2SDR_MOBIUS,
+    HDR2SDR_REINHARD
+};
+
+const CX_DESC list_vpp_hdr2sdr[] = {
+    { _T("none"),     HDR2SDR_DISABLED },
+    { _T("hable"),    HDR2SDR_HABLE },
+    { _T("mobius"),   HDR2SDR_MOBIUS },
+    { _T("reinhard"), HDR2SDR_REINHARD },
+    { NULL, NULL }
+};
+
+enum VppNnediField {
+    VPP_NNEDI_FIELD_UNKNOWN = 0,
+    VPP_NNEDI_FIELD_BOB_AUTO,
+    VPP_NNEDI_FIELD_USE_AUTO,
+    VPP_NNEDI_FIELD_USE_TOP,
+    VPP_NNEDI_FIELD_USE_BOTTOM,
+    VPP_NNEDI_FIELD_BOB_TOP_BOTTOM,
+    VPP_NNEDI_FIELD_BOB_BOTTOM_TOP,
+
+    VPP_NNEDI_FIELD_MAX,
+};
+
+const CX_DESC list_vpp_nnedi_field[] = {
+    { _T("bob"),     VPP_NNEDI_FIELD_BOB_AUTO },
+    { _T("auto"),    VPP_NNEDI_FIELD_USE_AUTO },
+    { _T("top"),     VPP_NNEDI_FIELD_USE_TOP },
+    { _T("bottom"),  VPP_NNEDI_FIELD_USE_BOTTOM },
+    { _T("bob_tff"), VPP_NNEDI_FIELD_BOB_TOP_BOTTOM },
+    { _T("bob_bff"), VPP_NNEDI_FIELD_BOB_BOTTOM_TOP },
+    { NULL, NULL }
+};
+
+const CX_DESC list_vpp_nnedi_nns[] = {
+    { _T("16"),   16 },
+    { _T("32"),   32 },
+    { _T("64"),   64 },
+    { _T("128"), 128 },
+    { _T("256"), 256 },
+    { NULL, NULL }
+};
+
+enum VppNnediNSize {
+    VPP_NNEDI_NSIZE_UNKNOWN = -1,
+
+    VPP_NNEDI_NSIZE_8x6 = 0,
+    VPP_NNEDI_NSIZE_16x6,
+    VPP_NNEDI_NSIZE_32x6,
+    VPP_NNEDI_NSIZE_48x6,
+    VPP_NNEDI_NSIZE_8x4,
+    VPP_NNEDI_NSIZE_16x4,
+    VPP_NNEDI_NSIZE_32x4,
+
+    VPP_NNEDI_NSIZE_MAX,
+};
+
+const CX_DESC list_vpp_nnedi_nsize[] = {
+    { _T("8x6"),  VPP_NNEDI_NSIZE_8x6  },
+    { _T("16x6"), VPP_NNEDI_NSIZE_16x6 },
+    { _T("32x6"), VPP_NNEDI_NSIZE_32x6 },
+    { _T("48x6"), VPP_NNEDI_NSIZE_48x6 },
+    { _T("8x4"),  VPP_NNEDI_NSIZE_8x4  },
+    { _T("16x4"), VPP_NNEDI_NSIZE_16x4 },
+    { _T("32x4"), VPP_NNEDI_NSIZE_32x4 },
+    { NULL, NULL }
+};
+
+enum VppNnediQuality {
+    VPP_NNEDI_QUALITY_UNKNOWN = 0,
+    VPP_NNEDI_QUALITY_FAST,
+    VPP_NNEDI_QUALITY_SLOW,
+
+    VPP_NNEDI_QUALITY_MAX,
+};
+
+const CX_DESC list_vpp_nnedi_quality[] = {
+    { _T("fast"), VPP_NNEDI_QUALITY_FAST },
+    { _T("slow"), VPP_NNEDI_QUALITY_SLOW },
+    { NULL, NULL }
+};
+
+enum VppNnediPreScreen : uint32_t {
+    VPP_NNEDI_PRE_SCREEN_NONE            = 0x00,
+    VPP_NNEDI_PRE_SCREEN_ORIGINAL        = 0x01,
+    VPP_NNEDI_PRE_SCREEN_NEW             = 0x02,
+    VPP_NNEDI_PRE_SCREEN_MODE            = 0x07,
+    VPP_NNEDI_PRE_SCREEN_BLOCK           = 0x10,
+    VPP_NNEDI_PRE_SCREEN_ONLY            = 0x20,
+    VPP_NNEDI_PRE_SCREEN_ORIGINAL_BLOCK  = VPP_NNEDI_PRE_SCREEN_ORIGINAL | VPP_NNEDI_PRE_SCREEN_BLOCK,
+    VPP_NNEDI_PRE_SCREEN_NEW_BLOCK       = VPP_NNEDI_PRE_SCREEN_NEW      | VPP_NNEDI_PRE_SCREEN_BLOCK,
+    VPP_NNEDI_PRE_SCREEN_ORIGINAL_ONLY   = VPP_NNEDI_PRE_SCREEN_ORIGINAL | VPP_NNEDI_PRE_SCREEN_ONLY,
+    VPP_NNEDI_PRE_SCREEN_NEW_ONLY        = VPP_NNEDI_PRE_SCREEN_NEW      | VPP_NNEDI_PRE_SCREEN_ONLY,
+
+    VPP_NNEDI_PRE_SCREEN_MAX,
+};
+
+static VppNnediPreScreen operator|(VppNnediPreScreen a, VppNnediPreScreen b) {
+    return (VppNnediPreScreen)((uint32_t)a | (uint32_t)b);
+}
+
+static VppNnediPreScreen operator|=(VppNnediPreScreen& a, VppNnediPreScreen b) {
+    a = a | b;
+    return a;
+}
+
+static VppNnediPreScreen operator&(VppNnediPreScreen a, VppNnediPreScreen b) {
+    return (VppNnediPreScreen)((uint32_t)a & (uint32_t)b);
+}
+
+static VppNnediPreScreen operator&=(VppNnediPreScreen& a, VppNnediPreScreen b) {
+    a = (VppNnediPreScreen)((uint32_t)a & (uint32_t)b);
+    return a;
+}
+
+const CX_DESC list_vpp_nnedi_pre_screen[] = {
+    { _T("none"),           VPP_NNEDI_PRE_SCREEN_NONE },
+    { _T("original"),       VPP_NNEDI_PRE_SCREEN_ORIGINAL },
+    { _T("new"),            VPP_NNEDI_PRE_SCREEN_NEW },
+    { _T("original_block"), VPP_NNEDI_PRE_SCREEN_ORIGINAL_BLOCK },
+    { _T("new_block"),      VPP_NNEDI_PRE_SCREEN_NEW_BLOCK },
+    { _T("original_only"),  VPP_NNEDI_PRE_SCREEN_ORIGINAL_ONLY },
+    { _T("new_only"),       VPP_NNEDI_PRE_SCREEN_NEW_ONLY },
+    { NULL, NULL }
+};
+
+enum VppNnediErrorType {
+    VPP_NNEDI_ETYPE_ABS = 0,
+    VPP_NNEDI_ETYPE_SQUARE,
+
+    VPP_NNEDI_ETYPE_MAX,
+};
+
+const CX_DESC list_vpp_nnedi_error_type[] = {
+    { _T("abs"),    VPP_NNEDI_ETYPE_ABS },
+    { _T("square"), VPP_NNEDI_ETYPE_SQUARE },
+    { NULL, NULL }
+};
+
+enum VppNnediPrecision {
+    VPP_NNEDI_PRECISION_UNKNOWN = -1,
+
+    VPP_NNEDI_PRECISION_AUTO = 0,
+    VPP_NNEDI_PRECISION_FP32,
+    VPP_NNEDI_PRECISION_FP16,
+
+    VPP_NNEDI_PRECISION_MAX,
+};
+
+const CX_DESC list_vpp_nnedi_prec[] = {
+    { _T("auto"), VPP_NNEDI_PRECISION_AUTO },
+    { _T("fp32"), VPP_NNEDI_PRECISION_FP32 },
+    { _T("fp16"), VPP_NNEDI_PRECISION_FP16 },
+    { NULL, NULL }
+};
+
+enum VppYadifMode : uint32_t {
+    VPP_YADIF_MODE_UNKNOWN  = 0x00,
+
+    VPP_YADIF_MODE_TFF      = 0x01,
+    VPP_YADIF_MODE_BFF      = 0x02,
+    VPP_YADIF_MODE_AUTO     = 0x04,
+    VPP_YADIF_MODE_BOB      = 0x08,
+    VPP_YADIF_MODE_BOB_TFF  = VPP_YADIF_MODE_BOB | VPP_YADIF_MODE_TFF,
+    VPP_YADIF_MODE_BOB_BFF  = VPP_YADIF_MODE_BOB | VPP_YADIF_MODE_BFF,
+    VPP_YADIF_MODE_BOB_AUTO = VPP_YADIF_MODE_BOB | VPP_YADIF_MODE_AUTO,
+
+    VPP_YADIF_MODE_MAX = VPP_YADIF_MODE_BOB_AUTO + 1,
+};
+
+static VppYadifMode operator|(VppYadifMode a, VppYadifMode b) {
+    return (VppYadifMode)((uint32_t)a | (uint32_t)b);
+}
+
+static VppYadifMode operator|=(VppYadifMode& a, VppYadifMode b) {
+    a = a | b;
+    return a;
+}
+
+static VppYadifMode operator&(VppYadifMode a, VppYadifMode b) {
+    return (VppYadifMode)((uint32_t)a & (uint32_t)b);
+}
+
+static VppYadifMode operator&=(VppYadifMode& a, VppYadifMode b) {
+    a = (VppYadifMode)((uint32_t)a & (uint32_t)b);
+    return a;
+}
+
+const CX_DESC list_vpp_yadif_mode[] = {
+    { _T("unknown"),  VPP_YADIF_MODE_UNKNOWN  },
+    { _T("tff"),      VPP_YADIF_MODE_TFF      },
+    { _T("bff"),      VPP_YADIF_MODE_BFF      },
+    { _T("auto"),     VPP_YADIF_MODE_AUTO     },
+    { _T("bob_tff"),  VPP_YADIF_MODE_BOB_TFF  },
+    { _T("bob_bff"),  VPP_YADIF_MODE_BOB_BFF  },
+    { _T("bob"),      VPP_YADIF_MODE_BOB_AUTO },
+    { NULL, NULL }
+};
+
+const CX_DESC list_vpp_ass_shaping[] = {
+    { _T("simple"),  0 },
+    { _T("complex"), 1 },
+    { NULL, NULL }
+};
+
+struct VppDelogo {
+    bool enable;
+    tstring logoFilePath;  //ロゴファイル名
+    tstring logoSelect;    //ロゴの名前
+    int posX, posY; //位置オフセット
+    int depth;      //透明度深度
+    int Y, Cb, Cr;  //(輝度・色差)オフセット
+    int mode;
+    bool autoFade;
+    bool autoNR;
+    int NRArea;
+    int NRValue;
+    bool log;
+
+    VppDelogo();
+    bool operator==(const VppDelogo& x) const;
+    bool operator!=(const VppDelogo& x) const;
+};
+
+struct VppUnsharp {
+    bool  enable;
+    int   radius;
+    float weight;
+    float threshold;
+
+    VppUnsharp();
+    bool operator==(const VppUnsharp& x) const;
+    bool operator!=(const VppUnsharp& x) const;
+};
+
+struct VppEdgelevel {
+    bool  enable;
+    float strength;
+    float threshold;
+    float black;
+    float white;
+
+    VppEdgelevel();
+    bool operator==(const VppEdgelevel& x) const;
+    bool operator!=(const VppEdgelevel& x) const;
+};
+
+struct VppKnn {
+    bool  enable;
+    int   radius;
+    float strength;
+    float lerpC;
+    float weight_threshold;
+    float lerp_threshold;
+
+    VppKnn();
+    bool operator==(const VppKnn& x) const;
+    bool operator!=(const VppKnn& x) const;
+};
+
+struct VppPmd {
+    bool  enable;
+    float strength;
+    float threshold;
+    int   applyCount;
+    bool  useExp;
+
+    VppPmd();
+    bool operator==(const VppPmd& x) const;
+    bool operator!=(const VppPmd& x) const;
+};
+
+struct VppDeband {
+    bool enable;
+    int range;
+    int threY;
+    int threCb;
+    int threCr;
+    int ditherY;
+    int ditherC;
+    int sample;
+    int seed;
+    bool blurFirst;
+    bool randEachFrame;
+
+    VppDeband();
+    bool operator==(const VppDeband& x) const;
+    bool operator!=(const VppDeband& x) const;
+};
+
+struct ColorspaceConv {
+    VideoVUIInfo from, to;
+    double source_peak;
+    bool approx_gamma;
+    bool scene_ref;
+
+    ColorspaceConv();
+    void set(const VideoVUIInfo& csp_from, const VideoVUIInfo &csp_to) {
+        from = csp_from;
+        to = csp_to;
+    }
+    bool operator==(const ColorspaceConv &x) const;
+    bool operator!=(const ColorspaceConv &x) const;
+};
+
+struct TonemapHable {
+    double a, b, c, d, e, f, w;
+
+    TonemapHable();
+    bool operator==(const TonemapHable &x) const;
+    bool operator!=(const TonemapHable &x) const;
+};
+
+struct TonemapMobius {
+    double transition, peak;
+
+    TonemapMobius();
+    bool operator==(const TonemapMobius &x) const;
+    bool operator!=(const TonemapMobius &x) const;
+};
+
+struct TonemapReinhard {
+    double contrast, peak;
+
+    TonemapReinhard();
+    bool operator==(const TonemapReinhard &x) const;
+    bool operator!=(const TonemapReinhard &x) const;
+};
+
+struct HDR2SDRParams {
+    HDR2SDRToneMap tonemap;
+    TonemapHable hable;
+    TonemapMobius mobius;
+    TonemapReinhard reinhard;
+    double ldr_nits;
+
+    HDR2SDRParams();
+    bool operator==(const HDR2SDRParams &x) const;
+    bool operator!=(const HDR2SDRParams &x) const;
+};
+
+struct VppColorspace {
+    bool enable;
+    HDR2SDRParams hdr2sdr;
+    vector<ColorspaceConv> convs;
+
+    VppColorspace();
+    bool operator==(const VppColorspace &x) const;
+    bool operator!=(const VppColorspace &x) const;
+};
+
+struct VppTweak {
+    bool  enable;
+    float brightness; // -1.0 - 1.0 (0.0)
+    float contrast;   // -2.0 - 2.0 (1.0)
+    float gamma;      //  0.1 - 10.0 (1.0)
+    float saturation; //  0.0 - 3.0 (1.0)
+    float hue;        // -180 - 180 (0.0)
+
+    VppTweak();
+    bool operator==(const VppTweak& x) const;
+    bool operator!=(const VppTweak& x) const;
+};
+
+struct VppSelectEvery {
+    bool  enable;
+    int   step;
+    int   offset;
+
+    VppSelectEvery();
+    bool operator==(const VppSelectEvery& x) const;
+    bool operator!=(const VppSelectEvery& x) const;
+};
+
+struct VppSubburn {
+    bool  enable;
+    tstring filename;
+    std::string charcode;
+    int trackId;
+    int assShaping;
+    float scale;
+
+    VppSubburn();
+    bool operator==(const VppSubburn &x) const;
+    bool operator!=(const VppSubburn &x) const;
+};
+
+typedef struct {
+    int top, bottom, left, right;
+} AFS_SCAN_CLIP;
+
+static inline AFS_SCAN_CLIP scan_clip(int top, int bottom, int left, int right) {
+    AFS_SCAN_CLIP clip;
+    clip.top = top;
+    clip.bottom = bottom;
+    clip.left = left;
+    clip.right = right;
+    return clip;
+}
+
+struct VppAfs {
+    bool enable;
+    int tb_order;
+    AFS_SCAN_CLIP clip;    //上下左右
+    int method_switch;     //切替点
+    int coeff_shift;       //判定比
+    int thre_shift;        //縞(ｼﾌﾄ)
+    int thre_deint;        //縞(解除)
+    int thre_Ymotion;      //Y動き
+    int thre_Cmotion;      //C動き
+    int analyze;           //解除Lv
+    bool shift;            //フィールドシフト
+    bool drop;             //間引き
+    bool smooth;           //スムージング
+    bool force24;          //24fps化
+    bool tune;             //調整モード
+    bool rff;              //rffフラグを認識して調整
+    bool timecode;         //timecode出力
+    bool log;              //log出力
+
+    VppAfs();
+    void set_preset(int preset);
+    int read_afs_inifile(const TCHAR* inifile);
+    bool operator==(const VppAfs& x) const;
+    bool operator!=(const VppAfs& x) const;
+
+    void check();
+};
+
+struct VppYadif {
+    bool enable;
+    VppYadifMode mode;
+
+    VppYadif();
+    bool operator==(const VppYadif& x) const;
+    bool operator!=(const VppYadif& x) const;
+};
+
+struct VppPad {
+    bool enable;
+    int left, top, right, bottom;
+
+    VppPad();
+    bool operator==(const VppPad& x) const;
+    bool operator!=(const VppPad& x) const;
+};
+
+struct VppNnedi {
+    bool              enable;
+    VppNnediField     field;
+    int               nns;
+    VppNnediNSize     nsize;
+    VppNnediQuality   quality;
+    VppNnediPrecision precision;
+    VppNnediPreScreen pre_screen;
+    VppNnediErrorType errortype;
+    tstring           weightfile;
+
+    bool isbob();
+    VppNnedi();
+    bool operator==(const VppNnedi& x) const;
+    bool operator!=(const VppNnedi& x) const;
+};
+
+enum {
+    AFS_PRESET_DEFAULT = 0,
+    AFS_PRESET_TRIPLE,        //動き重視
+    AFS_PRESET_DOUBLE,        //二重化
+    AFS_PRESET_ANIME,                     //映画/アニメ
+    AFS_PRESET_CINEMA = AFS_PRESET_ANIME, //映画/アニメ
+    AFS_PRESET_MIN_AFTERIMG,              //残像最小化
+    AFS_PRESET_FORCE24_SD,                //24fps固定
+    AFS_PRESET_FORCE24_HD,                //24fps固定 (HD)
+    AFS_PRESET_FORCE30,                   //30fps固定
+};
+
+const CX_DESC list_afs_preset[] = {
+    { _T("default"),      AFS_PRESET_DEFAULT },
+    { _T("triple"),       AFS_PRESET_TRIPLE },
+    { _T("double"),       AFS_PRESET_DOUBLE },
+    { _T("anime/cinema"), AFS_PRESET_ANIME },
+    { _T("anime"),        AFS_PRESET_ANIME },
+    { _T("cinema"),       AFS_PRESET_CINEMA },
+    { _T("min_afterimg"), AFS_PRESET_MIN_AFTERIMG },
+    { _T("24fps"),        AFS_PRESET_FORCE24_HD },
+    { _T("24fps_sd"),     AFS_PRESET_FORCE24_SD },
+    { _T("30fps"),        AFS_PRESET_FORCE30 },
+    { NULL, NULL }
+};
+
+enum VppCustomInterface {
+    VPP_CUSTOM_INTERFACE_PER_PLANE,
+    VPP_CUSTOM_INTERFACE_PLANES,
+
+    VPP_CUSTOM_INTERFACE_MAX,
+};
+
+const CX_DESC list_vpp_custom_interface[] = {
+    { _T("per_plane"),    VPP_CUSTOM_INTERFACE_PER_PLANE },
+    { _T("planes"),       VPP_CUSTOM_INTERFACE_PLANES },
+    { NULL, NULL }
+};
+
+enum VppCustomInterlaceMode {
+    VPP_CUSTOM_INTERLACE_UNSUPPORTED,
+    VPP_CUSTOM_INTERLACE_PER_FIELD,
+    VPP_CUSTOM_INTERLACE_FRAME,
+
+    VPP_CUSTOM_INTERLACE_MAX,
+};
+
+const CX_DESC list_vpp_custom_interlace[] = {
+    { _T("unsupported"), VPP_CUSTOM_INTERLACE_UNSUPPORTED },
+    { _T("per_field"),   VPP_CUSTOM_INTERLACE_PER_FIELD },
+    { _T("frame"),       VPP_CUSTOM_INTERLACE_FRAME },
+    { NULL, NULL }
+};
+
+struct VppCustom {
+    bool enable;
+    tstring filter_name;
+    tstring kernel_name;
+    tstring kernel_path;
+    std::string kernel;
+    std::string compile_options;
+    VppCustomInterface kernel_interface;
+    VppCustomInterlaceMode interlace;
+    int threadPerBlockX;
+    int threadPerBlockY;
+    int pixelPerThreadX;
+    int pixelPerThreadY;
+    int dstWidth;
+    int dstHeight;
+    std::map<std::string, std::string> params;
+
+    VppCustom();
+    bool operator==(const VppCustom &x) const;
+    bool operator!=(const VppCustom &x) const;
+};
+
+struct VppParam {
+    bool bCheckPerformance;
+    bool cpu;          //対応するフィルタをCPUで処理する (--vpp-cpu)
+    int deinterlace;   //cudaVideoDeinterlaceMode
+    int resizeInterp;  //NppiInterpolationMode または RESIZE_CUDA_xxx
+    int gaussMaskSize; //NppiMaskSize (0で無効)
+
+    VppDelogo delogo;
+    VppUnsharp unsharp;
+    VppEdgelevel edgelevel;
+    VppKnn knn;
+    VppPmd pmd;
+    VppDeband deband;
+    VppAfs afs;
+    VppNnedi nnedi;
+    VppYadif yadif;
+    VppTweak tweak;
+    VppColorspace colorspace;
+    VppPad pad;
+    std::vector<VppSubburn> subburn;
+    VppSelectEvery selectevery;
+    bool rff;
+
+    VppParam();
+};
+
+#endif //__NVENC_VPP_PARAM_H__
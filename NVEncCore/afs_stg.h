@@ -1,8 +1,10 @@
 ﻿#pragma once
 
+#if defined(_WIN32) || defined(_WIN64)
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#endif //#if defined(_WIN32) || defined(_WIN64)
 
 static const char *const AFS_STG_UP               = "up";
 static const char *const AFS_STG_BOTTOM           = "bottom";
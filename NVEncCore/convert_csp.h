@@ -304,6 +304,7 @@ typedef struct ConvertCSP {
 } ConvertCSP;
 
 const ConvertCSP *get_convert_csp_func(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, uint32_t simd);
+const ConvertCSP *get_convert_csp_func_list(int *count);
 const TCHAR *get_simd_str(unsigned int simd);
 
 enum RGY_FRAME_FLAGS : uint64_t {
@@ -214,7 +214,7 @@ void convert_yuy2_to_nv12_i_avx2(void **dst_array, const void **src_array, int w
     const void *src = src_array[0];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
-    uint8_t *dstYLine = (uint8_t *)dst_array[0] + src_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
     for (int y = 0; y < y_range.len; y += 4) {
         for (int i = 0; i < 2; i++) {
@@ -365,7 +365,7 @@ void convert_rgb24r_to_rgb32_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     alignas(32) const char MASK_RGB3_TO_RGB4[] = {
         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
@@ -422,7 +422,7 @@ void convert_rgb32r_to_rgb32_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 4;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         avx2_memcpy<false>(dstLine, srcLine, y_width * 4);
@@ -452,7 +452,7 @@ void convert_rgb24r_to_rgb24_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         avx2_memcpy<false>(dstLine, srcLine, y_width * 3);
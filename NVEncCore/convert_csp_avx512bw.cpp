@@ -0,0 +1,598 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#define USE_SSE2  1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX   1
+#define USE_AVX2  1
+
+#include <immintrin.h>
+#include "rgy_simd.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "convert_csp.h"
+
+#if (defined(_MSC_VER) && defined(_M_X64)) || defined(__AVX512BW__)
+
+#if _MSC_VER >= 1800 && !defined(__AVX__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX512 for this file.");
+#endif
+
+//下位nbyte分のマスク (n <= 0 なら0)
+static __forceinline __mmask64 avx512_mask64(int n) {
+    return (n <= 0) ? (__mmask64)0 : ((n >= 64) ? (__mmask64)-1 : (((__mmask64)1 << n) - 1));
+}
+static __forceinline __mmask32 avx512_mask32(int n) {
+    return (n <= 0) ? (__mmask32)0 : ((n >= 32) ? (__mmask32)-1 : (((__mmask32)1 << n) - 1));
+}
+
+//128bit lane単位のpack/unpackの結果を、通常の並びに戻すための64bit単位の並べ替え
+#define zIDX_PACK_LANE      _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0)
+#define zIDX_UNPACK_LANE    _mm512_set_epi64(7, 3, 6, 2, 5, 1, 4, 0)
+
+template<bool use_stream>
+static void __forceinline avx512_memcpy(uint8_t *dst, const uint8_t *src, int size) {
+    uint8_t *dst_fin = dst + size;
+    __m512i z0, z1, z2, z3;
+    //端数はマスク付きのload/storeで処理する
+    const int start_align_diff = (int)((size_t)dst & 63);
+    if (start_align_diff) {
+        const __mmask64 mask = avx512_mask64(std::min(64 - start_align_diff, size));
+        z0 = _mm512_maskz_loadu_epi8(mask, src);
+        _mm512_mask_storeu_epi8(dst, mask, z0);
+        dst += 64 - start_align_diff;
+        src += 64 - start_align_diff;
+    }
+#define _mm512_stream_switch_si512(x, zmm) ((use_stream) ? _mm512_stream_si512((x), (zmm)) : _mm512_store_si512((x), (zmm)))
+    for ( ; dst + 256 <= dst_fin; dst += 256, src += 256) {
+        z0 = _mm512_loadu_si512((const __m512i*)(src +   0));
+        z1 = _mm512_loadu_si512((const __m512i*)(src +  64));
+        z2 = _mm512_loadu_si512((const __m512i*)(src + 128));
+        z3 = _mm512_loadu_si512((const __m512i*)(src + 192));
+        _mm512_stream_switch_si512((__m512i*)(dst +   0), z0);
+        _mm512_stream_switch_si512((__m512i*)(dst +  64), z1);
+        _mm512_stream_switch_si512((__m512i*)(dst + 128), z2);
+        _mm512_stream_switch_si512((__m512i*)(dst + 192), z3);
+    }
+#undef _mm512_stream_switch_si512
+    for ( ; dst < dst_fin; dst += 64, src += 64) {
+        const __mmask64 mask = avx512_mask64((int)(dst_fin - dst));
+        z0 = _mm512_maskz_loadu_epi8(mask, src);
+        _mm512_mask_storeu_epi8(dst, mask, z0);
+    }
+}
+
+static __forceinline void separate_low_up_avx512(__m512i& z0_return_lower, __m512i& z1_return_upper) {
+    __m512i z4, z5;
+    const __m512i zMaskLowByte = _mm512_set1_epi16(0x00ff);
+    z4 = _mm512_srli_epi16(z0_return_lower, 8);
+    z5 = _mm512_srli_epi16(z1_return_upper, 8);
+
+    z0_return_lower = _mm512_and_si512(z0_return_lower, zMaskLowByte);
+    z1_return_upper = _mm512_and_si512(z1_return_upper, zMaskLowByte);
+
+    //lane単位でpackされるので、並べ替えは呼び出し側で行う
+    z0_return_lower = _mm512_packus_epi16(z0_return_lower, z1_return_upper);
+    z1_return_upper = _mm512_packus_epi16(z4, z5);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4100)
+void convert_yuy2_to_nv12_avx512(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    const __m512i zIdx = zIDX_PACK_LANE;
+    for (int y = 0; y < y_range.len; y += 2) {
+        uint8_t *p = srcLine;
+        uint8_t *pw = p + src_y_pitch_byte;
+        const int x_fin = width - crop_right - crop_left;
+        __m512i z0, z1, z3;
+        for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+            const int remain = x_fin - x;
+            const __mmask64 mask_src0 = avx512_mask64(remain * 2);
+            const __mmask64 mask_src1 = avx512_mask64(remain * 2 - 64);
+            const __mmask64 mask_dst  = avx512_mask64(remain);
+            //-----------1行目---------------
+            z0 = _mm512_maskz_loadu_epi8(mask_src0, p +  0);
+            z1 = _mm512_maskz_loadu_epi8(mask_src1, p + 64);
+
+            separate_low_up_avx512(z0, z1);
+            z3 = z1;
+
+            _mm512_mask_storeu_epi8(dstYLine + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z0));
+            //-----------1行目終了---------------
+
+            //-----------2行目---------------
+            z0 = _mm512_maskz_loadu_epi8(mask_src0, pw +  0);
+            z1 = _mm512_maskz_loadu_epi8(mask_src1, pw + 64);
+
+            separate_low_up_avx512(z0, z1);
+
+            _mm512_mask_storeu_epi8(dstYLine + dst_y_pitch_byte + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z0));
+            //-----------2行目終了---------------
+
+            z1 = _mm512_avg_epu8(z1, z3);  //VUVUVUVUVUVUVUVU
+            _mm512_mask_storeu_epi8(dstCLine + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z1));
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+        dstCLine += dst_y_pitch_byte;
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+static __forceinline __m512i yuv422_to_420_i_interpolate_avx512(__m512i z_up, __m512i z_down, int i) {
+    __m512i z0, z1;
+    //i=0なら 下:上=1:3、i=1なら 下:上=3:1
+    const __m512i zWeight = _mm512_set1_epi16((i) ? 0x0103 : 0x0301);
+    z0 = _mm512_unpacklo_epi8(z_down, z_up);
+    z1 = _mm512_unpackhi_epi8(z_down, z_up);
+    z0 = _mm512_maddubs_epi16(z0, zWeight);
+    z1 = _mm512_maddubs_epi16(z1, zWeight);
+    z0 = _mm512_add_epi16(z0, _mm512_set1_epi16(2));
+    z1 = _mm512_add_epi16(z1, _mm512_set1_epi16(2));
+    z0 = _mm512_srai_epi16(z0, 2);
+    z1 = _mm512_srai_epi16(z1, 2);
+    z0 = _mm512_packus_epi16(z0, z1);
+    return z0;
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+#pragma warning (disable: 4100)
+void convert_yuy2_to_nv12_i_avx512(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    const __m512i zIdx = zIDX_PACK_LANE;
+    for (int y = 0; y < y_range.len; y += 4) {
+        for (int i = 0; i < 2; i++) {
+            uint8_t *p = srcLine;
+            uint8_t *pw = p + (src_y_pitch_byte<<1);
+            __m512i z0, z1, z3;
+            const int x_fin = width - crop_right - crop_left;
+            for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+                const int remain = x_fin - x;
+                const __mmask64 mask_src0 = avx512_mask64(remain * 2);
+                const __mmask64 mask_src1 = avx512_mask64(remain * 2 - 64);
+                const __mmask64 mask_dst  = avx512_mask64(remain);
+                //-----------    1+i行目   ---------------
+                z0 = _mm512_maskz_loadu_epi8(mask_src0, p +  0);
+                z1 = _mm512_maskz_loadu_epi8(mask_src1, p + 64);
+
+                separate_low_up_avx512(z0, z1);
+                z3 = z1;
+
+                _mm512_mask_storeu_epi8(dstYLine + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z0));
+                //-----------1+i行目終了---------------
+
+                //-----------3+i行目---------------
+                z0 = _mm512_maskz_loadu_epi8(mask_src0, pw +  0);
+                z1 = _mm512_maskz_loadu_epi8(mask_src1, pw + 64);
+
+                separate_low_up_avx512(z0, z1);
+
+                _mm512_mask_storeu_epi8(dstYLine + (dst_y_pitch_byte<<1) + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z0));
+                //-----------3+i行目終了---------------
+                z0 = yuv422_to_420_i_interpolate_avx512(z3, z1, i);
+
+                _mm512_mask_storeu_epi8(dstCLine + x, mask_dst, _mm512_permutexvar_epi64(zIdx, z0));
+            }
+            srcLine  += src_y_pitch_byte;
+            dstYLine += dst_y_pitch_byte;
+            dstCLine += dst_y_pitch_byte;
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+    }
+    _mm256_zeroupper();
+}
+
+template<bool uv_only>
+static void __forceinline convert_yv12_to_nv12_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy<false>(dstLine, srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const __m512i zIdx = zIDX_UNPACK_LANE;
+    const int uv_width = width - crop_right - crop_left;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint8_t *dst_ptr = dstLine;
+        __m512i z0, z1, z2;
+        for (int x = 0; x < uv_width; x += 128, src_u_ptr += 64, src_v_ptr += 64, dst_ptr += 128) {
+            const int remain = uv_width - x;
+            const __mmask64 mask_src = avx512_mask64((remain + 1) >> 1);
+            z0 = _mm512_maskz_loadu_epi8(mask_src, src_u_ptr);
+            z1 = _mm512_maskz_loadu_epi8(mask_src, src_v_ptr);
+
+            z0 = _mm512_permutexvar_epi64(zIdx, z0);
+            z1 = _mm512_permutexvar_epi64(zIdx, z1);
+
+            z2 = _mm512_unpackhi_epi8(z0, z1);
+            z0 = _mm512_unpacklo_epi8(z0, z1);
+
+            _mm512_mask_storeu_epi8(dst_ptr +  0, avx512_mask64(remain),      z0);
+            _mm512_mask_storeu_epi8(dst_ptr + 64, avx512_mask64(remain - 64), z2);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_uv_yv12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512_base<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+#pragma warning (disable: 4100)
+template<bool src_bottom_up>
+static void __forceinline convert_rgb24_to_rgb32_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (src_bottom_up)
+        ? (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 3
+        : (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left * 3;
+    uint8_t *dstLine = (src_bottom_up)
+        ? (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len))
+        : (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+    const int src_line_step = (src_bottom_up) ? -src_y_pitch_byte : src_y_pitch_byte;
+    //48byte(16pixel)を各laneに12byteずつ配置し、lane内でshuffleする
+    const __m512i zIdx = _mm512_set_epi32(11, 11, 10, 9, 8, 8, 7, 6, 5, 5, 4, 3, 2, 2, 1, 0);
+    const __m512i zMask = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+    const int x_fin = width - crop_left - crop_right;
+    for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_line_step) {
+        uint8_t *ptr_src = srcLine;
+        uint8_t *ptr_dst = dstLine;
+        int x = 0;
+        for (; x + 64 <= x_fin; x += 64, ptr_dst += 256, ptr_src += 192) {
+            const __mmask64 mask_src = avx512_mask64(48);
+            __m512i z0 = _mm512_maskz_loadu_epi8(mask_src, ptr_src +   0);
+            __m512i z1 = _mm512_maskz_loadu_epi8(mask_src, ptr_src +  48);
+            __m512i z2 = _mm512_maskz_loadu_epi8(mask_src, ptr_src +  96);
+            __m512i z3 = _mm512_maskz_loadu_epi8(mask_src, ptr_src + 144);
+            z0 = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(zIdx, z0), zMask);
+            z1 = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(zIdx, z1), zMask);
+            z2 = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(zIdx, z2), zMask);
+            z3 = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(zIdx, z3), zMask);
+            _mm512_storeu_si512((__m512i*)(ptr_dst +   0), z0);
+            _mm512_storeu_si512((__m512i*)(ptr_dst +  64), z1);
+            _mm512_storeu_si512((__m512i*)(ptr_dst + 128), z2);
+            _mm512_storeu_si512((__m512i*)(ptr_dst + 192), z3);
+        }
+        for (; x < x_fin; x += 16, ptr_dst += 64, ptr_src += 48) {
+            const int remain = x_fin - x;
+            __m512i z0 = _mm512_maskz_loadu_epi8(avx512_mask64(remain * 3), ptr_src);
+            z0 = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(zIdx, z0), zMask);
+            _mm512_mask_storeu_epi8(ptr_dst, avx512_mask64(remain * 4), z0);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+void convert_rgb24_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_rgb24_to_rgb32_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb24r_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_rgb24_to_rgb32_avx512_base<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+template<bool uv_only>
+static void __forceinline convert_yv12_to_p010_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const __m512i zOffset = _mm512_set1_epi16(2 << 6);
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine  = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            uint16_t *dst_ptr = (uint16_t *)dstLine;
+            uint8_t *src_ptr = srcYLine;
+            __m512i z0, z1;
+            for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                const int remain = y_width - x;
+                z1 = _mm512_maskz_loadu_epi8(avx512_mask64(remain), src_ptr);
+                z0 = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(z1));
+                z1 = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(z1, 1));
+                z0 = _mm512_add_epi16(_mm512_slli_epi16(z0, 8), zOffset);
+                z1 = _mm512_add_epi16(_mm512_slli_epi16(z1, 8), zOffset);
+                _mm512_mask_storeu_epi16(dst_ptr +  0, avx512_mask32(remain),      z0);
+                _mm512_mask_storeu_epi16(dst_ptr + 32, avx512_mask32(remain - 32), z1);
+            }
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const __m512i zIdx = zIDX_UNPACK_LANE;
+    const int uv_width = width - crop_right - crop_left;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint16_t *dst_ptr = (uint16_t *)dstLine;
+        __m512i z0, z1, z2;
+        for (int x = 0; x < uv_width; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            const int remain = uv_width - x;
+            const __mmask32 mask_src = avx512_mask32((remain + 1) >> 1);
+            z0 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask_src, src_u_ptr));
+            z1 = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask_src, src_v_ptr));
+
+            z0 = _mm512_permutexvar_epi64(zIdx, z0);
+            z1 = _mm512_permutexvar_epi64(zIdx, z1);
+
+            z2 = _mm512_unpackhi_epi16(z0, z1);
+            z0 = _mm512_unpacklo_epi16(z0, z1);
+
+            z0 = _mm512_add_epi16(_mm512_slli_epi16(z0, 8), zOffset);
+            z2 = _mm512_add_epi16(_mm512_slli_epi16(z2, 8), zOffset);
+
+            _mm512_mask_storeu_epi16(dst_ptr +  0, avx512_mask32(remain),      z0);
+            _mm512_mask_storeu_epi16(dst_ptr + 32, avx512_mask32(remain - 32), z2);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_p010_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+#pragma warning (disable: 4100)
+template<int in_bit_depth, bool uv_only>
+static void __forceinline convert_yv12_high_to_nv12_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint8_t *dstLine  = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        const __m512i zIdx = zIDX_PACK_LANE;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch_byte) {
+            uint8_t *dst_ptr = dstLine;
+            uint16_t *src_ptr = srcYLine;
+            __m512i z0, z1;
+            for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                const int remain = y_width - x;
+                z0 = _mm512_maskz_loadu_epi16(avx512_mask32(remain),      src_ptr +  0);
+                z1 = _mm512_maskz_loadu_epi16(avx512_mask32(remain - 32), src_ptr + 32);
+
+                z0 = _mm512_srli_epi16(z0, in_bit_depth - 8);
+                z1 = _mm512_srli_epi16(z1, in_bit_depth - 8);
+
+                z0 = _mm512_packus_epi16(z0, z1);
+                z0 = _mm512_permutexvar_epi64(zIdx, z0);
+
+                _mm512_mask_storeu_epi8(dst_ptr, avx512_mask64(remain), z0);
+            }
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const __m512i zMaskHighByte = _mm512_set1_epi16((short)0xff00);
+    const int uv_width = width - crop_right - crop_left;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch_byte) {
+        uint16_t *src_u_ptr = srcULine;
+        uint16_t *src_v_ptr = srcVLine;
+        uint8_t *dst_ptr = dstLine;
+        __m512i z0, z1;
+        for (int x = 0; x < uv_width; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            const int remain = uv_width - x;
+            const __mmask32 mask_src = avx512_mask32((remain + 1) >> 1);
+            z0 = _mm512_maskz_loadu_epi16(mask_src, src_u_ptr);
+            z1 = _mm512_maskz_loadu_epi16(mask_src, src_v_ptr);
+
+            z0 = _mm512_srli_epi16(z0, in_bit_depth - 8);
+            z1 = _mm512_slli_epi16(z1, 16 - in_bit_depth);
+            z1 = _mm512_and_si512(z1, zMaskHighByte);
+
+            z0 = _mm512_or_si512(z0, z1);
+
+            _mm512_mask_storeu_epi8(dst_ptr, avx512_mask64(remain), z0);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_16_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<16, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<14, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<12, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<10, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<9, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4100)
+#pragma warning (disable: 4127)
+template<int in_bit_depth, bool uv_only>
+static void __forceinline convert_yv12_high_to_p010_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            if (in_bit_depth == 16) {
+                avx512_memcpy<true>((uint8_t *)dstLine, (uint8_t *)srcYLine, y_width * (int)sizeof(uint16_t));
+            } else {
+                uint16_t *src_ptr = srcYLine;
+                uint16_t *dst_ptr = dstLine;
+                for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                    const int remain = y_width - x;
+                    const __mmask32 mask0 = avx512_mask32(remain);
+                    const __mmask32 mask1 = avx512_mask32(remain - 32);
+                    __m512i z0 = _mm512_maskz_loadu_epi16(mask0, src_ptr +  0);
+                    __m512i z1 = _mm512_maskz_loadu_epi16(mask1, src_ptr + 32);
+                    z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+                    z1 = _mm512_slli_epi16(z1, 16 - in_bit_depth);
+                    _mm512_mask_storeu_epi16(dst_ptr +  0, mask0, z0);
+                    _mm512_mask_storeu_epi16(dst_ptr + 32, mask1, z1);
+                }
+            }
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *dstLine = (uint16_t *)dst[1] + dst_y_pitch * uv_range.start_dst;
+    const __m512i zIdx = zIDX_UNPACK_LANE;
+    const int uv_width = width - crop_right - crop_left;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
+        uint16_t *src_u_ptr = srcULine;
+        uint16_t *src_v_ptr = srcVLine;
+        uint16_t *dst_ptr = dstLine;
+        __m512i z0, z1, z2;
+        for (int x = 0; x < uv_width; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            const int remain = uv_width - x;
+            const __mmask32 mask_src = avx512_mask32((remain + 1) >> 1);
+            z0 = _mm512_maskz_loadu_epi16(mask_src, src_u_ptr);
+            z1 = _mm512_maskz_loadu_epi16(mask_src, src_v_ptr);
+
+            if (in_bit_depth < 16) {
+                z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+                z1 = _mm512_slli_epi16(z1, 16 - in_bit_depth);
+            }
+
+            z0 = _mm512_permutexvar_epi64(zIdx, z0);
+            z1 = _mm512_permutexvar_epi64(zIdx, z1);
+
+            z2 = _mm512_unpackhi_epi16(z0, z1);
+            z0 = _mm512_unpacklo_epi16(z0, z1);
+
+            _mm512_mask_storeu_epi16(dst_ptr +  0, avx512_mask32(remain),      z0);
+            _mm512_mask_storeu_epi16(dst_ptr + 32, avx512_mask32(remain - 32), z2);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_16_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<16, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<14, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<12, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<10, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<9, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#endif //#if (defined(_MSC_VER) && defined(_M_X64)) || defined(__AVX512BW__)
@@ -0,0 +1,323 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#if _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif //_MSC_VER
+#include "rgy_osdep.h"
+#include "rgy_simd.h"
+#include "rgy_util.h"
+#include "rgy_input.h"
+#include "cpu_info.h"
+#include "convert_csp_bench.h"
+
+static const int CSP_BENCH_MIN_FRAMES = 4;
+static const int CSP_BENCH_MIN_TIME_MS = 50;
+static const int CSP_BENCH_PITCH_ALIGN = 64;
+static const int CSP_BENCH_PAD_LINES = 4;
+
+struct CSPBenchPlane {
+    int width_byte;
+    int height;
+};
+
+//csp_from, csp_toのメモリ上の並び (変換関数に渡すポインタの配列の各要素の幅と高さ)
+static int csp_bench_planes(RGY_CSP csp, int width, int height, CSPBenchPlane planes[4]) {
+    const int pixel_size = (RGY_CSP_BIT_DEPTH[csp] > 8) ? 2 : 1;
+    switch (csp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_P010:
+        planes[0] = { width * pixel_size, height };
+        planes[1] = { width * pixel_size, height >> 1 };
+        return 2;
+    case RGY_CSP_NV16:
+    case RGY_CSP_P210:
+        planes[0] = { width * pixel_size, height };
+        planes[1] = { width * pixel_size, height };
+        return 2;
+    case RGY_CSP_YUY2:
+        planes[0] = { width * 2, height };
+        return 1;
+    case RGY_CSP_YC48:
+        planes[0] = { width * 6, height };
+        return 1;
+    case RGY_CSP_RGB24R:
+    case RGY_CSP_RGB24:
+    case RGY_CSP_BGR24:
+        planes[0] = { width * 3, height };
+        return 1;
+    case RGY_CSP_RGB32R:
+    case RGY_CSP_RGB32:
+    case RGY_CSP_BGR32:
+        planes[0] = { width * 4, height };
+        return 1;
+    case RGY_CSP_Y8:
+    case RGY_CSP_Y16:
+        planes[0] = { width * pixel_size, height };
+        return 1;
+    default:
+        break;
+    }
+    switch (RGY_CSP_CHROMA_FORMAT[csp]) {
+    case RGY_CHROMAFMT_YUV420:
+        planes[0] = { width * pixel_size, height };
+        planes[1] = { (width >> 1) * pixel_size, height >> 1 };
+        planes[2] = planes[1];
+        return 3;
+    case RGY_CHROMAFMT_YUV422:
+        planes[0] = { width * pixel_size, height };
+        planes[1] = { (width >> 1) * pixel_size, height };
+        planes[2] = planes[1];
+        return 3;
+    case RGY_CHROMAFMT_YUVA444:
+    case RGY_CHROMAFMT_RGB:
+        for (int i = 0; i < 4; i++) {
+            planes[i] = { width * pixel_size, height };
+        }
+        return (csp == RGY_CSP_RGB || csp == RGY_CSP_GBR) ? 3 : 4;
+    case RGY_CHROMAFMT_YUV444:
+    default:
+        for (int i = 0; i < 3; i++) {
+            planes[i] = { width * pixel_size, height };
+        }
+        return 3;
+    }
+}
+
+class CSPBenchFrame {
+public:
+    CSPBenchFrame() : m_csp(RGY_CSP_NA), m_planes(), m_plane_count(0), m_pitch(0), m_uv_pitch(0), m_offset(), m_size(0), m_buf() {};
+    ~CSPBenchFrame() {};
+
+    //入力側は読み込み側(RGYInputRaw)と同じく各planeを詰めて配置し、
+    //出力側はRGYFrame::ptrArrayと同じくpitch * heightごとに配置する
+    void alloc(RGY_CSP csp, int width, int height, bool input) {
+        m_csp = csp;
+        m_plane_count = csp_bench_planes(csp, width, height, m_planes);
+        m_pitch = ALIGN(m_planes[0].width_byte, CSP_BENCH_PITCH_ALIGN);
+        //入力側のplanarの色差は、読み込み側と同様に輝度の半分のpitchとする
+        m_uv_pitch = (input && m_plane_count == 3 && m_planes[1].width_byte < m_planes[0].width_byte) ? m_pitch >> 1 : m_pitch;
+        m_offset[0] = 0;
+        for (int i = 1; i < m_plane_count; i++) {
+            m_offset[i] = (input) ? m_offset[i-1] + plane_pitch(i-1) * m_planes[i-1].height : (size_t)m_pitch * height * i;
+        }
+        m_size = m_offset[m_plane_count-1] + (size_t)m_pitch * (height + CSP_BENCH_PAD_LINES);
+        m_buf = std::unique_ptr<uint8_t, aligned_malloc_deleter>((uint8_t *)_aligned_malloc(m_size, CSP_BENCH_PITCH_ALIGN), aligned_malloc_deleter());
+    }
+    void clear() {
+        memset(m_buf.get(), 0, m_size);
+    }
+    void fill_random(RGY_CSP csp, uint32_t seed) {
+        clear();
+        const int bit_depth = RGY_CSP_BIT_DEPTH[csp];
+        for (int i = 0; i < m_plane_count; i++) {
+            for (int y = 0; y < m_planes[i].height; y++) {
+                uint8_t *line = plane_line(i, y);
+                for (int x = 0; x < m_planes[i].width_byte; x += 2) {
+                    seed = seed * 1664525u + 1013904223u;
+                    uint16_t value = (uint16_t)(seed >> 16);
+                    if (csp == RGY_CSP_YC48) {
+                        //Y: 0～4095, Cb/Cr: -2048～2047 の範囲に収める
+                        value = ((x >> 1) % 3 == 0) ? (value & 4095) : (uint16_t)((int16_t)(value & 4095) - 2048);
+                    } else if (bit_depth > 8 && bit_depth < 16) {
+                        value &= (1 << bit_depth) - 1;
+                    }
+                    memcpy(line + x, &value, std::min(2, m_planes[i].width_byte - x));
+                }
+            }
+        }
+    }
+    //有効領域 (cropした場合は出力される範囲の width x height) のみを比較する
+    bool equals(const CSPBenchFrame& frame, int width, int height) const {
+        CSPBenchPlane planes[4];
+        csp_bench_planes(m_csp, width, height, planes);
+        for (int i = 0; i < m_plane_count; i++) {
+            for (int y = 0; y < planes[i].height; y++) {
+                if (memcmp(plane_line(i, y), frame.plane_line(i, y), planes[i].width_byte)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    void ptrArray(void *ptr[4]) const {
+        for (int i = 0; i < 4; i++) {
+            ptr[i] = (i < m_plane_count) ? m_buf.get() + m_offset[i] : nullptr;
+        }
+    }
+    //width x heightの範囲を読み書きするバイト数
+    size_t frame_bytes(bool uv_only, int width, int height) const {
+        CSPBenchPlane planes[4];
+        csp_bench_planes(m_csp, width, height, planes);
+        size_t size = 0;
+        for (int i = (uv_only) ? 1 : 0; i < m_plane_count; i++) {
+            size += (size_t)planes[i].width_byte * planes[i].height;
+        }
+        return size;
+    }
+    int pitch() const { return m_pitch; };
+    int uv_pitch() const { return m_uv_pitch; };
+protected:
+    int plane_pitch(int iplane) const {
+        return (iplane == 0) ? m_pitch : m_uv_pitch;
+    }
+    uint8_t *plane_line(int iplane, int y) const {
+        return m_buf.get() + m_offset[iplane] + (size_t)plane_pitch(iplane) * y;
+    }
+
+    RGY_CSP m_csp;
+    CSPBenchPlane m_planes[4];
+    int m_plane_count;
+    int m_pitch;
+    int m_uv_pitch;
+    size_t m_offset[4];
+    size_t m_size;
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> m_buf;
+};
+
+//同じ変換を行うもののうち、利用可能でもっとも低いSIMDの関数 (リストの後ろにあるもの) を比較の基準とする
+//インタレの場合は、インタレ用の関数を持たない (プログレッシブと同じ関数の) ものは基準としない
+static const ConvertCSP *csp_bench_reference(const ConvertCSP *list, int count, const ConvertCSP *target, int interlaced, uint32_t availableSIMD) {
+    const ConvertCSP *ref = nullptr;
+    for (int i = 0; i < count; i++) {
+        if (list[i].csp_from == target->csp_from
+            && list[i].csp_to == target->csp_to
+            && list[i].uv_only == target->uv_only
+            && list[i].simd == (availableSIMD & list[i].simd)
+            && (!interlaced || &list[i] == target || list[i].func[1] != list[i].func[0])) {
+            ref = &list[i];
+        }
+    }
+    return ref;
+}
+
+int convert_csp_bench(FILE *fp, int max_threads) {
+    struct CSPBenchCase {
+        int width, height;
+        int crop[4]; //left, up, right, bottom
+    };
+    static const CSPBenchCase cases[] = {
+        { 1280,  720, { 0, 0, 0, 0 } },
+        { 1920, 1080, { 0, 0, 0, 0 } },
+        { 3840, 2160, { 0, 0, 0, 0 } },
+        //cropした場合の入力の位置の計算を確認する (左端はSIMDの幅にそろわない位置とする)
+        { 1920, 1080, { 2, 4, 6, 4 } },
+    };
+    if (max_threads <= 0) {
+        max_threads = (int)get_cpu_info().physical_cores;
+    }
+    const uint32_t availableSIMD = get_availableSIMD();
+    int count = 0;
+    const ConvertCSP *list = get_convert_csp_func_list(&count);
+
+    int mismatch = 0;
+    _ftprintf(fp, _T("from,to,uv_only,picstruct,simd,width,height,crop,threads,frames,GB/s,cycles/pixel,verify\n"));
+    for (int ifunc = 0; ifunc < count; ifunc++) {
+        const ConvertCSP *target = &list[ifunc];
+        if (target->simd != (availableSIMD & target->simd)) {
+            continue;
+        }
+        const TCHAR *simd_str = (target->simd == NONE) ? _T("C") : get_simd_str(target->simd);
+        for (int interlaced = 0; interlaced < 2; interlaced++) {
+            //インタレ用の関数がプログレッシブと同じものは計測を省略する
+            if (interlaced && target->func[1] == target->func[0]) {
+                continue;
+            }
+            const ConvertCSP *ref = csp_bench_reference(list, count, target, interlaced, availableSIMD);
+            for (const auto& benchCase : cases) {
+                const int width = benchCase.width;
+                const int height = benchCase.height;
+                int crop[4];
+                memcpy(crop, benchCase.crop, sizeof(crop));
+                const int outWidth = width - crop[0] - crop[2];
+                const int outHeight = height - crop[1] - crop[3];
+                CSPBenchFrame src, dst, dst_ref;
+                src.alloc(target->csp_from, width, height, true);
+                dst.alloc(target->csp_to, width, height, false);
+                dst_ref.alloc(target->csp_to, width, height, false);
+                src.fill_random(target->csp_from, (uint32_t)(ifunc * 4 + interlaced));
+                dst_ref.clear();
+
+                void *src_ptr[4], *dst_ptr[4], *dst_ref_ptr[4];
+                src.ptrArray(src_ptr);
+                dst.ptrArray(dst_ptr);
+                dst_ref.ptrArray(dst_ref_ptr);
+                ref->func[interlaced](dst_ref_ptr, (const void **)src_ptr, width, src.pitch(), src.uv_pitch(), dst.pitch(), height, height, 0, 1, crop);
+
+                const double bytes_per_frame = (double)(src.frame_bytes(target->uv_only, outWidth, outHeight) + dst.frame_bytes(target->uv_only, outWidth, outHeight));
+                for (int threads = 1; threads <= max_threads; threads++) {
+                    RGYConvertCSP convert(threads);
+                    if (convert.getFunc(target->csp_from, target->csp_to, target->uv_only, target->simd) != target) {
+                        //より上位のSIMDに同じ条件の関数がある場合 (計測対象の関数に到達できない)
+                        continue;
+                    }
+                    //スレッドの起動とキャッシュのウォームアップ
+                    convert.run(interlaced, dst_ptr, (const void **)src_ptr, width, src.pitch(), src.uv_pitch(), dst.pitch(), height, height, crop);
+
+                    int frames = 0;
+                    const auto start = std::chrono::high_resolution_clock::now();
+                    const uint64_t tsc_start = __rdtsc();
+                    double elapsed_ms = 0.0;
+                    do {
+                        convert.run(interlaced, dst_ptr, (const void **)src_ptr, width, src.pitch(), src.uv_pitch(), dst.pitch(), height, height, crop);
+                        frames++;
+                        elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                    } while (frames < CSP_BENCH_MIN_FRAMES || elapsed_ms < CSP_BENCH_MIN_TIME_MS);
+                    const uint64_t tsc_fin = __rdtsc();
+
+                    //計測後の出力を基準と比較する (スレッド分割の誤りも検出できるよう、毎回確認する)
+                    dst.clear();
+                    convert.run(interlaced, dst_ptr, (const void **)src_ptr, width, src.pitch(), src.uv_pitch(), dst.pitch(), height, height, crop);
+                    const TCHAR *verify = _T("ref");
+                    if (ref != target) {
+                        if (dst.equals(dst_ref, outWidth, outHeight)) {
+                            verify = _T("OK");
+                        } else {
+                            verify = _T("NG");
+                            mismatch++;
+                        }
+                    }
+                    const double gb_per_sec = bytes_per_frame * frames / (elapsed_ms * 1e-3) * 1e-9;
+                    const double cycles_per_pixel = (double)(tsc_fin - tsc_start) / ((double)outWidth * outHeight * frames);
+                    _ftprintf(fp, _T("%s,%s,%d,%s,%s,%d,%d,%d:%d:%d:%d,%d,%d,%.3f,%.3f,%s\n"),
+                        RGY_CSP_NAMES[target->csp_from], RGY_CSP_NAMES[target->csp_to], target->uv_only ? 1 : 0,
+                        interlaced ? _T("i") : _T("p"), simd_str,
+                        width, height, crop[0], crop[1], crop[2], crop[3], threads, frames, gb_per_sec, cycles_per_pixel, verify);
+                    fflush(fp);
+                }
+            }
+        }
+    }
+    return mismatch;
+}
@@ -0,0 +1,42 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __CONVERT_CSP_BENCH_H__
+#define __CONVERT_CSP_BENCH_H__
+
+#include <cstdio>
+#include "convert_csp.h"
+
+//登録されているすべての色空間変換関数について、
+//720p/1080p/2160pでスレッド数1～max_threadsの速度を計測し、CSVで出力する
+//あわせて同じ変換のもっとも低いSIMDの関数(Cがあればその結果)とのビット一致を確認する
+//max_threads <= 0 の場合は物理コア数まで計測する
+//戻り値: 不一致のあった計測の数
+int convert_csp_bench(FILE *fp, int max_threads);
+
+#endif //__CONVERT_CSP_BENCH_H__
@@ -433,7 +433,7 @@ static void __forceinline convert_rgb24r_to_rgb32_simd(void **dst, const void **
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1)) + crop_left * 3;;
-    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * y_range.start_dst);
+    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len)));
     alignas(16) const char MASK_RGB3_TO_RGB4[] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
     __m128i xMask = _mm_load_si128((__m128i*)MASK_RGB3_TO_RGB4);
     for (int y = 0; y  < y_range.len; y++, srcLine -= src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
@@ -474,7 +474,7 @@ static void __forceinline convert_rgb24_to_rgb_simd(void **dst, const void **src
     uint8_t *dst0Line = (uint8_t *)dst[(plane_from >>  0) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst1Line = (uint8_t *)dst[(plane_from >>  8) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst2Line = (uint8_t *)dst[(plane_from >> 16) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
-    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_src - 1) : y_range.start_src) + crop_left * 3;
+    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_dst - 1) : y_range.start_src) + crop_left * 3;
     alignas(16) const char MASK_RGB_TO_RGB24[] = {
         0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
         1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -613,7 +613,7 @@ static void __forceinline convert_rgb32_to_rgb_simd(void **dst, const void **src
     uint8_t *dst0Line = (uint8_t *)dst[(plane_from >>  0) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst1Line = (uint8_t *)dst[(plane_from >>  8) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst2Line = (uint8_t *)dst[(plane_from >> 16) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
-    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_src - 1) : y_range.start_src) + crop_left * 4;
+    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_dst - 1) : y_range.start_src) + crop_left * 4;
     __m128i xMask = _mm_set1_epi16(0xff);
     if (source_reverse) {
         src_y_pitch_byte = -1 * src_y_pitch_byte;
@@ -818,7 +818,7 @@ static void __forceinline convert_rgb24r_to_rgb24_simd(void **dst, const void **
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 3);
@@ -835,7 +835,7 @@ void convert_rgb32_to_rgb32_simd(void **dst, const void **src, int width, int sr
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left * 4;
     uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
     const int x_width = width - crop_right - crop_left;
-    if (csp_from == RGY_CSP_RGB24) {
+    if (csp_from == RGY_CSP_RGB32) {
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, x_width * 4);
     }
@@ -880,7 +880,7 @@ static void __forceinline convert_rgb32r_to_rgb32_simd(void **dst, const void **
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 4;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 4);
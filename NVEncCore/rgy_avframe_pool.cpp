@@ -0,0 +1,110 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include "rgy_avframe_pool.h"
+
+#if ENABLE_AVSW_READER
+
+RGYAVFramePool::RGYAVFramePool() :
+    m_freeList(),
+    m_hit(0), m_miss(0), m_discard(0),
+    m_used(0), m_peakUsed(0) {
+}
+
+RGYAVFramePool::~RGYAVFramePool() {
+    clear();
+}
+
+void RGYAVFramePool::init(size_t maxCachedFrames) {
+    clear();
+    if (maxCachedFrames > 0) {
+        m_freeList.init(maxCachedFrames);
+    }
+    m_hit = 0;
+    m_miss = 0;
+    m_discard = 0;
+    m_used = 0;
+    m_peakUsed = 0;
+}
+
+AVFrame *RGYAVFramePool::get() {
+    AVFrame *frame = nullptr;
+    if (m_freeList.try_pop(&frame)) {
+        m_hit++;
+    } else {
+        if (nullptr == (frame = av_frame_alloc())) {
+            return nullptr;
+        }
+        m_miss++;
+    }
+    const int64_t used = ++m_used;
+    int64_t peak = m_peakUsed.load();
+    while (peak < used && !m_peakUsed.compare_exchange_weak(peak, used)) {
+    }
+    return frame;
+}
+
+AVFrame *RGYAVFramePool::clone(const AVFrame *src) {
+    AVFrame *frame = get();
+    if (frame && av_frame_ref(frame, src) < 0) {
+        release(frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+void RGYAVFramePool::release(AVFrame *frame) {
+    if (frame == nullptr) {
+        return;
+    }
+    m_used--;
+    //データへの参照はここで解放し、構造体のみを保持する
+    av_frame_unref(frame);
+    if (!m_freeList.try_push(frame)) {
+        av_frame_free(&frame);
+        m_discard++;
+    }
+}
+
+void RGYAVFramePool::clear() {
+    AVFrame *frame = nullptr;
+    while (m_freeList.try_pop(&frame)) {
+        av_frame_free(&frame);
+    }
+}
+
+RGYAVFramePoolStats RGYAVFramePool::stats() const {
+    RGYAVFramePoolStats stats;
+    stats.hit      = m_hit.load();
+    stats.miss     = m_miss.load();
+    stats.discard  = m_discard.load();
+    stats.used     = m_used.load();
+    stats.peakUsed = m_peakUsed.load();
+    return stats;
+}
+
+#endif //#if ENABLE_AVSW_READER
@@ -0,0 +1,82 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_AVFRAME_POOL_H__
+#define __RGY_AVFRAME_POOL_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include "rgy_version.h"
+#include "rgy_util.h"
+#include "rgy_queue.h"
+
+#if ENABLE_AVSW_READER
+#include "rgy_avutil.h"
+
+struct RGYAVFramePoolStats {
+    uint64_t hit;      //空きフレームを再利用できた回数
+    uint64_t miss;     //新たにav_frame_allocした回数
+    uint64_t discard;  //空きフレームが上限を超えるため解放した回数
+    int64_t  used;     //貸し出し中のフレーム数
+    int64_t  peakUsed; //貸し出し中のフレーム数の最大値
+};
+
+//AVFrame構造体を使いまわすためのプール
+//返却時にav_frame_unrefでデータへの参照を解放し、構造体のみを保持する
+//(データ領域は、デコーダ/フィルタ側のAVBufferPoolで使いまわされる)
+//空きフレームはRGYQueueMPMCで保持するので、デコードする側とエンコードする側のスレッドが異なっていてもよい
+//initしていない場合やmaxCachedFrames=0でinitした場合は、毎回av_frame_alloc/av_frame_freeする
+class RGYAVFramePool {
+public:
+    RGYAVFramePool();
+    ~RGYAVFramePool();
+
+    //maxCachedFrames: 空きフレームとして保持する数の上限 (0ならプールしない)
+    void init(size_t maxCachedFrames);
+    //空のフレームを取得する (確保できなければnullptr)
+    AVFrame *get();
+    //srcと同じデータを参照するフレームを取得する (av_frame_cloneの代わり)
+    AVFrame *clone(const AVFrame *src);
+    //フレームの参照を解放してプールに返却する (nullptrなら何もしない)
+    void release(AVFrame *frame);
+    //保持している空きフレームをすべて解放する
+    void clear();
+    RGYAVFramePoolStats stats() const;
+protected:
+    RGYQueueMPMC<AVFrame *> m_freeList;
+    std::atomic<uint64_t> m_hit;
+    std::atomic<uint64_t> m_miss;
+    std::atomic<uint64_t> m_discard;
+    std::atomic<int64_t> m_used;
+    std::atomic<int64_t> m_peakUsed;
+};
+
+#endif //#if ENABLE_AVSW_READER
+
+#endif //__RGY_AVFRAME_POOL_H__
@@ -26,9 +26,94 @@
 // --------------------------------------------------------------------------------------------
 
 #include <regex>
+#include <random>
+#include <chrono>
+#include <emmintrin.h>
 #include "rgy_util.h"
+#include "rgy_simd.h"
 #include "rgy_bitstream.h"
 
+size_t find_start_code_c(const uint8_t *data, size_t size) {
+    for (size_t i = 0; i + 2 < size; i++) {
+        if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
+            return i;
+        }
+    }
+    return size;
+}
+
+size_t find_start_code_sse2(const uint8_t *data, size_t size) {
+    const __m128i xZero = _mm_setzero_si128();
+    const __m128i xOne = _mm_set1_epi8(1);
+    size_t i = 0;
+    for (; i + 16 + 2 <= size; i += 16) {
+        //まず3バイト目の01を探し、候補がある場合のみ前の2バイトを確認する
+        const __m128i x2 = _mm_loadu_si128((const __m128i *)(data + i + 2));
+        const int mask2 = _mm_movemask_epi8(_mm_cmpeq_epi8(x2, xOne));
+        if (mask2 == 0) {
+            continue;
+        }
+        const __m128i x0 = _mm_loadu_si128((const __m128i *)(data + i + 0));
+        const __m128i x1 = _mm_loadu_si128((const __m128i *)(data + i + 1));
+        const int mask = mask2 & _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(x0, x1), xZero));
+        if (mask) {
+            return i + ctz32(mask);
+        }
+    }
+    return i + find_start_code_c(data + i, size - i);
+}
+
+funcFindStartCode get_find_start_code_func() {
+    static const funcFindStartCode func = []() {
+        const auto simd = get_availableSIMD();
+        if (simd & AVX2) return find_start_code_avx2;
+        if (simd & SSE2) return find_start_code_sse2;
+        return find_start_code_c;
+    }();
+    return func;
+}
+
+template<bool hevc>
+static void parse_nal_unit(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size, funcFindStartCode find_start_code) {
+    nal_list.clear();
+    if (size <= 3) {
+        return;
+    }
+    if (find_start_code == nullptr) {
+        find_start_code = get_find_start_code_func();
+    }
+    nal_info nal_start = { nullptr, 0, 0 };
+    //NALヘッダの1バイト目まで含まれている必要がある
+    const auto i_fin = size - 3;
+    for (size_t i = 0; i < i_fin; i += 4) {
+        i += find_start_code(data + i, size - i);
+        if (i >= i_fin) {
+            break;
+        }
+        if (nal_start.ptr) {
+            nal_list.push_back(nal_start);
+        }
+        nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
+        nal_start.type = (hevc) ? (data[i+3] & 0x7f) >> 1 : data[i+3] & 0x1f;
+        nal_start.size = data + size - nal_start.ptr;
+        if (nal_list.size()) {
+            auto prev = nal_list.end()-1;
+            prev->size = nal_start.ptr - prev->ptr;
+        }
+    }
+    if (nal_start.ptr) {
+        nal_list.push_back(nal_start);
+    }
+}
+
+void parse_nal_unit_h264(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size, funcFindStartCode find_start_code) {
+    parse_nal_unit<false>(nal_list, data, size, find_start_code);
+}
+
+void parse_nal_unit_hevc(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size, funcFindStartCode find_start_code) {
+    parse_nal_unit<true>(nal_list, data, size, find_start_code);
+}
+
 HEVCHDRSeiPrm::HEVCHDRSeiPrm() : maxcll(-1), maxfall(-1), masterdisplay(), masterdisplay_set(false) {
     memset(&masterdisplay, 0, sizeof(masterdisplay));
 }
@@ -154,3 +239,161 @@ void HEVCHDRSei::to_nal(std::vector<uint8_t>& data) const {
         }
     }
 }
+
+static const int NAL_BENCH_FPS = 60;
+static const int NAL_BENCH_GOP = 60;
+static const int NAL_BENCH_FRAMES = NAL_BENCH_GOP * 2;
+static const int NAL_BENCH_MIN_TIME_MS = 200;
+
+//従来の実装 (1バイトずつ比較し、毎回vectorを確保する)
+static std::vector<nal_info> parse_nal_unit_hevc_legacy(const uint8_t *data, size_t size) {
+    std::vector<nal_info> nal_list;
+    if (size > 3) {
+        nal_info nal_start = { nullptr, 0, 0 };
+        const auto i_fin = size - 3;
+
+        for (size_t i = 0; i < i_fin; i++) {
+            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
+                if (nal_start.ptr) {
+                    nal_list.push_back(nal_start);
+                }
+                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
+                nal_start.type = (data[i+3] & 0x7f) >> 1;
+                nal_start.size = data + size - nal_start.ptr;
+                if (nal_list.size()) {
+                    auto prev = nal_list.end()-1;
+                    prev->size = nal_start.ptr - prev->ptr;
+                }
+                i += 3;
+            }
+        }
+        if (nal_start.ptr) {
+            nal_list.push_back(nal_start);
+        }
+    }
+    return nal_list;
+}
+
+//乱数のペイロードを持つNALを追加する (エミュレーション防止バイトも挿入する)
+static void nal_bench_add_nal(std::vector<uint8_t>& au, uint8_t nal_type, size_t payload_size, bool zero_byte, std::mt19937& mt) {
+    static const uint8_t start_code[] = { 0, 0, 0, 1 };
+    au.insert(au.end(), start_code + (zero_byte ? 0 : 1), start_code + sizeof(start_code));
+    au.push_back((uint8_t)(nal_type << 1));
+    au.push_back(1);
+    std::uniform_int_distribution<int> rand_byte(0, 255);
+    for (size_t i = 0; i < payload_size; i++) {
+        const uint8_t byte = (uint8_t)rand_byte(mt);
+        if (byte <= 3 && au[au.size()-1] == 0 && au[au.size()-2] == 0) {
+            au.push_back(3);
+        }
+        au.push_back(byte);
+    }
+    if (au.back() == 0) {
+        au.push_back(0x80); //rbsp_trailing_bits
+    }
+}
+
+static bool nal_bench_equal(const std::vector<nal_info>& a, const std::vector<nal_info>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].ptr != b[i].ptr || a[i].size != b[i].size || a[i].type != b[i].type) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int parse_nal_unit_bench(FILE *fp, int bitrate_kbps) {
+    if (bitrate_kbps <= 0) {
+        bitrate_kbps = 50000;
+    }
+    //4K 60fpsで指定ビットレートとなるような擬似的なアクセスユニットを作成する
+    //GOP先頭はVPS/SPS/PPS/SEI + IDRスライス、それ以外はTRAILスライスのみ
+    const size_t avg_bytes = (size_t)bitrate_kbps * 1000 / 8 / NAL_BENCH_FPS;
+    std::mt19937 mt(1234);
+    std::uniform_real_distribution<double> rand_ratio(0.6, 1.0);
+    std::vector<std::vector<uint8_t>> au_list(NAL_BENCH_FRAMES);
+    size_t total_bytes = 0;
+    for (int i = 0; i < NAL_BENCH_FRAMES; i++) {
+        auto& au = au_list[i];
+        if (i % NAL_BENCH_GOP == 0) {
+            nal_bench_add_nal(au, NALU_HEVC_VPS, 20, true, mt);
+            nal_bench_add_nal(au, NALU_HEVC_SPS, 60, true, mt);
+            nal_bench_add_nal(au, NALU_HEVC_PPS, 8, true, mt);
+            nal_bench_add_nal(au, NALU_HEVC_PREFIX_SEI, 32, false, mt);
+            nal_bench_add_nal(au, 19 /*IDR_W_RADL*/, avg_bytes * 4, false, mt);
+        } else {
+            nal_bench_add_nal(au, 1 /*TRAIL_R*/, (size_t)(avg_bytes * rand_ratio(mt)), true, mt);
+        }
+        total_bytes += au.size();
+    }
+
+    struct NalBenchFunc {
+        const TCHAR *name;
+        funcFindStartCode func; //nullptrなら従来の実装
+        uint32_t simd;
+    };
+    const NalBenchFunc funcs[] = {
+        { _T("legacy"), nullptr,              NONE },
+        { _T("C"),      find_start_code_c,    NONE },
+        { _T("SSE2"),   find_start_code_sse2, SSE2 },
+        { _T("AVX2"),   find_start_code_avx2, AVX2 },
+    };
+    const uint32_t availableSIMD = get_availableSIMD();
+
+    int mismatch = 0;
+    double legacy_ns_per_au = 0.0;
+    std::vector<nal_info> nal_list;
+    _ftprintf(fp, _T("func,bitrate (kbps),access units,avg AU bytes,GB/s,ns/AU,speedup,verify\n"));
+    for (const auto& target : funcs) {
+        if (target.simd != (availableSIMD & target.simd)) {
+            continue;
+        }
+        //従来の実装の結果と一致するか確認する
+        const TCHAR *verify = _T("ref");
+        if (target.func) {
+            verify = _T("OK");
+            for (const auto& au : au_list) {
+                parse_nal_unit_hevc(nal_list, au.data(), au.size(), target.func);
+                if (!nal_bench_equal(nal_list, parse_nal_unit_hevc_legacy(au.data(), au.size()))) {
+                    verify = _T("NG");
+                    mismatch++;
+                    break;
+                }
+            }
+        }
+
+        size_t checksum = 0;
+        int64_t count = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        double elapsed_ms = 0.0;
+        do {
+            for (const auto& au : au_list) {
+                if (target.func) {
+                    parse_nal_unit_hevc(nal_list, au.data(), au.size(), target.func);
+                    checksum += nal_list.size();
+                } else {
+                    checksum += parse_nal_unit_hevc_legacy(au.data(), au.size()).size();
+                }
+            }
+            count++;
+            elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        } while (elapsed_ms < NAL_BENCH_MIN_TIME_MS);
+
+        const double ns_per_au = elapsed_ms * 1e6 / (double)(count * au_list.size());
+        if (target.func == nullptr) {
+            legacy_ns_per_au = ns_per_au;
+        }
+        _ftprintf(fp, _T("%s,%d,%d,%d,%.3f,%.1f,%.2f,%s\n"),
+            target.name, bitrate_kbps, (int)au_list.size(), (int)(total_bytes / au_list.size()),
+            total_bytes * count / (elapsed_ms * 1e-3) * 1e-9, ns_per_au,
+            (legacy_ns_per_au > 0.0) ? legacy_ns_per_au / ns_per_au : 0.0, verify);
+        fflush(fp);
+        if (checksum == 0) {
+            mismatch++;
+        }
+    }
+    return mismatch;
+}
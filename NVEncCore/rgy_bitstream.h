@@ -31,6 +31,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstdio>
 #include <string>
 
 struct nal_info {
@@ -117,61 +118,37 @@ enum PayloadType {
     REGIONAL_NESTING                     = 157,
 };
 
+//dataからsizeバイトの範囲で最初に00 00 01の現れる位置を返す (見つからなければsizeを返す)
+typedef size_t (*funcFindStartCode)(const uint8_t *data, size_t size);
+size_t find_start_code_c(const uint8_t *data, size_t size);
+size_t find_start_code_sse2(const uint8_t *data, size_t size);
+size_t find_start_code_avx2(const uint8_t *data, size_t size);
+//使用可能なもっとも高速な関数を返す
+funcFindStartCode get_find_start_code_func();
+
+//nal_listをクリアし、dataに含まれるNALの一覧を格納する
+//nal_listを呼び出し側で使いまわせば、毎フレームのメモリ確保が不要になる
+//find_start_codeがnullptrなら、get_find_start_code_func()を使用する
+void parse_nal_unit_h264(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size, funcFindStartCode find_start_code = nullptr);
+void parse_nal_unit_hevc(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size, funcFindStartCode find_start_code = nullptr);
+
 static std::vector<nal_info> parse_nal_unit_h264(const uint8_t *data, size_t size) {
     std::vector<nal_info> nal_list;
-    if (size > 3) {
-        nal_info nal_start = { nullptr, 0, 0 };
-        const auto i_fin = size - 3;
-        for (size_t i = 0; i < i_fin; i++) {
-            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
-                if (nal_start.ptr) {
-                    nal_list.push_back(nal_start);
-                }
-                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
-                nal_start.type = data[i+3] & 0x1f;
-                nal_start.size = data + size - nal_start.ptr;
-                if (nal_list.size()) {
-                    auto prev = nal_list.end()-1;
-                    prev->size = nal_start.ptr - prev->ptr;
-                }
-                i += 3;
-            }
-        }
-        if (nal_start.ptr) {
-            nal_list.push_back(nal_start);
-        }
-    }
+    parse_nal_unit_h264(nal_list, data, size);
     return nal_list;
 }
 
 static std::vector<nal_info> parse_nal_unit_hevc(const uint8_t *data, size_t size) {
     std::vector<nal_info> nal_list;
-    if (size > 3) {
-        nal_info nal_start = { nullptr, 0, 0 };
-        const auto i_fin = size - 3;
-
-        for (size_t i = 0; i < i_fin; i++) {
-            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
-                if (nal_start.ptr) {
-                    nal_list.push_back(nal_start);
-                }
-                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
-                nal_start.type = (data[i+3] & 0x7f) >> 1;
-                nal_start.size = data + size - nal_start.ptr;
-                if (nal_list.size()) {
-                    auto prev = nal_list.end()-1;
-                    prev->size = nal_start.ptr - prev->ptr;
-                }
-                i += 3;
-            }
-        }
-        if (nal_start.ptr) {
-            nal_list.push_back(nal_start);
-        }
-    }
+    parse_nal_unit_hevc(nal_list, data, size);
     return nal_list;
 }
 
+//擬似的な4K HEVCのアクセスユニットでparse_nal_unit_hevcの速度を計測し、CSVで出力する
+//従来の実装(1バイトずつの比較 + 毎回のvector確保)とあわせて結果の一致を確認する
+//戻り値: 不一致のあった計測の数
+int parse_nal_unit_bench(FILE *fp, int bitrate_kbps);
+
 struct HEVCHDRSeiPrm {
     int maxcll;
     int maxfall;
@@ -0,0 +1,59 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <immintrin.h>
+#include "rgy_util.h"
+#include "rgy_bitstream.h"
+
+size_t find_start_code_avx2(const uint8_t *data, size_t size) {
+    const __m256i yZero = _mm256_setzero_si256();
+    const __m256i yOne = _mm256_set1_epi8(1);
+    size_t i = 0;
+    for (; i + 64 + 2 <= size; i += 64) {
+        //まず3バイト目の01を探し、候補がある場合のみ前の2バイトを確認する
+        const __m256i y2a = _mm256_loadu_si256((const __m256i *)(data + i + 2));
+        const __m256i y2b = _mm256_loadu_si256((const __m256i *)(data + i + 34));
+        const __m256i yCandA = _mm256_cmpeq_epi8(y2a, yOne);
+        const __m256i yCandB = _mm256_cmpeq_epi8(y2b, yOne);
+        if (_mm256_testz_si256(_mm256_or_si256(yCandA, yCandB), _mm256_or_si256(yCandA, yCandB))) {
+            continue;
+        }
+        const __m256i y0a = _mm256_loadu_si256((const __m256i *)(data + i + 0));
+        const __m256i y1a = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+        const uint32_t maskA = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(yCandA, _mm256_cmpeq_epi8(_mm256_or_si256(y0a, y1a), yZero)));
+        if (maskA) {
+            return i + ctz32(maskA);
+        }
+        const __m256i y0b = _mm256_loadu_si256((const __m256i *)(data + i + 32));
+        const __m256i y1b = _mm256_loadu_si256((const __m256i *)(data + i + 33));
+        const uint32_t maskB = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(yCandB, _mm256_cmpeq_epi8(_mm256_or_si256(y0b, y1b), yZero)));
+        if (maskB) {
+            return i + 32 + ctz32(maskB);
+        }
+    }
+    return i + find_start_code_sse2(data + i, size - i);
+}
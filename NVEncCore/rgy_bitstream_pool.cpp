@@ -0,0 +1,157 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+#include "rgy_bitstream_pool.h"
+
+static const size_t BITSTREAM_POOL_ALIGN = 32;
+
+RGYBitstreamPool::RGYBitstreamPool() :
+    m_freeList(), m_maxCachedBytes(0),
+    m_hit(0), m_miss(0), m_discard(0),
+    m_usedBytes(0), m_cachedBytes(0), m_peakBytes(0) {
+}
+
+RGYBitstreamPool::~RGYBitstreamPool() {
+    clear();
+}
+
+size_t RGYBitstreamPool::classSize(int idx) {
+    const int octave = idx / SIZE_CLASS_STEPS;
+    const int step   = idx % SIZE_CLASS_STEPS;
+    return ((size_t)1 << (SIZE_CLASS_MIN_LOG2 + octave)) / SIZE_CLASS_STEPS * (SIZE_CLASS_STEPS + step);
+}
+
+int RGYBitstreamPool::classIndexCeil(size_t size) {
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        if (size <= classSize(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RGYBitstreamPool::classIndexFloor(size_t size) {
+    for (int i = SIZE_CLASS_COUNT - 1; i >= 0; i--) {
+        if (classSize(i) <= size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void RGYBitstreamPool::init(size_t maxCachedBytes, size_t maxBlocksPerClass) {
+    clear();
+    m_freeList.clear();
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        m_freeList.push_back(std::make_unique<RGYQueueMPMC<uint8_t *>>());
+        m_freeList.back()->init(maxBlocksPerClass);
+    }
+    m_maxCachedBytes = maxCachedBytes;
+    m_hit = 0;
+    m_miss = 0;
+    m_discard = 0;
+    m_usedBytes = 0;
+    m_cachedBytes = 0;
+    m_peakBytes = 0;
+}
+
+void RGYBitstreamPool::updatePeak() {
+    const int64_t total = m_usedBytes.load() + m_cachedBytes.load();
+    int64_t peak = m_peakBytes.load();
+    while (peak < total && !m_peakBytes.compare_exchange_weak(peak, total)) {
+    }
+}
+
+RGY_ERR RGYBitstreamPool::get(RGYBitstream *bitstream, size_t size) {
+    release(bitstream);
+    const int idx = classIndexCeil(size);
+    uint8_t *ptr = nullptr;
+    if (idx >= 0 && idx < (int)m_freeList.size() && m_freeList[idx]->try_pop(&ptr)) {
+        m_cachedBytes -= classSize(idx);
+        m_hit++;
+    } else {
+        //クラスに収まらない大きさの場合は、そのままのサイズで確保する
+        const size_t allocSize = (idx >= 0) ? classSize(idx) : size;
+        if (nullptr == (ptr = (uint8_t *)_aligned_malloc(allocSize, BITSTREAM_POOL_ALIGN))) {
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+        m_miss++;
+    }
+    const size_t bufSize = (idx >= 0) ? classSize(idx) : size;
+    bitstream->attach(ptr, bufSize);
+    m_usedBytes += bufSize;
+    updatePeak();
+    return RGY_ERR_NONE;
+}
+
+void RGYBitstreamPool::release(RGYBitstream *bitstream) {
+    if (bitstream->bufsize() == 0) {
+        //領域を所有していない(refしている)場合は何もしない
+        bitstream->clear();
+        return;
+    }
+    //RGYBitstream側でchangeSizeされている場合もあるので、実際の領域のサイズで扱う
+    const size_t bufSize = bitstream->bufsize();
+    int64_t used = m_usedBytes.load();
+    while (!m_usedBytes.compare_exchange_weak(used, (std::max)((int64_t)0, used - (int64_t)bufSize))) {
+    }
+    //大きめの領域でも、その大きさ以下のクラスの空き領域として使いまわせる
+    const int idx = classIndexFloor(bufSize);
+    if (idx >= 0 && idx < (int)m_freeList.size()
+        && m_cachedBytes.load() + (int64_t)classSize(idx) <= (int64_t)m_maxCachedBytes) {
+        uint8_t *ptr = bitstream->detach();
+        if (m_freeList[idx]->try_push(ptr)) {
+            m_cachedBytes += classSize(idx);
+            return;
+        }
+        _aligned_free(ptr);
+        m_discard++;
+        return;
+    }
+    bitstream->clear();
+    m_discard++;
+}
+
+void RGYBitstreamPool::clear() {
+    for (size_t i = 0; i < m_freeList.size(); i++) {
+        uint8_t *ptr = nullptr;
+        while (m_freeList[i]->try_pop(&ptr)) {
+            _aligned_free(ptr);
+            m_cachedBytes -= classSize((int)i);
+        }
+    }
+}
+
+RGYBitstreamPoolStats RGYBitstreamPool::stats() const {
+    RGYBitstreamPoolStats stats;
+    stats.hit         = m_hit.load();
+    stats.miss        = m_miss.load();
+    stats.discard     = m_discard.load();
+    stats.usedBytes   = m_usedBytes.load();
+    stats.cachedBytes = m_cachedBytes.load();
+    stats.peakBytes   = m_peakBytes.load();
+    return stats;
+}
@@ -0,0 +1,92 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+#pragma once
+#ifndef __RGY_BITSTREAM_POOL_H__
+#define __RGY_BITSTREAM_POOL_H__
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "rgy_util.h"
+#include "rgy_queue.h"
+#include "NVEncUtil.h"
+
+struct RGYBitstreamPoolStats {
+    uint64_t hit;         //空き領域を再利用できた回数
+    uint64_t miss;        //新たに領域を確保した回数
+    uint64_t discard;     //空き領域が上限を超えるため解放した回数
+    int64_t  usedBytes;   //貸し出し中の領域のバイト数 (貸し出し中にchangeSizeされた場合は概算)
+    int64_t  cachedBytes; //空き領域として保持しているバイト数
+    int64_t  peakBytes;   //usedBytes + cachedBytes の最大値
+};
+
+//RGYBitstreamのデータ領域をサイズクラスごとに使いまわすためのプール
+//サイズクラスは4KB～256MBを1/4オクターブずつ区切ったもので、確保サイズは要求サイズの1.25倍以内に収まる
+//空き領域は各クラスごとにRGYQueueMPMCで保持するので、エンコードスレッドと出力スレッドから並列に使用できる
+//領域は_aligned_mallocで確保したものなので、貸し出し中にRGYBitstream側でclear/changeSizeしてもかまわない
+class RGYBitstreamPool {
+public:
+    static const int SIZE_CLASS_MIN_LOG2 = 12;
+    static const int SIZE_CLASS_MAX_LOG2 = 28;
+    static const int SIZE_CLASS_STEPS = 4; //1オクターブあたりのクラス数
+    static const int SIZE_CLASS_COUNT = (SIZE_CLASS_MAX_LOG2 - SIZE_CLASS_MIN_LOG2) * SIZE_CLASS_STEPS + 1;
+
+    RGYBitstreamPool();
+    ~RGYBitstreamPool();
+
+    //maxCachedBytes: 空き領域として保持するバイト数の上限
+    //maxBlocksPerClass: 各クラスで保持する空き領域の数の上限
+    void init(size_t maxCachedBytes, size_t maxBlocksPerClass);
+    //size以上のデータ領域をbitstreamに割り当てる
+    //bitstreamがすでに領域を持っていれば、先にプールに返却する
+    RGY_ERR get(RGYBitstream *bitstream, size_t size);
+    //bitstreamのデータ領域をプールに返却し、bitstreamは空にする
+    void release(RGYBitstream *bitstream);
+    //保持している空き領域をすべて解放する
+    void clear();
+    RGYBitstreamPoolStats stats() const;
+    //サイズクラスidxの領域のバイト数
+    static size_t classSize(int idx);
+protected:
+    //size以上の最小のクラス (すべてのクラスより大きければ-1)
+    static int classIndexCeil(size_t size);
+    //size以下の最大のクラス (すべてのクラスより小さければ-1)
+    static int classIndexFloor(size_t size);
+    void updatePeak();
+
+    std::vector<std::unique_ptr<RGYQueueMPMC<uint8_t *>>> m_freeList;
+    size_t m_maxCachedBytes;
+    std::atomic<uint64_t> m_hit;
+    std::atomic<uint64_t> m_miss;
+    std::atomic<uint64_t> m_discard;
+    std::atomic<int64_t> m_usedBytes;
+    std::atomic<int64_t> m_cachedBytes;
+    std::atomic<int64_t> m_peakBytes;
+};
+
+#endif //__RGY_BITSTREAM_POOL_H__
@@ -282,12 +282,8 @@ private:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_pLog->write_va(log_level, _T("cap: "), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
     std::vector<CAPTION_DATA> getCaptionDataList(uint8_t ucLangTag);
     std::vector<AVPacket> genCaption(int64_t pts);
@@ -25,75 +25,1074 @@
 //
 // --------------------------------------------------------------------------------------------
 
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-#include <fcntl.h>
-#include <io.h>
+#include <cmath>
+#include <cstdarg>
 #include "rgy_hdr10plus.h"
 
-const TCHAR *RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME =  _T("hdr10plus_gen.exe");
+//HDR10+のjsonを読むための最小限のjsonパーサ
+struct RGYJsonValue {
+    enum Type {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT,
+    };
+    Type type;
+    bool boolean;
+    double number;
+    std::string str;
+    std::vector<RGYJsonValue> array;
+    std::vector<std::pair<std::string, RGYJsonValue>> object;
+
+    RGYJsonValue() : type(JSON_NULL), boolean(false), number(0.0), str(), array(), object() {};
+    void clear() {
+        type = JSON_NULL;
+        boolean = false;
+        number = 0.0;
+        str.clear();
+        array.clear();
+        object.clear();
+    }
+    const RGYJsonValue *find(const char *key) const {
+        if (type != JSON_OBJECT) {
+            return nullptr;
+        }
+        for (const auto& member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class RGYJsonParser {
+public:
+    static const int MAX_DEPTH = 64;
+    RGYJsonParser(const char *json, size_t size) : m_ptr(json), m_fin(json + size), m_top(json), m_error() {};
+
+    //次の文字がcなら読み進める
+    bool accept(char c) {
+        skipSpace();
+        if (m_ptr < m_fin && *m_ptr == c) {
+            m_ptr++;
+            return true;
+        }
+        return false;
+    }
+    bool expect(char c) {
+        if (!accept(c)) {
+            return setError(strsprintf("'%c' expected", c).c_str());
+        }
+        return true;
+    }
+    bool end() {
+        skipSpace();
+        return m_ptr >= m_fin;
+    }
+    bool parseString(std::string& str) {
+        str.clear();
+        if (!expect('"')) {
+            return false;
+        }
+        while (m_ptr < m_fin) {
+            const char c = *m_ptr++;
+            if (c == '"') {
+                return true;
+            } else if ((uint8_t)c < 0x20) {
+                return setError("control character in string");
+            } else if (c != '\\') {
+                str.push_back(c);
+                continue;
+            }
+            if (m_ptr >= m_fin) {
+                break;
+            }
+            switch (*m_ptr++) {
+            case '"':  str.push_back('"'); break;
+            case '\\': str.push_back('\\'); break;
+            case '/':  str.push_back('/'); break;
+            case 'b':  str.push_back('\b'); break;
+            case 'f':  str.push_back('\f'); break;
+            case 'n':  str.push_back('\n'); break;
+            case 'r':  str.push_back('\r'); break;
+            case 't':  str.push_back('\t'); break;
+            case 'u': {
+                //キー名の比較にしか使わないので、サロゲートペアは考慮せずUTF-8に変換する
+                if (m_fin - m_ptr < 4) {
+                    return setError("invalid unicode escape");
+                }
+                uint32_t code = 0;
+                for (int i = 0; i < 4; i++, m_ptr++) {
+                    const char h = *m_ptr;
+                    code <<= 4;
+                    if ('0' <= h && h <= '9')      code |= h - '0';
+                    else if ('a' <= h && h <= 'f') code |= h - 'a' + 10;
+                    else if ('A' <= h && h <= 'F') code |= h - 'A' + 10;
+                    else return setError("invalid unicode escape");
+                }
+                if (code < 0x80) {
+                    str.push_back((char)code);
+                } else if (code < 0x800) {
+                    str.push_back((char)(0xC0 | (code >> 6)));
+                    str.push_back((char)(0x80 | (code & 0x3F)));
+                } else {
+                    str.push_back((char)(0xE0 | (code >> 12)));
+                    str.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+                    str.push_back((char)(0x80 | (code & 0x3F)));
+                }
+                break;
+            }
+            default:
+                return setError("invalid escape sequence");
+            }
+        }
+        return setError("unterminated string");
+    }
+    bool parseValue(RGYJsonValue& value, int depth = 0) {
+        value.clear();
+        if (depth >= MAX_DEPTH) {
+            return setError("nesting too deep");
+        }
+        skipSpace();
+        if (m_ptr >= m_fin) {
+            return setError("unexpected end of data");
+        }
+        switch (*m_ptr) {
+        case '{':
+            m_ptr++;
+            value.type = RGYJsonValue::JSON_OBJECT;
+            if (accept('}')) {
+                return true;
+            }
+            do {
+                value.object.push_back(std::make_pair(std::string(), RGYJsonValue()));
+                if (!parseString(value.object.back().first) || !expect(':') || !parseValue(value.object.back().second, depth + 1)) {
+                    return false;
+                }
+            } while (accept(','));
+            return expect('}');
+        case '[':
+            m_ptr++;
+            value.type = RGYJsonValue::JSON_ARRAY;
+            if (accept(']')) {
+                return true;
+            }
+            do {
+                value.array.push_back(RGYJsonValue());
+                if (!parseValue(value.array.back(), depth + 1)) {
+                    return false;
+                }
+            } while (accept(','));
+            return expect(']');
+        case '"':
+            value.type = RGYJsonValue::JSON_STRING;
+            return parseString(value.str);
+        case 't':
+            value.type = RGYJsonValue::JSON_BOOL;
+            value.boolean = true;
+            return parseLiteral("true");
+        case 'f':
+            value.type = RGYJsonValue::JSON_BOOL;
+            value.boolean = false;
+            return parseLiteral("false");
+        case 'n':
+            value.type = RGYJsonValue::JSON_NULL;
+            return parseLiteral("null");
+        default:
+            value.type = RGYJsonValue::JSON_NUMBER;
+            return parseNumber(value.number);
+        }
+    }
+    //エラー位置を含むメッセージ
+    std::string error() const {
+        int line = 1, column = 1;
+        for (auto ptr = m_top; ptr < m_ptr && ptr < m_fin; ptr++) {
+            if (*ptr == '\n') {
+                line++;
+                column = 1;
+            } else {
+                column++;
+            }
+        }
+        return strsprintf("%s at line %d, column %d", m_error.c_str(), line, column);
+    }
+    bool setError(const char *mes) {
+        if (m_error.length() == 0) {
+            m_error = mes;
+        }
+        return false;
+    }
+protected:
+    void skipSpace() {
+        while (m_ptr < m_fin && (*m_ptr == ' ' || *m_ptr == '\t' || *m_ptr == '\r' || *m_ptr == '\n')) {
+            m_ptr++;
+        }
+    }
+    bool parseLiteral(const char *literal) {
+        const size_t len = strlen(literal);
+        if ((size_t)(m_fin - m_ptr) < len || strncmp(m_ptr, literal, len) != 0) {
+            return setError("invalid literal");
+        }
+        m_ptr += len;
+        return true;
+    }
+    bool parseNumber(double& number) {
+        //strtodは終端を見ないので、数値として有効な文字の範囲をコピーしてから変換する
+        char buf[64];
+        size_t len = 0;
+        while (m_ptr + len < m_fin && len < _countof(buf) - 1 && strchr("+-0123456789.eE", m_ptr[len])) {
+            buf[len] = m_ptr[len];
+            len++;
+        }
+        buf[len] = '\0';
+        char *end = nullptr;
+        number = strtod(buf, &end);
+        if (len == 0 || end != buf + len || !std::isfinite(number)) {
+            return setError("invalid value");
+        }
+        m_ptr += len;
+        return true;
+    }
+
+    const char *m_ptr;
+    const char *m_fin;
+    const char *m_top;
+    std::string m_error;
+};
+
+//ビット単位でバッファに追記する
+class RGYBitWriter {
+public:
+    RGYBitWriter(std::vector<uint8_t>& buf) : m_buf(buf), m_bitPos(8) {};
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            if (m_bitPos == 8) {
+                m_buf.push_back(0);
+                m_bitPos = 0;
+            }
+            m_buf.back() |= (uint8_t)(((value >> i) & 1) << (7 - m_bitPos));
+            m_bitPos++;
+        }
+    }
+protected:
+    std::vector<uint8_t>& m_buf;
+    int m_bitPos; //m_buf.back()内の次に書き込むビット位置
+};
+
+//SEIの各値の取得 (範囲外ならエラー)
+static bool hdr10plus_get_int(const RGYJsonValue *value, const char *name, int bits, int *out, std::string& err) {
+    if (value == nullptr) {
+        err = strsprintf("%s not found", name);
+        return false;
+    }
+    const int max_value = (1 << bits) - 1;
+    if (value->type != RGYJsonValue::JSON_NUMBER || value->number != std::floor(value->number)
+        || value->number < 0.0 || value->number > (double)max_value) {
+        err = strsprintf("%s must be an integer in range 0 - %d", name, max_value);
+        return false;
+    }
+    *out = (int)value->number;
+    return true;
+}
+
+static bool hdr10plus_get_int_array(const RGYJsonValue *value, const char *name, int bits, size_t max_count, std::vector<int>& out, std::string& err) {
+    out.clear();
+    if (value == nullptr || value->type != RGYJsonValue::JSON_ARRAY) {
+        err = strsprintf("%s not found", name);
+        return false;
+    }
+    if (value->array.size() > max_count) {
+        err = strsprintf("too many elements in %s (max %d)", name, (int)max_count);
+        return false;
+    }
+    for (const auto& elem : value->array) {
+        int v = 0;
+        if (!hdr10plus_get_int(&elem, name, bits, &v, err)) {
+            return false;
+        }
+        out.push_back(v);
+    }
+    return true;
+}
+
+//2つ目以降のウィンドウの位置と楕円の指定 (WindowParametersの要素のキーとビット数、ST2094-40の順)
+static const int HDR10PLUS_WINDOW_GEOMETRY_COUNT = 11;
+static const std::pair<const char *, int> HDR10PLUS_WINDOW_GEOMETRY[HDR10PLUS_WINDOW_GEOMETRY_COUNT] = {
+    { "UpperLeftCornerX",             16 },
+    { "UpperLeftCornerY",             16 },
+    { "LowerRightCornerX",            16 },
+    { "LowerRightCornerY",            16 },
+    { "CenterOfEllipseX",             16 },
+    { "CenterOfEllipseY",             16 },
+    { "RotationAngle",                 8 },
+    { "SemiMajorAxisInternalEllipse", 16 },
+    { "SemiMajorAxisExternalEllipse", 16 },
+    { "SemiMinorAxisExternalEllipse", 16 },
+    { "OverlapProcessOption",          1 },
+};
+
+//ウィンドウごとのパラメータ
+struct HDR10PlusWindowParam {
+    int geometry[HDR10PLUS_WINDOW_GEOMETRY_COUNT]; //2つ目以降のウィンドウのみ
+    int average_maxrgb;
+    std::vector<int> maxscl, percentages, percentiles;
+    bool tone_mapping;
+    int knee_point_x, knee_point_y;
+    std::vector<int> anchors;
+
+    HDR10PlusWindowParam() : geometry(), average_maxrgb(0), maxscl(), percentages(), percentiles(), tone_mapping(false), knee_point_x(0), knee_point_y(0), anchors() {};
+};
+
+//ウィンドウが複数の場合、LuminanceParameters/BezierCurveDataはウィンドウごとの配列とする
+//値が配列ならiwindow番目の要素を、そうでなければ (ウィンドウが1つの場合のみ) 値そのものを返す
+//値がない、あるいはnullならoutはnullptrとなる
+static bool hdr10plus_window_value(const RGYJsonValue *value, const char *name, int iwindow, int num_windows, const RGYJsonValue **out, std::string& err) {
+    *out = nullptr;
+    if (value == nullptr) {
+        return true;
+    }
+    if (value->type == RGYJsonValue::JSON_ARRAY) {
+        if ((int)value->array.size() != num_windows) {
+            err = strsprintf("%s must have %d elements (NumberOfWindows)", name, num_windows);
+            return false;
+        }
+        value = &value->array[iwindow];
+    } else if (num_windows != 1) {
+        err = strsprintf("%s must be an array of %d elements (NumberOfWindows)", name, num_windows);
+        return false;
+    }
+    *out = (value->type == RGYJsonValue::JSON_NULL) ? nullptr : value;
+    return true;
+}
+
+static bool hdr10plus_get_window(HDR10PlusWindowParam& window, const RGYJsonValue& scene, int iwindow, int num_windows, std::string& err) {
+    if (iwindow > 0) {
+        const auto windowParams = scene.find("WindowParameters");
+        if (windowParams == nullptr || windowParams->type != RGYJsonValue::JSON_ARRAY || (int)windowParams->array.size() != num_windows - 1) {
+            err = strsprintf("WindowParameters must be an array of %d elements (NumberOfWindows - 1)", num_windows - 1);
+            return false;
+        }
+        const auto& windowParam = windowParams->array[iwindow - 1];
+        for (int i = 0; i < HDR10PLUS_WINDOW_GEOMETRY_COUNT; i++) {
+            if (!hdr10plus_get_int(windowParam.find(HDR10PLUS_WINDOW_GEOMETRY[i].first), HDR10PLUS_WINDOW_GEOMETRY[i].first, HDR10PLUS_WINDOW_GEOMETRY[i].second, &window.geometry[i], err)) {
+                return false;
+            }
+        }
+    }
+    const RGYJsonValue *lum = nullptr;
+    if (!hdr10plus_window_value(scene.find("LuminanceParameters"), "LuminanceParameters", iwindow, num_windows, &lum, err)) {
+        return false;
+    }
+    if (lum == nullptr) {
+        err = "LuminanceParameters not found";
+        return false;
+    }
+    if (!hdr10plus_get_int(lum->find("AverageRGB"), "AverageRGB", 17, &window.average_maxrgb, err)
+        || !hdr10plus_get_int_array(lum->find("MaxScl"), "MaxScl", 17, 3, window.maxscl, err)) {
+        return false;
+    }
+    if (window.maxscl.size() != 3) {
+        err = "MaxScl must have 3 elements";
+        return false;
+    }
+    const auto dist = lum->find("LuminanceDistributions");
+    if (dist == nullptr) {
+        err = "LuminanceDistributions not found";
+        return false;
+    }
+    if (!hdr10plus_get_int_array(dist->find("DistributionIndex"), "DistributionIndex", 7, 15, window.percentages, err)
+        || !hdr10plus_get_int_array(dist->find("DistributionValues"), "DistributionValues", 17, 15, window.percentiles, err)) {
+        return false;
+    }
+    if (window.percentages.size() != window.percentiles.size()) {
+        err = "DistributionIndex and DistributionValues must have the same number of elements";
+        return false;
+    }
+    //BezierCurveDataがなければtone mappingなし
+    const RGYJsonValue *bezier = nullptr;
+    if (!hdr10plus_window_value(scene.find("BezierCurveData"), "BezierCurveData", iwindow, num_windows, &bezier, err)) {
+        return false;
+    }
+    window.tone_mapping = bezier != nullptr;
+    if (bezier) {
+        if (!hdr10plus_get_int(bezier->find("KneePointX"), "KneePointX", 12, &window.knee_point_x, err)
+            || !hdr10plus_get_int(bezier->find("KneePointY"), "KneePointY", 12, &window.knee_point_y, err)
+            || !hdr10plus_get_int_array(bezier->find("Anchors"), "Anchors", 10, 15, window.anchors, err)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//SceneInfoの1要素からST2094-40のペイロード(country codeから)をbufに追記する
+static bool hdr10plus_write_payload(std::vector<uint8_t>& buf, const RGYJsonValue& scene, std::string& err) {
+    if (scene.type != RGYJsonValue::JSON_OBJECT) {
+        err = "SceneInfo element must be an object";
+        return false;
+    }
+    int num_windows = 1;
+    if (auto value = scene.find("NumberOfWindows")) {
+        if (!hdr10plus_get_int(value, "NumberOfWindows", 2, &num_windows, err)) {
+            return false;
+        }
+        if (num_windows < 1) {
+            err = "NumberOfWindows must be 1 - 3";
+            return false;
+        }
+    }
+    int target_max_luminance = 0;
+    if (!hdr10plus_get_int(scene.find("TargetedSystemDisplayMaximumLuminance"), "TargetedSystemDisplayMaximumLuminance", 27, &target_max_luminance, err)) {
+        return false;
+    }
+    HDR10PlusWindowParam windows[3];
+    for (int iw = 0; iw < num_windows; iw++) {
+        if (!hdr10plus_get_window(windows[iw], scene, iw, num_windows, err)) {
+            return false;
+        }
+    }
+
+    RGYBitWriter writer(buf);
+    writer.put(0xB5, 8);   //itu_t_t35_country_code
+    writer.put(0x003C, 16); //itu_t_t35_terminal_provider_code
+    writer.put(0x0001, 16); //itu_t_t35_terminal_provider_oriented_code
+    writer.put(4, 8);       //application_identifier
+    writer.put(1, 8);       //application_version
+    writer.put(num_windows, 2);
+    for (int iw = 1; iw < num_windows; iw++) {
+        for (int i = 0; i < HDR10PLUS_WINDOW_GEOMETRY_COUNT; i++) {
+            writer.put(windows[iw].geometry[i], HDR10PLUS_WINDOW_GEOMETRY[i].second);
+        }
+    }
+    writer.put(target_max_luminance, 27);
+    writer.put(0, 1);       //targeted_system_display_actual_peak_luminance_flag
+    for (int iw = 0; iw < num_windows; iw++) {
+        const auto& window = windows[iw];
+        for (int i = 0; i < 3; i++) {
+            writer.put(window.maxscl[i], 17);
+        }
+        writer.put(window.average_maxrgb, 17);
+        writer.put((uint32_t)window.percentiles.size(), 4);
+        for (size_t i = 0; i < window.percentiles.size(); i++) {
+            writer.put(window.percentages[i], 7);
+            writer.put(window.percentiles[i], 17);
+        }
+        writer.put(0, 10);  //fraction_bright_pixels
+    }
+    writer.put(0, 1);       //mastering_display_actual_peak_luminance_flag
+    for (int iw = 0; iw < num_windows; iw++) {
+        const auto& window = windows[iw];
+        writer.put(window.tone_mapping ? 1 : 0, 1); //tone_mapping_flag
+        if (window.tone_mapping) {
+            writer.put(window.knee_point_x, 12);
+            writer.put(window.knee_point_y, 12);
+            writer.put((uint32_t)window.anchors.size(), 4);
+            for (const auto anchor : window.anchors) {
+                writer.put(anchor, 10);
+            }
+        }
+        writer.put(0, 1);   //color_saturation_mapping_flag
+    }
+    return true;
+}
 
 RGYHDR10Plus::RGYHDR10Plus() :
-    m_proc(), m_pipes(),
-    m_fpStdOut(std::unique_ptr<FILE, decltype(&fclose)>(nullptr, fclose)),
-    m_buffer(std::make_pair(-1, vector<uint8_t>())){
+    m_inputJson(), m_pPrintMes(), m_payload(), m_offset() {
 }
 
 RGYHDR10Plus::~RGYHDR10Plus() {
-    m_fpStdOut.reset();
-    m_proc.reset();
+    m_payload.clear();
+    m_offset.clear();
 }
 
-RGY_ERR RGYHDR10Plus::init(const tstring &inputJson) {
-    if (!(PathFileExists(inputJson.c_str()))) {
-        return RGY_ERR_NOT_FOUND;
+void RGYHDR10Plus::AddMessage(int log_level, const tstring& str) {
+    if (m_pPrintMes == nullptr || log_level < m_pPrintMes->getLogLevel()) {
+        return;
+    }
+    auto lines = split(str, _T("\n"));
+    for (const auto& line : lines) {
+        if (line[0] != _T('\0')) {
+            m_pPrintMes->write(log_level, (_T("hdr10plus: ") + line + _T("\n")).c_str());
+        }
     }
+}
+
+void RGYHDR10Plus::AddMessage(int log_level, const TCHAR *format, ...) {
+    if (m_pPrintMes == nullptr || log_level < m_pPrintMes->getLogLevel()) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    m_pPrintMes->write_va(log_level, _T("hdr10plus: "), format, args);
+    va_end(args);
+}
+
+RGY_ERR RGYHDR10Plus::init(const tstring &inputJson, shared_ptr<RGYLog> pLog) {
+    m_pPrintMes = pLog;
     m_inputJson = inputJson;
-    const tstring HDR10PlusGenExePath = (PathFileExists(HDR10PLUS_GEN_EXE_NAME)) ? HDR10PLUS_GEN_EXE_NAME : getExeDir() + _T("\\") + HDR10PLUS_GEN_EXE_NAME;
-    if (!(PathFileExists(HDR10PlusGenExePath.c_str()))) {
+    std::unique_ptr<FILE, decltype(&fclose)> fp(_tfopen(inputJson.c_str(), _T("rb")), fclose);
+    if (!fp) {
+        AddMessage(RGY_LOG_ERROR, _T("Failed to open %s.\n"), inputJson.c_str());
         return RGY_ERR_NOT_FOUND;
     }
-    const tstring HDR10PlusGenExePathWithQuotes = tstring(_T("\"")) + HDR10PlusGenExePath + _T("\"");
-    const tstring inputJsonWithQuotes = tstring(_T("\"")) + inputJson + _T("\"");
-    std::vector<const TCHAR *> args;
-    args.push_back(HDR10PlusGenExePathWithQuotes.c_str());
-    args.push_back(_T("-i"));
-    args.push_back(inputJsonWithQuotes.c_str());
-    args.push_back(_T("-o"));
-    args.push_back(_T("-"));
-
-    m_pipes.stdOut.mode = PIPE_MODE_ENABLE;
-    m_pipes.stdOut.bufferSize = 1024;
+    std::vector<char> json;
+    char buf[64 * 1024];
+    size_t read_size = 0;
+    while ((read_size = fread(buf, 1, sizeof(buf), fp.get())) > 0) {
+        json.insert(json.end(), buf, buf + read_size);
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("Loaded %s: %d bytes.\n"), inputJson.c_str(), (int)json.size());
+    const auto ret = parse(json.data(), json.size());
+    if (ret != RGY_ERR_NONE) {
+        return ret;
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("Created SEI for %d frames: %d bytes.\n"), frameCount(), (int)m_payload.size());
+    return RGY_ERR_NONE;
+}
 
-    m_proc = std::make_unique<RGYPipeProcessWin>();
-    m_proc->init();
-    if (m_proc->run(args, nullptr, &m_pipes, 0, true, true)) {
-        return RGY_ERR_RUN_PROCESS;
+RGY_ERR RGYHDR10Plus::parse(const char *json, size_t size) {
+    m_payload.clear();
+    m_offset.clear();
+    m_offset.push_back(0);
+    //UTF-8のBOMは読み飛ばす
+    if (size >= 3 && memcmp(json, "\xEF\xBB\xBF", 3) == 0) {
+        json += 3;
+        size -= 3;
+    }
+    //ファイル全体を展開するとフレーム数に比例してメモリを使うので、
+    //SceneInfoの要素は1つずつ読んではペイロードを作成し、破棄する
+    RGYJsonParser parser(json, size);
+    RGYJsonValue value;
+    std::string key, err;
+    bool sceneInfoFound = false;
+    bool ok = parser.expect('{');
+    if (ok && !parser.accept('}')) {
+        do {
+            if (!(ok = parser.parseString(key) && parser.expect(':'))) {
+                break;
+            }
+            if (key != "SceneInfo") {
+                if (!(ok = parser.parseValue(value))) {
+                    break;
+                }
+                continue;
+            }
+            sceneInfoFound = true;
+            if (!(ok = parser.expect('['))) {
+                break;
+            }
+            if (parser.accept(']')) {
+                continue;
+            }
+            do {
+                if (!(ok = parser.parseValue(value, 2))) {
+                    break;
+                }
+                if (!hdr10plus_write_payload(m_payload, value, err)) {
+                    AddMessage(RGY_LOG_ERROR, _T("Invalid SceneInfo #%d: %s.\n"), frameCount(), char_to_tstring(err).c_str());
+                    return RGY_ERR_INVALID_PARAM;
+                }
+                m_offset.push_back((uint32_t)m_payload.size());
+            } while (parser.accept(','));
+            if (!ok || !(ok = parser.expect(']'))) {
+                break;
+            }
+        } while (parser.accept(','));
+        ok = ok && parser.expect('}');
+    }
+    if (ok && !parser.end()) {
+        ok = parser.setError("unexpected data after the end of json");
     }
-    m_fpStdOut = std::unique_ptr<FILE, decltype(&fclose)>(_fdopen(_open_osfhandle((intptr_t)m_pipes.stdOut.h_read, _O_BINARY), "rb"), fclose);
-    if (!m_fpStdOut) {
-        return RGY_ERR_INVALID_HANDLE;
+    if (!ok) {
+        AddMessage(RGY_LOG_ERROR, _T("Failed to parse json: %s.\n"), char_to_tstring(parser.error()).c_str());
+        return RGY_ERR_INVALID_FORMAT;
     }
+    if (!sceneInfoFound) {
+        AddMessage(RGY_LOG_ERROR, _T("SceneInfo not found in json.\n"));
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    m_payload.shrink_to_fit();
     return RGY_ERR_NONE;
 }
 
-const vector<uint8_t> *RGYHDR10Plus::getData(int iframe) {
-    if (!m_proc->processAlive() || !m_fpStdOut) {
+const uint8_t *RGYHDR10Plus::getData(int iframe, size_t *size) const {
+    if (iframe < 0 || iframe >= frameCount()) {
         return nullptr;
     }
-    while (m_buffer.first != iframe) {
-        m_buffer.second.clear();
-        int header[2];
-        if (fread(header, sizeof(header[0]), _countof(header), m_fpStdOut.get()) != _countof(header)) {
-            return nullptr;
+    *size = m_offset[iframe+1] - m_offset[iframe];
+    return m_payload.data() + m_offset[iframe];
+}
+
+//ビット単位でバッファから読み出す (hdr10plus_checkでペイロードを検証するために使用)
+class RGYBitReader {
+public:
+    RGYBitReader(const uint8_t *data, size_t size) : m_data(data), m_size(size), m_bitPos(0) {};
+    uint32_t get(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++, m_bitPos++) {
+            const uint32_t bit = (m_bitPos < m_size * 8) ? (m_data[m_bitPos >> 3] >> (7 - (m_bitPos & 7))) & 1 : 0;
+            value = (value << 1) | bit;
         }
-        const int frameNum = header[0];
-        const int dataSize = header[1];
-        m_buffer.second.resize(dataSize, 0);
-        if (fread(m_buffer.second.data(), 1, m_buffer.second.size(), m_fpStdOut.get()) != m_buffer.second.size()) {
-            return nullptr;
+        return value;
+    }
+    //読み出した位置がデータの範囲内か
+    bool valid() const { return m_bitPos <= m_size * 8; }
+    //残りのビットがバイト境界までの0のみか
+    bool paddingOnly() {
+        if (m_size * 8 - m_bitPos >= 8) {
+            return false;
+        }
+        return get((int)(m_size * 8 - m_bitPos)) == 0;
+    }
+protected:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_bitPos;
+};
+
+static RGYJsonValue hdr10plus_json_number(uint32_t value) {
+    RGYJsonValue number;
+    number.type = RGYJsonValue::JSON_NUMBER;
+    number.number = value;
+    return number;
+}
+
+static RGYJsonValue hdr10plus_json_array(RGYBitReader& reader, uint32_t count, int bits) {
+    RGYJsonValue array;
+    array.type = RGYJsonValue::JSON_ARRAY;
+    for (uint32_t i = 0; i < count; i++) {
+        array.array.push_back(hdr10plus_json_number(reader.get(bits)));
+    }
+    return array;
+}
+
+static void hdr10plus_json_add(RGYJsonValue& obj, const char *key, const RGYJsonValue& value) {
+    obj.object.push_back(std::make_pair(std::string(key), value));
+}
+
+static void hdr10plus_json_add(RGYJsonValue& obj, const char *key, uint32_t value) {
+    hdr10plus_json_add(obj, key, hdr10plus_json_number(value));
+}
+
+//ST2094-40のペイロードを読み、シンタックス要素名をキーとしたjsonの値に変換する
+static bool hdr10plus_decode_payload(RGYJsonValue& frame, const uint8_t *data, size_t size) {
+    RGYBitReader reader(data, size);
+    frame.clear();
+    frame.type = RGYJsonValue::JSON_OBJECT;
+    hdr10plus_json_add(frame, "itu_t_t35_country_code", reader.get(8));
+    hdr10plus_json_add(frame, "itu_t_t35_terminal_provider_code", reader.get(16));
+    hdr10plus_json_add(frame, "itu_t_t35_terminal_provider_oriented_code", reader.get(16));
+    hdr10plus_json_add(frame, "application_identifier", reader.get(8));
+    hdr10plus_json_add(frame, "application_version", reader.get(8));
+    const uint32_t num_windows = reader.get(2);
+    hdr10plus_json_add(frame, "num_windows", num_windows);
+    RGYJsonValue windows;
+    windows.type = RGYJsonValue::JSON_ARRAY;
+    for (uint32_t iw = 0; iw < num_windows; iw++) {
+        windows.array.push_back(RGYJsonValue());
+        windows.array.back().type = RGYJsonValue::JSON_OBJECT;
+    }
+    static const char *geometryNames[HDR10PLUS_WINDOW_GEOMETRY_COUNT] = {
+        "window_upper_left_corner_x", "window_upper_left_corner_y", "window_lower_right_corner_x", "window_lower_right_corner_y",
+        "center_of_ellipse_x", "center_of_ellipse_y", "rotation_angle",
+        "semimajor_axis_internal_ellipse", "semimajor_axis_external_ellipse", "semiminor_axis_external_ellipse", "overlap_process_option"
+    };
+    for (uint32_t iw = 1; iw < num_windows; iw++) {
+        for (int i = 0; i < HDR10PLUS_WINDOW_GEOMETRY_COUNT; i++) {
+            hdr10plus_json_add(windows.array[iw], geometryNames[i], reader.get(HDR10PLUS_WINDOW_GEOMETRY[i].second));
+        }
+    }
+    hdr10plus_json_add(frame, "targeted_system_display_maximum_luminance", reader.get(27));
+    const uint32_t targeted_peak_flag = reader.get(1);
+    hdr10plus_json_add(frame, "targeted_system_display_actual_peak_luminance_flag", targeted_peak_flag);
+    if (targeted_peak_flag) {
+        return false; //作成しないので、現れたらエラー
+    }
+    for (uint32_t iw = 0; iw < num_windows; iw++) {
+        auto& window = windows.array[iw];
+        hdr10plus_json_add(window, "maxscl", hdr10plus_json_array(reader, 3, 17));
+        hdr10plus_json_add(window, "average_maxrgb", reader.get(17));
+        const uint32_t num_percentiles = reader.get(4);
+        RGYJsonValue percentages, percentiles;
+        percentages.type = RGYJsonValue::JSON_ARRAY;
+        percentiles.type = RGYJsonValue::JSON_ARRAY;
+        for (uint32_t i = 0; i < num_percentiles; i++) {
+            percentages.array.push_back(hdr10plus_json_number(reader.get(7)));
+            percentiles.array.push_back(hdr10plus_json_number(reader.get(17)));
+        }
+        hdr10plus_json_add(window, "distribution_maxrgb_percentages", percentages);
+        hdr10plus_json_add(window, "distribution_maxrgb_percentiles", percentiles);
+        hdr10plus_json_add(window, "fraction_bright_pixels", reader.get(10));
+    }
+    const uint32_t mastering_peak_flag = reader.get(1);
+    hdr10plus_json_add(frame, "mastering_display_actual_peak_luminance_flag", mastering_peak_flag);
+    if (mastering_peak_flag) {
+        return false;
+    }
+    for (uint32_t iw = 0; iw < num_windows; iw++) {
+        auto& window = windows.array[iw];
+        const uint32_t tone_mapping_flag = reader.get(1);
+        hdr10plus_json_add(window, "tone_mapping_flag", tone_mapping_flag);
+        if (tone_mapping_flag) {
+            hdr10plus_json_add(window, "knee_point_x", reader.get(12));
+            hdr10plus_json_add(window, "knee_point_y", reader.get(12));
+            const uint32_t num_anchors = reader.get(4);
+            hdr10plus_json_add(window, "bezier_curve_anchors", hdr10plus_json_array(reader, num_anchors, 10));
+        }
+        const uint32_t color_saturation_mapping_flag = reader.get(1);
+        hdr10plus_json_add(window, "color_saturation_mapping_flag", color_saturation_mapping_flag);
+        if (color_saturation_mapping_flag) {
+            return false;
+        }
+    }
+    hdr10plus_json_add(frame, "windows", windows);
+    return reader.valid() && reader.paddingOnly();
+}
+
+//jsonの値を比較し、一致しなければ最初に異なる位置をpathに返す (オブジェクトのキーの順序は問わない)
+static bool hdr10plus_json_equal(const RGYJsonValue& a, const RGYJsonValue& b, std::string& path) {
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+    case RGYJsonValue::JSON_BOOL:   return a.boolean == b.boolean;
+    case RGYJsonValue::JSON_NUMBER: return a.number == b.number;
+    case RGYJsonValue::JSON_STRING: return a.str == b.str;
+    case RGYJsonValue::JSON_ARRAY:
+        for (size_t i = 0; i < std::max(a.array.size(), b.array.size()); i++) {
+            const auto pathParent = path;
+            path += strsprintf("[%d]", (int)i);
+            if (i >= a.array.size() || i >= b.array.size() || !hdr10plus_json_equal(a.array[i], b.array[i], path)) {
+                return false;
+            }
+            path = pathParent;
+        }
+        return true;
+    case RGYJsonValue::JSON_OBJECT:
+        for (const auto& member : b.object) {
+            if (a.find(member.first.c_str()) == nullptr) {
+                path += "." + member.first;
+                return false;
+            }
+        }
+        for (const auto& member : a.object) {
+            const auto pathParent = path;
+            path += "." + member.first;
+            const auto value = b.find(member.first.c_str());
+            if (value == nullptr || !hdr10plus_json_equal(member.second, *value, path)) {
+                return false;
+            }
+            path = pathParent;
+        }
+        return true;
+    case RGYJsonValue::JSON_NULL:
+    default:
+        return true;
+    }
+}
+
+int hdr10plus_check(FILE *fp) {
+    //input: --dhdr10-infoに指定するjson
+    //reference: 作成されるペイロードをシンタックス要素名で表したもの (フレームごとの配列)
+    //           エラーとなるべき入力ではnullptrとし、errに期待するエラーを指定する
+    struct HDR10PlusCheckCase {
+        const char *name;
+        const char *input;
+        const char *reference;
+        RGY_ERR err;
+    };
+    static const HDR10PlusCheckCase checkCases[] = {
+        { "single_window",
+R"({
+  "JSONInfo": { "HDR10plusProfile": "A", "Version": "1.0" },
+  "SceneInfo": [
+    {
+      "NumberOfWindows": 1,
+      "TargetedSystemDisplayMaximumLuminance": 400,
+      "LuminanceParameters": {
+        "AverageRGB": 1037,
+        "MaxScl": [ 17830, 16895, 14252 ],
+        "LuminanceDistributions": {
+          "DistributionIndex": [ 1, 5, 10, 25, 50, 75, 90, 95, 99 ],
+          "DistributionValues": [ 0, 3, 8, 64, 310, 1214, 3010, 4864, 10245 ]
+        }
+      }
+    },
+    {
+      "TargetedSystemDisplayMaximumLuminance": 0,
+      "LuminanceParameters": {
+        "AverageRGB": 0,
+        "MaxScl": [ 0, 0, 131071 ],
+        "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] }
+      }
+    }
+  ]
+})",
+R"([
+  {
+    "itu_t_t35_country_code": 181, "itu_t_t35_terminal_provider_code": 60, "itu_t_t35_terminal_provider_oriented_code": 1,
+    "application_identifier": 4, "application_version": 1, "num_windows": 1,
+    "targeted_system_display_maximum_luminance": 400, "targeted_system_display_actual_peak_luminance_flag": 0,
+    "mastering_display_actual_peak_luminance_flag": 0,
+    "windows": [
+      {
+        "maxscl": [ 17830, 16895, 14252 ], "average_maxrgb": 1037,
+        "distribution_maxrgb_percentages": [ 1, 5, 10, 25, 50, 75, 90, 95, 99 ],
+        "distribution_maxrgb_percentiles": [ 0, 3, 8, 64, 310, 1214, 3010, 4864, 10245 ],
+        "fraction_bright_pixels": 0, "tone_mapping_flag": 0, "color_saturation_mapping_flag": 0
+      }
+    ]
+  },
+  {
+    "itu_t_t35_country_code": 181, "itu_t_t35_terminal_provider_code": 60, "itu_t_t35_terminal_provider_oriented_code": 1,
+    "application_identifier": 4, "application_version": 1, "num_windows": 1,
+    "targeted_system_display_maximum_luminance": 0, "targeted_system_display_actual_peak_luminance_flag": 0,
+    "mastering_display_actual_peak_luminance_flag": 0,
+    "windows": [
+      {
+        "maxscl": [ 0, 0, 131071 ], "average_maxrgb": 0,
+        "distribution_maxrgb_percentages": [], "distribution_maxrgb_percentiles": [],
+        "fraction_bright_pixels": 0, "tone_mapping_flag": 0, "color_saturation_mapping_flag": 0
+      }
+    ]
+  }
+])", RGY_ERR_NONE },
+        { "bezier",
+R"({
+  "SceneInfo": [
+    {
+      "NumberOfWindows": 1,
+      "TargetedSystemDisplayMaximumLuminance": 1000,
+      "BezierCurveData": {
+        "Anchors": [ 102, 205, 307, 410, 512, 614, 717, 819, 1023 ],
+        "KneePointX": 4095,
+        "KneePointY": 1365
+      },
+      "LuminanceParameters": {
+        "AverageRGB": 131071,
+        "MaxScl": [ 4000, 5000, 6000 ],
+        "LuminanceDistributions": {
+          "DistributionIndex": [ 1, 5, 10, 25, 50, 75, 90, 95, 98, 99, 100, 127, 0, 2, 3 ],
+          "DistributionValues": [ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 131071 ]
+        }
+      },
+      "SceneFrameIndex": 0, "SceneId": 0, "SequenceFrameIndex": 0
+    }
+  ]
+})",
+R"([
+  {
+    "itu_t_t35_country_code": 181, "itu_t_t35_terminal_provider_code": 60, "itu_t_t35_terminal_provider_oriented_code": 1,
+    "application_identifier": 4, "application_version": 1, "num_windows": 1,
+    "targeted_system_display_maximum_luminance": 1000, "targeted_system_display_actual_peak_luminance_flag": 0,
+    "mastering_display_actual_peak_luminance_flag": 0,
+    "windows": [
+      {
+        "maxscl": [ 4000, 5000, 6000 ], "average_maxrgb": 131071,
+        "distribution_maxrgb_percentages": [ 1, 5, 10, 25, 50, 75, 90, 95, 98, 99, 100, 127, 0, 2, 3 ],
+        "distribution_maxrgb_percentiles": [ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 131071 ],
+        "fraction_bright_pixels": 0,
+        "tone_mapping_flag": 1, "knee_point_x": 4095, "knee_point_y": 1365,
+        "bezier_curve_anchors": [ 102, 205, 307, 410, 512, 614, 717, 819, 1023 ],
+        "color_saturation_mapping_flag": 0
+      }
+    ]
+  }
+])", RGY_ERR_NONE },
+        { "multi_window2",
+R"({
+  "SceneInfo": [
+    {
+      "NumberOfWindows": 2,
+      "TargetedSystemDisplayMaximumLuminance": 600,
+      "WindowParameters": [
+        {
+          "UpperLeftCornerX": 0, "UpperLeftCornerY": 0, "LowerRightCornerX": 1919, "LowerRightCornerY": 539,
+          "CenterOfEllipseX": 960, "CenterOfEllipseY": 270, "RotationAngle": 179,
+          "SemiMajorAxisInternalEllipse": 400, "SemiMajorAxisExternalEllipse": 900, "SemiMinorAxisExternalEllipse": 260,
+          "OverlapProcessOption": 1
+        }
+      ],
+      "LuminanceParameters": [
+        {
+          "AverageRGB": 2000, "MaxScl": [ 30000, 20000, 10000 ],
+          "LuminanceDistributions": { "DistributionIndex": [ 50, 99 ], "DistributionValues": [ 500, 25000 ] }
+        },
+        {
+          "AverageRGB": 800, "MaxScl": [ 9000, 8000, 7000 ],
+          "LuminanceDistributions": { "DistributionIndex": [ 1, 50, 99 ], "DistributionValues": [ 2, 150, 6000 ] }
+        }
+      ],
+      "BezierCurveData": [
+        { "KneePointX": 100, "KneePointY": 200, "Anchors": [ 256, 512, 768 ] },
+        null
+      ]
+    }
+  ]
+})",
+R"([
+  {
+    "itu_t_t35_country_code": 181, "itu_t_t35_terminal_provider_code": 60, "itu_t_t35_terminal_provider_oriented_code": 1,
+    "application_identifier": 4, "application_version": 1, "num_windows": 2,
+    "targeted_system_display_maximum_luminance": 600, "targeted_system_display_actual_peak_luminance_flag": 0,
+    "mastering_display_actual_peak_luminance_flag": 0,
+    "windows": [
+      {
+        "maxscl": [ 30000, 20000, 10000 ], "average_maxrgb": 2000,
+        "distribution_maxrgb_percentages": [ 50, 99 ], "distribution_maxrgb_percentiles": [ 500, 25000 ],
+        "fraction_bright_pixels": 0,
+        "tone_mapping_flag": 1, "knee_point_x": 100, "knee_point_y": 200, "bezier_curve_anchors": [ 256, 512, 768 ],
+        "color_saturation_mapping_flag": 0
+      },
+      {
+        "window_upper_left_corner_x": 0, "window_upper_left_corner_y": 0,
+        "window_lower_right_corner_x": 1919, "window_lower_right_corner_y": 539,
+        "center_of_ellipse_x": 960, "center_of_ellipse_y": 270, "rotation_angle": 179,
+        "semimajor_axis_internal_ellipse": 400, "semimajor_axis_external_ellipse": 900, "semiminor_axis_external_ellipse": 260,
+        "overlap_process_option": 1,
+        "maxscl": [ 9000, 8000, 7000 ], "average_maxrgb": 800,
+        "distribution_maxrgb_percentages": [ 1, 50, 99 ], "distribution_maxrgb_percentiles": [ 2, 150, 6000 ],
+        "fraction_bright_pixels": 0, "tone_mapping_flag": 0, "color_saturation_mapping_flag": 0
+      }
+    ]
+  }
+])", RGY_ERR_NONE },
+        { "multi_window3",
+R"({
+  "SceneInfo": [
+    {
+      "NumberOfWindows": 3,
+      "TargetedSystemDisplayMaximumLuminance": 134217727,
+      "WindowParameters": [
+        {
+          "UpperLeftCornerX": 100, "UpperLeftCornerY": 50, "LowerRightCornerX": 700, "LowerRightCornerY": 450,
+          "CenterOfEllipseX": 400, "CenterOfEllipseY": 250, "RotationAngle": 0,
+          "SemiMajorAxisInternalEllipse": 100, "SemiMajorAxisExternalEllipse": 300, "SemiMinorAxisExternalEllipse": 200,
+          "OverlapProcessOption": 0
+        },
+        {
+          "UpperLeftCornerX": 65535, "UpperLeftCornerY": 65535, "LowerRightCornerX": 65535, "LowerRightCornerY": 65535,
+          "CenterOfEllipseX": 65535, "CenterOfEllipseY": 65535, "RotationAngle": 255,
+          "SemiMajorAxisInternalEllipse": 65535, "SemiMajorAxisExternalEllipse": 65535, "SemiMinorAxisExternalEllipse": 65535,
+          "OverlapProcessOption": 1
+        }
+      ],
+      "LuminanceParameters": [
+        { "AverageRGB": 1, "MaxScl": [ 1, 2, 3 ], "LuminanceDistributions": { "DistributionIndex": [ 99 ], "DistributionValues": [ 4 ] } },
+        { "AverageRGB": 5, "MaxScl": [ 6, 7, 8 ], "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] } },
+        { "AverageRGB": 9, "MaxScl": [ 10, 11, 12 ], "LuminanceDistributions": { "DistributionIndex": [ 50 ], "DistributionValues": [ 13 ] } }
+      ],
+      "BezierCurveData": [
+        { "KneePointX": 1, "KneePointY": 2, "Anchors": [ 3 ] },
+        { "KneePointX": 0, "KneePointY": 0, "Anchors": [] },
+        { "KneePointX": 4095, "KneePointY": 4095, "Anchors": [ 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023 ] }
+      ]
+    }
+  ]
+})",
+R"([
+  {
+    "itu_t_t35_country_code": 181, "itu_t_t35_terminal_provider_code": 60, "itu_t_t35_terminal_provider_oriented_code": 1,
+    "application_identifier": 4, "application_version": 1, "num_windows": 3,
+    "targeted_system_display_maximum_luminance": 134217727, "targeted_system_display_actual_peak_luminance_flag": 0,
+    "mastering_display_actual_peak_luminance_flag": 0,
+    "windows": [
+      {
+        "maxscl": [ 1, 2, 3 ], "average_maxrgb": 1,
+        "distribution_maxrgb_percentages": [ 99 ], "distribution_maxrgb_percentiles": [ 4 ],
+        "fraction_bright_pixels": 0,
+        "tone_mapping_flag": 1, "knee_point_x": 1, "knee_point_y": 2, "bezier_curve_anchors": [ 3 ],
+        "color_saturation_mapping_flag": 0
+      },
+      {
+        "window_upper_left_corner_x": 100, "window_upper_left_corner_y": 50,
+        "window_lower_right_corner_x": 700, "window_lower_right_corner_y": 450,
+        "center_of_ellipse_x": 400, "center_of_ellipse_y": 250, "rotation_angle": 0,
+        "semimajor_axis_internal_ellipse": 100, "semimajor_axis_external_ellipse": 300, "semiminor_axis_external_ellipse": 200,
+        "overlap_process_option": 0,
+        "maxscl": [ 6, 7, 8 ], "average_maxrgb": 5,
+        "distribution_maxrgb_percentages": [], "distribution_maxrgb_percentiles": [],
+        "fraction_bright_pixels": 0,
+        "tone_mapping_flag": 1, "knee_point_x": 0, "knee_point_y": 0, "bezier_curve_anchors": [],
+        "color_saturation_mapping_flag": 0
+      },
+      {
+        "window_upper_left_corner_x": 65535, "window_upper_left_corner_y": 65535,
+        "window_lower_right_corner_x": 65535, "window_lower_right_corner_y": 65535,
+        "center_of_ellipse_x": 65535, "center_of_ellipse_y": 65535, "rotation_angle": 255,
+        "semimajor_axis_internal_ellipse": 65535, "semimajor_axis_external_ellipse": 65535, "semiminor_axis_external_ellipse": 65535,
+        "overlap_process_option": 1,
+        "maxscl": [ 10, 11, 12 ], "average_maxrgb": 9,
+        "distribution_maxrgb_percentages": [ 50 ], "distribution_maxrgb_percentiles": [ 13 ],
+        "fraction_bright_pixels": 0,
+        "tone_mapping_flag": 1, "knee_point_x": 4095, "knee_point_y": 4095,
+        "bezier_curve_anchors": [ 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023, 1023 ],
+        "color_saturation_mapping_flag": 0
+      }
+    ]
+  }
+])", RGY_ERR_NONE },
+        //ウィンドウが複数なのに、ウィンドウごとの配列になっていない
+        { "multi_window_not_array",
+R"({ "SceneInfo": [ { "NumberOfWindows": 2, "TargetedSystemDisplayMaximumLuminance": 400,
+  "WindowParameters": [ { "UpperLeftCornerX": 0, "UpperLeftCornerY": 0, "LowerRightCornerX": 1, "LowerRightCornerY": 1,
+    "CenterOfEllipseX": 0, "CenterOfEllipseY": 0, "RotationAngle": 0,
+    "SemiMajorAxisInternalEllipse": 0, "SemiMajorAxisExternalEllipse": 0, "SemiMinorAxisExternalEllipse": 0, "OverlapProcessOption": 0 } ],
+  "LuminanceParameters": { "AverageRGB": 0, "MaxScl": [ 0, 0, 0 ], "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] } } } ] })",
+            nullptr, RGY_ERR_INVALID_PARAM },
+        //2つ目のウィンドウの位置の指定がない
+        { "multi_window_no_geometry",
+R"({ "SceneInfo": [ { "NumberOfWindows": 2, "TargetedSystemDisplayMaximumLuminance": 400,
+  "LuminanceParameters": [
+    { "AverageRGB": 0, "MaxScl": [ 0, 0, 0 ], "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] } },
+    { "AverageRGB": 0, "MaxScl": [ 0, 0, 0 ], "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] } } ] } ] })",
+            nullptr, RGY_ERR_INVALID_PARAM },
+        //アンカーの値が10bitを超える
+        { "bezier_out_of_range",
+R"({ "SceneInfo": [ { "TargetedSystemDisplayMaximumLuminance": 400,
+  "BezierCurveData": { "KneePointX": 0, "KneePointY": 0, "Anchors": [ 1024 ] },
+  "LuminanceParameters": { "AverageRGB": 0, "MaxScl": [ 0, 0, 0 ], "LuminanceDistributions": { "DistributionIndex": [], "DistributionValues": [] } } } ] })",
+            nullptr, RGY_ERR_INVALID_PARAM },
+        //jsonとして正しくない
+        { "broken_json",
+R"({ "SceneInfo": [ { "TargetedSystemDisplayMaximumLuminance": 400, } ] })",
+            nullptr, RGY_ERR_INVALID_FORMAT },
+    };
+    int ret = 0;
+    fprintf(fp, "case,frames,payload_bytes,err,first_mismatch,verify\n");
+    for (const auto& checkCase : checkCases) {
+        RGYHDR10Plus hdr10plus;
+        const auto err = hdr10plus.parse(checkCase.input, strlen(checkCase.input));
+        std::string mismatch;
+        size_t payloadBytes = 0;
+        if (err == RGY_ERR_NONE && checkCase.reference) {
+            RGYJsonParser parser(checkCase.reference, strlen(checkCase.reference));
+            RGYJsonValue reference;
+            if (!parser.parseValue(reference) || !parser.end() || reference.type != RGYJsonValue::JSON_ARRAY) {
+                mismatch = "reference";
+            } else if ((int)reference.array.size() != hdr10plus.frameCount()) {
+                mismatch = "frames";
+            }
+            for (int i = 0; mismatch.length() == 0 && i < hdr10plus.frameCount(); i++) {
+                size_t size = 0;
+                const auto data = hdr10plus.getData(i, &size);
+                payloadBytes += size;
+                RGYJsonValue frame;
+                std::string path = strsprintf("[%d]", i);
+                if (data == nullptr || !hdr10plus_decode_payload(frame, data, size)) {
+                    mismatch = path;
+                } else if (!hdr10plus_json_equal(frame, reference.array[i], path)) {
+                    mismatch = path;
+                }
+            }
         }
+        const bool ok = err == checkCase.err && mismatch.length() == 0;
+        fprintf(fp, "%s,%d,%d,%s,%s,%s\n", checkCase.name, (err == RGY_ERR_NONE) ? hdr10plus.frameCount() : 0, (int)payloadBytes,
+            tchar_to_string(get_err_mes(err)).c_str(), (mismatch.length() > 0) ? mismatch.c_str() : "-", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
     }
-    return &m_buffer.second;
+    return ret;
 }
@@ -30,26 +30,39 @@
 #define __RGY_HDR10PLUS_H__
 
 #include <string>
+#include <vector>
 #include <memory>
 #include "rgy_err.h"
-#include "rgy_pipe.h"
+#include "rgy_log.h"
 #include "rgy_util.h"
 
+//HDR10+のjson(SceneInfoの各要素が1フレームに対応)を読み込み、
+//各フレームのST2094-40 SEI (user_data_registered_itu_t_t35) のペイロードを作成する
+//全フレーム分のペイロードは初期化時に1つのバッファに連続して作成しておき、getDataでは位置を返すだけにする
 class RGYHDR10Plus {
 public:
-    static const TCHAR *HDR10PLUS_GEN_EXE_NAME;
     RGYHDR10Plus();
     virtual ~RGYHDR10Plus();
 
-    RGY_ERR init(const tstring& inputJson);
-    const vector<uint8_t> *getData(int iframe);
+    RGY_ERR init(const tstring& inputJson, shared_ptr<RGYLog> pLog = nullptr);
+    //json文字列から全フレームのペイロードを作成する
+    RGY_ERR parse(const char *json, size_t size);
+    //iframeのペイロードを返す (存在しなければnullptr)
+    const uint8_t *getData(int iframe, size_t *size) const;
+    int frameCount() const { return (int)m_offset.size() - 1; }
     const tstring &inputJson() const { return m_inputJson; };
 protected:
+    void AddMessage(int log_level, const tstring& str);
+    void AddMessage(int log_level, const TCHAR *format, ...);
+
     tstring m_inputJson;
-    std::unique_ptr<RGYPipeProcess> m_proc;
-    ProcessPipe m_pipes;
-    std::unique_ptr<FILE, decltype(&fclose)> m_fpStdOut;
-    std::pair<int, std::vector<uint8_t>> m_buffer;
+    shared_ptr<RGYLog> m_pPrintMes;
+    std::vector<uint8_t> m_payload;  //全フレームのペイロードを連結したもの
+    std::vector<uint32_t> m_offset;  //各フレームのペイロードのm_payload内の位置 (フレーム数+1個)
 };
 
+//埋め込みのjsonから作成したペイロードを読み戻し、参照のjson (シンタックス要素名で記述) と比較してCSVで出力する
+//ウィンドウが1つ/複数、BezierCurveDataあり/なし、エラーとなるべき入力を確認する
+int hdr10plus_check(FILE *fp);
+
 #endif //__RGY_HDR10PLUS_H__
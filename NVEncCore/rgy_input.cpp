@@ -30,6 +30,8 @@
 #include <fstream>
 #include <set>
 #include "rgy_input.h"
+#include "rgy_thread_pool.h"
+#include "rgy_perf_trace.h"
 
 std::vector<int> read_keyfile(tstring keyfile) {
     std::set<int> s; //重複回避のため
@@ -49,22 +51,6 @@ std::vector<int> read_keyfile(tstring keyfile) {
     return vector<int>(s.begin(), s.end());
 }
 
-RGYConvertCSPPrm::RGYConvertCSPPrm() :
-    abort(false),
-    dst(nullptr),
-    src(nullptr),
-    interlaced(false),
-    width(0),
-    src_y_pitch_byte(0),
-    src_uv_pitch_byte(0),
-    dst_y_pitch_byte(0),
-    height(0),
-    dst_height(0),
-    crop(nullptr) {
-
-}
-
-
 RGYConvertCSP::RGYConvertCSP() : RGYConvertCSP(0) {
 }
 
@@ -73,23 +59,10 @@ RGYConvertCSP::RGYConvertCSP(int threads) :
     m_csp_from(RGY_CSP_NA),
     m_csp_to(RGY_CSP_NA),
     m_uv_only(false),
-    m_threads(threads),
-    m_th(), m_heStart(), m_heFin(), m_heFinCopy(),
-    m_prm() {
+    m_threads(threads) {
 };
 
 RGYConvertCSP::~RGYConvertCSP() {
-    m_prm.abort = true;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    for (size_t i = 0; i < m_th.size(); i++) {
-        m_th[i].join();
-    }
-    m_heFinCopy.clear();
-    m_heStart.clear();
-    m_heFin.clear();
-    m_th.clear();
 };
 const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, uint32_t simd) {
     if (m_csp == nullptr
@@ -103,53 +76,26 @@ const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool
 }
 
 int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop) {
+    RGY_PERF_TRACE_SCOPE(traceCsp, RGY_TRACE_CSP, -1, RGY_PERF_TRACE_NO_PTS);
     if (m_threads == 0) {
         const int div = (m_csp->simd == 0) ? 2 : 4;
         const int max = (m_csp->simd == 0) ? 8 : 4;
         m_threads = std::min(max, ((int)get_cpu_info().physical_cores + div) / div);
     }
-    if (m_threads > 1 && m_th.size() == 0) {
-        m_heFinCopy.clear();
-        m_heStart.clear();
-        m_heFin.clear();
-        for (int ith = 1; ith < m_threads; ith++) {
-            auto heStart = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            auto heFin = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            m_th.push_back(std::thread([heStart = heStart.get(), heFin = heFin.get(), ithId = ith, threadN = m_threads, prm = &m_prm, cspfunc = &m_csp]() {
-                WaitForSingleObject((HANDLE)heStart, INFINITE);
-                while (!prm->abort) {
-                    (*cspfunc)->func[prm->interlaced](prm->dst, prm->src,
-                        prm->width, prm->src_y_pitch_byte, prm->src_uv_pitch_byte, prm->dst_y_pitch_byte,
-                        prm->height, prm->dst_height, ithId, threadN, prm->crop);
-                    SetEvent((HANDLE)heFin);
-                    WaitForSingleObject((HANDLE)heStart, INFINITE);
-                }
-            }));
-            m_heFinCopy.push_back(heFin.get());
-            m_heStart.push_back(std::move(heStart));
-            m_heFin.push_back(std::move(heFin));
-        }
-    }
-    m_prm.abort = false;
-    m_prm.interlaced = interlaced;
-    m_prm.dst = dst;
-    m_prm.src = src;
-    m_prm.width = width;
-    m_prm.src_y_pitch_byte = src_y_pitch_byte;
-    m_prm.src_uv_pitch_byte = src_uv_pitch_byte;
-    m_prm.dst_y_pitch_byte = dst_y_pitch_byte;
-    m_prm.height = height;
-    m_prm.dst_height = dst_height;
-    m_prm.crop = crop;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    m_csp->func[interlaced](dst, src,
-        width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
-        height, dst_height, 0, (int)m_th.size()+1, crop);
-    if (m_th.size() > 0) {
-        WaitForMultipleObjects((DWORD)m_heFinCopy.size(), m_heFinCopy.data(), TRUE, INFINITE);
+    if (m_threads <= 1) {
+        m_csp->func[interlaced](dst, src,
+            width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+            height, dst_height, 0, 1, crop);
+        return 0;
     }
+    //行方向にm_threads個に分割したタスクを共有スレッドプールで処理する
+    const int thread_n = m_threads;
+    const auto func = m_csp->func[interlaced];
+    RGYThreadPool::get()->run(thread_n, [=](int thread_id) {
+        func(dst, src,
+            width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+            height, dst_height, thread_id, thread_n, crop);
+    });
     return 0;
 }
 
@@ -42,34 +42,13 @@
 
 std::vector<int> read_keyfile(tstring keyfile);
 
-struct RGYConvertCSPPrm {
-    bool abort;
-    void **dst;
-    const void **src;
-    int interlaced;
-    int width;
-    int src_y_pitch_byte;
-    int src_uv_pitch_byte;
-    int dst_y_pitch_byte;
-    int height;
-    int dst_height;
-    int *crop;
-
-    RGYConvertCSPPrm();
-};
-
 class RGYConvertCSP {
 private:
     const ConvertCSP *m_csp;
     RGY_CSP m_csp_from;
     RGY_CSP m_csp_to;
     bool m_uv_only;
-    int m_threads;
-    std::vector<std::thread> m_th;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heStart;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heFin;
-    std::vector<HANDLE> m_heFinCopy;
-    RGYConvertCSPPrm m_prm;
+    int m_threads; //行方向の分割数 (共有スレッドプールで並列に処理される)
 public:
     RGYConvertCSP();
     RGYConvertCSP(int threads);
@@ -175,12 +154,8 @@ public:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_pPrintMes->write_va(log_level, (m_strReaderName + _T(": ")).c_str(), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
 
     //HWデコードを行う場合のコーデックを返す
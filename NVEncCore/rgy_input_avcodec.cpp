@@ -35,6 +35,7 @@
 #include <climits>
 #include <limits>
 #include <memory>
+#include <chrono>
 #include "rgy_thread.h"
 #include "rgy_input_avcodec.h"
 #include "rgy_bitstream.h"
@@ -97,12 +98,16 @@ RGYInputAvcodecPrm::RGYInputAvcodecPrm(RGYInputPrm base) :
     nProcSpeedLimit(0),
     fSeekSec(0.0),
     pFramePosListLog(nullptr),
+    pIndexFile(nullptr),
     pLogCopyFrameData(nullptr),
     nInputThread(0),
     pQueueInfo(nullptr),
     pHWDecCodecCsp(nullptr),
     bVideoDetectPulldown(false),
     caption2ass(FORMAT_ASS),
+    nDecodeAhead(0),
+    nDecodeThreads(0),
+    nDecodeThreadType(RGY_AVSW_THREAD_AUTO),
     RGYInputPrm(base) {
 
 }
@@ -110,6 +115,13 @@ RGYInputAvcodecPrm::RGYInputAvcodecPrm(RGYInputPrm base) :
 RGYInputAvcodec::RGYInputAvcodec() {
     memset(&m_Demux.format, 0, sizeof(m_Demux.format));
     memset(&m_Demux.video,  0, sizeof(m_Demux.video));
+    m_Demux.decode.nDecodeAhead = 0;
+    m_Demux.decode.bAbortDecode = false;
+    m_Demux.decode.nDecodeErr = RGY_ERR_NONE;
+    m_Demux.decode.nFrameWait = 0;
+    m_indexSave = false;
+    m_indexSeek = false;
+    memset(&m_indexAnalysis, 0, sizeof(m_indexAnalysis));
     m_strReaderName = _T("av" DECODER_NAME "/avsw");
 }
 
@@ -128,6 +140,23 @@ void RGYInputAvcodec::CloseThread() {
     m_Demux.thread.bAbortInput = false;
 }
 
+void RGYInputAvcodec::CloseDecodeThread() {
+    m_Demux.decode.bAbortDecode = true;
+    if (m_Demux.decode.thDecode.joinable()) {
+        //空きフレーム待ちのデコードスレッドを起こす
+        m_Demux.decode.qFrameFree.close();
+        m_Demux.decode.thDecode.join();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed decode thread, converter waited for decoder %lld times.\n"), (lls)m_Demux.decode.nFrameWait);
+    }
+    for (auto frame : m_Demux.decode.frames) {
+        av_frame_free(&frame);
+    }
+    m_Demux.decode.frames.clear();
+    m_Demux.decode.bAbortDecode = false;
+    m_Demux.decode.nDecodeErr = RGY_ERR_NONE;
+    m_Demux.decode.nFrameWait = 0;
+}
+
 void RGYInputAvcodec::CloseFormat(AVDemuxFormat *pFormat) {
     //close video file
     if (pFormat->fpInput) {
@@ -194,6 +223,7 @@ void RGYInputAvcodec::CloseStream(AVDemuxStream *pStream) {
 void RGYInputAvcodec::Close() {
     AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
     //リソースの解放
+    CloseDecodeThread();
     CloseThread();
     m_Demux.qVideoPkt.close([](AVPacket *pkt) { av_packet_unref(pkt); });
     for (uint32_t i = 0; i < m_Demux.qStreamPktL1.size(); i++) {
@@ -220,6 +250,11 @@ void RGYInputAvcodec::Close() {
 
     m_hevcMp42AnnexbBuffer.clear();
 
+    m_index.reset();
+    m_indexFile.clear();
+    m_indexSave = false;
+    m_indexSeek = false;
+
     //free input buffer (使用していない)
     //if (buffer) {
     //    free(buffer);
@@ -405,7 +440,7 @@ void RGYInputAvcodec::hevcMp42Annexb(AVPacket *pkt) {
     m_hevcMp42AnnexbBuffer.clear();
 }
 
-RGY_ERR RGYInputAvcodec::getFirstFramePosAndFrameRate(const sTrim *pTrimList, int nTrimCount, bool bDetectpulldown) {
+RGY_ERR RGYInputAvcodec::getFirstFramePosAndFrameRate(const sTrim *pTrimList, int nTrimCount, bool bDetectpulldown, const RGYAvIndexAnalysis *cached) {
     AVRational fpsDecoder = m_Demux.video.pStream->avg_frame_rate;
     const bool fpsDecoderInvalid = (fpsDecoder.den == 0 || fpsDecoder.num == 0);
     //timebaseが60で割り切れない場合には、ptsが完全には割り切れない値である場合があり、より多くのフレーム数を解析する必要がある
@@ -424,6 +459,41 @@ RGY_ERR RGYInputAvcodec::getFirstFramePosAndFrameRate(const sTrim *pTrimList, in
     vector<std::pair<int, int>> durationHistgram;
     bool bPulldown = false;
 
+    if (cached) {
+        //解析結果がある場合は、ptsの確定と音声の先頭のパケットの取得に必要な分だけ読み込む
+        auto audioPktReady = [this]() {
+            for (const auto& streamInfo : m_Demux.stream) {
+                if (streamInfo.pStream && avcodec_get_type(streamInfo.pStream->codecpar->codec_id) == AVMEDIA_TYPE_AUDIO) {
+                    int count = 0;
+                    for (int j = 0; j < (int)m_Demux.qStreamPktL1.size() && count < 2; j++) {
+                        count += (m_Demux.qStreamPktL1[j].stream_index == streamInfo.nIndex) ? 1 : 0;
+                    }
+                    if (count < 2) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+        for (; i_samples < maxCheckFrames && !getSample(&pkt); i_samples++) {
+            m_Demux.qVideoPkt.push(pkt);
+            if (i_samples + 1 >= RGY_AVINDEX_PREREAD_FRAMES && audioPktReady()) {
+                break;
+            }
+        }
+        double dEstFrameDurationByFpsDecoder = 0.0;
+        if (av_isvalid_q(fpsDecoder) && av_isvalid_q(m_Demux.video.pStream->time_base)) {
+            dEstFrameDurationByFpsDecoder = av_q2d(av_inv_q(fpsDecoder)) * av_q2d(av_inv_q(m_Demux.video.pStream->time_base));
+        }
+        m_Demux.frames.checkPtsStatus(dEstFrameDurationByFpsDecoder, (RGYPtsStatus)cached->ptsStatus);
+        m_Demux.video.nStreamPtsInvalid |= cached->ptsInvalid;
+        m_Demux.video.nAvgFramerate = av_make_q(cached->fpsN, cached->fpsD);
+        m_indexAnalysis = *cached;
+        AddMessage(RGY_LOG_DEBUG, _T("read %d packets, use fps %d/%d, pts status 0x%02x from index.\n"),
+            m_Demux.frames.frameNum(), cached->fpsN, cached->fpsD, cached->ptsStatus);
+        return setStreamPktSample();
+    }
+
     for (int i_retry = 0; ; i_retry++) {
         if (i_retry) {
             //フレームレート推定がうまくいかなそうだった場合、もう少しフレームを解析してみる
@@ -652,7 +722,112 @@ RGY_ERR RGYInputAvcodec::getFirstFramePosAndFrameRate(const sTrim *pTrimList, in
 
     AddMessage(RGY_LOG_DEBUG, _T("final AvgFps (round): %d/%d\n\n"), m_Demux.video.nAvgFramerate.num, m_Demux.video.nAvgFramerate.den);
 
-    auto trimList = make_vector(pTrimList, nTrimCount);
+    //インデックスに保存する解析結果
+    memset(&m_indexAnalysis, 0, sizeof(m_indexAnalysis));
+    m_indexAnalysis.analyzeSec = m_Demux.format.nAnalyzeSec;
+    m_indexAnalysis.detectPulldown = (bDetectpulldown) ? 1 : 0;
+    m_indexAnalysis.fpsN = m_Demux.video.nAvgFramerate.num;
+    m_indexAnalysis.fpsD = m_Demux.video.nAvgFramerate.den;
+    m_indexAnalysis.ptsStatus = m_Demux.frames.getStreamPtsStatus();
+    m_indexAnalysis.ptsInvalid = m_Demux.video.nStreamPtsInvalid;
+    m_indexAnalysis.picstruct = m_Demux.frames.getVideoPicStruct();
+    m_indexAnalysis.flags |= (bPulldown) ? RGY_AVINDEX_PULLDOWN : 0;
+    for (int i = 0; i < m_Demux.frames.frameNum(); i++) {
+        if (m_Demux.frames.list(i).pic_struct & RGY_PICSTRUCT_FIELD) {
+            m_indexAnalysis.flags |= RGY_AVINDEX_FIELD_CODED;
+            break;
+        }
+    }
+
+    return setStreamPktSample();
+}
+
+RGY_ERR RGYInputAvcodec::initIndex(const TCHAR *indexFile, const TCHAR *strFileName, const TCHAR *inputFormat) {
+    RGYAvIndexSource source;
+    if (RGY_ERR_NONE != rgy_avindex_source(strFileName, &source)) {
+        AddMessage(RGY_LOG_WARN, _T("index: failed to get file info of \"%s\", index disabled.\n"), strFileName);
+        return RGY_ERR_FILE_OPEN;
+    }
+    source.streamIndex = m_Demux.video.nIndex;
+    source.codecId = (int32_t)m_Demux.video.pStream->codecpar->codec_id;
+    source.timebaseNum = m_Demux.video.pStream->time_base.num;
+    source.timebaseDen = m_Demux.video.pStream->time_base.den;
+    m_indexFile = (indexFile[0]) ? tstring(indexFile) : rgy_avindex_default_path(strFileName);
+
+    std::unique_ptr<RGYAvIndex> index(new RGYAvIndex());
+    auto err = index->load(m_indexFile.c_str(), source);
+    if (err == RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_DEBUG, _T("index: loaded \"%s\": %d packets%s.\n"),
+            m_indexFile.c_str(), index->frameCount(), (index->analysis()) ? _T(", with analysis") : _T(""));
+    } else {
+        if (err != RGY_ERR_FILE_OPEN) {
+            AddMessage(RGY_LOG_DEBUG, _T("index: \"%s\" is outdated or broken: %s.\n"), m_indexFile.c_str(), get_err_mes(err));
+        }
+        AddMessage(RGY_LOG_INFO, _T("index: creating index \"%s\"...\n"), m_indexFile.c_str());
+        const auto timeStart = std::chrono::system_clock::now();
+        if (RGY_ERR_NONE != (err = index->build(strFileName, inputFormat, source, m_pPrintMes))) {
+            AddMessage(RGY_LOG_WARN, _T("index: failed to create index, index disabled.\n"));
+            return err;
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("index: created index of %d packets in %.1f sec.\n"), index->frameCount(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - timeStart).count() * 0.001);
+        m_indexSave = true;
+    }
+    m_index = std::move(index);
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputAvcodec::seekByIndex(int trimStart) {
+    const auto targets = m_index->seekTargets(trimStart, RGY_AVINDEX_SEEK_RETRY);
+    if (targets.empty()) {
+        AddMessage(RGY_LOG_DEBUG, _T("index: no keyframe to seek before frame %d.\n"), trimStart);
+        return RGY_ERR_NONE;
+    }
+    AVFormatContext *pFormatCtx = m_Demux.format.pFormatCtx;
+    const int videoIndex = m_Demux.video.nIndex;
+    //シーク後に最初に得られるキーフレームの、インデックス上の位置を取得する
+    auto landedKeyframe = [&]() {
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        int keyIndex = -1;
+        while (av_read_frame(pFormatCtx, &pkt) >= 0) {
+            const bool key = pkt.stream_index == videoIndex && (pkt.flags & AV_PKT_FLAG_KEY) && !(pkt.flags & AV_PKT_FLAG_DISCARD);
+            if (key) {
+                keyIndex = m_index->cleanKeyframeIndex(pkt.pts);
+            }
+            av_packet_unref(&pkt);
+            if (key) {
+                break;
+            }
+        }
+        return keyIndex;
+    };
+    //シークした場合は、読み込み開始後に必ず最初のキーフレームの位置を確認する
+    m_indexSeek = true;
+    //シーク先がデマクサによってずれる場合があるので、実際に読み込んで確認し、ずれていたらより前のキーフレームで再試行する
+    for (const auto& target : targets) {
+        if (0 <= av_seek_frame(pFormatCtx, videoIndex, target.pts, AVSEEK_FLAG_BACKWARD)) {
+            const int keyIndex = landedKeyframe();
+            //確認のために読み込んだパケットは破棄し、もう一度シークする
+            if (0 <= keyIndex && keyIndex <= trimStart
+                && 0 <= av_seek_frame(pFormatCtx, videoIndex, target.pts, AVSEEK_FLAG_BACKWARD)) {
+                AddMessage(RGY_LOG_DEBUG, _T("index: seek to keyframe #%d for trim start %d.\n"), keyIndex, trimStart);
+                return RGY_ERR_NONE;
+            }
+            AddMessage(RGY_LOG_DEBUG, _T("index: seek to keyframe #%d landed on #%d.\n"), target.frameIndex, keyIndex);
+        }
+    }
+    //シークできなかった場合は、先頭に戻して通常どおり読み込む
+    AddMessage(RGY_LOG_WARN, _T("index: failed to seek by index, reading from the beginning.\n"));
+    const int64_t startTime = (pFormatCtx->start_time != AV_NOPTS_VALUE) ? pFormatCtx->start_time : 0;
+    if (0 > avformat_seek_file(pFormatCtx, -1, INT64_MIN, startTime, startTime, 0)) {
+        AddMessage(RGY_LOG_ERROR, _T("index: failed to seek back to the beginning.\n"));
+        return RGY_ERR_UNKNOWN;
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputAvcodec::setStreamPktSample() {
     //出力時の音声・字幕解析用に1パケットコピーしておく
     if (m_Demux.qStreamPktL1.size() > 0 || m_Demux.qStreamPktL2.size() > 0) {
         if (!m_Demux.frames.isEof() && m_Demux.qStreamPktL2.size() > 0) {
@@ -1184,6 +1359,20 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
             m_inputVideoInfo.codecExtra = m_Demux.video.pExtradata;
             m_inputVideoInfo.codecExtraSize = m_Demux.video.nExtradataSize;
         }
+        //インデックスを使用する場合は、読み込むか作成する
+        if (input_prm->pIndexFile && !m_Demux.format.bIsPipe) {
+            initIndex(input_prm->pIndexFile, strFileName, input_prm->pInputFormat);
+        }
+        int trimStart = 0;
+        for (int i = 0; i < input_prm->nTrimCount; i++) {
+            trimStart = (i == 0) ? input_prm->pTrimList[i].start : (std::min)(trimStart, input_prm->pTrimList[i].start);
+        }
+        //同じ条件での解析結果があれば使用する (--seekでは先頭の位置が異なるので使用しない)
+        const RGYAvIndexAnalysis *indexAnalysis = (m_index && input_prm->fSeekSec <= 0.0f
+            && m_index->hasAnalysis(m_Demux.format.nAnalyzeSec, input_prm->bVideoDetectPulldown)) ? m_index->analysis() : nullptr;
+        if (m_index && !indexAnalysis && input_prm->fSeekSec <= 0.0f) {
+            m_indexSave = true;
+        }
         if (input_prm->fSeekSec > 0.0f) {
             AVPacket firstpkt;
             getSample(&firstpkt); //現在のtimestampを取得する
@@ -1199,6 +1388,14 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
             }
             //seekのために行ったgetSampleの結果は破棄する
             m_Demux.frames.clear();
+        } else if (indexAnalysis && trimStart > 0
+            && indexAnalysis->ptsStatus == RGY_PTS_NORMAL
+            && !(indexAnalysis->flags & RGY_AVINDEX_FIELD_CODED)) {
+            //フィールド単位で符号化されている場合や、ptsが正常でない場合は、
+            //パケットの位置とフレーム番号が対応しないのでシークしない
+            if (RGY_ERR_NONE != (sts = seekByIndex(trimStart))) {
+                return sts;
+            }
         }
 
         //parserはseek後に初期化すること
@@ -1241,10 +1438,33 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
         }
 #endif
 
-        if (RGY_ERR_NONE != (sts = getFirstFramePosAndFrameRate(input_prm->pTrimList, input_prm->nTrimCount, input_prm->bVideoDetectPulldown))) {
+        if (RGY_ERR_NONE != (sts = getFirstFramePosAndFrameRate(input_prm->pTrimList, input_prm->nTrimCount, input_prm->bVideoDetectPulldown, indexAnalysis))) {
             AddMessage(RGY_LOG_ERROR, _T("failed to get first frame position.\n"));
             return sts;
         }
+        if (m_indexSeek) {
+            //シーク後の最初のキーフレームのデコード順の位置が、先頭から読み込んだ場合のフレーム番号になる
+            const int keyIndex = m_index->cleanKeyframeIndex(m_Demux.video.nStreamFirstKeyPts);
+            if (keyIndex < 0 || keyIndex > trimStart) {
+                AddMessage(RGY_LOG_ERROR, _T("index: unexpected keyframe (pts %lld) after seek.\n"), (long long int)m_Demux.video.nStreamFirstKeyPts);
+                AddMessage(RGY_LOG_ERROR, _T("       please remove index file \"%s\" and retry.\n"), m_indexFile.c_str());
+                return RGY_ERR_UNKNOWN;
+            }
+            m_sTrimParam.offset = keyIndex;
+            AddMessage(RGY_LOG_DEBUG, _T("index: started from keyframe #%d.\n"), keyIndex);
+        }
+        if (m_indexSave) {
+            if (!indexAnalysis && input_prm->fSeekSec <= 0.0f) {
+                m_index->setAnalysis(m_indexAnalysis);
+            }
+            auto err = m_index->save(m_indexFile.c_str());
+            if (err != RGY_ERR_NONE) {
+                AddMessage(RGY_LOG_WARN, _T("index: failed to save \"%s\": %s.\n"), m_indexFile.c_str(), get_err_mes(err));
+            } else {
+                AddMessage(RGY_LOG_DEBUG, _T("index: saved \"%s\".\n"), m_indexFile.c_str());
+            }
+            m_indexSave = false;
+        }
         if (m_cap2ass.enabled()) {
             m_cap2ass.setVidFirstKeyPts(m_Demux.video.nStreamFirstKeyPts);
         }
@@ -1358,10 +1578,14 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
                 AddMessage(RGY_LOG_ERROR, _T("failed to set codec param to context for decoder: %s.\n"), qsv_av_err2str(ret).c_str());
                 return RGY_ERR_UNKNOWN;
             }
+            int decodeThreads = input_prm->nDecodeThreads;
             cpu_info_t cpu_info;
-            if (get_cpu_info(&cpu_info)) {
+            if (decodeThreads <= 0 && get_cpu_info(&cpu_info)) {
+                decodeThreads = (int)std::min(cpu_info.logical_cores, 16u);
+            }
+            if (decodeThreads > 0) {
                 AVDictionary *pDict = nullptr;
-                av_dict_set_int(&pDict, "threads", std::min(cpu_info.logical_cores, 16u), 0);
+                av_dict_set_int(&pDict, "threads", decodeThreads, 0);
                 if (0 > (ret = av_opt_set_dict(m_Demux.video.pCodecCtxDecode, &pDict))) {
                     AddMessage(RGY_LOG_ERROR, _T("Failed to set threads for decode (codec: %s): %s\n"),
                         char_to_tstring(avcodec_get_name(m_Demux.video.pStream->codecpar->codec_id)).c_str(), qsv_av_err2str(ret).c_str());
@@ -1369,6 +1593,9 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
                 }
                 av_dict_free(&pDict);
             }
+            if (input_prm->nDecodeThreadType != RGY_AVSW_THREAD_AUTO) {
+                m_Demux.video.pCodecCtxDecode->thread_type = input_prm->nDecodeThreadType;
+            }
             m_Demux.video.pCodecCtxDecode->time_base = av_stream_get_codec_timebase(m_Demux.video.pStream);
             m_Demux.video.pCodecCtxDecode->pkt_timebase = m_Demux.video.pStream->time_base;
             if (0 > (ret = avcodec_open2(m_Demux.video.pCodecCtxDecode, m_Demux.video.pCodecDecode, nullptr))) {
@@ -1421,6 +1648,14 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
                 AddMessage(RGY_LOG_ERROR, _T("Failed to allocate frame for decoder.\n"));
                 return RGY_ERR_NULL_PTR;
             }
+            //デコードスレッドは、caption2assの設定などが終わってから最初のLoadNextFrameで起動する
+            m_Demux.decode.nDecodeAhead = clamp(input_prm->nDecodeAhead, 0, RGY_AVSW_DECODE_AHEAD_MAX);
+            AddMessage(RGY_LOG_DEBUG, _T("decoder threads: %d (%s), active type: %s, decode ahead: %d frames.\n"),
+                m_Demux.video.pCodecCtxDecode->thread_count,
+                get_chr_from_value(list_avsw_thread_type, input_prm->nDecodeThreadType),
+                (m_Demux.video.pCodecCtxDecode->active_thread_type & FF_THREAD_FRAME) ? _T("frame")
+                    : ((m_Demux.video.pCodecCtxDecode->active_thread_type & FF_THREAD_SLICE) ? _T("slice") : _T("none")),
+                m_Demux.decode.nDecodeAhead);
         } else {
             //HWデコードの場合は、色変換がかからないので、入力フォーマットがそのまま出力フォーマットとなる
             m_inputVideoInfo.csp = pixfmtData->output_csp;
@@ -1437,7 +1672,7 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, c
         m_inputVideoInfo.sar[0]      = (bAspectRatioUnknown) ? 0 : m_Demux.video.pStream->codecpar->sample_aspect_ratio.num;
         m_inputVideoInfo.sar[1]      = (bAspectRatioUnknown) ? 0 : m_Demux.video.pStream->codecpar->sample_aspect_ratio.den;
         m_inputVideoInfo.shift       = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
-        m_inputVideoInfo.picstruct   = m_Demux.frames.getVideoPicStruct();
+        m_inputVideoInfo.picstruct   = (indexAnalysis) ? (RGY_PICSTRUCT)indexAnalysis->picstruct : m_Demux.frames.getVideoPicStruct();
         m_inputVideoInfo.frames      = 0;
         //getFirstFramePosAndFrameRateをもとにfpsを決定
         m_inputVideoInfo.fpsN        = m_Demux.video.nAvgFramerate.num;
@@ -2083,69 +2318,131 @@ RGY_ERR RGYInputAvcodec::GetHeader(RGYBitstream *pBitstream) {
     return RGY_ERR_NONE;
 }
 
+RGY_ERR RGYInputAvcodec::decodeNextFrame(AVFrame *frame) {
+    for (;;) {
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        if (!m_Demux.thread.thInput.joinable() //入力スレッドがなければ、自分で読み込む
+            && m_Demux.qVideoPkt.get_keep_length() > 0) { //keep_length == 0なら読み込みは終了していて、これ以上読み込む必要はない
+            if (0 == getSample(&pkt)) {
+                m_Demux.qVideoPkt.push(pkt);
+            }
+        }
+
+        bool bGetPacket = false;
+        for (int i = 0; false == (bGetPacket = m_Demux.qVideoPkt.front_copy_no_lock(&pkt, (m_Demux.thread.pQueueInfo) ? &m_Demux.thread.pQueueInfo->usage_vid_in : nullptr)) && m_Demux.qVideoPkt.size() > 0; i++) {
+            m_Demux.qVideoPkt.wait_for_push();
+        }
+        if (!bGetPacket) {
+            //flushするためのパケット
+            pkt.data = nullptr;
+            pkt.size = 0;
+        }
+        int ret = avcodec_send_packet(m_Demux.video.pCodecCtxDecode, &pkt);
+        //AVERROR(EAGAIN) -> パケットを送る前に受け取る必要がある
+        //パケットが受け取られていないのでpopしない
+        if (ret != AVERROR(EAGAIN)) {
+            m_Demux.qVideoPkt.pop();
+            av_packet_unref(&pkt);
+        }
+        if (ret == AVERROR_EOF) { //これ以上パケットを送れない
+            AddMessage(RGY_LOG_DEBUG, _T("failed to send packet to video decoder, already flushed: %s.\n"), qsv_av_err2str(ret).c_str());
+        } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to send packet to video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        ret = avcodec_receive_frame(m_Demux.video.pCodecCtxDecode, frame);
+        if (ret == AVERROR(EAGAIN)) { //もっとパケットを送る必要がある
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            //最後まで読み込んだ
+            return RGY_ERR_MORE_DATA;
+        }
+        if (ret < 0) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to receive frame from video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        return RGY_ERR_NONE;
+    }
+}
+
+RGY_ERR RGYInputAvcodec::initDecodeThread() {
+    //変換中の1フレームに加えて、nDecodeAheadフレームを先行してデコードできるようにする
+    const int frameCount = m_Demux.decode.nDecodeAhead + 1;
+    m_Demux.decode.qFrameFree.init(frameCount);
+    m_Demux.decode.qFrameDecoded.init(frameCount);
+    for (int i = 0; i < frameCount; i++) {
+        AVFrame *frame = av_frame_alloc();
+        if (frame == nullptr) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate frame for decode thread.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
+        m_Demux.decode.frames.push_back(frame);
+        m_Demux.decode.qFrameFree.push(frame);
+    }
+    m_Demux.decode.bAbortDecode = false;
+    m_Demux.decode.nDecodeErr = RGY_ERR_NONE;
+    m_Demux.decode.thDecode = std::thread(&RGYInputAvcodec::ThreadFuncDecode, this);
+    AddMessage(RGY_LOG_DEBUG, _T("Started decode thread, %d frames in ring.\n"), frameCount);
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputAvcodec::ThreadFuncDecode() {
+    RGY_PERF_TRACE_THREAD_NAME("avsw decode");
+    RGY_ERR sts = RGY_ERR_NONE;
+    AVFrame *frame = nullptr;
+    while (!m_Demux.decode.bAbortDecode && m_Demux.decode.qFrameFree.pop(&frame)) {
+        if ((sts = decodeNextFrame(frame)) != RGY_ERR_NONE) {
+            break;
+        }
+        //キューの容量はフレーム数以上なので、ここで待機することはない
+        m_Demux.decode.qFrameDecoded.push(frame);
+    }
+    //変換側は残りのフレームを取り出したのち、nDecodeErrを返す
+    m_Demux.decode.nDecodeErr = (sts != RGY_ERR_NONE) ? sts : RGY_ERR_MORE_DATA;
+    m_Demux.decode.qFrameDecoded.close();
+    return sts;
+}
+
 #pragma warning(push)
 #pragma warning(disable:4100)
 RGY_ERR RGYInputAvcodec::LoadNextFrame(RGYFrame *pSurface) {
     if (m_Demux.video.pCodecCtxDecode) {
         //動画のデコードを行う
-        int got_frame = 0;
-        while (!got_frame) {
-            AVPacket pkt;
-            av_init_packet(&pkt);
-            if (!m_Demux.thread.thInput.joinable() //入力スレッドがなければ、自分で読み込む
-                && m_Demux.qVideoPkt.get_keep_length() > 0) { //keep_length == 0なら読み込みは終了していて、これ以上読み込む必要はない
-                if (0 == getSample(&pkt)) {
-                    m_Demux.qVideoPkt.push(pkt);
+        AVFrame *frame = m_Demux.video.pFrame;
+        if (m_Demux.decode.nDecodeAhead > 0) {
+            if (!m_Demux.decode.thDecode.joinable() && m_Demux.decode.frames.size() == 0) {
+                auto sts = initDecodeThread();
+                if (sts != RGY_ERR_NONE) {
+                    return sts;
                 }
             }
-
-            bool bGetPacket = false;
-            for (int i = 0; false == (bGetPacket = m_Demux.qVideoPkt.front_copy_no_lock(&pkt, (m_Demux.thread.pQueueInfo) ? &m_Demux.thread.pQueueInfo->usage_vid_in : nullptr)) && m_Demux.qVideoPkt.size() > 0; i++) {
-                m_Demux.qVideoPkt.wait_for_push();
-            }
-            if (!bGetPacket) {
-                //flushするためのパケット
-                pkt.data = nullptr;
-                pkt.size = 0;
-            }
-            int ret = avcodec_send_packet(m_Demux.video.pCodecCtxDecode, &pkt);
-            //AVERROR(EAGAIN) -> パケットを送る前に受け取る必要がある
-            //パケットが受け取られていないのでpopしない
-            if (ret != AVERROR(EAGAIN)) {
-                m_Demux.qVideoPkt.pop();
-                av_packet_unref(&pkt);
-            }
-            if (ret == AVERROR_EOF) { //これ以上パケットを送れない
-                AddMessage(RGY_LOG_DEBUG, _T("failed to send packet to video decoder, already flushed: %s.\n"), qsv_av_err2str(ret).c_str());
-            } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
-                AddMessage(RGY_LOG_ERROR, _T("failed to send packet to video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
-                return RGY_ERR_UNDEFINED_BEHAVIOR;
-            }
-            ret = avcodec_receive_frame(m_Demux.video.pCodecCtxDecode, m_Demux.video.pFrame);
-            if (ret == AVERROR(EAGAIN)) { //もっとパケットを送る必要がある
-                continue;
-            }
-            if (ret == AVERROR_EOF) {
-                //最後まで読み込んだ
-                return RGY_ERR_MORE_DATA;
+            if (!m_Demux.decode.qFrameDecoded.try_pop(&frame)) {
+                m_Demux.decode.nFrameWait++;
+                if (!m_Demux.decode.qFrameDecoded.pop(&frame)) {
+                    return (RGY_ERR)m_Demux.decode.nDecodeErr.load();
+                }
             }
-            if (ret < 0) {
-                AddMessage(RGY_LOG_ERROR, _T("failed to receive frame from video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
-                return RGY_ERR_UNDEFINED_BEHAVIOR;
+        } else {
+            auto sts = decodeNextFrame(frame);
+            if (sts != RGY_ERR_NONE) {
+                return sts;
             }
-            got_frame = TRUE;
         }
-        pSurface->setTimestamp(m_Demux.video.pFrame->pts);
-        pSurface->setDuration(m_Demux.video.pFrame->pkt_duration);
+        pSurface->setTimestamp(frame->pts);
+        pSurface->setDuration(frame->pkt_duration);
         //フレームデータをコピー
+        //デコードスレッドを使用する場合は、この間に次のフレームのデコードが進む
         void *dst_array[3];
         pSurface->ptrArray(dst_array, m_sConvert->getFunc()->csp_to == RGY_CSP_RGB24 || m_sConvert->getFunc()->csp_to == RGY_CSP_RGB32);
-        m_sConvert->run(m_Demux.video.pFrame->interlaced_frame != 0,
-            dst_array, (const void **)m_Demux.video.pFrame->data,
-            m_inputVideoInfo.srcWidth, m_Demux.video.pFrame->linesize[0], m_Demux.video.pFrame->linesize[1], pSurface->pitch(),
+        m_sConvert->run(frame->interlaced_frame != 0,
+            dst_array, (const void **)frame->data,
+            m_inputVideoInfo.srcWidth, frame->linesize[0], frame->linesize[1], pSurface->pitch(),
             m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
-        if (got_frame) {
-            av_frame_unref(m_Demux.video.pFrame);
+        av_frame_unref(frame);
+        if (m_Demux.decode.nDecodeAhead > 0) {
+            m_Demux.decode.qFrameFree.push(frame);
         }
         m_pEncSatusInfo->m_sData.frameIn++;
     } else {
@@ -2190,6 +2487,7 @@ void RGYInputAvcodec::setOutputVideoInfo(int w, int h, int sar_x, int sar_y, boo
 }
 
 RGY_ERR RGYInputAvcodec::ThreadFuncRead() {
+    RGY_PERF_TRACE_THREAD_NAME("demux");
     while (!m_Demux.thread.bAbortInput) {
         AVPacket pkt;
         if (getSample(&pkt)) {
@@ -2229,5 +2527,87 @@ int64_t RGYInputAvcodec::seek(int64_t offset, int whence) {
 }
 #endif //USE_CUSTOM_INPUT
 
+static const int AVSW_DECODE_BENCH_MAX_FRAMES = 1000;
+
+//指定した条件でファイルを開き、先頭からAVSW_DECODE_BENCH_MAX_FRAMESまでデコード+色変換したときのfpsを計測する
+static RGY_ERR avsw_decode_bench_run(const TCHAR *filename, int decodeAhead, int threadType,
+    VideoInfo *pInputInfo, int *pFrames, double *pFps) {
+    RGYInputPrm base;
+    base.threadCsp = 0;
+    base.simdCsp = (uint32_t)-1; //NVEncCのデフォルトと同じく、使用可能なSIMDをすべて使う
+    RGYInputAvcodecPrm prm(base);
+    prm.bReadVideo = true;
+    prm.nInputThread = RGY_INPUT_THREAD_AUTO;
+    prm.caption2ass = FORMAT_INVALID;
+    prm.nDecodeAhead = decodeAhead;
+    prm.nDecodeThreads = 0;
+    prm.nDecodeThreadType = threadType;
+
+    VideoInfo inputInfo;
+    memset(&inputInfo, 0, sizeof(inputInfo));
+    inputInfo.type = RGY_INPUT_FMT_AVSW;
+    inputInfo.csp = RGY_CSP_NV12;
+
+    auto log = std::make_shared<RGYLog>(nullptr, RGY_LOG_ERROR);
+    auto status = std::make_shared<EncodeStatus>();
+    RGYInputAvcodec reader;
+    auto sts = reader.Init(filename, &inputInfo, &prm, log, status);
+    if (sts != RGY_ERR_NONE) {
+        return sts;
+    }
+    //出力色空間によらず収まるよう、1画素4byte x 3面で確保する
+    const int pitch = ALIGN(inputInfo.srcWidth * 4, 64);
+    unique_ptr<uint8_t, aligned_malloc_deleter> buffer((uint8_t *)_aligned_malloc((size_t)pitch * inputInfo.srcHeight * 3, 64), aligned_malloc_deleter());
+    if (!buffer) {
+        return RGY_ERR_NULL_PTR;
+    }
+    RGYFrame surface = RGYFrameInit();
+    surface.set(buffer.get(), inputInfo.srcWidth, inputInfo.srcHeight, pitch, inputInfo.csp);
+
+    int frames = 0;
+    const auto start = std::chrono::high_resolution_clock::now();
+    while (frames < AVSW_DECODE_BENCH_MAX_FRAMES && (sts = reader.LoadNextFrame(&surface)) == RGY_ERR_NONE) {
+        frames++;
+    }
+    const double elapsed_sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    reader.Close();
+    if (sts != RGY_ERR_NONE && sts != RGY_ERR_MORE_DATA) {
+        return sts;
+    }
+    *pInputInfo = inputInfo;
+    *pFrames = frames;
+    *pFps = (elapsed_sec > 0.0) ? frames / elapsed_sec : 0.0;
+    return RGY_ERR_NONE;
+}
+
+int avsw_decode_bench(FILE *fp, const TCHAR *filename) {
+    static const int threadTypes[] = { RGY_AVSW_THREAD_FRAME, RGY_AVSW_THREAD_SLICE };
+    static const int decodeAheads[] = { 0, RGY_AVSW_DECODE_AHEAD_DEFAULT };
+    _ftprintf(fp, _T("width,height,csp,thread_type,decode_ahead,frames,fps,speedup\n"));
+    for (const auto threadType : threadTypes) {
+        double fps_sync = 0.0;
+        for (const auto decodeAhead : decodeAheads) {
+            VideoInfo inputInfo;
+            int frames = 0;
+            double fps = 0.0;
+            auto sts = avsw_decode_bench_run(filename, decodeAhead, threadType, &inputInfo, &frames, &fps);
+            if (sts != RGY_ERR_NONE) {
+                _ftprintf(stderr, _T("Failed to decode \"%s\": %s\n"), filename, get_err_mes(sts));
+                return 1;
+            }
+            //先行デコードなし (従来の処理) を基準とする
+            if (decodeAhead == 0) {
+                fps_sync = fps;
+            }
+            _ftprintf(fp, _T("%d,%d,%s,%s,%d,%d,%.2f,%.3f\n"),
+                inputInfo.srcWidth, inputInfo.srcHeight, RGY_CSP_NAMES[inputInfo.csp],
+                get_chr_from_value(list_avsw_thread_type, threadType), decodeAhead,
+                frames, fps, (fps_sync > 0.0) ? fps / fps_sync : 0.0);
+            fflush(fp);
+        }
+    }
+    return 0;
+}
+
 #endif //ENABLE_AVSW_READER
 
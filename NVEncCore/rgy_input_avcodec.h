@@ -36,6 +36,7 @@
 #include "rgy_avutil.h"
 #include "rgy_queue.h"
 #include "rgy_perf_monitor.h"
+#include "rgy_input_avindex.h"
 #include "convert_csp.h"
 #include <deque>
 #include <atomic>
@@ -382,7 +383,8 @@ public:
     }
     //現在の情報から、ptsの状態を確認する
     //さらにptsの補正、ptsのソート、pocの確定を行う
-    void checkPtsStatus(double durationHintifPtsAllInvalid = 0.0) {
+    //forceStatusが指定された場合は、読み込んだフレームからは判定せずにforceStatusを使用する
+    void checkPtsStatus(double durationHintifPtsAllInvalid = 0.0, RGYPtsStatus forceStatus = RGY_PTS_UNKNOWN) {
         const int nInputPacketCount = (int)m_list.size();
         int nInputFrames = 0;
         int nInputFields = 0;
@@ -470,6 +472,12 @@ public:
                 m_nStreamPtsStatus |= RGY_PTS_SOMETIMES_INVALID;
             }
         }
+        if (forceStatus != RGY_PTS_UNKNOWN) {
+            m_nStreamPtsStatus = forceStatus;
+            if (!(forceStatus & RGY_PTS_NORMAL)) {
+                m_dFrameDuration = durationHintifPtsAllInvalid;
+            }
+        }
         if ((m_nStreamPtsStatus & RGY_PTS_ALL_INVALID)) {
             auto& mostPopularDuration = durationHistgram[durationHistgram.size() > 1 && durationHistgram[0].first == 0];
             if ((m_dFrameDuration > 0.0 && m_list[0].data.duration == 0) || mostPopularDuration.first == 0) {
@@ -745,6 +753,17 @@ typedef struct AVDemuxThread {
     PerfQueueInfo               *pQueueInfo;         //キューの情報を格納する構造体
 } AVDemuxThread;
 
+typedef struct AVDemuxDecode {
+    int                          nDecodeAhead;       //先行してデコードするフレーム数 (0ならLoadNextFrame内でデコードする)
+    std::atomic<bool>            bAbortDecode;       //デコードスレッドに停止を通知する
+    std::atomic<int>             nDecodeErr;         //デコードスレッドの終了コード (RGY_ERR)
+    std::thread                  thDecode;           //デコードスレッド
+    vector<AVFrame *>            frames;             //デコード用に確保したフレーム (終了時にまとめて解放する)
+    RGYQueueMPMC<AVFrame *>      qFrameFree;         //デコードに使用可能なフレーム
+    RGYQueueMPMC<AVFrame *>      qFrameDecoded;      //デコード済みで変換待ちのフレーム
+    uint64_t                     nFrameWait;         //デコード済みのフレームがなく、変換側が待機した回数
+} AVDemuxDecode;
+
 typedef struct AVDemuxer {
     AVDemuxFormat            format;
     AVDemuxVideo             video;
@@ -752,6 +771,7 @@ typedef struct AVDemuxer {
     vector<AVDemuxStream>    stream;
     vector<const AVChapter*> chapter;
     AVDemuxThread            thread;
+    AVDemuxDecode            decode;
     RGYQueueSPSP<AVPacket>   qVideoPkt;
     deque<AVPacket>          qStreamPktL1;
     RGYQueueSPSP<AVPacket>   qStreamPktL2;
@@ -953,12 +973,16 @@ public:
     int            nProcSpeedLimit;         //プリデコードする場合の処理速度制限 (0で制限なし)
     float          fSeekSec;                //指定された秒数分先頭を飛ばす
     const TCHAR   *pFramePosListLog;        //FramePosListの内容を入力終了時に出力する (デバッグ用)
+    const TCHAR   *pIndexFile;              //映像パケットのインデックスの保存先 (nullptrなら使用しない)
     const TCHAR   *pLogCopyFrameData;       //frame情報copy関数のログ出力先 (デバッグ用)
     int            nInputThread;            //入力スレッドを有効にする
     PerfQueueInfo *pQueueInfo;              //キューの情報を格納する構造体
     DeviceCodecCsp *pHWDecCodecCsp;         //HWデコーダのサポートするコーデックと色空間
     bool           bVideoDetectPulldown;    //pulldownの検出を試みるかどうか
     C2AFormat      caption2ass;             //caption2assの処理の有効化
+    int            nDecodeAhead;            //swデコード時に先行してデコードするフレーム数 (0で無効)
+    int            nDecodeThreads;          //swデコード時のlibavcodecのスレッド数 (0で自動)
+    int            nDecodeThreadType;       //swデコード時のlibavcodecのスレッドの種類 (RGY_AVSW_THREAD_xxx)
 
     RGYInputAvcodecPrm(RGYInputPrm base);
     virtual ~RGYInputAvcodecPrm() {};
@@ -1066,11 +1090,31 @@ protected:
     //QSVでデコードした際の最初のフレームのptsを取得する
     //さらに、平均フレームレートを推定する
     //fpsDecoderはdecoderの推定したfps
-    RGY_ERR getFirstFramePosAndFrameRate(const sTrim *pTrimList, int nTrimCount, bool bDetectpulldown);
+    //cachedが指定された場合は、その解析結果を使用し、先頭の読み込みは最小限にする
+    RGY_ERR getFirstFramePosAndFrameRate(const sTrim *pTrimList, int nTrimCount, bool bDetectpulldown, const RGYAvIndexAnalysis *cached);
+
+    //出力時の音声解析用に、各音声の先頭のパケットをコピーしておく
+    RGY_ERR setStreamPktSample();
+
+    //インデックスを読み込み、無効なら作成する
+    RGY_ERR initIndex(const TCHAR *indexFile, const TCHAR *strFileName, const TCHAR *inputFormat);
+
+    //インデックスを使用して、trimの開始位置の直前の"きれいに切れる"キーフレームにシークする
+    RGY_ERR seekByIndex(int trimStart);
 
     //読み込みスレッド関数
     RGY_ERR ThreadFuncRead();
 
+    //パケットを送り、1フレーム分デコードしてframeに格納する
+    //最後までデコードした場合はRGY_ERR_MORE_DATAを返す
+    RGY_ERR decodeNextFrame(AVFrame *frame);
+
+    //デコードスレッドとフレームのリングを準備する
+    RGY_ERR initDecodeThread();
+
+    //デコードスレッド関数
+    RGY_ERR ThreadFuncDecode();
+
     //指定したptsとtimebaseから、該当する動画フレームを取得する
     int getVideoFrameIdx(int64_t pts, AVRational timebase, int iStart);
 
@@ -1089,13 +1133,23 @@ protected:
     void CloseVideo(AVDemuxVideo *pVideo);
     void CloseFormat(AVDemuxFormat *pFormat);
     void CloseThread();
+    void CloseDecodeThread();
 
     AVDemuxer        m_Demux;                      //デコード用情報
     tstring          m_sFramePosListLog;           //FramePosListの内容を入力終了時に出力する (デバッグ用)
     vector<uint8_t>  m_hevcMp42AnnexbBuffer;       //HEVCのmp4->AnnexB簡易変換用バッファ
     AVCaption2Ass    m_cap2ass;
+    std::unique_ptr<RGYAvIndex> m_index;            //映像パケットのインデックス (--input-index)
+    tstring          m_indexFile;                   //インデックスの保存先
+    bool             m_indexSave;                   //インデックスを保存する必要があるか
+    bool             m_indexSeek;                   //インデックスを使用してシークしたか
+    RGYAvIndexAnalysis m_indexAnalysis;             //先頭フレームの解析結果 (インデックスに保存する)
 };
 
+//指定したファイルの動画をswデコードし、先行デコードの有無やlibavcodecのスレッドの種類ごとに
+//デコード+色変換の速度を計測してCSVで出力する
+int avsw_decode_bench(FILE *fp, const TCHAR *filename);
+
 #endif //ENABLE_AVSW_READER
 
 #endif //__RGY_INPUT_AVCODEC_H__
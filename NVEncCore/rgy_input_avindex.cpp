@@ -0,0 +1,611 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <climits>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_input_avindex.h"
+#if ENABLE_AVSW_READER
+#include "rgy_avutil.h"
+
+static_assert(RGY_AVINDEX_PKT_KEY == AV_PKT_FLAG_KEY, "RGY_AVINDEX_PKT_KEY must be same as AV_PKT_FLAG_KEY.");
+static_assert(RGY_AVINDEX_PKT_DISCARD == AV_PKT_FLAG_DISCARD, "RGY_AVINDEX_PKT_DISCARD must be same as AV_PKT_FLAG_DISCARD.");
+#endif //#if ENABLE_AVSW_READER
+
+static const int64_t RGY_AVINDEX_NOPTS = INT64_MIN; //AV_NOPTS_VALUE
+
+static uint64_t avindex_checksum(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool avindex_source_equal(const RGYAvIndexSource& a, const RGYAvIndexSource& b) {
+    return a.fileSize == b.fileSize
+        && a.fileTime == b.fileTime
+        && a.streamIndex == b.streamIndex
+        && a.codecId == b.codecId
+        && a.timebaseNum == b.timebaseNum
+        && a.timebaseDen == b.timebaseDen;
+}
+
+RGY_ERR rgy_avindex_source(const TCHAR *filename, RGYAvIndexSource *source) {
+    memset(source, 0, sizeof(source[0]));
+#if defined(_WIN32) || defined(_WIN64)
+    struct __stat64 st;
+    if (0 != _tstat64(filename, &st)) {
+#else
+    struct stat st;
+    if (0 != stat(filename, &st)) {
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        return RGY_ERR_FILE_OPEN;
+    }
+    source->fileSize = (uint64_t)st.st_size;
+    source->fileTime = (int64_t)st.st_mtime;
+    return RGY_ERR_NONE;
+}
+
+tstring rgy_avindex_default_path(const tstring& inputFile) {
+    return inputFile + _T(".rgyidx");
+}
+
+RGYAvIndex::RGYAvIndex() :
+    m_source(),
+    m_analysis(),
+    m_flags(0),
+    m_frames(),
+    m_map(),
+    m_mapFrames(nullptr),
+    m_mapFrameCount(0) {
+    memset(&m_source, 0, sizeof(m_source));
+    memset(&m_analysis, 0, sizeof(m_analysis));
+}
+
+RGYAvIndex::~RGYAvIndex() {
+    m_map.reset();
+}
+
+RGY_ERR RGYAvIndex::load(const TCHAR *path, const RGYAvIndexSource& source) {
+    std::unique_ptr<RGYFileMapRead> map(new RGYFileMapRead());
+    auto err = map->open(path);
+    if (err != RGY_ERR_NONE) {
+        return err;
+    }
+    if (map->size() < sizeof(RGYAvIndexHeader)) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    RGYAvIndexHeader header;
+    memcpy(&header, map->ptr(), sizeof(header));
+    if (header.magic != RGY_AVINDEX_MAGIC
+        || header.headerSize != sizeof(RGYAvIndexHeader)
+        || header.frameSize != sizeof(RGYAvIndexFrame)
+        || header.fileSize != (uint64_t)map->size()
+        || header.frameCount > (uint64_t)INT_MAX
+        || header.fileSize != header.headerSize + header.frameCount * header.frameSize) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    if (header.version != RGY_AVINDEX_VERSION
+        || !avindex_source_equal(header.source, source)) {
+        return RGY_ERR_INVALID_VERSION;
+    }
+    if (header.checksum != avindex_checksum(map->ptr() + header.headerSize, map->size() - header.headerSize)) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    m_source = header.source;
+    m_analysis = header.analysis;
+    m_flags = header.flags;
+    m_frames.clear();
+    //ヘッダのサイズは8の倍数なので、そのまま参照できる
+    m_mapFrames = (const RGYAvIndexFrame *)(map->ptr() + header.headerSize);
+    m_mapFrameCount = (int)header.frameCount;
+    m_map = std::move(map);
+    return RGY_ERR_NONE;
+}
+
+void RGYAvIndex::set(const RGYAvIndexSource& source, std::vector<RGYAvIndexFrame>&& frames) {
+    m_map.reset();
+    m_mapFrames = nullptr;
+    m_mapFrameCount = 0;
+    m_source = source;
+    m_frames = std::move(frames);
+    m_flags = 0;
+    memset(&m_analysis, 0, sizeof(m_analysis));
+}
+
+void RGYAvIndex::setAnalysis(const RGYAvIndexAnalysis& analysis) {
+    m_analysis = analysis;
+    m_flags |= RGY_AVINDEX_ANALYSIS_VALID;
+}
+
+bool RGYAvIndex::hasAnalysis(int analyzeSec, bool detectPulldown) const {
+    return (m_flags & RGY_AVINDEX_ANALYSIS_VALID)
+        && m_analysis.analyzeSec == analyzeSec
+        && m_analysis.detectPulldown == (detectPulldown ? 1 : 0)
+        && m_analysis.fpsN > 0 && m_analysis.fpsD > 0;
+}
+
+RGY_ERR RGYAvIndex::save(const TCHAR *path) const {
+    const size_t dataSize = sizeof(RGYAvIndexFrame) * (size_t)frameCount();
+    RGYAvIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RGY_AVINDEX_MAGIC;
+    header.version = RGY_AVINDEX_VERSION;
+    header.headerSize = sizeof(RGYAvIndexHeader);
+    header.frameSize = sizeof(RGYAvIndexFrame);
+    header.frameCount = (uint64_t)frameCount();
+    header.fileSize = sizeof(RGYAvIndexHeader) + dataSize;
+    header.checksum = avindex_checksum((const uint8_t *)frames(), dataSize);
+    header.flags = m_flags;
+    header.source = m_source;
+    header.analysis = m_analysis;
+
+    //同じ入力を同時にエンコードしても壊れたファイルが見えないよう、一時ファイルに書き込んでから置き換える
+#if defined(_WIN32) || defined(_WIN64)
+    const tstring tmpPath = tstring(path) + strsprintf(_T(".%d.tmp"), GetCurrentProcessId());
+#else
+    const tstring tmpPath = tstring(path) + strsprintf(_T(".%d.tmp"), (int)getpid());
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    {
+        std::ofstream fout(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fout.good()) {
+            return RGY_ERR_FILE_OPEN;
+        }
+        fout.write((const char *)&header, sizeof(header));
+        if (dataSize) {
+            fout.write((const char *)frames(), dataSize);
+        }
+        if (!fout.good()) {
+            fout.close();
+            _tremove(tmpPath.c_str());
+            return RGY_ERR_UNKNOWN;
+        }
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (!MoveFileEx(tmpPath.c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (0 != rename(tmpPath.c_str(), path)) {
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        _tremove(tmpPath.c_str());
+        return RGY_ERR_ACCESS_DENIED;
+    }
+    return RGY_ERR_NONE;
+}
+
+#if ENABLE_AVSW_READER
+RGY_ERR RGYAvIndex::build(const tstring& filename, const TCHAR *inputFormat, const RGYAvIndexSource& source, std::shared_ptr<RGYLog> log) {
+    if (!check_avcodec_dll()) {
+        if (log) log->write(RGY_LOG_ERROR, error_mes_avcodec_dll_not_found().c_str());
+        return RGY_ERR_NULL_PTR;
+    }
+    std::string filename_char;
+    if (0 == tchar_to_string(filename.c_str(), filename_char, CP_UTF8)) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: failed to convert filename to utf-8 characters.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    AVInputFormat *format = nullptr;
+    if (inputFormat && nullptr == (format = av_find_input_format(tchar_to_string(inputFormat).c_str()))) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: unknown input format: %s.\n"), inputFormat);
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    AVDictionary *formatOptions = nullptr;
+    av_dict_set(&formatOptions, "scan_all_pmts", "1", 0);
+    AVFormatContext *formatCtx = nullptr;
+    int ret = avformat_open_input(&formatCtx, filename_char.c_str(), format, &formatOptions);
+    av_dict_free(&formatOptions);
+    if (ret != 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: error opening file \"%s\": %s\n"), filename.c_str(), qsv_av_err2str(ret).c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    unique_ptr_custom<AVFormatContext> formatCtxHolder(formatCtx, [](AVFormatContext *ctx) { avformat_close_input(&ctx); });
+    if (avformat_find_stream_info(formatCtx, nullptr) < 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: error finding stream information.\n"));
+        return RGY_ERR_UNKNOWN;
+    }
+    //入力側で選択されたストリームと同じものか確認する
+    if (source.streamIndex < 0 || source.streamIndex >= (int)formatCtx->nb_streams
+        || formatCtx->streams[source.streamIndex]->codecpar->codec_id != (AVCodecID)source.codecId
+        || formatCtx->streams[source.streamIndex]->time_base.num != source.timebaseNum
+        || formatCtx->streams[source.streamIndex]->time_base.den != source.timebaseDen) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: video stream #%d does not match the input.\n"), source.streamIndex);
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    //映像以外のパケットは読み込まない
+    for (int i = 0; i < (int)formatCtx->nb_streams; i++) {
+        formatCtx->streams[i]->discard = (i == source.streamIndex) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    std::vector<RGYAvIndexFrame> frames;
+    int keyframes = 0;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    while (av_read_frame(formatCtx, &pkt) >= 0) {
+        if (pkt.stream_index == source.streamIndex) {
+            if (frames.size() >= (size_t)INT_MAX) {
+                av_packet_unref(&pkt);
+                if (log) log->write(RGY_LOG_ERROR, _T("index: too many packets in the input video.\n"));
+                return RGY_ERR_UNSUPPORTED;
+            }
+            RGYAvIndexFrame frame;
+            frame.pts = pkt.pts;
+            frame.dts = pkt.dts;
+            frame.pos = pkt.pos;
+            frame.duration = (int32_t)pkt.duration;
+            frame.flags = (uint32_t)pkt.flags & (RGY_AVINDEX_PKT_KEY | RGY_AVINDEX_PKT_DISCARD);
+            keyframes += (frame.flags & RGY_AVINDEX_PKT_KEY) ? 1 : 0;
+            frames.push_back(frame);
+        }
+        av_packet_unref(&pkt);
+    }
+    if (keyframes == 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("index: no keyframe found in the input video.\n"));
+        return RGY_ERR_NOT_FOUND;
+    }
+    if (log) log->write(RGY_LOG_DEBUG, _T("index: scanned %d packets, %d keyframes.\n"), (int)frames.size(), keyframes);
+    set(source, std::move(frames));
+    return RGY_ERR_NONE;
+}
+#endif //#if ENABLE_AVSW_READER
+
+std::vector<bool> RGYAvIndex::cleanKeyframes() const {
+    const int count = frameCount();
+    const RGYAvIndexFrame *frame = frames();
+    std::vector<bool> clean(count, false);
+    int firstKey = -1;
+    for (int i = 0; i < count; i++) {
+        //ptsが無効、あるいは破棄されるパケットがある場合はデコード順の位置とフレーム番号が一致しない
+        if (frame[i].pts == RGY_AVINDEX_NOPTS || (frame[i].flags & RGY_AVINDEX_PKT_DISCARD)) {
+            return std::vector<bool>(count, false);
+        }
+        if (firstKey < 0 && (frame[i].flags & RGY_AVINDEX_PKT_KEY)) {
+            firstKey = i;
+        }
+    }
+    if (firstKey < 0) {
+        return clean;
+    }
+    //後ろから、それ以降のパケットのptsの最小値を求める
+    std::vector<int64_t> minPtsAfter(count + 1);
+    minPtsAfter[count] = INT64_MAX;
+    for (int i = count - 1; i >= 0; i--) {
+        minPtsAfter[i] = std::min(minPtsAfter[i + 1], frame[i].pts);
+    }
+    //最初のキーフレームより前のパケットはデコードされないので、表示順の判定には含めない
+    int64_t maxPtsBefore = INT64_MIN;
+    for (int i = firstKey; i < count; i++) {
+        if ((frame[i].flags & RGY_AVINDEX_PKT_KEY)
+            && maxPtsBefore < frame[i].pts && frame[i].pts < minPtsAfter[i + 1]) {
+            clean[i] = true;
+        }
+        maxPtsBefore = std::max(maxPtsBefore, frame[i].pts);
+    }
+    //最初のキーフレームが"きれいに切れる"ものでない場合 (open-GOPなど) は、
+    //先頭からデコードした場合のフレーム番号がデコーダの動作に依存するので、シークしない
+    if (!clean[firstKey]) {
+        return std::vector<bool>(count, false);
+    }
+    return clean;
+}
+
+std::vector<RGYAvIndexSeek> RGYAvIndex::seekTargets(int trimStart, int maxCount) const {
+    std::vector<RGYAvIndexSeek> targets;
+    const int count = frameCount();
+    if (trimStart <= 0 || count == 0) {
+        return targets;
+    }
+    const auto clean = cleanKeyframes();
+    const RGYAvIndexFrame *frame = frames();
+    int firstKey = -1;
+    for (int i = 0; i < count && firstKey < 0; i++) {
+        if (clean[i]) {
+            firstKey = i;
+        }
+    }
+    //最初のキーフレームへのシークは意味がないので含めない
+    for (int i = std::min(trimStart, count - 1); i > firstKey && firstKey >= 0 && (int)targets.size() < maxCount; i--) {
+        if (clean[i]) {
+            RGYAvIndexSeek seek;
+            seek.frameIndex = i;
+            seek.pts = frame[i].pts;
+            seek.dts = frame[i].dts;
+            targets.push_back(seek);
+        }
+    }
+    return targets;
+}
+
+int RGYAvIndex::cleanKeyframeIndex(int64_t pts) const {
+    const auto clean = cleanKeyframes();
+    const RGYAvIndexFrame *frame = frames();
+    for (int i = 0; i < frameCount(); i++) {
+        if (clean[i] && frame[i].pts == pts) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//--- ここからベンチマーク ---
+
+//擬似的なストリームを作成する (デコード順)
+//  anchorInterval: IまたはPの間隔 (間のフレームはB、アンカーの後にデコードされる)
+//  gop:            Iの間隔 (アンカーの数)
+//  openGop:        trueならIの前のBはIの後にデコードされる (leading picture)
+//  prefix:         先頭のキーフレームより前にあるキーフレームでないパケットの数
+static std::vector<RGYAvIndexFrame> avindex_bench_stream(int frameCount, int anchorInterval, int gop, bool openGop, int prefix) {
+    std::vector<RGYAvIndexFrame> frames;
+    const int64_t duration = 1001;
+    auto add = [&](int64_t displayIndex, bool key) {
+        RGYAvIndexFrame frame;
+        frame.pts = displayIndex * duration;
+        frame.dts = (int64_t)frames.size() * duration - 2 * duration;
+        frame.pos = (int64_t)frames.size() * 4096;
+        frame.duration = (int32_t)duration;
+        frame.flags = (key) ? RGY_AVINDEX_PKT_KEY : 0;
+        frames.push_back(frame);
+    };
+    for (int i = 0; i < prefix; i++) {
+        add(i - prefix, false);
+    }
+    int prevAnchor = -1;
+    for (int anchor = 0, anchorCount = 0; anchor < frameCount; anchor += anchorInterval, anchorCount++) {
+        const bool key = (anchorCount % gop) == 0;
+        if (key && !openGop) {
+            //closed-GOP: Iの前のフレームはPとして先にデコードする
+            for (int j = prevAnchor + 1; j < anchor; j++) {
+                add(j, false);
+            }
+            add(anchor, true);
+        } else {
+            add(anchor, key);
+            for (int j = prevAnchor + 1; j < anchor; j++) {
+                add(j, false);
+            }
+        }
+        prevAnchor = anchor;
+    }
+    for (int j = prevAnchor + 1; j < frameCount; j++) {
+        add(j, false);
+    }
+    return frames;
+}
+
+struct AvIndexBenchOutput {
+    int trimFrame;
+    int64_t pts;
+};
+
+//startからデコードした場合の出力 (RGYInputAvcodecのフレーム番号の決め方を再現する)
+//  最初のキーフレームより前のパケットと、最初のキーフレームより前に表示されるパケットは出力せず、フレーム番号のオフセットとする
+static std::vector<AvIndexBenchOutput> avindex_bench_decode(const std::vector<RGYAvIndexFrame>& frames, int start, int offset) {
+    int firstKey = -1;
+    std::vector<int64_t> decoded;
+    for (int i = start; i < (int)frames.size(); i++) {
+        if (firstKey < 0) {
+            if ((frames[i].flags & RGY_AVINDEX_PKT_KEY) == 0) {
+                offset++;
+                continue;
+            }
+            firstKey = i;
+        } else if (frames[i].pts < frames[firstKey].pts) {
+            offset++;
+            continue;
+        }
+        decoded.push_back(frames[i].pts);
+    }
+    std::sort(decoded.begin(), decoded.end());
+    std::vector<AvIndexBenchOutput> output;
+    for (int i = 0; i < (int)decoded.size(); i++) {
+        output.push_back({ i + offset, decoded[i] });
+    }
+    return output;
+}
+
+//"きれいに切れる"キーフレームの定義どおりに、trimStart以前で最後のものを探す
+static int avindex_bench_latest_clean(const std::vector<RGYAvIndexFrame>& frames, int trimStart) {
+    int firstKey = -1;
+    for (int i = 0; i < (int)frames.size() && firstKey < 0; i++) {
+        if (frames[i].flags & RGY_AVINDEX_PKT_KEY) {
+            firstKey = i;
+        }
+    }
+    auto isClean = [&](int k) {
+        for (int j = firstKey; j < (int)frames.size(); j++) {
+            if (j != k && ((j < k) != (frames[j].pts < frames[k].pts))) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (firstKey < 0 || !isClean(firstKey)) {
+        return -1;
+    }
+    for (int i = std::min(trimStart, (int)frames.size() - 1); i > firstKey; i--) {
+        if ((frames[i].flags & RGY_AVINDEX_PKT_KEY) && isClean(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool avindex_bench_check_seek(const std::vector<RGYAvIndexFrame>& frames, const RGYAvIndex& index, int trimStart) {
+    const auto targets = index.seekTargets(trimStart, 1);
+    const int expected = avindex_bench_latest_clean(frames, trimStart);
+    if (expected < 0) {
+        return targets.empty();
+    }
+    if (targets.size() != 1 || targets[0].frameIndex != expected || targets[0].pts != frames[expected].pts) {
+        return false;
+    }
+    //シークした場合は、キーフレームのデコード順の位置をフレーム番号のオフセットとする
+    auto fromStart = avindex_bench_decode(frames, 0, 0);
+    auto fromSeek = avindex_bench_decode(frames, targets[0].frameIndex, targets[0].frameIndex);
+    auto trimmed = [trimStart](std::vector<AvIndexBenchOutput>& output) {
+        output.erase(std::remove_if(output.begin(), output.end(), [trimStart](const AvIndexBenchOutput& o) { return o.trimFrame < trimStart; }), output.end());
+    };
+    trimmed(fromStart);
+    trimmed(fromSeek);
+    if (fromStart.size() != fromSeek.size() || fromStart.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < fromStart.size(); i++) {
+        if (fromStart[i].trimFrame != fromSeek[i].trimFrame || fromStart[i].pts != fromSeek[i].pts) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int avindex_bench(FILE *fp) {
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR tempDir[1024] = { 0 };
+    GetTempPath(_countof(tempDir), tempDir);
+    const tstring indexPath = PathCombineS(tstring(tempDir), strsprintf(_T("rgy_avindex_bench_%d.rgyidx"), GetCurrentProcessId()));
+#else
+    const tstring indexPath = strsprintf(_T("/tmp/rgy_avindex_bench_%d.rgyidx"), (int)getpid());
+#endif
+    RGYAvIndexSource source;
+    memset(&source, 0, sizeof(source));
+    source.fileSize = 1234567890;
+    source.fileTime = 1500000000;
+    source.streamIndex = 0;
+    source.codecId = 27;
+    source.timebaseNum = 1;
+    source.timebaseDen = 30000;
+    RGYAvIndexAnalysis analysis;
+    memset(&analysis, 0, sizeof(analysis));
+    analysis.analyzeSec = 0;
+    analysis.detectPulldown = 1;
+    analysis.fpsN = 30000;
+    analysis.fpsD = 1001;
+    analysis.ptsStatus = 0x01;
+
+    struct BenchStream {
+        const char *name;
+        int anchorInterval;
+        int gop;
+        bool openGop;
+        int prefix;
+    };
+    const BenchStream streams[] = {
+        { "intra",          1,  1, false, 0 },
+        { "closed_gop_b3",  4,  8, false, 0 },
+        { "closed_gop_pre", 3, 10, false, 5 },
+        { "open_gop_b3",    4,  8, true,  0 },
+        { "p_only",         1, 60, false, 2 },
+    };
+    bool allOK = true;
+    fprintf(fp, "case,frames,targets,time_ms,verify\n");
+    //シーク先の選択と、シークした場合のデコード結果を確認する
+    for (const auto& s : streams) {
+        auto frames = avindex_bench_stream(600, s.anchorInterval, s.gop, s.openGop, s.prefix);
+        RGYAvIndex index;
+        index.set(source, std::vector<RGYAvIndexFrame>(frames));
+        bool ok = true;
+        int targets = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int trimStart = 1; trimStart < (int)frames.size(); trimStart += 7) {
+            ok &= avindex_bench_check_seek(frames, index, trimStart);
+            targets += (index.seekTargets(trimStart, 1).empty()) ? 0 : 1;
+        }
+        const double timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        //open-GOPではシークしない
+        if (s.openGop) {
+            ok &= targets == 0;
+        }
+        fprintf(fp, "seek_%s,%d,%d,%.1f,%s\n", s.name, (int)frames.size(), targets, timeMs, ok ? "OK" : "NG");
+        allOK &= ok;
+    }
+    //ptsが無効なパケットがある場合はシークしない
+    {
+        auto frames = avindex_bench_stream(600, 4, 8, false, 0);
+        frames[100].pts = RGY_AVINDEX_NOPTS;
+        RGYAvIndex index;
+        index.set(source, std::move(frames));
+        const bool ok = index.seekTargets(500, 1).empty();
+        fprintf(fp, "seek_invalid_pts,600,0,0.0,%s\n", ok ? "OK" : "NG");
+        allOK &= ok;
+    }
+    //保存と読み込み、入力ファイルが変更された場合/インデックスが壊れた場合の無効化
+    {
+        const int frameCount = 2 * 1000 * 1000;
+        auto frames = avindex_bench_stream(frameCount, 4, 60, false, 0);
+        RGYAvIndex index;
+        index.set(source, std::vector<RGYAvIndexFrame>(frames));
+        index.setAnalysis(analysis);
+        auto start = std::chrono::high_resolution_clock::now();
+        bool ok = index.save(indexPath.c_str()) == RGY_ERR_NONE;
+        double timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        fprintf(fp, "save,%d,0,%.1f,%s\n", frameCount, timeMs, ok ? "OK" : "NG");
+        allOK &= ok;
+
+        RGYAvIndex loaded;
+        start = std::chrono::high_resolution_clock::now();
+        ok = loaded.load(indexPath.c_str(), source) == RGY_ERR_NONE;
+        const auto targets = (ok) ? loaded.seekTargets(frameCount / 2, RGY_AVINDEX_SEEK_RETRY) : std::vector<RGYAvIndexSeek>();
+        timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        ok = ok && loaded.frameCount() == frameCount
+            && 0 == memcmp(loaded.frames(), frames.data(), sizeof(frames[0]) * frames.size())
+            && loaded.hasAnalysis(analysis.analyzeSec, analysis.detectPulldown != 0)
+            && !loaded.hasAnalysis(analysis.analyzeSec + 1, analysis.detectPulldown != 0)
+            && targets.size() == RGY_AVINDEX_SEEK_RETRY
+            && targets[0].frameIndex <= frameCount / 2 && targets[0].frameIndex > targets[1].frameIndex;
+        fprintf(fp, "load_and_seek,%d,%d,%.1f,%s\n", frameCount, (int)targets.size(), timeMs, ok ? "OK" : "NG");
+        allOK &= ok;
+
+        //入力ファイルのサイズ/更新日時が異なる場合
+        RGYAvIndexSource modified = source;
+        modified.fileTime++;
+        RGYAvIndex loadModified;
+        ok = loadModified.load(indexPath.c_str(), modified) == RGY_ERR_INVALID_VERSION;
+        modified = source;
+        modified.fileSize--;
+        ok &= loadModified.load(indexPath.c_str(), modified) == RGY_ERR_INVALID_VERSION;
+        fprintf(fp, "invalidate_source,%d,0,0.0,%s\n", frameCount, ok ? "OK" : "NG");
+        allOK &= ok;
+
+        //インデックスが壊れている場合
+        {
+            std::fstream fio(indexPath, std::ios::in | std::ios::out | std::ios::binary);
+            fio.seekp(sizeof(RGYAvIndexHeader) + sizeof(RGYAvIndexFrame) * 12345 + 3);
+            fio.put((char)0x5a);
+        }
+        RGYAvIndex loadBroken;
+        ok = loadBroken.load(indexPath.c_str(), source) == RGY_ERR_INVALID_FORMAT;
+        fprintf(fp, "invalidate_checksum,%d,0,0.0,%s\n", frameCount, ok ? "OK" : "NG");
+        allOK &= ok;
+        _tremove(indexPath.c_str());
+    }
+    return (allOK) ? 0 : 1;
+}
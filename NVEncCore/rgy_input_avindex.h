@@ -0,0 +1,185 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_INPUT_AVINDEX_H__
+#define __RGY_INPUT_AVINDEX_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <memory>
+#include "rgy_version.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+#include "rgy_log.h"
+
+//入力ファイルの映像パケットの一覧 (インデックス) をファイルに保存し、同じ入力を繰り返しエンコードする際に使用する
+//
+//インデックスには、デコード順の全映像パケットのpts/dts/位置/フラグと、
+//RGYInputAvcodecの先頭フレームの解析結果 (fps, ptsの状態, picstruct) を保存する
+//
+//2回目以降は
+// - 解析結果を使用し、先頭の解析のための読み込みを最小限にする
+// - --trimの開始位置の直前の"きれいに切れる"キーフレームにシークし、そこまでの読み込み/デコードを省略する
+//
+//"きれいに切れる"キーフレームとは、デコード順でそれより前のパケットはすべて表示順でも前、
+//それより後のパケットはすべて表示順でも後になるもので、この場合、そのキーフレームのデコード順の位置が
+//先頭からデコードした場合のフレーム番号 (--trimで指定する番号) と一致する
+//
+//インデックスは入力ファイルのサイズと更新日時を保持し、一致しない場合は作り直す
+
+static const uint32_t RGY_AVINDEX_MAGIC = 0x58494752; //'RGIX'
+static const uint32_t RGY_AVINDEX_VERSION = 1;
+static const int RGY_AVINDEX_PREREAD_FRAMES = 32; //解析結果を使用する場合に、先頭で読み込むフレーム数
+static const int RGY_AVINDEX_SEEK_RETRY = 3;      //シーク先が想定と異なる場合に、より前のキーフレームで再試行する回数
+
+//パケットのフラグ (AV_PKT_FLAG_xxxと同じ値)
+static const uint32_t RGY_AVINDEX_PKT_KEY     = 0x0001;
+static const uint32_t RGY_AVINDEX_PKT_DISCARD = 0x0004;
+
+//RGYAvIndexHeader::flags
+enum RGYAvIndexFlag : uint32_t {
+    RGY_AVINDEX_ANALYSIS_VALID = 0x01, //解析結果が保存されている
+};
+
+//RGYAvIndexAnalysis::flags
+enum RGYAvIndexAnalysisFlag : uint32_t {
+    RGY_AVINDEX_PULLDOWN     = 0x01, //プルダウンを検出した
+    RGY_AVINDEX_FIELD_CODED  = 0x02, //フィールド単位で符号化されている (パケットとフレームが一対一でない)
+};
+
+#pragma pack(push, 8)
+//映像パケット (デコード順)
+struct RGYAvIndexFrame {
+    int64_t pts;
+    int64_t dts;
+    int64_t pos;       //ファイル上の位置 (不明なら-1)
+    int32_t duration;
+    uint32_t flags;    //RGY_AVINDEX_PKT_xxx
+};
+static_assert(sizeof(RGYAvIndexFrame) == 32, "RGYAvIndexFrame must be 32 bytes.");
+
+//RGYInputAvcodecの先頭フレームの解析結果
+struct RGYAvIndexAnalysis {
+    int32_t analyzeSec;     //解析時の--input-analyze
+    int32_t detectPulldown; //解析時にプルダウンの検出を行ったか
+    int32_t fpsN;
+    int32_t fpsD;
+    uint32_t ptsStatus;     //RGYPtsStatus
+    uint32_t ptsInvalid;    //RGY_PTS_xxx (m_Demux.video.nStreamPtsInvalid)
+    uint32_t picstruct;     //RGY_PICSTRUCT
+    uint32_t flags;         //RGYAvIndexAnalysisFlag
+};
+
+//インデックスを作成した入力ファイルの情報 (一致しない場合はインデックスを使用しない)
+struct RGYAvIndexSource {
+    uint64_t fileSize;
+    int64_t fileTime;       //更新日時
+    int32_t streamIndex;
+    int32_t codecId;
+    int32_t timebaseNum;
+    int32_t timebaseDen;
+};
+
+struct RGYAvIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t frameSize;     //sizeof(RGYAvIndexFrame)
+    uint64_t frameCount;
+    uint64_t fileSize;
+    uint64_t checksum;      //ヘッダ以降のデータのFNV-1a
+    uint32_t flags;         //RGYAvIndexFlag
+    uint32_t reserved;
+    RGYAvIndexSource source;
+    RGYAvIndexAnalysis analysis;
+};
+#pragma pack(pop)
+
+//シーク先
+struct RGYAvIndexSeek {
+    int frameIndex;         //キーフレームのデコード順の位置 (= 先頭からデコードした場合のフレーム番号)
+    int64_t pts;
+    int64_t dts;
+};
+
+//入力ファイルのサイズと更新日時を取得する (ストリームの情報は含まない)
+RGY_ERR rgy_avindex_source(const TCHAR *filename, RGYAvIndexSource *source);
+//--input-indexのファイル名が省略された場合のインデックスのファイル名
+tstring rgy_avindex_default_path(const tstring& inputFile);
+
+class RGYAvIndex {
+public:
+    RGYAvIndex();
+    ~RGYAvIndex();
+
+    //インデックスを読み込む (ファイルはメモリマップし、パケットの一覧はコピーしない)
+    //sourceと一致しない場合はRGY_ERR_INVALID_VERSIONを返す
+    RGY_ERR load(const TCHAR *path, const RGYAvIndexSource& source);
+    //パケットの一覧を設定する
+    void set(const RGYAvIndexSource& source, std::vector<RGYAvIndexFrame>&& frames);
+    //解析結果を設定する
+    void setAnalysis(const RGYAvIndexAnalysis& analysis);
+    //インデックスを保存する
+    RGY_ERR save(const TCHAR *path) const;
+#if ENABLE_AVSW_READER
+    //入力ファイルを読み込んでパケットの一覧を作成する
+    RGY_ERR build(const tstring& filename, const TCHAR *inputFormat, const RGYAvIndexSource& source, std::shared_ptr<RGYLog> log);
+#endif //#if ENABLE_AVSW_READER
+
+    const RGYAvIndexFrame *frames() const { return (m_map) ? m_mapFrames : m_frames.data(); }
+    int frameCount() const { return (m_map) ? m_mapFrameCount : (int)m_frames.size(); }
+    const RGYAvIndexSource& source() const { return m_source; }
+    const RGYAvIndexAnalysis *analysis() const { return (m_flags & RGY_AVINDEX_ANALYSIS_VALID) ? &m_analysis : nullptr; }
+    //同じ条件での解析結果があるか
+    bool hasAnalysis(int analyzeSec, bool detectPulldown) const;
+
+    //trimStart以前の"きれいに切れる"キーフレームを、後ろから最大maxCount個取得する
+    //シークできない (すべてのパケットのptsが有効でない、フィールド単位で符号化されているなど) 場合は空を返す
+    std::vector<RGYAvIndexSeek> seekTargets(int trimStart, int maxCount) const;
+    //ptsのキーフレームが"きれいに切れる"キーフレームならそのデコード順の位置、そうでなければ-1を返す
+    int cleanKeyframeIndex(int64_t pts) const;
+protected:
+    //"きれいに切れる"キーフレームかどうかの一覧を作成する
+    std::vector<bool> cleanKeyframes() const;
+
+    RGYAvIndexSource m_source;
+    RGYAvIndexAnalysis m_analysis;
+    uint32_t m_flags;
+    std::vector<RGYAvIndexFrame> m_frames;
+    std::unique_ptr<RGYFileMapRead> m_map;
+    const RGYAvIndexFrame *m_mapFrames;
+    int m_mapFrameCount;
+};
+
+//擬似的なストリームでインデックスの保存/読み込み/無効化とシーク先の選択を確認し、
+//作成/読み込みにかかる時間をCSVで出力する
+int avindex_bench(FILE *fp);
+
+#endif //__RGY_INPUT_AVINDEX_H__
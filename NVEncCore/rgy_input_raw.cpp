@@ -27,10 +27,65 @@
 
 #include <sstream>
 #include <fcntl.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 #include "rgy_input_raw.h"
 
 #if ENABLE_RAW_READER
 
+//y4mのフレームヘッダ ("FRAME" + パラメータ + '\n') の最大長
+static const int Y4M_FRAME_HEADER_MAX = 5 + 64 + 1;
+//mmap/direct読み込み時のアライメント (ページサイズ/セクタサイズの倍数)
+static const int64_t RAW_READ_ALIGN = 4096;
+
+//y4mのフレームヘッダの長さを返す (不正なヘッダなら-1)
+static int y4m_frame_header_size(const uint8_t *ptr, int64_t size) {
+    if (size < (int64_t)strlen("FRAME") || memcmp(ptr, "FRAME", strlen("FRAME")) != 0) {
+        return -1;
+    }
+    const int len = (int)(std::min<int64_t>)(size, Y4M_FRAME_HEADER_MAX);
+    for (int i = (int)strlen("FRAME"); i < len; i++) {
+        if (ptr[i] == '\n') {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+//mmapした領域のうち、[offset, offset+size)の先読みをOSに要求する
+static void mmap_prefetch(const uint8_t *base, int64_t offset, int64_t size) {
+    const int64_t start = offset & ~(RAW_READ_ALIGN - 1);
+    size += offset - start;
+    if (size <= 0) {
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    //PrefetchVirtualMemoryはWindows 8以降のみなので動的にロードする
+    struct RGYMemoryRangeEntry {
+        void *VirtualAddress;
+        size_t NumberOfBytes;
+    };
+    typedef BOOL(WINAPI *funcPrefetchVirtualMemory)(HANDLE hProcess, ULONG_PTR NumberOfEntries, RGYMemoryRangeEntry *VirtualAddresses, ULONG Flags);
+    static const auto fPrefetchVirtualMemory = (funcPrefetchVirtualMemory)GetProcAddress(GetModuleHandle(_T("kernel32.dll")), "PrefetchVirtualMemory");
+    if (fPrefetchVirtualMemory) {
+        RGYMemoryRangeEntry range = { (void *)(base + start), (size_t)size };
+        fPrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    madvise((void *)(base + start), (size_t)size, MADV_WILLNEED);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+RGYInputRawPrm::RGYInputRawPrm(RGYInputPrm base) :
+    RGYInputPrm(base),
+    readMode(RGY_INPUT_READ_FREAD),
+    readAhead(RGY_INPUT_READ_AHEAD_DEFAULT) {
+
+}
+
 RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
     char *p, *q = nullptr;
 
@@ -152,7 +207,32 @@ RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
 RGYInputRaw::RGYInputRaw() :
     m_fSource(NULL),
     m_nBufSize(0),
-    m_pBuffer() {
+    m_pBuffer(),
+    m_readMode(RGY_INPUT_READ_FREAD),
+    m_readAhead(RGY_INPUT_READ_AHEAD_DEFAULT),
+    m_dataOffset(0),
+    m_fileSize(0),
+    m_readBytes(0),
+    m_tmReadStart(),
+    m_mapPtr(nullptr),
+    m_mapPos(0),
+    m_mapPrefetchPos(0),
+    m_mapReleasePos(0),
+#if defined(_WIN32) || defined(_WIN64)
+    m_hFile(NULL),
+    m_hMap(NULL),
+#else
+    m_fd(-1),
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_readAheadBuf(),
+    m_readAheadBufSize(0),
+    m_thReadAhead(),
+    m_mtxReadAhead(),
+    m_cvReadAhead(),
+    m_readAheadProduced(0),
+    m_readAheadConsumed(0),
+    m_readAheadAbort(false),
+    m_readAheadError(false) {
     m_strReaderName = _T("raw");
 }
 
@@ -161,6 +241,56 @@ RGYInputRaw::~RGYInputRaw() {
 }
 
 void RGYInputRaw::Close() {
+    if (m_thReadAhead.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtxReadAhead);
+            m_readAheadAbort = true;
+        }
+        m_cvReadAhead.notify_all();
+        m_thReadAhead.join();
+    }
+    m_readAheadBuf.clear();
+    m_readAheadBufSize = 0;
+    m_readAheadProduced = 0;
+    m_readAheadConsumed = 0;
+    m_readAheadAbort = false;
+    m_readAheadError = false;
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_mapPtr) {
+        UnmapViewOfFile(m_mapPtr);
+    }
+    if (m_hMap) {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+    }
+    if (m_hFile) {
+        CloseHandle(m_hFile);
+        m_hFile = NULL;
+    }
+#else
+    if (m_mapPtr) {
+        munmap((void *)m_mapPtr, (size_t)m_fileSize);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapPtr = nullptr;
+    m_mapPos = 0;
+    m_mapPrefetchPos = 0;
+    m_mapReleasePos = 0;
+    m_fileSize = 0;
+    m_dataOffset = 0;
+    if (m_readBytes > 0) {
+        const double sec = std::chrono::duration<double>(std::chrono::system_clock::now() - m_tmReadStart).count();
+        AddMessage(RGY_LOG_DEBUG, _T("%s: read %.2f GB, %.3f GB/s.\n"),
+            get_chr_from_value(list_input_read_mode, m_readMode),
+            m_readBytes / (double)(1024 * 1024 * 1024),
+            (sec > 0.0) ? m_readBytes / (double)(1024 * 1024 * 1024) / sec : 0.0);
+        m_readBytes = 0;
+    }
+    m_readMode = RGY_INPUT_READ_FREAD;
     if (m_fSource) {
         fclose(m_fSource);
         m_fSource = NULL;
@@ -170,6 +300,181 @@ void RGYInputRaw::Close() {
     RGYInput::Close();
 }
 
+RGY_ERR RGYInputRaw::InitMmap(const TCHAR *strFileName) {
+#if defined(_WIN32) || defined(_WIN64)
+    m_hFile = CreateFile(strFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE) {
+        m_hFile = NULL;
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to open file \"%s\".\n"), strFileName);
+        return RGY_ERR_FILE_OPEN;
+    }
+    LARGE_INTEGER fileSize = { 0 };
+    if (!GetFileSizeEx(m_hFile, &fileSize)) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to get file size.\n"));
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fileSize = fileSize.QuadPart;
+    if ((uint64_t)m_fileSize > (uint64_t)SIZE_MAX) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: file too large to map in this process.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_hMap = CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_hMap == NULL) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to create file mapping.\n"));
+        return RGY_ERR_NULL_PTR;
+    }
+    m_mapPtr = (const uint8_t *)MapViewOfFile(m_hMap, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_fd = open(strFileName, O_RDONLY);
+    if (m_fd < 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to open file \"%s\".\n"), strFileName);
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to get file size.\n"));
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fileSize = st.st_size;
+    void *ptr = (m_fileSize > 0) ? mmap(nullptr, (size_t)m_fileSize, PROT_READ, MAP_SHARED, m_fd, 0) : MAP_FAILED;
+    if (ptr != MAP_FAILED) {
+        madvise(ptr, (size_t)m_fileSize, MADV_SEQUENTIAL);
+        m_mapPtr = (const uint8_t *)ptr;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    if (m_mapPtr == nullptr) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: failed to map file.\n"));
+        return RGY_ERR_NULL_PTR;
+    }
+    m_mapPos = m_dataOffset;
+    m_mapPrefetchPos = m_dataOffset;
+    m_mapReleasePos = 0;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputRaw::InitDirect(const TCHAR *strFileName) {
+#if defined(_WIN32) || defined(_WIN64)
+    m_hFile = CreateFile(strFileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE) {
+        m_hFile = NULL;
+        AddMessage(RGY_LOG_DEBUG, _T("direct: failed to open file \"%s\".\n"), strFileName);
+        return RGY_ERR_FILE_OPEN;
+    }
+    LARGE_INTEGER fileSize = { 0 };
+    if (!GetFileSizeEx(m_hFile, &fileSize)) {
+        AddMessage(RGY_LOG_DEBUG, _T("direct: failed to get file size.\n"));
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fileSize = fileSize.QuadPart;
+#else
+    m_fd = open(strFileName, O_RDONLY | O_DIRECT);
+    if (m_fd < 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("direct: failed to open file \"%s\".\n"), strFileName);
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("direct: failed to get file size.\n"));
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fileSize = st.st_size;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    //フレームの先頭がアライメントされているとは限らないので、前後に1ブロックずつ余裕をもたせる
+    const size_t readSize = m_nBufSize + ((m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) ? Y4M_FRAME_HEADER_MAX : 0);
+    m_readAheadBufSize = (size_t)ALIGN((int64_t)readSize, RAW_READ_ALIGN) + (size_t)RAW_READ_ALIGN;
+    m_readAheadBuf.resize(m_readAhead);
+    for (auto& buf : m_readAheadBuf) {
+        buf.buf = std::unique_ptr<uint8_t, aligned_malloc_deleter>((uint8_t *)_aligned_malloc(m_readAheadBufSize, (size_t)RAW_READ_ALIGN), aligned_malloc_deleter());
+        buf.frame = nullptr;
+        if (!buf.buf) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate read-ahead buffer.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
+    }
+    m_readAheadProduced = 0;
+    m_readAheadConsumed = 0;
+    m_readAheadAbort = false;
+    m_readAheadError = false;
+    m_thReadAhead = std::thread(&RGYInputRaw::ReadAheadThreadFunc, this);
+    return RGY_ERR_NONE;
+}
+
+int64_t RGYInputRaw::ReadDirect(uint8_t *buf, int64_t offset, size_t size) {
+#if defined(_WIN32) || defined(_WIN64)
+    OVERLAPPED ov = { 0 };
+    ov.Offset = (DWORD)(offset & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD readBytes = 0;
+    if (!ReadFile(m_hFile, buf, (DWORD)size, &readBytes, &ov)) {
+        return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+    }
+    return readBytes;
+#else
+    size_t total = 0;
+    while (total < size) {
+        const auto ret = pread(m_fd, buf + total, size - total, (off_t)(offset + total));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    return (int64_t)total;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+void RGYInputRaw::ReadAheadThreadFunc() {
+    const bool y4m = m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M;
+    const int64_t readSize = m_nBufSize + ((y4m) ? Y4M_FRAME_HEADER_MAX : 0);
+    int64_t pos = m_dataOffset;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mtxReadAhead);
+            m_cvReadAhead.wait(lock, [&]() {
+                return m_readAheadAbort || m_readAheadProduced - m_readAheadConsumed < (int64_t)m_readAheadBuf.size();
+            });
+            if (m_readAheadAbort) {
+                return;
+            }
+        }
+        //空いているバッファに、アライメントした位置から読み込む
+        auto& ahead = m_readAheadBuf[m_readAheadProduced % m_readAheadBuf.size()];
+        ahead.frame = nullptr;
+        const int64_t alignedPos = pos & ~(RAW_READ_ALIGN - 1);
+        const int64_t headSkip = pos - alignedPos;
+        const int64_t readBytes = ReadDirect(ahead.buf.get(), alignedPos, (size_t)ALIGN(headSkip + readSize, RAW_READ_ALIGN));
+        if (readBytes > headSkip) {
+            const uint8_t *ptr = ahead.buf.get() + headSkip;
+            int64_t remain = readBytes - headSkip;
+            if (y4m) {
+                const int headerSize = y4m_frame_header_size(ptr, remain);
+                ptr += (std::max)(headerSize, 0);
+                remain = (headerSize < 0) ? 0 : remain - headerSize;
+                pos += (std::max)(headerSize, 0);
+            }
+            if (remain >= (int64_t)m_nBufSize) {
+                ahead.frame = ptr;
+                pos += m_nBufSize;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtxReadAhead);
+            m_readAheadError = readBytes < 0;
+            m_readAheadProduced++;
+        }
+        m_cvReadAhead.notify_all();
+        if (ahead.frame == nullptr) {
+            return; //ファイル終端 or エラー
+        }
+    }
+}
+
 RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) {
     memcpy(&m_inputVideoInfo, pInputInfo, sizeof(m_inputVideoInfo));
 
@@ -288,10 +593,33 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         m_inputVideoInfo.csp = output_csp_if_lossless;
     }
 
-    m_pBuffer = std::shared_ptr<uint8_t>((uint8_t *)_aligned_malloc(bufferSize, 32), aligned_malloc_deleter());
-    if (!m_pBuffer) {
-        AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
-        return RGY_ERR_NULL_PTR;
+    m_nBufSize = bufferSize;
+
+    const auto prmRaw = dynamic_cast<const RGYInputRawPrm *>(prm);
+    m_readMode = (prmRaw) ? prmRaw->readMode : RGY_INPUT_READ_FREAD;
+    m_readAhead = (prmRaw) ? clamp(prmRaw->readAhead, 1, RGY_INPUT_READ_AHEAD_MAX) : RGY_INPUT_READ_AHEAD_DEFAULT;
+    if (m_readMode != RGY_INPUT_READ_FREAD) {
+        if (use_stdin) {
+            AddMessage(RGY_LOG_WARN, _T("%s read is not supported for stdin, switching to fread.\n"), get_chr_from_value(list_input_read_mode, m_readMode));
+            m_readMode = RGY_INPUT_READ_FREAD;
+        } else {
+            //ここまでfreadで読んだ分 (y4mのストリームヘッダ) は飛ばす
+            m_dataOffset = _ftelli64(m_fSource);
+            const auto sts = (m_readMode == RGY_INPUT_READ_MMAP) ? InitMmap(strFileName) : InitDirect(strFileName);
+            if (sts != RGY_ERR_NONE) {
+                AddMessage(RGY_LOG_WARN, _T("failed to init %s read, switching to fread.\n"), get_chr_from_value(list_input_read_mode, m_readMode));
+                m_readMode = RGY_INPUT_READ_FREAD;
+            }
+        }
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("read mode: %s, read ahead %d frames.\n"), get_chr_from_value(list_input_read_mode, m_readMode), m_readAhead);
+
+    if (m_readMode == RGY_INPUT_READ_FREAD) {
+        m_pBuffer = std::shared_ptr<uint8_t>((uint8_t *)_aligned_malloc(bufferSize, 32), aligned_malloc_deleter());
+        if (!m_pBuffer) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
     }
 
     m_inputVideoInfo.shift = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
@@ -308,75 +636,108 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     return RGY_ERR_NONE;
 }
 
-RGY_ERR RGYInputRaw::LoadNextFrame(RGYFrame *pSurface) {
-    //m_pEncSatusInfo->m_nInputFramesがtrimの結果必要なフレーム数を大きく超えたら、エンコードを打ち切る
-    //ちょうどのところで打ち切ると他のストリームに影響があるかもしれないので、余分に取得しておく
-    if (getVideoTrimMaxFramIdx() < (int)m_pEncSatusInfo->m_sData.frameIn - TRIM_OVERREAD_FRAMES) {
-        return RGY_ERR_MORE_DATA;
-    }
-
+const uint8_t *RGYInputRaw::GetNextFrameFread() {
     if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
         uint8_t y4m_buf[8] = { 0 };
         if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fSource) != strlen("FRAME")) {
             AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
-            return RGY_ERR_MORE_DATA;
+            return nullptr;
         }
         if (memcmp(y4m_buf, "FRAME", strlen("FRAME")) != 0) {
             AddMessage(RGY_LOG_DEBUG, _T("header2: finish.\n"));
-            return RGY_ERR_MORE_DATA;
+            return nullptr;
         }
         int i;
         for (i = 0; _fgetc_nolock(m_fSource) != '\n'; i++) {
             if (i >= 64) {
                 AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
-                return RGY_ERR_MORE_DATA;
+                return nullptr;
             }
         }
     }
+    if (m_nBufSize != _fread_nolock(m_pBuffer.get(), 1, m_nBufSize, m_fSource)) {
+        AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), m_nBufSize);
+        return nullptr;
+    }
+    return m_pBuffer.get();
+}
 
-    uint32_t frameSize = 0;
-    switch (m_sConvert->getFunc()->csp_from) {
-    case RGY_CSP_NV12:
-    case RGY_CSP_YV12:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3 / 2; break;
-    case RGY_CSP_P010:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 2; break;
-    case RGY_CSP_YUV444:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YV12_09:
-    case RGY_CSP_YV12_10:
-    case RGY_CSP_YV12_12:
-    case RGY_CSP_YV12_14:
-    case RGY_CSP_YV12_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422_09:
-    case RGY_CSP_YUV422_10:
-    case RGY_CSP_YUV422_12:
-    case RGY_CSP_YUV422_14:
-    case RGY_CSP_YUV422_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 4; break;
-    case RGY_CSP_YUV444_09:
-    case RGY_CSP_YUV444_10:
-    case RGY_CSP_YUV444_12:
-    case RGY_CSP_YUV444_14:
-    case RGY_CSP_YUV444_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 6; break;
-    default:
-        AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
-        return RGY_ERR_INVALID_COLOR_FORMAT;
+const uint8_t *RGYInputRaw::GetNextFrameMmap() {
+    int64_t pos = m_mapPos;
+    int frameHeaderSize = 0;
+    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
+        if ((frameHeaderSize = y4m_frame_header_size(m_mapPtr + pos, m_fileSize - pos)) < 0) {
+            AddMessage(RGY_LOG_DEBUG, _T("header: finish.\n"));
+            return nullptr;
+        }
+        pos += frameHeaderSize;
     }
-    if (frameSize != _fread_nolock(m_pBuffer.get(), 1, frameSize, m_fSource)) {
-        AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), frameSize);
+    if (pos + (int64_t)m_nBufSize > m_fileSize) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: finish: %d.\n"), m_nBufSize);
+        return nullptr;
+    }
+    m_mapPos = pos + m_nBufSize;
+
+    //指定フレーム数分先まで先読みを要求しておく
+    const int64_t prefetchEnd = (std::min)(m_fileSize, m_mapPos + (m_nBufSize + frameHeaderSize) * (int64_t)m_readAhead);
+    if (prefetchEnd > m_mapPrefetchPos) {
+        mmap_prefetch(m_mapPtr, m_mapPrefetchPos, prefetchEnd - m_mapPrefetchPos);
+        m_mapPrefetchPos = prefetchEnd;
+    }
+#if !(defined(_WIN32) || defined(_WIN64))
+    //変換済みのフレームのページはマップから外し、メモリ使用量が増え続けないようにする
+    const int64_t releaseEnd = pos & ~(RAW_READ_ALIGN - 1);
+    if (releaseEnd > m_mapReleasePos) {
+        madvise((void *)(m_mapPtr + m_mapReleasePos), (size_t)(releaseEnd - m_mapReleasePos), MADV_DONTNEED);
+        m_mapReleasePos = releaseEnd;
+    }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    return m_mapPtr + pos;
+}
+
+const uint8_t *RGYInputRaw::GetNextFrameDirect() {
+    std::unique_lock<std::mutex> lock(m_mtxReadAhead);
+    m_cvReadAhead.wait(lock, [&]() { return m_readAheadProduced > m_readAheadConsumed; });
+    const auto& ahead = m_readAheadBuf[m_readAheadConsumed % m_readAheadBuf.size()];
+    if (ahead.frame == nullptr) {
+        if (m_readAheadError) {
+            AddMessage(RGY_LOG_ERROR, _T("direct: failed to read file.\n"));
+        } else {
+            AddMessage(RGY_LOG_DEBUG, _T("direct: finish: %d.\n"), m_nBufSize);
+        }
+    }
+    return ahead.frame;
+}
+
+RGY_ERR RGYInputRaw::LoadNextFrame(RGYFrame *pSurface) {
+    //m_pEncSatusInfo->m_nInputFramesがtrimの結果必要なフレーム数を大きく超えたら、エンコードを打ち切る
+    //ちょうどのところで打ち切ると他のストリームに影響があるかもしれないので、余分に取得しておく
+    if (getVideoTrimMaxFramIdx() < (int)m_pEncSatusInfo->m_sData.frameIn - TRIM_OVERREAD_FRAMES) {
         return RGY_ERR_MORE_DATA;
     }
 
+    //mmap/directの場合は、読み込んだ領域から直接変換する
+    const uint8_t *frameData = nullptr;
+    switch (m_readMode) {
+    case RGY_INPUT_READ_MMAP:   frameData = GetNextFrameMmap(); break;
+    case RGY_INPUT_READ_DIRECT: frameData = GetNextFrameDirect(); break;
+    case RGY_INPUT_READ_FREAD:
+    default:                    frameData = GetNextFrameFread(); break;
+    }
+    if (frameData == nullptr) {
+        return RGY_ERR_MORE_DATA;
+    }
+    if (m_readBytes == 0) {
+        m_tmReadStart = std::chrono::system_clock::now();
+    }
+    m_readBytes += m_nBufSize;
+    m_pEncSatusInfo->AddInputBytes(m_nBufSize);
+
     void *dst_array[3];
     pSurface->ptrArray(dst_array, m_sConvert->getFunc()->csp_to == RGY_CSP_RGB24 || m_sConvert->getFunc()->csp_to == RGY_CSP_RGB32);
 
     const void *src_array[3];
-    src_array[0] = m_pBuffer.get();
+    src_array[0] = frameData;
     src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
     switch (m_sConvert->getFunc()->csp_from) {
     case RGY_CSP_YV12:
@@ -428,6 +789,14 @@ RGY_ERR RGYInputRaw::LoadNextFrame(RGYFrame *pSurface) {
         dst_array, src_array, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcPitch,
         src_uv_pitch, pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
 
+    if (m_readMode == RGY_INPUT_READ_DIRECT) {
+        //変換が終わったので、先読みバッファを返却する
+        {
+            std::lock_guard<std::mutex> lock(m_mtxReadAhead);
+            m_readAheadConsumed++;
+        }
+        m_cvReadAhead.notify_all();
+    }
     m_pEncSatusInfo->m_sData.frameIn++;
     return m_pEncSatusInfo->UpdateDisplay();
 }
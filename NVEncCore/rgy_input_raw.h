@@ -29,10 +29,28 @@
 #ifndef __RGY_INPUT_RAW_H__
 #define __RGY_INPUT_RAW_H__
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "rgy_input.h"
 
 #if ENABLE_RAW_READER
 
+class RGYInputRawPrm : public RGYInputPrm {
+public:
+    RGYInputReadMode readMode; //読み込み方法
+    int readAhead;             //mmap/direct時に先読みするフレーム数
+
+    RGYInputRawPrm(RGYInputPrm base);
+    virtual ~RGYInputRawPrm() {};
+};
+
+//direct読み込み時の先読みバッファ
+struct RGYInputRawReadAheadBuf {
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> buf;
+    const uint8_t *frame; //buf内のフレームデータの先頭 (nullptrならファイル終端)
+};
+
 class RGYInputRaw : public RGYInput {
 public:
     RGYInputRaw();
@@ -45,10 +63,48 @@ protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) override;
     RGY_ERR ParseY4MHeader(char *buf, VideoInfo *pInfo);
 
+    RGY_ERR InitMmap(const TCHAR *strFileName);
+    RGY_ERR InitDirect(const TCHAR *strFileName);
+    const uint8_t *GetNextFrameFread();
+    const uint8_t *GetNextFrameMmap();
+    const uint8_t *GetNextFrameDirect();
+    int64_t ReadDirect(uint8_t *buf, int64_t offset, size_t size);
+    void ReadAheadThreadFunc();
+
     FILE *m_fSource;
 
     uint32_t m_nBufSize;
     shared_ptr<uint8_t> m_pBuffer;
+
+    RGYInputReadMode m_readMode;
+    int m_readAhead;
+    int64_t m_dataOffset;      //y4mのストリームヘッダを除いた最初のフレームの位置
+    int64_t m_fileSize;
+    uint64_t m_readBytes;      //読み込んだフレームデータの総バイト数
+    std::chrono::system_clock::time_point m_tmReadStart;
+
+    //mmap
+    const uint8_t *m_mapPtr;
+    int64_t m_mapPos;          //次のフレーム(y4mならフレームヘッダ)の位置
+    int64_t m_mapPrefetchPos;  //ここまでのページは先読みを要求済み
+    int64_t m_mapReleasePos;   //ここまでのページは解放済み
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_hFile;
+    HANDLE m_hMap;
+#else
+    int m_fd;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    //direct
+    std::vector<RGYInputRawReadAheadBuf> m_readAheadBuf;
+    size_t m_readAheadBufSize;
+    std::thread m_thReadAhead;
+    std::mutex m_mtxReadAhead;
+    std::condition_variable m_cvReadAhead;
+    int64_t m_readAheadProduced;
+    int64_t m_readAheadConsumed;
+    bool m_readAheadAbort;
+    bool m_readAheadError;
 };
 
 #endif //ENABLE_RAW_READER
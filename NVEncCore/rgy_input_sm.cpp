@@ -0,0 +1,205 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include "rgy_input_sm.h"
+
+#if ENABLE_SM_READER
+
+RGYInputSM::RGYInputSM() :
+    m_ring(),
+    m_frameBytes(0) {
+    m_strReaderName = _T("sm");
+}
+
+RGYInputSM::~RGYInputSM() {
+    Close();
+}
+
+void RGYInputSM::Close() {
+    AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
+    m_ring.close();
+    m_frameBytes = 0;
+    RGYInput::Close();
+    AddMessage(RGY_LOG_DEBUG, _T("Closed.\n"));
+}
+
+RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) {
+    memcpy(&m_inputVideoInfo, pInputInfo, sizeof(m_inputVideoInfo));
+
+    m_sConvert = std::make_unique<RGYConvertCSP>(prm->threadCsp);
+
+    auto sts = m_ring.open(strFileName);
+    if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to open shared memory \"%s\": %s.\n"), strFileName, get_err_mes(sts));
+        return sts;
+    }
+    const auto header = m_ring.header();
+    AddMessage(RGY_LOG_DEBUG, _T("Opened shared memory \"%s\": %d slots, slot size %llu, producer pid %u.\n"),
+        strFileName, header->slotCount, (unsigned long long)header->slotSize, header->producerPid);
+
+    m_InputCsp = (RGY_CSP)header->csp;
+    m_inputVideoInfo.srcWidth = header->width;
+    m_inputVideoInfo.srcHeight = header->height;
+    m_inputVideoInfo.srcPitch = header->planePitch[0];
+    //コマンドラインでの指定を優先する
+    if (m_inputVideoInfo.fpsN <= 0 || m_inputVideoInfo.fpsD <= 0) {
+        m_inputVideoInfo.fpsN = header->fpsN;
+        m_inputVideoInfo.fpsD = header->fpsD;
+    }
+    if (m_inputVideoInfo.sar[0] <= 0 || m_inputVideoInfo.sar[1] <= 0) {
+        m_inputVideoInfo.sar[0] = header->sar[0];
+        m_inputVideoInfo.sar[1] = header->sar[1];
+    }
+    if (m_inputVideoInfo.picstruct == RGY_PICSTRUCT_UNKNOWN) {
+        m_inputVideoInfo.picstruct = (RGY_PICSTRUCT)header->picstruct;
+    }
+    m_inputVideoInfo.frames = 0;
+    rgy_reduce(m_inputVideoInfo.fpsN, m_inputVideoInfo.fpsD);
+
+    auto nOutputCSP = m_inputVideoInfo.csp;
+    RGY_CSP output_csp_if_lossless = RGY_CSP_NA;
+    switch (m_InputCsp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_YV12:
+        output_csp_if_lossless = RGY_CSP_NV12;
+        break;
+    case RGY_CSP_P010:
+    case RGY_CSP_YV12_09:
+    case RGY_CSP_YV12_10:
+    case RGY_CSP_YV12_12:
+    case RGY_CSP_YV12_14:
+    case RGY_CSP_YV12_16:
+        output_csp_if_lossless = RGY_CSP_P010;
+        break;
+    case RGY_CSP_YUV422:
+        if (ENCODER_VCEENC) {
+            AddMessage(RGY_LOG_ERROR, _T("yuv422 not supported as input color format."));
+            return RGY_ERR_INVALID_FORMAT;
+        }
+        //yuv422読み込みは、出力フォーマットへの直接変換を持たないのでNV16に変換する
+        nOutputCSP = RGY_CSP_NV16;
+        output_csp_if_lossless = RGY_CSP_YUV444;
+        break;
+    case RGY_CSP_YUV422_09:
+    case RGY_CSP_YUV422_10:
+    case RGY_CSP_YUV422_12:
+    case RGY_CSP_YUV422_14:
+    case RGY_CSP_YUV422_16:
+        if (ENCODER_VCEENC) {
+            AddMessage(RGY_LOG_ERROR, _T("yuv422 not supported as input color format."));
+            return RGY_ERR_INVALID_FORMAT;
+        }
+        //yuv422読み込みは、出力フォーマットへの直接変換を持たないのでP210に変換する
+        nOutputCSP = RGY_CSP_P210;
+        //m_inputVideoInfo.shiftも出力フォーマットに対応する値でなく入力フォーマットに対するものに
+        m_inputVideoInfo.shift = 16 - RGY_CSP_BIT_DEPTH[m_InputCsp];
+        output_csp_if_lossless = RGY_CSP_YUV444_16;
+        break;
+    case RGY_CSP_YUV444:
+        output_csp_if_lossless = RGY_CSP_YUV444;
+        break;
+    case RGY_CSP_YUV444_09:
+    case RGY_CSP_YUV444_10:
+    case RGY_CSP_YUV444_12:
+    case RGY_CSP_YUV444_14:
+    case RGY_CSP_YUV444_16:
+        output_csp_if_lossless = RGY_CSP_YUV444_16;
+        break;
+    default:
+        AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
+    //ステータス表示用の読み込みバイト数は、ピッチの余白を含めない
+    m_frameBytes = (uint32_t)(m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * RGY_CSP_BIT_PER_PIXEL[m_InputCsp] / 8);
+    AddMessage(RGY_LOG_DEBUG, _T("%dx%d, pitch:%d, %s.\n"), m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcPitch, RGY_CSP_NAMES[m_InputCsp]);
+
+    if (nOutputCSP != RGY_CSP_NA) {
+        m_inputVideoInfo.csp =
+            (ENCODER_NVENC
+                && RGY_CSP_BIT_PER_PIXEL[m_InputCsp] < RGY_CSP_BIT_PER_PIXEL[nOutputCSP])
+            ? output_csp_if_lossless : nOutputCSP;
+    } else {
+        //ロスレスの場合は、入力側で出力フォーマットを決める
+        m_inputVideoInfo.csp = output_csp_if_lossless;
+    }
+
+    m_inputVideoInfo.shift = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
+
+    if (m_sConvert->getFunc(m_InputCsp, m_inputVideoInfo.csp, false, prm->simdCsp) == nullptr) {
+        AddMessage(RGY_LOG_ERROR, _T("sm: color conversion not supported: %s -> %s.\n"),
+            RGY_CSP_NAMES[m_InputCsp], RGY_CSP_NAMES[m_inputVideoInfo.csp]);
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
+
+    CreateInputInfo(m_strReaderName.c_str(), RGY_CSP_NAMES[m_sConvert->getFunc()->csp_from], RGY_CSP_NAMES[m_sConvert->getFunc()->csp_to], get_simd_str(m_sConvert->getFunc()->simd), &m_inputVideoInfo);
+    AddMessage(RGY_LOG_DEBUG, m_strInputInfo);
+    *pInputInfo = m_inputVideoInfo;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputSM::LoadNextFrame(RGYFrame *pSurface) {
+    //m_pEncSatusInfo->m_nInputFramesがtrimの結果必要なフレーム数を大きく超えたら、エンコードを打ち切る
+    //ちょうどのところで打ち切ると他のストリームに影響があるかもしれないので、余分に取得しておく
+    if (getVideoTrimMaxFramIdx() < (int)m_pEncSatusInfo->m_sData.frameIn - TRIM_OVERREAD_FRAMES) {
+        return RGY_ERR_MORE_DATA;
+    }
+
+    const uint8_t *planes[3] = { nullptr, nullptr, nullptr };
+    RGYSMRingSlotInfo slotInfo;
+    const auto sts = m_ring.waitFrame(planes, &slotInfo);
+    if (sts == RGY_ERR_MORE_DATA) {
+        AddMessage(RGY_LOG_DEBUG, _T("sm: finish.\n"));
+        return RGY_ERR_MORE_DATA;
+    } else if (sts != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("sm: producer aborted.\n"));
+        return sts;
+    }
+
+    const auto picstruct = rgy_sm_slot_picstruct(slotInfo, m_inputVideoInfo.picstruct);
+
+    //スロットから直接変換する
+    void *dst_array[3];
+    pSurface->ptrArray(dst_array, m_sConvert->getFunc()->csp_to == RGY_CSP_RGB24 || m_sConvert->getFunc()->csp_to == RGY_CSP_RGB32);
+    const void *src_array[3] = { planes[0], planes[1], planes[2] };
+    const auto header = m_ring.header();
+    m_sConvert->run((picstruct & RGY_PICSTRUCT_INTERLACED) ? 1 : 0,
+        dst_array, src_array, m_inputVideoInfo.srcWidth, header->planePitch[0],
+        header->planePitch[1], pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
+
+    pSurface->setTimestamp(slotInfo.timestamp);
+    pSurface->setDuration(slotInfo.duration);
+    pSurface->setPicstruct(picstruct);
+
+    //変換が終わったので、スロットを返却する
+    m_ring.releaseFrame();
+
+    m_pEncSatusInfo->AddInputBytes(m_frameBytes);
+    m_pEncSatusInfo->m_sData.frameIn++;
+    return m_pEncSatusInfo->UpdateDisplay();
+}
+
+#endif //ENABLE_SM_READER
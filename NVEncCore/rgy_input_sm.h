@@ -0,0 +1,56 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_INPUT_SM_H__
+#define __RGY_INPUT_SM_H__
+
+#include "rgy_input.h"
+#include "rgy_shared_mem.h"
+
+#if ENABLE_SM_READER
+
+//共有メモリのリング (RGYSharedMemRing) からフレームを読み込む
+//入力ファイル名として、producerが作成した共有メモリの名前を指定する
+class RGYInputSM : public RGYInput {
+public:
+    RGYInputSM();
+    virtual ~RGYInputSM();
+
+    virtual RGY_ERR LoadNextFrame(RGYFrame *pSurface) override;
+    virtual void Close() override;
+
+protected:
+    virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) override;
+
+    RGYSharedMemRing m_ring;
+    uint32_t m_frameBytes;     //1フレームあたりの有効なデータ量 (ピッチの余白を除く)
+};
+
+#endif //ENABLE_SM_READER
+
+#endif //__RGY_INPUT_SM_H__
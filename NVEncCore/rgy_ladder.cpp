@@ -0,0 +1,409 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "rgy_ladder.h"
+
+RGYLadderFanout::RGYLadderFanout() :
+    m_depth(0), m_rungs(), m_encode(), m_flush(), m_mtx(), m_cvQueued(), m_cvFree(), m_eos(false), m_err(RGY_ERR_NONE) {
+}
+
+RGYLadderFanout::~RGYLadderFanout() {
+    bool running = false;
+    for (const auto& r : m_rungs) {
+        running |= r.thread.joinable();
+    }
+    if (running) {
+        abort(RGY_ERR_ABORTED);
+        finish();
+    }
+}
+
+RGY_ERR RGYLadderFanout::init(int rungs, int depth) {
+    if (rungs <= 0 || rungs > RGY_LADDER_MAX_RUNGS || depth <= 0 || depth > RGY_LADDER_QUEUE_MAX) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    m_depth = depth;
+    m_rungs = std::vector<Rung>(rungs);
+    for (auto& r : m_rungs) {
+        //pop_backで0番から使用する
+        for (int i = depth - 1; i >= 0; i--) {
+            r.free.push_back(i);
+        }
+        r.stat = { 0, 0, 0 };
+    }
+    m_eos = false;
+    m_err = RGY_ERR_NONE;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYLadderFanout::start(FrameFunc encode, FlushFunc flush) {
+    if (m_rungs.size() == 0 || !encode) {
+        return RGY_ERR_NOT_INITIALIZED;
+    }
+    m_encode = encode;
+    m_flush = flush;
+    for (int i = 0; i < (int)m_rungs.size(); i++) {
+        m_rungs[i].thread = std::thread(&RGYLadderFanout::run, this, i);
+    }
+    return RGY_ERR_NONE;
+}
+
+void RGYLadderFanout::run(int rung) {
+    auto& r = m_rungs[rung];
+    for (;;) {
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvQueued.wait(lock, [&]() { return r.queued.size() > 0 || m_eos || m_err != RGY_ERR_NONE; });
+            if (m_err != RGY_ERR_NONE) {
+                return;
+            }
+            if (r.queued.size() == 0) {
+                break; //m_eos
+            }
+            //エンコードが終わるまではキューに残しておく (キューの使用量に含める)
+            slot = r.queued.front();
+        }
+        const auto err = m_encode(rung, slot);
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            r.queued.pop_front();
+            r.free.push_back(slot);
+            r.stat.frames++;
+        }
+        m_cvFree.notify_all();
+        if (err != RGY_ERR_NONE) {
+            abort(err);
+            return;
+        }
+    }
+    if (m_flush) {
+        const auto err = m_flush(rung);
+        if (err != RGY_ERR_NONE) {
+            abort(err);
+        }
+    }
+}
+
+RGY_ERR RGYLadderFanout::send(FrameFunc prepare) {
+    for (int i = 0; i < (int)m_rungs.size(); i++) {
+        auto& r = m_rungs[i];
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (r.free.size() == 0 && m_err == RGY_ERR_NONE) {
+                const auto waitStart = std::chrono::steady_clock::now();
+                m_cvFree.wait(lock, [&]() { return r.free.size() > 0 || m_err != RGY_ERR_NONE; });
+                r.stat.waitUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+            }
+            if (m_err != RGY_ERR_NONE) {
+                return m_err;
+            }
+            slot = r.free.back();
+            r.free.pop_back();
+        }
+        const auto err = prepare(i, slot);
+        if (err != RGY_ERR_NONE) {
+            abort(err);
+            return err;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            r.queued.push_back(slot);
+            r.stat.maxQueued = std::max(r.stat.maxQueued, (int)r.queued.size());
+        }
+        m_cvQueued.notify_all();
+    }
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYLadderFanout::finish() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_eos = true;
+    }
+    m_cvQueued.notify_all();
+    for (auto& r : m_rungs) {
+        if (r.thread.joinable()) {
+            r.thread.join();
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_err;
+}
+
+void RGYLadderFanout::abort(RGY_ERR err) {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_err == RGY_ERR_NONE) {
+            m_err = (err != RGY_ERR_NONE) ? err : RGY_ERR_ABORTED;
+        }
+    }
+    m_cvQueued.notify_all();
+    m_cvFree.notify_all();
+}
+
+RGYLadderRungStat RGYLadderFanout::stat(int rung) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_rungs[rung].stat;
+}
+
+void ladder_close_outputs(int rungs, std::function<void()> parentWaitFin, std::function<void(int rung)> rungClose, std::function<void()> parentClose) {
+    parentWaitFin();
+    for (int i = 0; i < rungs; i++) {
+        rungClose(i);
+    }
+    parentClose();
+}
+
+//疑似的なエンコーダ
+//スロットに書き込まれたフレーム番号を段ごとに記録し、段の番号に応じた時間をかけてエンコードしたことにする
+struct LadderBenchRung {
+    std::vector<int> slotFrame;            //スロットに書き込まれたフレーム番号
+    std::unique_ptr<std::atomic<bool>[]> slotInUse;
+    std::vector<int> encoded;              //エンコードしたフレーム番号 (段のスレッドのみが使用)
+    std::atomic<int> outstanding;          //書き込んだがエンコードしていないフレーム数
+    std::atomic<int> maxOutstanding;
+    std::atomic<int> flushed;
+    bool slotError;
+
+    LadderBenchRung(int depth) : slotFrame(depth, -1), slotInUse(new std::atomic<bool>[depth]), encoded(),
+        outstanding(0), maxOutstanding(0), flushed(0), slotError(false) {
+        for (int i = 0; i < depth; i++) {
+            slotInUse[i] = false;
+        }
+    }
+};
+
+static uint32_t ladder_bench_work(int count, uint32_t seed) {
+    uint32_t work = seed;
+    for (int i = 0; i < count; i++) {
+        work = work * 1664525u + 1013904223u;
+    }
+    return work;
+}
+
+struct LadderBenchResult {
+    RGY_ERR sendErr;
+    RGY_ERR finishErr;
+    int sent;
+    double timeMs;
+    int maxQueued;
+    double waitMs;
+    bool ok;
+};
+
+//errRung/errFrameで指定したフレームのエンコードをエラーにする (errPrepareならスロットへの書き込みをエラーにする)
+static LadderBenchResult ladder_bench_run(int rungs, int depth, int frames, int workPerFrame, int errRung, int errFrame, bool errPrepare) {
+    std::vector<std::unique_ptr<LadderBenchRung>> mock;
+    for (int i = 0; i < rungs; i++) {
+        mock.push_back(std::unique_ptr<LadderBenchRung>(new LadderBenchRung(depth)));
+    }
+    std::atomic<uint32_t> sink(0);
+    LadderBenchResult result = { RGY_ERR_NONE, RGY_ERR_NONE, 0, 0.0, 0, 0.0, false };
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    RGYLadderFanout ladder;
+    if (ladder.init(rungs, depth) != RGY_ERR_NONE) {
+        return result;
+    }
+    ladder.start([&](int rung, int slot) {
+        auto& m = *mock[rung];
+        const int frame = m.slotFrame[slot];
+        if (!m.slotInUse[slot].load()) {
+            m.slotError = true;
+        }
+        //下の段ほど低解像度を想定し、上の段(rung=0)を最も遅くする
+        sink += ladder_bench_work(workPerFrame * (rungs - rung), (uint32_t)frame);
+        m.encoded.push_back(frame);
+        m.slotInUse[slot] = false;
+        m.outstanding--;
+        if (!errPrepare && rung == errRung && frame == errFrame) {
+            return RGY_ERR_UNKNOWN;
+        }
+        return RGY_ERR_NONE;
+    }, [&](int rung) {
+        mock[rung]->flushed++;
+        return RGY_ERR_NONE;
+    });
+    for (int frame = 0; frame < frames; frame++) {
+        result.sendErr = ladder.send([&](int rung, int slot) {
+            auto& m = *mock[rung];
+            if (m.slotInUse[slot].exchange(true)) {
+                m.slotError = true; //エンコード中のスロットに書き込もうとした
+            }
+            m.slotFrame[slot] = frame;
+            const int outstanding = ++m.outstanding;
+            int prevMax = m.maxOutstanding.load();
+            while (prevMax < outstanding && !m.maxOutstanding.compare_exchange_weak(prevMax, outstanding)) {}
+            if (errPrepare && rung == errRung && frame == errFrame) {
+                return RGY_ERR_UNKNOWN;
+            }
+            return RGY_ERR_NONE;
+        });
+        if (result.sendErr != RGY_ERR_NONE) {
+            break;
+        }
+        result.sent++;
+    }
+    result.finishErr = ladder.finish();
+    result.timeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count() * 0.001;
+
+    bool ok = true;
+    for (int i = 0; i < rungs; i++) {
+        const auto& m = *mock[i];
+        const auto st = ladder.stat(i);
+        result.maxQueued = std::max(result.maxQueued, st.maxQueued);
+        result.waitMs += st.waitUs * 0.001;
+        ok &= !m.slotError && m.maxOutstanding <= depth && st.maxQueued <= depth;
+        if (errFrame < 0) {
+            //すべてのフレームが順にエンコードされ、flushが1回ずつ呼ばれること
+            ok &= (int)m.encoded.size() == frames && st.frames == frames && m.flushed == 1;
+            for (int j = 0; ok && j < (int)m.encoded.size(); j++) {
+                ok &= m.encoded[j] == j;
+            }
+        } else {
+            //エラー後はflushを呼ばないこと
+            ok &= m.flushed == 0;
+            for (int j = 0; ok && j < (int)m.encoded.size(); j++) {
+                ok &= m.encoded[j] == j;
+            }
+        }
+    }
+    result.ok = ok;
+    return result;
+}
+
+//親の出力の音声ストリームを参照して音声を受け取る段の出力を模擬し、閉じる順序を検証する
+//親の出力スレッドには段に渡していない音声が残っており、段の出力は閉じる際に親のストリームを参照する
+//wrongOrderなら、親の出力を先に閉じる
+static bool ladder_bench_audio_close(int rungs, int packets, bool wrongOrder) {
+    struct MockRung {
+        std::atomic<int> received;
+        std::atomic<bool> closed;
+        bool error;
+        MockRung() : received(0), closed(false), error(false) {};
+    };
+    std::unique_ptr<MockRung[]> mock(new MockRung[rungs]);
+    std::atomic<bool> parentStreamFreed(false); //親の出力のCloseFormatで音声ストリームが破棄された
+    std::atomic<bool> mirrorError(false);
+    std::thread parentThread([&]() {
+        for (int i = 0; i < packets; i++) {
+            for (int j = 0; j < rungs; j++) {
+                //閉じた段には渡せない
+                if (mock[j].closed) {
+                    mirrorError = true;
+                }
+                mock[j].received++;
+            }
+            std::this_thread::yield();
+        }
+    });
+    auto parentWaitFin = [&]() {
+        parentThread.join();
+    };
+    auto rungClose = [&](int rung) {
+        auto& m = mock[rung];
+        //残りの音声をすべて受け取り、親の音声ストリームが有効な間に閉じること
+        m.error = parentStreamFreed || m.received != packets;
+        m.closed = true;
+    };
+    auto parentClose = [&]() {
+        if (parentThread.joinable()) {
+            parentThread.join();
+        }
+        parentStreamFreed = true;
+    };
+    if (wrongOrder) {
+        parentClose();
+        for (int i = 0; i < rungs; i++) {
+            rungClose(i);
+        }
+    } else {
+        ladder_close_outputs(rungs, parentWaitFin, rungClose, parentClose);
+    }
+    bool ok = !mirrorError;
+    for (int i = 0; i < rungs; i++) {
+        ok &= !mock[i].error && mock[i].received == packets;
+    }
+    return ok;
+}
+
+int ladder_bench(FILE *fp) {
+    const int frames = 2000;
+    const int workPerFrame = 4000;
+    int ret = 0;
+    fprintf(fp, "case,rungs,depth,frames,time_ms,max_queued,producer_wait_ms,verify\n");
+    for (int rungs : { 1, 3, 5 }) {
+        for (int depth : { 1, 4 }) {
+            const auto result = ladder_bench_run(rungs, depth, frames, workPerFrame, -1, -1, false);
+            const bool ok = result.ok && result.sendErr == RGY_ERR_NONE && result.finishErr == RGY_ERR_NONE && result.sent == frames;
+            fprintf(fp, "fanout,%d,%d,%d,%.1f,%d,%.1f,%s\n", rungs, depth, result.sent, result.timeMs, result.maxQueued, result.waitMs, ok ? "OK" : "NG");
+            ret |= ok ? 0 : 1;
+        }
+    }
+    {
+        //途中の段でエンコードがエラーになったら、生産者とほかの段を停止してエラーを返す
+        const int errFrame = 100;
+        const auto result = ladder_bench_run(5, 4, frames, workPerFrame, 2, errFrame, false);
+        const bool ok = result.ok && result.sendErr == RGY_ERR_UNKNOWN && result.finishErr == RGY_ERR_UNKNOWN
+            && result.sent > errFrame && result.sent < frames;
+        fprintf(fp, "encode_error,5,4,%d,%.1f,%d,%.1f,%s\n", result.sent, result.timeMs, result.maxQueued, result.waitMs, ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    {
+        //スロットへの書き込みがエラーになった場合も同様
+        const int errFrame = 100;
+        const auto result = ladder_bench_run(5, 4, frames, workPerFrame, 4, errFrame, true);
+        const bool ok = result.ok && result.sendErr == RGY_ERR_UNKNOWN && result.finishErr == RGY_ERR_UNKNOWN && result.sent == errFrame;
+        fprintf(fp, "prepare_error,5,4,%d,%.1f,%d,%.1f,%s\n", result.sent, result.timeMs, result.maxQueued, result.waitMs, ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    {
+        //不正な段数/スロット数
+        RGYLadderFanout ladder;
+        const bool ok = ladder.init(0, 4) == RGY_ERR_INVALID_PARAM
+            && ladder.init(RGY_LADDER_MAX_RUNGS + 1, 4) == RGY_ERR_INVALID_PARAM
+            && ladder.init(2, RGY_LADDER_QUEUE_MAX + 1) == RGY_ERR_INVALID_PARAM
+            && ladder.init(2, 0) == RGY_ERR_INVALID_PARAM;
+        fprintf(fp, "reject_param,0,0,0,0.0,0,0.0,%s\n", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    {
+        //音声を受け取る段の出力を、親の出力の音声ストリームを破棄する前に閉じること
+        //親の出力を先に閉じる順序は、検出できること
+        const int packets = 2000;
+        const bool ok = ladder_bench_audio_close(3, packets, false) && !ladder_bench_audio_close(3, packets, true);
+        fprintf(fp, "audio_close,3,0,%d,0.0,0,0.0,%s\n", packets, ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    return ret;
+}
@@ -0,0 +1,122 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_LADDER_H__
+#define __RGY_LADDER_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "rgy_version.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+
+//1回のデコード/フィルタ処理の結果を、解像度/ビットレートの異なる複数のエンコーダ(段)に分配する
+//
+//各段は、フレームを格納するスロットをdepth個ずつ持ち、段ごとのスレッドでエンコードを行う
+//フレームを送るスレッド(生産者)は、段ごとに空いているスロットを取得してフレームを書き込み、
+//その段のキューに積む。空いているスロットがなければ、その段のエンコードが進むまで待機する (backpressure)
+//したがって、段ごとにキューに積まれるフレームはdepth以下となり、最も遅い段の速度で全体が進む
+//
+//スロットへの書き込み(リサイズ)とエンコードはコールバックで指定し、分配の処理自体はエンコーダに依存しないので、
+//ladder_bench()では疑似的なエンコーダで確認する
+
+static const int RGY_LADDER_MAX_RUNGS = 8;       //最大の段数
+static const int RGY_LADDER_QUEUE_DEFAULT = 4;   //段ごとのスロット数のデフォルト
+static const int RGY_LADDER_QUEUE_MAX = 32;      //段ごとのスロット数の最大
+
+//段ごとの統計
+struct RGYLadderRungStat {
+    int64_t frames;       //エンコードしたフレーム数
+    int64_t waitUs;       //生産者が空きスロットを待った時間 (us)
+    int maxQueued;        //キューに積まれたフレーム数の最大
+};
+
+class RGYLadderFanout {
+public:
+    //rung: 段の番号, slot: スロットの番号 (0 ～ depth-1)
+    typedef std::function<RGY_ERR(int rung, int slot)> FrameFunc;
+    typedef std::function<RGY_ERR(int rung)> FlushFunc;
+
+    RGYLadderFanout();
+    ~RGYLadderFanout();
+
+    RGY_ERR init(int rungs, int depth);
+    //段ごとのスレッドを開始する
+    //encodeはスロットのフレームをエンコードする (戻った後にスロットは再利用される)
+    //flushはすべてのフレームを送った後に呼ばれる
+    RGY_ERR start(FrameFunc encode, FlushFunc flush);
+    //各段の空いているスロットを取得してprepareを呼び、キューに積む
+    //空いているスロットがない段があれば、空くまで待機する
+    //いずれかの段でエラーが発生していれば、そのエラーを返す
+    RGY_ERR send(FrameFunc prepare);
+    //すべてのフレームのエンコードとflushの終了を待ち、最初に発生したエラーを返す
+    RGY_ERR finish();
+    //処理を中断し、待機中の処理をすべて解除する
+    void abort(RGY_ERR err);
+
+    int rungs() const { return (int)m_rungs.size(); }
+    int depth() const { return m_depth; }
+    RGYLadderRungStat stat(int rung) const;
+protected:
+    struct Rung {
+        std::deque<int> queued;    //エンコード待ちのスロット (m_mtxで保護)
+        std::vector<int> free;     //空いているスロット (m_mtxで保護)
+        RGYLadderRungStat stat;
+        std::thread thread;
+    };
+    void run(int rung);
+
+    int m_depth;
+    std::vector<Rung> m_rungs;
+    FrameFunc m_encode;
+    FlushFunc m_flush;
+    mutable std::mutex m_mtx;
+    std::condition_variable m_cvQueued;  //キューにフレームが積まれた
+    std::condition_variable m_cvFree;    //スロットが空いた
+    bool m_eos;
+    RGY_ERR m_err;
+};
+
+//親の出力と段の出力を閉じる
+//段の出力は親の出力の音声ストリームを参照して音声を受け取るので、
+//親の出力のスレッドを停止して残りの音声をすべて段に渡し(parentWaitFin)、段の出力を閉じて(rungClose)から、
+//最後に親の出力を閉じる(parentClose)
+void ladder_close_outputs(int rungs, std::function<void()> parentWaitFin, std::function<void(int rung)> rungClose, std::function<void()> parentClose);
+
+//段ごとに速度の異なる疑似的なエンコーダで分配を行い、
+//フレームの順序/欠落、キューの上限、エラーの伝播、出力を閉じる順序を検証してCSVで出力する
+int ladder_bench(FILE *fp);
+
+#endif //__RGY_LADDER_H__
@@ -29,22 +29,32 @@
 #include <thread>
 #include <mutex>
 #include "rgy_log.h"
+#include "rgy_log_async.h"
 #include "rgy_version.h"
 
 const char *RGYLog::HTML_FOOTER = "</body>\n</html>\n";
 
-RGYLog::RGYLog(const TCHAR *pLogFile, int log_level) {
-    init(pLogFile, log_level);
+RGYLog::RGYLog(const TCHAR *pLogFile, int log_level, int log_mode) {
+    init(pLogFile, log_level, log_mode);
 };
 
 RGYLog::~RGYLog() {
+    //バックグラウンドのスレッドはこのインスタンスに出力するので、先に終了させる
+    m_async.reset();
 }
 
-void RGYLog::init(const TCHAR *pLogFile, int log_level) {
+void RGYLog::init(const TCHAR *pLogFile, int log_level, int log_mode) {
+    m_async.reset();
     m_pStrLog = pLogFile;
     m_nLogLevel = log_level;
+    m_nLogMode = log_mode;
+    m_bHtml = false;
     m_mtx.reset(new std::mutex());
-    if (pLogFile != nullptr && _tcslen(pLogFile) > 0) {
+    if (m_nLogMode == RGY_LOG_MODE_BINARY && pLogFile != nullptr && _tcslen(pLogFile) > 0) {
+        //バイナリログはRGYLogAsyncが書き込むので、テキストのログファイルとしては扱わない
+        CreateDirectoryRecursive(PathRemoveFileSpecFixed(pLogFile).second.c_str());
+        m_pStrLog = nullptr;
+    } else if (pLogFile != nullptr && _tcslen(pLogFile) > 0) {
         CreateDirectoryRecursive(PathRemoveFileSpecFixed(pLogFile).second.c_str());
         FILE *fp = NULL;
         if (_tfopen_s(&fp, pLogFile, _T("a+")) || fp == NULL) {
@@ -68,8 +78,17 @@ void RGYLog::init(const TCHAR *pLogFile, int log_level) {
             fclose(fp);
         }
     }
+    if (m_nLogMode != RGY_LOG_MODE_SYNC) {
+        m_async.reset(new RGYLogAsync(this, m_nLogMode, m_nLogLevel, pLogFile));
+    }
 };
 
+void RGYLog::flush() {
+    if (m_async) {
+        m_async->flush();
+    }
+}
+
 void RGYLog::writeHtmlHeader() {
     FILE *fp = NULL;
     if (_tfopen_s(&fp, m_pStrLog, _T("wb"))) {
@@ -152,8 +171,16 @@ void RGYLog::write_log(int log_level, const TCHAR *buffer, bool file_only) {
     if (log_level < m_nLogLevel) {
         return;
     }
+    if (m_async) {
+        m_async->pushText(log_level, buffer, file_only);
+        return;
+    }
+    RGYLogLine line = { log_level, true, !file_only, buffer };
+    write_log_lines(&line, 1);
+}
 
-    auto convert_to_html = [log_level](std::string str) {
+void RGYLog::write_log_lines(const RGYLogLine *lines, size_t count) {
+    auto convert_to_html = [](int log_level, std::string str) {
         //str = str_replace(str, "<", "&lt;");
         //str = str_replace(str, ">", "&gt;");
         //str = str_replace(str, "&", "&amp;");
@@ -176,30 +203,36 @@ void RGYLog::write_log(int log_level, const TCHAR *buffer, bool file_only) {
     HANDLE hStdErr = NULL;
 #endif //defined(_WIN32) || defined(_WIN64)
 
-    std::string buffer_char;
+    //ファイルにはまとめて書き込む
+    std::vector<std::string> buffer_char(count);
+    std::string buffer_file;
 #ifdef UNICODE
-    char *buffer_ptr = NULL;
     DWORD mode = 0;
     bool stderr_write_to_console = 0 != GetConsoleMode(hStdErr, &mode); //stderrの出力先がコンソールかどうか
-    if (m_pStrLog || !stderr_write_to_console) {
-        buffer_char = tchar_to_string(buffer, (m_bHtml) ? CP_UTF8 : CP_THREAD_ACP);
-        if (m_bHtml) {
-            buffer_char = convert_to_html(buffer_char);
+    for (size_t i = 0; i < count; i++) {
+        if (m_pStrLog || !stderr_write_to_console) {
+            buffer_char[i] = tchar_to_string(lines[i].str, (m_bHtml) ? CP_UTF8 : CP_THREAD_ACP);
+            if (m_bHtml) {
+                buffer_char[i] = convert_to_html(lines[i].level, buffer_char[i]);
+            }
+        }
+        if (lines[i].file) {
+            buffer_file += buffer_char[i];
         }
-        buffer_ptr = &buffer_char[0];
     }
 #else
-    const char *buffer_ptr = &buffer[0];
-    if (m_bHtml) {
-        buffer_char = wstring_to_string(char_to_wstring(buffer_ptr), CP_UTF8);
+    for (size_t i = 0; i < count; i++) {
+        buffer_char[i] = lines[i].str;
         if (m_bHtml) {
-            buffer_char = convert_to_html(buffer_char);
+            buffer_char[i] = convert_to_html(lines[i].level, wstring_to_string(char_to_wstring(buffer_char[i]), CP_UTF8));
+        }
+        if (lines[i].file) {
+            buffer_file += buffer_char[i];
         }
-        buffer_ptr = &buffer_char[0];
     }
 #endif
     std::lock_guard<std::mutex> lock(*m_mtx.get());
-    if (m_pStrLog) {
+    if (m_pStrLog && buffer_file.length() > 0) {
         FILE *fp_log = NULL;
         //logはANSI(まあようはShift-JIS)で保存する
         if (0 == _tfopen_s(&fp_log, m_pStrLog, (m_bHtml) ? _T("rb+") : _T("a")) && fp_log) {
@@ -209,20 +242,22 @@ void RGYLog::write_log(int log_level, const TCHAR *buffer, bool file_only) {
                 _fseeki64(fp_log, 0, SEEK_SET);
                 _fseeki64(fp_log, pos -1 * strlen(HTML_FOOTER), SEEK_CUR);
             }
-            fwrite(buffer_ptr, 1, strlen(buffer_ptr), fp_log);
+            fwrite(buffer_file.c_str(), 1, buffer_file.length(), fp_log);
             if (m_bHtml) {
                 fwrite(HTML_FOOTER, 1, strlen(HTML_FOOTER), fp_log);
             }
             fclose(fp_log);
         }
     }
-    if (!file_only) {
+    for (size_t i = 0; i < count; i++) {
+        if (lines[i].console) {
 #ifdef UNICODE
-        if (!stderr_write_to_console) //出力先がリダイレクトされるならANSIで
-            fprintf(stderr, buffer_ptr);
-        if (stderr_write_to_console) //出力先がコンソールならWCHARで
+            if (!stderr_write_to_console) //出力先がリダイレクトされるならANSIで
+                fprintf(stderr, buffer_char[i].c_str());
+            if (stderr_write_to_console) //出力先がコンソールならWCHARで
 #endif
-            rgy_print_stderr(log_level, buffer, hStdErr);
+                rgy_print_stderr(lines[i].level, lines[i].str.c_str(), hStdErr);
+        }
     }
 }
 
@@ -277,6 +312,10 @@ void RGYLog::write(int log_level, const TCHAR *format, ...) {
     va_list args;
     va_start(args, format);
 
+    if (m_async && m_async->push(log_level, nullptr, format, args, false)) {
+        va_end(args);
+        return;
+    }
     int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
     std::vector<TCHAR> buffer(len, 0);
     if (buffer.data() != nullptr) {
@@ -285,3 +324,25 @@ void RGYLog::write(int log_level, const TCHAR *format, ...) {
     }
     va_end(args);
 }
+
+void RGYLog::write_va(int log_level, const TCHAR *prefix, const TCHAR *format, va_list args, bool file_only) {
+    if (log_level < m_nLogLevel) {
+        return;
+    }
+    if (m_async && m_async->push(log_level, prefix, format, args, file_only)) {
+        return;
+    }
+    int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
+    std::vector<TCHAR> buffer(len, 0);
+    _vstprintf_s(buffer.data(), len, format, args);
+    if (prefix == nullptr) {
+        write_log(log_level, buffer.data(), file_only);
+        return;
+    }
+    auto lines = split(tstring(buffer.data()), _T("\n"));
+    for (const auto& line : lines) {
+        if (line[0] != _T('\0')) {
+            write_log(log_level, (prefix + line + _T("\n")).c_str(), file_only);
+        }
+    }
+}
@@ -39,18 +39,28 @@
 namespace std {
     class mutex;
 }
+class RGYLogAsync;
+
+struct RGYLogLine {
+    int level;
+    bool file;    //ファイルに出力する
+    bool console; //コンソールに出力する
+    tstring str;
+};
 
 class RGYLog {
 protected:
     int m_nLogLevel = RGY_LOG_INFO;
+    int m_nLogMode = RGY_LOG_MODE_SYNC;
     const TCHAR *m_pStrLog = nullptr;
     bool m_bHtml = false;
     unique_ptr<std::mutex> m_mtx;
+    unique_ptr<RGYLogAsync> m_async; //非同期モードの場合のみ
     static const char *HTML_FOOTER;
 public:
-    RGYLog(const TCHAR *pLogFile, int log_level = RGY_LOG_INFO);
+    RGYLog(const TCHAR *pLogFile, int log_level = RGY_LOG_INFO, int log_mode = RGY_LOG_MODE_SYNC);
     virtual ~RGYLog();
-    void init(const TCHAR *pLogFile, int log_level = RGY_LOG_INFO);
+    void init(const TCHAR *pLogFile, int log_level = RGY_LOG_INFO, int log_mode = RGY_LOG_MODE_SYNC);
     void writeHtmlHeader();
     void writeFileHeader(const TCHAR *pDstFilename);
     void writeFileFooter();
@@ -62,10 +72,20 @@ public:
         m_nLogLevel = newLogLevel;
         return prevLogLevel;
     }
+    int getLogMode() const {
+        return m_nLogMode;
+    }
     bool logFileAvail() {
         return m_pStrLog != nullptr;
     }
+    //非同期モードで、ここまでに書き込んだログがすべて出力されるまで待機する
+    void flush();
     virtual void write_log(int log_level, const TCHAR *buffer, bool file_only = false);
+    //まとめてファイル/コンソールに出力する (非同期モードではバックグラウンドのスレッドから呼ばれる)
+    void write_log_lines(const RGYLogLine *lines, size_t count);
+    //prefixを指定した場合、各行の先頭に付加する
+    //非同期モードでは書式化せずに引数のまま書き込み、書式化はバックグラウンドのスレッドで行う
+    virtual void write_va(int log_level, const TCHAR *prefix, const TCHAR *format, va_list args, bool file_only = false);
     virtual void write(int log_level, const TCHAR *format, ...);
     virtual void write(int log_level, const WCHAR *format, va_list args);
     virtual void write(int log_level, const char *format, va_list args, uint32_t codepage = CP_THREAD_ACP);
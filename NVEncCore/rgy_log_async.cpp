@@ -0,0 +1,934 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_log.h"
+#include "rgy_log_async.h"
+
+static uint32_t rgy_log_thread_id() {
+#if defined(_WIN32) || defined(_WIN64)
+    return (uint32_t)GetCurrentThreadId();
+#else
+    return (uint32_t)syscall(SYS_gettid);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+static uint64_t rgy_log_format_hash(const TCHAR *format) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *format; format++) {
+        hash = (hash ^ (uint64_t)*format) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool rgy_log_parse_format(const TCHAR *format, std::vector<RGYLogFormatPiece>& pieces) {
+    //TCHARがwchar_tの場合、%sと%cはwchar_tを、%Sと%Cはcharを示す (MSVCの仕様)
+    const bool wideFormat = sizeof(TCHAR) == sizeof(wchar_t) && sizeof(TCHAR) != sizeof(char);
+    pieces.clear();
+    tstring literal;
+    const TCHAR *ptr = format;
+    while (*ptr) {
+        if (*ptr != _T('%')) {
+            literal += *ptr++;
+            continue;
+        }
+        if (ptr[1] == _T('%')) {
+            literal += _T('%');
+            ptr += 2;
+            continue;
+        }
+        const TCHAR *start = ptr++;
+        RGYLogFormatPiece piece;
+        piece.literal = false;
+        piece.starCount = 0;
+        piece.type = RGY_LOG_ARG_INT;
+        //flags
+        while (*ptr && _tcschr(_T("-+ #0'"), *ptr)) ptr++;
+        //width
+        if (*ptr == _T('*')) {
+            piece.starCount++;
+            ptr++;
+        } else {
+            while (_T('0') <= *ptr && *ptr <= _T('9')) ptr++;
+        }
+        //precision
+        if (*ptr == _T('.')) {
+            ptr++;
+            if (*ptr == _T('*')) {
+                piece.starCount++;
+                ptr++;
+            } else {
+                while (_T('0') <= *ptr && *ptr <= _T('9')) ptr++;
+            }
+        }
+        //length
+        enum { LEN_NONE, LEN_SHORT, LEN_LONG, LEN_LONGLONG, LEN_SIZE, LEN_LDOUBLE } len = LEN_NONE;
+        if (*ptr == _T('h')) {
+            len = LEN_SHORT;
+            ptr += (ptr[1] == _T('h')) ? 2 : 1;
+        } else if (*ptr == _T('l')) {
+            len = (ptr[1] == _T('l')) ? LEN_LONGLONG : LEN_LONG;
+            ptr += (ptr[1] == _T('l')) ? 2 : 1;
+        } else if (*ptr == _T('w')) {
+            len = LEN_LONG;
+            ptr++;
+        } else if (*ptr == _T('j')) {
+            len = LEN_LONGLONG;
+            ptr++;
+        } else if (*ptr == _T('z') || *ptr == _T('t')) {
+            len = LEN_SIZE;
+            ptr++;
+        } else if (*ptr == _T('L')) {
+            len = LEN_LDOUBLE;
+            ptr++;
+        } else if (*ptr == _T('I')) {
+            if (ptr[1] == _T('6') && ptr[2] == _T('4')) {
+                len = LEN_LONGLONG;
+                ptr += 3;
+            } else if (ptr[1] == _T('3') && ptr[2] == _T('2')) {
+                len = LEN_NONE;
+                ptr += 3;
+            } else {
+                len = LEN_SIZE;
+                ptr++;
+            }
+        }
+        //conversion
+        switch (*ptr) {
+        case _T('d'): case _T('i'): case _T('u'): case _T('o'): case _T('x'): case _T('X'):
+            switch (len) {
+            case LEN_LONG:     piece.type = RGY_LOG_ARG_LONG; break;
+            case LEN_LONGLONG:
+            case LEN_LDOUBLE:  piece.type = RGY_LOG_ARG_INT64; break;
+            case LEN_SIZE:     piece.type = RGY_LOG_ARG_SIZE; break;
+            default:           piece.type = RGY_LOG_ARG_INT; break;
+            }
+            break;
+        case _T('c'): case _T('C'):
+            piece.type = RGY_LOG_ARG_INT;
+            break;
+        case _T('e'): case _T('E'): case _T('f'): case _T('F'): case _T('g'): case _T('G'): case _T('a'): case _T('A'):
+            piece.type = (len == LEN_LDOUBLE) ? RGY_LOG_ARG_LDOUBLE : RGY_LOG_ARG_DOUBLE;
+            break;
+        case _T('p'):
+            piece.type = RGY_LOG_ARG_PTR;
+            break;
+        case _T('s'):
+            piece.type = (len == LEN_SHORT) ? RGY_LOG_ARG_STR : ((len == LEN_LONG) ? RGY_LOG_ARG_WSTR : ((wideFormat) ? RGY_LOG_ARG_WSTR : RGY_LOG_ARG_STR));
+            break;
+        case _T('S'):
+            piece.type = (len == LEN_SHORT) ? RGY_LOG_ARG_STR : ((len == LEN_LONG) ? RGY_LOG_ARG_WSTR : ((wideFormat) ? RGY_LOG_ARG_STR : RGY_LOG_ARG_WSTR));
+            break;
+        default:
+            //%nや不正な書式は扱わない
+            return false;
+        }
+        ptr++;
+        if (literal.length() > 0) {
+            RGYLogFormatPiece lit;
+            lit.str = literal;
+            lit.literal = true;
+            lit.starCount = 0;
+            lit.type = RGY_LOG_ARG_INT;
+            pieces.push_back(lit);
+            literal.clear();
+        }
+        piece.str = tstring(start, ptr);
+        pieces.push_back(piece);
+    }
+    if (literal.length() > 0) {
+        RGYLogFormatPiece lit;
+        lit.str = literal;
+        lit.literal = true;
+        lit.starCount = 0;
+        lit.type = RGY_LOG_ARG_INT;
+        pieces.push_back(lit);
+    }
+    return true;
+}
+
+//フォーマット文字列の登録先 (プロセス全体で共通、解放しない)
+struct RGYLogFormatRegistry {
+    std::mutex mtx;
+    std::deque<RGYLogFormat> formats; //IDは(インデックス+1)
+    std::unordered_map<uint64_t, const RGYLogFormat *> hashMap;
+};
+
+static RGYLogFormatRegistry *rgy_log_format_registry() {
+    static RGYLogFormatRegistry *registry = new RGYLogFormatRegistry();
+    return registry;
+}
+
+const RGYLogFormat *rgy_log_format_register(const TCHAR *format) {
+    //まずスレッドごとのキャッシュを確認し、見つからなければ登録先を確認する
+    thread_local std::unordered_map<uint64_t, const RGYLogFormat *> tls_formats;
+    const uint64_t hash = rgy_log_format_hash(format);
+    auto it = tls_formats.find(hash);
+    if (it != tls_formats.end()) {
+        return it->second;
+    }
+    auto registry = rgy_log_format_registry();
+    const RGYLogFormat *ret = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(registry->mtx);
+        auto itr = registry->hashMap.find(hash);
+        if (itr != registry->hashMap.end()) {
+            ret = itr->second;
+        } else {
+            RGYLogFormat fmt;
+            fmt.id = (uint32_t)registry->formats.size() + 1;
+            fmt.format = format;
+            fmt.supported = rgy_log_parse_format(format, fmt.pieces);
+            registry->formats.push_back(fmt);
+            ret = &registry->formats.back();
+            registry->hashMap[hash] = ret;
+        }
+    }
+    if (ret->format != format) {
+        //ハッシュの衝突、このフォーマットはキャッシュせず書き込むスレッドで書式化する
+        static const RGYLogFormat unsupported = { 0, _T(""), false, {} };
+        return &unsupported;
+    }
+    tls_formats[hash] = ret;
+    return ret;
+}
+
+static const RGYLogFormat *rgy_log_format_get(uint32_t id) {
+    auto registry = rgy_log_format_registry();
+    std::lock_guard<std::mutex> lock(registry->mtx);
+    return (0 < id && id <= registry->formats.size()) ? &registry->formats[id - 1] : nullptr;
+}
+
+//引数をレコードに書き込む
+class RGYLogArgWriter {
+public:
+    RGYLogArgWriter(uint8_t *buf, size_t capacity) : m_buf(buf), m_capacity(capacity), m_size(0), m_truncated(false) {};
+    template<typename T>
+    void put(T value) {
+        if (m_size + sizeof(T) > m_capacity) {
+            m_truncated = true;
+            return;
+        }
+        memcpy(m_buf + m_size, &value, sizeof(T));
+        m_size += sizeof(T);
+    }
+    template<typename T>
+    void putStr(const T *str) {
+        //後続の数値の引数のために、文字列は少し余裕を残して切り詰める
+        static const size_t RESERVE = 64;
+        if (str == nullptr) {
+            put((uint32_t)UINT32_MAX);
+            return;
+        }
+        size_t len = 0;
+        while (str[len]) len++;
+        const size_t avail = (m_capacity > m_size + sizeof(uint32_t) + RESERVE) ? m_capacity - m_size - sizeof(uint32_t) - RESERVE : 0;
+        if (len * sizeof(T) > avail) {
+            len = avail / sizeof(T);
+            m_truncated = true;
+        }
+        put((uint32_t)(len * sizeof(T)));
+        if (!m_truncated || len > 0) {
+            memcpy(m_buf + m_size, str, len * sizeof(T));
+            m_size += len * sizeof(T);
+        }
+    }
+    size_t size() const { return m_size; }
+    bool truncated() const { return m_truncated; }
+private:
+    uint8_t *m_buf;
+    size_t m_capacity;
+    size_t m_size;
+    bool m_truncated;
+};
+
+//レコードから引数を読み出す
+class RGYLogArgReader {
+public:
+    RGYLogArgReader(const uint8_t *buf, size_t size) : m_buf(buf), m_size(size), m_pos(0) {};
+    template<typename T>
+    bool get(T& value) {
+        if (m_pos + sizeof(T) > m_size) {
+            return false;
+        }
+        memcpy(&value, m_buf + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+    template<typename T>
+    bool getStr(std::basic_string<T>& str, bool& isNull) {
+        uint32_t bytes = 0;
+        if (!get(bytes)) {
+            return false;
+        }
+        isNull = bytes == UINT32_MAX;
+        str.clear();
+        if (isNull) {
+            return true;
+        }
+        if (m_pos + bytes > m_size || bytes % sizeof(T) != 0) {
+            return false;
+        }
+        str.resize(bytes / sizeof(T));
+        if (bytes) {
+            memcpy(&str[0], m_buf + m_pos, bytes);
+        }
+        m_pos += bytes;
+        return true;
+    }
+private:
+    const uint8_t *m_buf;
+    size_t m_size;
+    size_t m_pos;
+};
+
+static bool rgy_log_encode_args(RGYLogArgWriter& writer, const RGYLogFormat *format, va_list args) {
+    for (const auto& piece : format->pieces) {
+        if (piece.literal) {
+            continue;
+        }
+        for (int i = 0; i < piece.starCount; i++) {
+            writer.put((int32_t)va_arg(args, int));
+        }
+        switch (piece.type) {
+        case RGY_LOG_ARG_INT:     writer.put((int32_t)va_arg(args, int)); break;
+        case RGY_LOG_ARG_LONG:    writer.put((int64_t)va_arg(args, long)); break;
+        case RGY_LOG_ARG_INT64:   writer.put((int64_t)va_arg(args, long long)); break;
+        case RGY_LOG_ARG_SIZE:    writer.put((uint64_t)va_arg(args, size_t)); break;
+        case RGY_LOG_ARG_DOUBLE:  writer.put((double)va_arg(args, double)); break;
+        case RGY_LOG_ARG_LDOUBLE: writer.put((double)va_arg(args, long double)); break;
+        case RGY_LOG_ARG_PTR:     writer.put((uint64_t)(uintptr_t)va_arg(args, void *)); break;
+        case RGY_LOG_ARG_STR:     writer.putStr(va_arg(args, const char *)); break;
+        case RGY_LOG_ARG_WSTR:    writer.putStr(va_arg(args, const wchar_t *)); break;
+        default: return false;
+        }
+    }
+    return true;
+}
+
+static tstring rgy_log_format_args(RGYLogArgReader& reader, const RGYLogFormat *format) {
+    tstring str;
+    for (const auto& piece : format->pieces) {
+        if (piece.literal) {
+            str += piece.str;
+            continue;
+        }
+        //'*'は読み込んだ値に置き換えて、値を1つだけ渡して書式化する
+        tstring spec = piece.str;
+        for (int i = 0; i < piece.starCount; i++) {
+            int32_t value = 0;
+            if (!reader.get(value)) {
+                return str + _T("...");
+            }
+            const auto pos = spec.find(_T('*'));
+            spec = spec.substr(0, pos) + strsprintf(_T("%d"), value) + spec.substr(pos + 1);
+        }
+        bool ok = true;
+        switch (piece.type) {
+        case RGY_LOG_ARG_INT:     { int32_t v = 0;  if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (int)v); break; }
+        case RGY_LOG_ARG_LONG:    { int64_t v = 0;  if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (long)v); break; }
+        case RGY_LOG_ARG_INT64:   { int64_t v = 0;  if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (long long)v); break; }
+        case RGY_LOG_ARG_SIZE:    { uint64_t v = 0; if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (size_t)v); break; }
+        case RGY_LOG_ARG_DOUBLE:  { double v = 0;   if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), v); break; }
+        case RGY_LOG_ARG_LDOUBLE: { double v = 0;   if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (long double)v); break; }
+        case RGY_LOG_ARG_PTR:     { uint64_t v = 0; if ((ok = reader.get(v))) str += strsprintf(spec.c_str(), (void *)(uintptr_t)v); break; }
+        case RGY_LOG_ARG_STR: {
+            std::string v;
+            bool isNull = false;
+            if ((ok = reader.getStr(v, isNull))) str += strsprintf(spec.c_str(), (isNull) ? nullptr : v.c_str());
+            break;
+        }
+        case RGY_LOG_ARG_WSTR: {
+            std::wstring v;
+            bool isNull = false;
+            if ((ok = reader.getStr(v, isNull))) str += strsprintf(spec.c_str(), (isNull) ? nullptr : v.c_str());
+            break;
+        }
+        default: ok = false; break;
+        }
+        if (!ok) {
+            return str + _T("...");
+        }
+    }
+    return str;
+}
+
+tstring rgy_log_format_record(const RGYLogRecordHeader *header, const uint8_t *payload, const RGYLogFormat *format) {
+    RGYLogArgReader reader(payload, header->payloadSize);
+    if (header->flags & RGY_LOG_REC_TEXT) {
+        tstring text;
+        bool isNull = false;
+        reader.getStr(text, isNull);
+        return text;
+    }
+    tstring prefix;
+    if (header->flags & RGY_LOG_REC_PREFIX) {
+        bool isNull = false;
+        if (!reader.getStr(prefix, isNull)) {
+            return _T("");
+        }
+    }
+    if (format == nullptr) {
+        return prefix + strsprintf(_T("<unknown format id %u>\n"), header->formatId);
+    }
+    tstring str = rgy_log_format_args(reader, format);
+    if (header->flags & RGY_LOG_REC_TRUNCATED) {
+        if (str.length() > 0 && str.back() == _T('\n')) {
+            str.pop_back();
+        }
+        str += _T("...\n");
+    }
+    if (!(header->flags & RGY_LOG_REC_PREFIX)) {
+        return str;
+    }
+    //AddMessageと同様に、行ごとにprefixを付加する
+    tstring ret;
+    for (const auto& line : split(str, _T("\n"))) {
+        if (line.length() > 0) {
+            ret += prefix + line + _T("\n");
+        }
+    }
+    return ret;
+}
+
+RGYLogRing::RGYLogRing(uint32_t threadId) :
+    m_buf(nullptr),
+    m_threadId(threadId),
+    m_head(0),
+    m_tail(0) {
+    m_buf = (uint8_t *)_aligned_malloc((size_t)RGY_LOG_RING_SLOTS * RGY_LOG_REC_SLOT_SIZE, 64);
+}
+
+RGYLogRing::~RGYLogRing() {
+    if (m_buf) {
+        _aligned_free(m_buf);
+        m_buf = nullptr;
+    }
+}
+
+bool RGYLogRing::push(const uint8_t *record, uint32_t size, uint32_t slots) {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    const uint32_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail + slots > (uint32_t)RGY_LOG_RING_SLOTS) {
+        return false;
+    }
+    //リングの終端をまたぐ場合は2回に分けてコピーする
+    const size_t offset = (size_t)(head & (RGY_LOG_RING_SLOTS - 1)) * RGY_LOG_REC_SLOT_SIZE;
+    const size_t first = (std::min)((size_t)size, (size_t)RGY_LOG_RING_SLOTS * RGY_LOG_REC_SLOT_SIZE - offset);
+    memcpy(m_buf + offset, record, first);
+    if (first < size) {
+        memcpy(m_buf, record + first, size - first);
+    }
+    m_head.store(head + slots, std::memory_order_release);
+    return true;
+}
+
+const RGYLogRecordHeader *RGYLogRing::front() const {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint32_t head = m_head.load(std::memory_order_acquire);
+    return (head != tail) ? (const RGYLogRecordHeader *)slotPtr(tail) : nullptr;
+}
+
+void RGYLogRing::pop(std::vector<uint8_t>& buf) {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    const auto header = (const RGYLogRecordHeader *)slotPtr(tail);
+    const size_t size = sizeof(RGYLogRecordHeader) + header->payloadSize;
+    const uint32_t slots = header->slots;
+    buf.resize(size);
+    const size_t offset = (size_t)(tail & (RGY_LOG_RING_SLOTS - 1)) * RGY_LOG_REC_SLOT_SIZE;
+    const size_t first = (std::min)(size, (size_t)RGY_LOG_RING_SLOTS * RGY_LOG_REC_SLOT_SIZE - offset);
+    memcpy(buf.data(), m_buf + offset, first);
+    if (first < size) {
+        memcpy(buf.data() + first, m_buf, size - first);
+    }
+    m_tail.store(tail + slots, std::memory_order_release);
+}
+
+//スレッドごとのリングのキャッシュ
+struct RGYLogThreadRing {
+    uint64_t instanceId;
+    RGYLogRing *ring;
+};
+static thread_local RGYLogThreadRing tls_ring = { 0, nullptr };
+static std::atomic<uint64_t> g_logAsyncInstanceId(0);
+
+RGYLogAsync::RGYLogAsync(RGYLog *log, int logMode, int logLevel, const TCHAR *logFile) :
+    m_log(log),
+    m_logMode(logMode),
+    m_instanceId(++g_logAsyncInstanceId),
+    m_start(std::chrono::steady_clock::now()),
+    m_mtxRings(),
+    m_rings(),
+    m_mtxWake(),
+    m_cvWake(),
+    m_cvDrained(),
+    m_drainCount(0),
+    m_abort(false),
+    m_thread(),
+    m_fpBin(nullptr),
+    m_recordBuf(),
+    m_lines(),
+    m_formats(),
+    m_formatWritten() {
+    if (m_logMode == RGY_LOG_MODE_BINARY && logFile != nullptr && _tcslen(logFile) > 0) {
+        if (_tfopen_s(&m_fpBin, logFile, _T("wb")) || m_fpBin == nullptr) {
+            fprintf(stderr, "failed to open log file, log writing disabled.\n");
+            m_fpBin = nullptr;
+        } else {
+            RGYLogBinHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = RGY_LOG_BIN_MAGIC;
+            header.version = RGY_LOG_BIN_VERSION;
+            header.headerSize = sizeof(header);
+            header.tcharSize = sizeof(TCHAR);
+            header.wcharSize = sizeof(wchar_t);
+            header.logLevel = logLevel;
+            header.startTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            fwrite(&header, 1, sizeof(header), m_fpBin);
+        }
+    }
+    m_thread = std::thread(&RGYLogAsync::run, this);
+}
+
+RGYLogAsync::~RGYLogAsync() {
+    m_abort = true;
+    m_cvWake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_fpBin) {
+        fclose(m_fpBin);
+        m_fpBin = nullptr;
+    }
+    m_rings.clear();
+}
+
+RGYLogRing *RGYLogAsync::ring() {
+    if (tls_ring.instanceId == m_instanceId) {
+        return tls_ring.ring;
+    }
+    //このスレッドで初めて書き込む場合のみロックする
+    std::lock_guard<std::mutex> lock(m_mtxRings);
+    const auto threadId = rgy_log_thread_id();
+    RGYLogRing *ring = nullptr;
+    for (const auto& r : m_rings) {
+        if (r->threadId() == threadId) {
+            ring = r.get();
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        m_rings.push_back(std::unique_ptr<RGYLogRing>(new RGYLogRing(threadId)));
+        ring = m_rings.back().get();
+    }
+    tls_ring.instanceId = m_instanceId;
+    tls_ring.ring = ring;
+    return ring;
+}
+
+void RGYLogAsync::pushRecord(uint8_t *record, uint32_t size) {
+    auto header = (RGYLogRecordHeader *)record;
+    header->slots = (uint16_t)((size + RGY_LOG_REC_SLOT_SIZE - 1) / RGY_LOG_REC_SLOT_SIZE);
+    header->threadId = rgy_log_thread_id();
+    header->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    auto ring = this->ring();
+    //空きがなければ、バックグラウンドのスレッドを起こして空くまで待つ
+    for (int i = 0; !ring->push(record, size, header->slots); i++) {
+        m_cvWake.notify_one();
+        if (i < 16) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    if (header->level >= RGY_LOG_ERROR) {
+        //エラーは処理が中断される前に確実に出力されるよう、出力まで待機する
+        flush();
+    } else if (header->level >= RGY_LOG_WARN
+        || ring->produced() - ring->consumed() >= RGY_LOG_RING_SLOTS / 2) {
+        m_cvWake.notify_one();
+    }
+}
+
+bool RGYLogAsync::push(int log_level, const TCHAR *prefix, const TCHAR *format, va_list args, bool file_only) {
+    const auto fmt = rgy_log_format_register(format);
+    if (!fmt->supported) {
+        return false;
+    }
+    alignas(8) uint8_t record[RGY_LOG_REC_SLOTS_MAX * RGY_LOG_REC_SLOT_SIZE];
+    auto header = (RGYLogRecordHeader *)record;
+    memset(header, 0, sizeof(*header));
+    header->level = (int8_t)log_level;
+    header->formatId = fmt->id;
+    header->flags = (file_only) ? RGY_LOG_REC_FILE_ONLY : 0;
+    RGYLogArgWriter writer(record + sizeof(RGYLogRecordHeader), sizeof(record) - sizeof(RGYLogRecordHeader));
+    if (prefix) {
+        header->flags |= RGY_LOG_REC_PREFIX;
+        writer.putStr(prefix);
+    }
+    rgy_log_encode_args(writer, fmt, args);
+    if (writer.truncated()) {
+        header->flags |= RGY_LOG_REC_TRUNCATED;
+    }
+    header->payloadSize = (uint32_t)writer.size();
+    pushRecord(record, (uint32_t)(sizeof(RGYLogRecordHeader) + writer.size()));
+    return true;
+}
+
+void RGYLogAsync::pushText(int log_level, const TCHAR *text, bool file_only) {
+    alignas(8) uint8_t record[RGY_LOG_REC_SLOTS_MAX * RGY_LOG_REC_SLOT_SIZE];
+    auto header = (RGYLogRecordHeader *)record;
+    memset(header, 0, sizeof(*header));
+    header->level = (int8_t)log_level;
+    header->formatId = 0;
+    header->flags = RGY_LOG_REC_TEXT | ((file_only) ? RGY_LOG_REC_FILE_ONLY : 0);
+    RGYLogArgWriter writer(record + sizeof(RGYLogRecordHeader), sizeof(record) - sizeof(RGYLogRecordHeader));
+    writer.putStr(text);
+    if (writer.truncated()) {
+        //長い文字列はレコードを分割して書き込む
+        const size_t chunk = (sizeof(record) - sizeof(RGYLogRecordHeader) - 128) / sizeof(TCHAR);
+        const size_t len = _tcslen(text);
+        for (size_t pos = 0; pos < len; pos += chunk) {
+            const tstring part(text + pos, (std::min)(chunk, len - pos));
+            pushText(log_level, part.c_str(), file_only);
+        }
+        return;
+    }
+    header->payloadSize = (uint32_t)writer.size();
+    pushRecord(record, (uint32_t)(sizeof(RGYLogRecordHeader) + writer.size()));
+}
+
+void RGYLogAsync::flush() {
+    //現時点で書き込まれている位置を記録し、バックグラウンドのスレッドがそこまで読み終えるのを待つ
+    std::vector<std::pair<RGYLogRing *, uint32_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mtxRings);
+        for (const auto& r : m_rings) {
+            targets.push_back(std::make_pair(r.get(), r->produced()));
+        }
+    }
+    auto done = [&targets]() {
+        for (const auto& t : targets) {
+            if ((int32_t)(t.first->consumed() - t.second) < 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    std::unique_lock<std::mutex> lock(m_mtxWake);
+    while (!done() && !m_abort) {
+        m_cvWake.notify_one();
+        const auto count = m_drainCount;
+        m_cvDrained.wait_for(lock, std::chrono::milliseconds(50), [&]() { return m_drainCount != count; });
+    }
+}
+
+const RGYLogFormat *RGYLogAsync::format(uint32_t id) {
+    if (id >= m_formats.size()) {
+        m_formats.resize(id + 1, nullptr);
+        m_formatWritten.resize(id + 1, false);
+    }
+    if (m_formats[id] == nullptr) {
+        m_formats[id] = rgy_log_format_get(id);
+    }
+    return m_formats[id];
+}
+
+void RGYLogAsync::writeBinary(const RGYLogRecordHeader *header, const uint8_t *payload, const RGYLogFormat *fmt) {
+    if (fmt && !m_formatWritten[fmt->id]) {
+        //はじめて使用するフォーマットは、先に定義を書き込む
+        RGYLogRecordHeader def;
+        memset(&def, 0, sizeof(def));
+        def.flags = RGY_LOG_REC_FORMAT_DEF;
+        def.formatId = fmt->id;
+        def.payloadSize = (uint32_t)(fmt->format.length() * sizeof(TCHAR));
+        fwrite(&def, 1, sizeof(def), m_fpBin);
+        fwrite(fmt->format.c_str(), 1, def.payloadSize, m_fpBin);
+        m_formatWritten[fmt->id] = true;
+    }
+    fwrite(header, 1, sizeof(RGYLogRecordHeader), m_fpBin);
+    fwrite(payload, 1, header->payloadSize, m_fpBin);
+}
+
+bool RGYLogAsync::drain() {
+    std::vector<RGYLogRing *> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_mtxRings);
+        for (const auto& r : m_rings) {
+            rings.push_back(r.get());
+        }
+    }
+    bool processed = false;
+    for (;;) {
+        //各スレッドのリングの先頭から、もっとも古いレコードを順に取り出す
+        RGYLogRing *target = nullptr;
+        int64_t oldest = INT64_MAX;
+        for (auto r : rings) {
+            auto header = r->front();
+            if (header && header->timestamp < oldest) {
+                oldest = header->timestamp;
+                target = r;
+            }
+        }
+        if (target == nullptr) {
+            break;
+        }
+        target->pop(m_recordBuf);
+        processed = true;
+        const auto header = (const RGYLogRecordHeader *)m_recordBuf.data();
+        const uint8_t *payload = m_recordBuf.data() + sizeof(RGYLogRecordHeader);
+        const auto fmt = (header->flags & RGY_LOG_REC_TEXT) ? nullptr : format(header->formatId);
+        const bool toConsole = !(header->flags & RGY_LOG_REC_FILE_ONLY);
+        if (m_logMode == RGY_LOG_MODE_BINARY) {
+            if (m_fpBin) {
+                writeBinary(header, payload, fmt);
+            }
+            if (toConsole && header->level >= RGY_LOG_INFO) {
+                m_lines.push_back({ header->level, false, true, rgy_log_format_record(header, payload, fmt) });
+            }
+        } else {
+            m_lines.push_back({ header->level, true, toConsole, rgy_log_format_record(header, payload, fmt) });
+        }
+        if (m_lines.size() >= 1024) {
+            m_log->write_log_lines(m_lines.data(), m_lines.size());
+            m_lines.clear();
+        }
+    }
+    if (m_lines.size() > 0) {
+        m_log->write_log_lines(m_lines.data(), m_lines.size());
+        m_lines.clear();
+    }
+    if (processed && m_fpBin) {
+        fflush(m_fpBin);
+    }
+    return processed;
+}
+
+void RGYLogAsync::run() {
+    for (;;) {
+        const bool aborting = m_abort;
+        drain();
+        {
+            std::unique_lock<std::mutex> lock(m_mtxWake);
+            m_drainCount++;
+            m_cvDrained.notify_all();
+            if (aborting) {
+                break;
+            }
+            m_cvWake.wait_for(lock, std::chrono::milliseconds(5));
+        }
+    }
+}
+
+int rgy_log_decode(FILE *fp, const TCHAR *binLogPath) {
+    std::ifstream fin(binLogPath, std::ios::in | std::ios::binary);
+    if (!fin.good()) {
+        _ftprintf(stderr, _T("Failed to open \"%s\".\n"), binLogPath);
+        return 1;
+    }
+    RGYLogBinHeader header;
+    if (!fin.read((char *)&header, sizeof(header))
+        || header.magic != RGY_LOG_BIN_MAGIC
+        || header.headerSize < sizeof(header)) {
+        _ftprintf(stderr, _T("\"%s\" is not a binary log.\n"), binLogPath);
+        return 1;
+    }
+    if (header.version != RGY_LOG_BIN_VERSION
+        || header.tcharSize != sizeof(TCHAR)
+        || header.wcharSize != sizeof(wchar_t)) {
+        _ftprintf(stderr, _T("\"%s\" was written by an incompatible version.\n"), binLogPath);
+        return 1;
+    }
+    fin.seekg(header.headerSize, std::ios::beg);
+
+    const time_t startTime = (time_t)(header.startTime / 1000000);
+    char timeStr[64] = { 0 };
+#if defined(_WIN32) || defined(_WIN64)
+    struct tm tmStart = {};
+    if (localtime_s(&tmStart, &startTime) == 0) {
+        strftime(timeStr, _countof(timeStr), "%Y-%m-%d %H:%M:%S", &tmStart);
+    }
+#else
+    struct tm tmStart = {};
+    if (localtime_r(&startTime, &tmStart)) {
+        strftime(timeStr, _countof(timeStr), "%Y-%m-%d %H:%M:%S", &tmStart);
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    _ftprintf(fp, _T("# log started at %s, log level: %s\n"), char_to_tstring(timeStr).c_str(), get_chr_from_value(list_log_level, header.logLevel));
+
+    std::map<uint32_t, RGYLogFormat> formats;
+    std::vector<uint8_t> payload;
+    RGYLogRecordHeader rec;
+    int records = 0;
+    while (fin.read((char *)&rec, sizeof(rec))) {
+        payload.resize(rec.payloadSize);
+        if (rec.payloadSize > 0 && !fin.read((char *)payload.data(), rec.payloadSize)) {
+            _ftprintf(stderr, _T("Unexpected end of file at record %d.\n"), records);
+            break;
+        }
+        if (rec.flags & RGY_LOG_REC_FORMAT_DEF) {
+            RGYLogFormat fmt;
+            fmt.id = rec.formatId;
+            fmt.format = tstring((const TCHAR *)payload.data(), rec.payloadSize / sizeof(TCHAR));
+            fmt.supported = rgy_log_parse_format(fmt.format.c_str(), fmt.pieces);
+            formats[fmt.id] = fmt;
+            continue;
+        }
+        records++;
+        const RGYLogFormat *fmt = nullptr;
+        if (!(rec.flags & RGY_LOG_REC_TEXT)) {
+            auto it = formats.find(rec.formatId);
+            fmt = (it != formats.end()) ? &it->second : nullptr;
+        }
+        const auto str = rgy_log_format_record(&rec, payload.data(), fmt);
+        const TCHAR *levelStr = get_chr_from_value(list_log_level, rec.level);
+        for (const auto& line : split(str, _T("\n"))) {
+            if (line.length() > 0) {
+                _ftprintf(fp, _T("[%12.6f][%6u][%-5s] %s\n"), rec.timestamp * 1e-9, rec.threadId, levelStr ? levelStr : _T("?"), line.c_str());
+            }
+        }
+    }
+    return 0;
+}
+
+static void rgy_log_bench_write(RGYLog *log, const TCHAR *prefix, const TCHAR *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log->write_va(RGY_LOG_DEBUG, prefix, format, args, true);
+    va_end(args);
+}
+
+//ファイルを行ごとに読み込む
+static std::vector<std::string> rgy_log_bench_read_lines(const tstring& path) {
+    std::vector<std::string> lines;
+    std::ifstream fin(path);
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.length() > 0) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+int rgy_log_bench(FILE *fp) {
+    static const int MESSAGES_PER_THREAD = 20000;
+    static const int thread_list[] = { 1, 4 };
+    static const struct {
+        int mode;
+        const TCHAR *name;
+    } mode_list[] = {
+        { RGY_LOG_MODE_SYNC,   _T("sync") },
+        { RGY_LOG_MODE_ASYNC,  _T("async") },
+        { RGY_LOG_MODE_BINARY, _T("binary") },
+    };
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR tempDir[1024] = { 0 };
+    GetTempPath(_countof(tempDir), tempDir);
+    const tstring tempBase = PathCombineS(tstring(tempDir), strsprintf(_T("rgy_log_bench_%d"), GetCurrentProcessId()));
+#else
+    const tstring tempBase = strsprintf(_T("/tmp/rgy_log_bench_%d"), (int)getpid());
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    int ret = 0;
+    _ftprintf(fp, _T("mode,threads,messages,ns/message (producer),ns/message (incl. output),verify\n"));
+    for (const int threads : thread_list) {
+        std::vector<std::string> syncLines;
+        for (const auto& mode : mode_list) {
+            const tstring logPath = tempBase + _T("_") + mode.name + _T(".log");
+            _tremove(logPath.c_str());
+            double producerNs = 0.0, totalNs = 0.0;
+            {
+                RGYLog log(logPath.c_str(), RGY_LOG_DEBUG, mode.mode);
+                const auto start = std::chrono::high_resolution_clock::now();
+                std::vector<std::thread> workers;
+                std::vector<double> elapsed(threads, 0.0);
+                for (int ith = 0; ith < threads; ith++) {
+                    workers.push_back(std::thread([&, ith]() {
+                        const auto t0 = std::chrono::high_resolution_clock::now();
+                        const tstring name = strsprintf(_T("worker%d"), ith);
+                        for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+                            rgy_log_bench_write(&log, _T("bench: "), _T("%s frame %d, pts %lld, size %u, %.3f ms, %s\n"),
+                                name.c_str(), i, (long long)i * 1001, (uint32_t)(i * 37 % 100000), i * 0.125, (i & 1) ? _T("key") : _T("non-key"));
+                        }
+                        elapsed[ith] = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - t0).count();
+                    }));
+                }
+                for (auto& w : workers) {
+                    w.join();
+                }
+                for (auto e : elapsed) {
+                    producerNs = (std::max)(producerNs, e);
+                }
+                log.flush();
+                totalNs = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+            std::vector<std::string> lines;
+            if (mode.mode == RGY_LOG_MODE_BINARY) {
+                const tstring decodedPath = logPath + _T(".txt");
+                FILE *fpDecoded = nullptr;
+                if (0 == _tfopen_s(&fpDecoded, decodedPath.c_str(), _T("w")) && fpDecoded) {
+                    rgy_log_decode(fpDecoded, logPath.c_str());
+                    fclose(fpDecoded);
+                }
+                //"[時刻][スレッド][レベル] "を取り除いて比較する
+                for (const auto& line : rgy_log_bench_read_lines(decodedPath)) {
+                    const auto pos = line.find("] ");
+                    if (line[0] == '[' && pos != std::string::npos) {
+                        lines.push_back(line.substr(pos + 2));
+                    }
+                }
+                _tremove(decodedPath.c_str());
+            } else {
+                lines = rgy_log_bench_read_lines(logPath);
+            }
+            _tremove(logPath.c_str());
+            //スレッド間の順序は保証されないので、並べ替えて比較する
+            std::sort(lines.begin(), lines.end());
+            if (mode.mode == RGY_LOG_MODE_SYNC) {
+                syncLines = lines;
+            }
+            const bool verify = lines.size() == (size_t)threads * MESSAGES_PER_THREAD && lines == syncLines;
+            if (!verify) ret = 1;
+            const double messages = (double)threads * MESSAGES_PER_THREAD;
+            _ftprintf(fp, _T("%s,%d,%d,%.1f,%.1f,%s\n"), mode.name, threads, (int)messages,
+                producerNs / MESSAGES_PER_THREAD, totalNs / messages, (verify) ? _T("OK") : _T("NG"));
+            fflush(fp);
+        }
+    }
+    return ret;
+}
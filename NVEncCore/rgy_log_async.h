@@ -0,0 +1,212 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_LOG_ASYNC_H__
+#define __RGY_LOG_ASYNC_H__
+
+#include <cstdint>
+#include <cstdarg>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+
+class RGYLog;
+struct RGYLogLine;
+
+//非同期ログ
+//
+//ログを書き込むスレッドは書式化を行わず、フォーマット文字列のIDと引数をそのままレコードとして
+//スレッドごとのリング (単一生産者/単一消費者) に書き込むだけにし、
+//書式化とファイル/コンソールへの出力はバックグラウンドのスレッドでまとめて行う
+//
+//RGY_LOG_MODE_BINARYでは、ログファイルにはレコードをそのまま書き込み、
+//コンソールにはRGY_LOG_INFO以上のみを出力する
+//ログファイルはrgy_log_decode()でテキストに変換する
+
+static const uint32_t RGY_LOG_BIN_MAGIC = 0x474c4752; //'RGLG'
+static const uint32_t RGY_LOG_BIN_VERSION = 1;
+static const int RGY_LOG_REC_SLOT_SIZE = 128;  //リングに書き込む単位
+static const int RGY_LOG_REC_SLOTS_MAX = 64;   //1レコードの最大スロット数 (これを超える引数は切り詰める)
+static const int RGY_LOG_RING_SLOTS = 8192;    //スレッドごとのリングのスロット数 (2のべき乗)
+
+enum RGYLogArgType : uint8_t {
+    RGY_LOG_ARG_INT = 0, //int (char, shortを含む)
+    RGY_LOG_ARG_LONG,    //long
+    RGY_LOG_ARG_INT64,   //long long
+    RGY_LOG_ARG_SIZE,    //size_t, ptrdiff_t
+    RGY_LOG_ARG_DOUBLE,  //double
+    RGY_LOG_ARG_LDOUBLE, //long double
+    RGY_LOG_ARG_PTR,     //void *
+    RGY_LOG_ARG_STR,     //char *
+    RGY_LOG_ARG_WSTR,    //wchar_t *
+};
+
+enum RGYLogRecordFlag : uint8_t {
+    RGY_LOG_REC_TEXT       = 0x01, //書式化済みの文字列
+    RGY_LOG_REC_PREFIX     = 0x02, //先頭の引数は各行の先頭に付加する文字列
+    RGY_LOG_REC_FILE_ONLY  = 0x04, //ファイルにのみ出力する
+    RGY_LOG_REC_TRUNCATED  = 0x08, //引数が切り詰められている
+    RGY_LOG_REC_FORMAT_DEF = 0x10, //(バイナリログのみ) フォーマット文字列の定義
+};
+
+#pragma pack(push, 8)
+struct RGYLogRecordHeader {
+    uint16_t slots;       //リング上のスロット数
+    int8_t   level;       //RGY_LOG_xxx
+    uint8_t  flags;       //RGYLogRecordFlag
+    uint32_t formatId;    //フォーマット文字列のID (RGY_LOG_REC_TEXTなら0)
+    uint32_t threadId;
+    uint32_t payloadSize; //ヘッダに続く引数のサイズ (byte)
+    int64_t  timestamp;   //ログの開始からの経過時間 (ns)
+};
+static_assert(sizeof(RGYLogRecordHeader) == 24, "RGYLogRecordHeader must be 24 bytes.");
+
+struct RGYLogBinHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t tcharSize;   //sizeof(TCHAR)
+    uint32_t wcharSize;   //sizeof(wchar_t)
+    int32_t  logLevel;
+    int64_t  startTime;   //ログの開始時刻 (UNIX時間, us)
+};
+#pragma pack(pop)
+
+//フォーマット文字列を解析した結果
+struct RGYLogFormatPiece {
+    tstring str;          //リテラル、または変換指定 ("%5.2f"など)
+    bool literal;
+    int starCount;        //幅/精度に'*'を使用している数 (値の前にintとして渡される)
+    RGYLogArgType type;
+};
+
+struct RGYLogFormat {
+    uint32_t id;
+    tstring format;
+    bool supported;       //falseなら書き込むスレッドで書式化する (%nなど)
+    std::vector<RGYLogFormatPiece> pieces;
+};
+
+//フォーマット文字列を解析する
+bool rgy_log_parse_format(const TCHAR *format, std::vector<RGYLogFormatPiece>& pieces);
+//フォーマット文字列を登録し、IDを取得する (プロセス全体で共通)
+const RGYLogFormat *rgy_log_format_register(const TCHAR *format);
+//レコードを書式化する (prefixがある場合は行ごとに付加する)
+tstring rgy_log_format_record(const RGYLogRecordHeader *header, const uint8_t *payload, const RGYLogFormat *format);
+
+class RGYLogRing {
+public:
+    RGYLogRing(uint32_t threadId);
+    ~RGYLogRing();
+    uint32_t threadId() const { return m_threadId; }
+
+    //producer: レコードを書き込む (空きがなければfalse)
+    bool push(const uint8_t *record, uint32_t size, uint32_t slots);
+
+    //consumer: 先頭のレコードのヘッダを取得する (なければnullptr)
+    const RGYLogRecordHeader *front() const;
+    //consumer: 先頭のレコードをbufにコピーして取り除く
+    void pop(std::vector<uint8_t>& buf);
+    //consumer: 読み込み済みの位置
+    uint32_t consumed() const { return m_tail.load(std::memory_order_acquire); }
+    //書き込み済みの位置
+    uint32_t produced() const { return m_head.load(std::memory_order_acquire); }
+protected:
+    uint8_t *slotPtr(uint32_t index) const {
+        return m_buf + (size_t)(index & (RGY_LOG_RING_SLOTS - 1)) * RGY_LOG_REC_SLOT_SIZE;
+    }
+
+    uint8_t *m_buf;
+    uint32_t m_threadId;
+    uint8_t m_pad0[64];
+    std::atomic<uint32_t> m_head; //producerが書き込んだスロット数
+    uint8_t m_pad1[64];
+    std::atomic<uint32_t> m_tail; //consumerが読み終えたスロット数
+    uint8_t m_pad2[64];
+};
+
+class RGYLogAsync {
+public:
+    RGYLogAsync(RGYLog *log, int logMode, int logLevel, const TCHAR *logFile);
+    ~RGYLogAsync();
+
+    //書式化せずにレコードとしてリングに書き込む
+    //非対応の書式の場合はfalseを返すので、呼び出し元で書式化してpushTextを呼ぶ
+    bool push(int log_level, const TCHAR *prefix, const TCHAR *format, va_list args, bool file_only);
+    //書式化済みの文字列をリングに書き込む
+    void pushText(int log_level, const TCHAR *text, bool file_only);
+    //ここまでに書き込まれたレコードがすべて出力されるまで待機する
+    void flush();
+protected:
+    RGYLogRing *ring();
+    void pushRecord(uint8_t *record, uint32_t size);
+    void run();
+    //すべてのリングのレコードを出力する (出力したレコードがなければfalse)
+    bool drain();
+    void writeBinary(const RGYLogRecordHeader *header, const uint8_t *payload, const RGYLogFormat *format);
+    const RGYLogFormat *format(uint32_t id);
+
+    RGYLog *m_log;
+    int m_logMode;
+    uint64_t m_instanceId;
+    std::chrono::steady_clock::time_point m_start;
+
+    std::mutex m_mtxRings;
+    std::vector<std::unique_ptr<RGYLogRing>> m_rings;
+
+    std::mutex m_mtxWake;
+    std::condition_variable m_cvWake;     //バックグラウンドのスレッドを起こす
+    std::condition_variable m_cvDrained;  //バックグラウンドのスレッドが一巡した
+    uint64_t m_drainCount;                //m_mtxWakeで保護
+    std::atomic<bool> m_abort;
+    std::thread m_thread;
+
+    //以下はバックグラウンドのスレッドのみが使用する
+    FILE *m_fpBin;
+    std::vector<uint8_t> m_recordBuf;
+    std::vector<RGYLogLine> m_lines;
+    std::vector<const RGYLogFormat *> m_formats;
+    std::vector<bool> m_formatWritten;
+};
+
+//バイナリログをテキストに変換して出力する
+int rgy_log_decode(FILE *fp, const TCHAR *binLogPath);
+
+//同期/非同期/バイナリの各モードで複数スレッドからログを書き込む速度を計測し、CSVで出力する
+//あわせて、バイナリログを変換した結果が同期モードの出力と一致するかを確認する
+int rgy_log_bench(FILE *fp);
+
+#endif //__RGY_LOG_ASYNC_H__
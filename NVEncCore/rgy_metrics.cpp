@@ -0,0 +1,695 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+//winsock2.hはWindows.hより前に読み込む必要がある (rgy_osdep.hではWIN32_LEAN_AND_MEANを指定している)
+#if defined(_WIN32) || defined(_WIN64)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif //#if defined(_WIN32) || defined(_WIN64)
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "rgy_version.h"
+#include "rgy_metrics.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+typedef SOCKET rgy_socket_t;
+#define RGY_INVALID_SOCKET INVALID_SOCKET
+#define RGY_SEND_FLAGS 0
+static void rgy_close_socket(rgy_socket_t sock) { closesocket(sock); }
+static uint32_t rgy_metrics_process_id() { return (uint32_t)GetCurrentProcessId(); }
+#else
+typedef int rgy_socket_t;
+#define RGY_INVALID_SOCKET (-1)
+#define RGY_SEND_FLAGS MSG_NOSIGNAL //切断されたソケットへの書き込みでSIGPIPEを発生させない
+static void rgy_close_socket(rgy_socket_t sock) { ::close(sock); }
+static uint32_t rgy_metrics_process_id() { return (uint32_t)getpid(); }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+static const char *RGY_METRICS_CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+//timeout_ms以内に読み込み可能になるか
+static bool rgy_socket_wait_readable(rgy_socket_t sock, int timeout_ms) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    return select((int)(sock + 1), &fds, nullptr, nullptr, &tv) > 0;
+}
+
+static bool rgy_socket_send_all(rgy_socket_t sock, const char *data, size_t size) {
+    while (size > 0) {
+        const int sent = send(sock, data, (int)std::min<size_t>(size, INT_MAX), RGY_SEND_FLAGS);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+RGYMetricsSnapshot::RGYMetricsSnapshot() : m_seq(0) {
+    for (size_t i = 0; i < WORDS; i++) {
+        m_words[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void RGYMetricsSnapshot::publish(const RGYMetricsData& data) {
+    uint64_t words[WORDS] = { 0 };
+    memcpy(words, &data, sizeof(data));
+    //書き込み中は奇数とし、読み出し側に再試行させる
+    const uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) {
+        m_words[i].store(words[i], std::memory_order_relaxed);
+    }
+    m_seq.store(seq + 2, std::memory_order_release);
+}
+
+bool RGYMetricsSnapshot::read(RGYMetricsData& data) const {
+    uint64_t words[WORDS];
+    for (;;) {
+        const uint32_t seq0 = m_seq.load(std::memory_order_acquire);
+        if (seq0 == 0) {
+            return false;
+        }
+        if (seq0 & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_seq.load(std::memory_order_relaxed) == seq0) {
+            break;
+        }
+    }
+    memcpy(&data, words, sizeof(data));
+    return true;
+}
+
+//メトリクスの名前の先頭に付加する文字列 ("nvencc")
+static std::string rgy_metrics_prefix() {
+    std::string prefix = ENCODER_NAME;
+    for (auto& c : prefix) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return prefix;
+}
+
+class RGYMetricsWriter {
+public:
+    RGYMetricsWriter(std::string& str) : m_str(str), m_prefix(rgy_metrics_prefix()) {};
+    //メトリクスの種類を宣言する (unitを指定する場合、nameはunitで終わること)
+    void family(const char *name, const char *type, const char *unit, const char *help) {
+        m_str += strsprintf("# TYPE %s_%s %s\n", m_prefix.c_str(), name, type);
+        if (unit) {
+            m_str += strsprintf("# UNIT %s_%s %s\n", m_prefix.c_str(), name, unit);
+        }
+        m_str += strsprintf("# HELP %s_%s %s\n", m_prefix.c_str(), name, help);
+    }
+    void sample(const char *name, const char *suffix, const char *labels, uint64_t value) {
+        m_str += strsprintf("%s_%s%s%s %llu\n", m_prefix.c_str(), name, suffix, labels, (unsigned long long)value);
+    }
+    void sample(const char *name, const char *suffix, const char *labels, double value) {
+        m_str += strsprintf("%s_%s%s%s %.3f\n", m_prefix.c_str(), name, suffix, labels, value);
+    }
+    void counter(const char *name, const char *unit, const char *help, uint64_t value) {
+        family(name, "counter", unit, help);
+        sample(name, "_total", "", value);
+    }
+    void gauge(const char *name, const char *unit, const char *help, double value) {
+        family(name, "gauge", unit, help);
+        sample(name, "", "", value);
+    }
+private:
+    std::string& m_str;
+    std::string m_prefix;
+};
+
+std::string rgy_metrics_render(const RGYMetricsData *data) {
+    std::string str;
+    RGYMetricsWriter w(str);
+    w.family("build", "info", nullptr, "Encoder version.");
+    w.sample("build", "_info", strsprintf("{version=\"%s\",pid=\"%u\"}", tchar_to_string(VER_STR_FILEVERSION_TCHAR).c_str(), rgy_metrics_process_id()).c_str(), (uint64_t)1);
+    if (data == nullptr) {
+        str += "# EOF\n";
+        return str;
+    }
+    const auto& enc = data->enc;
+    const auto& perf = data->perf;
+    w.gauge("last_update_timestamp_seconds", "seconds", "Time when the metrics were last updated.", data->updateTimeMs * 1e-3);
+    w.gauge("encode_started", nullptr, "1 if the encode has started.", (double)(data->encStarted ? 1 : 0));
+
+    //EncodeStatusData
+    w.gauge("frames_expected", nullptr, "Number of frames expected to be encoded (0 if unknown).", (double)enc.frameTotal);
+    w.counter("frames_in", nullptr, "Frames passed to the encoder.", enc.frameIn);
+    w.counter("frames_out", nullptr, "Frames output from the encoder.", enc.frameOut);
+    w.counter("frames_dropped", nullptr, "Frames dropped before the encoder.", enc.frameDrop);
+    w.counter("frames_out_idr", nullptr, "IDR frames output from the encoder.", enc.frameOutIDR);
+    w.family("frames_out_by_type", "counter", nullptr, "Frames output from the encoder by picture type.");
+    w.sample("frames_out_by_type", "_total", "{type=\"I\"}", (uint64_t)enc.frameOutI);
+    w.sample("frames_out_by_type", "_total", "{type=\"P\"}", (uint64_t)enc.frameOutP);
+    w.sample("frames_out_by_type", "_total", "{type=\"B\"}", (uint64_t)enc.frameOutB);
+    w.family("frame_bytes", "counter", "bytes", "Encoded size by picture type.");
+    w.sample("frame_bytes", "_total", "{type=\"I\"}", enc.frameOutISize);
+    w.sample("frame_bytes", "_total", "{type=\"P\"}", enc.frameOutPSize);
+    w.sample("frame_bytes", "_total", "{type=\"B\"}", enc.frameOutBSize);
+    w.family("frame_qp_sum", "counter", nullptr, "Sum of QP by picture type (divide by frames_out_by_type for the average QP).");
+    w.sample("frame_qp_sum", "_total", "{type=\"I\"}", (uint64_t)enc.frameOutIQPSum);
+    w.sample("frame_qp_sum", "_total", "{type=\"P\"}", (uint64_t)enc.frameOutPQPSum);
+    w.sample("frame_qp_sum", "_total", "{type=\"B\"}", (uint64_t)enc.frameOutBQPSum);
+    w.counter("output_bytes", "bytes", "Size of the encoded video stream.", enc.outFileSize);
+    w.counter("input_bytes", "bytes", "Size of the frame data read from the input.", enc.inputBytes);
+
+    //PerfInfo
+    if (data->perfValid) {
+        w.gauge("encode_fps", nullptr, "Encode speed over the last update interval.", perf.fps);
+        w.gauge("encode_fps_avg", nullptr, "Average encode speed.", perf.fps_avg);
+        w.gauge("bitrate_kbps", nullptr, "Bitrate over the last update interval.", perf.bitrate_kbps);
+        w.gauge("bitrate_kbps_avg", nullptr, "Average bitrate.", perf.bitrate_kbps_avg);
+        w.gauge("cpu_percent", nullptr, "CPU usage of the process.", perf.cpu_percent);
+        w.gauge("cpu_kernel_percent", nullptr, "Kernel CPU usage of the process.", perf.cpu_kernel_percent);
+        w.family("thread_cpu_percent", "gauge", nullptr, "CPU usage by thread.");
+        static const std::pair<const char *, ptrdiff_t> threads[] = {
+            { "main",       offsetof(PerfInfo, main_thread_percent) },
+            { "encode",     offsetof(PerfInfo, enc_thread_percent) },
+            { "input",      offsetof(PerfInfo, in_thread_percent) },
+            { "output",     offsetof(PerfInfo, out_thread_percent) },
+            { "audio_proc", offsetof(PerfInfo, aud_proc_thread_percent) },
+            { "audio_enc",  offsetof(PerfInfo, aud_enc_thread_percent) },
+            { "pool",       offsetof(PerfInfo, pool_thread_percent) },
+        };
+        for (const auto& th : threads) {
+            w.sample("thread_cpu_percent", "", strsprintf("{thread=\"%s\"}", th.first).c_str(), *(const double *)((const uint8_t *)&perf + th.second));
+        }
+        w.gauge("memory_private_bytes", "bytes", "Private memory used by the process.", (double)perf.mem_private);
+        w.family("io_bytes_per_second", "gauge", nullptr, "IO throughput.");
+        w.sample("io_bytes_per_second", "", "{direction=\"read\"}", perf.io_read_per_sec);
+        w.sample("io_bytes_per_second", "", "{direction=\"write\"}", perf.io_write_per_sec);
+        w.sample("io_bytes_per_second", "", "{direction=\"input\"}", perf.io_input_per_sec);
+        if (perf.gpu_info_valid) {
+            w.gauge("gpu_load_percent", nullptr, "GPU load.", perf.gpu_load_percent);
+            w.gauge("gpu_clock_mhz", nullptr, "GPU core clock.", perf.gpu_clock);
+            w.family("video_engine_load_percent", "gauge", nullptr, "Video engine load.");
+            w.sample("video_engine_load_percent", "", "{engine=\"encode\"}", perf.vee_load_percent);
+            w.sample("video_engine_load_percent", "", "{engine=\"decode\"}", perf.ved_load_percent);
+            w.gauge("video_engine_clock_mhz", nullptr, "Video engine clock.", perf.ve_clock);
+        }
+    }
+
+    //PerfQueueInfo
+    w.family("queue_usage", "gauge", nullptr, "Number of items in the queues between the pipeline threads.");
+    w.sample("queue_usage", "", "{queue=\"video_in\"}",   (uint64_t)data->queue.usage_vid_in);
+    w.sample("queue_usage", "", "{queue=\"audio_in\"}",   (uint64_t)data->queue.usage_aud_in);
+    w.sample("queue_usage", "", "{queue=\"video_out\"}",  (uint64_t)data->queue.usage_vid_out);
+    w.sample("queue_usage", "", "{queue=\"audio_out\"}",  (uint64_t)data->queue.usage_aud_out);
+    w.sample("queue_usage", "", "{queue=\"audio_enc\"}",  (uint64_t)data->queue.usage_aud_enc);
+    w.sample("queue_usage", "", "{queue=\"audio_proc\"}", (uint64_t)data->queue.usage_aud_proc);
+
+    //トラックごとの音声処理 (--audio-track-thread)
+    const int audTrackNum = (std::min)(data->queue.aud_track_num, PERF_MONITOR_AUD_TRACK_MAX);
+    if (audTrackNum > 0) {
+        w.family("audio_track_processed_seconds", "counter", "seconds", "Duration of the audio processed by the per-track audio threads.");
+        for (int i = 0; i < audTrackNum; i++) {
+            w.sample("audio_track_processed_seconds", "_total", strsprintf("{track=\"%d\"}", data->queue.aud_track_id[i]).c_str(), data->queue.aud_track_time_us[i] * 1e-6);
+        }
+        if (data->perfValid) {
+            w.family("audio_track_speed", "gauge", nullptr, "Audio processing speed of each track relative to realtime.");
+            for (int i = 0; i < audTrackNum; i++) {
+                w.sample("audio_track_speed", "", strsprintf("{track=\"%d\"}", data->queue.aud_track_id[i]).c_str(), data->perf.aud_track_speed[i]);
+            }
+        }
+    }
+    str += "# EOF\n";
+    return str;
+}
+
+RGYMetricsServer::RGYMetricsServer() :
+    m_log(),
+    m_snapshot(),
+    m_listen(),
+    m_unixPath(),
+    m_sock((intptr_t)RGY_INVALID_SOCKET),
+    m_port(-1),
+    m_wsaInit(false),
+    m_abort(false),
+    m_requests(0),
+    m_thread() {
+}
+
+RGYMetricsServer::~RGYMetricsServer() {
+    close();
+}
+
+RGY_ERR RGYMetricsServer::init(const tstring& listen, std::shared_ptr<RGYLog> log) {
+    m_listen = listen;
+    m_log = log;
+#if defined(_WIN32) || defined(_WIN64)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: failed to initialize winsock.\n"));
+        return RGY_ERR_UNKNOWN;
+    }
+    m_wsaInit = true;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    const std::string addr = tchar_to_string(listen);
+    rgy_socket_t sock = RGY_INVALID_SOCKET;
+    if (addr.substr(0, 5) == "unix:") {
+#if defined(_WIN32) || defined(_WIN64)
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: unix domain socket is not supported on this platform.\n"));
+        return RGY_ERR_UNSUPPORTED;
+#else
+        sockaddr_un addrUnix;
+        memset(&addrUnix, 0, sizeof(addrUnix));
+        addrUnix.sun_family = AF_UNIX;
+        m_unixPath = addr.substr(5);
+        if (m_unixPath.length() == 0 || m_unixPath.length() >= sizeof(addrUnix.sun_path)) {
+            if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: invalid socket path \"%s\".\n"), char_to_tstring(m_unixPath).c_str());
+            m_unixPath.clear();
+            return RGY_ERR_INVALID_PARAM;
+        }
+        strcpy(addrUnix.sun_path, m_unixPath.c_str());
+        //前回の実行で残ったソケットは削除する
+        struct stat st;
+        if (stat(m_unixPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(m_unixPath.c_str());
+        }
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock == RGY_INVALID_SOCKET
+            || bind(sock, (const sockaddr *)&addrUnix, sizeof(addrUnix)) != 0) {
+            if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: failed to bind \"%s\".\n"), char_to_tstring(m_unixPath).c_str());
+            if (sock != RGY_INVALID_SOCKET) rgy_close_socket(sock);
+            m_unixPath.clear();
+            return RGY_ERR_UNKNOWN;
+        }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    } else {
+        //<port>, <addr>:<port>, [<ipv6 addr>]:<port>
+        std::string host = "127.0.0.1", port = addr;
+        const auto pos = addr.rfind(':');
+        if (pos != std::string::npos) {
+            host = addr.substr(0, pos);
+            port = addr.substr(pos + 1);
+            if (host.length() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.length() - 2);
+            }
+        }
+        char *end = nullptr;
+        const long portValue = strtol(port.c_str(), &end, 10);
+        if (port.length() == 0 || *end != '\0' || portValue < 0 || portValue > 65535) {
+            if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: invalid port \"%s\".\n"), char_to_tstring(port).c_str());
+            return RGY_ERR_INVALID_PARAM;
+        }
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr) {
+            if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: failed to resolve \"%s\".\n"), char_to_tstring(host).c_str());
+            return RGY_ERR_INVALID_PARAM;
+        }
+        for (auto ai = result; ai; ai = ai->ai_next) {
+            sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock == RGY_INVALID_SOCKET) {
+                continue;
+            }
+#if !(defined(_WIN32) || defined(_WIN64))
+            //Windowsでは同じポートを他のプロセスと共有できてしまうので指定しない
+            int reuse = 1;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+            if (bind(sock, ai->ai_addr, (int)ai->ai_addrlen) == 0) {
+                break;
+            }
+            rgy_close_socket(sock);
+            sock = RGY_INVALID_SOCKET;
+        }
+        freeaddrinfo(result);
+        if (sock == RGY_INVALID_SOCKET) {
+            if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: failed to bind \"%s\".\n"), listen.c_str());
+            return RGY_ERR_UNKNOWN;
+        }
+        sockaddr_storage bound;
+        socklen_t boundLen = sizeof(bound);
+        if (getsockname(sock, (sockaddr *)&bound, &boundLen) == 0) {
+            m_port = ntohs((bound.ss_family == AF_INET6) ? ((sockaddr_in6 *)&bound)->sin6_port : ((sockaddr_in *)&bound)->sin_port);
+        }
+    }
+    if (::listen(sock, 16) != 0) {
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("metrics: failed to listen \"%s\".\n"), listen.c_str());
+        rgy_close_socket(sock);
+        return RGY_ERR_UNKNOWN;
+    }
+    m_sock = (intptr_t)sock;
+    m_abort = false;
+    m_thread = std::thread(&RGYMetricsServer::run, this);
+    if (m_log) {
+        if (m_port >= 0) {
+            m_log->write(RGY_LOG_INFO, _T("metrics: serving on port %d (GET /metrics).\n"), m_port);
+        } else {
+            m_log->write(RGY_LOG_INFO, _T("metrics: serving on %s (GET /metrics).\n"), listen.c_str());
+        }
+    }
+    return RGY_ERR_NONE;
+}
+
+void RGYMetricsServer::close() {
+    if (m_thread.joinable()) {
+        m_abort = true;
+        m_thread.join();
+    }
+    if ((rgy_socket_t)m_sock != RGY_INVALID_SOCKET) {
+        rgy_close_socket((rgy_socket_t)m_sock);
+        m_sock = (intptr_t)RGY_INVALID_SOCKET;
+    }
+#if !(defined(_WIN32) || defined(_WIN64))
+    if (m_unixPath.length() > 0) {
+        unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+    }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_wsaInit) {
+        WSACleanup();
+        m_wsaInit = false;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    if (m_log && m_requests > 0) {
+        m_log->write(RGY_LOG_DEBUG, _T("metrics: served %llu requests.\n"), (unsigned long long)m_requests.load());
+    }
+    m_log.reset();
+}
+
+void RGYMetricsServer::run() {
+    const rgy_socket_t listenSock = (rgy_socket_t)m_sock;
+    while (!m_abort) {
+        //終了の確認のため、一定時間ごとに戻る
+        if (!rgy_socket_wait_readable(listenSock, 100)) {
+            continue;
+        }
+        const rgy_socket_t client = accept(listenSock, nullptr, nullptr);
+        if (client == RGY_INVALID_SOCKET) {
+            continue;
+        }
+        handleClient((intptr_t)client);
+        rgy_close_socket(client);
+    }
+}
+
+void RGYMetricsServer::handleClient(intptr_t sock_) {
+    const rgy_socket_t sock = (rgy_socket_t)sock_;
+    //リクエストヘッダの終わりまで受信する (ボディは扱わない)
+    std::string request;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RGY_METRICS_REQUEST_TIMEOUT_MS);
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        const int remain = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remain <= 0 || m_abort || request.length() > RGY_METRICS_REQUEST_MAX_SIZE
+            || !rgy_socket_wait_readable(sock, remain)) {
+            return;
+        }
+        const int received = recv(sock, buf, sizeof(buf), 0);
+        if (received <= 0) {
+            return;
+        }
+        request.append(buf, received);
+    }
+    m_requests++;
+
+    //リクエスト行: <method> <path> HTTP/1.x
+    const auto lineEnd = request.find("\r\n");
+    const auto sp0 = request.find(' ');
+    const auto sp1 = (sp0 < lineEnd) ? request.find(' ', sp0 + 1) : std::string::npos;
+    const std::string method = (sp0 < lineEnd) ? request.substr(0, sp0) : std::string();
+    std::string path = (sp1 < lineEnd) ? request.substr(sp0 + 1, sp1 - sp0 - 1) : std::string();
+    path = path.substr(0, path.find('?'));
+
+    const char *status = "200 OK";
+    const char *contentType = RGY_METRICS_CONTENT_TYPE;
+    std::string body;
+    if (method != "GET" && method != "HEAD") {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain; charset=utf-8";
+        body = "method not allowed\n";
+    } else if (path != "/metrics") {
+        status = "404 Not Found";
+        contentType = "text/plain; charset=utf-8";
+        body = "not found, metrics are served on /metrics\n";
+    } else {
+        RGYMetricsData data;
+        body = (m_snapshot.read(data)) ? rgy_metrics_render(&data) : rgy_metrics_render(nullptr);
+    }
+    std::string response = strsprintf("HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+        status, contentType, (int)body.length());
+    if (method != "HEAD") {
+        response += body;
+    }
+    rgy_socket_send_all(sock, response.data(), response.length());
+}
+
+//--check-metrics-bench用の簡易なHTTPクライアント
+static bool metrics_http_get(const std::string& unixPath, int port, const char *path, std::string& response) {
+    response.clear();
+    rgy_socket_t sock = RGY_INVALID_SOCKET;
+    if (unixPath.length() > 0) {
+#if !(defined(_WIN32) || defined(_WIN64))
+        sockaddr_un addrUnix;
+        memset(&addrUnix, 0, sizeof(addrUnix));
+        addrUnix.sun_family = AF_UNIX;
+        strncpy(addrUnix.sun_path, unixPath.c_str(), sizeof(addrUnix.sun_path) - 1);
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock != RGY_INVALID_SOCKET && connect(sock, (const sockaddr *)&addrUnix, sizeof(addrUnix)) != 0) {
+            rgy_close_socket(sock);
+            sock = RGY_INVALID_SOCKET;
+        }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    } else {
+        sockaddr_in sin;
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t)port);
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock != RGY_INVALID_SOCKET && connect(sock, (const sockaddr *)&sin, sizeof(sin)) != 0) {
+            rgy_close_socket(sock);
+            sock = RGY_INVALID_SOCKET;
+        }
+    }
+    if (sock == RGY_INVALID_SOCKET) {
+        return false;
+    }
+    const std::string request = strsprintf("GET %s HTTP/1.1\r\nHost: localhost\r\nAccept: application/openmetrics-text\r\n\r\n", path);
+    bool ok = rgy_socket_send_all(sock, request.data(), request.length());
+    char buf[4096];
+    while (ok && rgy_socket_wait_readable(sock, RGY_METRICS_REQUEST_TIMEOUT_MS)) {
+        const int received = recv(sock, buf, sizeof(buf), 0);
+        if (received <= 0) {
+            break;
+        }
+        response.append(buf, received);
+    }
+    rgy_close_socket(sock);
+    return ok && response.length() > 0;
+}
+
+//レスポンスからサンプルの値を取得する (見つからなければ-1)
+static int64_t metrics_sample_value(const std::string& body, const std::string& sample) {
+    const std::string key = "\n" + sample + " ";
+    const auto pos = body.find(key);
+    return (pos == std::string::npos) ? -1 : strtoll(body.c_str() + pos + key.length(), nullptr, 10);
+}
+
+//書き込み中のデータを読み出しても、各値が同じ回のpublishのものであることを確認できるようにする
+static void metrics_bench_data(RGYMetricsData& data, uint32_t i) {
+    memset(&data, 0, sizeof(data));
+    data.encStarted = 1;
+    data.perfValid = 1;
+    data.enc.frameIn = i;
+    data.enc.frameOut = i;
+    data.enc.frameOutI = i / 16;
+    data.enc.frameOutP = i / 4;
+    data.enc.frameOutB = i - i / 16 - i / 4;
+    data.enc.outFileSize = (uint64_t)i * 1000;
+    data.perf.frames_out = i;
+    data.perf.fps = (double)i;
+    data.queue.usage_vid_out = i;
+}
+
+static bool metrics_bench_consistent(const RGYMetricsData& data) {
+    const uint32_t i = data.enc.frameIn;
+    return data.enc.frameOut == i
+        && data.enc.frameOutI + data.enc.frameOutP + data.enc.frameOutB == i
+        && data.enc.outFileSize == (uint64_t)i * 1000
+        && data.perf.frames_out == i
+        && data.perf.fps == (double)i
+        && data.queue.usage_vid_out == i;
+}
+
+int metrics_server_bench(FILE *fp) {
+    static const int READ_MS = 500;
+    static const int HTTP_REQUESTS = 200;
+    int ret = 0;
+    _ftprintf(fp, _T("mode,threads,count,ns/op,verify\n"));
+
+    //publishとreadを同時に行い、不整合なデータを読み出さないことを確認する
+    for (const int readers : { 1, 4 }) {
+        RGYMetricsSnapshot snapshot;
+        std::atomic<bool> abort(false);
+        std::atomic<uint64_t> publishCount(0);
+        std::thread writer([&]() {
+            RGYMetricsData data;
+            for (uint32_t i = 1; !abort; i++) {
+                metrics_bench_data(data, i);
+                snapshot.publish(data);
+                publishCount++;
+            }
+        });
+        std::vector<std::thread> threads;
+        std::atomic<uint64_t> reads(0), errors(0);
+        std::vector<double> readNs(readers, 0.0);
+        for (int ith = 0; ith < readers; ith++) {
+            threads.push_back(std::thread([&, ith]() {
+                RGYMetricsData data;
+                uint64_t count = 0, error = 0;
+                uint32_t last = 0;
+                const auto start = std::chrono::high_resolution_clock::now();
+                const auto end = start + std::chrono::milliseconds(READ_MS);
+                while (std::chrono::high_resolution_clock::now() < end) {
+                    if (!snapshot.read(data)) {
+                        continue;
+                    }
+                    //値は単調増加し、かつ整合していること
+                    if (!metrics_bench_consistent(data) || data.enc.frameIn < last) {
+                        error++;
+                    }
+                    last = data.enc.frameIn;
+                    count++;
+                }
+                const double ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+                reads += count;
+                errors += error;
+                readNs[ith] = ns / std::max<uint64_t>(count, 1);
+            }));
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        abort = true;
+        writer.join();
+        const bool ok = errors == 0 && reads > 0 && publishCount > 0;
+        _ftprintf(fp, _T("snapshot read,%d,%llu,%.1f,%s\n"), readers, (unsigned long long)reads.load(), *std::max_element(readNs.begin(), readNs.end()), ok ? _T("OK") : _T("NG"));
+        if (!ok) {
+            ret = 1;
+        }
+    }
+
+    //ローカルのサーバーにHTTPで問い合わせて、レスポンスを検証する
+    std::vector<tstring> listenList = { _T("127.0.0.1:0") };
+#if !(defined(_WIN32) || defined(_WIN64))
+    listenList.push_back(strsprintf(_T("unix:/tmp/rgy_metrics_bench_%d.sock"), (int)getpid()));
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    for (const auto& listen : listenList) {
+        const bool isUnix = listen.substr(0, 5) == _T("unix:");
+        const TCHAR *mode = isUnix ? _T("http unix") : _T("http tcp");
+        RGYMetricsServer server;
+        if (server.init(listen, nullptr) != RGY_ERR_NONE) {
+            _ftprintf(fp, _T("%s,1,0,-,NG (failed to listen %s)\n"), mode, listen.c_str());
+            ret = 1;
+            continue;
+        }
+        const std::string unixPath = isUnix ? tchar_to_string(listen.substr(5)) : std::string();
+        std::string response;
+        //publish前は、infoのみを返す
+        bool ok = metrics_http_get(unixPath, server.port(), "/metrics", response)
+            && response.find("\r\n\r\n# TYPE ") != std::string::npos
+            && metrics_sample_value(response, rgy_metrics_prefix() + "_frames_out_total") < 0;
+        //存在しないパスには404を返す
+        ok &= metrics_http_get(unixPath, server.port(), "/", response)
+            && response.substr(0, 12) == "HTTP/1.1 404";
+
+        std::atomic<bool> abort(false);
+        std::thread writer([&]() {
+            RGYMetricsData data;
+            for (uint32_t i = 1; !abort; i++) {
+                metrics_bench_data(data, i);
+                server.publish(data);
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        });
+        const std::string framesIn  = rgy_metrics_prefix() + "_frames_in_total";
+        const std::string framesOut = rgy_metrics_prefix() + "_frames_out_total";
+        const std::string header = strsprintf("HTTP/1.1 200 OK\r\nContent-Type: %s\r\n", RGY_METRICS_CONTENT_TYPE);
+        int64_t last = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < HTTP_REQUESTS && ok; i++) {
+            ok = metrics_http_get(unixPath, server.port(), "/metrics", response);
+            const auto bodyPos = response.find("\r\n\r\n");
+            const auto lengthPos = response.find("Content-Length: ");
+            const int64_t value = metrics_sample_value(response, framesIn);
+            ok = ok
+                && response.substr(0, header.length()) == header
+                && bodyPos != std::string::npos && lengthPos != std::string::npos
+                && strtoll(response.c_str() + lengthPos + 16, nullptr, 10) == (int64_t)(response.length() - bodyPos - 4)
+                && response.length() >= 6 && response.substr(response.length() - 6) == "# EOF\n"
+                && value >= last
+                && value == metrics_sample_value(response, framesOut);
+            last = value;
+        }
+        const double requestNs = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / HTTP_REQUESTS;
+        abort = true;
+        writer.join();
+        ok &= last > 0 && server.requests() == (uint64_t)HTTP_REQUESTS + 2;
+        server.close();
+        _ftprintf(fp, _T("%s,1,%d,%.1f,%s\n"), mode, HTTP_REQUESTS, requestNs, ok ? _T("OK") : _T("NG"));
+        if (!ok) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
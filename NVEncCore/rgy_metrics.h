@@ -0,0 +1,129 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __RGY_METRICS_H__
+#define __RGY_METRICS_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <string>
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+#include "rgy_log.h"
+#include "rgy_status.h"
+#include "rgy_perf_monitor.h"
+
+//エンコードの状況をOpenMetrics (Prometheus) のテキスト形式でHTTPにより公開する
+//
+//CPerfMonitorのスレッドが一定間隔でスナップショットを書き込み (publish)、
+//HTTPのスレッドはseqlockで読み出すので、エンコード側のスレッドは読み出しを一切待たない
+//
+//待ち受け先は --metrics で指定する
+//  <port>           127.0.0.1:<port>
+//  <addr>:<port>    指定したアドレス (0.0.0.0 なら全て)
+//  unix:<path>      Unixドメインソケット (Windows以外)
+
+static const int RGY_METRICS_UPDATE_INTERVAL_MS = 250;  //スナップショットを更新する間隔 (--perf-monitor-intervalの指定がない場合)
+static const int RGY_METRICS_REQUEST_TIMEOUT_MS = 1000; //リクエストの受信を待つ時間
+static const int RGY_METRICS_REQUEST_MAX_SIZE = 8192;   //これを超えるリクエストは受け付けない
+
+//公開するデータ
+struct RGYMetricsData {
+    EncodeStatusData enc;
+    PerfInfo perf;
+    PerfQueueInfo queue;
+    int64_t updateTimeMs;  //更新した時刻 (UNIX時間, ms)
+    int32_t encStarted;    //encが有効か
+    int32_t perfValid;     //perfが有効か
+};
+
+//単一の書き込みスレッドと複数の読み出しスレッドの間でデータを受け渡す
+//読み出しは書き込み中であれば再試行するのみで、ロックを取らない
+class RGYMetricsSnapshot {
+public:
+    RGYMetricsSnapshot();
+    //書き込み (単一のスレッドからのみ呼ぶこと)
+    void publish(const RGYMetricsData& data);
+    //読み出し (一度もpublishされていなければfalse)
+    bool read(RGYMetricsData& data) const;
+    uint32_t sequence() const { return m_seq.load(std::memory_order_acquire); }
+protected:
+    static const size_t WORDS = (sizeof(RGYMetricsData) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    std::atomic<uint32_t> m_seq; //奇数なら書き込み中
+    std::atomic<uint64_t> m_words[WORDS];
+};
+
+//スナップショットをOpenMetricsのテキスト形式に変換する
+std::string rgy_metrics_render(const RGYMetricsData *data);
+
+class RGYMetricsServer {
+public:
+    RGYMetricsServer();
+    ~RGYMetricsServer();
+
+    //待ち受けを開始する
+    RGY_ERR init(const tstring& listen, std::shared_ptr<RGYLog> log);
+    //待ち受けを終了する
+    void close();
+
+    void publish(const RGYMetricsData& data) {
+        m_snapshot.publish(data);
+    }
+    const RGYMetricsSnapshot& snapshot() const {
+        return m_snapshot;
+    }
+    //待ち受けているTCPのポート (ポート0を指定した場合に割り当てられたポートを確認する)
+    int port() const { return m_port; }
+    //処理したリクエストの数
+    uint64_t requests() const { return m_requests.load(std::memory_order_relaxed); }
+protected:
+    void run();
+    void handleClient(intptr_t sock);
+
+    std::shared_ptr<RGYLog> m_log;
+    RGYMetricsSnapshot m_snapshot;
+    tstring m_listen;
+    std::string m_unixPath;
+    intptr_t m_sock;
+    int m_port;
+    bool m_wsaInit;
+    std::atomic<bool> m_abort;
+    std::atomic<uint64_t> m_requests;
+    std::thread m_thread;
+};
+
+//ローカルのポート/Unixドメインソケットでサーバーを起動し、HTTPで取得した結果を検証してCSVで出力する
+//あわせて、書き込み中の読み出しでデータが不整合にならないことを確認する
+int metrics_server_bench(FILE *fp);
+
+#endif //__RGY_METRICS_H__
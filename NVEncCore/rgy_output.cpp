@@ -79,7 +79,9 @@ void RGYOutput::Close() {
 }
 
 RGYOutputRaw::RGYOutputRaw() :
-    m_seiNal()
+    m_seiNal(),
+    m_nalList(),
+    m_lowLatency(false)
 #if ENABLE_AVSW_READER
     , m_pBsfc()
 #endif //#if ENABLE_AVSW_READER
@@ -108,6 +110,7 @@ RGY_ERR RGYOutputRaw::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutp
         m_bNoOutput = true;
         AddMessage(RGY_LOG_DEBUG, _T("no output for benchmark mode.\n"));
     } else {
+        m_lowLatency = rawPrm->lowLatency;
         if (_tcscmp(strFileName, _T("-")) == 0) {
             m_fDest.reset(stdout);
             m_bOutputIsStdout = true;
@@ -123,7 +126,8 @@ RGY_ERR RGYOutputRaw::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutp
             m_fDest.reset(fp);
             AddMessage(RGY_LOG_DEBUG, _T("Opened file \"%s\"\n"), strFileName);
 
-            int bufferSizeByte = clamp(rawPrm->nBufSizeMB, 0, RGY_OUTPUT_BUF_MB_MAX) * 1024 * 1024;
+            //低遅延モードでは、フレームごとにフラッシュするので出力バッファは使用しない
+            int bufferSizeByte = (rawPrm->lowLatency) ? 0 : clamp(rawPrm->nBufSizeMB, 0, RGY_OUTPUT_BUF_MB_MAX) * 1024 * 1024;
             if (bufferSizeByte) {
                 void *ptr = nullptr;
                 bufferSizeByte = (int)malloc_degeneracy(&ptr, bufferSizeByte, 1024 * 1024);
@@ -257,13 +261,14 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
 #if ENABLE_AVSW_READER
         if (m_pBsfc) {
             uint8_t nal_type = 0;
-            std::vector<nal_info> nal_list;
+            auto& nal_list = m_nalList;
+            nal_list.clear();
             if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
                 nal_type = NALU_HEVC_SPS;
-                nal_list = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
+                parse_nal_unit_hevc(nal_list, pBitstream->data(), pBitstream->size());
             } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
                 nal_type = NALU_H264_SPS;
-                nal_list = parse_nal_unit_h264(pBitstream->data(), pBitstream->size());
+                parse_nal_unit_h264(nal_list, pBitstream->data(), pBitstream->size());
             }
             auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
             if (sps_nal != nal_list.end()) {
@@ -303,7 +308,8 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
         }
 #endif //#if ENABLE_AVSW_READER
         if (m_seiNal.size()) {
-            const auto nal_list     = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
+            parse_nal_unit_hevc(m_nalList, pBitstream->data(), pBitstream->size());
+            const auto& nal_list    = m_nalList;
             const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
             const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
             const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
@@ -327,6 +333,9 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
             nBytesWritten = _fwrite_nolock(pBitstream->data(), 1, pBitstream->size(), m_fDest.get());
             WRITE_CHECK(nBytesWritten, pBitstream->size());
         }
+        if (m_lowLatency) {
+            fflush(m_fDest.get());
+        }
     }
 
     m_pEncSatusInfo->SetOutputData(pBitstream->frametype(), pBitstream->size(), 0);
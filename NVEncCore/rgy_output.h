@@ -143,12 +143,8 @@ public:
 
         va_list args;
         va_start(args, format);
-        int len = _vsctprintf(format, args) + 1; // _vscprintf doesn't count terminating '\0'
-        tstring buffer;
-        buffer.resize(len, _T('\0'));
-        _vstprintf_s(&buffer[0], len, format, args);
+        m_pPrintMes->write_va(log_level, (m_strWriterName + _T(": ")).c_str(), format, args);
         va_end(args);
-        AddMessage(log_level, buffer);
     }
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) = 0;
@@ -175,6 +171,7 @@ struct RGYOutputRawPrm {
     int nBufSizeMB;
     RGY_CODEC codecId;
     vector<uint8_t> seiNal;
+    bool lowLatency; //フレームごとに出力をフラッシュする
 };
 
 class RGYOutputRaw : public RGYOutput {
@@ -189,6 +186,8 @@ protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
 
     vector<uint8_t> m_seiNal;
+    vector<nal_info> m_nalList; //フレームごとのNAL解析結果 (確保を避けるため再利用する)
+    bool m_lowLatency;          //フレームごとに出力をフラッシュする
 #if ENABLE_AVSW_READER
     unique_ptr<AVBSFContext, RGYAVDeleter<AVBSFContext>> m_pBsfc;
 #endif //#if ENABLE_AVSW_READER
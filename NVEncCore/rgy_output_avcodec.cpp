@@ -28,13 +28,20 @@
 #include <fcntl.h>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
+#include <fstream>
+#include <functional>
 #include <memory>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 #include "rgy_osdep.h"
 #include "rgy_util.h"
 #include "rgy_output_avcodec.h"
 #include "rgy_avlog.h"
 #include "rgy_bitstream.h"
+#include "rgy_perf_trace.h"
 
 #if ENABLE_AVSW_READER
 #if USE_CUSTOM_IO
@@ -54,6 +61,11 @@ static int64_t funcSeek(void *opaque, int64_t offset, int whence) {
 
 const AVRational RGYOutputAvcodec::QUEUE_DTS_TIMEBASE = av_make_q(1, 90000);
 
+//mux遅延の計測用の時刻 (us)
+static int64_t muxClockUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 RGYOutputAvcodec::RGYOutputAvcodec() {
     memset(&m_Mux.format, 0, sizeof(m_Mux.format));
     memset(&m_Mux.video,  0, sizeof(m_Mux.video));
@@ -110,6 +122,9 @@ void RGYOutputAvcodec::CloseAudio(AVMuxAudio *pMuxAudio) {
     if (pMuxAudio->pAACBsfc) {
         av_bsf_free(&pMuxAudio->pAACBsfc);
     }
+    if (pMuxAudio->pBuffer) {
+        delete pMuxAudio->pBuffer;
+    }
     memset(pMuxAudio, 0, sizeof(pMuxAudio[0]));
     AddMessage(RGY_LOG_DEBUG, _T("Closed audio.\n"));
 }
@@ -167,11 +182,23 @@ void RGYOutputAvcodec::CloseQueues() {
     m_Mux.thread.bThAudProcessAbort = true;
     m_Mux.thread.bAbortOutput = true;
     m_Mux.thread.qVideobitstream.close();
-    m_Mux.thread.qVideobitstreamFreeI.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
-    m_Mux.thread.qVideobitstreamFreePB.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
+    {
+        const auto stats = m_Mux.thread.videoBitstreamPool.stats();
+        AddMessage(RGY_LOG_DEBUG, _T("video bitstream pool: hit %lld, miss %lld, discard %lld, peak %.2f MB.\n"),
+            (lls)stats.hit, (lls)stats.miss, (lls)stats.discard, stats.peakBytes / (1024.0 * 1024.0));
+    }
+    m_Mux.thread.videoBitstreamPool.clear();
     m_Mux.thread.qAudioPacketOut.close();
     m_Mux.thread.qAudioFrameEncode.close();
     m_Mux.thread.qAudioPacketProcess.close();
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        worker->qPacketIn.close();
+        worker->qPacketOut.close();
+    }
+    m_Mux.thread.audioWorkers.clear();
+    for (auto& muxAudio : m_Mux.audio) {
+        muxAudio.pWorker = nullptr;
+    }
     AddMessage(RGY_LOG_DEBUG, _T("closed queues...\n"));
 #endif
 }
@@ -202,6 +229,26 @@ void RGYOutputAvcodec::CloseThread() {
         CloseEvent(m_Mux.thread.heEventClosingAudProcess);
         AddMessage(RGY_LOG_DEBUG, _T("closed audio process thread...\n"));
     }
+    //トラックごとの音声処理スレッドは、thAudProcessからの終端パケットを処理してから停止する
+    //出力スレッドがqPacketOutを参照するので、キューの破棄はCloseQueuesで行う
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        worker->bAbort = true;
+        if (worker->thread.joinable()) {
+            //qPacketInをcloseすると、スレッドは残ったパケットを処理してから停止する
+            worker->qPacketIn.close();
+            worker->thread.join();
+            CloseEvent(worker->heEventFlushed);
+            CloseEvent(worker->heEventClosing);
+            for (const auto& track : worker->tracks) {
+                if (track.nPackets > 0) {
+                    AddMessage(RGY_LOG_DEBUG, _T("audio worker %d, audio #%d: %lld packets, %.2f sec in %.2f sec (x%.1f).\n"),
+                        worker->nWorkerId, trackID(track.nInTrackId), (lls)track.nPackets,
+                        track.nAudioTimeUs * 1e-6, track.nProcessTimeUs * 1e-6, track.nAudioTimeUs / (double)(std::max)(track.nProcessTimeUs, (int64_t)1));
+                }
+            }
+            AddMessage(RGY_LOG_DEBUG, _T("closed audio worker thread %d...\n"), worker->nWorkerId);
+        }
+    }
     m_Mux.thread.bAbortOutput = true;
     if (m_Mux.thread.thOutput.joinable()) {
         //ここに来た時に、まだメインスレッドがループ中の可能性がある
@@ -233,11 +280,21 @@ void RGYOutputAvcodec::Close() {
         CloseAudio(&m_Mux.audio[i]);
     }
     m_Mux.audio.clear();
+    {
+        const auto stats = m_Mux.audioFramePool.stats();
+        if (stats.hit + stats.miss > 0) {
+            AddMessage(RGY_LOG_DEBUG, _T("audio frame pool: hit %lld, miss %lld, discard %lld, peak %lld frames.\n"),
+                (lls)stats.hit, (lls)stats.miss, (lls)stats.discard, (lls)stats.peakUsed);
+        }
+    }
+    m_Mux.audioFramePool.clear();
     for (int i = 0; i < (int)m_Mux.other.size(); i++) {
         CloseOther(&m_Mux.other[i]);
     }
     m_Mux.other.clear();
     CloseVideo(&m_Mux.video);
+    //音声はすべて渡し終えたので、以降は渡した先を参照しない
+    m_audioMirror.clear();
     m_strOutputInfo.clear();
     m_pEncSatusInfo.reset();
     AddMessage(RGY_LOG_DEBUG, _T("Closed.\n"));
@@ -792,8 +849,10 @@ RGY_ERR RGYOutputAvcodec::InitAudioFilter(AVMuxAudio *pMuxAudio, int channels, u
         )) {
         if (pMuxAudio->pFilterGraph) {
             //filterをflush
-            auto filteredFrames = AudioFilterFrameFlush(pMuxAudio);
-            WriteNextPacketToAudioSubtracks(filteredFrames);
+            vector<AVPktMuxData> flushedFrames;
+            vector<AVPktMuxData> filteredFrames;
+            AudioFilterFrameFlush(pMuxAudio, flushedFrames);
+            WriteNextPacketToAudioSubtracks(flushedFrames, filteredFrames);
 
             //filterをclose
             avfilter_graph_free(&pMuxAudio->pFilterGraph);
@@ -947,6 +1006,7 @@ RGY_ERR RGYOutputAvcodec::InitAudio(AVMuxAudio *pMuxAudio, AVOutputStreamPrm *pI
         return RGY_ERR_NULL_PTR;
     }
     pMuxAudio->pDecodedFrameCache = nullptr;
+    pMuxAudio->pBuffer = new AVMuxAudioBuffer();
     pMuxAudio->nIgnoreDecodeError = nAudioIgnoreDecodeError;
     pMuxAudio->nInTrackId = pInputAudio->src.nTrackId;
     pMuxAudio->nInSubStream = pInputAudio->src.nSubStreamId;
@@ -1529,6 +1589,13 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *pVideo
         return RGY_ERR_NULL_PTR;
     }
     m_Mux.format.bIsMatroska = 0 == strcmp(m_Mux.format.pFormatCtx->oformat->name, "matroska");
+    m_Mux.format.bLowLatency = prm->lowLatency;
+    if (m_Mux.format.bLowLatency) {
+        //インターリーブのための待機をせず、パケットごとにフラッシュする
+        m_Mux.format.pFormatCtx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+        m_Mux.format.pFormatCtx->max_interleave_delta = 1;
+        AddMessage(RGY_LOG_DEBUG, _T("low latency mode: flush per packet.\n"));
+    }
 
 #if USE_CUSTOM_IO
     if (m_Mux.format.bIsPipe || usingAVProtocols(filename, 1) || (m_Mux.format.pFormatCtx->oformat->flags & (AVFMT_NEEDNUMBER | AVFMT_NOFILE))) {
@@ -1561,7 +1628,8 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *pVideo
         AddMessage(RGY_LOG_DEBUG, _T("Opened file \"%s\".\n"), char_to_tstring(filename, CP_UTF8).c_str());
 #if USE_CUSTOM_IO
     } else {
-        m_Mux.format.nOutputBufferSize = clamp(prm->nBufSizeMB, 0, RGY_OUTPUT_BUF_MB_MAX) * 1024 * 1024;
+        //低遅延モードでは、パケットごとにフラッシュするので出力バッファは使用しない
+        m_Mux.format.nOutputBufferSize = (prm->lowLatency) ? 0 : clamp(prm->nBufSizeMB, 0, RGY_OUTPUT_BUF_MB_MAX) * 1024 * 1024;
         if (m_Mux.format.nOutputBufferSize == 0) {
             //出力バッファが0とされている場合、libavformat用の内部バッファも量を減らす
             m_Mux.format.nAVOutBufferSize = 128 * 1024;
@@ -1616,6 +1684,7 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *pVideo
     const int audioStreamCount = (int)count_if(prm->inputStreamList.begin(), prm->inputStreamList.end(), [](AVOutputStreamPrm prm) { return trackMediaType(prm.src.nTrackId) == AVMEDIA_TYPE_AUDIO; });
     if (audioStreamCount) {
         m_Mux.audio.resize(audioStreamCount, { 0 });
+        m_Mux.audioFramePool.init(prm->nAudioFramePoolMax);
         int iAudioIdx = 0;
         for (int iStream = 0; iStream < (int)prm->inputStreamList.size(); iStream++) {
             if (trackMediaType(prm->inputStreamList[iStream].src.nTrackId) == AVMEDIA_TYPE_AUDIO) {
@@ -1698,14 +1767,22 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *pVideo
     m_Mux.thread.pQueueInfo = prm->pQueueInfo;
     //スレッドの使用数を設定
     if (prm->nOutputThread == RGY_OUTPUT_THREAD_AUTO) {
-        prm->nOutputThread = 1;
+        //低遅延モードでは、キューを経由せずにエンコードスレッドから直接書き出す
+        prm->nOutputThread = (prm->lowLatency) ? 0 : 1;
     }
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
     if (prm->nAudioThread == RGY_AUDIO_THREAD_AUTO) {
         prm->nAudioThread = 0;
     }
-    m_Mux.thread.bEnableAudProcessThread = prm->nOutputThread > 0 && prm->nAudioThread > 0;
-    m_Mux.thread.bEnableAudEncodeThread  = prm->nOutputThread > 0 && prm->nAudioThread > 1;
+    //トラックごとの音声処理スレッドは、音声をエンコードするトラックがある場合のみ使用する
+    const bool bEnableAudWorkerThread = prm->nAudioTrackThread != 0
+        && std::any_of(m_Mux.audio.begin(), m_Mux.audio.end(), [](const AVMuxAudio& muxAudio) { return muxAudio.pOutCodecDecodeCtx != nullptr; });
+    if (bEnableAudWorkerThread && prm->nOutputThread <= 0) {
+        AddMessage(RGY_LOG_WARN, _T("--audio-track-thread requires output thread, disabled.\n"));
+    }
+    //トラックごとの音声処理スレッドを使用する場合、thAudProcessは各スレッドへの振り分けを担当し、エンコードもそれぞれのスレッドで行う
+    m_Mux.thread.bEnableAudProcessThread = prm->nOutputThread > 0 && (prm->nAudioThread > 0 || bEnableAudWorkerThread);
+    m_Mux.thread.bEnableAudEncodeThread  = prm->nOutputThread > 0 && prm->nAudioThread > 1 && !bEnableAudWorkerThread;
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
     m_Mux.thread.bEnableOutputThread     = prm->nOutputThread > 0;
     if (m_Mux.thread.bEnableOutputThread) {
@@ -1715,13 +1792,18 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *pVideo
         m_Mux.thread.bThAudEncodeAbort = false;
         m_Mux.thread.qAudioPacketOut.init(8192, 256 * std::max(1, (int)m_Mux.audio.size())); //字幕のみコピーするときのため、最低でもある程度は確保する
         m_Mux.thread.qVideobitstream.init(4096, (std::max)(64, (m_Mux.video.nFPS.den) ? m_Mux.video.nFPS.num * 4 / m_Mux.video.nFPS.den : 0));
-        m_Mux.thread.qVideobitstreamFreeI.init(256);
-        m_Mux.thread.qVideobitstreamFreePB.init(3840);
+        m_Mux.thread.videoBitstreamPool.init(VID_BITSTREAM_POOL_MAX_CACHED_BYTES, VID_BITSTREAM_POOL_MAX_BLOCKS);
         m_Mux.thread.heEventPktAddedOutput = CreateEvent(NULL, TRUE, FALSE, NULL);
         m_Mux.thread.heEventClosingOutput  = CreateEvent(NULL, TRUE, FALSE, NULL);
         m_Mux.thread.thOutput = std::thread(&RGYOutputAvcodec::WriteThreadFunc, this);
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
         if (m_Mux.thread.bEnableAudProcessThread) {
+            if (bEnableAudWorkerThread) {
+                auto sts = InitAudWorkers(prm->nAudioTrackThread);
+                if (sts != RGY_ERR_NONE) {
+                    return sts;
+                }
+            }
             AddMessage(RGY_LOG_DEBUG, _T("starting audio process thread...\n"));
             m_Mux.thread.qAudioPacketProcess.init(8192, 512, 4);
             m_Mux.thread.heEventPktAddedAudProcess = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -1998,20 +2080,14 @@ uint32_t RGYOutputAvcodec::getH264PAFFFieldLength(const uint8_t *ptr, uint32_t s
 RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *pBitstream) {
 #if ENABLE_AVCODEC_OUT_THREAD
     if (m_Mux.thread.thOutput.joinable()) {
-        RGYBitstream copyStream = RGYBitstreamInit();
-        bool bFrameI = (pBitstream->frametype() & RGY_FRAMETYPE_I) != 0;
-        bool bFrameP = (pBitstream->frametype() & RGY_FRAMETYPE_P) != 0;
-        //IフレームかPBフレームかでサイズが大きく違うため、空きのmfxBistreamは異なるキューで管理する
-        auto& qVideoQueueFree = (bFrameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        //空いているmfxBistreamを取り出す
-        if (!qVideoQueueFree.front_copy_and_pop_no_lock(&copyStream) || copyStream.bufsize() < pBitstream->size()) {
-            //空いているmfxBistreamがない、あるいはそのバッファサイズが小さい場合は、領域を取り直す
-            const auto allocate_bytes = pBitstream->size() * ((bFrameI | bFrameP) ? 2 : 8);
-            if (RGY_ERR_NONE != copyStream.init(allocate_bytes)) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %sB.\n"), allocate_bytes);
-                m_Mux.format.bStreamError = true;
-                return RGY_ERR_MEMORY_ALLOC;
-            }
+        AVMuxVideoPkt videoPkt;
+        auto& copyStream = videoPkt.bitstream;
+        copyStream = RGYBitstreamInit();
+        //サイズに応じたクラスの空き領域を取り出す (なければ確保する)
+        if (RGY_ERR_NONE != m_Mux.thread.videoBitstreamPool.get(&copyStream, pBitstream->size())) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %lldB.\n"), (lls)pBitstream->size());
+            m_Mux.format.bStreamError = true;
+            return RGY_ERR_MEMORY_ALLOC;
         }
         //必要な情報をコピー
         copyStream.setDataflag(pBitstream->dataflag());
@@ -2024,7 +2100,8 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *pBitstream) {
         copyStream.setOffset(0);
         memcpy(copyStream.bufptr(), pBitstream->data(), copyStream.size());
         //キューに押し込む
-        if (!m_Mux.thread.qVideobitstream.push(copyStream)) {
+        videoPkt.queuedTime = muxClockUs();
+        if (!m_Mux.thread.qVideobitstream.push(videoPkt)) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream queue.\n"));
             m_Mux.format.bStreamError = true;
         }
@@ -2041,6 +2118,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *pBitstream) {
 #pragma warning (push)
 #pragma warning (disable: 4127) //warning C4127: 条件式が定数です。
 RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64_t *pWrittenDts) {
+    RGY_PERF_TRACE_SCOPE(traceMux, RGY_TRACE_MUX, -1, pBitstream->pts());
     if (!m_Mux.format.bFileHeaderWritten) {
 #if ENCODER_QSV
         //HEVCエンコードでは、DecodeTimeStampが正しく設定されない
@@ -2052,7 +2130,8 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64
 #endif
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC && m_Mux.video.seiNal.size() > 0) {
             RGYBitstream old = *pBitstream;
-            std::vector<nal_info> nal_list = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
+            auto& nal_list = m_nalList;
+            parse_nal_unit_hevc(nal_list, pBitstream->data(), pBitstream->size());
             const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
             const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
             const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
@@ -2105,15 +2184,16 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64
     }
 #endif
 
-    std::vector<nal_info> nal_list;
+    auto& nal_list = m_nalList;
+    nal_list.clear();
     if (m_Mux.video.pBsfc) {
         int target_nal = 0;
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
             target_nal = NALU_HEVC_SPS;
-            nal_list = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
+            parse_nal_unit_hevc(nal_list, pBitstream->data(), pBitstream->size());
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
             target_nal = NALU_H264_SPS;
-            nal_list = parse_nal_unit_h264(pBitstream->data(), pBitstream->size());
+            parse_nal_unit_h264(nal_list, pBitstream->data(), pBitstream->size());
         }
         auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [target_nal](nal_info info) { return info.type == target_nal; });
         if (sps_nal != nal_list.end()) {
@@ -2157,7 +2237,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64
     if (m_Mux.video.pStreamOut->codecpar->field_order != AV_FIELD_PROGRESSIVE) {
         if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
             if (nal_list.size() == 0) {
-                nal_list = parse_nal_unit_h264(pBitstream->data(), pBitstream->size());
+                parse_nal_unit_h264(nal_list, pBitstream->data(), pBitstream->size());
             }
             //インタレ保持の際、IDRかどうかのフラグが正しく設定されていないことがある
             //どちらかのフィールドがIDRならIDRのフラグを立てる
@@ -2198,6 +2278,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64
     const auto pts = pkt.pts, dts = pkt.dts, duration = pkt.duration;
     *pWrittenDts = av_rescale_q(pkt.dts, streamTimebase, QUEUE_DTS_TIMEBASE);
     m_Mux.format.bStreamError |= 0 != av_interleaved_write_frame(m_Mux.format.pFormatCtx, &pkt);
+    FlushPacket();
 
     //インタレ保持の際、IDRかどうかのフラグが正しく設定されていないことがある
     //どちらかのフィールドがIDRならIDRのフラグを立ててているので、それを参照する
@@ -2211,16 +2292,9 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *pBitstream, int64
 #if ENABLE_AVCODEC_OUT_THREAD
     //最初のヘッダーを書いたパケットはコピーではないので、キューに入れない
     if (m_Mux.thread.thOutput.joinable()) {
-        //確保したメモリ領域を使いまわすためにキューに格納
-        const auto frameI = (frameType & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) != 0;
-        auto& qVideoQueueFree = (frameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        auto queueFavoredSize = (frameI) ? VID_BITSTREAM_QUEUE_SIZE_I : VID_BITSTREAM_QUEUE_SIZE_PB;
-        if (qVideoQueueFree.size() > queueFavoredSize) {
-            //あまり多すぎると無駄にメモリを使用するので減らす
-            pBitstream->clear();
-        } else {
-            qVideoQueueFree.push(*pBitstream);
-        }
+        //確保したメモリ領域を使いまわすためにプールに返却する
+        //保持する空き領域が上限を超える場合は解放される
+        m_Mux.thread.videoBitstreamPool.release(pBitstream);
     } else {
 #endif
         pBitstream->setSize(0);
@@ -2350,7 +2424,10 @@ RGY_ERR RGYOutputAvcodec::applyBitstreamFilterAAC(AVPacket *pkt, AVMuxAudio *pMu
 void RGYOutputAvcodec::WriteNextPacketProcessed(AVMuxAudio *pMuxAudio, AVPacket *pkt, int samples, int64_t *pWrittenDts) {
     if (pkt == nullptr || pkt->buf == nullptr) {
         for (uint32_t i = 0; i < m_Mux.audio.size(); i++) {
-            AudioFlushStream(&m_Mux.audio[i], pWrittenDts);
+            //トラックごとの音声処理スレッドが担当するストリームは、そのスレッドでflush済み
+            if (m_Mux.audio[i].pWorker == nullptr) {
+                AudioFlushStream(&m_Mux.audio[i], pWrittenDts);
+            }
         }
         *pWrittenDts = INT64_MAX;
         AddMessage(RGY_LOG_DEBUG, _T("Flushed audio buffer.\n"));
@@ -2369,6 +2446,10 @@ void RGYOutputAvcodec::WriteNextPacketProcessed(AVMuxAudio *pMuxAudio, AVPacket
     } else {
         pkt->pts = av_rescale_q(pkt->pts, pMuxAudio->pOutCodecEncodeCtx->time_base, pMuxAudio->pStreamOut->time_base);
     }
+    if (m_audioMirror.size() > 0) {
+        //映像の先頭による補正は、渡した先でそれぞれ行う
+        WriteAudioMirror(pMuxAudio, pkt, samples);
+    }
     if (m_Mux.video.pStreamOut) {
         pkt->pts -= av_rescale_q(m_Mux.video.nInputFirstKeyPts, m_Mux.video.inputStreamTimebase, pMuxAudio->pStreamOut->time_base);
     }
@@ -2401,9 +2482,35 @@ void RGYOutputAvcodec::WriteNextPacketProcessed(AVMuxAudio *pMuxAudio, AVPacket
     *pWrittenDts = av_rescale_q(pkt->dts, pMuxAudio->pStreamOut->time_base, QUEUE_DTS_TIMEBASE);
     //av_interleaved_write_frameに渡ったパケットは開放する必要がない
     m_Mux.format.bStreamError |= 0 != av_interleaved_write_frame(m_Mux.format.pFormatCtx, pkt);
+    FlushPacket();
     pMuxAudio->nOutputSamples += samples;
 }
 
+//出力する音声のパケットを、AddAudioMirror()で登録した出力にコピーとして渡す
+//pkt->ptsはpStreamOut->time_base基準で、映像の先頭による補正を行う前のもの
+void RGYOutputAvcodec::WriteAudioMirror(const AVMuxAudio *pMuxAudio, const AVPacket *pkt, int samples) {
+    const int index = (int)(pMuxAudio - m_Mux.audio.data());
+    const AVRational samplerate = { 1, pMuxAudio->pStreamOut->codecpar->sample_rate };
+    for (auto writer : m_audioMirror) {
+        AVPacket pktMirror;
+        av_init_packet(&pktMirror);
+        if (0 != av_packet_ref(&pktMirror, pkt)) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to copy audio packet for ladder output.\n"));
+            m_Mux.format.bStreamError = true;
+            return;
+        }
+        //GetAudioMirrorStreams()で返したストリームのパケットとして渡す
+        pktMirror.stream_index = index;
+        pktMirror.flags = AV_PKT_FLAG_KEY | ((uint32_t)trackFullID(AVMEDIA_TYPE_AUDIO, index + 1) << 16);
+        pktMirror.dts = pktMirror.pts;
+        if (samples > 0) {
+            pktMirror.duration = av_rescale_q(samples, samplerate, pMuxAudio->pStreamOut->time_base);
+        }
+        //WriteNextPacketに渡したパケットは、渡した先で開放される
+        writer->WriteNextPacket(&pktMirror);
+    }
+}
+
 //音声/字幕パケットを実際に書き出す (構造体版)
 // pktData->pMuxAudio ... [i]  pktに対応するストリーム情報
 // &pktData->pkt      ... [io] 書き出す音声/字幕パケット この関数でデータはav_interleaved_write_frameに渡されるか解放される
@@ -2418,10 +2525,10 @@ void RGYOutputAvcodec::WriteNextPacketProcessed(AVPktMuxData *pktData, int64_t *
     *pWrittenDts = pktData->dts;
 }
 
-vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> RGYOutputAvcodec::AudioDecodePacket(AVMuxAudio *pMuxAudio, AVPacket *pkt) {
-    vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> decodedFrames;
+void RGYOutputAvcodec::AudioDecodePacket(AVMuxAudio *pMuxAudio, AVPacket *pkt, vector<AVFrame *>& decodedFrames) {
+    RGY_PERF_TRACE_SCOPE(traceAudDec, RGY_TRACE_AUD_DEC, -1, (pkt) ? pkt->pts : RGY_PERF_TRACE_NO_PTS);
     if (pMuxAudio->nDecodeError > pMuxAudio->nIgnoreDecodeError) {
-        return std::move(decodedFrames);
+        return;
     }
     AVPacket pktInInfo;
     av_packet_copy_props(&pktInInfo, pkt);
@@ -2431,7 +2538,7 @@ vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> RGYOutputAvcodec::AudioDe
     //最終的な出力フレーム
     int recv_ret = 0;
     for (;;) {
-        unique_ptr<AVFrame, decltype(&av_frame_unref)> receivedData(nullptr, av_frame_unref);
+        AVFrame *receivedData = nullptr;
         int send_ret = 0;
         //必ず一度はパケットを送る
         if (!sent_packet || pkt->size > 0) {
@@ -2450,10 +2557,11 @@ vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> RGYOutputAvcodec::AudioDe
         if (send_ret < 0 && send_ret != AVERROR(EAGAIN)) {
             pMuxAudio->nDecodeError++;
         } else {
-            receivedData = unique_ptr<AVFrame, decltype(&av_frame_unref)>(av_frame_alloc(), av_frame_unref);
-            recv_ret = avcodec_receive_frame(pMuxAudio->pOutCodecDecodeCtx, receivedData.get());
+            receivedData = m_Mux.audioFramePool.get();
+            recv_ret = avcodec_receive_frame(pMuxAudio->pOutCodecDecodeCtx, receivedData);
             if (recv_ret == AVERROR(EAGAIN)   //もっとパケットを送る必要がある
                 || recv_ret == AVERROR_EOF) { //最後まで読み込んだ
+                m_Mux.audioFramePool.release(receivedData);
                 break;
             }
             if (recv_ret < 0) {
@@ -2486,7 +2594,7 @@ vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> RGYOutputAvcodec::AudioDe
             if (pMuxAudio->nDecodeError <= pMuxAudio->nIgnoreDecodeError) {
 #if 0
                 //デコードエラーを無視する場合、入力パケットのサイズ分、無音を挿入する
-                unique_ptr<AVFrame, decltype(&av_frame_unref)> silentFrame(av_frame_alloc(), av_frame_unref);
+                AVFrame *silentFrame = m_Mux.audioFramePool.get();
                 AVRational samplerate = { 1, pMuxAudio->pOutCodecDecodeCtx->sample_rate };
                 silentFrame->nb_samples     = (int)av_rescale_q(pktInInfo.duration, pMuxAudio->pStreamIn->time_base, samplerate);
                 silentFrame->channels       = pMuxAudio->pOutCodecDecodeCtx->channels;
@@ -2494,29 +2602,32 @@ vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> RGYOutputAvcodec::AudioDe
                 silentFrame->sample_rate    = pMuxAudio->pOutCodecDecodeCtx->sample_rate;
                 silentFrame->format         = pMuxAudio->pOutCodecDecodeCtx->sample_fmt;
                 silentFrame->pts            = receivedData->pts;
-                av_frame_get_buffer(silentFrame.get(), 32); //format, channel_layout, nb_samplesを埋めて、av_frame_get_buffer()により、メモリを確保する
+                av_frame_get_buffer(silentFrame, 32); //format, channel_layout, nb_samplesを埋めて、av_frame_get_buffer()により、メモリを確保する
                 av_samples_set_silence((uint8_t **)silentFrame->data, 0, silentFrame->nb_samples, silentFrame->channels, (AVSampleFormat)silentFrame->format);
-                decodedFrames.push_back(std::move(silentFrame));
+                decodedFrames.push_back(silentFrame);
 #else
                 AddMessage(RGY_LOG_WARN, _T("avcodec writer: ignore error(%d) on audio #%d decode at %lld(%s)\n"),
                     pMuxAudio->nDecodeError, trackID(pMuxAudio->nInTrackId), pktInInfo.pts, getTimestampString(pktInInfo.pts, pMuxAudio->pStreamIn->time_base).c_str());
 #endif
+                m_Mux.audioFramePool.release(receivedData);
             } else {
                 AddMessage(RGY_LOG_ERROR, _T("avcodec writer: failed to decode audio #%d for %d times.\n"), trackID(pMuxAudio->nInTrackId), pMuxAudio->nDecodeError);
                 m_Mux.format.bStreamError = true;
+                m_Mux.audioFramePool.release(receivedData);
                 break;
             }
         } else if (receivedData) {
-            decodedFrames.push_back(std::move(receivedData));
+            decodedFrames.push_back(receivedData);
         }
     }
-    return decodedFrames;
 }
 
 //音声をフィルタ
-vector<AVPktMuxData> RGYOutputAvcodec::AudioFilterFrame(vector<AVPktMuxData> inputFrames) {
-    vector<AVPktMuxData> outputFrames;
-    for (const auto& pktData : inputFrames) {
+//フィルタに渡したフレームはプールに返却し、フィルタしない場合はそのままoutputFramesに追加する
+void RGYOutputAvcodec::AudioFilterFrame(const vector<AVPktMuxData>& inputFrames, vector<AVPktMuxData>& outputFrames) {
+    size_t iframe = 0;
+    while (iframe < inputFrames.size()) {
+        const auto& pktData = inputFrames[iframe++];
         AVMuxAudio *pMuxAudio = pktData.pMuxAudio;
         if (pktData.pMuxAudio->pFilterGraph == nullptr) {
             //フィルタリングなし
@@ -2526,30 +2637,35 @@ vector<AVPktMuxData> RGYOutputAvcodec::AudioFilterFrame(vector<AVPktMuxData> inp
                 //音声入力フォーマットに変更がないか確認し、もしあればresamplerを再初期化する
                 auto sts = InitAudioFilter(pMuxAudio, pktData.pFrame->channels, pktData.pFrame->channel_layout, pktData.pFrame->sample_rate, (AVSampleFormat)pktData.pFrame->format);
                 if (sts != RGY_ERR_NONE) {
+                    m_Mux.audioFramePool.release(pktData.pFrame);
                     m_Mux.format.bStreamError = true;
                     break;
                 }
             }
             //フィルターチェーンにフレームを追加
-            if (av_buffersrc_add_frame_flags(pMuxAudio->pFilterBufferSrcCtx, pktData.pFrame, AV_BUFFERSRC_FLAG_PUSH) < 0) {
+            //データはフィルタに渡されるので、構造体はここでプールに返却する
+            int ret = av_buffersrc_add_frame_flags(pMuxAudio->pFilterBufferSrcCtx, pktData.pFrame, AV_BUFFERSRC_FLAG_PUSH);
+            m_Mux.audioFramePool.release(pktData.pFrame);
+            if (ret < 0) {
                 AddMessage(RGY_LOG_ERROR, _T("failed to feed the audio filtergraph\n"));
                 m_Mux.format.bStreamError = true;
-                av_frame_unref(pktData.pFrame);
                 break;
             }
             for (;;) {
-                unique_ptr<AVFrame, decltype(&av_frame_unref)> filteredFrame(av_frame_alloc(), av_frame_unref);
-                int ret = av_buffersink_get_frame_flags(pMuxAudio->pFilterBufferSinkCtx, filteredFrame.get(), AV_BUFFERSINK_FLAG_NO_REQUEST);
+                AVFrame *filteredFrame = m_Mux.audioFramePool.get();
+                ret = av_buffersink_get_frame_flags(pMuxAudio->pFilterBufferSinkCtx, filteredFrame, AV_BUFFERSINK_FLAG_NO_REQUEST);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                    m_Mux.audioFramePool.release(filteredFrame);
                     break;
                 }
                 if (ret < 0) {
+                    m_Mux.audioFramePool.release(filteredFrame);
                     m_Mux.format.bStreamError = true;
                     break;
                 }
                 AVPktMuxData pktFiltered = pktData;
                 pktFiltered.samples = filteredFrame->nb_samples;
-                pktFiltered.pFrame = filteredFrame.release();
+                pktFiltered.pFrame = filteredFrame;
                 outputFrames.push_back(pktFiltered);
             }
             if (m_Mux.format.bStreamError) {
@@ -2557,10 +2673,13 @@ vector<AVPktMuxData> RGYOutputAvcodec::AudioFilterFrame(vector<AVPktMuxData> inp
             }
         }
     }
-    return outputFrames;
+    //エラーで中断した場合、未処理のフレームもプールに返却する
+    for (; iframe < inputFrames.size(); iframe++) {
+        m_Mux.audioFramePool.release(inputFrames[iframe].pFrame);
+    }
 }
 
-vector<AVPktMuxData> RGYOutputAvcodec::AudioFilterFrameFlush(AVMuxAudio *pMuxAudio) {
+void RGYOutputAvcodec::AudioFilterFrameFlush(AVMuxAudio *pMuxAudio, vector<AVPktMuxData>& outputFrames) {
     vector<AVPktMuxData> flushFrame;
     AVPktMuxData pktData = { 0 };
     pktData.type = MUX_DATA_TYPE_FRAME;
@@ -2568,13 +2687,12 @@ vector<AVPktMuxData> RGYOutputAvcodec::AudioFilterFrameFlush(AVMuxAudio *pMuxAud
     pktData.got_result = TRUE;
     pktData.pMuxAudio = pMuxAudio;
     flushFrame.push_back(pktData);
-    return AudioFilterFrame(flushFrame);
+    AudioFilterFrame(flushFrame, outputFrames);
 }
 
 //音声をエンコード
-vector<AVPktMuxData> RGYOutputAvcodec::AudioEncodeFrame(AVMuxAudio *pMuxAudio, AVFrame *frame) {
-    vector<AVPktMuxData> encPktDatas;
-
+void RGYOutputAvcodec::AudioEncodeFrame(AVMuxAudio *pMuxAudio, AVFrame *frame, vector<AVPktMuxData>& encPktDatas) {
+    RGY_PERF_TRACE_SCOPE(traceAudEnc, RGY_TRACE_AUD_ENC, -1, (frame) ? frame->pts : RGY_PERF_TRACE_NO_PTS);
     if (frame) {
         //エンコーダのtimebaseに変換
         const auto timebase_filter = (pMuxAudio->pFilterGraph)
@@ -2584,12 +2702,12 @@ vector<AVPktMuxData> RGYOutputAvcodec::AudioEncodeFrame(AVMuxAudio *pMuxAudio, A
     }
     int ret = avcodec_send_frame(pMuxAudio->pOutCodecEncodeCtx, frame);
     if (ret == AVERROR_EOF) {
-        return encPktDatas;
+        return;
     }
     if (ret < 0) {
         AddMessage(RGY_LOG_WARN, _T("avcodec writer: failed to send frame to audio encoder #%d: %s\n"), trackID(pMuxAudio->nInTrackId), qsv_av_err2str(ret).c_str());
         pMuxAudio->bEncodeError = true;
-        return encPktDatas;
+        return;
     }
 
     AVPktMuxData pktData;
@@ -2608,42 +2726,56 @@ vector<AVPktMuxData> RGYOutputAvcodec::AudioEncodeFrame(AVMuxAudio *pMuxAudio, A
         pktData.samples = (int)av_rescale_q(pktData.pkt.duration, pMuxAudio->pOutCodecEncodeCtx->pkt_timebase, { 1, pMuxAudio->pStreamIn->codecpar->sample_rate });
         encPktDatas.push_back(pktData);
     }
-    return encPktDatas;
 }
 
 void RGYOutputAvcodec::AudioFlushStream(AVMuxAudio *pMuxAudio, int64_t *pWrittenDts) {
+    //flushは終了時に一度だけなので、作業用のvectorはここで作成する
+    vector<AVFrame *> decodedFrames;
+    vector<AVPktMuxData> audioFrames;
+    vector<AVPktMuxData> filteredFrames;
     while (pMuxAudio->pOutCodecDecodeCtx && !pMuxAudio->bEncodeError) {
         AVPacket pkt = { 0 };
-        auto decodedFrames = AudioDecodePacket(pMuxAudio, &pkt);
+        decodedFrames.clear();
+        AudioDecodePacket(pMuxAudio, &pkt, decodedFrames);
         if (decodedFrames.size() == 0) {
             break;
         }
-        vector<AVPktMuxData> audioFrames;
-        for (size_t i = 0; i < decodedFrames.size(); i++) {
+        audioFrames.clear();
+        for (auto frame : decodedFrames) {
             AVPktMuxData audPkt;
             av_init_packet(&audPkt.pkt);
             audPkt.dts = AV_NOPTS_VALUE;
             audPkt.samples = 0;
             audPkt.type = MUX_DATA_TYPE_FRAME;
-            audPkt.pFrame = decodedFrames[i].release();
+            audPkt.pMuxAudio = pMuxAudio;
+            audPkt.pFrame = frame;
             audPkt.got_result = audPkt.pFrame && audPkt.pFrame->nb_samples > 0;
             audioFrames.push_back(audPkt);
         }
         //フィルタリングを行う
-        WriteNextPacketToAudioSubtracks(std::move(audioFrames));
+        WriteNextPacketToAudioSubtracks(audioFrames, filteredFrames);
     }
     if (pMuxAudio->pFilterGraph) {
-        WriteNextPacketAudioFrame(std::move(AudioFilterFrameFlush(pMuxAudio)));
+        filteredFrames.clear();
+        AudioFilterFrameFlush(pMuxAudio, filteredFrames);
+        WriteNextPacketAudioFrame(filteredFrames);
     }
+    vector<AVPktMuxData> encPktDatas;
     while (pMuxAudio->pOutCodecEncodeCtx) {
-        auto encPktDatas = AudioEncodeFrame(pMuxAudio, nullptr);
+        encPktDatas.clear();
+        AudioEncodeFrame(pMuxAudio, nullptr, encPktDatas);
         if (encPktDatas.size() == 0) {
             break;
         }
         if (pMuxAudio->nDecodeError > pMuxAudio->nIgnoreDecodeError)
             break;
         for (auto& pktMux : encPktDatas) {
-            WriteNextPacketProcessed(&pktMux, pWrittenDts);
+            if (pMuxAudio->pWorker) {
+                //トラックごとの音声処理スレッドでflushしている場合は、出力キューに回す
+                AddAudQueue(&pktMux, AUD_QUEUE_OUT);
+            } else {
+                WriteNextPacketProcessed(&pktMux, pWrittenDts);
+            }
         }
     }
 }
@@ -2702,6 +2834,7 @@ RGY_ERR RGYOutputAvcodec::SubtitleTranscode(const AVMuxOther *pMuxSub, AVPacket
         pktOut.dts = pktOut.pts;
         m_Mux.format.bStreamError |= 0 != av_interleaved_write_frame(m_Mux.format.pFormatCtx, &pktOut);
     }
+    FlushPacket();
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
@@ -2718,9 +2851,22 @@ RGY_ERR RGYOutputAvcodec::WriteOtherPacket(AVPacket *pkt) {
     pkt->stream_index = pMuxOther->pStreamOut->index;
     pkt->pos = -1;
     m_Mux.format.bStreamError |= 0 != av_interleaved_write_frame(m_Mux.format.pFormatCtx, pkt);
+    FlushPacket();
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
+void RGYOutputAvcodec::FlushPacket() {
+    if (!m_Mux.format.bLowLatency || m_Mux.format.pFormatCtx->pb == nullptr) {
+        return;
+    }
+    avio_flush(m_Mux.format.pFormatCtx->pb);
+#if USE_CUSTOM_IO
+    if (m_Mux.format.fpOutput) {
+        fflush(m_Mux.format.fpOutput);
+    }
+#endif //#if USE_CUSTOM_IO
+}
+
 AVPktMuxData RGYOutputAvcodec::pktMuxData(const AVPacket *pkt) {
     AVPktMuxData data = { 0 };
     data.type = MUX_DATA_TYPE_PACKET;
@@ -2746,6 +2892,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacket(AVPacket *pkt) {
         auto heEventPktAdd = (m_Mux.thread.thAudProcess.joinable()) ? m_Mux.thread.heEventPktAddedAudProcess : m_Mux.thread.heEventPktAddedOutput;
         //pkt = nullptrの代理として、pkt.buf == nullptrなパケットを投入
         AVPktMuxData zeroFilled = { 0 };
+        zeroFilled.queuedTime = pktData.queuedTime = muxClockUs();
         if (!audioQueue.push((pkt == nullptr) ? zeroFilled : pktData)) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio packet queue.\n"));
             m_Mux.format.bStreamError = true;
@@ -2760,10 +2907,21 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacket(AVPacket *pkt) {
 //指定された音声キューに追加する
 RGY_ERR RGYOutputAvcodec::AddAudQueue(AVPktMuxData *pktData, int type) {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
-    if (m_Mux.thread.thAudProcess.joinable()) {
+    if (type == AUD_QUEUE_OUT && pktData->pMuxAudio && pktData->pMuxAudio->pWorker) {
+        //トラックごとの音声処理スレッドの出力は、スレッドごとの出力キューに追加する
+        auto pWorker = pktData->pMuxAudio->pWorker;
+        pktData->queuedTime = muxClockUs();
+        if (!pWorker->qPacketOut.push(*pktData)) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio queue.\n"));
+            m_Mux.format.bStreamError = true;
+        }
+        SetEvent(m_Mux.thread.heEventPktAddedOutput);
+        return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+    } else if (m_Mux.thread.thAudProcess.joinable()) {
         //出力キューに追加する
         auto& qAudio       = (type == AUD_QUEUE_OUT) ? m_Mux.thread.qAudioPacketOut       : ((type == AUD_QUEUE_PROCESS) ? m_Mux.thread.qAudioPacketProcess       : m_Mux.thread.qAudioFrameEncode);
         auto& heEventAdded = (type == AUD_QUEUE_OUT) ? m_Mux.thread.heEventPktAddedOutput : ((type == AUD_QUEUE_PROCESS) ? m_Mux.thread.heEventPktAddedAudProcess : m_Mux.thread.heEventPktAddedAudEncode);
+        pktData->queuedTime = muxClockUs();
         if (!qAudio.push(*pktData)) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio queue.\n"));
             m_Mux.format.bStreamError = true;
@@ -2777,6 +2935,44 @@ RGY_ERR RGYOutputAvcodec::AddAudQueue(AVPktMuxData *pktData, int type) {
     }
 }
 
+//トラックごとの音声処理スレッドのキューに追加する
+RGY_ERR RGYOutputAvcodec::AddAudWorkerQueue(AVMuxAudioWorker *pWorker, AVPktMuxData *pktData) {
+#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    pktData->queuedTime = muxClockUs();
+    //キューが満杯なら、スレッドが取り出すまで待機する
+    if (!pWorker->qPacketIn.push(*pktData)) {
+        AddMessage(RGY_LOG_ERROR, _T("audio worker %d has already been closed.\n"), pWorker->nWorkerId);
+        m_Mux.format.bStreamError = true;
+    }
+    return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+#else
+    return RGY_ERR_NOT_INITIALIZED;
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+}
+
+//トラックごとの音声処理スレッドに終端パケットを渡し、担当するストリームのflushが終わるまで待機する
+//終端パケットは、この後で出力キューに追加することで、各スレッドの出力より後に処理されるようにする
+void RGYOutputAvcodec::FlushAudWorkers() {
+#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        ResetEvent(worker->heEventFlushed);
+        AVPktMuxData zeroFilled = { 0 };
+        AddAudWorkerQueue(worker.get(), &zeroFilled);
+    }
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        //終端パケットを渡せなかった場合や、スレッドが停止した場合は、flushの完了が通知されないので待機をやめる
+        while (WAIT_TIMEOUT == WaitForSingleObject(worker->heEventFlushed, 100)) {
+            if (worker->bAbort || m_Mux.format.bStreamError
+                || WAIT_OBJECT_0 == WaitForSingleObject(worker->heEventClosing, 0)) {
+                AddMessage(RGY_LOG_WARN, _T("audio worker %d stopped before flushing audio.\n"), worker->nWorkerId);
+                break;
+            }
+        }
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("Flushed audio worker threads.\n"));
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+}
+
 //音声処理スレッドが存在する場合、この関数は音声処理スレッドによって処理される
 //音声処理スレッドがなく、出力スレッドがあれば、出力スレッドにより処理される
 //出力スレッドがなければメインエンコードスレッドが処理する
@@ -2813,6 +3009,9 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketInternal(AVPktMuxData *pktData, int64_t
             //音声処理を別スレッドでやっている場合は、AddAudOutputQueueを後段の出力スレッドで行う必要がある
             //WriteNextPacketInternalでは音声キューに追加するだけにして、WriteNextPacketProcessedで対応する
             //ひとまず、ここでは処理せず、次のキューに回す
+            if (m_Mux.thread.audioWorkers.size() > 0) {
+                FlushAudWorkers();
+            }
             return AddAudQueue(pktData, (m_Mux.thread.thAudEncode.joinable()) ? AUD_QUEUE_ENCODE : AUD_QUEUE_OUT);
         }
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
@@ -2835,6 +3034,12 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketInternal(AVPktMuxData *pktData, int64_t
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
         return WriteOtherPacket(&pktData->pkt);
     }
+#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    if (pktData->pMuxAudio && pktData->pMuxAudio->pWorker) {
+        //トラックごとの音声処理スレッドに回す
+        return AddAudWorkerQueue(pktData->pMuxAudio->pWorker, pktData);
+    }
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
     return WriteNextPacketAudio(pktData);
 }
 
@@ -2916,10 +3121,12 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketAudio(AVPktMuxData *pktData) {
         pMuxAudio->nLastPtsIn = pktData->pkt.pts;
         writeOrSetNextPacketAudioProcessed(pktData);
     } else if (!(pMuxAudio->nDecodeError > pMuxAudio->nIgnoreDecodeError) && !pMuxAudio->bEncodeError) {
-        vector<AVPktMuxData> audioFrames;
+        //出力先のvectorは呼び出しごとに作らず、ストリームごとのものを使いまわす
+        auto& audioFrames = pMuxAudio->pBuffer->frames;
+        audioFrames.clear();
         if (bSetSilenceDueToAACBsfError) {
             //無音挿入
-            AVFrame *silentFrame        = av_frame_alloc();
+            AVFrame *silentFrame        = m_Mux.audioFramePool.get();
             silentFrame->nb_samples     = nSamples;
             silentFrame->channels       = pMuxAudio->pOutCodecDecodeCtx->channels;
             silentFrame->channel_layout = pMuxAudio->pOutCodecDecodeCtx->channel_layout;
@@ -2935,23 +3142,25 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketAudio(AVPktMuxData *pktData) {
             silentPkt.got_result = silentFrame && silentFrame->nb_samples > 0;
             audioFrames.push_back(silentPkt);
         } else {
-            auto decodedFrames = AudioDecodePacket(pMuxAudio, &pktData->pkt);
-            for (size_t i = 0; i < decodedFrames.size(); i++) {
+            auto& decodedFrames = pMuxAudio->pBuffer->decoded;
+            decodedFrames.clear();
+            AudioDecodePacket(pMuxAudio, &pktData->pkt, decodedFrames);
+            for (auto frame : decodedFrames) {
                 AVPktMuxData audPkt = *pktData;
                 audPkt.type = MUX_DATA_TYPE_FRAME;
-                audPkt.pFrame = decodedFrames[i].release();
+                audPkt.pFrame = frame;
                 audPkt.samples = (audPkt.pFrame) ? audPkt.pFrame->nb_samples : 0;
                 audPkt.got_result = audPkt.pFrame && audPkt.pFrame->nb_samples > 0;
                 audioFrames.push_back(audPkt);
             }
         }
-        WriteNextPacketToAudioSubtracks(std::move(audioFrames));
+        WriteNextPacketToAudioSubtracks(audioFrames, pMuxAudio->pBuffer->filtered);
     }
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
 //フィルタリング後のパケットをサブトラックに分配する
-RGY_ERR RGYOutputAvcodec::WriteNextPacketToAudioSubtracks(vector<AVPktMuxData> audioFrames) {
+RGY_ERR RGYOutputAvcodec::WriteNextPacketToAudioSubtracks(vector<AVPktMuxData>& audioFrames, vector<AVPktMuxData>& filteredFrames) {
     const auto origPkts = audioFrames.size();
     for (size_t i = 0; i < origPkts; i++) {
         //サブストリームが存在すれば、frameをコピーしてそれぞれに渡す
@@ -2959,15 +3168,17 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketToAudioSubtracks(vector<AVPktMuxData> a
         for (int iSubStream = 1; nullptr != (pMuxAudioSubStream = getAudioStreamData(audioFrames[i].pMuxAudio->nInTrackId, iSubStream)); iSubStream++) {
             auto pktDataCopy = audioFrames[i];
             pktDataCopy.pMuxAudio = pMuxAudioSubStream;
-            pktDataCopy.pFrame = (audioFrames[i].pFrame) ? av_frame_clone(audioFrames[i].pFrame) : nullptr;
+            pktDataCopy.pFrame = (audioFrames[i].pFrame) ? m_Mux.audioFramePool.clone(audioFrames[i].pFrame) : nullptr;
             audioFrames.push_back(pktDataCopy);
         }
     }
-    return WriteNextPacketAudioFrame(std::move(AudioFilterFrame(std::move(audioFrames))));
+    filteredFrames.clear();
+    AudioFilterFrame(audioFrames, filteredFrames);
+    return WriteNextPacketAudioFrame(filteredFrames);
 }
 
 //フレームをresampleして後段に渡す
-RGY_ERR RGYOutputAvcodec::WriteNextPacketAudioFrame(vector<AVPktMuxData> audioFrames) {
+RGY_ERR RGYOutputAvcodec::WriteNextPacketAudioFrame(vector<AVPktMuxData>& audioFrames) {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
     const bool bAudEncThread = m_Mux.thread.thAudEncode.joinable();
 #else
@@ -2981,6 +3192,9 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacketAudioFrame(vector<AVPktMuxData> audioFr
             } else {
                 WriteNextAudioFrame(&pktData);
             }
+        } else {
+            //後段に渡さないフレームはここで返却する
+            m_Mux.audioFramePool.release(pktData.pFrame);
         }
     }
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
@@ -3004,8 +3218,10 @@ RGY_ERR RGYOutputAvcodec::WriteNextAudioFrame(AVPktMuxData *pktData) {
         //音声エンコードスレッドが存在しない場合、ここにAVPacketは流れてこないはず
         return RGY_ERR_UNSUPPORTED;
     }
-    auto encPktDatas = AudioEncodeFrame(pktData->pMuxAudio, pktData->pFrame);
-    av_frame_unref(pktData->pFrame);
+    auto& encPktDatas = pktData->pMuxAudio->pBuffer->encoded;
+    encPktDatas.clear();
+    AudioEncodeFrame(pktData->pMuxAudio, pktData->pFrame, encPktDatas);
+    m_Mux.audioFramePool.release(pktData->pFrame);
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
     if (m_Mux.thread.thAudProcess.joinable()) {
         for (auto& pktMux : encPktDatas) {
@@ -3024,6 +3240,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextAudioFrame(AVPktMuxData *pktData) {
 
 RGY_ERR RGYOutputAvcodec::ThreadFuncAudEncodeThread() {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    RGY_PERF_TRACE_THREAD_NAME("audio encode");
     WaitForSingleObject(m_Mux.thread.heEventPktAddedAudEncode, INFINITE);
     while (!m_Mux.thread.bThAudEncodeAbort) {
         if (!m_Mux.format.bFileHeaderWritten) {
@@ -3051,6 +3268,7 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudEncodeThread() {
 
 RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    RGY_PERF_TRACE_THREAD_NAME("audio process");
     WaitForSingleObject(m_Mux.thread.heEventPktAddedAudProcess, INFINITE);
     while (!m_Mux.thread.bThAudProcessAbort) {
         if (!m_Mux.format.bFileHeaderWritten) {
@@ -3077,25 +3295,109 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
+RGY_ERR RGYOutputAvcodec::InitAudWorkers(int nAudioTrackThread) {
+#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    //音声をエンコードする入力トラック (チャンネル分離したストリームは同じ入力トラックとして扱う)
+    vector<int> inTrackIds;
+    for (const auto& muxAudio : m_Mux.audio) {
+        if (muxAudio.pOutCodecDecodeCtx
+            && std::find(inTrackIds.begin(), inTrackIds.end(), muxAudio.nInTrackId) == inTrackIds.end()) {
+            inTrackIds.push_back(muxAudio.nInTrackId);
+        }
+    }
+    const int nWorkers = (nAudioTrackThread < 0) ? (int)inTrackIds.size() : (std::min)(nAudioTrackThread, (int)inTrackIds.size());
+    for (int i = 0; i < nWorkers; i++) {
+        std::unique_ptr<AVMuxAudioWorker> worker(new AVMuxAudioWorker());
+        worker->nWorkerId = i;
+        worker->bAbort = false;
+        worker->heEventFlushed  = CreateEvent(NULL, TRUE, FALSE, NULL);
+        worker->heEventClosing  = CreateEvent(NULL, TRUE, FALSE, NULL);
+        m_Mux.thread.audioWorkers.push_back(std::move(worker));
+    }
+    //入力トラックを順に割り当てる
+    //同じ入力トラックのパケットは常に同じスレッドで処理されるので、トラック内の順序は保たれる
+    auto pQueueInfo = m_Mux.thread.pQueueInfo;
+    for (int i = 0; i < (int)inTrackIds.size(); i++) {
+        auto pWorker = m_Mux.thread.audioWorkers[i % nWorkers].get();
+        AVMuxAudioWorkerTrack track = { 0 };
+        track.nInTrackId = inTrackIds[i];
+        track.nPerfSlot = -1;
+        if (pQueueInfo && pQueueInfo->aud_track_num < PERF_MONITOR_AUD_TRACK_MAX) {
+            track.nPerfSlot = pQueueInfo->aud_track_num;
+            pQueueInfo->aud_track_id[track.nPerfSlot] = trackID(inTrackIds[i]);
+            pQueueInfo->aud_track_time_us[track.nPerfSlot] = 0;
+            pQueueInfo->aud_track_num++;
+        }
+        pWorker->tracks.push_back(track);
+        for (auto& muxAudio : m_Mux.audio) {
+            if (muxAudio.nInTrackId == inTrackIds[i]) {
+                muxAudio.pWorker = pWorker;
+            }
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("audio #%d: processed by audio worker thread %d.\n"), trackID(inTrackIds[i]), pWorker->nWorkerId);
+    }
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        worker->qPacketIn.init(8192);
+        worker->qPacketOut.init(8192, 256 * worker->tracks.size());
+        worker->thread = std::thread(&RGYOutputAvcodec::ThreadFuncAudWorkerThread, this, worker.get());
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("started %d audio worker threads for %d tracks.\n"), nWorkers, (int)inTrackIds.size());
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYOutputAvcodec::ThreadFuncAudWorkerThread(AVMuxAudioWorker *pWorker) {
+#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    RGY_PERF_TRACE_THREAD_NAME(strsprintf("audio worker %d", pWorker->nWorkerId).c_str());
+    //パケットが追加されるまでqPacketIn内で待機し、closeされて空になったら終了する
+    AVPktMuxData pktData = { 0 };
+    while (pWorker->qPacketIn.pop(&pktData)) {
+        if (pktData.pkt.data == nullptr) {
+            //終端パケット: 担当するストリームをflushし、その出力をすべてキューに追加したことを通知する
+            for (auto& muxAudio : m_Mux.audio) {
+                if (muxAudio.pWorker == pWorker) {
+                    AudioFlushStream(&muxAudio, &pktData.dts);
+                }
+            }
+            SetEvent(pWorker->heEventFlushed);
+            continue;
+        }
+        auto track = std::find_if(pWorker->tracks.begin(), pWorker->tracks.end(), [&pktData](const AVMuxAudioWorkerTrack& t) {
+            return t.nInTrackId == pktData.pMuxAudio->nInTrackId;
+        });
+        const int64_t audioTimeUs = av_rescale_q(pktData.pkt.duration, pktData.pMuxAudio->pStreamIn->time_base, av_make_q(1, 1000000));
+        const int64_t processStart = muxClockUs();
+        //音声処理を実行、出力キューに追加する
+        WriteNextPacketAudio(&pktData);
+        if (track != pWorker->tracks.end()) {
+            track->nPackets++;
+            track->nAudioTimeUs += audioTimeUs;
+            track->nProcessTimeUs += muxClockUs() - processStart;
+            if (m_Mux.thread.pQueueInfo && track->nPerfSlot >= 0) {
+                m_Mux.thread.pQueueInfo->aud_track_time_us[track->nPerfSlot] = track->nAudioTimeUs;
+            }
+        }
+    }
+    SetEvent(pWorker->heEventClosing);
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+}
+
 RGY_ERR RGYOutputAvcodec::WriteThreadFunc() {
 #if ENABLE_AVCODEC_OUT_THREAD
-    //映像と音声の同期をとる際に、それをあきらめるまでの閾値
-    const int nWaitThreshold = 32;
-    const size_t videoPacketThreshold = std::min<size_t>(3072, m_Mux.thread.qVideobitstream.capacity()) - nWaitThreshold;
-    const size_t audioPacketThreshold = std::min<size_t>(6144, m_Mux.thread.qAudioPacketOut.capacity()) - nWaitThreshold;
-    //キューにデータが存在するか
-    bool bAudioExists = false;
-    bool bVideoExists = false;
+    RGY_PERF_TRACE_THREAD_NAME("mux");
     const auto fpsTimebase = av_inv_q(m_Mux.video.nFPS);
     const auto dtsThreshold = std::max(av_rescale_q(4, fpsTimebase, QUEUE_DTS_TIMEBASE), 4ll);
-    //syncIgnoreDtsは映像と音声の同期を行う必要がないことを意味する
-    //dtsThresholdを加算したときにオーバーフローしないよう、dtsThresholdを引いておく
-    const int64_t syncIgnoreDts = INT64_MAX - dtsThreshold;
-    int64_t audioDts = (m_Mux.audio.size()) ? 0 : syncIgnoreDts;
-    int64_t videoDts = (m_Mux.video.pStreamOut) ? 0 : syncIgnoreDts;
+    auto& qVideo = m_Mux.thread.qVideobitstream;
+    auto& qAudio = m_Mux.thread.qAudioPacketOut;
     WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
     //bThAudProcessは出力開始した後で取得する(この前だとまだ起動していないことがある)
     const bool bThAudProcess = m_Mux.thread.thAudProcess.joinable();
+    //トラックごとの音声処理スレッドも同様に、出力開始した後で取得する
+    std::vector<AVMuxAudioWorker *> audWorkers;
+    for (auto& worker : m_Mux.thread.audioWorkers) {
+        audWorkers.push_back(worker.get());
+    }
     auto writeProcessedPacket = [this](AVPktMuxData *pktData) {
         //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
         auto sts = RGY_ERR_NONE;
@@ -3107,130 +3409,239 @@ RGY_ERR RGYOutputAvcodec::WriteThreadFunc() {
         }
         return sts;
     };
+
+    //映像と音声の入力トラックごとにストリームを用意し、直近に出力したdtsの小さいストリームから順に次のパケットを出力する
+    //次に出力すべきストリームのパケットがまだ来ていない場合のみ、パケットの追加を待機する
+    std::vector<AVMuxSchedStream> streams;
+    auto addStream = [&streams](int nInTrackId) {
+        AVMuxSchedStream stream;
+        stream.nInTrackId = nInTrackId;
+        stream.lastDts = 0;
+        stream.parked = false;
+        stream.nPackets = 0;
+        stream.latencySum = 0;
+        stream.latencyMax = 0;
+        streams.push_back(std::move(stream));
+    };
+    const int videoIdx = (m_Mux.video.pStreamOut) ? 0 : -1;
+    if (videoIdx >= 0) {
+        addStream(0);
+    }
+    const int audioIdxStart = (int)streams.size();
+    auto findAudioStream = [&streams, audioIdxStart](int nInTrackId) {
+        for (int i = audioIdxStart; i < (int)streams.size(); i++) {
+            if (streams[i].nInTrackId == nInTrackId) {
+                return i;
+            }
+        }
+        return -1;
+    };
+    for (const auto& muxAudio : m_Mux.audio) {
+        //チャンネル分離した音声は同じ入力トラックから生成されるので、ひとつのストリームとして扱う
+        if (findAudioStream(muxAudio.nInTrackId) < 0) {
+            addStream(muxAudio.nInTrackId);
+        }
+    }
+    //(直近に出力したdts, ストリームのindex)の最小ヒープ
+    //dtsが同じならindexの小さいほう(映像)を先に出力するので、出力順は一意に決まる
+    typedef std::pair<int64_t, int> SchedKey;
+    std::vector<SchedKey> heap;
+    auto heapPush = [&heap](int64_t dts, int idx) {
+        heap.push_back(SchedKey(dts, idx));
+        std::push_heap(heap.begin(), heap.end(), std::greater<SchedKey>());
+    };
+    auto heapPop = [&heap]() {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<SchedKey>());
+        heap.pop_back();
+    };
+    for (int i = 0; i < (int)streams.size(); i++) {
+        heapPush(streams[i].lastDts, i);
+    }
+    //音声処理スレッドがない場合、m_AudPktBufFileHeadにキャッシュしてあるパケットを処理するdtsの上限
+    auto maxDtsToWrite = [&]() {
+        return (videoIdx >= 0) ? streams[videoIdx].lastDts + dtsThreshold : INT64_MAX;
+    };
+    auto writeAudioPacket = [&](AVPktMuxData *pktData) {
+        (bThAudProcess) ? writeProcessedPacket(pktData) : WriteNextPacketInternal(pktData, maxDtsToWrite());
+    };
+
+    std::deque<AVPktMuxData> otherPending; //字幕・データ・終端のパケット
+    size_t audioPendingCount = 0;
     int audPacketsPerSec = 64;
-    int nWaitAudio = 0;
-    int nWaitVideo = 0;
-    while (!m_Mux.thread.bAbortOutput) {
-        do {
-            if (!m_Mux.format.bFileHeaderWritten) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                //ヘッダー取得前に音声キューのサイズが足りず、エンコードが進まなくなってしまうことがある
-                //キューのcapcityを増やすことでこれを回避する
-                auto type = (m_Mux.thread.thAudEncode.joinable()) ? AUD_QUEUE_ENCODE : AUD_QUEUE_OUT;
-                auto& qAudio = (type == AUD_QUEUE_OUT) ? m_Mux.thread.qAudioPacketOut : m_Mux.thread.qAudioFrameEncode;
-                const auto nQueueCapacity = qAudio.capacity();
-                if (qAudio.size() >= nQueueCapacity) {
-                    qAudio.set_capacity(nQueueCapacity * 3 / 2);
+    //音声キューのパケットを入力トラックごとに振り分ける
+    //振り分け済みのパケットが音声キューの容量に達したら、それ以上は取り出さない (エンコード側を待機させる)
+    auto drainAudioQueue = [&](RGYQueueSPSP<AVPktMuxData, 64>& queue, size_t *pQueueUsage) {
+        AVPktMuxData pktData = { 0 };
+        while (audioPendingCount < qAudio.capacity()
+            && queue.front_copy_and_pop_no_lock(&pktData, pQueueUsage)) {
+            if (pktData.pMuxAudio && pktData.pMuxAudio->pStreamIn) {
+                audPacketsPerSec = std::max(audPacketsPerSec, (int)(1.0 / (av_q2d(pktData.pMuxAudio->pStreamIn->time_base) * pktData.pkt.duration) + 0.5));
+                if ((int)qAudio.capacity() < audPacketsPerSec * 4) {
+                    qAudio.set_capacity(audPacketsPerSec * 4);
                 }
-                //動画キューになにもなかったら再度待機する
-                if (m_Mux.thread.qVideobitstream.size() == 0) {
-                    break;
+                if ((int)queue.capacity() < audPacketsPerSec * 4) {
+                    queue.set_capacity(audPacketsPerSec * 4);
                 }
             }
-            //映像・音声の同期待ちが必要な場合、falseとなってループから抜けるよう、ここでfalseに設定する
-            bAudioExists = false;
-            bVideoExists = false;
-            RGYBitstream bitstream = RGYBitstreamInit();
-            while ((audioDts < 0 || videoDts <= audioDts + dtsThreshold)
-                && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_vid_out : nullptr))) {
-                WriteNextFrameInternal(&bitstream, &videoDts);
-                nWaitVideo = 0;
-                //AddMessage(RGY_LOG_TRACE, _T("videoDts=%8lld.\n"), videoDts);
+            const int idx = (pktData.pMuxAudio && pktData.pkt.data) ? findAudioStream(pktData.pMuxAudio->nInTrackId) : -1;
+            if (idx < 0) {
+                otherPending.push_back(pktData);
+                continue;
             }
-            AVPktMuxData pktData = { 0 };
-            while ((videoDts < 0 || audioDts <= videoDts + dtsThreshold)
-                && false != (bAudioExists = m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_aud_out : nullptr))) {
-                if (pktData.pMuxAudio && pktData.pMuxAudio->pStreamIn) {
-                    audPacketsPerSec = std::max(audPacketsPerSec, (int)(1.0 / (av_q2d(pktData.pMuxAudio->pStreamIn->time_base) * pktData.pkt.duration) + 0.5));
-                    if ((int)m_Mux.thread.qAudioPacketOut.capacity() < audPacketsPerSec * 4) {
-                        m_Mux.thread.qAudioPacketOut.set_capacity(audPacketsPerSec * 4);
-                    }
-                }
-                const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : syncIgnoreDts;
-                //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-                (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-                //複数のstreamがあり得るので最大値をとる
-                audioDts = (std::max)(audioDts, pktData.dts);
-                nWaitAudio = 0;
-                //AddMessage(RGY_LOG_TRACE, _T("audioDts=%8lld, maxDst=%8lld.\n"), audioDts, maxDts);
-            }
-            //一定以上の動画フレームがキューにたまっており、音声キューになにもなければ、
-            //音声を無視して動画フレームの処理を開始させる
-            //音声が途中までしかなかったり、途中からしかなかったりする場合にこうした処理が必要
-            if (m_Mux.thread.qAudioPacketOut.size() == 0 && m_Mux.thread.qVideobitstream.size() > videoPacketThreshold) {
-                nWaitAudio++;
-                if (nWaitAudio <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    break;
-                }
-                audioDts = videoDts;
-                //AddMessage(RGY_LOG_TRACE, _T("audio not coming.\n"));
-            }
-            //一定以上の音声フレームがキューにたまっており、動画キューになにもなければ、
-            //動画を無視して音声フレームの処理を開始させる
-            if (m_Mux.thread.qVideobitstream.size() == 0 && m_Mux.thread.qAudioPacketOut.size() > audioPacketThreshold) {
-                nWaitVideo++;
-                if (nWaitVideo <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    break;
-                }
-                videoDts = audioDts;
-                //AddMessage(RGY_LOG_TRACE, _T("video not coming.\n"));
-            }
-        } while (bAudioExists || bVideoExists); //両方のキューがひとまず空になるか、映像・音声の同期待ちが必要になるまで回す
-                                                //次のフレーム・パケットが送られてくるまで待機する
-        //キューの容量が両方とも半分以下なら、すこし待ってみる
-        //一方、どちらかのキューが半分以上使われていれば、なるべく早く処理する必要がある
-        if (   m_Mux.thread.qVideobitstream.size() / (double)m_Mux.thread.qVideobitstream.capacity() < 0.5
-            && m_Mux.thread.qAudioPacketOut.size() / (double)m_Mux.thread.qAudioPacketOut.capacity() < 0.5) {
-            ResetEvent(m_Mux.thread.heEventPktAddedOutput);
-            WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, 16);
+            auto& stream = streams[idx];
+            stream.pending.push_back(pktData);
+            audioPendingCount++;
+            if (stream.parked) {
+                stream.parked = false;
+                heapPush(stream.lastDts, idx);
+            }
+        }
+    };
+    //トラックごとの音声処理スレッドの出力を先に振り分ける
+    //終端のパケットは、すべてのスレッドの出力がキューに追加された後でqAudioに追加される
+    auto drainAudio = [&]() {
+        for (auto worker : audWorkers) {
+            drainAudioQueue(worker->qPacketOut, nullptr);
+        }
+        drainAudioQueue(qAudio, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_aud_out : nullptr);
+    };
+    //振り分け前の音声パケットの数
+    auto audioWorkerQueued = [&]() {
+        size_t queued = 0;
+        for (auto worker : audWorkers) {
+            queued += worker->qPacketOut.size();
+        }
+        return queued;
+    };
+    auto audioQueued = [&]() {
+        return qAudio.size() + audioWorkerQueued();
+    };
+    //字幕・データのパケットは同期の対象とせず、来た順に出力する
+    //終端のパケット(pkt.data == nullptr)は、振り分け済みの音声パケットと、トラックごとの音声処理スレッドの出力をすべて出力してから処理する
+    auto writeOtherPending = [&]() {
+        while (m_Mux.format.bFileHeaderWritten && otherPending.size() > 0) {
+            if (otherPending.front().pkt.data == nullptr && (audioPendingCount > 0 || audioWorkerQueued() > 0)) {
+                break;
+            }
+            AVPktMuxData pktData = otherPending.front();
+            otherPending.pop_front();
+            writeAudioPacket(&pktData);
+        }
+    };
+    //ストリームの次のパケットを出力する、パケットがまだなければfalseを返す
+    auto writeNext = [&](int idx) {
+        auto& stream = streams[idx];
+        int64_t queuedTime = 0;
+        if (idx == videoIdx) {
+            AVMuxVideoPkt videoPkt;
+            if (!qVideo.front_copy_and_pop_no_lock(&videoPkt, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_vid_out : nullptr)) {
+                return false;
+            }
+            WriteNextFrameInternal(&videoPkt.bitstream, &stream.lastDts);
+            queuedTime = videoPkt.queuedTime;
         } else {
-            std::this_thread::yield();
+            if (stream.pending.size() == 0) {
+                return false;
+            }
+            AVPktMuxData pktData = stream.pending.front();
+            stream.pending.pop_front();
+            audioPendingCount--;
+            writeAudioPacket(&pktData);
+            //チャンネル分離などで複数のstreamがあり得るので最大値をとる
+            stream.lastDts = (std::max)(stream.lastDts, pktData.dts);
+            queuedTime = pktData.queuedTime;
+        }
+        const int64_t latency = muxClockUs() - queuedTime;
+        stream.nPackets++;
+        stream.latencySum += latency;
+        stream.latencyMax = (std::max)(stream.latencyMax, latency);
+        return true;
+    };
+    //いずれかのキューが上限に達していると、エンコード側が待機してしまうため、待っているパケットが来ることはない
+    //音声が途中までしかなかったり、途中からしかなかったりする場合にこうなる
+    auto isStalled = [&]() {
+        return (videoIdx >= 0 && qVideo.size() >= qVideo.capacity())
+            || audioPendingCount + audioQueued() >= qAudio.capacity();
+    };
+    int64_t nWait = 0;
+    int64_t nParked = 0;
+    auto waitPacket = [&](int idx) {
+        const bool waitVideo = videoIdx >= 0 && (idx == videoIdx || streams[videoIdx].parked);
+        ResetEvent(m_Mux.thread.heEventPktAddedOutput);
+        nWait++;
+        if (!m_Mux.format.bFileHeaderWritten) {
+            //ヘッダー取得前に音声キューのサイズが足りず、エンコードが進まなくなってしまうことがある
+            //キューのcapcityを増やすことでこれを回避する
+            auto type = (m_Mux.thread.thAudEncode.joinable()) ? AUD_QUEUE_ENCODE : AUD_QUEUE_OUT;
+            auto& qAudioHead = (type == AUD_QUEUE_OUT) ? qAudio : m_Mux.thread.qAudioFrameEncode;
+            const auto nQueueCapacity = qAudioHead.capacity();
+            if (qAudioHead.size() + ((type == AUD_QUEUE_OUT) ? audioPendingCount : 0) >= nQueueCapacity) {
+                qAudioHead.set_capacity(nQueueCapacity * 3 / 2);
+            }
+            //音声エンコードスレッド側のキューは追加の通知が来ないので、最初の映像パケットが来るまでは一定時間ごとに確認する
+            WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, 1);
+            return;
+        }
+        //ResetEventの後に改めて確認し、状況が変わっていなければ、パケットが追加されるまで待機する
+        if (m_Mux.thread.bAbortOutput || isStalled() || audioQueued() > 0 || (waitVideo && qVideo.size() > 0)) {
+            return;
+        }
+        WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
+    };
+    for (;;) {
+        //bAbortOutputがセットされた後は、もうパケットが追加されることはないので、残ったパケットを出力しきったら終了する
+        const bool bAbort = m_Mux.thread.bAbortOutput;
+        drainAudio();
+        writeOtherPending();
+        if (videoIdx >= 0 && streams[videoIdx].parked && qVideo.size() > 0) {
+            streams[videoIdx].parked = false;
+            heapPush(streams[videoIdx].lastDts, videoIdx);
+        }
+        if (heap.size() == 0) {
+            if (bAbort) {
+                break;
+            }
+            waitPacket(-1);
+            continue;
+        }
+        const int idx = heap.front().second;
+        if (writeNext(idx)) {
+            heapPop();
+            heapPush(streams[idx].lastDts, idx);
+            continue;
         }
+        //次に出力すべきストリームのパケットがまだ来ていない
+        //もう来ないと判断できる場合は、そのストリームを同期の対象から外し、次のパケットが来たら戻す
+        if (bAbort || (isStalled() && (idx != videoIdx || m_Mux.format.bFileHeaderWritten))) {
+            heapPop();
+            streams[idx].parked = true;
+            nParked++;
+            continue;
+        }
+        waitPacket(idx);
     }
     //メインループを抜けたことを通知する
     SetEvent(m_Mux.thread.heEventClosingOutput);
-    m_Mux.thread.qAudioPacketOut.set_keep_length(0);
-    m_Mux.thread.qVideobitstream.set_keep_length(0);
-    bAudioExists = !m_Mux.thread.qAudioPacketOut.empty();
-    bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    //まずは映像と音声の同期をとって出力するためのループ
-    while (bAudioExists && bVideoExists) {
-        AVPktMuxData pktData = { 0 };
-        while (audioDts <= videoDts + dtsThreshold
-            && false != (bAudioExists = m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_aud_out : nullptr))) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : INT64_MAX;
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-            //複数のstreamがあり得るので最大値をとる
-            audioDts = (std::max)(audioDts, pktData.dts);
-        }
-        RGYBitstream bitstream = RGYBitstreamInit();
-        while (videoDts <= audioDts + dtsThreshold
-            && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_vid_out : nullptr))) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
-        }
-        bAudioExists = !m_Mux.thread.qAudioPacketOut.empty();
-        bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    }
-    { //音声を書き出す
-        AVPktMuxData pktData = { 0 };
-        while (m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_aud_out : nullptr)) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, INT64_MAX);
+    //ヘッダーが出力されないまま終了した場合など、まだ残っているパケットを出力する
+    for (auto& stream : streams) {
+        for (auto& pktData : stream.pending) {
+            writeAudioPacket(&pktData);
         }
+        stream.pending.clear();
     }
-    { //動画を書き出す
-        RGYBitstream bitstream = RGYBitstreamInit();
-        while (m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.pQueueInfo) ? &m_Mux.thread.pQueueInfo->usage_vid_out : nullptr)) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
+    audioPendingCount = 0;
+    for (auto& pktData : otherPending) {
+        writeAudioPacket(&pktData);
+    }
+    otherPending.clear();
+    for (const auto& stream : streams) {
+        if (stream.nPackets > 0) {
+            const tstring name = (stream.nInTrackId) ? strsprintf(_T("audio #%d"), trackID(stream.nInTrackId)) : tstring(_T("video"));
+            AddMessage(RGY_LOG_DEBUG, _T("mux latency %s: %lld packets, avg %.2f ms, max %.2f ms.\n"),
+                name.c_str(), (lls)stream.nPackets, stream.latencySum * 0.001 / stream.nPackets, stream.latencyMax * 0.001);
         }
     }
+    AddMessage(RGY_LOG_DEBUG, _T("mux scheduler: waited %lld times, parked streams %lld times.\n"), (lls)nWait, (lls)nParked);
 #endif
     return (m_Mux.format.bStreamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
@@ -3239,6 +3650,29 @@ void RGYOutputAvcodec::WaitFin() {
     CloseThread();
 }
 
+vector<AVDemuxStream> RGYOutputAvcodec::GetAudioMirrorStreams() {
+    vector<AVDemuxStream> streams;
+    for (int i = 0; i < (int)m_Mux.audio.size(); i++) {
+        const auto& muxAudio = m_Mux.audio[i];
+        AVDemuxStream stream = { 0 };
+        stream.nIndex = i;
+        stream.nTrackId = trackFullID(AVMEDIA_TYPE_AUDIO, i + 1);
+        stream.nSubStreamId = 0;
+        stream.pStream = muxAudio.pStreamOut;
+        stream.timebase = muxAudio.pStreamOut->time_base;
+        streams.push_back(stream);
+    }
+    return streams;
+}
+
+void RGYOutputAvcodec::AddAudioMirror(RGYOutputAvcodec *writer) {
+    m_audioMirror.push_back(writer);
+}
+
+RGYAVFramePoolStats RGYOutputAvcodec::GetAudioFramePoolStats() const {
+    return m_Mux.audioFramePool.stats();
+}
+
 HANDLE RGYOutputAvcodec::getThreadHandleOutput() {
 #if ENABLE_AVCODEC_OUT_THREAD
     return (HANDLE)m_Mux.thread.thOutput.native_handle();
@@ -3275,4 +3709,241 @@ int64_t RGYOutputAvcodec::seek(int64_t offset, int whence) {
 }
 #endif //USE_CUSTOM_IO
 
+static const int AUD_POOL_BENCH_TRACKS = 4;
+static const int AUD_POOL_BENCH_SECONDS = 120;
+static const int AUD_POOL_BENCH_SAMPLE_RATE = 48000;
+
+static AVCodecContext *audio_pool_bench_open_encoder(int bitrate) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AC3);
+    if (codec == nullptr) {
+        return nullptr;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (ctx == nullptr) {
+        return nullptr;
+    }
+    ctx->sample_fmt     = AV_SAMPLE_FMT_FLTP;
+    ctx->sample_rate    = AUD_POOL_BENCH_SAMPLE_RATE;
+    ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+    ctx->channels       = av_get_channel_layout_nb_channels(ctx->channel_layout);
+    ctx->bit_rate       = bitrate;
+    ctx->time_base      = av_make_q(1, AUD_POOL_BENCH_SAMPLE_RATE);
+    if (avcodec_open2(ctx, codec, nullptr) < 0) {
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+//トラックごとに周波数の異なる正弦波をac3にエンコードして入力とし、streamに入力ストリームの情報を設定する
+static RGY_ERR audio_pool_bench_make_input(int track, AVStream *stream, std::vector<AVPacket>& packets) {
+    AVCodecContext *enc = audio_pool_bench_open_encoder(384 * 1000);
+    if (enc == nullptr) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    std::unique_ptr<AVCodecContext *, decltype(&avcodec_free_context)> encDeleter(&enc, avcodec_free_context);
+    if (avcodec_parameters_from_context(stream->codecpar, enc) < 0) {
+        return RGY_ERR_UNKNOWN;
+    }
+    stream->time_base = enc->time_base;
+    std::unique_ptr<AVFrame, RGYAVDeleter<AVFrame>> frame(av_frame_alloc(), RGYAVDeleter<AVFrame>(av_frame_free));
+    frame->format         = enc->sample_fmt;
+    frame->channel_layout = enc->channel_layout;
+    frame->channels       = enc->channels;
+    frame->sample_rate    = enc->sample_rate;
+    frame->nb_samples     = enc->frame_size;
+    if (av_frame_get_buffer(frame.get(), 0) < 0) {
+        return RGY_ERR_MEMORY_ALLOC;
+    }
+    auto receive = [&]() {
+        for (;;) {
+            AVPacket pkt;
+            av_init_packet(&pkt);
+            pkt.data = nullptr;
+            pkt.size = 0;
+            if (avcodec_receive_packet(enc, &pkt) < 0) {
+                break;
+            }
+            //readerと同様に、flagsの上位16bitにtrackIdを格納しておく
+            pkt.stream_index = stream->index;
+            pkt.flags = (pkt.flags & 0xffff) | ((uint32_t)trackFullID(AVMEDIA_TYPE_AUDIO, track + 1) << 16);
+            packets.push_back(pkt);
+        }
+    };
+    const double freq = 220.0 * (track + 1);
+    const int64_t totalSamples = (int64_t)AUD_POOL_BENCH_SECONDS * AUD_POOL_BENCH_SAMPLE_RATE;
+    for (int64_t pts = 0; pts < totalSamples; pts += enc->frame_size) {
+        if (av_frame_make_writable(frame.get()) < 0) {
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+        for (int ch = 0; ch < enc->channels; ch++) {
+            float *ptr = (float *)frame->extended_data[ch];
+            for (int i = 0; i < frame->nb_samples; i++) {
+                ptr[i] = (float)(0.5 * std::sin(2.0 * 3.14159265358979 * freq * (pts + i) / AUD_POOL_BENCH_SAMPLE_RATE + ch));
+            }
+        }
+        frame->pts = pts;
+        if (avcodec_send_frame(enc, frame.get()) < 0) {
+            return RGY_ERR_UNKNOWN;
+        }
+        receive();
+    }
+    avcodec_send_frame(enc, nullptr);
+    receive();
+    return (packets.size() > 0) ? RGY_ERR_NONE : RGY_ERR_UNKNOWN;
+}
+
+static uint32_t audio_pool_bench_hash_file(const tstring& filename, int64_t *pFileSize) {
+    uint32_t hash = 2166136261u;
+    int64_t fileSize = 0;
+    std::ifstream fin(filename, std::ios::in | std::ios::binary);
+    std::vector<char> buf(1024 * 1024);
+    while (fin.good()) {
+        fin.read(buf.data(), buf.size());
+        const auto readSize = fin.gcount();
+        for (std::streamsize i = 0; i < readSize; i++) {
+            hash = (hash ^ (uint8_t)buf[i]) * 16777619u;
+        }
+        fileSize += readSize;
+    }
+    *pFileSize = fileSize;
+    return hash;
+}
+
+//--audio-fileと同様に音声のみを出力するRGYOutputAvcodecで、すべてのトラックをデコード→フィルタ→エンコードしてmuxする
+//トラックごとの音声処理スレッド (--audio-track-thread) を使用し、音声フレームのプールはwriter内で共有される
+static RGY_ERR audio_pool_bench_run(const AVFormatContext *inputCtx, const std::vector<std::vector<AVPacket>>& inputs,
+    const tstring& filename, size_t poolMaxCached, RGYAVFramePoolStats *pStats, double *pTimeMs) {
+    AvcodecWriterPrm prm;
+    prm.outputFormat = _T("matroska");
+    prm.nOutputThread = 1;
+    prm.nAudioThread = 0;
+    prm.nAudioTrackThread = -1;
+    prm.nAudioFramePoolMax = poolMaxCached;
+    //出力を比較するため、実行ごとに変わる値を書き込まないようにする
+    prm.vMuxOpt.push_back(std::make_pair(tstring(_T("fflags")), tstring(_T("+bitexact"))));
+    for (int i = 0; i < (int)inputs.size(); i++) {
+        AVOutputStreamPrm streamPrm;
+        streamPrm.src.nIndex = i;
+        streamPrm.src.nTrackId = trackFullID(AVMEDIA_TYPE_AUDIO, i + 1);
+        streamPrm.src.nSubStreamId = 0;
+        streamPrm.src.pStream = inputCtx->streams[i];
+        streamPrm.src.timebase = inputCtx->streams[i]->time_base;
+        streamPrm.encodeCodec = _T("ac3");
+        streamPrm.bitrate = 192;
+        streamPrm.filter = _T("volume=0.5:precision=float");
+        prm.inputStreamList.push_back(streamPrm);
+    }
+
+    auto log = std::make_shared<RGYLog>(nullptr, RGY_LOG_ERROR);
+    auto status = std::make_shared<EncodeStatus>();
+    RGYOutputAvcodec writer;
+    RGYOutput& output = writer;
+    const auto start = std::chrono::high_resolution_clock::now();
+    auto sts = output.Init(filename.c_str(), nullptr, &prm, log, status);
+    if (sts != RGY_ERR_NONE) {
+        return sts;
+    }
+    //readerと同様に、各トラックのパケットを交互に渡す
+    for (size_t ipkt = 0; sts == RGY_ERR_NONE; ipkt++) {
+        bool remaining = false;
+        for (const auto& packets : inputs) {
+            if (ipkt >= packets.size()) {
+                continue;
+            }
+            remaining = true;
+            AVPacket pkt;
+            av_init_packet(&pkt);
+            if (0 != av_packet_ref(&pkt, &packets[ipkt])) {
+                sts = RGY_ERR_MEMORY_ALLOC;
+                break;
+            }
+            if ((sts = writer.WriteNextPacket(&pkt)) != RGY_ERR_NONE) {
+                break;
+            }
+        }
+        if (!remaining) {
+            break;
+        }
+    }
+    if (sts == RGY_ERR_NONE) {
+        //エンコーダなどにキャッシュされたパケットを書き出す
+        sts = writer.WriteNextPacket(nullptr);
+    }
+    writer.Close();
+    *pTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    *pStats = writer.GetAudioFramePoolStats();
+    return sts;
+}
+
+int audio_pool_bench(FILE *fp) {
+    av_register_all();
+    avcodec_register_all();
+    avfilter_register_all();
+
+    //入力の音声トラックに相当するストリーム
+    std::unique_ptr<AVFormatContext, decltype(&avformat_free_context)> inputCtx(avformat_alloc_context(), avformat_free_context);
+    std::vector<std::vector<AVPacket>> inputs(AUD_POOL_BENCH_TRACKS);
+    int64_t inputPackets = 0;
+    for (int i = 0; i < AUD_POOL_BENCH_TRACKS; i++) {
+        AVStream *stream = avformat_new_stream(inputCtx.get(), nullptr);
+        auto sts = (stream) ? audio_pool_bench_make_input(i, stream, inputs[i]) : RGY_ERR_MEMORY_ALLOC;
+        if (sts != RGY_ERR_NONE) {
+            _ftprintf(stderr, _T("Failed to create input audio for track %d: %s\n"), i, get_err_mes(sts));
+            return 1;
+        }
+        inputPackets += inputs[i].size();
+    }
+
+    if (!inputCtx) {
+        return 1;
+    }
+    fprintf(fp, "mode,tracks,packets_in,frame_get,frame_alloc,alloc_per_frame,peak_used,output_size,time_ms,verify\n");
+    bool allOK = true;
+    uint32_t refHash = 0;
+    for (int usePool = 0; usePool < 2; usePool++) {
+#if defined(_WIN32) || defined(_WIN64)
+        TCHAR tempDir[1024] = { 0 };
+        GetTempPath(_countof(tempDir), tempDir);
+        const tstring filename = PathCombineS(tstring(tempDir), strsprintf(_T("rgy_audio_pool_bench_%d_%d.mka"), GetCurrentProcessId(), usePool));
+#else
+        const tstring filename = strsprintf(_T("/tmp/rgy_audio_pool_bench_%d_%d.mka"), (int)getpid(), usePool);
+#endif
+        RGYAVFramePoolStats stats = { 0 };
+        double timeMs = 0.0;
+        auto sts = audio_pool_bench_run(inputCtx.get(), inputs, filename, (usePool) ? AUD_FRAME_POOL_MAX_CACHED : 0, &stats, &timeMs);
+        int64_t outputSize = 0;
+        const uint32_t hash = audio_pool_bench_hash_file(filename, &outputSize);
+        _tremove(filename.c_str());
+        if (sts != RGY_ERR_NONE) {
+            _ftprintf(stderr, _T("Failed to transcode audio (%s): %s\n"), (usePool) ? _T("pool") : _T("alloc"), get_err_mes(sts));
+        }
+
+        //すべてのフレームが返却されていること
+        bool ok = sts == RGY_ERR_NONE && outputSize > 0 && stats.used == 0;
+        if (usePool) {
+            //プールの有無で出力が変わらないこと
+            ok &= hash == refHash;
+            //確保は同時に使用するフレームの分だけで済むこと
+            ok &= stats.miss <= (uint64_t)stats.peakUsed + AUD_POOL_BENCH_TRACKS;
+        } else {
+            refHash = hash;
+        }
+        const uint64_t frameGet = stats.hit + stats.miss;
+        fprintf(fp, "%s,%d,%lld,%llu,%llu,%.3f,%lld,%lld,%.1f,%s\n", (usePool) ? "pool" : "alloc",
+            AUD_POOL_BENCH_TRACKS, (long long)inputPackets,
+            (unsigned long long)frameGet, (unsigned long long)stats.miss,
+            (frameGet) ? stats.miss / (double)frameGet : 0.0,
+            (long long)stats.peakUsed, (long long)outputSize, timeMs, ok ? "OK" : "NG");
+        fflush(fp);
+        allOK &= ok;
+    }
+    for (auto& packets : inputs) {
+        for (auto& pkt : packets) {
+            av_packet_unref(&pkt);
+        }
+    }
+    return allOK ? 0 : 1;
+}
+
 #endif //ENABLE_AVSW_READER
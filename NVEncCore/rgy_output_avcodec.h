@@ -36,8 +36,11 @@
 #include <thread>
 #include <atomic>
 #include <cstdint>
+#include <deque>
 #include "rgy_avutil.h"
 #include "rgy_bitstream.h"
+#include "rgy_bitstream_pool.h"
+#include "rgy_avframe_pool.h"
 #include "rgy_input_avcodec.h"
 #include "rgy_output.h"
 #include "rgy_perf_monitor.h"
@@ -50,8 +53,9 @@ using std::vector;
 
 static const int SUB_ENC_BUF_MAX_SIZE = 1024 * 1024;
 
-static const int VID_BITSTREAM_QUEUE_SIZE_I  = 4;
-static const int VID_BITSTREAM_QUEUE_SIZE_PB = 64;
+static const size_t VID_BITSTREAM_POOL_MAX_CACHED_BYTES = 256 * 1024 * 1024; //映像パケットの空き領域として保持する上限
+static const size_t VID_BITSTREAM_POOL_MAX_BLOCKS = 256; //映像パケットの空き領域としてサイズクラスごとに保持する上限
+static const size_t AUD_FRAME_POOL_MAX_CACHED = 1024; //音声フレームの空き構造体として保持する上限
 
 struct AVMuxTimestamp {
     int64_t timestamp_list[8];
@@ -104,6 +108,7 @@ typedef struct AVMuxFormat {
     bool                  bIsMatroska;          //mkvかどうか
     bool                  bIsPipe;              //パイプ出力かどうか
     bool                  bFileHeaderWritten;   //ファイルヘッダを出力したかどうか
+    bool                  bLowLatency;          //パケットごとに出力をフラッシュする
     AVDictionary         *pHeaderOptions;       //ヘッダオプション
 } AVMuxFormat;
 
@@ -123,6 +128,9 @@ typedef struct AVMuxVideo {
     RGYTimestamp         *pTimestamp;           //timestampの情報
 } AVMuxVideo;
 
+struct AVMuxAudioWorker;
+struct AVMuxAudioBuffer;
+
 typedef struct AVMuxAudio {
     int                   nInTrackId;           //ソースファイルの入力トラック番号
     int                   nInSubStream;         //ソースファイルの入力サブストリーム番号
@@ -167,6 +175,9 @@ typedef struct AVMuxAudio {
     int                   nOutputSamples;       //出力音声の出力済みsample数
     int64_t               nLastPtsIn;           //入力音声の前パケットのpts (input stream timebase)
     int64_t               nLastPtsOut;          //出力音声の前パケットのpts
+
+    AVMuxAudioWorker     *pWorker;              //このストリームを処理するトラックごとの音声処理スレッド (なければnullptr)
+    AVMuxAudioBuffer     *pBuffer;              //音声処理の各段の出力を格納する (InitAudioで作成)
 } AVMuxAudio;
 
 typedef struct AVMuxOther {
@@ -199,8 +210,24 @@ typedef struct AVPktMuxData {
     int         samples;     //type == MUX_DATA_TYPE_PACKET 時有効
     AVFrame    *pFrame;      //type == MUX_DATA_TYPE_FRAME 時有効
     int         got_result;  //type == MUX_DATA_TYPE_FRAME 時有効
+    int64_t     queuedTime;  //キューに追加した時刻 (us, mux遅延の計測用)
 } AVPktMuxData;
 
+//音声処理の各段の出力 (呼び出しごとに確保しないよう、ストリームごとに保持して使いまわす)
+//decoded/frames/filteredはデコードを行うスレッド、encodedはエンコードを行うスレッドのみが使用する
+//フィルタの再初期化に伴うflushは処理の途中で呼ばれるので、そちらでは使用しない
+typedef struct AVMuxAudioBuffer {
+    vector<AVFrame *>    decoded;  //AudioDecodePacketの出力
+    vector<AVPktMuxData> frames;   //デコードしたフレーム (サブストリームへのコピーを含む)
+    vector<AVPktMuxData> filtered; //AudioFilterFrameの出力
+    vector<AVPktMuxData> encoded;  //AudioEncodeFrameの出力
+} AVMuxAudioBuffer;
+
+typedef struct AVMuxVideoPkt {
+    RGYBitstream bitstream;  //映像パケット
+    int64_t      queuedTime; //キューに追加した時刻 (us, mux遅延の計測用)
+} AVMuxVideoPkt;
+
 enum {
     AUD_QUEUE_PROCESS = 0,
     AUD_QUEUE_ENCODE  = 1,
@@ -208,6 +235,38 @@ enum {
 };
 
 #if ENABLE_AVCODEC_OUT_THREAD
+//出力スレッドでdts順に出力するストリーム (映像 or 音声の入力トラック)
+typedef struct AVMuxSchedStream {
+    int                      nInTrackId;   //音声の入力トラック番号 (映像なら0)
+    std::deque<AVPktMuxData> pending;      //出力待ちの音声パケット (映像はqVideobitstreamから直接取り出す)
+    int64_t                  lastDts;      //最後に出力したパケットのdts (QUEUE_DTS_TIMEBASE)
+    bool                     parked;       //パケットが来ないため、同期の対象から外している
+    int64_t                  nPackets;     //出力したパケット数
+    int64_t                  latencySum;   //キューに追加されてから出力するまでの時間の合計 (us)
+    int64_t                  latencyMax;   //キューに追加されてから出力するまでの時間の最大 (us)
+} AVMuxSchedStream;
+
+//トラックごとの音声処理スレッドが担当する入力トラック
+typedef struct AVMuxAudioWorkerTrack {
+    int                      nInTrackId;     //音声の入力トラック番号
+    int                      nPerfSlot;      //PerfQueueInfoのaud_track_xxxでの位置 (-1なら記録しない)
+    int64_t                  nPackets;       //処理したパケット数
+    int64_t                  nAudioTimeUs;   //処理した音声の長さ (us)
+    int64_t                  nProcessTimeUs; //処理にかかった時間 (us)
+} AVMuxAudioWorkerTrack;
+
+//トラックごとの音声処理スレッド (担当する入力トラックのデコード/フィルタ/エンコードを行う)
+typedef struct AVMuxAudioWorker {
+    int                                nWorkerId;
+    std::vector<AVMuxAudioWorkerTrack> tracks;          //担当する入力トラック
+    std::thread                        thread;
+    std::atomic<bool>                  bAbort;          //スレッドに停止を通知する
+    HANDLE                             heEventFlushed;  //終端パケットまでの出力をすべてqPacketOutに追加したことを通知する
+    HANDLE                             heEventClosing;  //スレッドが停止処理を開始したことを通知する
+    RGYQueueMPMC<AVPktMuxData>         qPacketIn;       //音声処理スレッドから処理前音声パケットを受け取るキュー (closeでスレッドを停止する)
+    RGYQueueSPSP<AVPktMuxData, 64>     qPacketOut;      //処理済み音声パケットを出力スレッドに渡すためのキュー
+} AVMuxAudioWorker;
+
 typedef struct AVMuxThread {
     bool                           bEnableOutputThread;       //出力スレッドを使用する
     bool                           bEnableAudProcessThread;   //音声処理スレッドを使用する
@@ -224,12 +283,12 @@ typedef struct AVMuxThread {
     HANDLE                         heEventClosingAudProcess;  //音声処理スレッドが停止処理を開始したことを通知する
     HANDLE                         heEventPktAddedAudEncode;  //キューのいずれかにデータが追加されたことを通知する
     HANDLE                         heEventClosingAudEncode;   //音声処理スレッドが停止処理を開始したことを通知する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstreamFreeI;      //映像 Iフレーム用に空いているデータ領域を格納する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstreamFreePB;     //映像 P/Bフレーム用に空いているデータ領域を格納する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstream;           //映像パケットを出力スレッドに渡すためのキュー
+    RGYBitstreamPool               videoBitstreamPool;        //映像パケットのデータ領域を使いまわすためのプール
+    RGYQueueSPSP<AVMuxVideoPkt, 64> qVideobitstream;          //映像パケットを出力スレッドに渡すためのキュー
     RGYQueueSPSP<AVPktMuxData, 64> qAudioPacketProcess;       //処理前音声パケットをデコード/エンコードスレッドに渡すためのキュー
     RGYQueueSPSP<AVPktMuxData, 64> qAudioFrameEncode;         //デコード済み音声フレームをエンコードスレッドに渡すためのキュー
     RGYQueueSPSP<AVPktMuxData, 64> qAudioPacketOut;           //音声パケットを出力スレッドに渡すためのキュー
+    std::vector<std::unique_ptr<AVMuxAudioWorker>> audioWorkers; //トラックごとの音声処理スレッド (thAudProcessが入力トラックごとに振り分ける)
     PerfQueueInfo                 *pQueueInfo;                //キューの情報を格納する構造体
 } AVMuxThread;
 #endif
@@ -238,6 +297,7 @@ typedef struct AVMux {
     AVMuxFormat         format;
     AVMuxVideo          video;
     vector<AVMuxAudio>  audio;
+    RGYAVFramePool      audioFramePool; //音声フレームを使いまわすためのプール
     vector<AVMuxOther>  other;
     vector<sTrim>       trim;
 #if ENABLE_AVCODEC_OUT_THREAD
@@ -286,12 +346,15 @@ struct AvcodecWriterPrm {
     int                          nBufSizeMB;              //出力バッファサイズ
     int                          nOutputThread;           //出力スレッド数
     int                          nAudioThread;            //音声処理スレッド数
+    int                          nAudioTrackThread;       //トラックごとの音声処理スレッド数 (0: 使用しない, -1: トラックごとに1スレッド)
+    size_t                       nAudioFramePoolMax;      //音声フレームのプールに保持する空き構造体の上限 (0: プールしない)
     muxOptList                   vMuxOpt;                 //mux時に使用するオプション
     PerfQueueInfo               *pQueueInfo;              //キューの情報を格納する構造体
     tstring                      muxVidTsLogFile;        //mux timestampログファイル
     HEVCHDRSei                  *pHEVCHdrSei;             //HDR関連のmetadata
     RGYTimestamp                *pVidTimestamp;           //動画のtimestampの情報
     std::string                  videoCodecTag;           //動画タグ
+    bool                         lowLatency;              //低遅延モード
 
     AvcodecWriterPrm() :
         pInputFormatMetadata(nullptr),
@@ -309,12 +372,15 @@ struct AvcodecWriterPrm {
         nBufSizeMB(0),
         nOutputThread(0),
         nAudioThread(0),
+        nAudioTrackThread(0),
+        nAudioFramePoolMax(AUD_FRAME_POOL_MAX_CACHED),
         vMuxOpt(),
         pQueueInfo(nullptr),
         muxVidTsLogFile(),
         pHEVCHdrSei(nullptr),
         pVidTimestamp(nullptr),
-        videoCodecTag() {
+        videoCodecTag(),
+        lowLatency(false) {
     }
 };
 
@@ -336,6 +402,18 @@ public:
 
     virtual void Close() override;
 
+    //出力する音声を、別の出力で入力ストリームとして扱うための情報を取得する (--ladder)
+    vector<AVDemuxStream> GetAudioMirrorStreams();
+
+    //出力する音声のパケットを、writerにも渡すようにする (--ladder)
+    //writerはGetAudioMirrorStreams()のストリームを入力として初期化しておく
+    //残りの音声はWaitFin()で渡し終わり、writerはこのインスタンスのストリームを参照するので、
+    //writerはこのインスタンスのWaitFin()の後、Close()の前に閉じること
+    void AddAudioMirror(RGYOutputAvcodec *writer);
+
+    //音声フレームのプールの使用状況を取得する (Close後も有効)
+    RGYAVFramePoolStats GetAudioFramePoolStats() const;
+
 #if USE_CUSTOM_IO
     int readPacket(uint8_t *buf, int buf_size);
     int writePacket(uint8_t *buf, int buf_size);
@@ -357,9 +435,21 @@ protected:
     //別のスレッドで実行する場合のスレッド関数 (音声エンコード処理)
     RGY_ERR ThreadFuncAudEncodeThread();
 
+    //別のスレッドで実行する場合のスレッド関数 (トラックごとの音声処理)
+    RGY_ERR ThreadFuncAudWorkerThread(AVMuxAudioWorker *pWorker);
+
+    //トラックごとの音声処理スレッドを作成し、音声をエンコードする入力トラックを割り当てる
+    RGY_ERR InitAudWorkers(int nAudioTrackThread);
+
+    //トラックごとの音声処理スレッドに終端パケットを渡し、flushが終わるまで待機する
+    void FlushAudWorkers();
+
     //音声出力キューに追加 (音声処理スレッドが有効な場合のみ有効)
     RGY_ERR AddAudQueue(AVPktMuxData *pktData, int type);
 
+    //トラックごとの音声処理スレッドのキューに追加
+    RGY_ERR AddAudWorkerQueue(AVMuxAudioWorker *pWorker, AVPktMuxData *pktData);
+
     //AVPktMuxDataを初期化する
     AVPktMuxData pktMuxData(const AVPacket *pkt);
 
@@ -376,17 +466,18 @@ protected:
     RGY_ERR WriteNextPacketAudio(AVPktMuxData *pktData);
 
     //WriteNextPacketの音声処理部分(エンコード)
-    RGY_ERR WriteNextPacketAudioFrame(vector<AVPktMuxData> audioFrames);
+    RGY_ERR WriteNextPacketAudioFrame(vector<AVPktMuxData>& audioFrames);
 
     //フィルタリング後のパケットをサブトラックに分配する
-    RGY_ERR WriteNextPacketToAudioSubtracks(vector<AVPktMuxData> audioFrames);
+    //filteredFramesは作業用 (フィルタの出力を格納する)
+    RGY_ERR WriteNextPacketToAudioSubtracks(vector<AVPktMuxData>& audioFrames, vector<AVPktMuxData>& filteredFrames);
 
     //音声フレームをエンコード
     RGY_ERR WriteNextAudioFrame(AVPktMuxData *pktData);
 
-    //音声のフィルタリングを実行
-    vector<AVPktMuxData> AudioFilterFrame(vector<AVPktMuxData> audioFrames);
-    vector<AVPktMuxData> AudioFilterFrameFlush(AVMuxAudio *pMuxAudio);
+    //音声のフィルタリングを実行 (結果はoutputFramesに追加する)
+    void AudioFilterFrame(const vector<AVPktMuxData>& inputFrames, vector<AVPktMuxData>& outputFrames);
+    void AudioFilterFrameFlush(AVMuxAudio *pMuxAudio, vector<AVPktMuxData>& outputFrames);
 
     //CodecIDがPCM系かどうか判定
     bool codecIDIsPCM(AVCodecID targetCodec);
@@ -455,11 +546,11 @@ protected:
     //音声ストリームをすべて吐き出す
     void AudioFlushStream(AVMuxAudio *pMuxAudio, int64_t *pWrittenDts);
 
-    //音声をデコード
-    vector<unique_ptr<AVFrame, decltype(&av_frame_unref)>> AudioDecodePacket(AVMuxAudio *pMuxAudio, AVPacket *pkt);
+    //音声をデコード (結果はdecodedFramesに追加する、フレームはm_Mux.audioFramePoolに返却すること)
+    void AudioDecodePacket(AVMuxAudio *pMuxAudio, AVPacket *pkt, vector<AVFrame *>& decodedFrames);
 
-    //音声をエンコード
-    vector<AVPktMuxData> AudioEncodeFrame(AVMuxAudio *pMuxAudio, AVFrame *frame);
+    //音声をエンコード (結果はencPktDatasに追加する)
+    void AudioEncodeFrame(AVMuxAudio *pMuxAudio, AVFrame *frame, vector<AVPktMuxData>& encPktDatas);
 
     //字幕パケットを書き出す
     RGY_ERR SubtitleTranscode(const AVMuxOther *pMuxSub, AVPacket *pkt);
@@ -467,6 +558,9 @@ protected:
     //その他のパケットを書き出す
     RGY_ERR WriteOtherPacket(AVPacket *pkt);
 
+    //低遅延モードの場合、書き出したパケットをフラッシュする
+    void FlushPacket();
+
     //パケットを実際に書き出す
     void WriteNextPacketProcessed(AVPktMuxData *pktData);
 
@@ -476,6 +570,9 @@ protected:
     //パケットを実際に書き出す
     void WriteNextPacketProcessed(AVMuxAudio *pMuxAudio, AVPacket *pkt, int samples, int64_t *pWrittenDts);
 
+    //書き出す音声パケットを、AddAudioMirror()で登録した出力に渡す
+    void WriteAudioMirror(const AVMuxAudio *pMuxAudio, const AVPacket *pkt, int samples);
+
     //extradataにH264のヘッダーを追加する
     RGY_ERR AddH264HeaderToExtraData(const RGYBitstream *pBitstream);
 
@@ -500,8 +597,15 @@ protected:
     static const AVRational QUEUE_DTS_TIMEBASE;
     AVMux m_Mux;
     vector<AVPktMuxData> m_AudPktBufFileHead; //ファイルヘッダを書く前にやってきた音声パケットのバッファ
+    vector<nal_info> m_nalList; //映像フレームごとのNAL解析結果 (確保を避けるため再利用する)
+    vector<RGYOutputAvcodec *> m_audioMirror; //音声パケットを渡す出力 (--ladder)
 };
 
+//複数の音声トラックをRGYOutputAvcodecでデコード→フィルタ→エンコードしてmuxし、
+//音声フレームのプールを使用しない場合と使用する場合の確保回数と速度を計測してCSVで出力する
+//あわせて、両者の出力ファイルが一致するかを確認する
+int audio_pool_bench(FILE *fp);
+
 #endif //ENABLE_AVSW_READER
 
 #endif //__RGY_OUTPUT_AVCODEC_H__
@@ -39,6 +39,9 @@
 #include "rgy_osdep.h"
 #include "rgy_util.h"
 #include "rgy_pipe.h"
+#include "rgy_perf_trace.h"
+#include "rgy_metrics.h"
+#include "rgy_thread_pool.h"
 #include "gpuz_info.h"
 #if defined(_WIN32) || defined(_WIN64)
 #include <psapi.h>
@@ -487,6 +490,7 @@ CPerfMonitor::CPerfMonitor() {
     m_thAudProcThread = NULL;
     m_thEncThread = NULL;
     m_thOutThread = NULL;
+    m_metrics = nullptr;
 }
 
 CPerfMonitor::~CPerfMonitor() {
@@ -527,6 +531,7 @@ void CPerfMonitor::clear() {
     }
     m_pProcess.reset();
     m_pRGYLog.reset();
+    m_metrics = nullptr;
 }
 
 int CPerfMonitor::createPerfMpnitorPyw(const TCHAR *pywPath) {
@@ -593,6 +598,9 @@ void CPerfMonitor::write_header(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_THREAD_OUT) {
         str += ",cpu out thread (%)";
     }
+    if (nSelect & PERF_MONITOR_THREAD_POOL) {
+        str += ",cpu thread pool (%)";
+    }
     if (nSelect & PERF_MONITOR_GPU_LOAD) {
         str += ",gpu load (%)";
     }
@@ -656,6 +664,9 @@ void CPerfMonitor::write_header(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_IO_WRITE) {
         str += ",write (MB/s)";
     }
+    if (nSelect & PERF_MONITOR_IO_INPUT) {
+        str += ",input read (MB/s)";
+    }
     str += "\n";
     fwrite(str.c_str(), 1, str.length(), fp);
     fflush(fp);
@@ -675,6 +686,7 @@ int CPerfMonitor::init(tstring filename, const TCHAR *pPythonPath,
     m_nSelectOutputLog = nSelectOutputLog;
     m_nSelectCheck = m_nSelectOutputLog | m_nSelectOutputPlot;
     m_thMainThread = std::move(thMainThread);
+    m_metrics = (prm) ? prm->metrics : nullptr;
 
     if (!m_fpLog && m_sMonitorFilename.length() > 0) {
         m_fpLog = std::unique_ptr<FILE, fp_deleter>(_tfopen(m_sMonitorFilename.c_str(), _T("a")));
@@ -1037,6 +1049,10 @@ void CPerfMonitor::check() {
         pInfoNew->io_read_per_sec = (pInfoNew->io_total_read - pInfoOld->io_total_read) * time_diff_inv * 1e6;
         pInfoNew->io_write_per_sec = (pInfoNew->io_total_write - pInfoOld->io_total_write) * time_diff_inv * 1e6;
 
+        //共有スレッドプールのCPU使用率 (タスクの処理時間から計算する)
+        pInfoNew->pool_thread_total_active_us = RGYThreadPool::totalActiveTimeUs();
+        pInfoNew->pool_thread_percent = (pInfoNew->pool_thread_total_active_us - pInfoOld->pool_thread_total_active_us) * 100.0 * logical_cpu_inv * time_diff_inv;
+
 #if defined(_WIN32) || defined(_WIN64)
         //スレッドCPU使用率
         if (m_thMainThread) {
@@ -1112,9 +1128,17 @@ void CPerfMonitor::check() {
     pInfoNew->bitrate_kbps = 0;
     pInfoNew->frames_out_byte = 0;
     pInfoNew->fps = 0.0;
+    pInfoNew->io_total_input = pInfoOld->io_total_input;
+    pInfoNew->io_input_per_sec = 0.0;
     if (m_bEncStarted && m_pEncStatus) {
         EncodeStatusData data = m_pEncStatus->GetEncodeData();
 
+        //入力の読み込み速度 (mmapの場合はプロセスのIO情報に現れないので別に集計する)
+        pInfoNew->io_total_input = data.inputBytes;
+        if (pInfoNew->time_us > pInfoOld->time_us) {
+            pInfoNew->io_input_per_sec = (pInfoNew->io_total_input - pInfoOld->io_total_input) * time_diff_inv * 1e6;
+        }
+
         //fps情報
         pInfoNew->frames_out = data.frameTotal;
         if (pInfoNew->frames_out > pInfoOld->frames_out) {
@@ -1135,9 +1159,35 @@ void CPerfMonitor::check() {
         }
     }
 
+    //トラックごとの音声処理の速度
+    for (int i = 0; i < (std::min)(m_QueueInfo.aud_track_num, PERF_MONITOR_AUD_TRACK_MAX); i++) {
+        pInfoNew->aud_track_time_us[i] = m_QueueInfo.aud_track_time_us[i];
+        pInfoNew->aud_track_speed[i] = 0.0;
+        if (pInfoNew->time_us > pInfoOld->time_us) {
+            pInfoNew->aud_track_speed[i] = (pInfoNew->aud_track_time_us[i] - pInfoOld->aud_track_time_us[i]) * time_diff_inv;
+        }
+    }
+
     m_nStep++;
 }
 
+void CPerfMonitor::publishMetrics() {
+    if (m_metrics == nullptr) {
+        return;
+    }
+    RGYMetricsData data;
+    memset(&data, 0, sizeof(data));
+    data.perf = m_info[m_nStep & 1];
+    data.perfValid = 1;
+    data.queue = m_QueueInfo;
+    data.encStarted = (m_bEncStarted && m_pEncStatus) ? 1 : 0;
+    if (data.encStarted) {
+        data.enc = m_pEncStatus->GetEncodeData();
+    }
+    data.updateTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_metrics->publish(data);
+}
+
 void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (fp == NULL) {
         return;
@@ -1168,6 +1218,9 @@ void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_THREAD_OUT) {
         str += strsprintf(",%lf", pInfo->out_thread_percent);
     }
+    if (nSelect & PERF_MONITOR_THREAD_POOL) {
+        str += strsprintf(",%lf", pInfo->pool_thread_percent);
+    }
     if (nSelect & PERF_MONITOR_GPU_LOAD) {
         str += strsprintf(",%lf", pInfo->gpu_load_percent);
     }
@@ -1233,6 +1286,9 @@ void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_IO_WRITE) {
         str += strsprintf(",%lf", pInfo->io_write_per_sec / (double)(1024 * 1024));
     }
+    if (nSelect & PERF_MONITOR_IO_INPUT) {
+        str += strsprintf(",%lf", pInfo->io_input_per_sec / (double)(1024 * 1024));
+    }
     str += "\n";
     fwrite(str.c_str(), 1, str.length(), fp);
     if (fp == m_pipes.f_stdin) {
@@ -1247,6 +1303,19 @@ void CPerfMonitor::loader(void *prm) {
 void CPerfMonitor::run() {
     while (!m_bAbort) {
         check();
+        publishMetrics();
+        //--perf-trace有効時は、キューの使用量をカウンタとして記録する
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_VID_IN,   m_QueueInfo.usage_vid_in);
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_AUD_IN,   m_QueueInfo.usage_aud_in);
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_VID_OUT,  m_QueueInfo.usage_vid_out);
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_AUD_OUT,  m_QueueInfo.usage_aud_out);
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_AUD_ENC,  m_QueueInfo.usage_aud_enc);
+        RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_AUD_PROC, m_QueueInfo.usage_aud_proc);
+        for (int i = 0; i < (std::min)(m_QueueInfo.aud_track_num, PERF_MONITOR_AUD_TRACK_MAX); i++) {
+            //実時間に対する倍率を%で記録する
+            RGY_PERF_TRACE_COUNTER(RGYPerfTrace::registerName(strsprintf(_T("audio #%d speed (%%)"), m_QueueInfo.aud_track_id[i])),
+                m_info[m_nStep & 1].aud_track_speed[i] * 100.0);
+        }
         if (m_pProcess && !m_pProcess->processAlive()) {
             if (m_pipes.f_stdin) {
                 fclose(m_pipes.f_stdin);
@@ -1262,6 +1331,7 @@ void CPerfMonitor::run() {
         std::this_thread::sleep_for(std::chrono::milliseconds(m_nInterval));
     }
     check();
+    publishMetrics();
     write(m_fpLog.get(),   m_nSelectOutputLog);
     write(m_pipes.f_stdin, m_nSelectOutputPlot);
 }
@@ -90,12 +90,14 @@ enum : int {
     PERF_MONITOR_VEE_LOAD      = 0x04000000,
     PERF_MONITOR_VED_LOAD      = 0x08000000,
     PERF_MONITOR_PCIE_LOAD     = 0x10000000,
+    PERF_MONITOR_THREAD_POOL   = 0x20000000,
+    PERF_MONITOR_IO_INPUT      = 0x40000000,
     PERF_MONITOR_ALL         = (int)UINT_MAX,
 };
 
 static const CX_DESC list_pref_monitor[] = {
     { _T("all"),         PERF_MONITOR_ALL },
-    { _T("cpu"),         PERF_MONITOR_CPU | PERF_MONITOR_CPU_KERNEL | PERF_MONITOR_THREAD_MAIN | PERF_MONITOR_THREAD_ENC | PERF_MONITOR_THREAD_OUT | PERF_MONITOR_THREAD_IN },
+    { _T("cpu"),         PERF_MONITOR_CPU | PERF_MONITOR_CPU_KERNEL | PERF_MONITOR_THREAD_MAIN | PERF_MONITOR_THREAD_ENC | PERF_MONITOR_THREAD_OUT | PERF_MONITOR_THREAD_IN | PERF_MONITOR_THREAD_POOL },
     { _T("cpu_total"),   PERF_MONITOR_CPU },
     { _T("cpu_kernel"),  PERF_MONITOR_CPU_KERNEL },
     { _T("cpu_main"),    PERF_MONITOR_THREAD_MAIN },
@@ -105,12 +107,14 @@ static const CX_DESC list_pref_monitor[] = {
     { _T("cpu_aud_proc"),PERF_MONITOR_THREAD_AUDP },
     { _T("cpu_aud_enc"), PERF_MONITOR_THREAD_AUDE },
     { _T("cpu_out"),     PERF_MONITOR_THREAD_OUT },
+    { _T("cpu_pool"),    PERF_MONITOR_THREAD_POOL },
     { _T("mem"),         PERF_MONITOR_MEM_PRIVATE | PERF_MONITOR_MEM_VIRTUAL },
     { _T("mem_private"), PERF_MONITOR_MEM_PRIVATE },
     { _T("mem_virtual"), PERF_MONITOR_MEM_VIRTUAL },
-    { _T("io"),          PERF_MONITOR_IO_READ | PERF_MONITOR_IO_WRITE },
+    { _T("io"),          PERF_MONITOR_IO_READ | PERF_MONITOR_IO_WRITE | PERF_MONITOR_IO_INPUT },
     { _T("io_read"),     PERF_MONITOR_IO_READ },
     { _T("io_write"),    PERF_MONITOR_IO_WRITE },
+    { _T("io_input"),    PERF_MONITOR_IO_INPUT },
     { _T("fps"),         PERF_MONITOR_FPS },
     { _T("fps_avg"),     PERF_MONITOR_FPS_AVG },
     { _T("bitrate"),     PERF_MONITOR_BITRATE },
@@ -130,6 +134,8 @@ static const CX_DESC list_pref_monitor[] = {
     { nullptr, 0 }
 };
 
+static const int PERF_MONITOR_AUD_TRACK_MAX = 16; //トラックごとの音声処理の情報を記録するトラック数の上限
+
 struct PerfInfo {
     int64_t time_us;
     int64_t cpu_total_us;
@@ -141,12 +147,14 @@ struct PerfInfo {
     int64_t aud_enc_thread_total_active_us;
     int64_t out_thread_total_active_us;
     int64_t in_thread_total_active_us;
+    int64_t pool_thread_total_active_us;
 
     int64_t mem_private;
     int64_t mem_virtual;
 
     int64_t io_total_read;
     int64_t io_total_write;
+    int64_t io_total_input;
 
     int64_t frames_in;
     int64_t frames_out;
@@ -160,6 +168,7 @@ struct PerfInfo {
 
     double  io_read_per_sec;
     double  io_write_per_sec;
+    double  io_input_per_sec;
 
     double  cpu_percent;
     double  cpu_kernel_percent;
@@ -170,6 +179,7 @@ struct PerfInfo {
     double  aud_enc_thread_percent;
     double  out_thread_percent;
     double  in_thread_percent;
+    double  pool_thread_percent;
 
     BOOL    gpu_info_valid;
     double  gpu_load_percent;
@@ -185,6 +195,9 @@ struct PerfInfo {
     int pcie_link;
     int pcie_throughput_tx_per_sec;
     int pcie_throughput_rx_per_sec;
+
+    int64_t aud_track_time_us[PERF_MONITOR_AUD_TRACK_MAX]; //トラックごとの処理済みの音声の長さ (us)
+    double  aud_track_speed[PERF_MONITOR_AUD_TRACK_MAX];   //トラックごとの音声処理の速度 (実時間に対する倍率)
 };
 
 struct PerfOutputInfo {
@@ -200,6 +213,9 @@ struct PerfQueueInfo {
     size_t usage_aud_out;
     size_t usage_aud_enc;
     size_t usage_aud_proc;
+    int     aud_track_num;                                 //トラックごとの音声処理スレッドが処理する入力トラックの数
+    int     aud_track_id[PERF_MONITOR_AUD_TRACK_MAX];      //入力トラックの番号
+    int64_t aud_track_time_us[PERF_MONITOR_AUD_TRACK_MAX]; //処理済みの音声の長さ (us)
 };
 
 #if ENABLE_METRIC_FRAMEWORK
@@ -348,10 +364,13 @@ public:
     int getData(NVMLMonitorInfo *info, const std::string& gpu_pcibusid);
 };
 
+class RGYMetricsServer;
+
 struct CPerfMonitorPrm {
 #if ENABLE_NVML
     const char *pciBusId;
 #endif
+    RGYMetricsServer *metrics; //--metrics 有効時、check()ごとにスナップショットを書き込む (CPerfMonitorより後に破棄すること)
     char reserved[256];
 };
 
@@ -394,6 +413,7 @@ protected:
     void run();
     void write_header(FILE *fp, int nSelect);
     void write(FILE *fp, int nSelect);
+    void publishMetrics();
 
     static void loader(void *prm);
 
@@ -427,6 +447,7 @@ protected:
     int m_nSelectOutputPlot;
     PerfQueueInfo m_QueueInfo;
     std::shared_ptr<RGYLog> m_pRGYLog;
+    RGYMetricsServer *m_metrics;
 
 #if ENABLE_METRIC_FRAMEWORK
     IExtensionLoader *m_pLoader;
@@ -0,0 +1,424 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <fstream>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_perf_trace.h"
+
+static uint32_t rgy_trace_thread_id() {
+#if defined(_WIN32) || defined(_WIN64)
+    return (uint32_t)GetCurrentThreadId();
+#else
+    return (uint32_t)syscall(SYS_gettid);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+static uint32_t rgy_trace_process_id() {
+#if defined(_WIN32) || defined(_WIN64)
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+//名前の登録はプロセス全体で共通とし、フィルタなどは一度取得したIDを使い続けられるようにする
+static const char *RGY_TRACE_FIXED_NAMES[RGY_TRACE_NAME_FIXED_COUNT] = {
+    "read", "csp", "filter", "encode", "output_wait", "output", "mux", "audio_decode", "audio_encode",
+    "queue_filter", "queue_encode", "queue_vid_in", "queue_aud_in", "queue_vid_out", "queue_aud_out", "queue_aud_enc", "queue_aud_proc"
+};
+static std::mutex g_trace_names_mtx;
+static std::deque<std::string> g_trace_names;
+static std::unordered_map<std::string, uint16_t> g_trace_name_ids;
+
+static const char *rgy_trace_category(uint16_t nameId) {
+    switch (nameId) {
+    case RGY_TRACE_READ:
+    case RGY_TRACE_CSP:         return "input";
+    case RGY_TRACE_ENCODE:
+    case RGY_TRACE_OUTPUT_WAIT:
+    case RGY_TRACE_OUTPUT:      return "encode";
+    case RGY_TRACE_MUX:         return "output";
+    case RGY_TRACE_AUD_DEC:
+    case RGY_TRACE_AUD_ENC:     return "audio";
+    default:                    return (nameId >= RGY_TRACE_NAME_FIXED_COUNT || nameId == RGY_TRACE_FILTER) ? "filter" : "queue";
+    }
+}
+
+static std::string rgy_trace_json_escape(const std::string& str) {
+    std::string ret;
+    for (auto c : str) {
+        if (c == '\"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if ((uint8_t)c < 0x20) {
+            char buf[8];
+            sprintf_s(buf, "\\u%04x", (uint8_t)c);
+            ret += buf;
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+uint16_t RGYPerfTrace::registerName(const tstring& name) {
+    const auto str = tchar_to_string(name, CP_UTF8);
+    std::lock_guard<std::mutex> lock(g_trace_names_mtx);
+    if (g_trace_names.size() == 0) {
+        for (int i = 0; i < RGY_TRACE_NAME_FIXED_COUNT; i++) {
+            g_trace_names.push_back(RGY_TRACE_FIXED_NAMES[i]);
+        }
+    }
+    auto it = g_trace_name_ids.find(str);
+    if (it != g_trace_name_ids.end()) {
+        return it->second;
+    }
+    if (g_trace_names.size() >= UINT16_MAX) {
+        return RGY_TRACE_FILTER;
+    }
+    const auto id = (uint16_t)g_trace_names.size();
+    g_trace_names.push_back(str);
+    g_trace_name_ids[str] = id;
+    return id;
+}
+
+RGYPerfTraceThread::RGYPerfTraceThread(uint32_t id) :
+    threadId(id),
+    threadName(),
+    chunks(),
+    count(0),
+    dropped(0),
+    curFrame(-1),
+    curPts(RGY_PERF_TRACE_NO_PTS) {
+}
+
+RGYPerfTraceEvent *RGYPerfTraceThread::next() {
+    if (count >= RGY_PERF_TRACE_MAX_EVENTS) {
+        dropped++;
+        return nullptr;
+    }
+    const int idx = count % RGY_PERF_TRACE_CHUNK_EVENTS;
+    if (idx == 0) {
+        chunks.push_back(std::unique_ptr<RGYPerfTraceEvent[]>(new RGYPerfTraceEvent[RGY_PERF_TRACE_CHUNK_EVENTS]));
+    }
+    count++;
+    return &chunks.back()[idx];
+}
+
+std::atomic<RGYPerfTrace *> RGYPerfTrace::s_current(nullptr);
+static std::atomic<uint64_t> g_trace_instance_count(0);
+
+struct RGYPerfTraceThreadCache {
+    uint64_t instanceId;
+    RGYPerfTraceThread *thread;
+};
+static thread_local RGYPerfTraceThreadCache tls_trace_thread = { 0, nullptr };
+
+RGYPerfTrace::RGYPerfTrace() :
+    m_filename(),
+    m_log(),
+    m_instanceId(++g_trace_instance_count),
+    m_start(std::chrono::steady_clock::now()),
+    m_mtxThreads(),
+    m_threads() {
+}
+
+RGYPerfTrace::~RGYPerfTrace() {
+    close();
+}
+
+RGY_ERR RGYPerfTrace::init(const tstring& filename, std::shared_ptr<RGYLog> log) {
+    m_filename = filename;
+    m_log = log;
+    //出力先に書き込めるかを先に確認しておく
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, m_filename.c_str(), _T("wb")) || fp == nullptr) {
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("perf-trace: failed to open \"%s\".\n"), m_filename.c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    fclose(fp);
+    registerName(_T("")); //固定の名前を登録させる
+    m_start = std::chrono::steady_clock::now();
+    RGYPerfTrace *expected = nullptr;
+    if (!s_current.compare_exchange_strong(expected, this)) {
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("perf-trace: another trace is running.\n"));
+        return RGY_ERR_ALREADY_INITIALIZED;
+    }
+    if (m_log) m_log->write(RGY_LOG_DEBUG, _T("perf-trace: started, output to \"%s\".\n"), m_filename.c_str());
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYPerfTrace::close() {
+    RGYPerfTrace *expected = this;
+    if (!s_current.compare_exchange_strong(expected, nullptr)) {
+        return RGY_ERR_NONE; //開始していない、または出力済み
+    }
+    auto sts = RGY_ERR_NONE;
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, m_filename.c_str(), _T("wb")) || fp == nullptr) {
+        if (m_log) m_log->write(RGY_LOG_ERROR, _T("perf-trace: failed to open \"%s\".\n"), m_filename.c_str());
+        sts = RGY_ERR_FILE_OPEN;
+    } else {
+        sts = write(fp);
+        fclose(fp);
+    }
+    int events = 0, dropped = 0;
+    for (const auto& th : m_threads) {
+        events += th->count;
+        dropped += th->dropped;
+    }
+    if (m_log) {
+        m_log->write(RGY_LOG_DEBUG, _T("perf-trace: wrote %d events of %d threads to \"%s\".\n"), events, (int)m_threads.size(), m_filename.c_str());
+        if (dropped > 0) {
+            m_log->write(RGY_LOG_WARN, _T("perf-trace: %d events were dropped, as the number of events per thread exceeded %d.\n"), dropped, RGY_PERF_TRACE_MAX_EVENTS);
+        }
+    }
+    m_threads.clear();
+    m_log.reset();
+    return sts;
+}
+
+RGYPerfTraceThread *RGYPerfTrace::thread() {
+    if (tls_trace_thread.instanceId == m_instanceId) {
+        return tls_trace_thread.thread;
+    }
+    //このスレッドで初めて記録する場合のみロックする
+    std::lock_guard<std::mutex> lock(m_mtxThreads);
+    const auto threadId = rgy_trace_thread_id();
+    RGYPerfTraceThread *th = nullptr;
+    for (const auto& t : m_threads) {
+        if (t->threadId == threadId) {
+            th = t.get();
+            break;
+        }
+    }
+    if (th == nullptr) {
+        m_threads.push_back(std::unique_ptr<RGYPerfTraceThread>(new RGYPerfTraceThread(threadId)));
+        th = m_threads.back().get();
+    }
+    tls_trace_thread.instanceId = m_instanceId;
+    tls_trace_thread.thread = th;
+    return th;
+}
+
+void RGYPerfTrace::setThreadName(const char *name) {
+    auto trace = get();
+    if (trace) {
+        trace->thread()->threadName = name;
+    }
+}
+
+void RGYPerfTrace::addSpan(uint16_t nameId, int64_t start, int64_t end, int32_t frame, int64_t pts) {
+    auto ev = thread()->next();
+    if (ev) {
+        ev->start = start;
+        ev->end = end;
+        ev->pts = pts;
+        ev->frame = frame;
+        ev->nameId = nameId;
+        ev->type = RGY_TRACE_EVENT_SPAN;
+        ev->reserved = 0;
+    }
+}
+
+void RGYPerfTrace::addCounter(uint16_t nameId, int64_t value) {
+    auto ev = thread()->next();
+    if (ev) {
+        ev->start = now();
+        ev->end = value;
+        ev->pts = RGY_PERF_TRACE_NO_PTS;
+        ev->frame = -1;
+        ev->nameId = nameId;
+        ev->type = RGY_TRACE_EVENT_COUNTER;
+        ev->reserved = 0;
+    }
+}
+
+RGY_ERR RGYPerfTrace::write(FILE *fp) {
+    const uint32_t pid = rgy_trace_process_id();
+    //名前はあらかじめjson用に変換しておく
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(g_trace_names_mtx);
+        for (const auto& name : g_trace_names) {
+            names.push_back(rgy_trace_json_escape(name));
+        }
+    }
+    auto name = [&names](uint16_t nameId) {
+        return (nameId < names.size()) ? names[nameId].c_str() : "unknown";
+    };
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"encoder\":\"%s\"},\"traceEvents\":[\n", rgy_trace_json_escape(strsprintf("%s %s", ENCODER_NAME, tchar_to_string(VER_STR_FILEVERSION_TCHAR).c_str())).c_str());
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"%s\"}}", pid, ENCODER_NAME);
+    std::lock_guard<std::mutex> lock(m_mtxThreads);
+    for (const auto& th : m_threads) {
+        if (th->threadName.length() > 0) {
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", pid, th->threadId, rgy_trace_json_escape(th->threadName).c_str());
+        }
+        for (int i = 0; i < th->count; i++) {
+            const auto& ev = th->chunks[i / RGY_PERF_TRACE_CHUNK_EVENTS][i % RGY_PERF_TRACE_CHUNK_EVENTS];
+            if (ev.type == RGY_TRACE_EVENT_COUNTER) {
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"queue\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%u,\"args\":{\"value\":%lld}}",
+                    name(ev.nameId), ev.start * 1e-3, pid, (long long)ev.end);
+                continue;
+            }
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u",
+                name(ev.nameId), rgy_trace_category(ev.nameId), ev.start * 1e-3, (ev.end - ev.start) * 1e-3, pid, th->threadId);
+            if (ev.frame >= 0 && ev.pts != RGY_PERF_TRACE_NO_PTS) {
+                fprintf(fp, ",\"args\":{\"frame\":%d,\"pts\":%lld}}", ev.frame, (long long)ev.pts);
+            } else if (ev.frame >= 0) {
+                fprintf(fp, ",\"args\":{\"frame\":%d}}", ev.frame);
+            } else if (ev.pts != RGY_PERF_TRACE_NO_PTS) {
+                fprintf(fp, ",\"args\":{\"pts\":%lld}}", (long long)ev.pts);
+            } else {
+                fprintf(fp, "}");
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    return (ferror(fp)) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+}
+
+void RGYPerfTraceScope::begin() {
+    m_thread = m_trace->thread();
+    m_prevFrame = m_thread->curFrame;
+    m_prevPts = m_thread->curPts;
+    if (m_frame >= 0 || m_pts != RGY_PERF_TRACE_NO_PTS) {
+        m_thread->curFrame = m_frame;
+        m_thread->curPts = m_pts;
+    } else {
+        m_frame = m_prevFrame;
+        m_pts = m_prevPts;
+    }
+    m_start = m_trace->now();
+}
+
+void RGYPerfTraceScope::end() {
+    m_trace->addSpan(m_nameId, m_start, m_trace->now(), m_frame, m_pts);
+    m_thread->curFrame = m_prevFrame;
+    m_thread->curPts = m_prevPts;
+}
+
+int perf_trace_bench(FILE *fp) {
+    static const int SPANS_PER_THREAD = 200000;
+    static const int thread_list[] = { 1, 4 };
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR tempDir[1024] = { 0 };
+    GetTempPath(_countof(tempDir), tempDir);
+    const tstring tracePath = PathCombineS(tstring(tempDir), strsprintf(_T("rgy_perf_trace_bench_%d.json"), GetCurrentProcessId()));
+#else
+    const tstring tracePath = strsprintf(_T("/tmp/rgy_perf_trace_bench_%d.json"), (int)getpid());
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    const uint16_t filterId = RGYPerfTrace::registerName(_T("bench filter"));
+
+    //各スレッドで、フレームごとに入れ子の区間とカウンタを記録する
+    auto run = [filterId](int threads) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> workers;
+        for (int ith = 0; ith < threads; ith++) {
+            workers.push_back(std::thread([ith, filterId]() {
+                RGY_PERF_TRACE_THREAD_NAME(strsprintf("worker %d", ith).c_str());
+                for (int i = 0; i < SPANS_PER_THREAD / 4; i++) {
+                    RGY_PERF_TRACE_SCOPE(read, RGY_TRACE_READ, i, (int64_t)i * 1001);
+                    { RGY_PERF_TRACE_SCOPE(csp, RGY_TRACE_CSP, -1, RGY_PERF_TRACE_NO_PTS); }
+                    { RGY_PERF_TRACE_SCOPE(filter, filterId, -1, RGY_PERF_TRACE_NO_PTS); }
+                    RGY_PERF_TRACE_COUNTER(RGY_TRACE_QUEUE_ENCODE, i & 7);
+                }
+            }));
+        }
+        for (auto& th : workers) {
+            th.join();
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    int ret = 0;
+    _ftprintf(fp, _T("mode,threads,events,ns/event,verify\n"));
+    for (const int threads : thread_list) {
+        const int events = SPANS_PER_THREAD * threads;
+        const double disabledNs = run(threads);
+        _ftprintf(fp, _T("disabled,%d,%d,%.1f,-\n"), threads, events, disabledNs / events);
+
+        double enabledNs = 0.0;
+        const auto writeStart = std::chrono::high_resolution_clock::now();
+        {
+            RGYPerfTrace trace;
+            if (trace.init(tracePath, nullptr) != RGY_ERR_NONE) {
+                _ftprintf(fp, _T("enabled,%d,%d,-,NG (failed to open %s)\n"), threads, events, tracePath.c_str());
+                ret = 1;
+                continue;
+            }
+            enabledNs = run(threads);
+        }
+        const double writeNs = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - writeStart).count() - enabledNs;
+
+        //出力したjsonの区間/カウンタの数と、入れ子の区間にフレームが引き継がれているかを確認する
+        int spans = 0, counters = 0, inherited = 0, threadNames = 0;
+        bool formatOK = false;
+        {
+            std::ifstream ifs(tracePath);
+            std::string line;
+            if (std::getline(ifs, line)) {
+                formatOK = line.find("\"traceEvents\":[") != std::string::npos;
+            }
+            std::string last;
+            while (std::getline(ifs, line)) {
+                if (line.find("\"ph\":\"X\"") != std::string::npos) {
+                    spans++;
+                    if (line.find("\"name\":\"csp\"") != std::string::npos && line.find("\"frame\":") != std::string::npos) {
+                        inherited++;
+                    }
+                } else if (line.find("\"ph\":\"C\"") != std::string::npos) {
+                    counters++;
+                } else if (line.find("\"thread_name\"") != std::string::npos) {
+                    threadNames++;
+                }
+                last = line;
+            }
+            formatOK &= (last == "]}");
+        }
+        _tremove(tracePath.c_str());
+        const bool ok = formatOK
+            && spans == events * 3 / 4
+            && counters == events / 4
+            && inherited == events / 4
+            && threadNames == threads;
+        _ftprintf(fp, _T("enabled,%d,%d,%.1f,%s\n"), threads, events, enabledNs / events, ok ? _T("OK") : _T("NG"));
+        _ftprintf(fp, _T("write json,%d,%d,%.1f,-\n"), threads, events, writeNs / events);
+        if (!ok) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,198 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_PERF_TRACE_H__
+#define __RGY_PERF_TRACE_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include "rgy_version.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+#include "rgy_log.h"
+
+//パイプラインの各段の処理区間を記録し、Chrome trace event形式のjsonとして出力する
+//(chrome://tracing や https://ui.perfetto.dev で表示できる)
+//
+//区間はスレッドごとのバッファに記録するので、記録時にロックは発生しない
+//無効時は、RGYPerfTraceScopeの構築時にRGYPerfTrace::get()がnullptrを返すことを確認するのみ
+//
+//トレースの終了(RGYPerfTraceの破棄)は、記録を行うスレッドがすべて終了してから行うこと
+
+static const int64_t RGY_PERF_TRACE_NO_PTS = INT64_MIN;
+static const int RGY_PERF_TRACE_CHUNK_EVENTS = 4096;          //スレッドごとのバッファの確保単位
+static const int RGY_PERF_TRACE_MAX_EVENTS = 4 * 1024 * 1024; //スレッドごとの記録の上限 (これ以降は記録しない)
+static const int RGY_PERF_TRACE_COUNTER_INTERVAL_MS = 100;    //キューの使用量を記録する間隔
+
+//区間/カウンタの名前 (これ以降はフィルタ名などを登録して使用する)
+enum RGYPerfTraceName : uint16_t {
+    RGY_TRACE_READ = 0,       //LoadNextFrame
+    RGY_TRACE_CSP,            //入力の色変換
+    RGY_TRACE_FILTER,         //名前が登録されていないフィルタ
+    RGY_TRACE_ENCODE,         //エンコーダへのフレームの投入
+    RGY_TRACE_OUTPUT_WAIT,    //エンコードの完了待ち
+    RGY_TRACE_OUTPUT,         //エンコード済みのフレームの取得
+    RGY_TRACE_MUX,            //映像のmux
+    RGY_TRACE_AUD_DEC,        //音声のデコード
+    RGY_TRACE_AUD_ENC,        //音声のエンコード
+    RGY_TRACE_QUEUE_FILTER,   //フィルタ待ちのフレーム数
+    RGY_TRACE_QUEUE_ENCODE,   //エンコーダへの投入待ちのフレーム数
+    RGY_TRACE_QUEUE_VID_IN,   //PerfQueueInfoの各キューの使用量
+    RGY_TRACE_QUEUE_AUD_IN,
+    RGY_TRACE_QUEUE_VID_OUT,
+    RGY_TRACE_QUEUE_AUD_OUT,
+    RGY_TRACE_QUEUE_AUD_ENC,
+    RGY_TRACE_QUEUE_AUD_PROC,
+    RGY_TRACE_NAME_FIXED_COUNT
+};
+
+enum RGYPerfTraceEventType : uint8_t {
+    RGY_TRACE_EVENT_SPAN = 0,
+    RGY_TRACE_EVENT_COUNTER,
+};
+
+struct RGYPerfTraceEvent {
+    int64_t start;     //トレースの開始からの経過時間 (ns)
+    int64_t end;       //区間の終了 (ns)、カウンタなら値
+    int64_t pts;       //RGY_PERF_TRACE_NO_PTSなら出力しない
+    int32_t frame;     //負なら出力しない
+    uint16_t nameId;   //RGYPerfTraceName または registerNameで取得したID
+    uint8_t type;      //RGYPerfTraceEventType
+    uint8_t reserved;
+};
+static_assert(sizeof(RGYPerfTraceEvent) == 32, "RGYPerfTraceEvent must be 32 bytes.");
+
+//スレッドごとの記録
+struct RGYPerfTraceThread {
+    uint32_t threadId;
+    std::string threadName;
+    std::vector<std::unique_ptr<RGYPerfTraceEvent[]>> chunks;
+    int count;         //記録したイベント数
+    int dropped;       //上限を超えて記録しなかったイベント数
+    int32_t curFrame;  //現在処理中のフレーム (入れ子の区間に引き継ぐ)
+    int64_t curPts;
+
+    RGYPerfTraceThread(uint32_t id);
+    RGYPerfTraceEvent *next();
+};
+
+class RGYPerfTrace {
+public:
+    RGYPerfTrace();
+    ~RGYPerfTrace();
+
+    //トレースを開始し、プロセス全体で使用するインスタンスとして登録する
+    RGY_ERR init(const tstring& filename, std::shared_ptr<RGYLog> log);
+    //登録を解除し、ファイルに出力する
+    RGY_ERR close();
+
+    //有効なトレースを取得する (無効ならnullptr)
+    static RGYPerfTrace *get() {
+        return s_current.load(std::memory_order_acquire);
+    }
+    //名前を登録してIDを取得する (プロセス全体で共通、同じ名前なら同じIDを返す)
+    static uint16_t registerName(const tstring& name);
+    //呼び出したスレッドの名前を設定する
+    static void setThreadName(const char *name);
+
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+    void addSpan(uint16_t nameId, int64_t start, int64_t end, int32_t frame, int64_t pts);
+    void addCounter(uint16_t nameId, int64_t value);
+    RGYPerfTraceThread *thread();
+protected:
+    RGY_ERR write(FILE *fp);
+
+    static std::atomic<RGYPerfTrace *> s_current;
+
+    tstring m_filename;
+    std::shared_ptr<RGYLog> m_log;
+    uint64_t m_instanceId;
+    std::chrono::steady_clock::time_point m_start;
+    std::mutex m_mtxThreads;
+    std::vector<std::unique_ptr<RGYPerfTraceThread>> m_threads;
+};
+
+//スコープの開始から終了までを区間として記録する
+//frameが負の場合は、同じスレッドで外側の区間に指定されたフレームを引き継ぐ
+class RGYPerfTraceScope {
+public:
+    RGYPerfTraceScope(uint16_t nameId, int frame = -1, int64_t pts = RGY_PERF_TRACE_NO_PTS) :
+        m_trace(RGYPerfTrace::get()), m_thread(nullptr), m_nameId(nameId), m_start(0), m_frame(frame), m_pts(pts), m_prevFrame(-1), m_prevPts(RGY_PERF_TRACE_NO_PTS) {
+        if (m_trace) {
+            begin();
+        }
+    }
+    ~RGYPerfTraceScope() {
+        if (m_trace) {
+            end();
+        }
+    }
+    //区間の途中でフレームが判明した場合に設定する
+    void setFrame(int frame, int64_t pts) {
+        m_frame = frame;
+        m_pts = pts;
+    }
+protected:
+    void begin();
+    void end();
+
+    RGYPerfTrace *m_trace;
+    RGYPerfTraceThread *m_thread;
+    uint16_t m_nameId;
+    int64_t m_start;
+    int m_frame;
+    int64_t m_pts;
+    int m_prevFrame;
+    int64_t m_prevPts;
+};
+
+#if ENABLE_PERF_TRACE
+#define RGY_PERF_TRACE_SCOPE(var, nameId, frame, pts) RGYPerfTraceScope var((nameId), (frame), (pts))
+#define RGY_PERF_TRACE_SET_FRAME(var, frame, pts) var.setFrame((frame), (pts))
+#define RGY_PERF_TRACE_THREAD_NAME(name) RGYPerfTrace::setThreadName(name)
+#define RGY_PERF_TRACE_COUNTER(nameId, value) { if (auto trace_ = RGYPerfTrace::get()) trace_->addCounter((nameId), (int64_t)(value)); }
+#else
+#define RGY_PERF_TRACE_SCOPE(var, nameId, frame, pts)
+#define RGY_PERF_TRACE_SET_FRAME(var, frame, pts)
+#define RGY_PERF_TRACE_THREAD_NAME(name)
+#define RGY_PERF_TRACE_COUNTER(nameId, value)
+#endif //#if ENABLE_PERF_TRACE
+
+//トレースの記録にかかる時間を、無効時/有効時それぞれ計測し、出力したjsonを検証してCSVで出力する
+int perf_trace_bench(FILE *fp);
+
+#endif //__RGY_PERF_TRACE_H__
@@ -148,4 +148,16 @@ void RGYPipeProcessWin::close() {
 bool RGYPipeProcessWin::processAlive() {
     return WAIT_OBJECT_0 == WaitForSingleObject(m_phandle, 0);
 }
+
+int RGYPipeProcessWin::waitAndGetExitCode() {
+    if (m_pi.hProcess == NULL) {
+        return -1;
+    }
+    DWORD exitCode = 0;
+    if (WAIT_OBJECT_0 != WaitForSingleObject(m_pi.hProcess, INFINITE)
+        || !GetExitCodeProcess(m_pi.hProcess, &exitCode)) {
+        return -1;
+    }
+    return (int)exitCode;
+}
 #endif //defined(_WIN32) || defined(_WIN64)
@@ -76,6 +76,8 @@ public:
     virtual int run(const std::vector<const TCHAR *>& args, const TCHAR *exedir, ProcessPipe *pipes, uint32_t priority, bool hidden, bool minimized) = 0;
     virtual void close() = 0;
     virtual bool processAlive() = 0;
+    //プロセスの終了を待機し、終了コードを返す (取得できなければ-1)
+    virtual int waitAndGetExitCode() = 0;
 protected:
     virtual int startPipes(ProcessPipe *pipes) = 0;
     PROCESS_HANDLE m_phandle;
@@ -91,6 +93,7 @@ public:
     virtual int run(const std::vector<const TCHAR *>& args, const TCHAR *exedir, ProcessPipe *pipes, uint32_t priority, bool hidden, bool minimized) override;
     virtual void close() override;
     virtual bool processAlive() override;
+    virtual int waitAndGetExitCode() override;
     const PROCESS_INFORMATION& getProcessInfo();
 protected:
     virtual int startPipes(ProcessPipe *pipes) override;
@@ -106,6 +109,7 @@ public:
     virtual int run(const std::vector<const TCHAR *>& args, const TCHAR *exedir, ProcessPipe *pipes, uint32_t priority, bool hidden, bool minimized) override;
     virtual void close() override;
     virtual bool processAlive() override;
+    virtual int waitAndGetExitCode() override;
 protected:
     virtual int startPipes(ProcessPipe *pipes) override;
 };
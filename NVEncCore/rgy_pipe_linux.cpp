@@ -102,4 +102,15 @@ bool RGYPipeProcessLinux::processAlive() {
     int status = 0;
     return 0 == waitpid(m_phandle, &status, WNOHANG);
 }
+
+int RGYPipeProcessLinux::waitAndGetExitCode() {
+    if (m_phandle <= 0) {
+        return -1;
+    }
+    int status = 0;
+    if (waitpid(m_phandle, &status, 0) != m_phandle || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
 #endif //#if !(defined(_WIN32) || defined(_WIN64))
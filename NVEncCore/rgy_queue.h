@@ -34,6 +34,11 @@
 #include <atomic>
 #include <climits>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
 #include "rgy_osdep.h"
 #include "rgy_event.h"
 
@@ -324,4 +329,262 @@ protected:
     std::atomic<int> m_bUsingData; //キューから読み出し中のスレッドの数
 };
 
+//複数の押し込みと複数の取り出しが並列に可能な固定長のキュー
+//各要素がシーケンス番号を持ち、押し込み/取り出しはCASのみでロックなしに行う
+//キューが満杯/空のときのみcondition_variableで待機し、RGYQueueSPSPのようなポーリングは行わない
+//RGYQueueSPSPと異なり、ムーブのみ可能な型も格納できる
+template<typename Type>
+class RGYQueueMPMC {
+    static const size_t CACHE_LINE = 64;
+    static const int SPIN_COUNT = 64; //待機に入る前にスピンする回数
+    struct queueCell {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(Type), alignof(Type)>::type data;
+    };
+    //押し込み位置と取り出し位置が同じキャッシュラインに載らないようにする
+    struct alignas(CACHE_LINE) queuePos {
+        std::atomic<size_t> pos;
+    };
+public:
+    RGYQueueMPMC() :
+        m_cells(), m_mask(0), m_head(), m_tail(),
+        m_pushWaiters(0), m_popWaiters(0), m_closed(false),
+        m_mtx(), m_cvPushed(), m_cvPoped() {
+        m_head.pos = 0;
+        m_tail.pos = 0;
+    }
+    ~RGYQueueMPMC() {
+        destroy();
+    }
+    RGYQueueMPMC(const RGYQueueMPMC&) = delete;
+    RGYQueueMPMC& operator=(const RGYQueueMPMC&) = delete;
+
+    //キューを初期化する
+    //capacityは2のべき乗に切り上げられる
+    //押し込み/取り出しを行うスレッドが動いていないときに呼ぶこと
+    void init(size_t capacity = 1024) {
+        destroy();
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_cells.reset(new queueCell[size]);
+        for (size_t i = 0; i < size; i++) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = size - 1;
+        m_head.pos.store(0, std::memory_order_relaxed);
+        m_tail.pos.store(0, std::memory_order_relaxed);
+        m_closed = false;
+    }
+    //以降の押し込みを失敗させ、待機中のスレッドをすべて起こす
+    //残っているデータは引き続き取り出せる
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_closed = true;
+        }
+        m_cvPushed.notify_all();
+        m_cvPoped.notify_all();
+    }
+    bool closed() const {
+        return m_closed.load();
+    }
+    //キューの最大サイズを取得する
+    size_t capacity() const {
+        return (m_cells) ? m_mask + 1 : 0;
+    }
+    //キューのsizeを取得する (並列に操作されている場合は概算)
+    size_t size() const {
+        const size_t tail = m_tail.pos.load(std::memory_order_acquire);
+        const size_t head = m_head.pos.load(std::memory_order_acquire);
+        return (tail > head) ? tail - head : 0;
+    }
+    //キューが空ならtrueを返す
+    bool empty() const {
+        return size() == 0;
+    }
+    //データを押し込む
+    //キューが満杯ならなにもせずfalseを返す
+    bool try_push(const Type& in) {
+        return try_push_impl(in) && notify_pushed();
+    }
+    bool try_push(Type&& in) {
+        return try_push_impl(std::move(in)) && notify_pushed();
+    }
+    //データを押し込む
+    //キューが満杯なら空きができるまで待機し、closeされた場合はfalseを返す
+    bool push(const Type& in) {
+        return push_wait(in);
+    }
+    bool push(Type&& in) {
+        return push_wait(std::move(in));
+    }
+    //先頭のデータを取り出す
+    //キューが空ならなにもせずfalseを返す
+    bool try_pop(Type *out) {
+        return try_pop_impl(out) && notify_poped();
+    }
+    //先頭のデータを取り出す
+    //キューが空ならデータが追加されるまで待機し、closeされて空になった場合はfalseを返す
+    bool pop(Type *out) {
+        return pop_wait(out, nullptr);
+    }
+    //先頭のデータを取り出す
+    //timeout_ms待ってもデータが追加されなければfalseを返す
+    bool pop(Type *out, uint32_t timeout_ms) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        return pop_wait(out, &deadline);
+    }
+protected:
+    template<typename T>
+    bool try_push_impl(T&& in) {
+        if (!m_cells) {
+            return false;
+        }
+        size_t pos = m_tail.pos.load(std::memory_order_relaxed);
+        for (;;) {
+            queueCell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_tail.pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (&cell.data) Type(std::forward<T>(in));
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; //満杯
+            } else {
+                pos = m_tail.pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    bool try_pop_impl(Type *out) {
+        if (!m_cells) {
+            return false;
+        }
+        size_t pos = m_head.pos.load(std::memory_order_relaxed);
+        for (;;) {
+            queueCell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_head.pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    Type *ptr = reinterpret_cast<Type *>(&cell.data);
+                    *out = std::move(*ptr);
+                    ptr->~Type();
+                    cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; //空
+            } else {
+                pos = m_head.pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    //待機中のスレッドがいる場合のみ起こす
+    //待機側はm_mtxをとったうえで待機数を増やしてから再度確認するので、
+    //ここでm_mtxをとってから通知すれば通知を取りこぼさない
+    bool notify_pushed() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_popWaiters.load(std::memory_order_relaxed) > 0) {
+            { std::lock_guard<std::mutex> lock(m_mtx); }
+            m_cvPushed.notify_one();
+        }
+        return true;
+    }
+    bool notify_poped() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_pushWaiters.load(std::memory_order_relaxed) > 0) {
+            { std::lock_guard<std::mutex> lock(m_mtx); }
+            m_cvPoped.notify_one();
+        }
+        return true;
+    }
+    template<typename T>
+    bool push_wait(T&& in) {
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            if (m_closed.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (try_push_impl(std::forward<T>(in))) {
+                return notify_pushed();
+            }
+            _mm_pause();
+        }
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_pushWaiters++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ret = false;
+        while (!m_closed) {
+            if (try_push_impl(std::forward<T>(in))) {
+                ret = true;
+                break;
+            }
+            m_cvPoped.wait(lock);
+        }
+        m_pushWaiters--;
+        lock.unlock();
+        return ret && notify_pushed();
+    }
+    bool pop_wait(Type *out, const std::chrono::steady_clock::time_point *deadline) {
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            if (try_pop_impl(out)) {
+                return notify_poped();
+            }
+            if (m_closed.load(std::memory_order_relaxed)) {
+                break;
+            }
+            _mm_pause();
+        }
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_popWaiters++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ret = false;
+        for (;;) {
+            if (try_pop_impl(out)) {
+                ret = true;
+                break;
+            }
+            if (m_closed) {
+                break;
+            }
+            if (deadline) {
+                if (m_cvPushed.wait_until(lock, *deadline) == std::cv_status::timeout) {
+                    ret = try_pop_impl(out);
+                    break;
+                }
+            } else {
+                m_cvPushed.wait(lock);
+            }
+        }
+        m_popWaiters--;
+        lock.unlock();
+        return ret && notify_poped();
+    }
+    //残っているデータを破棄し、メモリを解放する
+    void destroy() {
+        if (m_cells) {
+            for (size_t pos = m_head.pos.load(); pos != m_tail.pos.load(); pos++) {
+                reinterpret_cast<Type *>(&m_cells[pos & m_mask].data)->~Type();
+            }
+        }
+        m_cells.reset();
+        m_mask = 0;
+    }
+
+    std::unique_ptr<queueCell[]> m_cells; //リングバッファ
+    size_t m_mask;                       //リングバッファのサイズ - 1
+    queuePos m_head;                     //次に取り出す位置
+    queuePos m_tail;                     //次に押し込む位置
+    alignas(CACHE_LINE) std::atomic<int> m_pushWaiters; //空きを待っているスレッドの数
+    std::atomic<int> m_popWaiters;       //データを待っているスレッドの数
+    std::atomic<bool> m_closed;          //closeされたかどうか
+    std::mutex m_mtx;
+    std::condition_variable m_cvPushed;  //データが追加されたときに通知する
+    std::condition_variable m_cvPoped;   //データが取り出されたときに通知する
+};
+
 #endif //__RGY_QUEUE_H__
@@ -0,0 +1,202 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_queue.h"
+#include "rgy_queue_bench.h"
+
+static const int QUEUE_BENCH_ITEMS = 1 << 20;
+static const int QUEUE_BENCH_CAPACITY = 1024;
+
+struct QueueBenchItem {
+    uint32_t producer;
+    uint32_t seq;
+    int64_t push_time; //押し込んだ時刻 (ns)
+};
+
+static inline int64_t queue_bench_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//ムーブのみ可能な型での確認用
+typedef std::unique_ptr<QueueBenchItem> QueueBenchItemPtr;
+static inline QueueBenchItem queue_bench_make(uint32_t producer, uint32_t seq, QueueBenchItem *) {
+    return QueueBenchItem{ producer, seq, queue_bench_now() };
+}
+static inline QueueBenchItemPtr queue_bench_make(uint32_t producer, uint32_t seq, QueueBenchItemPtr *) {
+    return QueueBenchItemPtr(new QueueBenchItem{ producer, seq, queue_bench_now() });
+}
+static inline const QueueBenchItem *queue_bench_get(const QueueBenchItem& item) { return &item; }
+static inline const QueueBenchItem *queue_bench_get(const QueueBenchItemPtr& item) { return item.get(); }
+
+//取り出し側スレッドごとの結果
+struct QueueBenchConsumer {
+    std::vector<int64_t> latency;
+    std::vector<int64_t> lastSeq; //押し込みスレッドごとの最後に取り出したseq
+    uint64_t count;
+    uint64_t seqSum;
+    bool orderError;
+
+    QueueBenchConsumer(int producers) : latency(), lastSeq(producers, -1), count(0), seqSum(0), orderError(false) {
+        latency.reserve(QUEUE_BENCH_ITEMS);
+    }
+    void add(const QueueBenchItem *item) {
+        latency.push_back(queue_bench_now() - item->push_time);
+        if (item->producer >= lastSeq.size() || (int64_t)item->seq <= lastSeq[item->producer]) {
+            orderError = true;
+        } else {
+            lastSeq[item->producer] = item->seq;
+        }
+        count++;
+        seqSum += item->seq;
+    }
+};
+
+static int queue_bench_print(FILE *fp, const TCHAR *name, int producers, int consumers, int items_per_producer,
+    double elapsed_sec, std::vector<std::unique_ptr<QueueBenchConsumer>>& results) {
+    //すべてのデータが1回ずつ取り出されたか
+    uint64_t count = 0, seqSum = 0;
+    bool orderError = false;
+    std::vector<int64_t> latency;
+    for (auto& r : results) {
+        count += r->count;
+        seqSum += r->seqSum;
+        orderError |= r->orderError;
+        latency.insert(latency.end(), r->latency.begin(), r->latency.end());
+    }
+    const uint64_t total = (uint64_t)items_per_producer * producers;
+    const uint64_t expectedSum = (uint64_t)items_per_producer * (items_per_producer - 1) / 2 * producers;
+    const bool ok = !orderError && count == total && seqSum == expectedSum;
+
+    double avg = 0.0, p99 = 0.0;
+    if (latency.size() > 0) {
+        for (const auto v : latency) {
+            avg += (double)v;
+        }
+        avg /= latency.size();
+        auto p99_pos = latency.begin() + (size_t)(latency.size() * 0.99);
+        std::nth_element(latency.begin(), p99_pos, latency.end());
+        p99 = (double)*p99_pos;
+    }
+    _ftprintf(fp, _T("%s,%d,%d,%d,%d,%.2f,%.2f,%.2f,%s\n"),
+        name, producers, consumers, QUEUE_BENCH_CAPACITY, (int)total,
+        total / elapsed_sec * 1e-6, avg * 1e-3, p99 * 1e-3, (ok) ? _T("OK") : _T("NG"));
+    fflush(fp);
+    return (ok) ? 0 : 1;
+}
+
+//現在の使い方(muxerと同様)での計測
+//押し込み側は満杯ならpushの中で待機し、取り出し側は空ならwait_for_pushで待機する
+static int queue_bench_spsp(FILE *fp) {
+    RGYQueueSPSP<QueueBenchItem, 64> queue;
+    queue.init(QUEUE_BENCH_CAPACITY, QUEUE_BENCH_CAPACITY);
+    std::vector<std::unique_ptr<QueueBenchConsumer>> results;
+    results.push_back(std::make_unique<QueueBenchConsumer>(1));
+    auto result = results.back().get();
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        QueueBenchItem item;
+        while (result->count < (uint64_t)QUEUE_BENCH_ITEMS) {
+            if (queue.front_copy_and_pop_no_lock(&item)) {
+                result->add(&item);
+            } else {
+                queue.wait_for_push();
+            }
+        }
+    });
+    for (int i = 0; i < QUEUE_BENCH_ITEMS; i++) {
+        queue.push(queue_bench_make(0, i, (QueueBenchItem *)nullptr));
+    }
+    consumer.join();
+    const double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    queue.close();
+    return queue_bench_print(fp, _T("SPSP"), 1, 1, QUEUE_BENCH_ITEMS, elapsed_sec, results);
+}
+
+template<typename Type>
+static int queue_bench_mpmc(FILE *fp, const TCHAR *name, int producers, int consumers) {
+    RGYQueueMPMC<Type> queue;
+    queue.init(QUEUE_BENCH_CAPACITY);
+    const int items_per_producer = QUEUE_BENCH_ITEMS / producers;
+    std::vector<std::unique_ptr<QueueBenchConsumer>> results;
+    for (int i = 0; i < consumers; i++) {
+        results.push_back(std::make_unique<QueueBenchConsumer>(producers));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < consumers; i++) {
+        threads.push_back(std::thread([&queue](QueueBenchConsumer *result) {
+            Type item;
+            while (queue.pop(&item)) {
+                result->add(queue_bench_get(item));
+            }
+        }, results[i].get()));
+    }
+    std::vector<std::thread> producer_threads;
+    for (int i = 0; i < producers; i++) {
+        producer_threads.push_back(std::thread([&queue, items_per_producer](uint32_t producer) {
+            for (int j = 0; j < items_per_producer; j++) {
+                queue.push(queue_bench_make(producer, j, (Type *)nullptr));
+            }
+        }, (uint32_t)i));
+    }
+    for (auto& th : producer_threads) {
+        th.join();
+    }
+    //すべて押し込んだらcloseし、取り出し側は残りを取り出したら終了する
+    queue.close();
+    for (auto& th : threads) {
+        th.join();
+    }
+    const double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return queue_bench_print(fp, name, producers, consumers, items_per_producer, elapsed_sec, results);
+}
+
+int queue_bench(FILE *fp) {
+    struct QueueBenchThreads {
+        int producers, consumers;
+    };
+    const QueueBenchThreads threads[] = {
+        { 1, 1 }, { 2, 2 }, { 4, 4 }, { 4, 1 }, { 1, 4 },
+    };
+    int mismatch = 0;
+    _ftprintf(fp, _T("queue,producers,consumers,capacity,items,Mitems/s,avg latency (us),p99 latency (us),verify\n"));
+    mismatch += queue_bench_spsp(fp);
+    for (const auto& t : threads) {
+        mismatch += queue_bench_mpmc<QueueBenchItem>(fp, _T("MPMC"), t.producers, t.consumers);
+    }
+    mismatch += queue_bench_mpmc<QueueBenchItemPtr>(fp, _T("MPMC unique_ptr"), 2, 2);
+    return mismatch;
+}
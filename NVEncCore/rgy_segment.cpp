@@ -0,0 +1,693 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "rgy_segment.h"
+#include "rgy_pipe.h"
+
+static int64_t segment_rescale(int64_t v, rgy_rational<int> from, rgy_rational<int> to) {
+    if (from.n() == to.n() && from.d() == to.d()) {
+        return v;
+    }
+    const double scale = ((double)from.n() * (double)to.d()) / ((double)from.d() * (double)to.n());
+    return (int64_t)std::llround((double)v * scale);
+}
+
+int64_t RGYSegmentSourceInfo::minFrameInterval() const {
+    int64_t interval = 0;
+    for (size_t i = 1; i < frames.size(); i++) {
+        const int64_t diff = frames[i].pts - frames[i-1].pts;
+        if (diff > 0 && (interval == 0 || diff < interval)) {
+            interval = diff;
+        }
+    }
+    return interval;
+}
+
+std::vector<RGYSegment> rgy_segment_plan(const std::vector<RGYSegmentFrame>& frames, int count, int minFrames) {
+    std::vector<RGYSegment> segments;
+    const int total = (int)frames.size();
+    if (total == 0) {
+        return segments;
+    }
+    count = clamp(count, 1, RGY_SEGMENT_MAX);
+    minFrames = std::max(minFrames, 1);
+
+    std::vector<int> keys;
+    for (int i = 1; i < total; i++) {
+        if (frames[i].key) {
+            keys.push_back(i);
+        }
+    }
+    //k/count の位置に最も近いキーフレームを区間の境界とする
+    std::vector<int> bounds = { 0 };
+    for (int k = 1; k < count; k++) {
+        const int target = (int)((int64_t)total * k / count);
+        const auto it = std::lower_bound(keys.begin(), keys.end(), target);
+        int selected = -1;
+        for (auto candidate = (it == keys.begin()) ? it : it - 1; candidate != keys.end() && candidate <= it; candidate++) {
+            if (*candidate - bounds.back() < minFrames || total - *candidate < minFrames) {
+                continue;
+            }
+            if (selected < 0 || std::abs(*candidate - target) < std::abs(selected - target)) {
+                selected = *candidate;
+            }
+        }
+        if (selected > bounds.back()) {
+            bounds.push_back(selected);
+        }
+    }
+    bounds.push_back(total);
+    for (int i = 0; i < (int)bounds.size() - 1; i++) {
+        RGYSegment segment;
+        segment.index = i;
+        segment.start = bounds[i];
+        segment.frames = bounds[i+1] - bounds[i];
+        segment.startPts = frames[bounds[i]].pts;
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+double rgy_segment_seek_sec(const RGYSegmentSourceInfo& info, const RGYSegment& segment) {
+    if (segment.start == 0) {
+        return 0.0;
+    }
+    const int64_t target = segment.startPts - info.minFrameInterval() / 2 - info.firstPktPts;
+    return std::max<int64_t>(target, 0) * info.timebase.qdouble();
+}
+
+RGY_ERR rgy_segment_run(const std::vector<RGYSegment>& segments, int parallel,
+    std::function<RGY_ERR(const RGYSegment&, int)> func, const bool *abort) {
+    if (segments.size() == 0) {
+        return RGY_ERR_NONE;
+    }
+    parallel = clamp(parallel, 1, (int)segments.size());
+    std::atomic<int> next(0);
+    std::atomic<int> finished(0);
+    std::atomic<bool> failed(false);
+    std::mutex mtx;
+    RGY_ERR err = RGY_ERR_NONE;
+    std::vector<std::thread> threads;
+    for (int slot = 0; slot < parallel; slot++) {
+        threads.push_back(std::thread([&, slot]() {
+            while (!failed && !(abort && *abort)) {
+                const int index = next++;
+                if (index >= (int)segments.size()) {
+                    break;
+                }
+                const auto sts = func(segments[index], slot);
+                if (sts != RGY_ERR_NONE) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (err == RGY_ERR_NONE) {
+                        err = sts;
+                    }
+                    failed = true;
+                }
+                finished++;
+            }
+        }));
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    if (err == RGY_ERR_NONE && finished != (int)segments.size()) {
+        err = RGY_ERR_ABORTED;
+    }
+    return err;
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+//""で囲まれた部分は空白を含めてひとつの引数とする
+static std::vector<tstring> segment_split_cmd(const tstring& cmd) {
+    std::vector<tstring> args;
+    tstring arg;
+    bool quoted = false, hasArg = false;
+    for (auto c : cmd) {
+        if (c == _T('"')) {
+            quoted = !quoted;
+            hasArg = true;
+        } else if (!quoted && (c == _T(' ') || c == _T('\t'))) {
+            if (hasArg) {
+                args.push_back(arg);
+                arg.clear();
+                hasArg = false;
+            }
+        } else {
+            arg += c;
+            hasArg = true;
+        }
+    }
+    if (hasArg) {
+        args.push_back(arg);
+    }
+    return args;
+}
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+int rgy_segment_exec(const tstring& exePath, const tstring& cmd) {
+    ProcessPipe pipes;
+    memset(&pipes, 0, sizeof(pipes));
+#if defined(_WIN32) || defined(_WIN64)
+    //RGYPipeProcessWinは引数を空白で連結してコマンドラインとする
+    const tstring cmdLine = _T("\"") + exePath + _T("\" ") + cmd;
+    std::vector<const TCHAR *> args = { cmdLine.c_str() };
+    RGYPipeProcessWin process;
+#else
+    std::vector<tstring> argList = segment_split_cmd(cmd);
+    argList.insert(argList.begin(), exePath);
+    std::vector<const TCHAR *> args;
+    for (const auto& arg : argList) {
+        args.push_back(arg.c_str());
+    }
+    args.push_back(nullptr);
+    RGYPipeProcessLinux process;
+#endif
+    process.init();
+    //中断時に子プロセスにもCtrl+Cが伝わるよう、コンソールは共有する
+    if (process.run(args, nullptr, &pipes, 0, false, false)) {
+        return -1;
+    }
+    const int exitCode = process.waitAndGetExitCode();
+    process.close();
+    return exitCode;
+}
+
+RGYSegmentReaderMemory::RGYSegmentReaderMemory(std::vector<RGYSegmentPacket>&& packets, rgy_rational<int> timebase) :
+    m_packets(std::move(packets)), m_timebase(timebase), m_next(0) {
+}
+
+RGY_ERR RGYSegmentReaderMemory::read(RGYSegmentPacket *pkt) {
+    if (m_next >= m_packets.size()) {
+        return RGY_ERR_MORE_BITSTREAM;
+    }
+    *pkt = std::move(m_packets[m_next++]);
+    return RGY_ERR_NONE;
+}
+
+#if ENABLE_AVSW_READER
+//RGYInputAvcodecと同じ順で映像のトラックを選択する (解像度の大きい順)
+static int segment_select_video_stream(AVFormatContext *formatCtx, int videoTrack, int videoStreamId) {
+    std::vector<int> videoStreams;
+    for (int i = 0; i < (int)formatCtx->nb_streams; i++) {
+        if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            videoStreams.push_back(i);
+        }
+    }
+    std::stable_sort(videoStreams.begin(), videoStreams.end(), [formatCtx](int a, int b) {
+        const auto parA = formatCtx->streams[a]->codecpar;
+        const auto parB = formatCtx->streams[b]->codecpar;
+        return parA->width * parA->height > parB->width * parB->height;
+    });
+    if (videoStreams.size() == 0) {
+        return -1;
+    }
+    if (videoTrack) {
+        if ((int)videoStreams.size() < std::abs(videoTrack)) {
+            return -1;
+        }
+        if (videoTrack < 0) {
+            std::reverse(videoStreams.begin(), videoStreams.end());
+        }
+        return videoStreams[std::abs(videoTrack) - 1];
+    }
+    if (videoStreamId) {
+        for (auto index : videoStreams) {
+            if (formatCtx->streams[index]->id == videoStreamId) {
+                return index;
+            }
+        }
+        return -1;
+    }
+    return videoStreams[0];
+}
+
+RGY_ERR rgy_segment_scan(RGYSegmentSourceInfo *info, const tstring& filename, const TCHAR *inputFormat, int videoTrack, int videoStreamId, std::shared_ptr<RGYLog> log) {
+    if (!check_avcodec_dll()) {
+        if (log) log->write(RGY_LOG_ERROR, error_mes_avcodec_dll_not_found().c_str());
+        return RGY_ERR_NULL_PTR;
+    }
+    std::string filename_char;
+    if (0 == tchar_to_string(filename.c_str(), filename_char, CP_UTF8)) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: failed to convert filename to utf-8 characters.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    AVInputFormat *format = nullptr;
+    if (inputFormat && nullptr == (format = av_find_input_format(tchar_to_string(inputFormat).c_str()))) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: unknown input format: %s.\n"), inputFormat);
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    AVDictionary *formatOptions = nullptr;
+    av_dict_set(&formatOptions, "scan_all_pmts", "1", 0);
+    AVFormatContext *formatCtx = nullptr;
+    int ret = avformat_open_input(&formatCtx, filename_char.c_str(), format, &formatOptions);
+    av_dict_free(&formatOptions);
+    if (ret != 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: error opening file \"%s\": %s\n"), filename.c_str(), qsv_av_err2str(ret).c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    unique_ptr_custom<AVFormatContext> formatCtxHolder(formatCtx, [](AVFormatContext *ctx) { avformat_close_input(&ctx); });
+    if (avformat_find_stream_info(formatCtx, nullptr) < 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: error finding stream information.\n"));
+        return RGY_ERR_UNKNOWN;
+    }
+    const int videoIndex = segment_select_video_stream(formatCtx, videoTrack, videoStreamId);
+    if (videoIndex < 0) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: unable to find video stream.\n"));
+        return RGY_ERR_NOT_FOUND;
+    }
+    //映像以外のパケットは読み込まない
+    for (int i = 0; i < (int)formatCtx->nb_streams; i++) {
+        formatCtx->streams[i]->discard = (i == videoIndex) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    const AVStream *stream = formatCtx->streams[videoIndex];
+    info->frames.clear();
+    info->timebase = rgy_rational<int>(stream->time_base.num, stream->time_base.den);
+    info->firstPktPts = AV_NOPTS_VALUE;
+
+    int64_t firstKeyPts = AV_NOPTS_VALUE;
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    while (av_read_frame(formatCtx, &pkt) >= 0) {
+        if (pkt.stream_index == videoIndex) {
+            if (pkt.pts == AV_NOPTS_VALUE) {
+                av_packet_unref(&pkt);
+                if (log) log->write(RGY_LOG_ERROR, _T("segment: timestamp of the input video is not available.\n"));
+                return RGY_ERR_UNSUPPORTED;
+            }
+            if (info->firstPktPts == AV_NOPTS_VALUE) {
+                info->firstPktPts = pkt.pts;
+            }
+            const bool key = (pkt.flags & AV_PKT_FLAG_KEY) != 0;
+            if (key && firstKeyPts == AV_NOPTS_VALUE) {
+                firstKeyPts = pkt.pts;
+            }
+            RGYSegmentFrame frame;
+            frame.pts = pkt.pts;
+            frame.key = key;
+            info->frames.push_back(frame);
+        }
+        av_packet_unref(&pkt);
+    }
+    if (firstKeyPts == AV_NOPTS_VALUE) {
+        if (log) log->write(RGY_LOG_ERROR, _T("segment: no keyframe found in the input video.\n"));
+        return RGY_ERR_NOT_FOUND;
+    }
+    //表示順に並べ替え、最初のキーフレームより前のフレームは除く (RGYInputAvcodecでも出力されない)
+    std::stable_sort(info->frames.begin(), info->frames.end(), [](const RGYSegmentFrame& a, const RGYSegmentFrame& b) { return a.pts < b.pts; });
+    info->frames.erase(std::remove_if(info->frames.begin(), info->frames.end(), [firstKeyPts](const RGYSegmentFrame& frame) { return frame.pts < firstKeyPts; }), info->frames.end());
+    int keyframes = 0;
+    for (const auto& frame : info->frames) {
+        keyframes += frame.key ? 1 : 0;
+    }
+    if (log) log->write(RGY_LOG_DEBUG, _T("segment: scanned %d frames, %d keyframes, timebase %d/%d.\n"),
+        (int)info->frames.size(), keyframes, info->timebase.n(), info->timebase.d());
+    return RGY_ERR_NONE;
+}
+
+RGYSegmentReaderAvformat::RGYSegmentReaderAvformat() : m_formatCtx(nullptr), m_stream(nullptr) {
+}
+
+RGYSegmentReaderAvformat::~RGYSegmentReaderAvformat() {
+    close();
+}
+
+RGY_ERR RGYSegmentReaderAvformat::open(const tstring& filename) {
+    close();
+    std::string filename_char;
+    if (0 == tchar_to_string(filename.c_str(), filename_char, CP_UTF8)) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (avformat_open_input(&m_formatCtx, filename_char.c_str(), nullptr, nullptr) != 0) {
+        m_formatCtx = nullptr;
+        return RGY_ERR_FILE_OPEN;
+    }
+    if (avformat_find_stream_info(m_formatCtx, nullptr) < 0) {
+        close();
+        return RGY_ERR_UNKNOWN;
+    }
+    for (int i = 0; i < (int)m_formatCtx->nb_streams; i++) {
+        if (m_stream == nullptr && m_formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            m_stream = m_formatCtx->streams[i];
+        } else {
+            m_formatCtx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    if (m_stream == nullptr) {
+        close();
+        return RGY_ERR_NOT_FOUND;
+    }
+    return RGY_ERR_NONE;
+}
+
+void RGYSegmentReaderAvformat::close() {
+    if (m_formatCtx) {
+        avformat_close_input(&m_formatCtx);
+    }
+    m_formatCtx = nullptr;
+    m_stream = nullptr;
+}
+
+RGY_ERR RGYSegmentReaderAvformat::read(RGYSegmentPacket *pkt) {
+    if (m_stream == nullptr) {
+        return RGY_ERR_NOT_INITIALIZED;
+    }
+    AVPacket avpkt;
+    av_init_packet(&avpkt);
+    while (av_read_frame(m_formatCtx, &avpkt) >= 0) {
+        if (avpkt.stream_index != m_stream->index) {
+            av_packet_unref(&avpkt);
+            continue;
+        }
+        pkt->data.assign(avpkt.data, avpkt.data + avpkt.size);
+        pkt->pts = (avpkt.pts != AV_NOPTS_VALUE) ? avpkt.pts : avpkt.dts;
+        pkt->duration = avpkt.duration;
+        pkt->key = (avpkt.flags & AV_PKT_FLAG_KEY) != 0;
+        av_packet_unref(&avpkt);
+        return (pkt->pts != AV_NOPTS_VALUE) ? RGY_ERR_NONE : RGY_ERR_INVALID_FORMAT;
+    }
+    return RGY_ERR_MORE_BITSTREAM;
+}
+
+rgy_rational<int> RGYSegmentReaderAvformat::timebase() const {
+    return (m_stream) ? rgy_rational<int>(m_stream->time_base.num, m_stream->time_base.den) : rgy_rational<int>();
+}
+#endif //#if ENABLE_AVSW_READER
+
+RGYSegmentConcat::RGYSegmentConcat() :
+    m_timebase(),
+    m_segTimebase(),
+    m_segIndex(-1),
+    m_segExpectedFrames(0),
+    m_segFrames(0),
+    m_segFirstPts(0),
+    m_segLastPts(0),
+    m_segLastDuration(0),
+    m_segPts(),
+    m_lastInterval(0),
+    m_offset(0),
+    m_totalFrames(0),
+    m_inSegment(false),
+    m_message() {
+}
+
+RGY_ERR RGYSegmentConcat::error(RGY_ERR err, const tstring& message) {
+    m_message = message;
+    return err;
+}
+
+RGY_ERR RGYSegmentConcat::begin(const RGYSegment& segment, rgy_rational<int> timebase, int expectedFrames) {
+    if (m_inSegment) {
+        return error(RGY_ERR_INVALID_CALL, strsprintf(_T("segment %d is not finished.\n"), m_segIndex));
+    }
+    if (timebase.n() <= 0 || timebase.d() <= 0) {
+        return error(RGY_ERR_INVALID_PARAM, strsprintf(_T("segment %d: invalid timebase %d/%d.\n"), segment.index, timebase.n(), timebase.d()));
+    }
+    if (m_timebase.n() <= 0) {
+        m_timebase = timebase;
+    }
+    m_segTimebase = timebase;
+    m_segIndex = segment.index;
+    m_segExpectedFrames = expectedFrames;
+    m_segFrames = 0;
+    m_segFirstPts = 0;
+    m_segLastPts = 0;
+    m_segLastDuration = 0;
+    m_segPts.clear();
+    m_inSegment = true;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYSegmentConcat::add(RGYSegmentPacket *pkt) {
+    if (!m_inSegment) {
+        return error(RGY_ERR_INVALID_CALL, _T("segment is not started.\n"));
+    }
+    if (m_segFrames == 0) {
+        if (!pkt->key) {
+            return error(RGY_ERR_INVALID_FORMAT, strsprintf(_T("segment %d does not start with a keyframe.\n"), m_segIndex));
+        }
+        m_segFirstPts = pkt->pts;
+        m_segLastPts = pkt->pts;
+        m_segLastDuration = pkt->duration;
+    }
+    //先頭のキーフレームより前に表示されるフレームがあると、直前の区間と重なってしまう
+    if (pkt->pts < m_segFirstPts) {
+        return error(RGY_ERR_INVALID_FORMAT, strsprintf(_T("segment %d: frame (pts %lld) is displayed before the first keyframe (pts %lld).\n"),
+            m_segIndex, (long long)pkt->pts, (long long)m_segFirstPts));
+    }
+    if (pkt->pts >= m_segLastPts) {
+        m_segLastPts = pkt->pts;
+        m_segLastDuration = pkt->duration;
+    }
+    m_segPts.push_back(pkt->pts);
+    pkt->pts = m_offset + segment_rescale(pkt->pts - m_segFirstPts, m_segTimebase, m_timebase);
+    pkt->duration = segment_rescale(std::max<int64_t>(pkt->duration, 0), m_segTimebase, m_timebase);
+    m_segFrames++;
+    m_totalFrames++;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYSegmentConcat::end() {
+    if (!m_inSegment) {
+        return error(RGY_ERR_INVALID_CALL, _T("segment is not started.\n"));
+    }
+    m_inSegment = false;
+    if (m_segFrames == 0) {
+        return error(RGY_ERR_INVALID_FORMAT, strsprintf(_T("segment %d is empty.\n"), m_segIndex));
+    }
+    if (m_segExpectedFrames > 0 && m_segFrames != m_segExpectedFrames) {
+        return error(RGY_ERR_INVALID_FORMAT, strsprintf(_T("segment %d: %d frames found, %d frames expected.\n"), m_segIndex, m_segFrames, m_segExpectedFrames));
+    }
+    //区間の最後のフレームの表示時間 (不明ならフレームの間隔から推定する)
+    int64_t lastDuration = m_segLastDuration;
+    if (lastDuration <= 0) {
+        std::sort(m_segPts.begin(), m_segPts.end());
+        int64_t interval = 0;
+        for (size_t i = 1; i < m_segPts.size(); i++) {
+            const int64_t diff = m_segPts[i] - m_segPts[i-1];
+            if (diff > 0 && (interval == 0 || diff < interval)) {
+                interval = diff;
+            }
+        }
+        if (interval > 0) {
+            m_lastInterval = segment_rescale(interval, m_segTimebase, m_timebase);
+            lastDuration = interval;
+        } else if (m_lastInterval > 0) {
+            lastDuration = segment_rescale(m_lastInterval, m_timebase, m_segTimebase);
+        } else {
+            return error(RGY_ERR_INVALID_FORMAT, strsprintf(_T("segment %d: unable to estimate the duration of the last frame.\n"), m_segIndex));
+        }
+    }
+    m_offset += segment_rescale(m_segLastPts + lastDuration - m_segFirstPts, m_segTimebase, m_timebase);
+    return RGY_ERR_NONE;
+}
+
+//疑似的な入力: 90kHzのtimebaseで、30000/1001fps → 60000/1001fps(1501/1502の交互) → 24fps相当 と変化し、
+//キーフレームの間隔は不規則
+static RGYSegmentSourceInfo segment_bench_source(int frameCount) {
+    RGYSegmentSourceInfo info;
+    info.timebase = rgy_rational<int>(1, 90000);
+    info.firstPktPts = 6006; //デコード順で最初のパケット (Bフレームの遅延分だけ先頭のフレームより前)
+    uint32_t lcg = 12345;
+    int nextKey = 0;
+    int64_t pts = 9009;
+    for (int i = 0; i < frameCount; i++) {
+        RGYSegmentFrame frame;
+        frame.pts = pts;
+        frame.key = (i == nextKey);
+        if (frame.key) {
+            lcg = lcg * 1103515245u + 12345u;
+            nextKey = i + 15 + (int)((lcg >> 16) % 136);
+        }
+        info.frames.push_back(frame);
+        const int section = i * 3 / frameCount;
+        pts += (section == 0) ? 3003 : ((section == 1) ? (1501 + (i & 1)) : 3754);
+    }
+    return info;
+}
+
+static int64_t segment_bench_out_pts(const RGYSegmentSourceInfo& info, int index, rgy_rational<int> outTimebase) {
+    return segment_rescale(info.frames[index].pts, info.timebase, outTimebase);
+}
+
+//疑似的なエンコーダ: 区間の先頭へのシークを確認し、区間のフレームをBフレームの並べ替えを行ったデコード順で出力する
+static RGY_ERR segment_bench_encode(std::vector<RGYSegmentPacket>& packets, const RGYSegmentSourceInfo& info, const RGYSegment& seg, rgy_rational<int> outTimebase, int workPerFrame) {
+    if (seg.start > 0) {
+        //avformatのseekと同様に、指定位置以降の最初のキーフレームへ移動する
+        const double seekSec = rgy_segment_seek_sec(info, seg);
+        const int64_t seekPts = info.firstPktPts + (int64_t)std::ceil(seekSec / info.timebase.qdouble() - 1e-6);
+        int landed = -1;
+        for (int i = 0; i < (int)info.frames.size(); i++) {
+            if (info.frames[i].key && info.frames[i].pts >= seekPts) {
+                landed = i;
+                break;
+            }
+        }
+        if (landed != seg.start) {
+            return RGY_ERR_INVALID_FORMAT;
+        }
+    }
+    //I P B B P B B ... (表示順で2フレーム先のPを先に出力する)
+    std::vector<int> decodeOrder = { 0 };
+    for (int i = 1; i < seg.frames; i += 3) {
+        const int p = std::min(i + 2, seg.frames - 1);
+        decodeOrder.push_back(p);
+        for (int b = i; b < p; b++) {
+            decodeOrder.push_back(b);
+        }
+    }
+    const int64_t outOffset = 1234; //子プロセスの出力のptsは0から始まるとは限らない
+    uint32_t work = 0;
+    for (auto local : decodeOrder) {
+        const int index = seg.start + local;
+        for (int i = 0; i < workPerFrame; i++) {
+            work = work * 1664525u + 1013904223u + (uint32_t)index;
+        }
+        RGYSegmentPacket pkt;
+        pkt.data = { 0, 0, 0, 1, 0x09, (uint8_t)(index >> 24), (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index, (uint8_t)work };
+        pkt.pts = segment_bench_out_pts(info, index, outTimebase) + outOffset;
+        const int64_t nextPts = (index + 1 < (int)info.frames.size())
+            ? segment_bench_out_pts(info, index + 1, outTimebase)
+            : 2 * segment_bench_out_pts(info, index, outTimebase) - segment_bench_out_pts(info, index - 1, outTimebase);
+        pkt.duration = nextPts - segment_bench_out_pts(info, index, outTimebase);
+        pkt.key = (local == 0);
+        packets.push_back(std::move(pkt));
+    }
+    return RGY_ERR_NONE;
+}
+
+int segment_encode_bench(FILE *fp) {
+    const int frameCount = 6000;
+    const int workPerFrame = 20000;
+    const auto outTimebase = rgy_rational<int>(1, 120000);
+    const auto info = segment_bench_source(frameCount);
+    const double fps = (frameCount - 1) / ((info.frames.back().pts - info.frames.front().pts) * info.timebase.qdouble());
+    const int minFrames = (int)(RGY_SEGMENT_MIN_SEC * fps + 0.5);
+
+    int ret = 0;
+    fprintf(fp, "case,segments,parallel,frames,time_ms,max_seg_ratio,verify\n");
+    for (int count : { 1, 4, 16 }) {
+        for (int parallel : { 1, 4 }) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const auto segments = rgy_segment_plan(info.frames, count, minFrames);
+            std::vector<std::vector<RGYSegmentPacket>> outputs(segments.size());
+            auto err = rgy_segment_run(segments, parallel, [&](const RGYSegment& seg, int) {
+                return segment_bench_encode(outputs[seg.index], info, seg, outTimebase, workPerFrame);
+            }, nullptr);
+            RGYSegmentConcat concat;
+            std::vector<RGYSegmentPacket> result;
+            for (size_t i = 0; err == RGY_ERR_NONE && i < segments.size(); i++) {
+                RGYSegmentReaderMemory reader(std::move(outputs[i]), outTimebase);
+                err = concat.begin(segments[i], reader.timebase(), segments[i].frames);
+                RGYSegmentPacket pkt;
+                while (err == RGY_ERR_NONE && (err = reader.read(&pkt)) == RGY_ERR_NONE) {
+                    err = concat.add(&pkt);
+                    result.push_back(pkt);
+                }
+                if (err == RGY_ERR_MORE_BITSTREAM) {
+                    err = concat.end();
+                }
+            }
+            const double timeMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count() * 0.001;
+
+            //検証: フレーム数、表示順に並べた時のフレームの順序とpts、区間の境界がキーフレームであること、区間の大きさの偏り
+            bool ok = (err == RGY_ERR_NONE) && (int)result.size() == frameCount && segments.size() > 0;
+            int maxSegFrames = 0;
+            for (const auto& seg : segments) {
+                maxSegFrames = std::max(maxSegFrames, seg.frames);
+                ok &= info.frames[seg.start].key && (segments.size() == 1 || seg.frames >= minFrames);
+            }
+            const double maxSegRatio = (segments.size() > 0) ? maxSegFrames * (double)segments.size() / frameCount : 0.0;
+            ok &= (int)segments.size() == count && maxSegRatio < 2.0;
+            if (ok) {
+                std::stable_sort(result.begin(), result.end(), [](const RGYSegmentPacket& a, const RGYSegmentPacket& b) { return a.pts < b.pts; });
+                const int64_t basePts = segment_bench_out_pts(info, 0, outTimebase);
+                for (int i = 0; ok && i < frameCount; i++) {
+                    const auto& data = result[i].data;
+                    const int index = (data[5] << 24) | (data[6] << 16) | (data[7] << 8) | data[8];
+                    const int64_t expectedPts = segment_bench_out_pts(info, i, outTimebase) - basePts;
+                    ok &= index == i && std::abs(result[i].pts - expectedPts) <= 1;
+                    ok &= !result[i].key || info.frames[i].key;
+                }
+                for (const auto& seg : segments) {
+                    ok &= result[seg.start].key;
+                }
+            }
+            fprintf(fp, "encode,%d,%d,%d,%.1f,%.3f,%s\n", count, parallel, (int)result.size(), timeMs, maxSegRatio, ok ? "OK" : "NG");
+            ret |= ok ? 0 : 1;
+        }
+    }
+    {
+        //区間の先頭がキーフレームでなければエラーとする
+        RGYSegment seg = { 0, 0, 2, 0 };
+        RGYSegmentConcat concat;
+        RGYSegmentPacket pkt;
+        pkt.pts = 0;
+        pkt.duration = 1;
+        pkt.key = false;
+        bool ok = concat.begin(seg, outTimebase, 2) == RGY_ERR_NONE && concat.add(&pkt) == RGY_ERR_INVALID_FORMAT;
+        fprintf(fp, "reject_nonkey_start,1,1,0,0.0,0.000,%s\n", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    {
+        //エラーが発生したら以降の区間は開始しない
+        std::vector<RGYSegment> segments;
+        for (int i = 0; i < 8; i++) {
+            RGYSegment seg = { i, i * 100, 100, 0 };
+            segments.push_back(seg);
+        }
+        std::atomic<int> started(0);
+        const auto err = rgy_segment_run(segments, 1, [&](const RGYSegment& seg, int) {
+            started++;
+            return (seg.index == 2) ? RGY_ERR_RUN_PROCESS : RGY_ERR_NONE;
+        }, nullptr);
+        const bool ok = err == RGY_ERR_RUN_PROCESS && started == 3;
+        fprintf(fp, "stop_on_error,8,1,0,0.0,0.000,%s\n", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    {
+        //子プロセスの終了コードを取得できること
+#if defined(_WIN32) || defined(_WIN64)
+        const TCHAR *comspec = _tgetenv(_T("COMSPEC"));
+        const int exitCode = rgy_segment_exec((comspec) ? comspec : _T("cmd.exe"), _T("/c exit 3"));
+#else
+        const int exitCode = rgy_segment_exec(_T("/bin/sh"), _T("-c \"exit 3\""));
+#endif
+        const bool ok = exitCode == 3;
+        fprintf(fp, "exec_exit_code,1,1,0,0.0,0.000,%s\n", ok ? "OK" : "NG");
+        ret |= ok ? 0 : 1;
+    }
+    return ret;
+}
@@ -0,0 +1,194 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __RGY_SEGMENT_H__
+#define __RGY_SEGMENT_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "rgy_version.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+#include "rgy_log.h"
+#if ENABLE_AVSW_READER
+#include "rgy_avutil.h"
+#endif //#if ENABLE_AVSW_READER
+
+//入力をキーフレームで区間に分割し、区間ごとに並列にエンコードした結果を結合する
+//
+//区間の境界は、入力のキーフレームのうち、各区間のフレーム数が均等になるものを選択する
+//(入力のキーフレームは多くの場合シーンチェンジの位置にあるので、区間の境界での画質の変化も目立ちにくい)
+//各区間の出力は、先頭のフレームが必ずキーフレームとなっているので、そのまま連結できる
+//
+//区間の分割/並列実行/結合はエンコーダに依存しないので、
+//segment_encode_bench()では疑似的なエンコーダの出力で確認する
+
+static const int RGY_SEGMENT_MAX = 256;           //最大の分割数
+static const double RGY_SEGMENT_MIN_SEC = 2.0;    //1区間の最小の長さ (秒)
+
+//入力の映像フレーム (表示順)
+struct RGYSegmentFrame {
+    int64_t pts;
+    bool key;
+};
+
+//入力の映像フレームの一覧
+struct RGYSegmentSourceInfo {
+    std::vector<RGYSegmentFrame> frames; //表示順 (先頭のキーフレームより前のフレームは含まない)
+    rgy_rational<int> timebase;
+    int64_t firstPktPts;                 //デコード順で最初のパケットのpts (--seekの基準)
+
+    RGYSegmentSourceInfo() : frames(), timebase(), firstPktPts(0) {};
+    //フレームの最小の間隔 (求められなければ0)
+    int64_t minFrameInterval() const;
+};
+
+//分割した区間
+struct RGYSegment {
+    int index;
+    int start;         //開始フレーム (RGYSegmentSourceInfo::framesでの位置)
+    int frames;        //フレーム数
+    int64_t startPts;  //開始フレームのpts
+};
+
+//framesを、各区間のフレーム数がなるべく均等になるようにキーフレームで最大count個の区間に分割する
+//minFrames未満の区間はできないようにするため、キーフレームが少ない場合には区間の数はcountより少なくなる
+std::vector<RGYSegment> rgy_segment_plan(const std::vector<RGYSegmentFrame>& frames, int count, int minFrames);
+
+//区間の開始位置へ--seekで移動するための秒数
+//(avformatのseekは指定位置以降のキーフレームへ移動するので、1/2フレーム分手前を指定する)
+double rgy_segment_seek_sec(const RGYSegmentSourceInfo& info, const RGYSegment& segment);
+
+//区間ごとにfuncを最大parallel並列で実行する
+//funcの第2引数は実行中の処理の中での番号 (0 ～ parallel-1)
+//いずれかの区間でエラーが発生するか、abortがセットされると、以降の区間は開始せずに最初のエラーを返す
+RGY_ERR rgy_segment_run(const std::vector<RGYSegment>& segments, int parallel,
+    std::function<RGY_ERR(const RGYSegment&, int)> func, const bool *abort);
+
+//子プロセスを実行して終了を待ち、終了コードを返す (起動に失敗した場合は-1)
+//cmdはgen_cmd()の出力のように、空白を含む引数を""で囲んだもの
+int rgy_segment_exec(const tstring& exePath, const tstring& cmd);
+
+//区間の出力のアクセスユニット
+struct RGYSegmentPacket {
+    std::vector<uint8_t> data;
+    int64_t pts;
+    int64_t duration;  //不明なら0
+    bool key;
+};
+
+//区間の出力を読み込む
+class RGYSegmentReader {
+public:
+    RGYSegmentReader() {};
+    virtual ~RGYSegmentReader() {};
+    //次のアクセスユニット (デコード順) を取得する (終端ならRGY_ERR_MORE_BITSTREAM)
+    virtual RGY_ERR read(RGYSegmentPacket *pkt) = 0;
+    virtual rgy_rational<int> timebase() const = 0;
+};
+
+//メモリ上のアクセスユニットを読み込む
+class RGYSegmentReaderMemory : public RGYSegmentReader {
+public:
+    RGYSegmentReaderMemory(std::vector<RGYSegmentPacket>&& packets, rgy_rational<int> timebase);
+    virtual ~RGYSegmentReaderMemory() {};
+    virtual RGY_ERR read(RGYSegmentPacket *pkt) override;
+    virtual rgy_rational<int> timebase() const override { return m_timebase; }
+protected:
+    std::vector<RGYSegmentPacket> m_packets;
+    rgy_rational<int> m_timebase;
+    size_t m_next;
+};
+
+#if ENABLE_AVSW_READER
+//avformatで映像のパケットのみを読み込み、入力の映像フレームの一覧を作成する (デコードは行わない)
+//videoTrack, videoStreamIdは--video-track, --video-streamidと同じ (0なら最初の映像)
+RGY_ERR rgy_segment_scan(RGYSegmentSourceInfo *info, const tstring& filename, const TCHAR *inputFormat, int videoTrack, int videoStreamId, std::shared_ptr<RGYLog> log);
+
+//区間ごとに出力したファイルを読み込む
+class RGYSegmentReaderAvformat : public RGYSegmentReader {
+public:
+    RGYSegmentReaderAvformat();
+    virtual ~RGYSegmentReaderAvformat();
+    RGY_ERR open(const tstring& filename);
+    void close();
+    virtual RGY_ERR read(RGYSegmentPacket *pkt) override;
+    virtual rgy_rational<int> timebase() const override;
+    const AVStream *stream() const { return m_stream; }
+protected:
+    AVFormatContext *m_formatCtx;
+    AVStream *m_stream;
+};
+#endif //#if ENABLE_AVSW_READER
+
+//各区間の出力を連結する
+//区間ごとにbegin() → add() (アクセスユニットごと) → end()の順に呼び出す
+//区間の先頭がキーフレームであることを確認し、
+//各区間のptsを直前の区間の終端に続くように変換する (timebaseは最初の区間のもの)
+class RGYSegmentConcat {
+public:
+    RGYSegmentConcat();
+    ~RGYSegmentConcat() {};
+    //expectedFrames > 0なら、end()で区間のフレーム数を確認する
+    RGY_ERR begin(const RGYSegment& segment, rgy_rational<int> timebase, int expectedFrames);
+    //pkt->pts, durationを結合後のtimebaseに変換する
+    RGY_ERR add(RGYSegmentPacket *pkt);
+    RGY_ERR end();
+
+    rgy_rational<int> timebase() const { return m_timebase; }
+    int64_t frames() const { return m_totalFrames; }
+    const tstring& message() const { return m_message; }
+protected:
+    RGY_ERR error(RGY_ERR err, const tstring& message);
+
+    rgy_rational<int> m_timebase;   //結合後のtimebase
+    rgy_rational<int> m_segTimebase; //現在の区間のtimebase
+    int m_segIndex;
+    int m_segExpectedFrames;
+    int m_segFrames;
+    int64_t m_segFirstPts;   //現在の区間の先頭のpts (区間のtimebase)
+    int64_t m_segLastPts;    //現在の区間の最後に表示されるフレームのpts (区間のtimebase)
+    int64_t m_segLastDuration;
+    std::vector<int64_t> m_segPts; //最後のフレームのdurationが不明な場合に、フレームの間隔を求めるのに使用する
+    int64_t m_lastInterval;  //直前の区間のフレームの間隔 (結合後のtimebase)
+    int64_t m_offset;        //現在の区間の先頭の、結合後のpts
+    int64_t m_totalFrames;
+    bool m_inSegment;
+    tstring m_message;
+};
+
+//区間の分割/並列実行/結合を、可変フレームレートかつキーフレームの間隔が不規則な疑似的な入力と
+//疑似的なエンコーダの出力で実行し、所要時間と結果の検証をCSVで出力する
+int segment_encode_bench(FILE *fp);
+
+#endif //__RGY_SEGMENT_H__
@@ -0,0 +1,665 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <climits>
+#include <new>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <fcntl.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif //#if defined(_WIN32) || defined(_WIN64)
+#include "rgy_shared_mem.h"
+#include "rgy_input.h"
+
+static const uint64_t RGY_SM_RING_MAP_ALIGN = 4096;
+
+static uint32_t rgy_sm_current_pid() {
+#if defined(_WIN32) || defined(_WIN64)
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+//pid == 0 (まだ相手が接続していない) の場合も生きているものとして扱う
+static bool rgy_sm_process_alive(uint32_t pid) {
+    if (pid == 0) {
+        return true;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (hProcess == NULL) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    const bool alive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+    CloseHandle(hProcess);
+    return alive;
+#else
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+uint64_t rgy_sm_plane_layout(RGY_CSP csp, int width, int height, uint32_t planeOffset[3], uint32_t planePitch[3]) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    const uint32_t pitch = ALIGN(width * ((RGY_CSP_BIT_DEPTH[csp] > 8) ? 2 : 1), RGY_SM_RING_PITCH_ALIGN);
+    uint32_t uvPitch = pitch;
+    int uvHeight = height;
+    int planes = 3;
+    switch (csp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_P010:
+        planes = 2;
+        uvHeight = height >> 1;
+        break;
+    case RGY_CSP_YV12:
+    case RGY_CSP_YV12_09:
+    case RGY_CSP_YV12_10:
+    case RGY_CSP_YV12_12:
+    case RGY_CSP_YV12_14:
+    case RGY_CSP_YV12_16:
+        uvPitch = pitch >> 1;
+        uvHeight = height >> 1;
+        break;
+    case RGY_CSP_YUV422:
+    case RGY_CSP_YUV422_09:
+    case RGY_CSP_YUV422_10:
+    case RGY_CSP_YUV422_12:
+    case RGY_CSP_YUV422_14:
+    case RGY_CSP_YUV422_16:
+        uvPitch = pitch >> 1;
+        break;
+    case RGY_CSP_YUV444:
+    case RGY_CSP_YUV444_09:
+    case RGY_CSP_YUV444_10:
+    case RGY_CSP_YUV444_12:
+    case RGY_CSP_YUV444_14:
+    case RGY_CSP_YUV444_16:
+        break;
+    default:
+        return 0;
+    }
+    planePitch[0] = pitch;
+    planePitch[1] = uvPitch;
+    planePitch[2] = (planes == 3) ? uvPitch : 0;
+    planeOffset[0] = 0;
+    planeOffset[1] = pitch * height;
+    planeOffset[2] = (planes == 3) ? planeOffset[1] + uvPitch * uvHeight : 0;
+    const uint64_t frameSize = (uint64_t)planeOffset[planes - 1] + (uint64_t)uvPitch * uvHeight;
+    return ALIGN(frameSize, RGY_SM_RING_MAP_ALIGN);
+}
+
+RGYSharedMemRing::RGYSharedMemRing() :
+    m_producer(false),
+    m_header(nullptr),
+    m_mapSize(0),
+    m_name(),
+#if defined(_WIN32) || defined(_WIN64)
+    m_hMap(NULL),
+    m_heProduced(NULL),
+    m_heConsumed(NULL) {
+#else
+    m_fd(-1) {
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+RGYSharedMemRing::~RGYSharedMemRing() {
+    close();
+}
+
+RGY_ERR RGYSharedMemRing::map(const TCHAR *name, uint64_t size, bool create) {
+#if defined(_WIN32) || defined(_WIN64)
+    m_name = name;
+    if (create) {
+        m_hMap = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, m_name.c_str());
+        if (m_hMap != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+            return RGY_ERR_ALREADY_INITIALIZED;
+        }
+        m_heProduced = CreateEvent(NULL, FALSE, FALSE, (m_name + _T("_produced")).c_str());
+        m_heConsumed = CreateEvent(NULL, FALSE, FALSE, (m_name + _T("_consumed")).c_str());
+    } else {
+        m_hMap = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, m_name.c_str());
+        m_heProduced = OpenEvent(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, (m_name + _T("_produced")).c_str());
+        m_heConsumed = OpenEvent(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, (m_name + _T("_consumed")).c_str());
+    }
+    if (m_hMap == NULL || m_heProduced == NULL || m_heConsumed == NULL) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_header = (RGYSMRingHeader *)MapViewOfFile(m_hMap, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (m_header == nullptr) {
+        return RGY_ERR_MAP_FAILED;
+    }
+    MEMORY_BASIC_INFORMATION info = { 0 };
+    if (VirtualQuery(m_header, &info, sizeof(info)) == 0) {
+        return RGY_ERR_MAP_FAILED;
+    }
+    m_mapSize = info.RegionSize;
+#else
+    //POSIXの共有メモリ名は'/'から始める必要がある
+    m_name = (name[0] == '/') ? tstring(name) : tstring(_T("/")) + name;
+    m_fd = (create) ? shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) : shm_open(m_name.c_str(), O_RDWR, 0);
+    if (m_fd < 0) {
+        return (create && errno == EEXIST) ? RGY_ERR_ALREADY_INITIALIZED : RGY_ERR_FILE_OPEN;
+    }
+    if (create) {
+        if (ftruncate(m_fd, (off_t)size) != 0) {
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+    } else {
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            return RGY_ERR_FILE_OPEN;
+        }
+        size = (uint64_t)st.st_size;
+    }
+    if (size < sizeof(RGYSMRingHeader)) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    void *ptr = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (ptr == MAP_FAILED) {
+        return RGY_ERR_MAP_FAILED;
+    }
+    m_header = (RGYSMRingHeader *)ptr;
+    m_mapSize = size;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYSharedMemRing::create(const TCHAR *name, RGY_CSP csp, int width, int height, int picstruct, int fpsN, int fpsD, int sarW, int sarH, int slots) {
+    close();
+    m_producer = true;
+    uint32_t planeOffset[3], planePitch[3];
+    const uint64_t slotSize = rgy_sm_plane_layout(csp, width, height, planeOffset, planePitch);
+    if (slotSize == 0) {
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
+    if (fpsN <= 0 || fpsD <= 0) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    slots = clamp(slots, 1, RGY_SM_RING_SLOTS_MAX);
+    const uint64_t slotOffset = ALIGN((uint64_t)sizeof(RGYSMRingHeader), RGY_SM_RING_MAP_ALIGN);
+    auto sts = map(name, slotOffset + slotSize * slots, true);
+    if (sts != RGY_ERR_NONE) {
+        close();
+        return sts;
+    }
+    //共有メモリ上にヘッダを構築する (値初期化によりatomicも含めてすべて0となる)
+    m_header = new (m_header) RGYSMRingHeader();
+    m_header->version = RGY_SM_RING_VERSION;
+    m_header->headerSize = sizeof(RGYSMRingHeader);
+    m_header->slotCount = slots;
+    m_header->slotOffset = slotOffset;
+    m_header->slotSize = slotSize;
+    m_header->width = width;
+    m_header->height = height;
+    m_header->csp = csp;
+    m_header->picstruct = picstruct;
+    m_header->fpsN = fpsN;
+    m_header->fpsD = fpsD;
+    m_header->sar[0] = sarW;
+    m_header->sar[1] = sarH;
+    memcpy(m_header->planeOffset, planeOffset, sizeof(planeOffset));
+    memcpy(m_header->planePitch, planePitch, sizeof(planePitch));
+    m_header->producerPid = rgy_sm_current_pid();
+    m_header->consumerPid = 0;
+    m_header->produced.store(0);
+    m_header->producedSeq.store(0);
+    m_header->consumed.store(0);
+    m_header->consumedSeq.store(0);
+    m_header->state.store(RGY_SM_STATE_RUNNING);
+    //magicは最後に書き込み、consumerが初期化途中のヘッダを読まないようにする
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = RGY_SM_RING_MAGIC;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYSharedMemRing::open(const TCHAR *name) {
+    close();
+    m_producer = false;
+    auto sts = map(name, 0, false);
+    if (sts != RGY_ERR_NONE) {
+        close();
+        return sts;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_header->magic != RGY_SM_RING_MAGIC) {
+        close();
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    if (m_header->version != RGY_SM_RING_VERSION || m_header->headerSize != sizeof(RGYSMRingHeader)) {
+        close();
+        return RGY_ERR_INVALID_VERSION;
+    }
+    uint32_t planeOffset[3], planePitch[3];
+    const uint64_t slotSize = rgy_sm_plane_layout((RGY_CSP)m_header->csp, m_header->width, m_header->height, planeOffset, planePitch);
+    if (slotSize == 0
+        || m_header->slotCount == 0 || m_header->slotCount > RGY_SM_RING_SLOTS_MAX
+        || m_header->slotSize < slotSize
+        || m_header->slotOffset + m_header->slotSize * m_header->slotCount > m_mapSize) {
+        close();
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    m_header->consumerPid = rgy_sm_current_pid();
+    return RGY_ERR_NONE;
+}
+
+void RGYSharedMemRing::close() {
+    if (m_header) {
+        if (m_producer) {
+            finish();
+            //consumerが接続済みなら、残りのフレームが読み込まれるまで待つ
+            for (;;) {
+                const uint32_t seq = m_header->consumedSeq.load(std::memory_order_acquire);
+                if (m_header->consumerPid == 0
+                    || m_header->consumed.load(std::memory_order_acquire) == m_header->produced.load(std::memory_order_acquire)
+                    || m_header->state.load(std::memory_order_acquire) == RGY_SM_STATE_ABORT) {
+                    break;
+                }
+                if (!waitSeq(&m_header->consumedSeq, seq) && !rgy_sm_process_alive(m_header->consumerPid)) {
+                    break;
+                }
+            }
+        } else if (m_header->consumerPid == rgy_sm_current_pid()
+            && m_header->state.load(std::memory_order_acquire) == RGY_SM_STATE_RUNNING) {
+            //producerが書き込み中にconsumerが終了する場合は、producerに中断を通知する
+            //(ヘッダの確認に失敗し、接続していない場合は何もしない)
+            setState(RGY_SM_STATE_ABORT);
+        }
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(m_header);
+#else
+        munmap(m_header, (size_t)m_mapSize);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        m_header = nullptr;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_hMap) {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+    }
+    if (m_heProduced) {
+        CloseHandle(m_heProduced);
+        m_heProduced = NULL;
+    }
+    if (m_heConsumed) {
+        CloseHandle(m_heConsumed);
+        m_heConsumed = NULL;
+    }
+#else
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        //consumerはすでにマップしているので、producerが名前を削除しても読み込みは継続できる
+        if (m_producer) {
+            shm_unlink(m_name.c_str());
+        }
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapSize = 0;
+    m_name.clear();
+}
+
+uint8_t *RGYSharedMemRing::slotPtr(uint32_t index) const {
+    return (uint8_t *)m_header + m_header->slotOffset + m_header->slotSize * (index % m_header->slotCount);
+}
+
+void RGYSharedMemRing::setPlanes(uint32_t index, uint8_t *planes[3]) const {
+    uint8_t *ptr = slotPtr(index);
+    for (int i = 0; i < 3; i++) {
+        planes[i] = (m_header->planePitch[i]) ? ptr + m_header->planeOffset[i] : nullptr;
+    }
+}
+
+bool RGYSharedMemRing::waitSeq(std::atomic<uint32_t> *seq, uint32_t expected) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (seq->load(std::memory_order_acquire) != expected) {
+        return true;
+    }
+    return WaitForSingleObject(seqEvent(seq), RGY_SM_RING_WAIT_CHECK_MS) == WAIT_OBJECT_0;
+#else
+    //プロセス間で共有するため、FUTEX_PRIVATE_FLAGは使用しない
+    struct timespec timeout;
+    timeout.tv_sec = RGY_SM_RING_WAIT_CHECK_MS / 1000;
+    timeout.tv_nsec = (RGY_SM_RING_WAIT_CHECK_MS % 1000) * 1000000;
+    const long ret = syscall(SYS_futex, (uint32_t *)seq, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    return !(ret < 0 && errno == ETIMEDOUT);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+void RGYSharedMemRing::notifySeq(std::atomic<uint32_t> *seq) {
+    seq->fetch_add(1, std::memory_order_acq_rel);
+#if defined(_WIN32) || defined(_WIN64)
+    SetEvent(seqEvent(seq));
+#else
+    syscall(SYS_futex, (uint32_t *)seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+void RGYSharedMemRing::setState(RGYSMRingState state) {
+    uint32_t expected = RGY_SM_STATE_RUNNING;
+    if (m_header->state.compare_exchange_strong(expected, state)) {
+        if (m_producer) {
+            notifySeq(&m_header->producedSeq);
+        } else {
+            notifySeq(&m_header->consumedSeq);
+        }
+    }
+}
+
+RGY_ERR RGYSharedMemRing::acquireSlot(uint8_t *planes[3]) {
+    if (m_header == nullptr || !m_producer) {
+        return RGY_ERR_NOT_INITIALIZED;
+    }
+    const uint32_t produced = m_header->produced.load(std::memory_order_relaxed);
+    for (;;) {
+        const uint32_t seq = m_header->consumedSeq.load(std::memory_order_acquire);
+        if (m_header->state.load(std::memory_order_acquire) != RGY_SM_STATE_RUNNING) {
+            return RGY_ERR_ABORTED;
+        }
+        if (produced - m_header->consumed.load(std::memory_order_acquire) < m_header->slotCount) {
+            setPlanes(produced, planes);
+            return RGY_ERR_NONE;
+        }
+        if (!waitSeq(&m_header->consumedSeq, seq) && !rgy_sm_process_alive(m_header->consumerPid)) {
+            setState(RGY_SM_STATE_ABORT);
+            return RGY_ERR_ABORTED;
+        }
+    }
+}
+
+RGY_ERR RGYSharedMemRing::commitSlot(int64_t timestamp, int64_t duration, int picstruct) {
+    if (m_header == nullptr || !m_producer) {
+        return RGY_ERR_NOT_INITIALIZED;
+    }
+    const uint32_t produced = m_header->produced.load(std::memory_order_relaxed);
+    auto& info = m_header->slot[produced % m_header->slotCount];
+    info.timestamp = timestamp;
+    info.duration = duration;
+    info.picstruct = (uint32_t)picstruct;
+    m_header->produced.store(produced + 1, std::memory_order_release);
+    notifySeq(&m_header->producedSeq);
+    return RGY_ERR_NONE;
+}
+
+void RGYSharedMemRing::finish() {
+    if (m_header && m_producer) {
+        setState(RGY_SM_STATE_EOF);
+    }
+}
+
+RGY_ERR RGYSharedMemRing::waitFrame(const uint8_t *planes[3], RGYSMRingSlotInfo *info) {
+    if (m_header == nullptr || m_producer) {
+        return RGY_ERR_NOT_INITIALIZED;
+    }
+    const uint32_t consumed = m_header->consumed.load(std::memory_order_relaxed);
+    for (;;) {
+        const uint32_t seq = m_header->producedSeq.load(std::memory_order_acquire);
+        if (m_header->produced.load(std::memory_order_acquire) != consumed) {
+            setPlanes(consumed, (uint8_t **)planes);
+            *info = m_header->slot[consumed % m_header->slotCount];
+            return RGY_ERR_NONE;
+        }
+        const auto state = m_header->state.load(std::memory_order_acquire);
+        if (state == RGY_SM_STATE_EOF) {
+            //EOFは最後のフレームの書き込み後に設定されるので、再度確認してから終了する
+            if (m_header->produced.load(std::memory_order_acquire) != consumed) {
+                continue;
+            }
+            return RGY_ERR_MORE_DATA;
+        } else if (state == RGY_SM_STATE_ABORT) {
+            return RGY_ERR_ABORTED;
+        }
+        if (!waitSeq(&m_header->producedSeq, seq) && !rgy_sm_process_alive(m_header->producerPid)) {
+            return RGY_ERR_ABORTED;
+        }
+    }
+}
+
+void RGYSharedMemRing::releaseFrame() {
+    if (m_header && !m_producer) {
+        m_header->consumed.fetch_add(1, std::memory_order_release);
+        notifySeq(&m_header->consumedSeq);
+    }
+}
+
+static const int SM_BENCH_WIDTH = 1920;
+static const int SM_BENCH_HEIGHT = 1080;
+static const int SM_BENCH_FRAMES = 600;
+static const size_t SM_BENCH_PIPE_BUF = 64 * 1024;
+
+//ベンチマーク用のYV12フレーム (ピッチ = 幅の連続した領域)
+struct SMBenchSource {
+    std::vector<uint8_t> buf;
+    const uint8_t *plane[3];
+    int pitch[3];
+    int height[3];
+
+    SMBenchSource() : buf(SM_BENCH_WIDTH * SM_BENCH_HEIGHT * 3 / 2) {
+        uint32_t seed = 1;
+        for (auto& v : buf) {
+            seed = seed * 1664525u + 1013904223u;
+            v = (uint8_t)(seed >> 24);
+        }
+        plane[0] = buf.data();
+        plane[1] = plane[0] + SM_BENCH_WIDTH * SM_BENCH_HEIGHT;
+        plane[2] = plane[1] + SM_BENCH_WIDTH * SM_BENCH_HEIGHT / 4;
+        pitch[0] = SM_BENCH_WIDTH;
+        pitch[1] = pitch[2] = SM_BENCH_WIDTH / 2;
+        height[0] = SM_BENCH_HEIGHT;
+        height[1] = height[2] = SM_BENCH_HEIGHT / 2;
+    }
+    //フレームの描画に相当する処理として、各面をdstにコピーする
+    void render(uint8_t *dst[3], const uint32_t dstPitch[3]) const {
+        for (int i = 0; i < 3; i++) {
+            for (int y = 0; y < height[i]; y++) {
+                memcpy(dst[i] + (size_t)dstPitch[i] * y, plane[i] + (size_t)pitch[i] * y, pitch[i]);
+            }
+        }
+    }
+};
+
+//producerの書き込むフレーム情報
+//VFRとなるようdurationを変化させ、picstructにはヘッダの設定に従うRGY_PICSTRUCT_UNKNOWNを含める
+static RGYSMRingSlotInfo sm_bench_slot_info(int i) {
+    static const RGY_PICSTRUCT picstruct[] = { RGY_PICSTRUCT_FRAME, RGY_PICSTRUCT_FRAME_TFF, RGY_PICSTRUCT_UNKNOWN, RGY_PICSTRUCT_FRAME_BFF };
+    RGYSMRingSlotInfo info = { 0 };
+    info.timestamp = (i / 3) * 4 + (i % 3);
+    info.duration = (i % 3 == 2) ? 2 : 1;
+    info.picstruct = picstruct[i % _countof(picstruct)];
+    return info;
+}
+
+//受け取り側の変換先 (NV12)
+struct SMBenchDst {
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> buf;
+    int pitch;
+    SMBenchDst() : buf((uint8_t *)_aligned_malloc(ALIGN(SM_BENCH_WIDTH, 64) * SM_BENCH_HEIGHT * 3 / 2, 64), aligned_malloc_deleter()), pitch(ALIGN(SM_BENCH_WIDTH, 64)) {};
+    void ptrArray(void *dst[3]) {
+        dst[0] = buf.get();
+        dst[1] = buf.get() + pitch * SM_BENCH_HEIGHT;
+        dst[2] = nullptr;
+    }
+    bool equals(const SMBenchDst& b) const {
+        return memcmp(buf.get(), b.buf.get(), pitch * SM_BENCH_HEIGHT * 3 / 2) == 0;
+    }
+};
+
+//現在のAviutlのプラグインと同様に、パイプに64KB単位で書き込み、freadで1フレームずつ読み込んでから変換する
+static int shared_mem_bench_pipe(RGYConvertCSP *convert, const SMBenchSource& src, SMBenchDst *dst, double *elapsed_sec) {
+    int fds[2];
+#if defined(_WIN32) || defined(_WIN64)
+    if (_pipe(fds, (unsigned int)SM_BENCH_PIPE_BUF, _O_BINARY) != 0) {
+        return -1;
+    }
+    FILE *fw = _fdopen(fds[1], "wb");
+    FILE *fr = _fdopen(fds[0], "rb");
+#else
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    FILE *fw = fdopen(fds[1], "wb");
+    FILE *fr = fdopen(fds[0], "rb");
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    if (fw == nullptr || fr == nullptr) {
+        return -1;
+    }
+    setvbuf(fw, nullptr, _IOFBF, SM_BENCH_PIPE_BUF);
+
+    const size_t frameSize = src.buf.size();
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::thread producer([&]() {
+        std::vector<uint8_t> frame(frameSize);
+        uint8_t *planes[3] = { frame.data(), frame.data() + (src.plane[1] - src.plane[0]), frame.data() + (src.plane[2] - src.plane[0]) };
+        const uint32_t pitch[3] = { (uint32_t)src.pitch[0], (uint32_t)src.pitch[1], (uint32_t)src.pitch[2] };
+        for (int i = 0; i < SM_BENCH_FRAMES; i++) {
+            src.render(planes, pitch);
+            if (fwrite(frame.data(), 1, frameSize, fw) != frameSize) {
+                break;
+            }
+        }
+        fclose(fw);
+    });
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> readBuf((uint8_t *)_aligned_malloc(frameSize, 64), aligned_malloc_deleter());
+    int frames = 0;
+    int crop[4] = { 0 };
+    void *dst_array[3];
+    dst->ptrArray(dst_array);
+    while (fread(readBuf.get(), 1, frameSize, fr) == frameSize) {
+        const void *src_array[3] = { readBuf.get(), readBuf.get() + (src.plane[1] - src.plane[0]), readBuf.get() + (src.plane[2] - src.plane[0]) };
+        convert->run(0, dst_array, src_array, SM_BENCH_WIDTH, src.pitch[0], src.pitch[1], dst->pitch, SM_BENCH_HEIGHT, SM_BENCH_HEIGHT, crop);
+        frames++;
+    }
+    producer.join();
+    *elapsed_sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    fclose(fr);
+    return frames;
+}
+
+//producerはスロットに直接描画し、consumerはスロットから直接変換する
+//あわせて、各フレームのtimestamp, duration, picstructがsmリーダーと同じ方法で受け取れているかを確認する
+static int shared_mem_bench_ring(RGYConvertCSP *convert, const SMBenchSource& src, SMBenchDst *dst, int slots, double *elapsed_sec, bool *frameInfoOK) {
+    const tstring name = strsprintf(_T("rgy_sm_bench_%u"), rgy_sm_current_pid());
+    RGYSharedMemRing ringProducer;
+    const auto picstructStream = RGY_PICSTRUCT_FRAME_TFF;
+    if (ringProducer.create(name.c_str(), RGY_CSP_YV12, SM_BENCH_WIDTH, SM_BENCH_HEIGHT, picstructStream, 30, 1, 1, 1, slots) != RGY_ERR_NONE) {
+        return -1;
+    }
+    RGYSharedMemRing ringConsumer;
+    if (ringConsumer.open(name.c_str()) != RGY_ERR_NONE) {
+        return -1;
+    }
+    const auto header = ringConsumer.header();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::thread producer([&]() {
+        for (int i = 0; i < SM_BENCH_FRAMES; i++) {
+            uint8_t *planes[3];
+            if (ringProducer.acquireSlot(planes) != RGY_ERR_NONE) {
+                break;
+            }
+            src.render(planes, ringProducer.header()->planePitch);
+            const auto slotInfo = sm_bench_slot_info(i);
+            ringProducer.commitSlot(slotInfo.timestamp, slotInfo.duration, (int)slotInfo.picstruct);
+        }
+        ringProducer.finish();
+    });
+    int frames = 0;
+    int crop[4] = { 0 };
+    void *dst_array[3];
+    dst->ptrArray(dst_array);
+    const uint8_t *planes[3];
+    RGYSMRingSlotInfo info;
+    *frameInfoOK = true;
+    while (ringConsumer.waitFrame(planes, &info) == RGY_ERR_NONE) {
+        convert->run(0, dst_array, (const void **)planes, SM_BENCH_WIDTH, header->planePitch[0], header->planePitch[1], dst->pitch, SM_BENCH_HEIGHT, SM_BENCH_HEIGHT, crop);
+        const auto expected = sm_bench_slot_info(frames);
+        const auto expectedPicstruct = (expected.picstruct != RGY_PICSTRUCT_UNKNOWN) ? (RGY_PICSTRUCT)expected.picstruct : picstructStream;
+        if (info.timestamp != expected.timestamp
+            || info.duration != expected.duration
+            || rgy_sm_slot_picstruct(info, (RGY_PICSTRUCT)header->picstruct) != expectedPicstruct) {
+            *frameInfoOK = false;
+        }
+        ringConsumer.releaseFrame();
+        frames++;
+    }
+    producer.join();
+    *elapsed_sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    ringConsumer.close();
+    ringProducer.close();
+    return frames;
+}
+
+int shared_mem_bench(FILE *fp, int slots) {
+    if (slots <= 0) {
+        slots = RGY_SM_RING_SLOTS_DEFAULT;
+    }
+    const SMBenchSource src;
+    SMBenchDst dstPipe, dstRing;
+    RGYConvertCSP convert;
+    if (convert.getFunc(RGY_CSP_YV12, RGY_CSP_NV12, false, (uint32_t)-1) == nullptr) {
+        return 1;
+    }
+    const double bytesPerFrame = (double)src.buf.size();
+
+    _ftprintf(fp, _T("path,width,height,csp,slots,frames,fps,GB/s,speedup,verify\n"));
+    double elapsedPipe = 0.0;
+    const int framesPipe = shared_mem_bench_pipe(&convert, src, &dstPipe, &elapsedPipe);
+    if (framesPipe != SM_BENCH_FRAMES) {
+        _ftprintf(stderr, _T("failed to run pipe benchmark.\n"));
+        return 1;
+    }
+    const double fpsPipe = framesPipe / elapsedPipe;
+    _ftprintf(fp, _T("pipe,%d,%d,%s,-,%d,%.2f,%.3f,%.3f,ref\n"),
+        SM_BENCH_WIDTH, SM_BENCH_HEIGHT, RGY_CSP_NAMES[RGY_CSP_YV12], framesPipe, fpsPipe, fpsPipe * bytesPerFrame * 1e-9, 1.0);
+    fflush(fp);
+
+    double elapsedRing = 0.0;
+    bool frameInfoOK = false;
+    const int framesRing = shared_mem_bench_ring(&convert, src, &dstRing, slots, &elapsedRing, &frameInfoOK);
+    if (framesRing != SM_BENCH_FRAMES) {
+        _ftprintf(stderr, _T("failed to run shared memory benchmark.\n"));
+        return 1;
+    }
+    const double fpsRing = framesRing / elapsedRing;
+    const bool ok = dstRing.equals(dstPipe) && frameInfoOK;
+    _ftprintf(fp, _T("shared_mem,%d,%d,%s,%d,%d,%.2f,%.3f,%.3f,%s\n"),
+        SM_BENCH_WIDTH, SM_BENCH_HEIGHT, RGY_CSP_NAMES[RGY_CSP_YV12], slots, framesRing, fpsRing, fpsRing * bytesPerFrame * 1e-9, fpsRing / fpsPipe, (ok) ? _T("OK") : _T("NG"));
+    fflush(fp);
+    return (ok) ? 0 : 1;
+}
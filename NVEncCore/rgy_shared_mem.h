@@ -0,0 +1,169 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_SHARED_MEM_H__
+#define __RGY_SHARED_MEM_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+
+//フレームサーバー(producer)からエンコーダ(consumer)へ、共有メモリ上のリングでフレームを受け渡す
+//
+//共有メモリの先頭にRGYSMRingHeaderを置き、その後ろにslotCount個のフレームスロットが並ぶ
+//producerはスロットに直接各面を書き込んでproducedを進め、consumerはスロットから直接色変換してconsumedを進める
+//待機はLinuxではfutex、Windowsでは名前付きイベントで行い、パイプのようなカーネル経由のコピーは発生しない
+//
+//32bitのproducer (Aviutlのプラグインなど) と64bitのconsumerで同じ配置になるよう、固定長の型のみを使用する
+
+static const uint32_t RGY_SM_RING_MAGIC = 0x47534752; //'RGSG'
+static const uint32_t RGY_SM_RING_VERSION = 1;
+static const int RGY_SM_RING_SLOTS_DEFAULT = 4;
+static const int RGY_SM_RING_SLOTS_MAX = 32;
+static const int RGY_SM_RING_PITCH_ALIGN = 64;
+static const uint32_t RGY_SM_RING_WAIT_CHECK_MS = 1000; //この間隔で相手のプロセスが生きているか確認する
+
+enum RGYSMRingState : uint32_t {
+    RGY_SM_STATE_RUNNING = 0,
+    RGY_SM_STATE_EOF,         //producerがすべてのフレームを書き込んだ
+    RGY_SM_STATE_ABORT,       //どちらかが中断した
+};
+
+//スロットごとのフレーム情報
+struct RGYSMRingSlotInfo {
+    int64_t timestamp;        //ヘッダのfpsの逆数 (fpsD/fpsN) 単位
+    int64_t duration;         //ヘッダのfpsの逆数 (fpsD/fpsN) 単位
+    uint32_t picstruct;       //RGY_PICSTRUCT_xxx (RGY_PICSTRUCT_UNKNOWNならヘッダのpicstructに従う)
+    uint32_t reserved;
+};
+
+struct RGYSMRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t slotCount;
+    uint64_t slotOffset;      //共有メモリの先頭から最初のスロットまでのオフセット
+    uint64_t slotSize;        //スロット1つ分のサイズ
+    int32_t  width;
+    int32_t  height;
+    int32_t  csp;             //RGY_CSP
+    int32_t  picstruct;       //RGY_PICSTRUCT_xxx
+    int32_t  fpsN;
+    int32_t  fpsD;
+    int32_t  sar[2];
+    uint32_t planeOffset[3];  //スロットの先頭から各面までのオフセット
+    uint32_t planePitch[3];   //各面のピッチ (byte)
+    uint32_t producerPid;
+    uint32_t consumerPid;
+
+    //producerが書き込む
+    alignas(64) std::atomic<uint32_t> produced;    //書き込みが完了したフレーム数
+    std::atomic<uint32_t> producedSeq;             //producer側の通知のたびに増える (futexの待機用)
+    //consumerが書き込む
+    alignas(64) std::atomic<uint32_t> consumed;    //変換が完了し、返却されたフレーム数
+    std::atomic<uint32_t> consumedSeq;             //consumer側の通知のたびに増える (futexの待機用)
+    alignas(64) std::atomic<uint32_t> state;       //RGYSMRingState
+
+    alignas(64) RGYSMRingSlotInfo slot[RGY_SM_RING_SLOTS_MAX];
+};
+static_assert(sizeof(RGYSMRingHeader) == 1088, "RGYSMRingHeader layout must be identical for 32bit and 64bit.");
+
+//スロットのpicstructを返す (フレームごとの指定がなければ、ストリーム全体の設定に従う)
+static inline RGY_PICSTRUCT rgy_sm_slot_picstruct(const RGYSMRingSlotInfo& info, RGY_PICSTRUCT picstructStream) {
+    return (info.picstruct != RGY_PICSTRUCT_UNKNOWN) ? (RGY_PICSTRUCT)info.picstruct : picstructStream;
+}
+
+//共有メモリで使用可能な色空間かどうかと、各面の配置を計算する
+//戻り値: スロット1つ分のサイズ (対応しない色空間なら0)
+uint64_t rgy_sm_plane_layout(RGY_CSP csp, int width, int height, uint32_t planeOffset[3], uint32_t planePitch[3]);
+
+class RGYSharedMemRing {
+public:
+    RGYSharedMemRing();
+    ~RGYSharedMemRing();
+
+    //producer: 共有メモリを作成し、フォーマットを書き込む
+    RGY_ERR create(const TCHAR *name, RGY_CSP csp, int width, int height, int picstruct, int fpsN, int fpsD, int sarW, int sarH, int slots);
+    //consumer: producerの作成した共有メモリを開く
+    RGY_ERR open(const TCHAR *name);
+    //producerは終了を、consumerは中断を通知したのち、共有メモリを閉じる
+    void close();
+
+    const RGYSMRingHeader *header() const { return m_header; }
+
+    //producer: 空いたスロットを取得する (空きがなければ待機する)
+    //consumerが中断/終了した場合はRGY_ERR_ABORTEDを返す
+    RGY_ERR acquireSlot(uint8_t *planes[3]);
+    //producer: acquireSlotで取得したスロットの書き込み完了を通知する
+    RGY_ERR commitSlot(int64_t timestamp, int64_t duration, int picstruct);
+    //producer: すべてのフレームを書き込んだことを通知する
+    void finish();
+
+    //consumer: 書き込み済みのフレームを取得する (なければ待機する)
+    //producerが終了した場合はRGY_ERR_MORE_DATA、中断/異常終了した場合はRGY_ERR_ABORTEDを返す
+    RGY_ERR waitFrame(const uint8_t *planes[3], RGYSMRingSlotInfo *info);
+    //consumer: waitFrameで取得したフレームを返却する
+    void releaseFrame();
+
+protected:
+    RGY_ERR map(const TCHAR *name, uint64_t size, bool create);
+    uint8_t *slotPtr(uint32_t index) const;
+    void setPlanes(uint32_t index, uint8_t *planes[3]) const;
+    //seqが変化するまで最大RGY_SM_RING_WAIT_CHECK_MS待機する (タイムアウトならfalse)
+    bool waitSeq(std::atomic<uint32_t> *seq, uint32_t expected);
+    void notifySeq(std::atomic<uint32_t> *seq);
+    void setState(RGYSMRingState state);
+#if defined(_WIN32) || defined(_WIN64)
+    //seqに対応する通知用のイベントを返す
+    HANDLE seqEvent(const std::atomic<uint32_t> *seq) const {
+        return (seq == &m_header->producedSeq) ? m_heProduced : m_heConsumed;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    bool m_producer;
+    RGYSMRingHeader *m_header;
+    uint64_t m_mapSize;
+    tstring m_name;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_hMap;
+    HANDLE m_heProduced;      //producerからの通知
+    HANDLE m_heConsumed;      //consumerからの通知
+#else
+    int m_fd;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+};
+
+//1080pのフレームを、パイプ(64KB単位の書き込み)と共有メモリのリングでそれぞれ受け渡し、
+//受け取り側の色変換までを含めた速度を計測してCSVで出力する
+int shared_mem_bench(FILE *fp, int slots);
+
+#endif //__RGY_SHARED_MEM_H__
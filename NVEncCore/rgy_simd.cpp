@@ -55,5 +55,14 @@ unsigned int get_availableSIMD() {
     __cpuid(CPUInfo, 7);
     if ((simd & AVX) && (CPUInfo[1] & 0x00000020))
         simd |= AVX2;
+    //opmask, ZMM_Hi256, Hi16_ZMMの状態がOSにより保存されるか確認する
+    if ((simd & AVX) && (xgetbv & 0xE0) == 0xE0) {
+        if (CPUInfo[1] & 0x00010000) simd |= AVX512F;
+        if (simd & AVX512F) {
+            if (CPUInfo[1] & 0x00020000) simd |= AVX512DQ;
+            if (CPUInfo[1] & 0x40000000) simd |= AVX512BW;
+            if (CPUInfo[1] & 0x80000000) simd |= AVX512VL;
+        }
+    }
     return simd;
 }
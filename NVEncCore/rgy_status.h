@@ -40,6 +40,7 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
 #include "rgy_log.h"
 #include "cpu_info.h"
 #include "rgy_err.h"
@@ -76,6 +77,7 @@ typedef struct EncodeStatusData {
     uint32_t frameOutBQPSum;   //出力したBフレームの平均QP
     uint32_t frameIn;          //エンコーダに入力したフレーム数 (drop含まず)
     uint32_t frameDrop;        //ドロップしたフレーム数
+    uint64_t inputBytes;       //入力から読み込んだフレームデータのバイト数 (GetEncodeData()で設定される)
     double encodeFps;          //エンコード速度
     double bitrateKbps;        //ビットレート
     double CPUUsagePercent;
@@ -93,6 +95,7 @@ class EncodeStatus {
 public:
     EncodeStatus() {
         memset(&m_sData, 0, sizeof(m_sData));
+        m_inputBytes = 0;
 
         m_tmLastUpdate = std::chrono::system_clock::now();
         m_pause = false;
@@ -385,8 +388,14 @@ public:
 
     }
 #pragma warning(pop)
+    //読み込みスレッドから呼ばれ、性能モニタのスレッドからも参照されるので、m_sDataとは別にatomicで集計する
+    void AddInputBytes(uint64_t bytes) {
+        m_inputBytes += bytes;
+    }
     EncodeStatusData GetEncodeData() {
-        return m_sData;
+        EncodeStatusData data = m_sData;
+        data.inputBytes = m_inputBytes.load();
+        return data;
     }
     EncodeStatusData m_sData;
 protected:
@@ -443,6 +452,7 @@ protected:
     std::chrono::system_clock::time_point m_tmLastUpdate;     //最終更新時刻
     bool m_bStdErrWriteToConsole;
     bool m_bEncStarted;
+    std::atomic<uint64_t> m_inputBytes; //入力から読み込んだフレームデータのバイト数
 };
 
 class CProcSpeedControl {
@@ -54,6 +54,7 @@ typedef char TCHAR;
 #define _tcsdup strdup
 #define _tfopen fopen
 #define _tfopen_s fopen_s
+#define _tremove remove
 #define _stprintf_s sprintf_s
 #define _vsctprintf _vscprintf
 #define _vstprintf_s _vsprintf_s
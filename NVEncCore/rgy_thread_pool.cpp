@@ -0,0 +1,192 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <algorithm>
+#include "rgy_thread_pool.h"
+#include "cpu_info.h"
+
+static std::atomic<RGYThreadPool *> g_thread_pool(nullptr);
+static std::once_flag g_thread_pool_once;
+static std::atomic<int> g_thread_pool_threads(0);
+
+void RGYThreadPool::setThreads(int threads) {
+    g_thread_pool_threads = threads;
+}
+
+RGYThreadPool *RGYThreadPool::get() {
+    std::call_once(g_thread_pool_once, []() {
+        //呼び出し元のスレッドも処理に参加するので、指定数 (指定がなければ物理コア数) -1とする
+        const int requested = g_thread_pool_threads;
+        const int threads = (requested > 0) ? requested - 1 : std::max(1, (int)get_cpu_info().physical_cores - 1);
+        //プロセス終了まで使用するので、あえて解放しない
+        //(DLLとして読み込まれた場合、グローバル変数のデストラクタでスレッドを待機するとデッドロックする)
+        g_thread_pool = new RGYThreadPool(threads);
+    });
+    return g_thread_pool;
+}
+
+int64_t RGYThreadPool::totalActiveTimeUs() {
+    const RGYThreadPool *pool = g_thread_pool;
+    return (pool) ? pool->activeTimeUs() : 0;
+}
+
+RGYThreadPool::RGYThreadPool(int threads) :
+    m_workers(),
+    m_mtx(),
+    m_cv(),
+    m_queued(0),
+    m_next(0),
+    m_abort(false),
+    m_activeTimeUs(0),
+    m_taskCount(0),
+    m_stealCount(0) {
+    for (int i = 0; i < threads; i++) {
+        m_workers.push_back(std::unique_ptr<RGYThreadPoolWorker>(new RGYThreadPoolWorker()));
+    }
+    for (int i = 0; i < threads; i++) {
+        m_workers[i]->thread = std::thread(&RGYThreadPool::workerFunc, this, i);
+    }
+}
+
+RGYThreadPool::~RGYThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_abort = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    m_workers.clear();
+}
+
+bool RGYThreadPool::popTask(RGYThreadPoolTask& task, int self, const RGYThreadPoolJob *job_only) {
+    const int nworkers = (int)m_workers.size();
+    //まず自分のキューの末尾から
+    if (self >= 0) {
+        auto& worker = m_workers[self];
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        if (!worker->queue.empty()) {
+            task = worker->queue.back();
+            worker->queue.pop_back();
+            m_queued--;
+            return true;
+        }
+    }
+    //他のワーカーのキューの先頭から盗む
+    for (int i = 1; i <= nworkers; i++) {
+        const int target = (std::max(self, 0) + i) % nworkers;
+        auto& worker = m_workers[target];
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        if (!worker->queue.empty()
+            && (job_only == nullptr || worker->queue.front().job == job_only)) {
+            task = worker->queue.front();
+            worker->queue.pop_front();
+            m_queued--;
+            if (self >= 0) {
+                m_stealCount++;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void RGYThreadPool::execTask(const RGYThreadPoolTask& task, bool worker) {
+    //プールの使用率には、ワーカースレッドで処理した時間のみを計上する
+    //(呼び出し元スレッドの時間は、そのスレッド自身の使用率として計上される)
+    if (worker) {
+        const auto start = std::chrono::steady_clock::now();
+        (*task.job->func)(task.id);
+        m_activeTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    } else {
+        (*task.job->func)(task.id);
+    }
+    m_taskCount++;
+    //jobは呼び出し元のスタック上にあるので、ロックを解放した後は触らないこと
+    std::lock_guard<std::mutex> lock(task.job->mtx);
+    if (--task.job->remain == 0) {
+        task.job->cv.notify_all();
+    }
+}
+
+void RGYThreadPool::workerFunc(int self) {
+    for (;;) {
+        RGYThreadPoolTask task;
+        if (popTask(task, self, nullptr)) {
+            execTask(task, true);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv.wait(lock, [this]() { return m_abort || m_queued > 0; });
+        if (m_abort) {
+            break;
+        }
+    }
+}
+
+void RGYThreadPool::run(int task_count, const std::function<void(int task_id)>& func) {
+    if (task_count <= 0) {
+        return;
+    }
+    if (task_count == 1 || m_workers.size() == 0) {
+        for (int i = 0; i < task_count; i++) {
+            func(i);
+        }
+        m_taskCount += task_count;
+        return;
+    }
+    RGYThreadPoolJob job;
+    job.func = &func;
+    job.remain = task_count;
+
+    //task_id=0は呼び出し元で処理し、残りをワーカーのキューに順に配布する
+    const int nworkers = (int)m_workers.size();
+    const int start_worker = m_next.fetch_add(1) % nworkers;
+    for (int i = 1; i < task_count; i++) {
+        auto& worker = m_workers[(start_worker + i - 1) % nworkers];
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        worker->queue.push_back({ &job, i });
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_queued += task_count - 1;
+    }
+    m_cv.notify_all();
+
+    execTask({ &job, 0 }, false);
+    //ワーカーが空いていなければ、自分のjobのタスクを引き取って処理する
+    RGYThreadPoolTask task;
+    while (popTask(task, -1, &job)) {
+        execTask(task, false);
+    }
+    std::unique_lock<std::mutex> lock(job.mtx);
+    job.cv.wait(lock, [&job]() { return job.remain == 0; });
+}
@@ -0,0 +1,98 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_THREAD_POOL_H__
+#define __RGY_THREAD_POOL_H__
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+//プロセス全体で共有するwork-stealing型のスレッドプール
+//各ワーカーは自分のキューの末尾からタスクを取り出し、空になったら他のワーカーのキューの先頭から盗む
+class RGYThreadPool {
+public:
+    RGYThreadPool(int threads);
+    ~RGYThreadPool();
+
+    //プロセス全体で共有するスレッドプールを取得する (初回の呼び出しでスレッドを起動する)
+    static RGYThreadPool *get();
+    //共有スレッドプールで処理に参加するスレッド数 (呼び出し元スレッドを含む) を指定する (--thread-csp)
+    //0以下なら物理コア数とする、起動後に呼んだ場合は反映されない
+    static void setThreads(int threads);
+    //共有スレッドプールのワーカースレッドがタスクの処理に使用した時間の累計 (未起動なら0)
+    static int64_t totalActiveTimeUs();
+
+    //func(task_id)をtask_id = 0 ～ task_count-1について実行し、すべて完了するまで待機する
+    //呼び出し元のスレッドもタスクの処理に参加する
+    void run(int task_count, const std::function<void(int task_id)>& func);
+
+    //ワーカースレッド数 (呼び出し元スレッドを含まない)
+    int threadCount() const { return (int)m_workers.size(); };
+    //ワーカースレッドがタスクの処理に使用した時間 (呼び出し元スレッドで処理した分は含まない)
+    int64_t activeTimeUs() const { return m_activeTimeUs; };
+    int64_t taskCount() const { return m_taskCount; };
+    int64_t stealCount() const { return m_stealCount; };
+protected:
+    struct RGYThreadPoolJob {
+        const std::function<void(int)> *func;
+        int remain;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+    struct RGYThreadPoolTask {
+        RGYThreadPoolJob *job;
+        int id;
+    };
+    struct alignas(64) RGYThreadPoolWorker {
+        std::mutex mtx;
+        std::deque<RGYThreadPoolTask> queue;
+        std::thread thread;
+    };
+    void workerFunc(int self);
+    bool popTask(RGYThreadPoolTask& task, int self, const RGYThreadPoolJob *job_only);
+    void execTask(const RGYThreadPoolTask& task, bool worker);
+
+    std::vector<std::unique_ptr<RGYThreadPoolWorker>> m_workers;
+    std::mutex m_mtx;               //m_cvの待機用
+    std::condition_variable m_cv;   //タスクが追加された/終了するときに通知
+    std::atomic<int> m_queued;      //キューに積まれているタスク数
+    std::atomic<int> m_next;        //タスクを配布するワーカーの開始位置
+    bool m_abort;
+    std::atomic<int64_t> m_activeTimeUs;
+    std::atomic<int64_t> m_taskCount;
+    std::atomic<int64_t> m_stealCount;
+};
+
+#endif //__RGY_THREAD_POOL_H__
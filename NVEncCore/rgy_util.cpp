@@ -37,6 +37,10 @@
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <iconv.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 #include "rgy_util.h"
 #include "rgy_tchar.h"
@@ -550,15 +554,12 @@ bool rgy_get_filesize(const char *filepath, uint64_t *filesize) {
 #else //#if defined(_WIN32) || defined(_WIN64)
     struct stat stat;
     FILE *fp = fopen(filepath, "rb");
-    if (fp == NULL || fstat(fileno(fp), &stat)) {
-        *filesize = 0;
-        return 1;
-    }
+    const bool ret = fp != NULL && fstat(fileno(fp), &stat) == 0;
     if (fp) {
         fclose(fp);
     }
-    *filesize = stat.st_size;
-    return 0;
+    *filesize = (ret) ? stat.st_size : 0;
+    return ret;
 #endif //#if defined(_WIN32) || defined(_WIN64)
 }
 
@@ -608,6 +609,100 @@ tstring getExeDir() {
 
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
+tstring getExePath() {
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR exePath[1024];
+    memset(exePath, 0, sizeof(exePath));
+    GetModuleFileName(NULL, exePath, _countof(exePath));
+    return exePath;
+#else
+    char exePath[4096];
+    memset(exePath, 0, sizeof(exePath));
+    if (readlink("/proc/self/exe", exePath, sizeof(exePath) - 1) < 0) {
+        return tstring();
+    }
+    return char_to_tstring(exePath);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+RGYFileMapRead::RGYFileMapRead() : m_ptr(nullptr), m_size(0),
+#if defined(_WIN32) || defined(_WIN64)
+    m_hFile(INVALID_HANDLE_VALUE), m_hMap(NULL)
+#else
+    m_fd(-1)
+#endif //#if defined(_WIN32) || defined(_WIN64)
+{
+}
+
+RGYFileMapRead::~RGYFileMapRead() {
+    close();
+}
+
+RGY_ERR RGYFileMapRead::open(const TCHAR *path) {
+    close();
+#if defined(_WIN32) || defined(_WIN64)
+    m_hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    LARGE_INTEGER size = { 0 };
+    if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart <= 0) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    m_size = (size_t)size.QuadPart;
+    m_hMap = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_hMap == NULL) {
+        return RGY_ERR_MAP_FAILED;
+    }
+    m_ptr = (const uint8_t *)MapViewOfFile(m_hMap, FILE_MAP_READ, 0, 0, 0);
+    if (m_ptr == nullptr) {
+        return RGY_ERR_MAP_FAILED;
+    }
+#else
+    m_fd = ::open(path, O_RDONLY);
+    if (m_fd < 0) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size <= 0) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    m_size = (size_t)st.st_size;
+    void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (ptr == MAP_FAILED) {
+        return RGY_ERR_MAP_FAILED;
+    }
+    m_ptr = (const uint8_t *)ptr;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    return RGY_ERR_NONE;
+}
+
+void RGYFileMapRead::close() {
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_ptr) {
+        UnmapViewOfFile(m_ptr);
+    }
+    if (m_hMap) {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_ptr) {
+        munmap((void *)m_ptr, m_size);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_ptr = nullptr;
+    m_size = 0;
+}
+
 tstring print_time(double time) {
     int sec = (int)time;
     time -= sec;
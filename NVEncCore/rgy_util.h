@@ -31,6 +31,9 @@
 
 #include "rgy_tchar.h"
 #include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #if defined(_WIN32) || defined(_WIN64)
 #include <shlwapi.h>
 #pragma comment(lib, "shlwapi.lib")
@@ -137,6 +140,11 @@ template<typename T, std::size_t N>
 constexpr std::size_t array_size(T(&)[N]) {
     return N;
 }
+//文字列のハッシュ (FNV-1a)、リテラルに対してはコンパイル時に計算できる
+//乗算は64bitで行い、定数式中でのオーバーフローの警告を避ける
+static constexpr uint32_t rgy_str_hash(const TCHAR *str, uint32_t hash = 2166136261u) {
+    return (*str) ? rgy_str_hash(str + 1, (uint32_t)(((uint64_t)(hash ^ (uint32_t)*str) * 16777619u) & 0xffffffffu)) : hash;
+}
 template<typename T>
 void vector_cat(vector<T>& v1, const vector<T>& v2) {
     if (v2.size()) {
@@ -437,6 +445,8 @@ public:
     }
 };
 
+int64_t rational_rescale(int64_t v, rgy_rational<int> from, rgy_rational<int> to);
+
 #if UNICODE
 #define to_tstring to_wstring
 #else
@@ -495,6 +505,8 @@ bool CreateDirectoryRecursive(const WCHAR *dir);
 std::vector<tstring> get_file_list(const tstring& pattern, const tstring& dir);
 tstring getExeDir();
 #endif //#if defined(_WIN32) || defined(_WIN64)
+//実行ファイルのフルパスを取得する
+tstring getExePath();
 
 std::wstring tchar_to_wstring(const tstring& tstr, uint32_t codepage = CP_THREAD_ACP);
 std::wstring tchar_to_wstring(const TCHAR *tstr, uint32_t codepage = CP_THREAD_ACP);
@@ -524,6 +536,29 @@ std::pair<int, std::string> PathRemoveFileSpecFixed(const std::string& path);
 std::string PathRemoveExtensionS(const std::string& path);
 bool CreateDirectoryRecursive(const char *dir);
 
+//読み込み用にファイルをメモリマップする
+class RGYFileMapRead {
+public:
+    RGYFileMapRead();
+    ~RGYFileMapRead();
+    RGY_ERR open(const TCHAR *path);
+    void close();
+    const uint8_t *ptr() const { return m_ptr; }
+    size_t size() const { return m_size; }
+private:
+    RGYFileMapRead(const RGYFileMapRead&) = delete;
+    RGYFileMapRead& operator=(const RGYFileMapRead&) = delete;
+
+    const uint8_t *m_ptr;
+    size_t m_size;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_hFile;
+    HANDLE m_hMap;
+#else
+    int m_fd;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+};
+
 tstring print_time(double time);
 
 static inline uint16_t readUB16(const void *ptr) {
@@ -558,6 +593,17 @@ static inline uint32_t popcnt64(uint64_t bits) {
     return (uint32_t)bits;
 }
 
+//最下位の1のビットの位置を返す (bits != 0 であること)
+static inline uint32_t ctz32(uint32_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, bits);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(bits);
+#endif
+}
+
 template<typename type>
 static std::basic_string<type> repeatStr(std::basic_string<type> str, int count) {
     std::basic_string<type> ret;
@@ -648,6 +694,12 @@ enum {
     RGY_LOG_QUIET = 3,
 };
 
+enum RGYLogMode {
+    RGY_LOG_MODE_SYNC = 0, //書き込むスレッドで書式化して出力する
+    RGY_LOG_MODE_ASYNC,    //書式化と出力をバックグラウンドのスレッドで行う
+    RGY_LOG_MODE_BINARY,   //ログファイルにはバイナリのまま出力する
+};
+
 enum RGY_FRAMETYPE : uint32_t {
     RGY_FRAMETYPE_UNKNOWN = 0,
 
@@ -739,6 +791,7 @@ enum RGY_INPUT_FMT {
     RGY_INPUT_FMT_AVHW,
     RGY_INPUT_FMT_AVSW,
     RGY_INPUT_FMT_AVANY,
+    RGY_INPUT_FMT_SM,
 };
 
 #pragma warning(push)
@@ -1384,6 +1437,25 @@ static const int RGY_OUTPUT_THREAD_AUTO = -1;
 static const int RGY_AUDIO_THREAD_AUTO = -1;
 static const int RGY_INPUT_THREAD_AUTO = -1;
 
+enum RGYInputReadMode {
+    RGY_INPUT_READ_FREAD = 0, //freadでバッファに読み込んでから変換する
+    RGY_INPUT_READ_MMAP,      //ファイルをメモリにマップし、そこから直接変換する
+    RGY_INPUT_READ_DIRECT,    //OSのキャッシュを経由せず、別スレッドで先読みする
+};
+static const int RGY_INPUT_READ_AHEAD_DEFAULT = 4;
+static const int RGY_INPUT_READ_AHEAD_MAX = 64;
+
+//avswでのlibavcodecのスレッドの種類 (FF_THREAD_FRAME, FF_THREAD_SLICEと同じ値)
+enum RGYAVSWThreadType {
+    RGY_AVSW_THREAD_AUTO  = 0, //libavcodecのデフォルト
+    RGY_AVSW_THREAD_FRAME = 1,
+    RGY_AVSW_THREAD_SLICE = 2,
+    RGY_AVSW_THREAD_FRAME_SLICE = RGY_AVSW_THREAD_FRAME | RGY_AVSW_THREAD_SLICE,
+};
+static const int RGY_AVSW_DECODE_AHEAD_DEFAULT = 4;
+static const int RGY_AVSW_DECODE_AHEAD_MAX = 64;
+static const int RGY_AVSW_THREADS_MAX = 64;
+
 typedef struct {
     int start, fin;
 } sTrim;
@@ -1568,6 +1640,13 @@ const CX_DESC list_log_level[] = {
     { NULL, 0 }
 };
 
+const CX_DESC list_log_mode[] = {
+    { _T("sync"),   RGY_LOG_MODE_SYNC   },
+    { _T("async"),  RGY_LOG_MODE_ASYNC  },
+    { _T("binary"), RGY_LOG_MODE_BINARY },
+    { NULL, 0 }
+};
+
 const CX_DESC list_avsync[] = {
     { _T("cfr"),      RGY_AVSYNC_ASSUME_CFR   },
     { _T("vfr"),      RGY_AVSYNC_VFR       },
@@ -1575,6 +1654,21 @@ const CX_DESC list_avsync[] = {
     { NULL, 0 }
 };
 
+const CX_DESC list_input_read_mode[] = {
+    { _T("fread"),  RGY_INPUT_READ_FREAD  },
+    { _T("mmap"),   RGY_INPUT_READ_MMAP   },
+    { _T("direct"), RGY_INPUT_READ_DIRECT },
+    { NULL, 0 }
+};
+
+const CX_DESC list_avsw_thread_type[] = {
+    { _T("auto"),        RGY_AVSW_THREAD_AUTO        },
+    { _T("frame"),       RGY_AVSW_THREAD_FRAME       },
+    { _T("slice"),       RGY_AVSW_THREAD_SLICE       },
+    { _T("frame+slice"), RGY_AVSW_THREAD_FRAME_SLICE },
+    { NULL, 0 }
+};
+
 const CX_DESC list_resampler[] = {
     { _T("swr"),  RGY_RESAMPLER_SWR  },
     { _T("soxr"), RGY_RESAMPLER_SOXR },
@@ -61,6 +61,7 @@ const char *get_encoder_version();
 #define ENABLE_DTL 1
 
 #define ENABLE_NVTX 0
+#define ENABLE_PERF_TRACE 1
 
 #ifdef _M_IX86
 #define ENABLE_NVML 0
@@ -83,6 +84,7 @@ const char *get_encoder_version();
 #define ENABLE_AVISYNTH_READER    0
 #define ENABLE_VAPOURSYNTH_READER 0
 #define ENABLE_AVSW_READER 0
+#define ENABLE_SM_READER          0
 #else
 #define ENCODER_NAME "NVEncC"
 #define DECODER_NAME "cuvid"
@@ -92,6 +94,7 @@ const char *get_encoder_version();
 #define ENABLE_AVISYNTH_READER    1
 #define ENABLE_VAPOURSYNTH_READER 1
 #define ENABLE_AVSW_READER        1
+#define ENABLE_SM_READER          1
 #endif
 
 #endif //__RGY_CONFIG_H__
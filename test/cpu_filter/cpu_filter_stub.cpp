@@ -0,0 +1,86 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2020 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+//cpu版のフィルタのテストではCUDA/OpenCL/ffmpegとWin64用のasmをリンクしないので、
+//それらを使用するソースにある関数のうち、リンクに必要なものだけをここで定義する
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "rgy_util.h"
+#include "cpu_info.h"
+#include "gpu_info.h"
+#include "ram_speed.h"
+
+//cpu_info.cppはWin64用のasmが必要なので、スレッド数の決定に必要なコア数のみ設定する
+bool get_cpu_info(cpu_info_t *cpu_info) {
+    memset(cpu_info, 0, sizeof(cpu_info[0]));
+    cpu_info->logical_cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_info->physical_cores = cpu_info->logical_cores;
+    return true;
+}
+
+cpu_info_t get_cpu_info() {
+    cpu_info_t cpu;
+    get_cpu_info(&cpu);
+    return cpu;
+}
+
+int getCPUInfo(TCHAR *buffer, size_t nSize) {
+    if (nSize > 0) {
+        buffer[0] = _T('\0');
+    }
+    return 1;
+}
+
+std::vector<double> ram_speed_mt_list(int check_size_kilobytes, int mode, bool logical_core) {
+    return std::vector<double>();
+}
+
+//gpu_info.cppはCUDA/OpenCLが必要なので、GPUの情報は取得できないものとする
+int getGPUInfo(const char *VendorName, TCHAR *buffer, unsigned int buffer_size, int device_id, bool driver_version_only, bool use_opencl) {
+    if (buffer_size > 0) {
+        buffer[0] = _T('\0');
+    }
+    return 1;
+}
+
+//rgy_avutil.cpp(ffmpeg)とNVEncUtil.cpp(CUDA)の代わりに、NVEncUtil.cppのffmpeg非使用時の実装と同じものを使う
+#define TTMATH_NOASM
+#include "ttmath/ttmath.h"
+
+int64_t rational_rescale(int64_t v, rgy_rational<int> from, rgy_rational<int> to) {
+    auto mul = rgy_rational<int64_t>((int64_t)from.n() * (int64_t)to.d(), (int64_t)from.d() * (int64_t)to.n());
+    ttmath::Int<2> tmp1 = v;
+    tmp1 *= mul.n();
+    ttmath::Int<2> tmp2 = mul.d();
+
+    tmp1 = (tmp1 + tmp2 - 1) / tmp2;
+    int64_t ret;
+    tmp1.ToInt(ret);
+    return ret;
+}
@@ -0,0 +1,50 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2020 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include "NVEncFilterCpu.h"
+
+//CUDAもWindowsも使わずに、cpu版のフィルタのベンチマーク兼テストを実行する
+//NVEncCの--check-vpp-cpu-bench, --check-afs-cpu-bench, --check-nnedi-cpu-benchと同じ処理
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <vpp|afs|nnedi>\n", argv[0]);
+        return 1;
+    }
+    int ret = 1;
+    if (strcmp(argv[1], "vpp") == 0) {
+        ret = vpp_cpu_bench(stdout);
+    } else if (strcmp(argv[1], "afs") == 0) {
+        ret = afs_cpu_bench(stdout);
+    } else if (strcmp(argv[1], "nnedi") == 0) {
+        ret = nnedi_cpu_bench(stdout);
+    } else {
+        fprintf(stderr, "unknown test: %s\n", argv[1]);
+    }
+    return (ret == 0) ? 0 : 1;
+}